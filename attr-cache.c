@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-lock.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Opt-in cache of attribute values, keyed by the attribute's owner object
+ * (device or channel), index and name. Entries expire after the context's
+ * TTL, and a successful write through the library invalidates the written
+ * attribute, so that values which are static after boot (scale, name,
+ * available-lists...) stop costing one syscall or network round trip per
+ * read. Debug attributes are never cached, as reading them can have side
+ * effects (e.g. direct_reg_access). */
+
+/* Values bigger than this (e.g. huge available-lists) are not cached */
+#define ATTR_CACHE_MAX_LEN 0x1000
+
+struct iio_attr_cache_entry {
+	const void *obj;
+	unsigned int idx;
+	int type;
+	char *name;
+	char *value;
+	size_t len;
+	uint64_t expiry_us;
+};
+
+struct iio_attr_cache {
+	struct iio_mutex *lock;
+	struct iio_attr_cache_entry *entries;
+	size_t nb_entries, nb_allocated;
+};
+
+static bool iio_attr_cache_entry_matches(const struct iio_attr_cache_entry *e,
+					 const void *obj, unsigned int idx,
+					 int type, const char *name)
+{
+	return e->obj == obj && e->idx == idx && e->type == type
+		&& !strcmp(e->name, name);
+}
+
+static void iio_attr_cache_remove(struct iio_attr_cache *cache, size_t i)
+{
+	free(cache->entries[i].name);
+	free(cache->entries[i].value);
+
+	cache->entries[i] = cache->entries[--cache->nb_entries];
+}
+
+static void iio_attr_cache_flush(struct iio_attr_cache *cache)
+{
+	size_t i;
+
+	for (i = 0; i < cache->nb_entries; i++) {
+		free(cache->entries[i].name);
+		free(cache->entries[i].value);
+	}
+
+	cache->nb_entries = 0;
+}
+
+int iio_attr_cache_set_ttl(struct iio_context *ctx, unsigned int ttl_ms)
+{
+	struct iio_attr_cache *cache = ctx->attr_cache;
+	int err;
+
+	if (!cache && ttl_ms) {
+		cache = zalloc(sizeof(*cache));
+		if (!cache)
+			return -ENOMEM;
+
+		cache->lock = iio_mutex_create();
+		err = iio_err(cache->lock);
+		if (err) {
+			free(cache);
+			return err;
+		}
+
+		ctx->attr_cache = cache;
+	}
+
+	/* Changing the TTL (or disabling the cache) drops what was
+	 * cached with the old one. */
+	if (cache) {
+		iio_mutex_lock(cache->lock);
+		iio_attr_cache_flush(cache);
+		iio_mutex_unlock(cache->lock);
+	}
+
+	ctx->attr_cache_ttl_ms = ttl_ms;
+
+	return 0;
+}
+
+void iio_attr_cache_drop(const struct iio_context *ctx)
+{
+	struct iio_attr_cache *cache = ctx->attr_cache;
+
+	if (!cache)
+		return;
+
+	iio_mutex_lock(cache->lock);
+	iio_attr_cache_flush(cache);
+	iio_mutex_unlock(cache->lock);
+}
+
+void iio_attr_cache_destroy(struct iio_context *ctx)
+{
+	struct iio_attr_cache *cache = ctx->attr_cache;
+
+	if (!cache)
+		return;
+
+	iio_attr_cache_flush(cache);
+	iio_mutex_destroy(cache->lock);
+	free(cache->entries);
+	free(cache);
+
+	ctx->attr_cache = NULL;
+}
+
+ssize_t iio_attr_cache_get(const struct iio_context *ctx, const void *obj,
+			   unsigned int idx, int type, const char *name,
+			   char *dst, size_t len)
+{
+	struct iio_attr_cache *cache = ctx->attr_cache;
+	struct iio_attr_cache_entry *e;
+	ssize_t ret = -ENOENT;
+	size_t i;
+
+	if (!cache || !ctx->attr_cache_ttl_ms)
+		return -ENOENT;
+
+	iio_mutex_lock(cache->lock);
+
+	for (i = 0; i < cache->nb_entries; i++) {
+		e = &cache->entries[i];
+
+		if (!iio_attr_cache_entry_matches(e, obj, idx, type, name))
+			continue;
+
+		if (iio_read_counter_us() >= e->expiry_us) {
+			iio_attr_cache_remove(cache, i);
+			break;
+		}
+
+		/* The cached value must fit the caller's buffer entirely,
+		 * otherwise treat it as a miss. */
+		if (e->len > len)
+			break;
+
+		memcpy(dst, e->value, e->len);
+		ret = (ssize_t) e->len;
+		break;
+	}
+
+	iio_mutex_unlock(cache->lock);
+
+	return ret;
+}
+
+void iio_attr_cache_store(const struct iio_context *ctx, const void *obj,
+			  unsigned int idx, int type, const char *name,
+			  const char *value, size_t len)
+{
+	struct iio_attr_cache *cache = ctx->attr_cache;
+	struct iio_attr_cache_entry *e = NULL, *entries;
+	char *name_dup, *value_dup;
+	size_t i, nb;
+
+	if (!cache || !ctx->attr_cache_ttl_ms || !len
+	    || len > ATTR_CACHE_MAX_LEN)
+		return;
+
+	value_dup = malloc(len);
+	if (!value_dup)
+		return;
+
+	memcpy(value_dup, value, len);
+
+	iio_mutex_lock(cache->lock);
+
+	for (i = 0; i < cache->nb_entries; i++) {
+		if (iio_attr_cache_entry_matches(&cache->entries[i],
+						 obj, idx, type, name)) {
+			e = &cache->entries[i];
+			free(e->value);
+			break;
+		}
+	}
+
+	if (!e) {
+		if (cache->nb_entries == cache->nb_allocated) {
+			nb = cache->nb_allocated ? cache->nb_allocated * 2 : 32;
+
+			entries = realloc(cache->entries,
+					  nb * sizeof(*entries));
+			if (!entries)
+				goto out_drop;
+
+			cache->entries = entries;
+			cache->nb_allocated = nb;
+		}
+
+		name_dup = iio_strdup(name);
+		if (!name_dup)
+			goto out_drop;
+
+		e = &cache->entries[cache->nb_entries++];
+		e->obj = obj;
+		e->idx = idx;
+		e->type = type;
+		e->name = name_dup;
+	}
+
+	e->value = value_dup;
+	e->len = len;
+	e->expiry_us = iio_read_counter_us()
+		+ (uint64_t) ctx->attr_cache_ttl_ms * 1000;
+
+	iio_mutex_unlock(cache->lock);
+	return;
+
+out_drop:
+	iio_mutex_unlock(cache->lock);
+	free(value_dup);
+}
+
+void iio_attr_cache_invalidate(const struct iio_context *ctx, const void *obj,
+			       unsigned int idx, int type, const char *name)
+{
+	struct iio_attr_cache *cache = ctx->attr_cache;
+	size_t i;
+
+	if (!cache)
+		return;
+
+	iio_mutex_lock(cache->lock);
+
+	for (i = 0; i < cache->nb_entries; i++) {
+		if (iio_attr_cache_entry_matches(&cache->entries[i],
+						 obj, idx, type, name)) {
+			iio_attr_cache_remove(cache, i);
+			break;
+		}
+	}
+
+	iio_mutex_unlock(cache->lock);
+}
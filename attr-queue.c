@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-lock.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Write-behind queue for fire-and-forget attribute writes. Queued writes
+ * copy the attribute name and value and return immediately; the flush
+ * call pushes the whole queue through iio_attrs_write_bulk(), so over the
+ * network a burst of writes costs a single round trip instead of one
+ * each. Errors are reported at the flush, which acts as the barrier. */
+
+struct iio_attr_queue {
+	struct iio_mutex *lock;
+	struct iio_bulk_attr *attrs;
+	size_t nb_entries, nb_allocated;
+};
+
+struct iio_attr_queue * iio_attr_queue_create(void)
+{
+	struct iio_attr_queue *queue;
+	int err;
+
+	queue = zalloc(sizeof(*queue));
+	if (!queue)
+		return NULL;
+
+	queue->lock = iio_mutex_create();
+	err = iio_err(queue->lock);
+	if (err) {
+		free(queue);
+		return NULL;
+	}
+
+	return queue;
+}
+
+static void iio_attr_queue_free_entries(struct iio_bulk_attr *attrs,
+					size_t nb)
+{
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		free((char *) attrs[i].attr);
+		free(attrs[i].value);
+	}
+
+	free(attrs);
+}
+
+void iio_attr_queue_destroy(struct iio_context *ctx)
+{
+	struct iio_attr_queue *queue = ctx->attr_queue;
+
+	if (!queue)
+		return;
+
+	/* Writes still queued at this point are discarded */
+	iio_attr_queue_free_entries(queue->attrs, queue->nb_entries);
+	iio_mutex_destroy(queue->lock);
+	free(queue);
+
+	ctx->attr_queue = NULL;
+}
+
+int iio_attr_write_async(const struct iio_bulk_attr *attr)
+{
+	struct iio_attr_queue *queue;
+	struct iio_bulk_attr *entry, *attrs;
+	size_t new_nb;
+	int ret = -ENOMEM;
+
+	if (!attr || !attr->dev || !attr->attr || !attr->value || !attr->len)
+		return -EINVAL;
+
+	queue = attr->dev->ctx->attr_queue;
+
+	iio_mutex_lock(queue->lock);
+
+	if (queue->nb_entries == queue->nb_allocated) {
+		new_nb = queue->nb_allocated ? queue->nb_allocated * 2 : 16;
+
+		attrs = realloc(queue->attrs, new_nb * sizeof(*attrs));
+		if (!attrs)
+			goto out_unlock;
+
+		queue->attrs = attrs;
+		queue->nb_allocated = new_nb;
+	}
+
+	entry = &queue->attrs[queue->nb_entries];
+	*entry = *attr;
+	entry->ret = 0;
+
+	entry->attr = iio_strdup(attr->attr);
+	if (!entry->attr)
+		goto out_unlock;
+
+	entry->value = malloc(attr->len);
+	if (!entry->value) {
+		free((char *) entry->attr);
+		goto out_unlock;
+	}
+
+	memcpy(entry->value, attr->value, attr->len);
+
+	queue->nb_entries++;
+	ret = 0;
+
+out_unlock:
+	iio_mutex_unlock(queue->lock);
+	return ret;
+}
+
+int iio_attrs_write_flush(const struct iio_context *ctx)
+{
+	struct iio_attr_queue *queue = ctx->attr_queue;
+	struct iio_bulk_attr *attrs;
+	size_t i, nb;
+	int ret;
+
+	/* Steal the queued entries, so that writes queued while the flush
+	 * is in flight simply wait for the next one. */
+	iio_mutex_lock(queue->lock);
+	attrs = queue->attrs;
+	nb = queue->nb_entries;
+	queue->attrs = NULL;
+	queue->nb_entries = 0;
+	queue->nb_allocated = 0;
+	iio_mutex_unlock(queue->lock);
+
+	if (!nb)
+		return 0;
+
+	ret = iio_attrs_write_bulk(attrs, nb);
+
+	for (i = 0; !ret && i < nb; i++) {
+		if (attrs[i].ret < 0)
+			ret = (int) attrs[i].ret;
+	}
+
+	iio_attr_queue_free_entries(attrs, nb);
+
+	return ret;
+}
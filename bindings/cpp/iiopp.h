@@ -21,11 +21,25 @@
 #include <boost/optional.hpp>
 #else
 #include <optional>
+#include <string_view>
+#endif
+
+#if defined(__has_include)
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <functional>
+#include <cerrno>
+#define IIOPP_HAVE_COROUTINES 1
+#endif
 #endif
 #include <stdexcept>
 #include <system_error>
 #include <cassert>
 #include <memory>
+#include <type_traits>
 
 /** @brief Public C++ API
  *
@@ -65,6 +79,7 @@ using std::optional;
 class Context;
 class Device;
 class Buffer;
+template <typename T> class TypedChannel;
 
 /** @brief Non-owning immutable null terminated string
  *
@@ -110,6 +125,29 @@ public:
     virtual void write_double(double val) = 0;
     virtual void write_longlong(long long val) = 0;
 
+#if __cplusplus >= 201703L
+    /** @brief Reads the attribute into a caller-provided buffer and returns a view of the value
+     *
+     * Does not allocate; the view points into @p dst.
+     */
+    std::string_view read_view(char * dst, size_t size) const // Flawfinder: ignore
+    {
+        read(dst, size); // Flawfinder: ignore
+        return std::string_view(dst);
+    }
+
+    /** @brief Reads the attribute into a thread-local arena and returns a view of the value
+     *
+     * Does not allocate. The view stays valid until the next @c read_view() call without
+     * arguments on the same thread.
+     */
+    std::string_view read_view() const
+    {
+        thread_local char buf[1024]; // Flawfinder: ignore
+        return read_view(buf, sizeof(buf));
+    }
+#endif
+
     operator bool () const {return read_bool();}
     operator double () const {return read_double();}
     operator long long () const {return read_longlong();}
@@ -358,6 +396,9 @@ public:
     void convert_inverse(void * dst, void const * src) const {iio_channel_convert_inverse(p, dst, src);}
     iio_data_format const * data_format() const {return iio_channel_get_data_format(p);}
     unsigned long index() const { return impl::check_n(iio_channel_get_index(p), "iio_channel_get_index");}
+
+    /** @brief Typed view of this channel, see @ref TypedChannel */
+    template <typename T> TypedChannel<T> typed() const;
 };
 
 /** @brief C++ wrapper for the @ref Buffer C-API
@@ -387,8 +428,242 @@ public:
     void set_data(void * data){iio_buffer_set_data(p, data);}
     void * start() {return iio_buffer_start(p);}
     ptrdiff_t step() const {return iio_buffer_step(p);}
+
+#ifdef __cpp_lib_span
+    /** @brief Typed view of the samples between @c start() and @c end()
+     *
+     * Zero-copy access to the raw buffer contents. With a single enabled channel the
+     * span is one contiguous run of that channel's samples; with several enabled
+     * channels the samples are interleaved with a distance of @c step() bytes.
+     */
+    template <typename T>
+    std::span<T const> samples()
+    {
+        char const * const b = static_cast<char const *>(iio_buffer_start(p));
+        char const * const e = static_cast<char const *>(iio_buffer_end(p));
+        return {reinterpret_cast<T const *>(b), static_cast<size_t>(e - b) / sizeof(T)};
+    }
+#endif
 };
 
+/** @brief Channel whose sample type is checked once, at construction
+ *
+ * Validates the channel's @ref iio_data_format against @a T (storage size,
+ * signedness, endianness) up front, so that the per-sample accessors below are
+ * plain inlined loads and stores with no checks left: the compiler can
+ * vectorize loops over @ref samples(), which the void-pointer interface of
+ * @ref Buffer prevents.
+ *
+ * The samples are exposed raw, exactly as stored in the buffer; use
+ * @ref Channel::convert for channels that need shifting, masking or scaling.
+ */
+template <typename T>
+class TypedChannel
+{
+    static_assert(std::is_integral<T>::value, "IIO samples are raw integers");
+
+    iio_channel * const p;
+public:
+
+    TypedChannel() = delete;
+
+    /** @brief Wraps @p chan, throwing @ref error if its data format does not match @a T */
+    explicit TypedChannel(Channel chan) : p(chan)
+    {
+        iio_data_format const * const f = chan.data_format();
+
+        if (f->length != sizeof(T) * 8 || f->repeat > 1)
+            impl::err(EINVAL, "channel storage length does not match sample type");
+        if (!!f->is_signed != std::is_signed<T>::value)
+            impl::err(EINVAL, "channel signedness does not match sample type");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        if (sizeof(T) > 1 && !f->is_be)
+#else
+        if (sizeof(T) > 1 && f->is_be)
+#endif
+            impl::err(EINVAL, "channel endianness does not match host");
+    }
+
+    operator iio_channel * () const {return p;}
+    Channel channel() const {return Channel(p);}
+
+    /** @brief Strided view over this channel's samples within a buffer
+     *
+     * Iteration and indexing step by the buffer's sample distance, so the view
+     * is valid whether the channel's samples are contiguous (single enabled
+     * channel) or interleaved with other channels.
+     */
+    class Samples
+    {
+        char * const _first;
+        ptrdiff_t const _step;
+        size_t const _count;
+    public:
+        Samples(char * first, ptrdiff_t step, size_t count) : _first(first), _step(step), _count(count){}
+
+        /** @brief Random access iterator stepping from one sample to the next */
+        class Iterator
+        {
+            char * ptr;
+            ptrdiff_t step;
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef T *pointer;
+            typedef T &reference;
+            Iterator(char * p, ptrdiff_t s) : ptr(p), step(s){}
+
+            T & operator*() const {return *reinterpret_cast<T *>(ptr);}
+            Iterator& operator++() {ptr += step; return *this;}
+            Iterator operator++(int) {Iterator tmp = *this; ptr += step; return tmp;}
+            bool operator == (const Iterator& rhs) const {return ptr == rhs.ptr;}
+            bool operator != (const Iterator& rhs) const {return ptr != rhs.ptr;}
+            bool operator < (const Iterator& rhs) const {return ptr < rhs.ptr;}
+            bool operator > (const Iterator& rhs) const {return ptr > rhs.ptr;}
+            bool operator <= (const Iterator& rhs) const {return ptr <= rhs.ptr;}
+            bool operator >= (const Iterator& rhs) const {return ptr >= rhs.ptr;}
+            Iterator operator + (ssize_t x) const {return Iterator(ptr + x * step, step);}
+            ssize_t operator - (Iterator rhs) const {return (ptr - rhs.ptr) / step;}
+        };
+
+        size_t size() const {return _count;}
+        bool empty() const {return !_count;}
+
+        T & operator [](size_t i) const
+        {
+            assert(i < _count);
+            return *reinterpret_cast<T *>(_first + static_cast<ptrdiff_t>(i) * _step);
+        }
+
+        Iterator begin() const {return Iterator(_first, _step);}
+        Iterator end() const {return Iterator(_first + static_cast<ptrdiff_t>(_count) * _step, _step);}
+
+        /** @brief @c true when the samples form one contiguous run */
+        bool contiguous() const {return _step == sizeof(T);}
+
+#ifdef __cpp_lib_span
+        /** @brief Contiguous span over the samples
+         *
+         * Only valid when this channel is the only enabled one (@ref contiguous()
+         * returns @c true); throws @ref error otherwise.
+         */
+        std::span<T> span() const
+        {
+            if (!contiguous())
+                impl::err(EINVAL, "channel samples are interleaved");
+            return {reinterpret_cast<T *>(_first), _count};
+        }
+#endif
+    };
+
+    /** @brief View of this channel's samples in @p buffer */
+    Samples samples(Buffer buffer) const
+    {
+        char * const first = static_cast<char *>(iio_buffer_first(buffer, p));
+        char * const end = static_cast<char *>(iio_buffer_end(buffer));
+        ptrdiff_t const step = iio_buffer_step(buffer);
+        size_t const count = first < end
+            ? static_cast<size_t>((end - first + step - 1) / step) : 0;
+
+        return Samples(first, step, count);
+    }
+};
+
+#ifdef IIOPP_HAVE_COROUTINES
+
+/** @brief C++20 coroutine adapter for streaming from a @ref Buffer
+ *
+ * Layers iio streaming over an external event loop, so that no thread has to be
+ * dedicated to the stream. The buffer is switched to non-blocking mode, and whenever
+ * a refill would block, the awaiter suspends the coroutine and hands the buffer's
+ * poll fd together with the coroutine handle to the user-provided @c wait_readable
+ * callback. The callback registers the fd with the application's executor (asio,
+ * io_uring, epoll...) and resumes the handle once the fd becomes readable.
+ *
+ * Usage:
+ * @code
+ * iiopp::AsyncBufferStream stream(buffer, [&](int fd, std::coroutine_handle<> h) {
+ *     // e.g. asio: wait for fd to become readable, then call h.resume()
+ * });
+ * for (;;)
+ * {
+ *     size_t bytes = co_await stream.next_block();
+ *     // process stream.buffer() contents
+ * }
+ * @endcode
+ */
+class AsyncBufferStream
+{
+public:
+    /** @brief Callback registering @c fd with the executor and resuming @c h when readable */
+    typedef std::function<void(int fd, std::coroutine_handle<> h)> WaitReadable;
+
+    AsyncBufferStream(Buffer buf, WaitReadable wait_readable)
+        : _buf(buf), _wait(std::move(wait_readable)), _fd(buf.poll_fd())
+    {
+        _buf.set_blocking_mode(false);
+    }
+
+    Buffer buffer() {return _buf;}
+
+    /** @brief Awaitable that completes once the next block of samples is available
+     *
+     * @c co_await returns the number of bytes refilled, or throws @ref error.
+     */
+    auto next_block()
+    {
+        struct Awaiter
+        {
+            AsyncBufferStream & s;
+            size_t bytes = 0;
+
+            bool try_refill()
+            {
+                ssize_t const n = iio_buffer_refill(s._buf);
+                if (n == -EAGAIN)
+                    return false;
+                bytes = impl::check_n(n, "iio_buffer_refill");
+                return true;
+            }
+
+            bool await_ready() {return try_refill();}
+
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                // Retry before registering, to not lose a block that completed
+                // between await_ready() and here
+                if (try_refill())
+                    return false;
+                s._wait(s._fd, h);
+                return true;
+            }
+
+            size_t await_resume()
+            {
+                if (!bytes && !try_refill())
+                {
+                    // Spurious wakeup: fall back to one blocking refill rather
+                    // than busy-waiting on the fd
+                    s._buf.set_blocking_mode(true);
+                    bytes = s._buf.refill();
+                    s._buf.set_blocking_mode(false);
+                }
+                return bytes;
+            }
+        };
+
+        return Awaiter{*this};
+    }
+
+private:
+    Buffer _buf;
+    WaitReadable _wait;
+    int _fd;
+};
+
+#endif // IIOPP_HAVE_COROUTINES
+
 /** @brief C++ wrapper for the @ref Device C-API
  */
 class Device : public impl::IndexedSequence<Device, Channel>
@@ -597,6 +872,7 @@ inline size_t Channel::read(Buffer buffer, void * dst, size_t len) const {return
 inline size_t Channel::read_raw(Buffer buffer, void * dst, size_t len) const {return iio_channel_read_raw(p, buffer, dst, len);}
 inline size_t Channel::write(Buffer buffer, void const * src, size_t len) {return iio_channel_write(p, buffer, src, len);}
 inline size_t Channel::write_raw(Buffer buffer, void const * src, size_t len) {return iio_channel_write_raw(p, buffer, src, len);}
+template <typename T> inline TypedChannel<T> Channel::typed() const {return TypedChannel<T>(Channel(p));}
 
 namespace impl
 {
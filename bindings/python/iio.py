@@ -23,6 +23,7 @@ from ctypes import (
     c_size_t,
     c_ssize_t,
     c_char,
+    c_ubyte,
     c_void_p,
     c_bool,
     create_string_buffer,
@@ -983,6 +984,25 @@ class Channel(_IIO_Object):
         """
         return _channel_get_data_format(self._channel).contents
 
+    @property
+    def dtype(self):
+        """
+        NumPy-compatible dtype string derived from the channel's data format,
+        e.g. '<i2' for a 16-bit signed little-endian sample.
+        type: str
+
+        Pass it to numpy.frombuffer() together with Block.view() to process
+        samples without copies. Note that the samples still carry the
+        hardware layout: apply DataFormat.shift and mask to DataFormat.bits
+        when the storage is not fully used.
+        """
+        dataformat = self.data_format
+        return "%s%s%u" % (
+            ">" if dataformat.is_be else "<",
+            "i" if dataformat.is_signed else "u",
+            dataformat.length // 8,
+        )
+
     @property
     def modifier(self):
         """
@@ -1070,6 +1090,26 @@ class Block(_IIO_Object):
         _memmove(c_array, start, len(array))
         return array
 
+    def view(self):
+        """
+        Map the samples contained inside the Block object, without copies.
+
+        returns: type=memoryview
+            A writable view of the block's sample memory
+
+        The view is backed by the block's DMA memory directly, so
+        numpy.frombuffer(block.view(), dtype=channel.dtype) processes the
+        samples in place. It stays valid until the block is enqueued or
+        destroyed; accessing it while the block is enqueued is undefined.
+        """
+        if self.enqueued:
+            raise OSError(16, "Cannot map an enqueued block.")
+
+        start = _block_start(self._block)
+        end = _block_end(self._block)
+        mytype = c_ubyte * (end - start)
+        return memoryview(mytype.from_address(start)).cast("B")
+
     def write(self, array):
         """
         Copy the given array of samples inside the Block object.
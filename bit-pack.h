@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __IIO_BIT_PACK_H__
+#define __IIO_BIT_PACK_H__
+
+#include <iio/iio.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Bit-packing codec for padded sample formats (e.g. 12-bit samples in
+ * 16-bit slots): only the "bits" valuable bits of each "length"-bit
+ * sample cross the wire, dropping the zero padding. Both ends derive
+ * the packed size from the raw size, so the stream needs no extra
+ * framing. Shared between iiod-client.c and iiod/responder.c.
+ *
+ * Samples pass through verbatim as bit patterns; sign extension and
+ * shifting remain the consumer's job, as with raw transfers. A
+ * trailing partial sample, if any, is appended unpacked. */
+
+/* True if "fmt" can be packed, and matches the parameters already
+ * collected from the other enabled channels (*length == 0 on the first
+ * call). All enabled channels must agree for the codec to engage. */
+static inline bool iio_pack_format_ok(const struct iio_data_format *fmt,
+				      unsigned int *bits,
+				      unsigned int *length,
+				      unsigned int *shift)
+{
+	if (fmt->is_be || fmt->repeat > 1)
+		return false;
+
+	if (fmt->bits >= fmt->length || fmt->bits > 32)
+		return false;
+
+	if (fmt->length != 16 && fmt->length != 32 && fmt->length != 64)
+		return false;
+
+	if (*length && (fmt->bits != *bits || fmt->length != *length ||
+			fmt->shift != *shift))
+		return false;
+
+	*bits = fmt->bits;
+	*length = fmt->length;
+	*shift = fmt->shift;
+
+	return true;
+}
+
+static inline size_t iio_packed_size(size_t len, unsigned int bits,
+				     unsigned int length)
+{
+	size_t nb = len / (length / 8);
+
+	return (nb * bits + 7) / 8 + (len - nb * (length / 8));
+}
+
+static inline void iio_pack_samples(uint8_t *dst, const uint8_t *src,
+				    size_t len, unsigned int bits,
+				    unsigned int length, unsigned int shift)
+{
+	uint64_t acc = 0, val, mask = ((uint64_t) 1 << bits) - 1;
+	unsigned int j, nbits = 0, wsize = length / 8;
+	size_t i, nb = len / wsize;
+
+	for (i = 0; i < nb; i++) {
+		for (val = 0, j = 0; j < wsize; j++)
+			val |= (uint64_t) src[j] << (8 * j);
+
+		acc |= ((val >> shift) & mask) << nbits;
+		nbits += bits;
+
+		while (nbits >= 8) {
+			*dst++ = (uint8_t) acc;
+			acc >>= 8;
+			nbits -= 8;
+		}
+
+		src += wsize;
+	}
+
+	if (nbits)
+		*dst++ = (uint8_t) acc;
+
+	memcpy(dst, src, len - nb * wsize);
+}
+
+/* The inverse transform; "len" is the size of the raw data to
+ * reconstruct, the packed input being iio_packed_size(len) bytes. */
+static inline void iio_unpack_samples(uint8_t *dst, const uint8_t *src,
+				      size_t len, unsigned int bits,
+				      unsigned int length, unsigned int shift)
+{
+	uint64_t acc = 0, val, mask = ((uint64_t) 1 << bits) - 1;
+	unsigned int j, nbits = 0, wsize = length / 8;
+	size_t i, nb = len / wsize;
+
+	for (i = 0; i < nb; i++) {
+		while (nbits < bits) {
+			acc |= (uint64_t) *src++ << nbits;
+			nbits += 8;
+		}
+
+		val = (acc & mask) << shift;
+		acc >>= bits;
+		nbits -= bits;
+
+		for (j = 0; j < wsize; j++)
+			dst[j] = (uint8_t) (val >> (8 * j));
+
+		dst += wsize;
+	}
+
+	memcpy(dst, src, len - nb * wsize);
+}
+
+#endif /* __IIO_BIT_PACK_H__ */
@@ -7,25 +7,126 @@
  */
 
 #include "iio-private.h"
+#include "iio-trace.h"
 
 #include <errno.h>
 #include <iio/iio-lock.h>
 #include <stdbool.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Segments are page-aligned and at most this big, so that giant blocks
+ * never depend on a large contiguous virtual allocation succeeding. */
+#define BLOCK_SEGMENT_ALIGN	4096
+#define BLOCK_SEGMENT_SIZE	(4 * 1024 * 1024)
+
 struct iio_block {
 	struct iio_buffer *buffer;
 	struct iio_block_pdata *pdata;
 	size_t size;
 	void *data;
 
+	/* Segment list; points to "seg" when the block is contiguous */
+	struct iio_block_segment *segments;
+	size_t nb_segments;
+	struct iio_block_segment seg;
+
 	struct iio_task_token *token, *old_token;
 	size_t bytes_used;
 	bool cyclic;
+	bool arena; /* data carved from the buffer's arena */
+
+	/* Enqueue timestamp and payload size, for the buffer's stats */
+	uint64_t enqueue_time_us;
+	size_t stats_bytes;
+
+	/* Monotonic timestamp of the last completed transfer, taken as
+	 * close to the device read/write completion as the backend
+	 * allows; see iio_block_get_timestamp(). */
+	uint64_t capture_time_us;
 };
 
-struct iio_block *
-iio_buffer_create_block(struct iio_buffer *buf, size_t size)
+static void *iio_block_segment_alloc(size_t len)
+{
+#ifdef _WIN32
+	return _aligned_malloc(len, BLOCK_SEGMENT_ALIGN);
+#else
+	void *ptr;
+
+	if (posix_memalign(&ptr, BLOCK_SEGMENT_ALIGN, len))
+		return NULL;
+
+	return ptr;
+#endif
+}
+
+static void iio_block_segment_free(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+static void iio_block_free_segments(struct iio_block *block)
+{
+	size_t i;
+
+	for (i = 0; i < block->nb_segments; i++)
+		iio_block_segment_free(block->segments[i].data);
+	free(block->segments);
+}
+
+static int iio_block_alloc_segments(struct iio_block *block, size_t size)
+{
+	size_t i, len, nb;
+
+	nb = (size + BLOCK_SEGMENT_SIZE - 1) / BLOCK_SEGMENT_SIZE;
+
+	block->segments = calloc(nb, sizeof(*block->segments));
+	if (!block->segments)
+		return -ENOMEM;
+
+	for (i = 0; i < nb; i++) {
+		len = size > BLOCK_SEGMENT_SIZE ? BLOCK_SEGMENT_SIZE : size;
+
+		block->segments[i].data = iio_block_segment_alloc(len);
+		if (!block->segments[i].data) {
+			iio_block_free_segments(block);
+			block->segments = NULL;
+			return -ENOMEM;
+		}
+
+		block->segments[i].len = len;
+		block->nb_segments++;
+		size -= len;
+	}
+
+	return 0;
+}
+
+static uint64_t block_counter_us(void)
+{
+#ifdef _WIN32
+	return (uint64_t) GetTickCount64() * 1000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000;
+#endif
+}
+
+static struct iio_block *
+iio_buffer_do_create_block(struct iio_buffer *buf, size_t size,
+			   bool allow_segments)
 {
 	const struct iio_device *dev = buf->dev;
 	const struct iio_backend_ops *ops = dev->ctx->ops;
@@ -52,10 +153,24 @@ iio_buffer_create_block(struct iio_buffer *buf, size_t size)
 	}
 
 	if (!block->pdata) {
-		block->data = malloc(size);
+		block->data = iio_buffer_arena_alloc(buf, size);
+		block->arena = !!block->data;
+
+		if (!block->data)
+			block->data = malloc(size);
 		if (!block->data) {
+			/* The contiguous allocation failed; fall back to
+			 * page-aligned segments, but only when the caller
+			 * asked for them: segmented blocks have a NULL
+			 * iio_block_start(), which callers unaware of the
+			 * segment API would treat as an empty block. */
 			ret = -ENOMEM;
-			goto err_free_block;
+			if (!allow_segments)
+				goto err_free_block;
+
+			ret = iio_block_alloc_segments(block, size);
+			if (ret)
+				goto err_free_block;
 		}
 
 		if (size > buf->length)
@@ -64,6 +179,13 @@ iio_buffer_create_block(struct iio_buffer *buf, size_t size)
 		buf->block_size = size;
 	}
 
+	if (!block->segments) {
+		block->seg.data = block->data;
+		block->seg.len = size;
+		block->segments = &block->seg;
+		block->nb_segments = 1;
+	}
+
 	block->buffer = buf;
 	block->size = size;
 
@@ -78,6 +200,18 @@ err_free_block:
 	return iio_ptr(ret);
 }
 
+struct iio_block *
+iio_buffer_create_block(struct iio_buffer *buf, size_t size)
+{
+	return iio_buffer_do_create_block(buf, size, false);
+}
+
+struct iio_block *
+iio_buffer_create_block_segmented(struct iio_buffer *buf, size_t size)
+{
+	return iio_buffer_do_create_block(buf, size, true);
+}
+
 void iio_block_destroy(struct iio_block *block)
 {
 	struct iio_buffer *buf = block->buffer;
@@ -92,6 +226,10 @@ void iio_block_destroy(struct iio_block *block)
 	}
 	if (ops->free_block && block->pdata)
 		ops->free_block(block->pdata);
+	else if (block->arena)
+		iio_buffer_arena_free(buf, block->data);
+	else if (block->segments != &block->seg)
+		iio_block_free_segments(block);
 	else
 		free(block->data);
 	free(block);
@@ -110,7 +248,31 @@ iio_block_write(struct iio_block *block, size_t bytes_used)
 	if (!ops->writebuf)
 		return -ENOSYS;
 
+	if (block->segments != &block->seg) {
+		const struct iio_block_segment *seg;
+		size_t i, len;
+
+		for (i = 0; i < block->nb_segments && bytes_used; i++) {
+			seg = &block->segments[i];
+			len = bytes_used < seg->len ? bytes_used : seg->len;
+
+			ret = ops->writebuf(block->buffer->pdata,
+					    seg->data, len);
+			if (ret < 0)
+				return (int) ret;
+
+			bytes_used -= ret;
+			if ((size_t) ret < len)
+				break;
+		}
+
+		block->capture_time_us = block_counter_us();
+		return 0;
+	}
+
 	ret = ops->writebuf(block->buffer->pdata, block->data, bytes_used);
+	if (ret >= 0)
+		block->capture_time_us = block_counter_us();
 	return ret < 0 ? (int) ret : 0;
 }
 
@@ -122,7 +284,28 @@ static int iio_block_read(struct iio_block *block)
 	if (!ops->readbuf)
 		return -ENOSYS;
 
+	if (block->segments != &block->seg) {
+		const struct iio_block_segment *seg;
+		size_t i;
+
+		for (i = 0; i < block->nb_segments; i++) {
+			seg = &block->segments[i];
+
+			ret = ops->readbuf(block->buffer->pdata,
+					   seg->data, seg->len);
+			if (ret < 0)
+				return (int) ret;
+			if ((size_t) ret < seg->len)
+				break;
+		}
+
+		block->capture_time_us = block_counter_us();
+		return 0;
+	}
+
 	ret = ops->readbuf(block->buffer->pdata, block->data, block->size);
+	if (ret >= 0)
+		block->capture_time_us = block_counter_us();
 	return ret < 0 ? (int) ret : 0;
 }
 
@@ -144,12 +327,22 @@ int iio_block_io(struct iio_block *block)
 
 int iio_block_enqueue(struct iio_block *block, size_t bytes_used, bool cyclic)
 {
-	const struct iio_buffer *buffer = block->buffer;
+	struct iio_buffer *buffer = block->buffer;
 	const struct iio_device *dev = buffer->dev;
 	const struct iio_backend_ops *ops = dev->ctx->ops;
+	int ret;
+
+	iio_trace3(block_enqueue, block, bytes_used, cyclic);
 
-	if (ops->enqueue_block && block->pdata)
-		return ops->enqueue_block(block->pdata, bytes_used, cyclic);
+	block->enqueue_time_us = block_counter_us();
+	block->stats_bytes = bytes_used ? bytes_used : block->size;
+
+	if (ops->enqueue_block && block->pdata) {
+		ret = ops->enqueue_block(block->pdata, bytes_used, cyclic);
+		if (!ret)
+			iio_buffer_stats_enqueued(buffer);
+		return ret;
+	}
 
 	if (block->token) {
 		/* Already enqueued */
@@ -160,7 +353,11 @@ int iio_block_enqueue(struct iio_block *block, size_t bytes_used, bool cyclic)
 	block->cyclic = cyclic;
 	block->token = iio_task_enqueue(buffer->worker, block);
 
-	return iio_err(block->token);
+	ret = iio_err(block->token);
+	if (!ret)
+		iio_buffer_stats_enqueued(buffer);
+
+	return ret;
 }
 
 int iio_block_dequeue(struct iio_block *block, bool nonblock)
@@ -168,9 +365,27 @@ int iio_block_dequeue(struct iio_block *block, bool nonblock)
 	struct iio_buffer *buffer = block->buffer;
 	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
 	struct iio_task_token *token;
+	int ret;
 
-	if (ops->dequeue_block && block->pdata)
-		return ops->dequeue_block(block->pdata, nonblock);
+	if (ops->dequeue_block && block->pdata) {
+		ret = ops->dequeue_block(block->pdata, nonblock);
+		iio_trace2(block_dequeue, block, ret);
+		if (ret != -EBUSY) {
+			if (ret >= 0)
+				block->capture_time_us = block_counter_us();
+
+			/* A loss-tolerant transfer (UDP streaming mode)
+			 * reports how many payload bytes made it */
+			if (ret > 0 && (size_t) ret < block->size &&
+			    !iio_device_is_tx(buffer->dev))
+				iio_buffer_stats_lost(buffer,
+						block->size - (size_t) ret);
+			iio_buffer_stats_complete(buffer,
+					block_counter_us() - block->enqueue_time_us,
+					block->stats_bytes, ret);
+		}
+		return ret;
+	}
 
 	iio_mutex_lock(buffer->lock);
 	token = block->token;
@@ -188,7 +403,13 @@ int iio_block_dequeue(struct iio_block *block, bool nonblock)
 		return -EPERM;
 	}
 
-	return iio_task_sync(token, 0);
+	ret = iio_task_sync(token, 0);
+	iio_trace2(block_dequeue, block, ret);
+	iio_buffer_stats_complete(buffer,
+				  block_counter_us() - block->enqueue_time_us,
+				  block->stats_bytes, ret);
+
+	return ret;
 }
 
 void *iio_block_start(const struct iio_block *block)
@@ -196,11 +417,32 @@ void *iio_block_start(const struct iio_block *block)
 	return block->data;
 }
 
+int iio_block_get_dmabuf_fd(const struct iio_block *block)
+{
+	const struct iio_backend_ops *ops = block->buffer->dev->ctx->ops;
+
+	if (!block->pdata || !ops->get_dmabuf_fd)
+		return -ENOSYS;
+
+	return ops->get_dmabuf_fd(block->pdata);
+}
+
 void *iio_block_end(const struct iio_block *block)
 {
+	if (!block->data)
+		return NULL;
+
 	return (void *) ((uintptr_t) block->data + block->size);
 }
 
+size_t iio_block_get_segments(const struct iio_block *block,
+			      const struct iio_block_segment **segments)
+{
+	*segments = block->segments;
+
+	return block->nb_segments;
+}
+
 void *iio_block_first(const struct iio_block *block,
 		      const struct iio_channel *chn)
 {
@@ -211,10 +453,17 @@ void *iio_block_first(const struct iio_block *block,
 	unsigned int i;
 	size_t len;
 
+	if (!block->data)
+		return NULL;
+
 	/* Test if the block has samples for this channel */
 	if (!iio_channels_mask_test_bit(buf->mask, chn->number))
 		return iio_block_end(block);
 
+	/* Use the precomputed demux plan if the buffer has one */
+	if (buf->demux_offsets)
+		return (void *)(ptr + buf->demux_offsets[chn->number]);
+
 	for (i = 0; i < dev->nb_channels; i++) {
 		cur = dev->channels[i];
 		len = cur->format.length / 8 * cur->format.repeat;
@@ -256,6 +505,9 @@ iio_block_foreach_sample(const struct iio_block *block,
 	size_t sample_size;
 	ssize_t processed = 0;
 
+	if (!block->data)
+		return -EINVAL;
+
 	sample_size = iio_device_get_sample_size(dev, buf->mask);
 	if (sample_size == 0)
 		return -EINVAL;
@@ -296,7 +548,61 @@ iio_block_foreach_sample(const struct iio_block *block,
 	return processed;
 }
 
+ssize_t
+iio_block_foreach_chunk(const struct iio_block *block,
+			const struct iio_channels_mask *mask,
+			ssize_t (*callback)(const struct iio_channel *,
+					    void *, size_t, size_t, void *),
+			void *d)
+{
+	const struct iio_buffer *buf = block->buffer;
+	const struct iio_device *dev = buf->dev;
+	size_t sample_size, nb_samples;
+	ssize_t processed = 0, ret;
+	unsigned int i;
+
+	if (!block->data)
+		return -EINVAL;
+
+	sample_size = iio_device_get_sample_size(dev, buf->mask);
+	if (sample_size == 0)
+		return -EINVAL;
+
+	nb_samples = block->size / sample_size;
+
+	/* Every channel's samples are laid out with a constant stride of
+	 * one sample size, so the whole block is one strided run per
+	 * channel; iio_block_first() locates its start, through the demux
+	 * plan when the buffer has one. */
+	for (i = 0; i < dev->nb_channels; i++) {
+		const struct iio_channel *chn = dev->channels[i];
+
+		if (chn->index < 0)
+			break;
+
+		if (!iio_channels_mask_test_bit(buf->mask, chn->number))
+			continue;
+
+		if (!iio_channels_mask_test_bit(mask, chn->number))
+			continue;
+
+		ret = callback(chn, iio_block_first(block, chn),
+			       nb_samples, sample_size, d);
+		if (ret < 0)
+			return ret;
+
+		processed += ret;
+	}
+
+	return processed;
+}
+
 struct iio_buffer * iio_block_get_buffer(const struct iio_block *block)
 {
 	return block->buffer;
 }
+
+uint64_t iio_block_get_timestamp(const struct iio_block *block)
+{
+	return block->capture_time_us;
+}
@@ -6,14 +6,25 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for MAP_ANONYMOUS / MAP_HUGETLB */
+#endif
+
 #include "iio-config.h"
 #include "iio-private.h"
 
 #include <errno.h>
 #include <iio/iio-debug.h>
 #include <iio/iio-lock.h>
+#include <stdio.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 void iio_buffer_set_data(struct iio_buffer *buf, void *data)
 {
 	buf->userdata = data;
@@ -76,6 +87,70 @@ int iio_buffer_enable(struct iio_buffer *buffer)
 	return 0;
 }
 
+int iio_buffers_enable_sync(struct iio_buffer **buffers, size_t nb)
+{
+	const struct iio_backend_ops *ops;
+	struct iio_buffer_pdata **pdatas;
+	const struct iio_context *ctx;
+	size_t i;
+	int err = -ENOSYS;
+
+	if (!nb)
+		return 0;
+
+	ctx = buffers[0]->dev->ctx;
+
+	for (i = 0; i < nb; i++) {
+		if (buffers[i]->dev->ctx != ctx)
+			return -EINVAL;
+
+		if (buffers[i]->nb_blocks == 0) {
+			dev_err(buffers[i]->dev,
+				"Cannot enable buffer before creating blocks.\n");
+			return -EINVAL;
+		}
+	}
+
+	ops = ctx->ops;
+
+	if (ops->enable_buffers) {
+		pdatas = calloc(nb, sizeof(*pdatas));
+		if (!pdatas)
+			return -ENOMEM;
+
+		for (i = 0; i < nb; i++)
+			pdatas[i] = buffers[i]->pdata;
+
+		err = ops->enable_buffers(pdatas, nb);
+		free(pdatas);
+	}
+
+	if (err == -ENOSYS) {
+		/* No batched path: all the validation was done up front, so
+		 * the per-buffer enables below run back to back, without
+		 * anything else in between. */
+		for (i = 0; i < nb; i++) {
+			err = iio_buffer_set_enabled(buffers[i], true);
+			if (err < 0 && err != -ENOSYS)
+				break;
+
+			err = 0;
+		}
+	}
+
+	if (err < 0) {
+		/* Don't leave the group half-started */
+		while (i--)
+			iio_buffer_set_enabled(buffers[i], false);
+		return err;
+	}
+
+	for (i = 0; i < nb; i++)
+		iio_task_start(buffers[i]->worker);
+
+	return 0;
+}
+
 int iio_buffer_disable(struct iio_buffer *buffer)
 {
 	int err;
@@ -91,7 +166,72 @@ int iio_buffer_disable(struct iio_buffer *buffer)
 
 static int iio_buffer_enqueue_worker(void *_, void *d)
 {
-	return iio_block_io(d);
+	struct iio_block *block = d;
+	struct iio_buffer *buf = iio_block_get_buffer(block);
+	int ret;
+
+	ret = iio_block_io(block);
+
+#ifdef __linux__
+	/* Signal the completion (even a failed one) to pollers */
+	if (buf->event_fd >= 0) {
+		uint64_t event = 1;
+
+		if (write(buf->event_fd, &event, sizeof(event)) < 0)
+			dev_perror(buf->dev, -errno, "Unable to signal event fd");
+	}
+#endif
+
+	return ret;
+}
+
+static void iio_buffer_compute_demux_plan(struct iio_buffer *buf)
+{
+	const struct iio_device *dev = buf->dev;
+	const struct iio_channel *chn, *cur;
+	unsigned int i, j;
+	size_t ptr, len;
+
+	/* Same walk as iio_block_first(), done once per channel here so
+	 * that the per-sample demux code doesn't have to redo it. */
+	for (j = 0; j < dev->nb_channels; j++) {
+		chn = dev->channels[j];
+		buf->demux_offsets[chn->number] = -1;
+
+		if (chn->index < 0 ||
+		    !iio_channels_mask_test_bit(buf->mask, chn->number))
+			continue;
+
+		ptr = 0;
+
+		for (i = 0; i < dev->nb_channels; i++) {
+			cur = dev->channels[i];
+			len = cur->format.length / 8 * cur->format.repeat;
+
+			/* NOTE: dev->channels are ordered by index */
+			if (cur->index < 0 || cur->index == chn->index)
+				break;
+
+			if (!iio_channels_mask_test_bit(buf->mask,
+							cur->number))
+				continue;
+
+			/* Two channels with the same index use the same
+			 * samples */
+			if (i > 0 && cur->index == dev->channels[i - 1]->index)
+				continue;
+
+			if (ptr % len)
+				ptr += len - (ptr % len);
+			ptr += len;
+		}
+
+		len = chn->format.length / 8;
+		if (ptr % len)
+			ptr += len - (ptr % len);
+
+		buf->demux_offsets[chn->number] = (long) ptr;
+	}
 }
 
 struct iio_buffer *
@@ -118,6 +258,13 @@ iio_device_create_buffer(const struct iio_device *dev, unsigned int idx,
 
 	buf->dev = dev;
 	buf->idx = idx;
+	buf->event_fd = -1;
+
+#ifdef __linux__
+	/* Not fatal if unavailable; iio_buffer_get_event_fd() then
+	 * returns -ENOSYS. */
+	buf->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
 
 	buf->mask = iio_create_channels_mask(dev->nb_channels);
 	if (!buf->mask) {
@@ -129,6 +276,17 @@ iio_device_create_buffer(const struct iio_device *dev, unsigned int idx,
 	if (err)
 		goto err_free_mask;
 
+	buf->sample_size = (size_t) sample_size;
+
+	buf->demux_offsets = calloc(dev->nb_channels,
+				    sizeof(*buf->demux_offsets));
+	if (!buf->demux_offsets) {
+		err = -ENOMEM;
+		goto err_free_mask;
+	}
+
+	iio_buffer_compute_demux_plan(buf);
+
 	buf->lock = iio_mutex_create();
 	err = iio_err(buf->lock);
 	if (err)
@@ -152,6 +310,7 @@ err_destroy_worker:
 err_free_mutex:
 	iio_mutex_destroy(buf->lock);
 err_free_mask:
+	free(buf->demux_offsets);
 	iio_channels_mask_destroy(buf->mask);
 err_free_buf:
 	free(buf);
@@ -170,11 +329,303 @@ void iio_buffer_destroy(struct iio_buffer *buf)
 	iio_task_destroy(buf->worker);
 	iio_mutex_destroy(buf->lock);
 	iio_channels_mask_destroy(buf->mask);
+#ifdef __linux__
+	if (buf->arena)
+		munmap(buf->arena, buf->arena_size);
+	free(buf->arena_used);
+	if (buf->event_fd >= 0)
+		close(buf->event_fd);
+#endif
+	free(buf->demux_offsets);
 	free(buf);
 }
 
+#ifdef __linux__
+#define ARENA_ALIGN 4096
+
+/* Default huge page size of the system, from /proc/meminfo; zero when it
+ * cannot be determined. */
+static size_t iio_huge_page_size(void)
+{
+	size_t size_kb = 0;
+	char line[128];
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "re");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "Hugepagesize: %zu kB", &size_kb) == 1)
+			break;
+	}
+
+	fclose(f);
+
+	return size_kb * 1024;
+}
+
+int iio_buffer_reserve_arena(struct iio_buffer *buf,
+			     size_t nb_blocks, size_t block_size)
+{
+	size_t slot_size, size, mapped, huge_size;
+	void *arena = MAP_FAILED;
+
+	if (buf->arena || !nb_blocks || !block_size)
+		return -EINVAL;
+
+	/* Page-aligned slots, so that a big enough arena can be backed by
+	 * huge pages. */
+	slot_size = (block_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	size = slot_size * nb_blocks;
+	mapped = size;
+
+	/* Try to get huge pages from the hugetlb pool first; if there is
+	 * none, fall back to a regular mapping and let THP do its thing.
+	 * The hugetlb length must be rounded up to the huge page size:
+	 * mmap() rounds up by itself, but munmap() does not, and would
+	 * fail with EINVAL at teardown (leaking the arena) if passed the
+	 * unrounded length. */
+	huge_size = iio_huge_page_size();
+	if (huge_size) {
+		mapped = (size + huge_size - 1) & ~(huge_size - 1);
+		arena = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	if (arena == MAP_FAILED) {
+		mapped = size;
+		arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (arena == MAP_FAILED)
+			return -errno;
+
+#ifdef MADV_HUGEPAGE
+		madvise(arena, size, MADV_HUGEPAGE);
+#endif
+	}
+
+	buf->arena_used = calloc(nb_blocks, sizeof(*buf->arena_used));
+	if (!buf->arena_used) {
+		munmap(arena, mapped);
+		return -ENOMEM;
+	}
+
+	buf->arena = arena;
+	buf->arena_size = mapped;
+	buf->arena_slot_size = slot_size;
+	buf->arena_nb_slots = nb_blocks;
+
+	return 0;
+}
+
+void * iio_buffer_arena_alloc(struct iio_buffer *buf, size_t size)
+{
+	void *data = NULL;
+	size_t i;
+
+	if (!buf->arena || size > buf->arena_slot_size)
+		return NULL;
+
+	iio_mutex_lock(buf->lock);
+
+	for (i = 0; i < buf->arena_nb_slots; i++) {
+		if (!buf->arena_used[i]) {
+			buf->arena_used[i] = true;
+			data = buf->arena + i * buf->arena_slot_size;
+			break;
+		}
+	}
+
+	iio_mutex_unlock(buf->lock);
+
+	return data;
+}
+
+void iio_buffer_arena_free(struct iio_buffer *buf, void *data)
+{
+	size_t i = ((uint8_t *) data - buf->arena) / buf->arena_slot_size;
+
+	iio_mutex_lock(buf->lock);
+	buf->arena_used[i] = false;
+	iio_mutex_unlock(buf->lock);
+}
+#else
+int iio_buffer_reserve_arena(struct iio_buffer *buf,
+			     size_t nb_blocks, size_t block_size)
+{
+	return -ENOSYS;
+}
+
+void * iio_buffer_arena_alloc(struct iio_buffer *buf, size_t size)
+{
+	return NULL;
+}
+
+void iio_buffer_arena_free(struct iio_buffer *buf, void *data)
+{
+}
+#endif
+
+int iio_buffer_set_worker_attrs(struct iio_buffer *buf, int cpu, int priority)
+{
+	int err;
+
+	if (cpu >= 0) {
+		err = iio_task_set_affinity(buf->worker, (unsigned int) cpu);
+		if (err)
+			return err;
+	}
+
+	return iio_task_set_priority(buf->worker, priority);
+}
+
+int iio_buffer_set_wakeup(struct iio_buffer *buf, size_t min_bytes,
+			  unsigned int max_wait_ms)
+{
+	const struct iio_backend_ops *ops = buf->dev->ctx->ops;
+	ssize_t sample_size;
+
+	if (!ops->set_wakeup)
+		return -ENOSYS;
+
+	sample_size = iio_device_get_sample_size(buf->dev, buf->mask);
+	if (sample_size <= 0)
+		return sample_size ? (int) sample_size : -EINVAL;
+
+	return ops->set_wakeup(buf->pdata, min_bytes / (size_t) sample_size,
+			       max_wait_ms);
+}
+
+int iio_buffer_get_event_fd(const struct iio_buffer *buf)
+{
+	if (buf->event_fd < 0)
+		return -ENOSYS;
+
+	return buf->event_fd;
+}
+
 const struct iio_channels_mask *
 iio_buffer_get_channels_mask(const struct iio_buffer *buf)
 {
 	return buf->mask;
 }
+
+enum iio_buffer_mechanism
+iio_buffer_get_mechanism(const struct iio_buffer *buf)
+{
+	const struct iio_backend_ops *ops = buf->dev->ctx->ops;
+
+	if (!ops->get_mechanism)
+		return IIO_BUFFER_MECHANISM_UNKNOWN;
+
+	return ops->get_mechanism(buf->pdata);
+}
+
+int iio_buffer_update_mask(struct iio_buffer *buf,
+			   const struct iio_channels_mask *mask)
+{
+	const struct iio_backend_ops *ops = buf->dev->ctx->ops;
+	ssize_t sample_size;
+	int err;
+
+	if (!ops->update_mask)
+		return -ENOSYS;
+
+	sample_size = iio_device_get_sample_size(buf->dev, mask);
+	if (sample_size < 0)
+		return (int) sample_size;
+	if (!sample_size)
+		return -EINVAL;
+
+	/* The existing blocks are reused as-is; their byte size must still
+	 * hold a whole number of the new samples. */
+	if (buf->block_size && buf->block_size % (size_t) sample_size)
+		return -EINVAL;
+
+	/* Quiesce: stop the hardware, then the worker. The caller must have
+	 * dequeued all blocks beforehand. */
+	err = iio_buffer_set_enabled(buf, false);
+	if (err < 0 && err != -ENOSYS)
+		return err;
+
+	iio_task_stop(buf->worker);
+
+	err = iio_channels_mask_copy(buf->mask, mask);
+	if (err)
+		return err;
+
+	/* The backend may enable extra bits for coupled channels, like at
+	 * buffer creation. On failure the hardware state is undefined and
+	 * the buffer should be destroyed. */
+	err = ops->update_mask(buf->pdata, buf->mask);
+	if (err)
+		return err;
+
+	buf->sample_size = (size_t) sample_size;
+	iio_buffer_compute_demux_plan(buf);
+
+	return 0;
+}
+
+void iio_buffer_stats_enqueued(struct iio_buffer *buf)
+{
+	iio_mutex_lock(buf->lock);
+
+	buf->queue_depth++;
+	if (buf->queue_depth > buf->stats.queue_depth_hwm)
+		buf->stats.queue_depth_hwm = buf->queue_depth;
+
+	iio_mutex_unlock(buf->lock);
+}
+
+void iio_buffer_stats_complete(struct iio_buffer *buf,
+			       uint64_t latency_us, size_t bytes, int ret)
+{
+	struct iio_buffer_stats *stats = &buf->stats;
+	uint64_t tmp = latency_us;
+	unsigned int bucket = 0;
+
+	iio_mutex_lock(buf->lock);
+
+	if (buf->queue_depth > 0)
+		buf->queue_depth--;
+
+	if (ret < 0) {
+		/* The local backend reports kernel over/underflows as -EIO
+		 * (POLLERR from the buffer's descriptor). */
+		if (ret == -EIO || ret == -EOVERFLOW)
+			stats->xruns++;
+	} else {
+		if (!stats->blocks_transferred
+		    || latency_us < stats->latency_min_us)
+			stats->latency_min_us = latency_us;
+		if (latency_us > stats->latency_max_us)
+			stats->latency_max_us = latency_us;
+
+		while ((tmp >>= 1) && bucket < ARRAY_SIZE(stats->latency_buckets) - 1)
+			bucket++;
+		stats->latency_buckets[bucket]++;
+
+		stats->blocks_transferred++;
+		stats->bytes_transferred += bytes;
+	}
+
+	iio_mutex_unlock(buf->lock);
+}
+
+void iio_buffer_stats_lost(struct iio_buffer *buf, size_t bytes)
+{
+	iio_mutex_lock(buf->lock);
+	buf->stats.bytes_lost += bytes;
+	iio_mutex_unlock(buf->lock);
+}
+
+int iio_buffer_get_stats(const struct iio_buffer *buf,
+			 struct iio_buffer_stats *stats)
+{
+	iio_mutex_lock(buf->lock);
+	*stats = buf->stats;
+	iio_mutex_unlock(buf->lock);
+
+	return 0;
+}
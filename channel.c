@@ -349,6 +349,9 @@ iio_channel_do_find_attr(const struct iio_channel *chn, const char *name)
 {
 	unsigned int i;
 
+	if (chn->attr_index.entries)
+		return iio_str_index_find(&chn->attr_index, name, NULL, NULL);
+
 	for (i = 0; i < chn->nb_attrs; i++) {
 		const char *attr = chn->attrs[i].name;
 		if (!strcmp(attr, name))
@@ -387,6 +390,8 @@ const char * iio_channel_find_attr(const struct iio_channel *chn,
 ssize_t iio_channel_attr_read_raw(const struct iio_channel *chn,
 		const char *attr, char *dst, size_t len)
 {
+	ssize_t ret;
+
 	if (!attr)
 		return -EINVAL;
 
@@ -394,16 +399,30 @@ ssize_t iio_channel_attr_read_raw(const struct iio_channel *chn,
 	if (!attr)
 		return -ENOENT;
 
-	if (chn->dev->ctx->ops->read_channel_attr)
-		return chn->dev->ctx->ops->read_channel_attr(chn,
-				attr, dst, len);
-	else
+	if (!chn->dev->ctx->ops->read_channel_attr)
 		return -ENOSYS;
+
+	/* The channel pointer keys the cache entry; the type is unused */
+	ret = iio_attr_cache_get(chn->dev->ctx, chn, 0, 0, attr, dst, len);
+	if (ret >= 0)
+		return ret;
+
+	ret = chn->dev->ctx->ops->read_channel_attr(chn, attr, dst, len);
+
+	/* Don't cache values that may have been truncated to "len" */
+	if (ret > 0 && (size_t) ret < len) {
+		iio_attr_cache_store(chn->dev->ctx, chn, 0, 0, attr, dst,
+				     (size_t) ret);
+	}
+
+	return ret;
 }
 
 ssize_t iio_channel_attr_write_raw(const struct iio_channel *chn,
 		const char *attr, const void *src, size_t len)
 {
+	ssize_t ret;
+
 	if (!attr)
 		return -EINVAL;
 
@@ -411,11 +430,14 @@ ssize_t iio_channel_attr_write_raw(const struct iio_channel *chn,
 	if (!attr)
 		return -ENOENT;
 
-	if (chn->dev->ctx->ops->write_channel_attr)
-		return chn->dev->ctx->ops->write_channel_attr(chn,
-				attr, src, len);
-	else
+	if (!chn->dev->ctx->ops->write_channel_attr)
 		return -ENOSYS;
+
+	ret = chn->dev->ctx->ops->write_channel_attr(chn, attr, src, len);
+	if (ret >= 0)
+		iio_attr_cache_invalidate(chn->dev->ctx, chn, 0, 0, attr);
+
+	return ret;
 }
 
 ssize_t iio_channel_attr_write_string(const struct iio_channel *chn,
@@ -467,12 +489,9 @@ void iio_channel_disable(const struct iio_channel *chn,
 
 void free_channel(struct iio_channel *chn)
 {
-	size_t i;
-	for (i = 0; i < chn->nb_attrs; i++) {
-		free(chn->attrs[i].name);
-		free(chn->attrs[i].filename);
-	}
+	/* The attr names and filenames belong to the context's string pool */
 	free(chn->attrs);
+	iio_str_index_release(&chn->attr_index);
 	free(chn->name);
 	free(chn->id);
 	free(chn);
@@ -566,6 +585,530 @@ static void mask_upper_bits(uint8_t *dst, size_t bits, size_t len)
 		dst[i] = 0;
 }
 
+/*
+ * Batch conversion kernels for the common 16-bit and 32-bit sample layouts.
+ *
+ * The per-sample code above works byte per byte so that it can handle any
+ * sample length; for the formats that account for virtually all streaming
+ * use cases (le/be:s12/16, le/be:s16/16, le/be:s12/16>>4, 32-bit variants...)
+ * we can instead process whole arrays with full-width integer lanes, which
+ * the SIMD kernels below do 8/16 lanes at a time.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& defined(__SSE2__)
+#define IIO_BATCH_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define IIO_BATCH_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef IIO_BATCH_X86
+static bool cpu_has_avx2(void)
+{
+	static int has_avx2 = -1;
+
+	if (has_avx2 == -1)
+		has_avx2 = __builtin_cpu_supports("avx2");
+
+	return !!has_avx2;
+}
+#endif
+
+static void convert_batch16_scalar(uint16_t *dst, const uint16_t *src,
+				   size_t nb, unsigned int shift,
+				   unsigned int upper, uint16_t mask,
+				   bool swap, bool sign)
+{
+	uint16_t x;
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		x = src[i];
+		if (swap)
+			x = (uint16_t)((x << 8) | (x >> 8));
+		x >>= shift;
+		if (sign)
+			x = (uint16_t)((int16_t)(uint16_t)(x << upper) >> upper);
+		else
+			x &= mask;
+		dst[i] = x;
+	}
+}
+
+static void convert_batch32_scalar(uint32_t *dst, const uint32_t *src,
+				   size_t nb, unsigned int shift,
+				   unsigned int upper, uint32_t mask,
+				   bool swap, bool sign)
+{
+	uint32_t x;
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		x = src[i];
+		if (swap)
+			x = (x >> 24) | ((x >> 8) & 0xff00)
+				| ((x << 8) & 0xff0000) | (x << 24);
+		x >>= shift;
+		if (sign)
+			x = (uint32_t)((int32_t)(x << upper) >> upper);
+		else
+			x &= mask;
+		dst[i] = x;
+	}
+}
+
+static void convert_batch16_inv_scalar(uint16_t *dst, const uint16_t *src,
+				       size_t nb, unsigned int shift,
+				       uint16_t mask, bool swap)
+{
+	uint16_t x;
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		x = (uint16_t)((src[i] & mask) << shift);
+		if (swap)
+			x = (uint16_t)((x << 8) | (x >> 8));
+		dst[i] = x;
+	}
+}
+
+static void convert_batch32_inv_scalar(uint32_t *dst, const uint32_t *src,
+				       size_t nb, unsigned int shift,
+				       uint32_t mask, bool swap)
+{
+	uint32_t x;
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		x = (src[i] & mask) << shift;
+		if (swap)
+			x = (x >> 24) | ((x >> 8) & 0xff00)
+				| ((x << 8) & 0xff0000) | (x << 24);
+		dst[i] = x;
+	}
+}
+
+#ifdef IIO_BATCH_X86
+__attribute__((target("avx2")))
+static void convert_batch16_avx2(uint16_t *dst, const uint16_t *src,
+				 size_t nb, unsigned int shift,
+				 unsigned int upper, uint16_t mask,
+				 bool swap, bool sign)
+{
+	__m256i x, vmask = _mm256_set1_epi16((short) mask);
+
+	for (; nb >= 16; nb -= 16, src += 16, dst += 16) {
+		x = _mm256_loadu_si256((const __m256i *) src);
+		if (swap)
+			x = _mm256_or_si256(_mm256_slli_epi16(x, 8),
+					    _mm256_srli_epi16(x, 8));
+		x = _mm256_srli_epi16(x, shift);
+		if (sign)
+			x = _mm256_srai_epi16(_mm256_slli_epi16(x, upper),
+					      upper);
+		else
+			x = _mm256_and_si256(x, vmask);
+		_mm256_storeu_si256((__m256i *) dst, x);
+	}
+
+	convert_batch16_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+}
+
+__attribute__((target("avx2")))
+static void convert_batch32_avx2(uint32_t *dst, const uint32_t *src,
+				 size_t nb, unsigned int shift,
+				 unsigned int upper, uint32_t mask,
+				 bool swap, bool sign)
+{
+	__m256i x, vmask = _mm256_set1_epi32((int) mask);
+
+	for (; nb >= 8; nb -= 8, src += 8, dst += 8) {
+		x = _mm256_loadu_si256((const __m256i *) src);
+		if (swap) {
+			x = _mm256_or_si256(_mm256_slli_epi32(x, 16),
+					    _mm256_srli_epi32(x, 16));
+			x = _mm256_or_si256(_mm256_slli_epi16(x, 8),
+					    _mm256_srli_epi16(x, 8));
+		}
+		x = _mm256_srli_epi32(x, shift);
+		if (sign)
+			x = _mm256_srai_epi32(_mm256_slli_epi32(x, upper),
+					      upper);
+		else
+			x = _mm256_and_si256(x, vmask);
+		_mm256_storeu_si256((__m256i *) dst, x);
+	}
+
+	convert_batch32_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+}
+
+__attribute__((target("avx2")))
+static void convert_batch16_inv_avx2(uint16_t *dst, const uint16_t *src,
+				     size_t nb, unsigned int shift,
+				     uint16_t mask, bool swap)
+{
+	__m256i x, vmask = _mm256_set1_epi16((short) mask);
+
+	for (; nb >= 16; nb -= 16, src += 16, dst += 16) {
+		x = _mm256_loadu_si256((const __m256i *) src);
+		x = _mm256_slli_epi16(_mm256_and_si256(x, vmask), shift);
+		if (swap)
+			x = _mm256_or_si256(_mm256_slli_epi16(x, 8),
+					    _mm256_srli_epi16(x, 8));
+		_mm256_storeu_si256((__m256i *) dst, x);
+	}
+
+	convert_batch16_inv_scalar(dst, src, nb, shift, mask, swap);
+}
+
+__attribute__((target("avx2")))
+static void convert_batch32_inv_avx2(uint32_t *dst, const uint32_t *src,
+				     size_t nb, unsigned int shift,
+				     uint32_t mask, bool swap)
+{
+	__m256i x, vmask = _mm256_set1_epi32((int) mask);
+
+	for (; nb >= 8; nb -= 8, src += 8, dst += 8) {
+		x = _mm256_loadu_si256((const __m256i *) src);
+		x = _mm256_slli_epi32(_mm256_and_si256(x, vmask), shift);
+		if (swap) {
+			x = _mm256_or_si256(_mm256_slli_epi32(x, 16),
+					    _mm256_srli_epi32(x, 16));
+			x = _mm256_or_si256(_mm256_slli_epi16(x, 8),
+					    _mm256_srli_epi16(x, 8));
+		}
+		_mm256_storeu_si256((__m256i *) dst, x);
+	}
+
+	convert_batch32_inv_scalar(dst, src, nb, shift, mask, swap);
+}
+
+static void convert_batch16_sse2(uint16_t *dst, const uint16_t *src,
+				 size_t nb, unsigned int shift,
+				 unsigned int upper, uint16_t mask,
+				 bool swap, bool sign)
+{
+	__m128i x, vmask = _mm_set1_epi16((short) mask);
+
+	for (; nb >= 8; nb -= 8, src += 8, dst += 8) {
+		x = _mm_loadu_si128((const __m128i *) src);
+		if (swap)
+			x = _mm_or_si128(_mm_slli_epi16(x, 8),
+					 _mm_srli_epi16(x, 8));
+		x = _mm_srli_epi16(x, shift);
+		if (sign)
+			x = _mm_srai_epi16(_mm_slli_epi16(x, upper), upper);
+		else
+			x = _mm_and_si128(x, vmask);
+		_mm_storeu_si128((__m128i *) dst, x);
+	}
+
+	convert_batch16_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+}
+
+static void convert_batch32_sse2(uint32_t *dst, const uint32_t *src,
+				 size_t nb, unsigned int shift,
+				 unsigned int upper, uint32_t mask,
+				 bool swap, bool sign)
+{
+	__m128i x, vmask = _mm_set1_epi32((int) mask);
+
+	for (; nb >= 4; nb -= 4, src += 4, dst += 4) {
+		x = _mm_loadu_si128((const __m128i *) src);
+		if (swap) {
+			x = _mm_or_si128(_mm_slli_epi32(x, 16),
+					 _mm_srli_epi32(x, 16));
+			x = _mm_or_si128(_mm_slli_epi16(x, 8),
+					 _mm_srli_epi16(x, 8));
+		}
+		x = _mm_srli_epi32(x, shift);
+		if (sign)
+			x = _mm_srai_epi32(_mm_slli_epi32(x, upper), upper);
+		else
+			x = _mm_and_si128(x, vmask);
+		_mm_storeu_si128((__m128i *) dst, x);
+	}
+
+	convert_batch32_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+}
+
+static void convert_batch16_inv_sse2(uint16_t *dst, const uint16_t *src,
+				     size_t nb, unsigned int shift,
+				     uint16_t mask, bool swap)
+{
+	__m128i x, vmask = _mm_set1_epi16((short) mask);
+
+	for (; nb >= 8; nb -= 8, src += 8, dst += 8) {
+		x = _mm_loadu_si128((const __m128i *) src);
+		x = _mm_slli_epi16(_mm_and_si128(x, vmask), shift);
+		if (swap)
+			x = _mm_or_si128(_mm_slli_epi16(x, 8),
+					 _mm_srli_epi16(x, 8));
+		_mm_storeu_si128((__m128i *) dst, x);
+	}
+
+	convert_batch16_inv_scalar(dst, src, nb, shift, mask, swap);
+}
+
+static void convert_batch32_inv_sse2(uint32_t *dst, const uint32_t *src,
+				     size_t nb, unsigned int shift,
+				     uint32_t mask, bool swap)
+{
+	__m128i x, vmask = _mm_set1_epi32((int) mask);
+
+	for (; nb >= 4; nb -= 4, src += 4, dst += 4) {
+		x = _mm_loadu_si128((const __m128i *) src);
+		x = _mm_slli_epi32(_mm_and_si128(x, vmask), shift);
+		if (swap) {
+			x = _mm_or_si128(_mm_slli_epi32(x, 16),
+					 _mm_srli_epi32(x, 16));
+			x = _mm_or_si128(_mm_slli_epi16(x, 8),
+					 _mm_srli_epi16(x, 8));
+		}
+		_mm_storeu_si128((__m128i *) dst, x);
+	}
+
+	convert_batch32_inv_scalar(dst, src, nb, shift, mask, swap);
+}
+#endif /* IIO_BATCH_X86 */
+
+#ifdef IIO_BATCH_NEON
+static void convert_batch16_neon(uint16_t *dst, const uint16_t *src,
+				 size_t nb, unsigned int shift,
+				 unsigned int upper, uint16_t mask,
+				 bool swap, bool sign)
+{
+	int16x8_t vshift = vdupq_n_s16(-(int16_t) shift);
+	int16x8_t vup = vdupq_n_s16((int16_t) upper);
+	int16x8_t vdown = vdupq_n_s16(-(int16_t) upper);
+	uint16x8_t x, vmask = vdupq_n_u16(mask);
+
+	for (; nb >= 8; nb -= 8, src += 8, dst += 8) {
+		x = vld1q_u16(src);
+		if (swap)
+			x = vreinterpretq_u16_u8(
+				vrev16q_u8(vreinterpretq_u8_u16(x)));
+		x = vshlq_u16(x, vshift);
+		if (sign)
+			x = vreinterpretq_u16_s16(vshlq_s16(
+				vshlq_s16(vreinterpretq_s16_u16(x), vup),
+				vdown));
+		else
+			x = vandq_u16(x, vmask);
+		vst1q_u16(dst, x);
+	}
+
+	convert_batch16_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+}
+
+static void convert_batch32_neon(uint32_t *dst, const uint32_t *src,
+				 size_t nb, unsigned int shift,
+				 unsigned int upper, uint32_t mask,
+				 bool swap, bool sign)
+{
+	int32x4_t vshift = vdupq_n_s32(-(int32_t) shift);
+	int32x4_t vup = vdupq_n_s32((int32_t) upper);
+	int32x4_t vdown = vdupq_n_s32(-(int32_t) upper);
+	uint32x4_t x, vmask = vdupq_n_u32(mask);
+
+	for (; nb >= 4; nb -= 4, src += 4, dst += 4) {
+		x = vld1q_u32(src);
+		if (swap)
+			x = vreinterpretq_u32_u8(
+				vrev32q_u8(vreinterpretq_u8_u32(x)));
+		x = vshlq_u32(x, vshift);
+		if (sign)
+			x = vreinterpretq_u32_s32(vshlq_s32(
+				vshlq_s32(vreinterpretq_s32_u32(x), vup),
+				vdown));
+		else
+			x = vandq_u32(x, vmask);
+		vst1q_u32(dst, x);
+	}
+
+	convert_batch32_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+}
+
+static void convert_batch16_inv_neon(uint16_t *dst, const uint16_t *src,
+				     size_t nb, unsigned int shift,
+				     uint16_t mask, bool swap)
+{
+	int16x8_t vshift = vdupq_n_s16((int16_t) shift);
+	uint16x8_t x, vmask = vdupq_n_u16(mask);
+
+	for (; nb >= 8; nb -= 8, src += 8, dst += 8) {
+		x = vshlq_u16(vandq_u16(vld1q_u16(src), vmask), vshift);
+		if (swap)
+			x = vreinterpretq_u16_u8(
+				vrev16q_u8(vreinterpretq_u8_u16(x)));
+		vst1q_u16(dst, x);
+	}
+
+	convert_batch16_inv_scalar(dst, src, nb, shift, mask, swap);
+}
+
+static void convert_batch32_inv_neon(uint32_t *dst, const uint32_t *src,
+				     size_t nb, unsigned int shift,
+				     uint32_t mask, bool swap)
+{
+	int32x4_t vshift = vdupq_n_s32((int32_t) shift);
+	uint32x4_t x, vmask = vdupq_n_u32(mask);
+
+	for (; nb >= 4; nb -= 4, src += 4, dst += 4) {
+		x = vshlq_u32(vandq_u32(vld1q_u32(src), vmask), vshift);
+		if (swap)
+			x = vreinterpretq_u32_u8(
+				vrev32q_u8(vreinterpretq_u8_u32(x)));
+		vst1q_u32(dst, x);
+	}
+
+	convert_batch32_inv_scalar(dst, src, nb, shift, mask, swap);
+}
+#endif /* IIO_BATCH_NEON */
+
+static void convert_batch16(uint16_t *dst, const uint16_t *src, size_t nb,
+			    unsigned int shift, unsigned int upper,
+			    uint16_t mask, bool swap, bool sign)
+{
+#if defined(IIO_BATCH_X86)
+	if (cpu_has_avx2())
+		convert_batch16_avx2(dst, src, nb, shift, upper, mask,
+				     swap, sign);
+	else
+		convert_batch16_sse2(dst, src, nb, shift, upper, mask,
+				     swap, sign);
+#elif defined(IIO_BATCH_NEON)
+	convert_batch16_neon(dst, src, nb, shift, upper, mask, swap, sign);
+#else
+	convert_batch16_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+#endif
+}
+
+static void convert_batch32(uint32_t *dst, const uint32_t *src, size_t nb,
+			    unsigned int shift, unsigned int upper,
+			    uint32_t mask, bool swap, bool sign)
+{
+#if defined(IIO_BATCH_X86)
+	if (cpu_has_avx2())
+		convert_batch32_avx2(dst, src, nb, shift, upper, mask,
+				     swap, sign);
+	else
+		convert_batch32_sse2(dst, src, nb, shift, upper, mask,
+				     swap, sign);
+#elif defined(IIO_BATCH_NEON)
+	convert_batch32_neon(dst, src, nb, shift, upper, mask, swap, sign);
+#else
+	convert_batch32_scalar(dst, src, nb, shift, upper, mask, swap, sign);
+#endif
+}
+
+static void convert_batch16_inv(uint16_t *dst, const uint16_t *src, size_t nb,
+				unsigned int shift, uint16_t mask, bool swap)
+{
+#if defined(IIO_BATCH_X86)
+	if (cpu_has_avx2())
+		convert_batch16_inv_avx2(dst, src, nb, shift, mask, swap);
+	else
+		convert_batch16_inv_sse2(dst, src, nb, shift, mask, swap);
+#elif defined(IIO_BATCH_NEON)
+	convert_batch16_inv_neon(dst, src, nb, shift, mask, swap);
+#else
+	convert_batch16_inv_scalar(dst, src, nb, shift, mask, swap);
+#endif
+}
+
+static void convert_batch32_inv(uint32_t *dst, const uint32_t *src, size_t nb,
+				unsigned int shift, uint32_t mask, bool swap)
+{
+#if defined(IIO_BATCH_X86)
+	if (cpu_has_avx2())
+		convert_batch32_inv_avx2(dst, src, nb, shift, mask, swap);
+	else
+		convert_batch32_inv_sse2(dst, src, nb, shift, mask, swap);
+#elif defined(IIO_BATCH_NEON)
+	convert_batch32_inv_neon(dst, src, nb, shift, mask, swap);
+#else
+	convert_batch32_inv_scalar(dst, src, nb, shift, mask, swap);
+#endif
+}
+
+static bool chn_format_is_batchable(const struct iio_data_format *fmt)
+{
+	return (fmt->length == 16 || fmt->length == 32)
+		&& fmt->bits <= fmt->length
+		&& fmt->shift + fmt->bits <= fmt->length;
+}
+
+void iio_channel_convert_array(const struct iio_channel *chn,
+			       void *dst, const void *src, size_t nb_samples)
+{
+	const struct iio_data_format *fmt = &chn->format;
+	bool swap = is_little_endian() ^ !fmt->is_be;
+	size_t i, nb = nb_samples * fmt->repeat;
+	uintptr_t d = (uintptr_t) dst, s = (uintptr_t) src;
+	unsigned int len = fmt->length / 8 * fmt->repeat;
+	unsigned int upper = 0;
+	uint32_t mask;
+	bool sign;
+
+	if (!chn_format_is_batchable(fmt)) {
+		for (i = 0; i < nb_samples; i++, d += len, s += len)
+			iio_channel_convert(chn, (void *) d, (const void *) s);
+		return;
+	}
+
+	sign = fmt->is_signed && !fmt->is_fully_defined;
+	if (sign)
+		upper = fmt->length - fmt->bits;
+
+	if (fmt->is_fully_defined || fmt->bits == fmt->length)
+		mask = fmt->length == 32 ? 0xffffffff : 0xffff;
+	else
+		mask = (1u << fmt->bits) - 1;
+
+	if (fmt->length == 16) {
+		convert_batch16(dst, src, nb, fmt->shift, upper,
+				(uint16_t) mask, swap, sign);
+	} else {
+		convert_batch32(dst, src, nb, fmt->shift, upper,
+				mask, swap, sign);
+	}
+}
+
+void iio_channel_convert_array_inverse(const struct iio_channel *chn,
+				       void *dst, const void *src,
+				       size_t nb_samples)
+{
+	const struct iio_data_format *fmt = &chn->format;
+	bool swap = is_little_endian() ^ !fmt->is_be;
+	size_t i, nb = nb_samples * fmt->repeat;
+	uintptr_t d = (uintptr_t) dst, s = (uintptr_t) src;
+	unsigned int len = fmt->length / 8 * fmt->repeat;
+	uint32_t mask;
+
+	if (!chn_format_is_batchable(fmt)) {
+		for (i = 0; i < nb_samples; i++, d += len, s += len) {
+			iio_channel_convert_inverse(chn, (void *) d,
+						    (const void *) s);
+		}
+		return;
+	}
+
+	if (fmt->bits == fmt->length)
+		mask = fmt->length == 32 ? 0xffffffff : 0xffff;
+	else
+		mask = (1u << fmt->bits) - 1;
+
+	if (fmt->length == 16) {
+		convert_batch16_inv(dst, src, nb, fmt->shift,
+				    (uint16_t) mask, swap);
+	} else {
+		convert_batch32_inv(dst, src, nb, fmt->shift, mask, swap);
+	}
+}
+
 void iio_channel_convert(const struct iio_channel *chn,
 		void *dst, const void *src)
 {
@@ -644,36 +1187,47 @@ size_t iio_channel_read(const struct iio_channel *chn,
 	unsigned int length = chn->format.length / 8 * chn->format.repeat;
 	uintptr_t src_ptr, dst_ptr = (uintptr_t) dst, end = dst_ptr + len;
 	uintptr_t block_end = (uintptr_t) iio_block_end(block);
-	size_t step = iio_device_get_sample_size(dev, buf->mask);
-	void (*cb)(const struct iio_channel *, void *, const void *);
-	size_t block_len;
+	size_t step = buf->sample_size;
+	size_t block_len, nb;
 	const void *src;
 
-	if (raw && step == length) {
-		src = iio_block_start(block);
-		block_len = (uintptr_t) iio_block_end(block) - (uintptr_t) src;
+	if (!step)
+		step = iio_device_get_sample_size(dev, buf->mask);
+
+	if (step == length) {
+		src = iio_block_first(block, chn);
+		block_len = block_end - (uintptr_t) src;
 
 		if (block_len < len)
 			len = block_len;
 
-		memcpy(dst, src, len);
+		if (raw) {
+			memcpy(dst, src, len);
+		} else {
+			iio_channel_convert_array_inverse(chn, dst, src,
+							  len / length);
+			len -= len % length;
+		}
 
 		return len;
 	}
 
-	if (raw)
-		cb = chn_memcpy;
-	else
-		cb = iio_channel_convert_inverse;
-
+	/* Gather the (strided) raw samples into the destination buffer,
+	 * then convert them in place in one batch. */
 	for (src_ptr = (uintptr_t) iio_block_first(block, chn);
 	     src_ptr < block_end && dst_ptr + length <= end;
 	     src_ptr += step, dst_ptr += length) {
-		(*cb)(chn, (void *) dst_ptr, (const void *) src_ptr);
+		chn_memcpy(chn, (void *) dst_ptr, (const void *) src_ptr);
 	}
 
-	return dst_ptr - (uintptr_t) dst;
+	len = dst_ptr - (uintptr_t) dst;
+
+	if (!raw) {
+		nb = len / length;
+		iio_channel_convert_array_inverse(chn, dst, dst, nb);
+	}
 
+	return len;
 }
 
 size_t iio_channel_write(const struct iio_channel *chn,
@@ -685,32 +1239,66 @@ size_t iio_channel_write(const struct iio_channel *chn,
 	uintptr_t dst_ptr, src_ptr = (uintptr_t) src, end = src_ptr + len;
 	unsigned int length = chn->format.length / 8 * chn->format.repeat;
 	uintptr_t block_end = (uintptr_t) iio_block_end(block);
-	size_t step = iio_device_get_sample_size(dev, buf->mask);
-	void (*cb)(const struct iio_channel *, void *, const void *);
-	size_t block_len;
+	size_t step = buf->sample_size;
+	uint8_t tmp[1024];
+	size_t block_len, nb, chunk, i;
 	void *dst;
 
-	if (raw && step == length) {
-		dst = iio_block_start(block);
-		block_len = (uintptr_t) iio_block_end(block) - (uintptr_t) dst;
+	if (!step)
+		step = iio_device_get_sample_size(dev, buf->mask);
+
+	if (step == length) {
+		dst = iio_block_first(block, chn);
+		block_len = block_end - (uintptr_t) dst;
 
 		if (block_len < len)
 			len = block_len;
 
-		memcpy(dst, src, len);
+		if (raw) {
+			memcpy(dst, src, len);
+		} else {
+			iio_channel_convert_array_inverse(chn, dst, src,
+							  len / length);
+			len -= len % length;
+		}
 
 		return len;
 	}
 
-	if (raw)
-		cb = chn_memcpy;
-	else
-		cb = iio_channel_convert_inverse;
+	dst_ptr = (uintptr_t) iio_block_first(block, chn);
+
+	if (raw || length > sizeof(tmp)) {
+		for (; dst_ptr < block_end && src_ptr + length <= end;
+		     dst_ptr += step, src_ptr += length) {
+			if (raw)
+				chn_memcpy(chn, (void *) dst_ptr,
+					   (const void *) src_ptr);
+			else
+				iio_channel_convert_inverse(chn,
+						(void *) dst_ptr,
+						(const void *) src_ptr);
+		}
+
+		return src_ptr - (uintptr_t) src;
+	}
+
+	/* Convert a chunk of samples in one batch, then scatter it into
+	 * the (strided) block. */
+	chunk = sizeof(tmp) / length;
+
+	while (dst_ptr < block_end && src_ptr + length <= end) {
+		nb = (end - src_ptr) / length;
+		if (nb > chunk)
+			nb = chunk;
+		block_len = (block_end - dst_ptr + step - 1) / step;
+		if (nb > block_len)
+			nb = block_len;
+
+		iio_channel_convert_array_inverse(chn, tmp,
+						  (const void *) src_ptr, nb);
 
-	for (dst_ptr = (uintptr_t) iio_block_first(block, chn);
-	     dst_ptr < block_end && src_ptr + length <= end;
-	     dst_ptr += step, src_ptr += length) {
-		(*cb)(chn, (void *) dst_ptr, (const void *) src_ptr);
+		for (i = 0; i < nb; i++, dst_ptr += step, src_ptr += length)
+			chn_memcpy(chn, (void *) dst_ptr, tmp + i * length);
 	}
 
 	return src_ptr - (uintptr_t) src;
@@ -277,6 +277,12 @@ struct compat {
 					    ssize_t (*callback)(const struct iio_channel *,
 								void *, size_t, void *),
 					    void *);
+	ssize_t (*iio_block_foreach_chunk)(const struct iio_block *,
+					   const struct iio_channels_mask *,
+					   ssize_t (*callback)(const struct iio_channel *,
+							       void *, size_t,
+							       size_t, void *),
+					   void *);
 
 	/* Misc */
 	size_t (*iio_strlcpy)(char * __restrict, const char * __restrict, size_t);
@@ -1721,7 +1727,10 @@ struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
 	}
 
 	if (!dev_compat->is_tx) {
-		for (j = 1; j < nb_blocks; j++) {
+		/* Prime the whole ring right away, so that the capture is
+		 * pipelined from the very first iio_buffer_refill() call,
+		 * which then only has to dequeue. */
+		for (j = 0; j < nb_blocks; j++) {
 			err = IIO_CALL(iio_block_enqueue)(compat->blocks[j],
 							  0, false);
 			if (err)
@@ -1732,6 +1741,7 @@ struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
 		if (err)
 			goto err_free_blocks;
 
+		compat->enqueued = true;
 		compat->all_enqueued = true;
 	}
 
@@ -1929,6 +1939,27 @@ ssize_t iio_buffer_foreach_sample(struct iio_buffer *buf,
 						  callback, data);
 }
 
+/* Chunked variant of iio_buffer_foreach_sample(): one callback per enabled
+ * channel, covering the channel's whole strided run of samples, instead of
+ * one indirect call per sample. Not part of the v0.x API, but exported so
+ * legacy applications can opt into span processing with a one-line change. */
+ssize_t iio_buffer_foreach_chunk(struct iio_buffer *buf,
+				 ssize_t (*callback)(const struct iio_channel *chn,
+						     void *first,
+						     size_t nb_samples,
+						     size_t stride, void *d),
+				 void *data)
+{
+	const struct iio_device *dev = IIO_CALL(iio_buffer_get_device)(buf);
+	struct iio_buffer_compat *compat = IIO_CALL(iio_buffer_get_data)(buf);
+	struct iio_device_compat *dev_compat = IIO_CALL(iio_device_get_data)(dev);
+	struct iio_block *block = compat->blocks[compat->curr];
+
+	return IIO_CALL(iio_block_foreach_chunk)(block,
+						 dev_compat->mask,
+						 callback, data);
+}
+
 static void compat_lib_init(void)
 {
 	struct compat *ctx;
@@ -2091,6 +2122,7 @@ static void compat_lib_init(void)
 	FIND_SYMBOL(ctx->lib, iio_block_first);
 	FIND_SYMBOL(ctx->lib, iio_block_end);
 	FIND_SYMBOL(ctx->lib, iio_block_foreach_sample);
+	FIND_SYMBOL(ctx->lib, iio_block_foreach_chunk);
 
 	FIND_SYMBOL(ctx->lib, iio_strlcpy);
 	FIND_SYMBOL(ctx->lib, iio_strdup);
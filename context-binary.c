@@ -0,0 +1,785 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-debug.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compact binary alternative to the XML context description.
+ *
+ * The format is a single pass of length-prefixed tables, all multi-byte
+ * fields little-endian:
+ *
+ *   header:   "IIOB", u16 version, u16 reserved
+ *   context:  str description, str git_tag, u32 major, u32 minor,
+ *             u16 nb_attrs { str name, str value },
+ *             u16 nb_devices { device }
+ *   device:   str id, str name, str label,
+ *             u16 nb_attrs { str name },
+ *             u16 nb_buffer_attrs { str name },
+ *             u16 nb_debug_attrs { str name },
+ *             u16 nb_channels { channel }
+ *   channel:  str id, str name, u8 flags, i32 index,
+ *             u8 length, u8 bits, u8 shift, u8 repeat, u8 format_flags,
+ *             [ f64 scale if CTX_BIN_FMT_WITH_SCALE ],
+ *             u16 nb_attrs { str name, str filename }
+ *
+ * Strings are u16 length + payload (no terminating NUL); the length
+ * 0xffff denotes a NULL (absent) string. Unlike the XML path there is
+ * no DOM: the decoder walks the buffer once and only allocates the
+ * final context structures.
+ */
+
+#define CTX_BIN_MAGIC		"IIOB"
+#define CTX_BIN_VERSION		1
+
+#define CTX_BIN_STR_NULL	0xffff
+
+#define CTX_BIN_CHN_OUTPUT	BIT(0)
+#define CTX_BIN_CHN_SCAN_ELEMENT BIT(1)
+
+#define CTX_BIN_FMT_SIGNED	BIT(0)
+#define CTX_BIN_FMT_BE		BIT(1)
+#define CTX_BIN_FMT_FULLY_DEFINED BIT(2)
+#define CTX_BIN_FMT_WITH_SCALE	BIT(3)
+
+struct ctx_bin_writer {
+	uint8_t *buf;
+	size_t len, size;
+};
+
+struct ctx_bin_reader {
+	const uint8_t *ptr;
+	size_t left;
+};
+
+static int ctx_bin_write(struct ctx_bin_writer *w, const void *src, size_t len)
+{
+	uint8_t *buf;
+	size_t size;
+
+	if (w->len + len > w->size) {
+		size = w->size ? w->size * 2 : 4096;
+		while (w->len + len > size)
+			size *= 2;
+
+		buf = realloc(w->buf, size);
+		if (!buf)
+			return -ENOMEM;
+
+		w->buf = buf;
+		w->size = size;
+	}
+
+	memcpy(w->buf + w->len, src, len);
+	w->len += len;
+
+	return 0;
+}
+
+static int ctx_bin_write_u8(struct ctx_bin_writer *w, uint8_t val)
+{
+	return ctx_bin_write(w, &val, sizeof(val));
+}
+
+static int ctx_bin_write_u16(struct ctx_bin_writer *w, uint16_t val)
+{
+	uint8_t buf[2] = { val & 0xff, val >> 8 };
+
+	return ctx_bin_write(w, buf, sizeof(buf));
+}
+
+static int ctx_bin_write_u32(struct ctx_bin_writer *w, uint32_t val)
+{
+	uint8_t buf[4] = {
+		val & 0xff, (val >> 8) & 0xff,
+		(val >> 16) & 0xff, val >> 24,
+	};
+
+	return ctx_bin_write(w, buf, sizeof(buf));
+}
+
+static int ctx_bin_write_f64(struct ctx_bin_writer *w, double val)
+{
+	uint64_t bits;
+	uint8_t buf[8];
+	unsigned int i;
+
+	memcpy(&bits, &val, sizeof(bits));
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = (bits >> (i * 8)) & 0xff;
+
+	return ctx_bin_write(w, buf, sizeof(buf));
+}
+
+static int ctx_bin_write_str(struct ctx_bin_writer *w, const char *str)
+{
+	size_t len;
+	int ret;
+
+	if (!str)
+		return ctx_bin_write_u16(w, CTX_BIN_STR_NULL);
+
+	len = strlen(str);
+	if (len >= CTX_BIN_STR_NULL)
+		return -EINVAL;
+
+	ret = ctx_bin_write_u16(w, (uint16_t) len);
+	if (ret)
+		return ret;
+
+	return ctx_bin_write(w, str, len);
+}
+
+static int ctx_bin_serialize_channel(struct ctx_bin_writer *w,
+				     const struct iio_channel *chn)
+{
+	uint8_t flags = 0, fmt_flags = 0;
+	unsigned int i;
+	int ret;
+
+	ret = ctx_bin_write_str(w, chn->id);
+	if (!ret)
+		ret = ctx_bin_write_str(w, chn->name);
+	if (ret)
+		return ret;
+
+	if (chn->is_output)
+		flags |= CTX_BIN_CHN_OUTPUT;
+	if (chn->is_scan_element)
+		flags |= CTX_BIN_CHN_SCAN_ELEMENT;
+
+	ret = ctx_bin_write_u8(w, flags);
+	if (!ret)
+		ret = ctx_bin_write_u32(w, (uint32_t)(int32_t) chn->index);
+	if (ret)
+		return ret;
+
+	if (chn->format.is_signed)
+		fmt_flags |= CTX_BIN_FMT_SIGNED;
+	if (chn->format.is_be)
+		fmt_flags |= CTX_BIN_FMT_BE;
+	if (chn->format.is_fully_defined)
+		fmt_flags |= CTX_BIN_FMT_FULLY_DEFINED;
+	if (chn->format.with_scale)
+		fmt_flags |= CTX_BIN_FMT_WITH_SCALE;
+
+	ret = ctx_bin_write_u8(w, (uint8_t) chn->format.length);
+	if (!ret)
+		ret = ctx_bin_write_u8(w, (uint8_t) chn->format.bits);
+	if (!ret)
+		ret = ctx_bin_write_u8(w, (uint8_t) chn->format.shift);
+	if (!ret)
+		ret = ctx_bin_write_u8(w, (uint8_t) chn->format.repeat);
+	if (!ret)
+		ret = ctx_bin_write_u8(w, fmt_flags);
+	if (!ret && chn->format.with_scale)
+		ret = ctx_bin_write_f64(w, chn->format.scale);
+	if (ret)
+		return ret;
+
+	ret = ctx_bin_write_u16(w, (uint16_t) chn->nb_attrs);
+
+	for (i = 0; !ret && i < chn->nb_attrs; i++) {
+		ret = ctx_bin_write_str(w, chn->attrs[i].name);
+		if (!ret)
+			ret = ctx_bin_write_str(w, chn->attrs[i].filename);
+	}
+
+	return ret;
+}
+
+static int ctx_bin_serialize_dev_attrs(struct ctx_bin_writer *w,
+				       const struct iio_dev_attrs *attrs)
+{
+	unsigned int i;
+	int ret;
+
+	ret = ctx_bin_write_u16(w, (uint16_t) attrs->num);
+
+	for (i = 0; !ret && i < attrs->num; i++)
+		ret = ctx_bin_write_str(w, attrs->names[i]);
+
+	return ret;
+}
+
+static int ctx_bin_serialize_device(struct ctx_bin_writer *w,
+				    const struct iio_device *dev)
+{
+	unsigned int i;
+	int ret;
+
+	ret = ctx_bin_write_str(w, dev->id);
+	if (!ret)
+		ret = ctx_bin_write_str(w, dev->name);
+	if (!ret)
+		ret = ctx_bin_write_str(w, dev->label);
+	if (!ret)
+		ret = ctx_bin_serialize_dev_attrs(w, &dev->attrs);
+	if (!ret)
+		ret = ctx_bin_serialize_dev_attrs(w, &dev->buffer_attrs);
+	if (!ret)
+		ret = ctx_bin_serialize_dev_attrs(w, &dev->debug_attrs);
+	if (!ret)
+		ret = ctx_bin_write_u16(w, (uint16_t) dev->nb_channels);
+	if (ret)
+		return ret;
+
+	for (i = 0; !ret && i < dev->nb_channels; i++)
+		ret = ctx_bin_serialize_channel(w, dev->channels[i]);
+
+	return ret;
+}
+
+/* Does "key" (not NUL-terminated, "len" bytes) name this device? Same
+ * matching rules as iio_context_find_device(). */
+static bool ctx_bin_device_key_matches(const struct iio_device *dev,
+				       const char *key, size_t len)
+{
+	return (!strncmp(dev->id, key, len) && !dev->id[len]) ||
+		(dev->label && !strncmp(dev->label, key, len) &&
+		 !dev->label[len]) ||
+		(dev->name && !strncmp(dev->name, key, len) &&
+		 !dev->name[len]);
+}
+
+static bool ctx_bin_device_matches(const struct iio_device *dev,
+				   const char *devs)
+{
+	const char *ptr, *comma;
+
+	for (ptr = devs; *ptr; ptr = comma + !!*comma) {
+		comma = strchr(ptr, ',');
+		if (!comma)
+			comma = ptr + strlen(ptr);
+
+		if (comma != ptr &&
+		    ctx_bin_device_key_matches(dev, ptr, comma - ptr))
+			return true;
+	}
+
+	return false;
+}
+
+static ssize_t ctx_bin_serialize(const struct iio_context *ctx, void **out,
+				 const char *devs)
+{
+	struct ctx_bin_writer w = { 0 };
+	unsigned int i, nb_devices = 0;
+	int ret;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		if (!devs || ctx_bin_device_matches(ctx->devices[i], devs))
+			nb_devices++;
+	}
+
+	if (devs && !nb_devices)
+		return -ENODEV;
+
+	ret = ctx_bin_write(&w, CTX_BIN_MAGIC, sizeof(CTX_BIN_MAGIC) - 1);
+	if (!ret)
+		ret = ctx_bin_write_u16(&w, CTX_BIN_VERSION);
+	if (!ret)
+		ret = ctx_bin_write_u16(&w, 0);
+	if (!ret)
+		ret = ctx_bin_write_str(&w, ctx->description);
+	if (!ret)
+		ret = ctx_bin_write_str(&w, ctx->git_tag);
+	if (!ret)
+		ret = ctx_bin_write_u32(&w, ctx->major);
+	if (!ret)
+		ret = ctx_bin_write_u32(&w, ctx->minor);
+	if (!ret)
+		ret = ctx_bin_write_u16(&w, (uint16_t) ctx->nb_attrs);
+
+	for (i = 0; !ret && i < ctx->nb_attrs; i++) {
+		ret = ctx_bin_write_str(&w, ctx->attrs[i]);
+		if (!ret)
+			ret = ctx_bin_write_str(&w, ctx->values[i]);
+	}
+
+	if (!ret)
+		ret = ctx_bin_write_u16(&w, (uint16_t) nb_devices);
+
+	for (i = 0; !ret && i < ctx->nb_devices; i++) {
+		if (!devs || ctx_bin_device_matches(ctx->devices[i], devs))
+			ret = ctx_bin_serialize_device(&w, ctx->devices[i]);
+	}
+
+	if (ret) {
+		free(w.buf);
+		return ret;
+	}
+
+	*out = w.buf;
+
+	return (ssize_t) w.len;
+}
+
+ssize_t iio_context_serialize_binary(const struct iio_context *ctx, void **out)
+{
+	return ctx_bin_serialize(ctx, out, NULL);
+}
+
+ssize_t iio_context_serialize_binary_filtered(const struct iio_context *ctx,
+					      void **out, const char *devs)
+{
+	return ctx_bin_serialize(ctx, out, devs);
+}
+
+static int ctx_bin_read(struct ctx_bin_reader *r, void *dst, size_t len)
+{
+	if (len > r->left)
+		return -EINVAL;
+
+	memcpy(dst, r->ptr, len);
+	r->ptr += len;
+	r->left -= len;
+
+	return 0;
+}
+
+static int ctx_bin_read_u8(struct ctx_bin_reader *r, uint8_t *val)
+{
+	return ctx_bin_read(r, val, sizeof(*val));
+}
+
+static int ctx_bin_read_u16(struct ctx_bin_reader *r, uint16_t *val)
+{
+	uint8_t buf[2];
+	int ret;
+
+	ret = ctx_bin_read(r, buf, sizeof(buf));
+	if (ret)
+		return ret;
+
+	*val = (uint16_t)(buf[0] | ((uint16_t) buf[1] << 8));
+
+	return 0;
+}
+
+static int ctx_bin_read_u32(struct ctx_bin_reader *r, uint32_t *val)
+{
+	uint8_t buf[4];
+	int ret;
+
+	ret = ctx_bin_read(r, buf, sizeof(buf));
+	if (ret)
+		return ret;
+
+	*val = buf[0] | ((uint32_t) buf[1] << 8) |
+		((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24);
+
+	return 0;
+}
+
+static int ctx_bin_read_f64(struct ctx_bin_reader *r, double *val)
+{
+	uint64_t bits = 0;
+	uint8_t buf[8];
+	unsigned int i;
+	int ret;
+
+	ret = ctx_bin_read(r, buf, sizeof(buf));
+	if (ret)
+		return ret;
+
+	for (i = 0; i < sizeof(buf); i++)
+		bits |= (uint64_t) buf[i] << (i * 8);
+
+	memcpy(val, &bits, sizeof(*val));
+
+	return 0;
+}
+
+/* Read a string; *out is set to NULL (without error) for absent strings. */
+static int ctx_bin_read_str(struct ctx_bin_reader *r, char **out)
+{
+	uint16_t len;
+	int ret;
+
+	ret = ctx_bin_read_u16(r, &len);
+	if (ret)
+		return ret;
+
+	if (len == CTX_BIN_STR_NULL) {
+		*out = NULL;
+		return 0;
+	}
+
+	if (len > r->left)
+		return -EINVAL;
+
+	*out = iio_strndup((const char *) r->ptr, len);
+	if (!*out)
+		return -ENOMEM;
+
+	r->ptr += len;
+	r->left -= len;
+
+	return 0;
+}
+
+/* Same, but interned in the context's string pool */
+static int ctx_bin_read_pool_str(struct ctx_bin_reader *r,
+				 struct iio_str_pool *pool, const char **out)
+{
+	char *str;
+	int ret;
+
+	ret = ctx_bin_read_str(r, &str);
+	if (ret)
+		return ret;
+
+	if (!str) {
+		*out = NULL;
+		return 0;
+	}
+
+	*out = iio_str_pool_get(pool, str);
+	free(str);
+
+	return *out ? 0 : -ENOMEM;
+}
+
+static int ctx_bin_parse_channel(struct iio_device *dev,
+				 struct ctx_bin_reader *r)
+{
+	struct iio_channel *chn, **chns;
+	struct iio_channel_attr *attrs;
+	uint8_t flags, fmt_flags, u8 = 0;
+	uint16_t nb_attrs, i;
+	uint32_t index;
+	int ret;
+
+	chn = zalloc(sizeof(*chn));
+	if (!chn)
+		return -ENOMEM;
+
+	chn->dev = dev;
+
+	ret = ctx_bin_read_str(r, &chn->id);
+	if (!ret)
+		ret = ctx_bin_read_str(r, &chn->name);
+	if (!ret)
+		ret = ctx_bin_read_u8(r, &flags);
+	if (!ret)
+		ret = ctx_bin_read_u32(r, &index);
+	if (ret)
+		goto err_free_channel;
+
+	if (!chn->id) {
+		ret = -EINVAL;
+		goto err_free_channel;
+	}
+
+	chn->is_output = flags & CTX_BIN_CHN_OUTPUT;
+	chn->is_scan_element = flags & CTX_BIN_CHN_SCAN_ELEMENT;
+	chn->index = (long)(int32_t) index;
+
+	ret = ctx_bin_read_u8(r, &u8);
+	chn->format.length = u8;
+	if (!ret)
+		ret = ctx_bin_read_u8(r, &u8);
+	chn->format.bits = u8;
+	if (!ret)
+		ret = ctx_bin_read_u8(r, &u8);
+	chn->format.shift = u8;
+	if (!ret)
+		ret = ctx_bin_read_u8(r, &u8);
+	chn->format.repeat = u8;
+	if (!ret)
+		ret = ctx_bin_read_u8(r, &fmt_flags);
+	if (ret)
+		goto err_free_channel;
+
+	chn->format.is_signed = fmt_flags & CTX_BIN_FMT_SIGNED;
+	chn->format.is_be = fmt_flags & CTX_BIN_FMT_BE;
+	chn->format.is_fully_defined = fmt_flags & CTX_BIN_FMT_FULLY_DEFINED;
+	chn->format.with_scale = fmt_flags & CTX_BIN_FMT_WITH_SCALE;
+
+	if (chn->format.with_scale) {
+		ret = ctx_bin_read_f64(r, &chn->format.scale);
+		if (ret)
+			goto err_free_channel;
+	}
+
+	ret = ctx_bin_read_u16(r, &nb_attrs);
+	if (ret)
+		goto err_free_channel;
+
+	if (nb_attrs) {
+		attrs = calloc(nb_attrs, sizeof(*attrs));
+		if (!attrs) {
+			ret = -ENOMEM;
+			goto err_free_channel;
+		}
+
+		chn->attrs = attrs;
+
+		for (i = 0; i < nb_attrs; i++) {
+			ret = ctx_bin_read_pool_str(r, dev->ctx->str_pool,
+						    &attrs[i].name);
+			if (!ret)
+				ret = ctx_bin_read_pool_str(r,
+							    dev->ctx->str_pool,
+							    &attrs[i].filename);
+			if (ret)
+				goto err_free_channel;
+
+			chn->nb_attrs++;
+
+			if (!attrs[i].name || !attrs[i].filename) {
+				ret = -EINVAL;
+				goto err_free_channel;
+			}
+		}
+	}
+
+	iio_channel_init_finalize(chn);
+
+	chns = realloc(dev->channels,
+		       (1 + dev->nb_channels) * sizeof(struct iio_channel *));
+	if (!chns) {
+		ret = -ENOMEM;
+		goto err_free_channel;
+	}
+
+	chns[dev->nb_channels++] = chn;
+	dev->channels = chns;
+
+	return 0;
+
+err_free_channel:
+	free_channel(chn);
+	return ret;
+}
+
+static int ctx_bin_parse_dev_attrs(struct iio_device *dev,
+				   struct iio_dev_attrs *attrs,
+				   struct ctx_bin_reader *r)
+{
+	uint16_t nb, i;
+	char *name;
+	int ret;
+
+	ret = ctx_bin_read_u16(r, &nb);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < nb; i++) {
+		ret = ctx_bin_read_str(r, &name);
+		if (ret)
+			return ret;
+
+		if (!name)
+			return -EINVAL;
+
+		ret = add_iio_dev_attr(dev, attrs, name, "");
+		free(name);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int ctx_bin_parse_device(struct iio_context *ctx,
+				struct ctx_bin_reader *r)
+{
+	struct iio_device *dev;
+	uint16_t nb_channels, i;
+	int ret;
+
+	dev = zalloc(sizeof(*dev));
+	if (!dev)
+		return -ENOMEM;
+
+	dev->ctx = ctx;
+
+	ret = ctx_bin_read_str(r, &dev->id);
+	if (!ret)
+		ret = ctx_bin_read_str(r, &dev->name);
+	if (!ret)
+		ret = ctx_bin_read_str(r, &dev->label);
+	if (ret)
+		goto err_free_device;
+
+	if (!dev->id) {
+		ret = -EINVAL;
+		goto err_free_device;
+	}
+
+	ret = ctx_bin_parse_dev_attrs(dev, &dev->attrs, r);
+	if (!ret)
+		ret = ctx_bin_parse_dev_attrs(dev, &dev->buffer_attrs, r);
+	if (!ret)
+		ret = ctx_bin_parse_dev_attrs(dev, &dev->debug_attrs, r);
+	if (!ret)
+		ret = ctx_bin_read_u16(r, &nb_channels);
+	if (ret)
+		goto err_free_device;
+
+	for (i = 0; i < nb_channels; i++) {
+		ret = ctx_bin_parse_channel(dev, r);
+		if (ret)
+			goto err_free_device;
+	}
+
+	ret = iio_context_add_device(ctx, dev);
+	if (ret)
+		goto err_free_device;
+
+	return 0;
+
+err_free_device:
+	free_device(dev);
+	return ret;
+}
+
+struct iio_context *
+iio_create_context_from_binary(const struct iio_context_params *params,
+			       const struct iio_backend *backend,
+			       const char *description, const char **ctx_attrs,
+			       const char **ctx_values,
+			       unsigned int nb_ctx_attrs,
+			       const void *data, size_t data_len)
+{
+	struct ctx_bin_reader r = { data, data_len };
+	char *bin_description = NULL, *git_tag = NULL,
+	     *name = NULL, *value = NULL, *new_description;
+	struct iio_context *ctx = NULL;
+	uint32_t major, minor;
+	uint16_t version, reserved, nb, i;
+	uint8_t magic[sizeof(CTX_BIN_MAGIC) - 1];
+	ssize_t len;
+	int ret;
+
+	ret = ctx_bin_read(&r, magic, sizeof(magic));
+	if (ret)
+		return iio_ptr(ret);
+
+	if (memcmp(magic, CTX_BIN_MAGIC, sizeof(magic)))
+		return iio_ptr(-EINVAL);
+
+	ret = ctx_bin_read_u16(&r, &version);
+	if (!ret)
+		ret = ctx_bin_read_u16(&r, &reserved);
+	if (ret)
+		return iio_ptr(ret);
+
+	if (version != CTX_BIN_VERSION) {
+		prm_err(params, "Unsupported binary context version %u\n",
+			version);
+		return iio_ptr(-EINVAL);
+	}
+
+	ret = ctx_bin_read_str(&r, &bin_description);
+	if (!ret)
+		ret = ctx_bin_read_str(&r, &git_tag);
+	if (!ret)
+		ret = ctx_bin_read_u32(&r, &major);
+	if (!ret)
+		ret = ctx_bin_read_u32(&r, &minor);
+	if (ret)
+		goto err_free_strings;
+
+	ctx = iio_context_create_from_backend(backend, bin_description);
+	ret = iio_err(ctx);
+	if (ret) {
+		ctx = NULL;
+		goto err_free_strings;
+	}
+
+	ctx->params = *params;
+
+	if (git_tag) {
+		ctx->major = major;
+		ctx->minor = minor;
+		ctx->git_tag = git_tag;
+		git_tag = NULL;
+	}
+
+	if (description && ctx->description) {
+		len = iio_snprintf(NULL, 0, "%s %s",
+				   description, ctx->description);
+		if (len < 0) {
+			ret = (int) len;
+			goto err_free_strings;
+		}
+
+		new_description = malloc(len + 1);
+		if (!new_description) {
+			ret = -ENOMEM;
+			goto err_free_strings;
+		}
+
+		iio_snprintf(new_description, len + 1, "%s %s",
+			     description, ctx->description);
+
+		free(ctx->description);
+		ctx->description = new_description;
+	}
+
+	for (i = 0; i < nb_ctx_attrs; i++) {
+		ret = iio_context_add_attr(ctx, ctx_attrs[i], ctx_values[i]);
+		if (ret)
+			goto err_free_strings;
+	}
+
+	ret = ctx_bin_read_u16(&r, &nb);
+	if (ret)
+		goto err_free_strings;
+
+	for (i = 0; i < nb; i++) {
+		ret = ctx_bin_read_str(&r, &name);
+		if (!ret)
+			ret = ctx_bin_read_str(&r, &value);
+		if (!ret && (!name || !value))
+			ret = -EINVAL;
+		if (!ret)
+			ret = iio_context_add_attr(ctx, name, value);
+
+		free(name);
+		free(value);
+		name = NULL;
+		value = NULL;
+
+		if (ret)
+			goto err_free_strings;
+	}
+
+	ret = ctx_bin_read_u16(&r, &nb);
+	if (ret)
+		goto err_free_strings;
+
+	for (i = 0; i < nb; i++) {
+		ret = ctx_bin_parse_device(ctx, &r);
+		if (ret)
+			goto err_free_strings;
+	}
+
+	ret = iio_context_init(ctx);
+	if (ret)
+		goto err_free_strings;
+
+	free(bin_description);
+
+	return ctx;
+
+err_free_strings:
+	free(bin_description);
+	free(git_tag);
+	if (ctx)
+		iio_context_destroy(ctx);
+	return iio_ptr(ret);
+}
@@ -11,6 +11,7 @@
 #include "sort.h"
 
 #include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
 
 #include <errno.h>
 #include <string.h>
@@ -87,7 +88,7 @@ static ssize_t sanitize_xml(char *ptr, ssize_t len, const char *str)
 }
 
 ssize_t iio_xml_print_and_sanitized_param(char *ptr, ssize_t len,
-					  const char *before, char *param,
+					  const char *before, const char *param,
 					  const char *after)
 {
 	ssize_t ret, alen = 0;
@@ -206,6 +207,7 @@ struct iio_context * iio_context_create_from_backend(
 		const char *description)
 {
 	struct iio_context *ctx;
+	const char *env;
 	int ret;
 
 	if (!backend)
@@ -222,11 +224,30 @@ struct iio_context * iio_context_create_from_backend(
 			goto err_free_ctx;
 	}
 
+	ctx->str_pool = iio_str_pool_create();
+	if (!ctx->str_pool)
+		goto err_free_description;
+
+	ctx->attr_queue = iio_attr_queue_create();
+	if (!ctx->attr_queue)
+		goto err_free_str_pool;
+
 	ctx->name = backend->name;
 	ctx->ops = backend->ops;
 
+	/* IIO_ATTR_CACHE opts in to the attribute value cache, with the
+	 * TTL in milliseconds. Best effort; a failure just leaves the
+	 * cache disabled. */
+	env = getenv("IIO_ATTR_CACHE"); /* Flawfinder: ignore */
+	if (env)
+		iio_attr_cache_set_ttl(ctx, (unsigned int) strtoul(env, NULL, 10));
+
 	return ctx;
 
+err_free_str_pool:
+	iio_str_pool_destroy(ctx->str_pool);
+err_free_description:
+	free(ctx->description);
 err_free_ctx:
 	free(ctx);
 	return iio_ptr(ret);
@@ -250,6 +271,23 @@ void iio_context_set_pdata(struct iio_context *ctx, struct iio_context_pdata *d)
 
 const char * iio_context_get_xml(const struct iio_context *ctx)
 {
+	struct iio_context *mut = (struct iio_context *) ctx;
+	unsigned int i;
+	char *xml;
+
+	if (!ctx->xml) {
+		/* Lazy context: hydrate every device, then generate the
+		 * description on first request. */
+		for (i = 0; i < ctx->nb_devices; i++)
+			iio_device_hydrate(ctx->devices[i]);
+
+		xml = iio_context_create_xml(ctx);
+		if (iio_err(xml))
+			return NULL;
+
+		mut->xml = xml;
+	}
+
 	return ctx->xml;
 }
 
@@ -271,9 +309,14 @@ void iio_context_destroy(struct iio_context *ctx)
 	unsigned int i;
 	void *lib = ctx->lib;
 
+	iio_context_unwatch_devices(ctx);
+
 	if (ctx->ops->shutdown)
 		ctx->ops->shutdown(ctx);
 
+	iio_attr_cache_destroy(ctx);
+	iio_attr_queue_destroy(ctx);
+
 	for (i = 0; i < ctx->nb_attrs; i++) {
 		free(ctx->attrs[i]);
 		free(ctx->values[i]);
@@ -283,6 +326,7 @@ void iio_context_destroy(struct iio_context *ctx)
 	for (i = 0; i < ctx->nb_devices; i++)
 		free_device(ctx->devices[i]);
 	free(ctx->devices);
+	iio_str_pool_destroy(ctx->str_pool);
 	free(ctx->xml);
 	free(ctx->description);
 	free(ctx->git_tag);
@@ -321,7 +365,7 @@ struct iio_device * iio_context_find_device(const struct iio_context *ctx,
 	return NULL;
 }
 
-static void reorder_channels(struct iio_device *dev)
+void reorder_channels(struct iio_device *dev)
 {
 	bool found;
 	unsigned int i;
@@ -350,6 +394,8 @@ static void reorder_channels(struct iio_device *dev)
 
 	for (i = 0; i < dev->nb_channels; i++)
 		dev->channels[i]->number = i;
+
+	iio_device_build_index(dev);
 }
 
 int iio_context_init(struct iio_context *ctx)
@@ -359,7 +405,9 @@ int iio_context_init(struct iio_context *ctx)
 	for (i = 0; i < ctx->nb_devices; i++)
 		reorder_channels(ctx->devices[i]);
 
-	if (ctx->xml)
+	/* In lazy mode the description is generated on the first call to
+	 * iio_context_get_xml() instead. */
+	if (ctx->xml || ctx->params.lazy)
 		return 0;
 
 	ctx->xml = iio_context_create_xml(ctx);
@@ -406,12 +454,98 @@ int iio_context_set_timeout(struct iio_context *ctx, unsigned int timeout)
 	return 0;
 }
 
+int iio_context_set_attr_cache_ttl(struct iio_context *ctx,
+				   unsigned int ttl_ms)
+{
+	return iio_attr_cache_set_ttl(ctx, ttl_ms);
+}
+
+int iio_context_watch_devices(struct iio_context *ctx,
+			      void (*cb)(const struct iio_context *ctx,
+					 const char *id, bool added, void *d),
+			      void *d)
+{
+	if (!cb)
+		return -EINVAL;
+
+	if (!ctx->ops->watch_devices)
+		return -ENOSYS;
+
+	return ctx->ops->watch_devices(ctx, cb, d);
+}
+
+void iio_context_unwatch_devices(struct iio_context *ctx)
+{
+	if (ctx->ops->unwatch_devices)
+		ctx->ops->unwatch_devices(ctx);
+}
+
+struct iio_device *
+iio_context_insert_device(struct iio_context *ctx, const char *id)
+{
+	struct iio_device *dev;
+	int err;
+
+	if (!ctx->ops->insert_device)
+		return iio_ptr(-ENOSYS);
+
+	if (iio_context_find_device(ctx, id))
+		return iio_ptr(-EEXIST);
+
+	dev = ctx->ops->insert_device(ctx, id);
+	err = iio_err(dev);
+	if (err)
+		return dev;
+
+	err = iio_context_add_device(ctx, dev);
+	if (err) {
+		if (ctx->ops->remove_device)
+			ctx->ops->remove_device(dev);
+		free_device(dev);
+		return iio_ptr(err);
+	}
+
+	return dev;
+}
+
+int iio_context_remove_device(struct iio_context *ctx, struct iio_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		if (ctx->devices[i] == dev)
+			break;
+	}
+
+	if (i == ctx->nb_devices)
+		return -ENODEV;
+
+	if (ctx->ops->remove_device)
+		ctx->ops->remove_device(dev);
+
+	memmove(&ctx->devices[i], &ctx->devices[i + 1],
+		(ctx->nb_devices - i - 1) * sizeof(*ctx->devices));
+	ctx->nb_devices--;
+
+	/* Cached attribute values are keyed by object pointers, which a
+	 * later allocation could re-use; drop them all. */
+	iio_attr_cache_drop(ctx);
+
+	free_device(dev);
+
+	return 0;
+}
+
 const struct iio_backend *iio_backends[] = {
 	IF_ENABLED(WITH_LOCAL_BACKEND, &iio_local_backend),
 	IF_ENABLED(WITH_NETWORK_BACKEND && !WITH_NETWORK_BACKEND_DYNAMIC,
 		   &iio_ip_backend),
+	IF_ENABLED(WITH_RDMA_BACKEND && !WITH_RDMA_BACKEND_DYNAMIC,
+		   &iio_rdma_backend),
 	IF_ENABLED(WITH_SERIAL_BACKEND && !WITH_SERIAL_BACKEND_DYNAMIC,
 		   &iio_serial_backend),
+	IF_ENABLED(WITH_NETWORK_BACKEND && !WITH_NETWORK_BACKEND_DYNAMIC,
+		   &iio_uds_backend),
 	IF_ENABLED(WITH_USB_BACKEND && !WITH_USB_BACKEND_DYNAMIC,
 		   &iio_usb_backend),
 	IF_ENABLED(WITH_XML_BACKEND, &iio_xml_backend),
@@ -468,6 +602,123 @@ struct iio_context * iio_create_context(const struct iio_context_params *params,
 	return ctx;
 }
 
+struct iio_context_future {
+	struct iio_thrd *thrd;
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+
+	struct iio_context_params params;
+	bool has_params;
+	char *uri;
+
+	struct iio_context *ctx;
+	bool done;
+};
+
+static int iio_create_context_thrd(void *d)
+{
+	struct iio_context_future *future = d;
+	struct iio_context *ctx;
+
+	ctx = iio_create_context(future->has_params ? &future->params : NULL,
+				 future->uri);
+
+	iio_mutex_lock(future->lock);
+	future->ctx = ctx;
+	future->done = true;
+	iio_cond_signal(future->cond);
+	iio_mutex_unlock(future->lock);
+
+	return 0;
+}
+
+struct iio_context_future *
+iio_create_context_async(const struct iio_context_params *params,
+			 const char *uri)
+{
+	struct iio_context_future *future;
+	int ret;
+
+	future = zalloc(sizeof(*future));
+	if (!future)
+		return iio_ptr(-ENOMEM);
+
+	/* The caller's params and URI only have to stay valid for the
+	 * duration of this call; keep copies for the worker thread. */
+	if (params) {
+		future->params = *params;
+		future->has_params = true;
+	}
+
+	if (uri) {
+		future->uri = iio_strdup(uri);
+		if (!future->uri) {
+			ret = -ENOMEM;
+			goto err_free_future;
+		}
+	}
+
+	future->lock = iio_mutex_create();
+	ret = iio_err(future->lock);
+	if (ret)
+		goto err_free_uri;
+
+	future->cond = iio_cond_create();
+	ret = iio_err(future->cond);
+	if (ret)
+		goto err_free_lock;
+
+	future->thrd = iio_thrd_create(iio_create_context_thrd, future,
+				       "iio-connect");
+	ret = iio_err(future->thrd);
+	if (ret)
+		goto err_free_cond;
+
+	return future;
+
+err_free_cond:
+	iio_cond_destroy(future->cond);
+err_free_lock:
+	iio_mutex_destroy(future->lock);
+err_free_uri:
+	free(future->uri);
+err_free_future:
+	free(future);
+	return iio_ptr(ret);
+}
+
+bool iio_context_future_done(struct iio_context_future *future)
+{
+	bool done;
+
+	iio_mutex_lock(future->lock);
+	done = future->done;
+	iio_mutex_unlock(future->lock);
+
+	return done;
+}
+
+struct iio_context * iio_context_future_get(struct iio_context_future *future)
+{
+	struct iio_context *ctx;
+
+	iio_mutex_lock(future->lock);
+	while (!future->done)
+		iio_cond_wait(future->cond, future->lock, 0);
+	iio_mutex_unlock(future->lock);
+
+	iio_thrd_join_and_destroy(future->thrd);
+
+	ctx = future->ctx;
+
+	iio_cond_destroy(future->cond);
+	iio_mutex_destroy(future->lock);
+	free(future->uri);
+	free(future);
+
+	return ctx;
+}
+
 unsigned int iio_context_get_attrs_count(const struct iio_context *ctx)
 {
 	return ctx->nb_attrs;
@@ -501,9 +752,20 @@ const char * iio_context_get_attr_value(
 
 int iio_context_add_device(struct iio_context *ctx, struct iio_device *dev)
 {
-	struct iio_device **devices = realloc(ctx->devices,
-			(ctx->nb_devices + 1) * sizeof(struct iio_device *));
+	struct iio_device **devices;
+	int err;
+
+	if (!dev->hydrate_lock) {
+		dev->hydrate_lock = iio_mutex_create();
+		err = iio_err(dev->hydrate_lock);
+		if (err) {
+			dev->hydrate_lock = NULL;
+			return err;
+		}
+	}
 
+	devices = realloc(ctx->devices,
+			(ctx->nb_devices + 1) * sizeof(struct iio_device *));
 	if (!devices) {
 		ctx_err(ctx, "Unable to allocate memory\n");
 		return -ENOMEM;
@@ -635,6 +897,104 @@ err_context_destroy:
 	return iio_ptr(ret);
 }
 
+static ssize_t iio_bulk_attr_rw(struct iio_bulk_attr *attr, bool write)
+{
+	if (attr->chn) {
+		if (write) {
+			return iio_channel_attr_write_raw(attr->chn,
+							  attr->attr,
+							  attr->value,
+							  attr->len);
+		}
+
+		return iio_channel_attr_read_raw(attr->chn, attr->attr,
+						 attr->value, attr->len);
+	}
+
+	switch (attr->type) {
+	case IIO_ATTR_TYPE_DEVICE:
+		if (write) {
+			return iio_device_attr_write_raw(attr->dev, attr->attr,
+							 attr->value,
+							 attr->len);
+		}
+
+		return iio_device_attr_read_raw(attr->dev, attr->attr,
+						attr->value, attr->len);
+	case IIO_ATTR_TYPE_DEBUG:
+		if (write) {
+			return iio_device_debug_attr_write_raw(attr->dev,
+							       attr->attr,
+							       attr->value,
+							       attr->len);
+		}
+
+		return iio_device_debug_attr_read_raw(attr->dev, attr->attr,
+						      attr->value, attr->len);
+	case IIO_ATTR_TYPE_BUFFER:
+		if (write) {
+			return iio_device_buffer_attr_write_raw(attr->dev,
+								attr->buf_id,
+								attr->attr,
+								attr->value,
+								attr->len);
+		}
+
+		return iio_device_buffer_attr_read_raw(attr->dev,
+						       attr->buf_id,
+						       attr->attr,
+						       attr->value,
+						       attr->len);
+	default:
+		return -EINVAL;
+	}
+}
+
+static int iio_attrs_bulk(struct iio_bulk_attr *attrs, size_t nb, bool write)
+{
+	const struct iio_context *ctx;
+	size_t i;
+	int ret;
+
+	if (!nb || !attrs[0].dev)
+		return -EINVAL;
+
+	ctx = attrs[0].dev->ctx;
+
+	for (i = 0; i < nb; i++) {
+		if (!attrs[i].dev || attrs[i].dev->ctx != ctx)
+			return -EINVAL;
+	}
+
+	if (!write && ctx->ops->read_attrs_bulk) {
+		ret = ctx->ops->read_attrs_bulk(ctx, attrs, nb);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	if (write && ctx->ops->write_attrs_bulk) {
+		ret = ctx->ops->write_attrs_bulk(ctx, attrs, nb);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	/* No bulk support in the backend: access the attributes one by one */
+	for (i = 0; i < nb; i++)
+		attrs[i].ret = iio_bulk_attr_rw(&attrs[i], write);
+
+	return 0;
+}
+
+int iio_attrs_read_bulk(struct iio_bulk_attr *attrs, size_t nb)
+{
+	return iio_attrs_bulk(attrs, nb, false);
+}
+
+int iio_attrs_write_bulk(struct iio_bulk_attr *attrs, size_t nb)
+{
+	return iio_attrs_bulk(attrs, nb, true);
+}
+
 void iio_context_set_data(struct iio_context *ctx, void *data)
 {
 	ctx->userdata = data;
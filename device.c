@@ -9,6 +9,7 @@
 #include "iio-private.h"
 
 #include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <stdio.h>
@@ -107,17 +108,15 @@ ssize_t iio_snprintf_device_xml(char *ptr, ssize_t len,
 int add_iio_dev_attr(struct iio_device *dev, struct iio_dev_attrs *attrs,
 		     const char *attr, const char *type)
 {
-	char **names, *name;
+	const char **names, *name;
 
-	name = iio_strdup(attr);
+	name = iio_str_pool_get(dev->ctx->str_pool, attr);
 	if (!name)
 		return -ENOMEM;
 
 	names = realloc(attrs->names, (1 + attrs->num) * sizeof(char *));
-	if (!names) {
-		free(name);
+	if (!names)
 		return -ENOMEM;
-	}
 
 	names[attrs->num++] = name;
 	attrs->names = names;
@@ -126,6 +125,84 @@ int add_iio_dev_attr(struct iio_device *dev, struct iio_dev_attrs *attrs,
 	return 0;
 }
 
+/* (Re)build the hash indexes used by the lookup functions. Called once
+ * the channel and attribute sets are final; failure to allocate a table
+ * is not fatal, the lookups then fall back to a linear scan. */
+void iio_device_build_index(struct iio_device *dev)
+{
+	struct iio_channel *chn;
+	unsigned int i, j;
+	int ret;
+
+	iio_str_index_release(&dev->chn_index);
+
+	if (dev->nb_channels) {
+		/* Two keys per channel: its ID and its name */
+		ret = iio_str_index_init(&dev->chn_index,
+					 dev->nb_channels * 2);
+		if (ret < 0)
+			return;
+
+		for (i = 0; i < dev->nb_channels; i++) {
+			chn = dev->channels[i];
+
+			iio_str_index_add(&dev->chn_index, chn->id, chn);
+			if (chn->name)
+				iio_str_index_add(&dev->chn_index,
+						  chn->name, chn);
+		}
+	}
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+
+		iio_str_index_release(&chn->attr_index);
+
+		if (!chn->nb_attrs)
+			continue;
+
+		ret = iio_str_index_init(&chn->attr_index, chn->nb_attrs);
+		if (ret < 0)
+			continue;
+
+		for (j = 0; j < chn->nb_attrs; j++)
+			iio_str_index_add(&chn->attr_index,
+					  chn->attrs[j].name,
+					  (char *) chn->attrs[j].name);
+	}
+}
+
+int iio_device_hydrate(const struct iio_device *d)
+{
+	struct iio_device *dev = (struct iio_device *) d;
+	int ret = 0;
+
+	/* Unlocked fast path: "lazy" is only ever cleared, so a stale
+	 * read here simply sends us through the locked path below. */
+	if (!dev->lazy)
+		return 0;
+
+	iio_mutex_lock(dev->hydrate_lock);
+
+	if (!dev->lazy) {
+		/* Another thread hydrated the device while we waited */
+	} else if (!dev->ctx->ops->hydrate) {
+		ret = -ENOSYS;
+	} else {
+		ret = dev->ctx->ops->hydrate(dev);
+		if (ret < 0) {
+			dev_perror(dev, ret, "Unable to hydrate device");
+		} else {
+			reorder_channels(dev);
+			dev->lazy = false;
+		}
+	}
+
+	iio_mutex_unlock(dev->hydrate_lock);
+
+	return ret;
+}
+
 const char * iio_device_get_id(const struct iio_device *dev)
 {
 	return dev->id;
@@ -143,22 +220,42 @@ const char * iio_device_get_label(const struct iio_device *dev)
 
 unsigned int iio_device_get_channels_count(const struct iio_device *dev)
 {
+	iio_device_hydrate(dev);
+
 	return dev->nb_channels;
 }
 
 struct iio_channel * iio_device_get_channel(const struct iio_device *dev,
 		unsigned int index)
 {
+	iio_device_hydrate(dev);
+
 	if (index >= dev->nb_channels)
 		return NULL;
 	else
 		return dev->channels[index];
 }
 
+static bool iio_channel_match_output(void *ptr, void *d)
+{
+	struct iio_channel *chn = ptr;
+	bool *output = d;
+
+	return iio_channel_is_output(chn) == *output;
+}
+
 struct iio_channel * iio_device_find_channel(const struct iio_device *dev,
 		const char *name, bool output)
 {
 	unsigned int i;
+
+	iio_device_hydrate(dev);
+
+	if (dev->chn_index.entries) {
+		return iio_str_index_find(&dev->chn_index, name,
+					  iio_channel_match_output, &output);
+	}
+
 	for (i = 0; i < dev->nb_channels; i++) {
 		struct iio_channel *chn = dev->channels[i];
 		if (iio_channel_is_output(chn) != output)
@@ -194,41 +291,55 @@ const char * iio_device_find_dev_attr(const struct iio_dev_attrs *attrs,
 
 unsigned int iio_device_get_attrs_count(const struct iio_device *dev)
 {
+	iio_device_hydrate(dev);
+
 	return dev->attrs.num;
 }
 
 const char * iio_device_get_attr(const struct iio_device *dev,
 		unsigned int index)
 {
+	iio_device_hydrate(dev);
+
 	return iio_device_get_dev_attr(&dev->attrs, index);
 }
 
 const char * iio_device_find_attr(const struct iio_device *dev,
 		const char *name)
 {
+	iio_device_hydrate(dev);
+
 	return iio_device_find_dev_attr(&dev->attrs, name);
 }
 
 unsigned int iio_device_get_buffer_attrs_count(const struct iio_device *dev)
 {
+	iio_device_hydrate(dev);
+
 	return dev->buffer_attrs.num;
 }
 
 const char * iio_device_get_buffer_attr(const struct iio_device *dev,
 		unsigned int index)
 {
+	iio_device_hydrate(dev);
+
 	return iio_device_get_dev_attr(&dev->buffer_attrs, index);
 }
 
 const char * iio_device_find_buffer_attr(const struct iio_device *dev,
 		const char *name)
 {
+	iio_device_hydrate(dev);
+
 	return iio_device_find_dev_attr(&dev->buffer_attrs, name);
 }
 
 const char * iio_device_find_debug_attr(const struct iio_device *dev,
 		const char *name)
 {
+	iio_device_hydrate(dev);
+
 	return iio_device_find_dev_attr(&dev->debug_attrs, name);
 }
 
@@ -237,6 +348,8 @@ bool iio_device_is_tx(const struct iio_device *dev)
 	struct iio_channel *ch;
 	unsigned int i;
 
+	iio_device_hydrate(dev);
+
 	for (i = 0; i < dev->nb_channels; i++) {
 		ch = dev->channels[i];
 		if (iio_channel_is_output(ch) && iio_channel_is_scan_element(ch))
@@ -249,27 +362,50 @@ bool iio_device_is_tx(const struct iio_device *dev)
 ssize_t iio_device_attr_read_raw(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len)
 {
+	ssize_t ret;
+
 	if (!attr)
 		return -EINVAL;
 
-	if (dev->ctx->ops->read_device_attr)
-		return dev->ctx->ops->read_device_attr(dev, 0,
-				attr, dst, len, IIO_ATTR_TYPE_DEVICE);
-	else
+	if (!dev->ctx->ops->read_device_attr)
 		return -ENOSYS;
+
+	ret = iio_attr_cache_get(dev->ctx, dev, 0, IIO_ATTR_TYPE_DEVICE,
+				 attr, dst, len);
+	if (ret >= 0)
+		return ret;
+
+	ret = dev->ctx->ops->read_device_attr(dev, 0, attr, dst, len,
+					      IIO_ATTR_TYPE_DEVICE);
+
+	/* Don't cache values that may have been truncated to "len" */
+	if (ret > 0 && (size_t) ret < len) {
+		iio_attr_cache_store(dev->ctx, dev, 0, IIO_ATTR_TYPE_DEVICE,
+				     attr, dst, (size_t) ret);
+	}
+
+	return ret;
 }
 
 ssize_t iio_device_attr_write_raw(const struct iio_device *dev,
 		const char *attr, const void *src, size_t len)
 {
+	ssize_t ret;
+
 	if (!attr)
 		return -EINVAL;
 
-	if (dev->ctx->ops->write_device_attr)
-		return dev->ctx->ops->write_device_attr(dev, 0,
-				attr, src, len, IIO_ATTR_TYPE_DEVICE);
-	else
+	if (!dev->ctx->ops->write_device_attr)
 		return -ENOSYS;
+
+	ret = dev->ctx->ops->write_device_attr(dev, 0,
+			attr, src, len, IIO_ATTR_TYPE_DEVICE);
+	if (ret >= 0) {
+		iio_attr_cache_invalidate(dev->ctx, dev, 0,
+					  IIO_ATTR_TYPE_DEVICE, attr);
+	}
+
+	return ret;
 }
 
 ssize_t iio_device_attr_write_string(const struct iio_device *dev,
@@ -282,28 +418,51 @@ ssize_t iio_device_buffer_attr_read_raw(const struct iio_device *dev,
 					unsigned int buf_id, const char *attr,
 					char *dst, size_t len)
 {
+	ssize_t ret;
+
 	if (!attr)
 		return -EINVAL;
 
-	if (dev->ctx->ops->read_device_attr)
-		return dev->ctx->ops->read_device_attr(dev, buf_id,
-				attr, dst, len, IIO_ATTR_TYPE_BUFFER);
-	else
+	if (!dev->ctx->ops->read_device_attr)
 		return -ENOSYS;
+
+	ret = iio_attr_cache_get(dev->ctx, dev, buf_id, IIO_ATTR_TYPE_BUFFER,
+				 attr, dst, len);
+	if (ret >= 0)
+		return ret;
+
+	ret = dev->ctx->ops->read_device_attr(dev, buf_id, attr, dst, len,
+					      IIO_ATTR_TYPE_BUFFER);
+
+	if (ret > 0 && (size_t) ret < len) {
+		iio_attr_cache_store(dev->ctx, dev, buf_id,
+				     IIO_ATTR_TYPE_BUFFER, attr, dst,
+				     (size_t) ret);
+	}
+
+	return ret;
 }
 
 ssize_t iio_device_buffer_attr_write_raw(const struct iio_device *dev,
 					 unsigned int buf_id, const char *attr,
 					 const void *src, size_t len)
 {
+	ssize_t ret;
+
 	if (!attr)
 		return -EINVAL;
 
-	if (dev->ctx->ops->write_device_attr)
-		return dev->ctx->ops->write_device_attr(dev, buf_id,
-				attr, src, len, IIO_ATTR_TYPE_BUFFER);
-	else
+	if (!dev->ctx->ops->write_device_attr)
 		return -ENOSYS;
+
+	ret = dev->ctx->ops->write_device_attr(dev, buf_id,
+			attr, src, len, IIO_ATTR_TYPE_BUFFER);
+	if (ret >= 0) {
+		iio_attr_cache_invalidate(dev->ctx, dev, buf_id,
+					  IIO_ATTR_TYPE_BUFFER, attr);
+	}
+
+	return ret;
 }
 
 ssize_t iio_device_buffer_attr_write_string(const struct iio_device *dev,
@@ -360,11 +519,7 @@ int iio_device_set_trigger(const struct iio_device *dev,
 
 static void free_iio_dev_attrs(struct iio_dev_attrs *attrs)
 {
-	unsigned int i;
-
-	for (i = 0; i <  attrs->num; i++)
-		free(attrs->names[i]);
-
+	/* The names themselves belong to the context's string pool */
 	free(attrs->names);
 }
 
@@ -376,6 +531,12 @@ void free_device(struct iio_device *dev)
 	free_iio_dev_attrs(&dev->buffer_attrs);
 	free_iio_dev_attrs(&dev->debug_attrs);
 
+	iio_str_index_release(&dev->chn_index);
+
+	/* NULL when the device never made it into the context */
+	if (dev->hydrate_lock)
+		iio_mutex_destroy(dev->hydrate_lock);
+
 	for (i = 0; i < dev->nb_channels; i++)
 		free_channel(dev->channels[i]);
 	free(dev->channels);
@@ -392,6 +553,8 @@ ssize_t iio_device_get_sample_size(const struct iio_device *dev,
 	unsigned int i, largest = 1;
 	const struct iio_channel *prev = NULL;
 
+	iio_device_hydrate(dev);
+
 	if (mask->words != (dev->nb_channels + 31) / 32)
 		return -EINVAL;
 
@@ -634,12 +797,16 @@ ssize_t iio_device_debug_attr_write_string(const struct iio_device *dev,
 
 unsigned int iio_device_get_debug_attrs_count(const struct iio_device *dev)
 {
+	iio_device_hydrate(dev);
+
 	return dev->debug_attrs.num;
 }
 
 const char * iio_device_get_debug_attr(const struct iio_device *dev,
 		unsigned int index)
 {
+	iio_device_hydrate(dev);
+
 	return iio_device_get_dev_attr(&dev->debug_attrs, index);
 }
 
@@ -753,6 +920,57 @@ int iio_device_reg_read(struct iio_device *dev,
 	return ret;
 }
 
+int iio_device_reg_read_multi(struct iio_device *dev,
+		const uint32_t *addrs, uint32_t *values, size_t nb)
+{
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	size_t i;
+	int ret;
+
+	if (!nb)
+		return -EINVAL;
+
+	if (ops->reg_read_multi) {
+		ret = ops->reg_read_multi(dev, addrs, values, nb);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	/* Fallback: one register per round trip */
+	for (i = 0; i < nb; i++) {
+		ret = iio_device_reg_read(dev, addrs[i], &values[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int iio_device_reg_write_multi(struct iio_device *dev,
+		const uint32_t *addrs, const uint32_t *values, size_t nb)
+{
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	size_t i;
+	int ret;
+
+	if (!nb)
+		return -EINVAL;
+
+	if (ops->reg_write_multi) {
+		ret = ops->reg_write_multi(dev, addrs, values, nb);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	for (i = 0; i < nb; i++) {
+		ret = iio_device_reg_write(dev, addrs[i], values[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
 const struct iio_context * iio_device_get_context(const struct iio_device *dev)
 {
 	return dev->ctx;
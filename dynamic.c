@@ -12,6 +12,7 @@
 
 #include <iio/iio-backend.h>
 #include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
 
 #include <errno.h>
 #include <stdio.h>
@@ -22,8 +23,79 @@ struct iio_module {
 	const struct iio_context_params *params;
 	void *lib;
 	char *name;
+
+	/* Cached modules stay loaded for the lifetime of the process, so
+	 * that only the very first context using a backend pays the
+	 * dynamic loader's price. */
+	struct iio_module *next;
+	unsigned int refs;
 };
 
+/* NULL when the cache could not be initialized; modules are then opened
+ * and closed per context, as before. */
+static struct iio_mutex *modules_lock;
+static struct iio_module *modules_cache;
+
+static struct iio_module *
+iio_module_cache_get(const struct iio_context_params *params, const char *name)
+{
+	struct iio_module *module = NULL, *m;
+
+	if (!modules_lock)
+		return NULL;
+
+	iio_mutex_lock(modules_lock);
+
+	for (m = modules_cache; m; m = m->next) {
+		if (!strcmp(m->name, name)) {
+			m->refs++;
+			m->params = params;
+			module = m;
+			break;
+		}
+	}
+
+	iio_mutex_unlock(modules_lock);
+
+	return module;
+}
+
+static struct iio_module * iio_module_cache_add(struct iio_module *module)
+{
+	struct iio_module *m;
+
+	if (!modules_lock)
+		return module;
+
+	iio_mutex_lock(modules_lock);
+
+	for (m = modules_cache; m; m = m->next) {
+		if (!strcmp(m->name, module->name))
+			break;
+	}
+
+	if (m) {
+		/* Raced with another thread loading the same module */
+		m->refs++;
+		m->params = module->params;
+	} else {
+		module->refs = 1;
+		module->next = modules_cache;
+		modules_cache = module;
+	}
+
+	iio_mutex_unlock(modules_lock);
+
+	if (!m)
+		return module;
+
+	iio_dlclose(module->lib);
+	free(module->name);
+	free(module);
+
+	return m;
+}
+
 struct iio_module * iio_open_module(const struct iio_context_params *params,
 				    const char *name)
 {
@@ -31,6 +103,10 @@ struct iio_module * iio_open_module(const struct iio_context_params *params,
 	struct iio_module *module;
 	int err = -ENOMEM;
 
+	module = iio_module_cache_get(params, name);
+	if (module)
+		return module;
+
 	module = zalloc(sizeof(*module));
 	if (!module)
 		return iio_ptr(-ENOMEM);
@@ -53,7 +129,7 @@ struct iio_module * iio_open_module(const struct iio_context_params *params,
 		goto err_free_name;
 	}
 
-	return module;
+	return iio_module_cache_add(module);
 
 err_free_name:
 	free(module->name);
@@ -64,18 +140,28 @@ err_free_module:
 
 void iio_release_module(struct iio_module *module)
 {
+	if (modules_lock) {
+		/* Cached modules are kept loaded, so that the next context
+		 * creation does not go through the loader again. */
+		iio_mutex_lock(modules_lock);
+		module->refs--;
+		iio_mutex_unlock(modules_lock);
+		return;
+	}
+
 	iio_dlclose(module->lib);
 	free(module->name);
 	free(module);
 }
 
-const struct iio_backend * iio_module_get_backend(struct iio_module *module)
+static const struct iio_backend *
+iio_module_get_backend_by_name(struct iio_module *module, const char *name)
 {
 	const struct iio_backend *backend;
 	char buf[1024];
 	int err;
 
-	iio_snprintf(buf, sizeof(buf), "iio_%s_backend", module->name);
+	iio_snprintf(buf, sizeof(buf), "iio_%s_backend", name);
 
 	backend = iio_dlsym(module->lib, buf);
 	err = iio_err(backend);
@@ -85,22 +171,28 @@ const struct iio_backend * iio_module_get_backend(struct iio_module *module)
 	return backend;
 }
 
+const struct iio_backend * iio_module_get_backend(struct iio_module *module)
+{
+	return iio_module_get_backend_by_name(module, module->name);
+}
+
 static const struct iio_backend *
 get_iio_backend(const struct iio_context_params *params,
-		const char *name, struct iio_module **libp)
+		const char *module_name, const char *backend_name,
+		struct iio_module **libp)
 {
 	const struct iio_backend *backend;
 	struct iio_module *lib;
 	int ret;
 
-	lib = iio_open_module(params, name);
+	lib = iio_open_module(params, module_name);
 	ret = iio_err(lib);
 	if (ret) {
 		prm_dbg(params, "Unable to open plug-in\n");
 		return iio_err_cast(lib);
 	}
 
-	backend = iio_module_get_backend(lib);
+	backend = iio_module_get_backend_by_name(lib, backend_name);
 	ret = iio_err(backend);
 	if (ret) {
 		prm_err(params, "Module is not a backend\n");
@@ -120,7 +212,7 @@ iio_create_dynamic_context(const struct iio_context_params *params,
 	struct iio_context_params params2 = *params;
 	const struct iio_backend *backend;
 	struct iio_context *ctx;
-	const char *ptr;
+	const char *module_name, *ptr;
 	char buf[256];
 	struct iio_module *lib;
 	int ret;
@@ -134,7 +226,13 @@ iio_create_dynamic_context(const struct iio_context_params *params,
 
 	iio_snprintf(buf, sizeof(buf), "%.*s", (int) (ptr - uri), uri);
 
-	backend = get_iio_backend(params, buf, &lib);
+	/* The "uds" backend lives in the network plug-in */
+	if (!strcmp(buf, "uds"))
+		module_name = "ip";
+	else
+		module_name = buf;
+
+	backend = get_iio_backend(params, module_name, buf, &lib);
 	ret = iio_err(backend);
 	if (ret)
 		return iio_err_cast(backend);
@@ -163,3 +261,98 @@ out_release_module:
 	iio_release_module(lib);
 	return iio_ptr(ret);
 }
+
+/* Eager module preload: IIO_PRELOAD names a comma-separated list of
+ * backend modules (e.g. "ip,usb") which are loaded into the cache when
+ * the library itself is loaded, one loader thread per module, so that
+ * the first context creation does not stall in dlopen() - on NFS roots
+ * that stall can reach hundreds of milliseconds. */
+
+#define PRELOAD_MAX_MODULES 16
+
+static struct iio_thrd *preload_thrds[PRELOAD_MAX_MODULES];
+static unsigned int nb_preload_thrds;
+
+static int iio_preload_thrd(void *d)
+{
+	const struct iio_context_params *params = get_default_params();
+	char *name = d;
+	struct iio_module *module;
+	int err;
+
+	module = iio_open_module(params, name);
+	err = iio_err(module);
+	if (err)
+		prm_warn(params, "Unable to preload module '%s'\n", name);
+	else
+		iio_release_module(module);
+
+	free(name);
+	return err;
+}
+
+static void iio_join_preload_thrds(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_preload_thrds; i++)
+		iio_thrd_join_and_destroy(preload_thrds[i]);
+
+	nb_preload_thrds = 0;
+}
+
+#if defined(_MSC_BUILD)
+#pragma section(".CRT$XCU", read)
+#define __CONSTRUCTOR(f, p) \
+  static void f(void); \
+  __declspec(allocate(".CRT$XCU")) void (*f##_)(void) = f; \
+  __pragma(comment(linker,"/include:" p #f "_")) \
+  static void f(void)
+#ifdef _WIN64
+#define _CONSTRUCTOR(f) __CONSTRUCTOR(f, "")
+#else
+#define _CONSTRUCTOR(f) __CONSTRUCTOR(f, "_")
+#endif
+#elif defined(__GNUC__)
+#define _CONSTRUCTOR(f) static void __attribute__((constructor)) f(void)
+#else
+#define _CONSTRUCTOR(f) static void f(void)
+#endif
+
+_CONSTRUCTOR(iio_dynamic_init)
+{
+	struct iio_mutex *lock;
+	struct iio_thrd *thrd;
+	char *env, *name, *dup, *saveptr = NULL;
+
+	lock = iio_mutex_create();
+	if (!iio_err(lock))
+		modules_lock = lock;
+
+	env = iio_getenv("IIO_PRELOAD");
+	if (!env)
+		return;
+
+	for (name = iio_strtok_r(env, ",", &saveptr);
+	     name && nb_preload_thrds < PRELOAD_MAX_MODULES;
+	     name = iio_strtok_r(NULL, ",", &saveptr)) {
+		dup = strdup(name);
+		if (!dup)
+			break;
+
+		thrd = iio_thrd_create(iio_preload_thrd, dup, "iio-preload");
+		if (iio_err(thrd)) {
+			free(dup);
+			break;
+		}
+
+		preload_thrds[nb_preload_thrds++] = thrd;
+	}
+
+	/* Make sure the loader threads are done before teardown */
+	if (nb_preload_thrds)
+		atexit(iio_join_preload_thrds);
+
+	free(env);
+}
+#undef _CONSTRUCTOR
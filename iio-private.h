@@ -71,11 +71,13 @@ struct iio_channel_pdata;
 struct iio_directory;
 struct iio_module;
 struct iio_mutex;
+struct iio_str_pool;
 struct iio_task;
 
+/* Both strings are interned in the context's string pool */
 struct iio_channel_attr {
-	char *name;
-	char *filename;
+	const char *name;
+	const char *filename;
 };
 
 struct iio_context {
@@ -101,6 +103,47 @@ struct iio_context {
 	struct iio_context_params params;
 
 	struct iio_module *lib;
+
+	/* Opt-in attribute value cache (see attr-cache.c). Disabled when
+	 * the TTL is zero. */
+	struct iio_attr_cache *attr_cache;
+	unsigned int attr_cache_ttl_ms;
+
+	/* Interning pool for the attribute names, which repeat massively
+	 * across near-identical devices. */
+	struct iio_str_pool *str_pool;
+
+	/* Write-behind queue for asynchronous attribute writes (see
+	 * attr-queue.c). */
+	struct iio_attr_queue *attr_queue;
+};
+
+int iio_attr_cache_set_ttl(struct iio_context *ctx, unsigned int ttl_ms);
+void iio_attr_cache_drop(const struct iio_context *ctx);
+void iio_attr_cache_destroy(struct iio_context *ctx);
+ssize_t iio_attr_cache_get(const struct iio_context *ctx, const void *obj,
+			   unsigned int idx, int type, const char *name,
+			   char *dst, size_t len);
+void iio_attr_cache_store(const struct iio_context *ctx, const void *obj,
+			  unsigned int idx, int type, const char *name,
+			  const char *value, size_t len);
+void iio_attr_cache_invalidate(const struct iio_context *ctx, const void *obj,
+			       unsigned int idx, int type, const char *name);
+
+struct iio_attr_queue * iio_attr_queue_create(void);
+void iio_attr_queue_destroy(struct iio_context *ctx);
+
+/* Small open-addressed hash index for name lookups. The key and value
+ * sets are fixed once the context is fully created; the key strings are
+ * owned by the indexed objects. */
+struct iio_str_index_entry {
+	const char *key;
+	void *ptr;
+};
+
+struct iio_str_index {
+	struct iio_str_index_entry *entries;
+	uint32_t mask; /* table size - 1; the size is a power of two */
 };
 
 struct iio_channel {
@@ -119,11 +162,15 @@ struct iio_channel {
 	struct iio_channel_attr *attrs;
 	unsigned int nb_attrs;
 
+	/* Maps attribute names to their canonical name pointers */
+	struct iio_str_index attr_index;
+
 	unsigned int number;
 };
 
 struct iio_dev_attrs {
-	char **names;
+	/* Interned in the context's string pool */
+	const char **names;
 	unsigned int num;
 };
 
@@ -140,6 +187,16 @@ struct iio_device {
 
 	struct iio_channel **channels;
 	unsigned int nb_channels;
+
+	/* Maps channel IDs and names to the channel objects */
+	struct iio_str_index chn_index;
+
+	/* Set when the device was registered lazily and its channels and
+	 * attributes have not been discovered yet. Cleared under
+	 * "hydrate_lock", which serializes the one-time hydration when
+	 * several threads hit the same un-hydrated device at once. */
+	bool lazy;
+	struct iio_mutex *hydrate_lock;
 };
 
 struct iio_buffer {
@@ -156,11 +213,43 @@ struct iio_buffer {
 
 	size_t block_size;
 
+	/* Demux plan, precomputed at buffer creation: sample size for the
+	 * buffer's channel mask, and per-channel byte offsets (indexed by
+	 * channel number, -1 if the channel is not enabled). */
+	size_t sample_size;
+	long *demux_offsets;
+
 	/* Mutex to protect nb_blocks. Should really be an atomic... */
 	struct iio_mutex *lock;
 	unsigned int nb_blocks;
+
+	/* Signaled by the worker task when a block completes;
+	 * -1 when unsupported. */
+	int event_fd;
+
+	/* Optional arena backing the data of blocks that the backend does
+	 * not allocate itself: one contiguous (hugepage-friendly) mapping
+	 * carved into page-aligned slots. Protected by "lock". */
+	uint8_t *arena;
+	size_t arena_size, arena_slot_size, arena_nb_slots;
+	bool *arena_used;
+
+	/* Transfer statistics, updated at block enqueue/dequeue.
+	 * Protected by "lock". */
+	struct iio_buffer_stats stats;
+	unsigned int queue_depth;
 };
 
+void iio_buffer_stats_enqueued(struct iio_buffer *buf);
+void iio_buffer_stats_complete(struct iio_buffer *buf,
+			       uint64_t latency_us, size_t bytes, int ret);
+void iio_buffer_stats_lost(struct iio_buffer *buf, size_t bytes);
+
+int iio_buffer_reserve_arena(struct iio_buffer *buf,
+			     size_t nb_blocks, size_t block_size);
+void * iio_buffer_arena_alloc(struct iio_buffer *buf, size_t size);
+void iio_buffer_arena_free(struct iio_buffer *buf, void *data);
+
 struct iio_context_info {
 	char *description;
 	char *uri;
@@ -202,6 +291,20 @@ const struct iio_backend * iio_module_get_backend(struct iio_module *module);
 void free_channel(struct iio_channel *chn);
 void free_device(struct iio_device *dev);
 
+int iio_device_hydrate(const struct iio_device *dev);
+void reorder_channels(struct iio_device *dev);
+void iio_device_build_index(struct iio_device *dev);
+
+struct iio_str_pool * iio_str_pool_create(void);
+const char * iio_str_pool_get(struct iio_str_pool *pool, const char *str);
+void iio_str_pool_destroy(struct iio_str_pool *pool);
+
+int iio_str_index_init(struct iio_str_index *idx, unsigned int nb);
+void iio_str_index_add(struct iio_str_index *idx, const char *key, void *ptr);
+void * iio_str_index_find(const struct iio_str_index *idx, const char *key,
+			  bool (*match)(void *ptr, void *d), void *d);
+void iio_str_index_release(struct iio_str_index *idx);
+
 ssize_t iio_snprintf_channel_xml(char *str, ssize_t slen,
 				 const struct iio_channel *chn);
 ssize_t iio_snprintf_device_xml(char *str, ssize_t slen,
@@ -216,6 +319,14 @@ int write_double(char *buf, size_t len, double val);
 
 bool iio_list_has_elem(const char *list, const char *elem);
 
+struct iio_context *
+iio_create_context_from_binary(const struct iio_context_params *params,
+			       const struct iio_backend *backend,
+			       const char *description, const char **ctx_attrs,
+			       const char **ctx_values,
+			       unsigned int nb_ctx_attrs,
+			       const void *data, size_t data_len);
+
 struct iio_context *
 iio_create_dynamic_context(const struct iio_context_params *params,
 			   const char *uri);
@@ -242,7 +353,9 @@ __cnst const struct iio_context_params *get_default_params(void);
 
 extern const struct iio_backend iio_ip_backend;
 extern const struct iio_backend iio_local_backend;
+extern const struct iio_backend iio_rdma_backend;
 extern const struct iio_backend iio_serial_backend;
+extern const struct iio_backend iio_uds_backend;
 extern const struct iio_backend iio_usb_backend;
 extern const struct iio_backend iio_xml_backend;
 
@@ -250,7 +363,7 @@ extern const struct iio_backend *iio_backends[];
 extern const unsigned int iio_backends_size;
 
 ssize_t iio_xml_print_and_sanitized_param(char *ptr, ssize_t len,
-					  const char *before, char *param,
+					  const char *before, const char *param,
 					  const char *after);
 
 static inline void iio_update_xml_indexes(ssize_t ret, char **ptr, ssize_t *len,
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __IIO_TRACE_H__
+#define __IIO_TRACE_H__
+
+#include "iio-config.h"
+
+/* USDT static tracepoints on the streaming hot path, under the "libiio"
+ * provider. Compiled out by default (WITH_USDT=OFF); when enabled, each
+ * probe is a single nop instruction until a tracer (perf, bpftrace,
+ * SystemTap...) attaches to it, so they can stay on in production. */
+
+#if WITH_USDT
+#include <sys/sdt.h>
+
+#define iio_trace1(name, a1)		DTRACE_PROBE1(libiio, name, a1)
+#define iio_trace2(name, a1, a2)	DTRACE_PROBE2(libiio, name, a1, a2)
+#define iio_trace3(name, a1, a2, a3)	DTRACE_PROBE3(libiio, name, a1, a2, a3)
+#else
+#define iio_trace1(name, a1)		do { } while (0)
+#define iio_trace2(name, a1, a2)	do { } while (0)
+#define iio_trace3(name, a1, a2, a3)	do { } while (0)
+#endif
+
+#endif /* __IIO_TRACE_H__ */
@@ -6,9 +6,14 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for memfd_create() */
+#endif
+
 #include "iio-config.h"
 #include "iio-private.h"
 #include "iiod-responder.h"
+#include "bit-pack.h"
 
 #include <iio/iiod-client.h>
 #include <iio/iio-backend.h>
@@ -19,6 +24,10 @@
 #include <inttypes.h>
 #include <string.h>
 #include <stdio.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #if WITH_ZSTD
 #include <zstd.h>
 #endif
@@ -30,6 +39,56 @@ struct iiod_client {
 	struct iio_mutex *lock;
 
 	struct iiod_responder *responder;
+
+	/* Optional binary-protocol features advertised by the server
+	 * (IIOD_FEAT_* mask, empty for old servers). */
+	uint32_t server_features;
+
+	/* Comma-separated list of device IDs, names or labels; when set
+	 * (and the server supports it), the context description is
+	 * restricted to those devices. */
+	char *device_filter;
+
+	/* Set when striped block transfers have been negotiated; block
+	 * payloads then move through the transport's oob ops. */
+	bool oob;
+
+#if WITH_ZSTD
+	/* Streaming contexts for compressed block transfers, reused
+	 * across blocks and protected by the client lock. The level is
+	 * adapted between 1 and the negotiated level by the controller
+	 * in iiod_client_compress_block(). */
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+	int zstd_level, zstd_level_max;
+	uint64_t zstd_last_us;
+	bool zstd_blocks;
+#endif
+
+	/* Attribute watches (see iiod_client_watch_attr()). The pushes
+	 * are dispatched from the responder's reader thread, so the list
+	 * has its own lock instead of reusing the client lock, which may
+	 * be held across a response wait. */
+	struct iio_mutex *watch_lock;
+	struct iiod_client_watch *watches;
+	uint16_t next_watch_id;
+
+	/* Read-side buffer for the ASCII protocol, so that line parsing
+	 * does not cost one recv() per byte. Only filled between a command
+	 * and the end of its response, so it is always empty when the
+	 * client switches to the binary protocol. */
+	char rbuf[4096];
+	size_t rbuf_start, rbuf_len;
+};
+
+struct iiod_client_watch {
+	struct iiod_client_watch *next;
+	uint16_t id;
+
+	void (*cb)(void *, ssize_t, const char *);
+	void *priv;
+
+	char value[IIOD_WATCH_MAX_LEN];
 };
 
 struct iiod_client_io {
@@ -53,6 +112,23 @@ struct iiod_client_buffer_pdata {
 
 	/* TODO: atomic? */
 	uint16_t next_block_idx;
+
+	/* Bit-packing codec parameters (see bit-pack.h), valid when
+	 * "pack" has been negotiated for this buffer. */
+	unsigned int pack_bits, pack_length, pack_shift;
+	bool pack;
+
+	/* True when re-enqueueing an unmodified cyclic waveform may skip
+	 * the payload upload (see iiod_client_enable_cyclic_cache). */
+	bool cyclic_cache;
+
+	/* True when blocks of this buffer are created in shared memory
+	 * (see iiod_client_enable_memfd). */
+	bool memfd;
+
+	/* True when this buffer's block payloads arrive on the UDP data
+	 * plane (see iiod_client_enable_udp). */
+	bool udp;
 };
 
 struct iio_block_pdata {
@@ -67,6 +143,24 @@ struct iio_block_pdata {
 
 	void *data;
 	bool enqueued;
+
+	/* Scratch for compressed transfers, of ZSTD_compressBound(size)
+	 * bytes, lazily allocated on the first compressed enqueue. */
+	void *zstd_buf;
+	size_t zstd_buf_len;
+	uint64_t zstd_csize;
+
+	/* Scratch for bit-packed transfers */
+	void *pack_buf;
+
+	/* Last payload uploaded to the server, used to detect when a
+	 * cyclic re-enqueue can reference it instead of re-sending it */
+	uint64_t uploaded_bytes_used;
+	bool uploaded;
+
+	/* Set when "data" is a shared mapping that the server also holds;
+	 * transfers then only carry the bytes_used field. */
+	bool shared;
 };
 
 void iiod_client_mutex_lock(struct iiod_client *client)
@@ -79,6 +173,32 @@ void iiod_client_mutex_unlock(struct iiod_client *client)
 	iio_mutex_unlock(client->lock);
 }
 
+static ssize_t iiod_client_recv(struct iiod_client *client,
+				void *dst, size_t len, unsigned int remaining)
+{
+	size_t avail = client->rbuf_len - client->rbuf_start;
+	ssize_t ret;
+
+	if (!avail) {
+		ret = client->ops->read(client->desc, client->rbuf,
+					sizeof(client->rbuf), remaining);
+		if (ret <= 0)
+			return ret;
+
+		client->rbuf_start = 0;
+		client->rbuf_len = (size_t) ret;
+		avail = (size_t) ret;
+	}
+
+	if (len > avail)
+		len = avail;
+
+	memcpy(dst, &client->rbuf[client->rbuf_start], len);
+	client->rbuf_start += len;
+
+	return (ssize_t) len;
+}
+
 static ssize_t iiod_client_read_integer(struct iiod_client *client, int *val)
 {
 	bool accept_eol = false, has_read_line = !!client->ops->read_line;
@@ -112,9 +232,11 @@ static ssize_t iiod_client_read_integer(struct iiod_client *client, int *val)
 				remaining = (unsigned int)((int64_t)timeout_ms - diff_ms);
 			}
 
-			ret = client->ops->read(client->desc, &buf[i], 1, remaining);
+			ret = iiod_client_recv(client, &buf[i], 1, remaining);
 			if (ret < 0)
 				return ret;
+			if (ret == 0)
+				return -EPIPE;
 		}
 
 		if (buf[i] != '\n')
@@ -202,6 +324,7 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 	uintptr_t ptr = (uintptr_t) dst;
 	unsigned int remaining = 0, timeout_ms = client->params->timeout_ms;
 	uint64_t start_time, diff_ms;
+	bool buffered;
 	ssize_t ret;
 
 	start_time = iiod_responder_read_counter_us();
@@ -209,6 +332,11 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 	if (iiod_client_uses_binary_interface(client))
 		timeout_ms = 0;
 
+	/* Serve ASCII responses from the client's read buffer; transports
+	 * that have their own read_line op do their own buffering. */
+	buffered = !ops->read_line
+		&& !iiod_client_uses_binary_interface(client);
+
 	while (len) {
 		diff_ms = (iiod_responder_read_counter_us() - start_time) / 1000;
 
@@ -219,7 +347,12 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 			remaining = (unsigned int)((int64_t)timeout_ms - diff_ms);
 		}
 
-		ret = ops->read(client->desc, (void *) ptr, len, remaining);
+		if (buffered)
+			ret = iiod_client_recv(client, (void *) ptr, len,
+					       remaining);
+		else
+			ret = ops->read(client->desc, (void *) ptr, len,
+					remaining);
 		if (ret < 0) {
 			if (ret == -EINTR)
 				continue;
@@ -259,14 +392,21 @@ struct iiod_client * iiod_client_new(const struct iio_context_params *params,
 	if (err)
 		goto err_free_client;
 
+	client->watch_lock = iio_mutex_create();
+	err = iio_err(client->watch_lock);
+	if (err)
+		goto err_free_lock;
+
 	client->params = params;
 	client->ops = ops;
 	client->desc = desc;
 	client->responder = NULL;
+	client->watches = NULL;
+	client->next_watch_id = 1;
 
 	err = iiod_client_enable_binary(client);
 	if (err)
-		goto err_free_lock;
+		goto err_free_watch_lock;
 
 	err = iiod_client_set_timeout(client, params->timeout_ms);
 	if (err)
@@ -279,6 +419,8 @@ err_free_responder:
 		iiod_client_cancel(client);
 		iiod_responder_destroy(client->responder);
 	}
+err_free_watch_lock:
+	iio_mutex_destroy(client->watch_lock);
 err_free_lock:
 	iio_mutex_destroy(client->lock);
 err_free_client:
@@ -288,15 +430,47 @@ err_free_client:
 
 void iiod_client_destroy(struct iiod_client *client)
 {
+	struct iiod_client_watch *watch, *next;
+
 	if (client->responder) {
 		iiod_client_cancel(client);
 		iiod_responder_destroy(client->responder);
 	}
 
+#if WITH_ZSTD
+	ZSTD_freeCCtx(client->cctx);
+	ZSTD_freeDCtx(client->dctx);
+#endif
+
+	/* The responder (and its reader thread) is gone; no more pushes
+	 * can race with us here. */
+	for (watch = client->watches; watch; watch = next) {
+		next = watch->next;
+		free(watch);
+	}
+
+	iio_mutex_destroy(client->watch_lock);
 	iio_mutex_destroy(client->lock);
+	free(client->device_filter);
 	free(client);
 }
 
+int iiod_client_set_device_filter(struct iiod_client *client, const char *devs)
+{
+	char *dup = NULL;
+
+	if (devs) {
+		dup = iio_strdup(devs);
+		if (!dup)
+			return -ENOMEM;
+	}
+
+	free(client->device_filter);
+	client->device_filter = dup;
+
+	return 0;
+}
+
 static int iio_device_get_index(const struct iio_device *dev)
 {
 	const struct iio_context *ctx = iio_device_get_context(dev);
@@ -494,6 +668,12 @@ int iiod_client_set_timeout(struct iiod_client *client, unsigned int timeout)
 	return ret;
 }
 
+void iiod_client_set_params(struct iiod_client *client,
+			    const struct iio_context_params *params)
+{
+	client->params = params;
+}
+
 static int iiod_client_discard(struct iiod_client *client,
 			       char *buf, size_t buf_len, size_t to_discard)
 {
@@ -516,27 +696,25 @@ static int iiod_client_discard(struct iiod_client *client,
 	return 0;
 }
 
-static ssize_t iiod_client_read_attr_new(struct iiod_client *client,
-					 const struct iio_device *dev,
-					 const struct iio_channel *chn,
-					 const char *attr, char *dest,
-					 size_t len, enum iio_attr_type type,
-					 unsigned int buf_id)
+static int iiod_client_get_attr_cmd(const struct iio_device *dev,
+				    const struct iio_channel *chn,
+				    const char *attr, enum iio_attr_type type,
+				    unsigned int buf_id, bool write,
+				    uint8_t *op, uint16_t *arg1,
+				    uint16_t *arg2)
 {
-	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
-	struct iiod_command cmd = { 0 };
 	unsigned int i;
-	uint16_t arg1, arg2 = 0;
-	struct iiod_buf iiod_buf;
+
+	*arg2 = 0;
 
 	if (chn) {
-		cmd.op = IIOD_OP_READ_CHN_ATTR;
+		*op = write ? IIOD_OP_WRITE_CHN_ATTR : IIOD_OP_READ_CHN_ATTR;
 
 		for (i = 0; i < iio_device_get_channels_count(dev); i++)
 			if (iio_device_get_channel(dev, i) == chn)
 				break;
 
-		arg2 = (uint16_t) i;
+		*arg2 = (uint16_t) i;
 
 		for (i = 0; i < iio_channel_get_attrs_count(chn); i++)
 			if (!strcmp(iio_channel_get_attr(chn, i), attr))
@@ -545,49 +723,74 @@ static ssize_t iiod_client_read_attr_new(struct iiod_client *client,
 		if (i == iio_channel_get_attrs_count(chn))
 			return -ENOENT;
 
-		arg1 = (uint16_t) i;
-	} else {
-		switch (type) {
-		default:
-			cmd.op = IIOD_OP_READ_ATTR;
+		*arg1 = (uint16_t) i;
 
-			for (i = 0; i < iio_device_get_attrs_count(dev); i++)
-				if (!strcmp(iio_device_get_attr(dev, i), attr))
-					break;
+		return 0;
+	}
 
-			if (i == iio_device_get_attrs_count(dev))
-				return -ENOENT;
+	switch (type) {
+	default:
+		*op = write ? IIOD_OP_WRITE_ATTR : IIOD_OP_READ_ATTR;
 
-			arg1 = (uint16_t) i;
-			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			cmd.op = IIOD_OP_READ_DBG_ATTR;
+		for (i = 0; i < iio_device_get_attrs_count(dev); i++)
+			if (!strcmp(iio_device_get_attr(dev, i), attr))
+				break;
 
-			for (i = 0; i < iio_device_get_debug_attrs_count(dev); i++)
-				if (!strcmp(iio_device_get_debug_attr(dev, i), attr))
-					break;
+		if (i == iio_device_get_attrs_count(dev))
+			return -ENOENT;
 
-			if (i == iio_device_get_debug_attrs_count(dev))
-				return -ENOENT;
+		*arg1 = (uint16_t) i;
+		break;
+	case IIO_ATTR_TYPE_DEBUG:
+		*op = write ? IIOD_OP_WRITE_DBG_ATTR : IIOD_OP_READ_DBG_ATTR;
 
-			arg1 = (uint16_t) i;
-			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			cmd.op = IIOD_OP_READ_BUF_ATTR;
+		for (i = 0; i < iio_device_get_debug_attrs_count(dev); i++)
+			if (!strcmp(iio_device_get_debug_attr(dev, i), attr))
+				break;
 
-			for (i = 0; i < iio_device_get_buffer_attrs_count(dev); i++)
-				if (!strcmp(iio_device_get_buffer_attr(dev, i), attr))
-					break;
+		if (i == iio_device_get_debug_attrs_count(dev))
+			return -ENOENT;
 
-			if (i == iio_device_get_buffer_attrs_count(dev))
-				return -ENOENT;
+		*arg1 = (uint16_t) i;
+		break;
+	case IIO_ATTR_TYPE_BUFFER:
+		*op = write ? IIOD_OP_WRITE_BUF_ATTR : IIOD_OP_READ_BUF_ATTR;
 
-			arg1 = (uint16_t) i;
-			arg2 = (uint16_t) buf_id;
-			break;
-		}
+		for (i = 0; i < iio_device_get_buffer_attrs_count(dev); i++)
+			if (!strcmp(iio_device_get_buffer_attr(dev, i), attr))
+				break;
+
+		if (i == iio_device_get_buffer_attrs_count(dev))
+			return -ENOENT;
+
+		*arg1 = (uint16_t) i;
+		*arg2 = (uint16_t) buf_id;
+		break;
 	}
 
+	return 0;
+}
+
+static ssize_t iiod_client_read_attr_new(struct iiod_client *client,
+					 const struct iio_device *dev,
+					 const struct iio_channel *chn,
+					 const char *attr, char *dest,
+					 size_t len, enum iio_attr_type type,
+					 unsigned int buf_id)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	uint16_t arg1, arg2;
+	uint8_t op;
+	struct iiod_buf iiod_buf;
+	int ret;
+
+	ret = iiod_client_get_attr_cmd(dev, chn, attr, type, buf_id, false,
+				       &op, &arg1, &arg2);
+	if (ret)
+		return ret;
+
+	cmd.op = op;
 	cmd.dev = (uint8_t) iio_device_get_index(dev);
 	cmd.code = (arg1 << 16) | arg2;
 
@@ -698,71 +901,18 @@ static ssize_t iiod_client_write_attr_new(struct iiod_client *client,
 {
 	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
 	struct iiod_command cmd = { 0 };
-	uint16_t arg1, arg2 = 0;
+	uint16_t arg1, arg2;
+	uint8_t op;
 	struct iiod_buf iiod_buf[2];
 	uint64_t length = (uint64_t) len;
-	unsigned int i;
 	int ret;
 
-	if (chn) {
-		cmd.op = IIOD_OP_WRITE_CHN_ATTR;
-
-		for (i = 0; i < iio_device_get_channels_count(dev); i++)
-			if (iio_device_get_channel(dev, i) == chn)
-				break;
-
-		arg2 = (uint16_t) i;
-
-		for (i = 0; i < iio_channel_get_attrs_count(chn); i++)
-			if (!strcmp(iio_channel_get_attr(chn, i), attr))
-				break;
-
-		if (i == iio_channel_get_attrs_count(chn))
-			return -ENOENT;
-
-		arg1 = (uint16_t) i;
-	} else {
-		switch (type) {
-		default:
-			cmd.op = IIOD_OP_WRITE_ATTR;
-
-			for (i = 0; i < iio_device_get_attrs_count(dev); i++)
-				if (!strcmp(iio_device_get_attr(dev, i), attr))
-					break;
-
-			if (i == iio_device_get_attrs_count(dev))
-				return -ENOENT;
-
-			arg1 = (uint16_t) i;
-			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			cmd.op = IIOD_OP_WRITE_DBG_ATTR;
-
-			for (i = 0; i < iio_device_get_debug_attrs_count(dev); i++)
-				if (!strcmp(iio_device_get_debug_attr(dev, i), attr))
-					break;
-
-			if (i == iio_device_get_debug_attrs_count(dev))
-				return -ENOENT;
-
-			arg1 = (uint16_t) i;
-			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			cmd.op = IIOD_OP_WRITE_BUF_ATTR;
-
-			for (i = 0; i < iio_device_get_buffer_attrs_count(dev); i++)
-				if (!strcmp(iio_device_get_buffer_attr(dev, i), attr))
-					break;
-
-			if (i == iio_device_get_buffer_attrs_count(dev))
-				return -ENOENT;
-
-			arg1 = (uint16_t) i;
-			arg2 = (uint16_t) buf_id;
-			break;
-		}
-	}
+	ret = iiod_client_get_attr_cmd(dev, chn, attr, type, buf_id, true,
+				       &op, &arg1, &arg2);
+	if (ret)
+		return ret;
 
+	cmd.op = op;
 	cmd.dev = (uint8_t) iio_device_get_index(dev);
 	cmd.code = (arg1 << 16) | arg2;
 
@@ -848,32 +998,799 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 		}
 	}
 
-	iio_mutex_lock(client->lock);
-	ret = iiod_client_write_all(client, buf, strlen(buf));
-	if (ret < 0)
-		goto out_unlock;
+	iio_mutex_lock(client->lock);
+	ret = iiod_client_write_all(client, buf, strlen(buf));
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = iiod_client_write_all(client, src, len);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = iiod_client_read_integer(client, &resp);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = (ssize_t) resp;
+
+out_unlock:
+	iio_mutex_unlock(client->lock);
+	return ret;
+}
+
+static int iiod_client_fill_attrs_entries(struct iio_bulk_attr *attrs,
+					  size_t nb, bool write,
+					  struct iiod_attrs_entry *entries)
+{
+	uint16_t arg1, arg2;
+	uint8_t op;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < nb; i++) {
+		if (attrs[i].len > 0xffff)
+			return -EINVAL;
+
+		ret = iiod_client_get_attr_cmd(attrs[i].dev, attrs[i].chn,
+					       attrs[i].attr, attrs[i].type,
+					       attrs[i].buf_id, write,
+					       &op, &arg1, &arg2);
+		if (ret)
+			return ret;
+
+		entries[i].op = op;
+		entries[i].dev = (uint8_t) iio_device_get_index(attrs[i].dev);
+		entries[i].arg1 = arg1;
+		entries[i].arg2 = arg2;
+		entries[i].len = (uint16_t) attrs[i].len;
+	}
+
+	return 0;
+}
+
+int iiod_client_read_attrs_bulk(struct iiod_client *client,
+				struct iio_bulk_attr *attrs, size_t nb)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	struct iiod_attrs_entry *entries;
+	struct iiod_buf cmd_buf, resp_buf;
+	uint8_t *resp, *ptr;
+	size_t i, resp_len = 0;
+	int32_t code;
+	intptr_t ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_ATTRS_BULK))
+		return -ENOSYS;
+
+	entries = calloc(nb, sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	ret = iiod_client_fill_attrs_entries(attrs, nb, false, entries);
+	if (ret)
+		goto out_free_entries;
+
+	for (i = 0; i < nb; i++)
+		resp_len += sizeof(int32_t) + IIOD_ATTRS_PAD(entries[i].len);
+
+	resp = malloc(resp_len);
+	if (!resp) {
+		ret = -ENOMEM;
+		goto out_free_entries;
+	}
+
+	cmd.op = IIOD_OP_READ_ATTRS;
+	cmd.code = (int32_t) nb;
+
+	cmd_buf.ptr = entries;
+	cmd_buf.size = nb * sizeof(*entries);
+	resp_buf.ptr = resp;
+	resp_buf.size = resp_len;
+
+	ret = iiod_io_exec_command(io, &cmd, &cmd_buf, &resp_buf);
+	if (ret < 0)
+		goto out_free_resp;
+
+	resp_len = (size_t) ret;
+	ret = 0;
+
+	for (i = 0, ptr = resp; i < nb; i++) {
+		if (resp_len < sizeof(code)) {
+			ret = -EIO;
+			goto out_free_resp;
+		}
+
+		memcpy(&code, ptr, sizeof(code));
+		ptr += sizeof(code);
+		resp_len -= sizeof(code);
+
+		attrs[i].ret = (ssize_t) code;
+
+		if (code <= 0)
+			continue;
+
+		if ((size_t) code > attrs[i].len
+		    || IIOD_ATTRS_PAD(code) > resp_len) {
+			ret = -EIO;
+			goto out_free_resp;
+		}
+
+		memcpy(attrs[i].value, ptr, (size_t) code);
+		ptr += IIOD_ATTRS_PAD(code);
+		resp_len -= IIOD_ATTRS_PAD(code);
+	}
+
+out_free_resp:
+	free(resp);
+out_free_entries:
+	free(entries);
+	return (int) ret;
+}
+
+int iiod_client_write_attrs_bulk(struct iiod_client *client,
+				 struct iio_bulk_attr *attrs, size_t nb)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	struct iiod_attrs_entry *entries;
+	struct iiod_buf cmd_buf, resp_buf;
+	uint8_t *payload, *ptr;
+	int32_t *codes;
+	size_t i, payload_len;
+	intptr_t ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_ATTRS_BULK))
+		return -ENOSYS;
+
+	payload_len = nb * sizeof(*entries);
+	for (i = 0; i < nb; i++)
+		payload_len += IIOD_ATTRS_PAD(attrs[i].len);
+
+	payload = calloc(1, payload_len);
+	codes = calloc(nb, sizeof(*codes));
+	if (!payload || !codes) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	entries = (struct iiod_attrs_entry *) payload;
+
+	ret = iiod_client_fill_attrs_entries(attrs, nb, true, entries);
+	if (ret)
+		goto out_free;
+
+	ptr = payload + nb * sizeof(*entries);
+
+	for (i = 0; i < nb; i++) {
+		memcpy(ptr, attrs[i].value, attrs[i].len);
+		ptr += IIOD_ATTRS_PAD(attrs[i].len);
+	}
+
+	cmd.op = IIOD_OP_WRITE_ATTRS;
+	cmd.code = (int32_t) nb;
+
+	cmd_buf.ptr = payload;
+	cmd_buf.size = payload_len;
+	resp_buf.ptr = codes;
+	resp_buf.size = nb * sizeof(*codes);
+
+	ret = iiod_io_exec_command(io, &cmd, &cmd_buf, &resp_buf);
+	if (ret < 0)
+		goto out_free;
+
+	if ((size_t) ret < nb * sizeof(*codes)) {
+		ret = -EIO;
+		goto out_free;
+	}
+
+	for (i = 0; i < nb; i++)
+		attrs[i].ret = (ssize_t) codes[i];
+
+	ret = 0;
+
+out_free:
+	free(codes);
+	free(payload);
+	return (int) ret;
+}
+
+int iiod_client_reg_read_multi(struct iiod_client *client,
+			       const struct iio_device *dev,
+			       const uint32_t *addrs, uint32_t *values,
+			       size_t nb)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	struct iiod_buf cmd_buf, resp_buf;
+	int ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_REG_MULTI))
+		return -ENOSYS;
+
+	if (!nb || nb > 0xffff)
+		return -EINVAL;
+
+	cmd.op = IIOD_OP_REG_READ_MULTI;
+	cmd.dev = (uint8_t) iio_device_get_index(dev);
+	cmd.code = (int32_t) nb;
+
+	cmd_buf.ptr = (void *) addrs;
+	cmd_buf.size = nb * sizeof(*addrs);
+	resp_buf.ptr = values;
+	resp_buf.size = nb * sizeof(*values);
+
+	ret = iiod_io_exec_command(io, &cmd, &cmd_buf, &resp_buf);
+	if (ret < 0)
+		return ret;
+	if ((size_t) ret < nb * sizeof(*values))
+		return -EIO;
+
+	return 0;
+}
+
+int iiod_client_reg_write_multi(struct iiod_client *client,
+				const struct iio_device *dev,
+				const uint32_t *addrs, const uint32_t *values,
+				size_t nb)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	struct iiod_buf cmd_buf;
+	uint32_t *payload;
+	int ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_REG_MULTI))
+		return -ENOSYS;
+
+	if (!nb || nb > 0xffff)
+		return -EINVAL;
+
+	/* Payload: the addresses, followed by the values */
+	payload = malloc(2 * nb * sizeof(*payload));
+	if (!payload)
+		return -ENOMEM;
+
+	memcpy(payload, addrs, nb * sizeof(*payload));
+	memcpy(payload + nb, values, nb * sizeof(*payload));
+
+	cmd.op = IIOD_OP_REG_WRITE_MULTI;
+	cmd.dev = (uint8_t) iio_device_get_index(dev);
+	cmd.code = (int32_t) nb;
+
+	cmd_buf.ptr = payload;
+	cmd_buf.size = 2 * nb * sizeof(*payload);
+
+	ret = iiod_io_exec_command(io, &cmd, &cmd_buf, NULL);
+
+	free(payload);
+
+	return ret < 0 ? ret : 0;
+}
+
+uint32_t iiod_client_get_server_features(const struct iiod_client *client)
+{
+	return client->server_features;
+}
+
+int iiod_client_enable_stripes(struct iiod_client *client,
+			       uint64_t token, unsigned int nb)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	struct iiod_buf buf;
+	int ret;
+
+	if (!nb || nb > IIOD_MAX_STRIPES)
+		return -EINVAL;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_STRIPE))
+		return -ENOSYS;
+
+	if (!client->ops->write_block_oob || !client->ops->read_block_oob)
+		return -ENOSYS;
+
+	cmd.op = IIOD_OP_STRIPE_ENABLE;
+	cmd.code = (int32_t) nb;
+
+	buf.ptr = &token;
+	buf.size = sizeof(token);
+
+	ret = iiod_io_exec_command(io, &cmd, &buf, NULL);
+	if (ret < 0)
+		return ret;
+
+	client->oob = true;
+
+	return 0;
+}
+
+int iiod_client_enable_zstd(struct iiod_client *client, int level,
+			    const void *dict, size_t dict_len)
+{
+#if WITH_ZSTD
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { 0 };
+	struct iiod_buf buf;
+	int ret;
+
+	if (level < 1 || level > ZSTD_maxCLevel() || dict_len > INT32_MAX)
+		return -EINVAL;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_ZSTD_BLOCKS))
+		return -ENOSYS;
+
+	/* Striped payloads move out-of-band and are not compressed */
+	if (client->oob || client->zstd_blocks)
+		return -EPERM;
+
+	client->cctx = ZSTD_createCCtx();
+	client->dctx = ZSTD_createDCtx();
+	if (!client->cctx || !client->dctx) {
+		ret = -ENOMEM;
+		goto err_free_ctx;
+	}
+
+	ZSTD_CCtx_setParameter(client->cctx, ZSTD_c_compressionLevel, level);
+
+	if (dict && dict_len &&
+	    (ZSTD_isError(ZSTD_CCtx_loadDictionary(client->cctx,
+						   dict, dict_len)) ||
+	     ZSTD_isError(ZSTD_DCtx_loadDictionary(client->dctx,
+						   dict, dict_len)))) {
+		ret = -EINVAL;
+		goto err_free_ctx;
+	}
+
+	cmd.op = IIOD_OP_ZSTD_ENABLE;
+	cmd.dev = (uint8_t) level;
+	cmd.code = (int32_t) dict_len;
+
+	buf.ptr = (void *) dict;
+	buf.size = dict_len;
+
+	ret = iiod_io_exec_command(io, &cmd, dict_len ? &buf : NULL, NULL);
+	if (ret < 0)
+		goto err_free_ctx;
+
+	client->zstd_level = level;
+	client->zstd_level_max = level;
+	client->zstd_last_us = iiod_responder_read_counter_us();
+	client->zstd_blocks = true;
+
+	return 0;
+
+err_free_ctx:
+	ZSTD_freeCCtx(client->cctx);
+	ZSTD_freeDCtx(client->dctx);
+	client->cctx = NULL;
+	client->dctx = NULL;
+	return ret;
+#else
+	return -ENOSYS;
+#endif
+}
+
+int iiod_client_enable_pack(struct iiod_client_buffer_pdata *pdata)
+{
+	struct iiod_client *client = pdata->client;
+	struct iiod_io *io;
+	struct iiod_command cmd = { 0 };
+	struct iiod_buf buf;
+	unsigned int i, bits = 0, length = 0, shift = 0, nb_enabled = 0;
+	const struct iio_channel *chn;
+	uint8_t fmt[4];
+	int ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_PACK))
+		return -ENOSYS;
+
+	/* Out-of-band, shared-memory, datagram and compressed payloads
+	 * are never packed */
+	if (client->oob || pdata->memfd || pdata->udp)
+		return -EPERM;
+#if WITH_ZSTD
+	if (client->zstd_blocks)
+		return -EPERM;
+#endif
+
+	for (i = 0; i < iio_device_get_channels_count(pdata->dev); i++) {
+		chn = iio_device_get_channel(pdata->dev, i);
+
+		if (!iio_channel_is_enabled(chn, pdata->mask))
+			continue;
+
+		if (!iio_pack_format_ok(iio_channel_get_data_format(chn),
+					&bits, &length, &shift))
+			return -EINVAL;
+
+		nb_enabled++;
+	}
+
+	if (!nb_enabled)
+		return -EINVAL;
+
+	cmd.op = IIOD_OP_PACK_ENABLE;
+	cmd.dev = (uint8_t) iio_device_get_index(pdata->dev);
+	cmd.code = pdata->idx;
+
+	fmt[0] = (uint8_t) bits;
+	fmt[1] = (uint8_t) length;
+	fmt[2] = (uint8_t) shift;
+	fmt[3] = 0;
+
+	buf.ptr = fmt;
+	buf.size = sizeof(fmt);
+
+	io = iiod_responder_get_default_io(client->responder);
+
+	ret = iiod_io_exec_command(io, &cmd, &buf, NULL);
+	if (ret < 0)
+		return ret;
+
+	pdata->pack_bits = bits;
+	pdata->pack_length = length;
+	pdata->pack_shift = shift;
+	pdata->pack = true;
+
+	return 0;
+}
+
+int iiod_client_enable_cyclic_cache(struct iiod_client_buffer_pdata *pdata)
+{
+	struct iiod_client *client = pdata->client;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_CYCLIC_CACHE))
+		return -ENOSYS;
+
+	/* Out-of-band payloads are always transferred */
+	if (client->oob)
+		return -EPERM;
+
+	if (!iio_device_is_tx(pdata->dev))
+		return -EINVAL;
+
+	/* No negotiation needed: the server loops the payload a block
+	 * already holds whenever a cyclic enqueue carries none. The
+	 * application must not modify a block's contents between
+	 * enqueues once this is enabled. */
+	pdata->cyclic_cache = true;
+
+	return 0;
+}
+
+int iiod_client_enable_memfd(struct iiod_client_buffer_pdata *pdata)
+{
+#ifdef __linux__
+	struct iiod_client *client = pdata->client;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_MEMFD) ||
+	    !client->ops->write_fd)
+		return -ENOSYS;
+
+	/* Shared payloads are neither striped, packed, compressed nor
+	 * sent as datagrams */
+	if (client->oob || pdata->pack || pdata->udp)
+		return -EPERM;
+#if WITH_ZSTD
+	if (client->zstd_blocks)
+		return -EPERM;
+#endif
+
+	/* No negotiation needed: each block of this buffer is now created
+	 * with IIOD_OP_CREATE_BLOCK_MEMFD, which carries the descriptor. */
+	pdata->memfd = true;
+
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+int iiod_client_enable_udp(struct iiod_client_buffer_pdata *pdata,
+			   uint64_t token)
+{
+	struct iiod_client *client = pdata->client;
+	struct iiod_io *io;
+	struct iiod_command cmd = { 0 };
+	struct iiod_buf buf;
+	int ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_UDP))
+		return -ENOSYS;
+
+	/* Only capture payloads may tolerate loss */
+	if (iio_device_is_tx(pdata->dev))
+		return -EINVAL;
+
+	/* Out-of-band and shared payloads have their own data plane, and
+	 * packed or compressed payloads cannot survive holes. */
+	if (client->oob || pdata->pack || pdata->memfd)
+		return -EPERM;
+#if WITH_ZSTD
+	if (client->zstd_blocks)
+		return -EPERM;
+#endif
+
+	cmd.op = IIOD_OP_UDP_ENABLE;
+	cmd.dev = (uint8_t) iio_device_get_index(pdata->dev);
+	cmd.code = pdata->idx;
+
+	buf.ptr = &token;
+	buf.size = sizeof(token);
+
+	io = iiod_responder_get_default_io(client->responder);
+
+	ret = iiod_io_exec_command(io, &cmd, &buf, NULL);
+	if (ret <= 0)
+		return ret ? ret : -EPROTO;
+
+	/* Committed: the server now sends this buffer's payloads as
+	 * datagrams, whether or not the handshake below succeeds. */
+	pdata->udp = true;
+
+	/* The response code is the server's UDP port number */
+	return ret;
+}
+
+/* Client IDs used by the ios of a batch. Blocks use their (small) index
+ * as ID and the default io uses zero, so the upper half of the ID space
+ * is free; batches are serialized by the client's mutex. */
+#define BATCH_FIRST_ID	0x8000
+
+int iiod_client_exec_commands(struct iiod_client *client,
+			      struct iiod_client_command *cmds, size_t nb)
+{
+	struct iiod_command cmd = { 0 };
+	struct iiod_io **ios;
+	size_t i, nb_io = 0;
+	int ret = 0, err;
+
+	if (!nb)
+		return 0;
+
+	if (!iiod_client_uses_binary_interface(client))
+		return -ENOSYS;
+
+	ios = calloc(nb, sizeof(*ios));
+	if (!ios)
+		return -ENOMEM;
+
+	iiod_client_mutex_lock(client);
+
+	for (i = 0; i < nb; i++) {
+		ios[i] = iiod_responder_create_io(client->responder,
+						  (uint16_t) (BATCH_FIRST_ID + i));
+		err = iio_err(ios[i]);
+		if (err) {
+			ios[i] = NULL;
+			ret = err;
+			goto out_cancel;
+		}
+
+		nb_io++;
+	}
+
+	/* Register all the response readers up front, then hand all the
+	 * commands to the writer task; they go out back to back, without
+	 * waiting for any round trip in between. */
+	for (i = 0; i < nb; i++) {
+		err = iiod_io_get_response_async(ios[i], cmds[i].resp_buf,
+						 cmds[i].resp_buf != NULL);
+		if (err) {
+			ret = err;
+			goto out_cancel;
+		}
+	}
+
+	for (i = 0; i < nb; i++) {
+		cmd.op = cmds[i].op;
+		cmd.dev = cmds[i].dev;
+		cmd.code = cmds[i].code;
+
+		err = iiod_io_send_command_async(ios[i], &cmd, cmds[i].cmd_buf,
+						 cmds[i].cmd_buf != NULL);
+		if (err) {
+			ret = err;
+			goto out_cancel;
+		}
+	}
+
+	for (i = 0; i < nb; i++) {
+		err = iiod_io_wait_for_command_done(ios[i]);
+		if (err) {
+			/* Drop the pending response request, so that the io
+			 * is not left in the responder's readers list. */
+			iiod_io_cancel(ios[i]);
+			cmds[i].ret = err;
+		} else {
+			cmds[i].ret = iiod_io_wait_for_response(ios[i]);
+		}
+	}
+
+	goto out_unref;
+
+out_cancel:
+	for (i = 0; i < nb_io; i++)
+		iiod_io_cancel(ios[i]);
+out_unref:
+	for (i = 0; i < nb_io; i++)
+		iiod_io_unref(ios[i]);
+
+	iiod_client_mutex_unlock(client);
+	free(ios);
+	return ret;
+}
+
+static void iiod_client_remove_watch(struct iiod_client *client, uint16_t id)
+{
+	struct iiod_client_watch *watch, **pwatch;
+
+	iio_mutex_lock(client->watch_lock);
+
+	for (pwatch = &client->watches; (watch = *pwatch);
+	     pwatch = &watch->next) {
+		if (watch->id == id) {
+			*pwatch = watch->next;
+			free(watch);
+			break;
+		}
+	}
+
+	iio_mutex_unlock(client->watch_lock);
+}
+
+static int iiod_client_cmd(const struct iiod_command *cmd,
+			   struct iiod_command_data *data, void *d)
+{
+	struct iiod_client *client = d;
+	struct iiod_client_watch *watch;
+	struct iiod_buf buf;
+	ssize_t len = cmd->code;
+	char drain[256];
+	int ret;
+
+	/* Attribute watch pushes are the only commands we accept. */
+	if (cmd->op != IIOD_OP_WATCH_ATTR || len > IIOD_WATCH_MAX_LEN)
+		return -EINVAL;
+
+	iio_mutex_lock(client->watch_lock);
+
+	for (watch = client->watches; watch; watch = watch->next)
+		if (watch->id == cmd->client_id)
+			break;
+
+	if (!watch) {
+		iio_mutex_unlock(client->watch_lock);
+
+		/* The watch was just cancelled; drop the pushed value */
+		buf.ptr = drain;
+		while (len > 0) {
+			buf.size = len > (ssize_t) sizeof(drain) ?
+				sizeof(drain) : (size_t) len;
+
+			ret = iiod_command_data_read(data, &buf);
+			if (ret < 0)
+				return ret;
+
+			len -= buf.size;
+		}
+
+		return 0;
+	}
+
+	if (len > 0) {
+		buf.ptr = watch->value;
+		buf.size = (size_t) len;
+
+		ret = iiod_command_data_read(data, &buf);
+		if (ret < 0) {
+			iio_mutex_unlock(client->watch_lock);
+			return ret;
+		}
+	}
+
+	(*watch->cb)(watch->priv, len, len > 0 ? watch->value : NULL);
+
+	iio_mutex_unlock(client->watch_lock);
+
+	return 0;
+}
+
+int iiod_client_watch_attr(struct iiod_client *client,
+			   const struct iio_device *dev,
+			   const struct iio_channel *chn,
+			   const char *attr, enum iio_attr_type type,
+			   unsigned int buf_id, unsigned int period_ms,
+			   void (*cb)(void *d, ssize_t len, const char *value),
+			   void *d)
+{
+	struct iiod_io *io;
+	struct iiod_command cmd = { 0 };
+	struct iiod_watch_params params = { 0 };
+	struct iiod_client_watch *watch;
+	struct iiod_buf buf;
+	uint16_t arg1, arg2;
+	uint8_t op;
+	int ret;
+
+	if (!iiod_client_uses_binary_interface(client) ||
+	    !(client->server_features & IIOD_FEAT_ATTR_WATCH))
+		return -ENOSYS;
 
-	ret = iiod_client_write_all(client, src, len);
-	if (ret < 0)
-		goto out_unlock;
+	ret = iiod_client_get_attr_cmd(dev, chn, attr, type, buf_id, false,
+				       &op, &arg1, &arg2);
+	if (ret)
+		return ret;
 
-	ret = iiod_client_read_integer(client, &resp);
-	if (ret < 0)
-		goto out_unlock;
+	watch = zalloc(sizeof(*watch));
+	if (!watch)
+		return -ENOMEM;
 
-	ret = (ssize_t) resp;
+	watch->cb = cb;
+	watch->priv = d;
 
-out_unlock:
-	iio_mutex_unlock(client->lock);
-	return ret;
+	/* Register the watch before the command is sent, so that the
+	 * initial snapshot cannot slip through. */
+	iio_mutex_lock(client->watch_lock);
+	watch->id = client->next_watch_id++;
+	watch->next = client->watches;
+	client->watches = watch;
+	iio_mutex_unlock(client->watch_lock);
+
+	cmd.op = IIOD_OP_WATCH_ATTR;
+	cmd.dev = (uint8_t) iio_device_get_index(dev);
+	cmd.code = (arg1 << 16) | arg2;
+
+	params.op = op;
+	params.id = watch->id;
+	params.period_ms = period_ms;
+
+	buf.ptr = &params;
+	buf.size = sizeof(params);
+
+	io = iiod_responder_get_default_io(client->responder);
+
+	ret = iiod_io_exec_command(io, &cmd, &buf, NULL);
+	if (ret < 0) {
+		iiod_client_remove_watch(client, watch->id);
+		return ret;
+	}
+
+	return watch->id;
 }
 
-static int iiod_client_cmd(const struct iiod_command *cmd,
-			   struct iiod_command_data *data, void *d)
+int iiod_client_unwatch_attr(struct iiod_client *client, int watch_id)
 {
-	/* We don't support receiving commands. */
+	struct iiod_io *io;
+	struct iiod_command cmd = { 0 };
+	int ret;
+
+	if (!iiod_client_uses_binary_interface(client))
+		return -ENOSYS;
+
+	cmd.op = IIOD_OP_UNWATCH_ATTR;
+	cmd.code = watch_id;
+
+	io = iiod_responder_get_default_io(client->responder);
+
+	ret = iiod_io_exec_simple_command(io, &cmd);
+
+	/* Late pushes for an ID no longer in the list are drained in
+	 * iiod_client_cmd(), so the entry can go away right now. */
+	iiod_client_remove_watch(client, (uint16_t) watch_id);
 
-	return -EINVAL;
+	return ret;
 }
 
 static ssize_t
@@ -894,6 +1811,65 @@ iiod_client_read_cb(void *d, const struct iiod_buf *buf, size_t nb)
 	return count;
 }
 
+static ssize_t
+iiod_client_writev_all(struct iiod_client *client,
+		       const struct iiod_buf *bufs, size_t nb)
+{
+	const struct iiod_client_ops *ops = client->ops;
+	struct iiod_client_pdata *desc = client->desc;
+	struct iiod_buf curr_bufs[32], *curr = curr_bufs;
+	unsigned int remaining = 0, timeout_ms = client->params->timeout_ms;
+	uint64_t start_time, diff_ms;
+	ssize_t ret, count = 0;
+
+	if (nb > ARRAY_SIZE(curr_bufs))
+		return -EINVAL;
+
+	memcpy(curr_bufs, bufs, nb * sizeof(*bufs));
+
+	start_time = iiod_responder_read_counter_us();
+
+	if (iiod_client_uses_binary_interface(client))
+		timeout_ms = 0;
+
+	while (nb) {
+		diff_ms = (iiod_responder_read_counter_us() - start_time) / 1000;
+
+		if (timeout_ms) {
+			if (diff_ms >= timeout_ms)
+				return -ETIMEDOUT;
+
+			remaining = (unsigned int)((int64_t)timeout_ms - diff_ms);
+		}
+
+		ret = ops->writev(desc, curr, nb, remaining);
+		if (ret < 0) {
+			if (ret == -EINTR)
+				continue;
+			else
+				return ret;
+		}
+
+		if (ret == 0)
+			return -EPIPE;
+
+		count += ret;
+
+		while (nb && (size_t) ret >= curr->size) {
+			ret -= curr->size;
+			curr++;
+			nb--;
+		}
+
+		if (nb) {
+			curr->ptr = (char *) curr->ptr + ret;
+			curr->size -= ret;
+		}
+	}
+
+	return count;
+}
+
 static ssize_t
 iiod_client_write_cb(void *d, const struct iiod_buf *buf, size_t nb)
 {
@@ -901,6 +1877,12 @@ iiod_client_write_cb(void *d, const struct iiod_buf *buf, size_t nb)
 	ssize_t ret, count = 0;
 	unsigned int i;
 
+	/* With a scatter-gather transport a command header and its payload
+	 * go out in one syscall (and one TCP segment where they fit),
+	 * instead of one small packet per buffer. */
+	if (client->ops->writev && nb > 1 && nb <= 32)
+		return iiod_client_writev_all(client, buf, nb);
+
 	for (i = 0; i < nb; i++) {
 		ret = iiod_client_write_all(client, buf[i].ptr, buf[i].size);
 		if (ret <= 0)
@@ -925,17 +1907,35 @@ static ssize_t iiod_client_discard_cb(void *d, size_t bytes)
 	return bytes;
 }
 
+static ssize_t
+iiod_client_write_fd_cb(void *d, const struct iiod_buf *buf, size_t nb, int fd)
+{
+	struct iiod_client *client = d;
+
+	if (!client->ops->write_fd)
+		return -ENOSYS;
+
+	return client->ops->write_fd(client->desc, buf, nb, fd, 0);
+}
+
 static const struct iiod_responder_ops iiod_client_ops = {
 	.cmd		= iiod_client_cmd,
 	.read		= iiod_client_read_cb,
 	.write		= iiod_client_write_cb,
 	.discard	= iiod_client_discard_cb,
+	.write_fd	= iiod_client_write_fd_cb,
 };
 
 static int iiod_client_enable_binary(struct iiod_client *client)
 {
 	int ret;
 
+	/* Probe the optional features while still in ASCII mode; old
+	 * servers answer unknown commands with an error code, which here
+	 * simply reads as an empty feature mask. */
+	ret = iiod_client_exec_command(client, "FEATURES\r\n");
+	client->server_features = ret > 0 ? (uint32_t) ret : 0;
+
 	ret = iiod_client_exec_command(client, "BINARY\r\n");
 
 	/* If the BINARY command fail, don't create the responder */
@@ -981,6 +1981,23 @@ iiod_client_create_context_private_new(struct iiod_client *client,
 		return iio_ptr(-ENOMEM);
 
 	ret = iiod_client_send_print(client, xml, xml_len);
+	if (ret > 0 && (size_t) ret > xml_len) {
+		/* Undersized buffer; the extra bytes were discarded, but we
+		 * now know the total size, so try again. One single transfer
+		 * of the whole compressed description is much cheaper than
+		 * streaming it in scratch-sized pieces, especially on
+		 * transports like USB where every round trip is costly. */
+		free(xml);
+
+		xml_len = (size_t) ret;
+		xml = malloc(xml_len);
+		if (!xml)
+			return iio_ptr(-ENOMEM);
+
+		ret = iiod_client_send_print(client, xml, xml_len);
+		if (ret > 0 && (size_t) ret > xml_len)
+			ret = -EIO;
+	}
 	if (ret < 0) {
 		prm_perror(client->params, -ret,
 			   "Unable to send PRINT command");
@@ -1153,6 +2170,73 @@ out_unlock:
 	return ctx ? ctx : iio_ptr(ret);
 }
 
+static struct iio_context *
+iiod_client_create_context_bin(struct iiod_client *client,
+			       const struct iio_backend *backend,
+			       const char *description,
+			       const char **ctx_attrs,
+			       const char **ctx_values,
+			       unsigned int nb_ctx_attrs)
+{
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { .op = IIOD_OP_PRINT_BIN };
+	struct iiod_buf iiod_buf, cmd_buf, *cmd_buf_ptr = NULL;
+	struct iio_context *ctx;
+	size_t buf_len = 0x10000;
+	void *buf;
+	int ret;
+
+	if (client->device_filter &&
+	    (client->server_features & IIOD_FEAT_DEV_FILTER)) {
+		cmd.op = IIOD_OP_PRINT_BIN_FILTERED;
+		cmd.code = (int32_t) strlen(client->device_filter);
+		cmd_buf.ptr = client->device_filter;
+		cmd_buf.size = (size_t) cmd.code;
+		cmd_buf_ptr = &cmd_buf;
+	}
+
+	buf = malloc(buf_len);
+	if (!buf)
+		return iio_ptr(-ENOMEM);
+
+	iiod_buf.ptr = buf;
+	iiod_buf.size = buf_len;
+
+	ret = iiod_io_exec_command(io, &cmd, cmd_buf_ptr, &iiod_buf);
+	if (ret > 0 && (size_t) ret > buf_len) {
+		/* Undersized buffer; the extra bytes were discarded, but we
+		 * now know the total size, so try again. */
+		free(buf);
+
+		buf_len = (size_t) ret;
+		buf = malloc(buf_len);
+		if (!buf)
+			return iio_ptr(-ENOMEM);
+
+		iiod_buf.ptr = buf;
+		iiod_buf.size = buf_len;
+
+		ret = iiod_io_exec_command(io, &cmd, cmd_buf_ptr, &iiod_buf);
+		if (ret > 0 && (size_t) ret > buf_len)
+			ret = -EIO;
+	}
+	if (ret < 0) {
+		free(buf);
+		return iio_ptr(ret);
+	}
+
+	ctx = iio_create_context_from_binary(client->params, backend,
+					     description, ctx_attrs,
+					     ctx_values, nb_ctx_attrs,
+					     buf, (size_t) ret);
+	free(buf);
+
+	if (!iio_err(ctx))
+		client->params = &ctx->params;
+
+	return ctx;
+}
+
 struct iio_context * iiod_client_create_context(struct iiod_client *client,
 						const struct iio_backend *backend,
 						const char *description,
@@ -1160,6 +2244,20 @@ struct iio_context * iiod_client_create_context(struct iiod_client *client,
 						const char **ctx_values,
 						unsigned int nb_ctx_attrs)
 {
+	struct iio_context *ctx;
+
+	if (iiod_client_uses_binary_interface(client) &&
+	    (client->server_features & IIOD_FEAT_PRINT_BIN)) {
+		ctx = iiod_client_create_context_bin(client, backend,
+						     description, ctx_attrs,
+						     ctx_values, nb_ctx_attrs);
+		if (!iio_err(ctx))
+			return ctx;
+
+		prm_perror(client->params, -iio_err(ctx),
+			   "Unable to use binary context description");
+	}
+
 	if (!WITH_ZSTD || !iiod_client_uses_binary_interface(client))
 		return iiod_client_create_context_private(client, backend,
 							  description,
@@ -1543,6 +2641,123 @@ int iiod_client_enable_buffer(struct iiod_client_buffer_pdata *pdata,
 	return iiod_io_exec_simple_command(io, &cmd);
 }
 
+int iiod_client_enable_buffers(struct iiod_client_buffer_pdata **pdatas,
+			       size_t nb)
+{
+	struct iiod_command cmd = { 0 };
+	struct iiod_client **clients;
+	struct iiod_io **ios;
+	size_t i, j, nb_clients = 0, nb_io = 0;
+	int ret = 0, err;
+
+	if (!nb)
+		return 0;
+
+	for (i = 0; i < nb; i++) {
+		if (!iiod_client_uses_binary_interface(pdatas[i]->client))
+			return -ENOSYS;
+	}
+
+	ios = calloc(nb, sizeof(*ios));
+	clients = calloc(nb, sizeof(*clients));
+	if (!ios || !clients) {
+		free(clients);
+		free(ios);
+		return -ENOMEM;
+	}
+
+	/* Collect the distinct clients, sorted by address so that two
+	 * concurrent group enables always take the locks in the same
+	 * order. The buffers may all share one connection (serial) or
+	 * have one each (network, usb). */
+	for (i = 0; i < nb; i++) {
+		for (j = 0; j < nb_clients; j++) {
+			if (clients[j] == pdatas[i]->client)
+				break;
+		}
+		if (j < nb_clients)
+			continue;
+
+		while (j > 0 && clients[j - 1] > pdatas[i]->client) {
+			clients[j] = clients[j - 1];
+			j--;
+		}
+		clients[j] = pdatas[i]->client;
+		nb_clients++;
+	}
+
+	for (i = 0; i < nb_clients; i++)
+		iiod_client_mutex_lock(clients[i]);
+
+	for (i = 0; i < nb; i++) {
+		ios[i] = iiod_responder_create_io(pdatas[i]->client->responder,
+						  (uint16_t) (BATCH_FIRST_ID + i));
+		err = iio_err(ios[i]);
+		if (err) {
+			ios[i] = NULL;
+			ret = err;
+			goto out_cancel;
+		}
+
+		nb_io++;
+	}
+
+	/* Register all the response readers, then send all the enable
+	 * commands without waiting for any round trip in between: the
+	 * starts are triggered back to back, even when every buffer sits
+	 * on its own connection. */
+	for (i = 0; i < nb; i++) {
+		err = iiod_io_get_response_async(ios[i], NULL, 0);
+		if (err) {
+			ret = err;
+			goto out_cancel;
+		}
+	}
+
+	for (i = 0; i < nb; i++) {
+		cmd.op = IIOD_OP_ENABLE_BUFFER;
+		cmd.dev = (uint8_t) iio_device_get_index(pdatas[i]->dev);
+		cmd.code = pdatas[i]->idx;
+
+		err = iiod_io_send_command_async(ios[i], &cmd, NULL, 0);
+		if (err) {
+			ret = err;
+			goto out_cancel;
+		}
+	}
+
+	for (i = 0; i < nb; i++) {
+		err = iiod_io_wait_for_command_done(ios[i]);
+		if (!err) {
+			err = (int) iiod_io_wait_for_response(ios[i]);
+		} else {
+			/* Drop the pending response request, so that the io
+			 * is not left in the responder's readers list. */
+			iiod_io_cancel(ios[i]);
+		}
+
+		if (err < 0 && !ret)
+			ret = err;
+	}
+
+	goto out_unref;
+
+out_cancel:
+	for (i = 0; i < nb_io; i++)
+		iiod_io_cancel(ios[i]);
+out_unref:
+	for (i = 0; i < nb_io; i++)
+		iiod_io_unref(ios[i]);
+
+	for (i = nb_clients; i > 0; i--)
+		iiod_client_mutex_unlock(clients[i - 1]);
+
+	free(clients);
+	free(ios);
+
+	return ret;
+}
+
 struct iio_block_pdata *
 iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 			 size_t size, void **data)
@@ -1553,6 +2768,7 @@ iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 	struct iiod_buf buf;
 	int ret = -ENOMEM;
 	uint64_t block_size = size;
+	int memfd = -1;
 
 	if (!iiod_client_uses_binary_interface(client))
 		return iio_ptr(-ENOSYS);
@@ -1569,10 +2785,39 @@ iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 	if (ret)
 		goto err_free_block;
 
-	block->data = malloc(size);
-	if (!block->data)
-		goto err_free_mutex;
+#ifdef __linux__
+	if (pdata->memfd) {
+		/* The block's payload lives in a shared mapping; the server
+		 * maps the same memfd and transfers become local copies. */
+		memfd = memfd_create("iio-block", MFD_CLOEXEC);
+		if (memfd < 0) {
+			ret = -errno;
+			goto err_free_mutex;
+		}
+
+		if (ftruncate(memfd, size) < 0) {
+			ret = -errno;
+			goto err_close_memfd;
+		}
+
+		block->data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				   MAP_SHARED, memfd, 0);
+		if (block->data == MAP_FAILED) {
+			ret = -errno;
+			block->data = NULL;
+			goto err_close_memfd;
+		}
+
+		block->shared = true;
+	}
+#endif
+	if (!block->shared) {
+		block->data = malloc(size);
+		if (!block->data)
+			goto err_free_mutex;
+	}
 
+	block->size = size;
 	block->idx = pdata->next_block_idx++;
 
 	block->io = iiod_responder_create_io(client->responder, block->idx + 1);
@@ -1580,25 +2825,58 @@ iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 	if (ret)
 		goto err_free_data;
 
-	cmd.op = IIOD_OP_CREATE_BLOCK;
+	cmd.op = block->shared ? IIOD_OP_CREATE_BLOCK_MEMFD
+			       : IIOD_OP_CREATE_BLOCK;
 	cmd.dev = (uint8_t) iio_device_get_index(pdata->dev);
 	cmd.code = pdata->idx | (block->idx << 16);
 
-	ret = iiod_io_exec_command(block->io, &cmd, &buf, NULL);
+	if (block->shared) {
+		ret = iiod_io_get_response_async(block->io, NULL, 0);
+		if (ret < 0)
+			goto err_free_io;
+
+		/* The descriptor rides with the command bytes as ancillary
+		 * data, so the server holds it before it runs the handler. */
+		ret = iiod_io_send_command_fd(block->io, &cmd, &buf, 1, memfd);
+		if (ret < 0) {
+			iiod_io_cancel_response(block->io);
+			goto err_free_io;
+		}
+
+		ret = (int) iiod_io_wait_for_response(block->io);
+	} else {
+		ret = iiod_io_exec_command(block->io, &cmd, &buf, NULL);
+	}
 	if (ret < 0)
 		goto err_free_io;
 
+#ifdef __linux__
+	/* Both ends hold a mapping now; the descriptor itself is no
+	 * longer needed. */
+	if (memfd >= 0)
+		close(memfd);
+#endif
+
 	*data = block->data;
 
 	block->buffer = pdata;
-	block->size = size;
 
 	return block;
 
 err_free_io:
 	iiod_io_unref(block->io);
 err_free_data:
-	free(block->data);
+#ifdef __linux__
+	if (block->shared)
+		munmap(block->data, size);
+	else
+#endif
+		free(block->data);
+#ifdef __linux__
+err_close_memfd:
+	if (memfd >= 0)
+		close(memfd);
+#endif
 err_free_mutex:
 	iio_mutex_destroy(block->lock);
 err_free_block:
@@ -1629,40 +2907,160 @@ void iiod_client_free_block(struct iio_block_pdata *block)
 	io = iiod_responder_get_default_io(client->responder);
 	iiod_io_exec_simple_command(io, &cmd);
 
-	free(block->data);
+	free(block->pack_buf);
+	free(block->zstd_buf);
+#ifdef __linux__
+	if (block->shared)
+		munmap(block->data, block->size);
+	else
+#endif
+		free(block->data);
 	iio_mutex_destroy(block->lock);
 	free(block);
 }
 
+#if WITH_ZSTD
+/* Compress a TX payload into the block's scratch buffer, adapting the
+ * level as we go: when compressing a block costs a significant share of
+ * the inter-block interval, the CPU (not the link) is the bottleneck and
+ * the level is lowered; when it is cheap, the level creeps back up to
+ * the negotiated one. Returns zero when the data is not worth
+ * compressing; it is then sent raw. Called with the client lock held. */
+static size_t iiod_client_compress_block(struct iiod_client *client,
+					 struct iio_block_pdata *block,
+					 size_t bytes_used)
+{
+	uint64_t now, interval, elapsed;
+	size_t ret;
+
+	now = iiod_responder_read_counter_us();
+	interval = now - client->zstd_last_us;
+	client->zstd_last_us = now;
+
+	ret = ZSTD_compress2(client->cctx, block->zstd_buf,
+			     block->zstd_buf_len, block->data, bytes_used);
+
+	elapsed = iiod_responder_read_counter_us() - now;
+
+	if (interval && elapsed * 2 > interval && client->zstd_level > 1) {
+		ZSTD_CCtx_setParameter(client->cctx, ZSTD_c_compressionLevel,
+				       --client->zstd_level);
+	} else if (elapsed * 8 < interval &&
+		   client->zstd_level < client->zstd_level_max) {
+		ZSTD_CCtx_setParameter(client->cctx, ZSTD_c_compressionLevel,
+				       ++client->zstd_level);
+	}
+
+	if (ZSTD_isError(ret) || ret >= bytes_used)
+		return 0;
+
+	return ret;
+}
+#endif
+
 int iiod_client_enqueue_block(struct iio_block_pdata *block,
 			      size_t bytes_used, bool cyclic)
 {
 	struct iiod_client_buffer_pdata *pdata = block->buffer;
+	struct iiod_client *client = pdata->client;
 	struct iiod_command cmd;
-	struct iiod_buf buf[2];
+	struct iiod_buf buf[3];
 	bool is_rx = !iio_device_is_tx(pdata->dev);
 	unsigned int nb_buf = 1;
+	bool cached;
 	int ret = 0;
 
 	if (bytes_used > block->size)
 		return -EINVAL;
 
+	/* If the server already holds this exact payload from a previous
+	 * enqueue, a cyclic enqueue may reference it instead of
+	 * re-sending it: bytes_used == 0 on the wire tells the server to
+	 * loop the block's current contents. */
+	cached = cyclic && !is_rx && pdata->cyclic_cache && block->uploaded &&
+		 bytes_used && block->uploaded_bytes_used == bytes_used;
+
+#if WITH_ZSTD
+	if (client->zstd_blocks && !cached && !block->shared &&
+	    !block->zstd_buf) {
+		block->zstd_buf_len = ZSTD_compressBound(block->size);
+		block->zstd_buf = malloc(block->zstd_buf_len);
+		if (!block->zstd_buf)
+			return -ENOMEM;
+	}
+#endif
+
+	if (pdata->pack && !cached && !block->pack_buf) {
+		block->pack_buf = malloc(iio_packed_size(block->size,
+							 pdata->pack_bits,
+							 pdata->pack_length));
+		if (!block->pack_buf)
+			return -ENOMEM;
+	}
+
 	cmd.op = cyclic ? IIOD_OP_ENQUEUE_BLOCK_CYCLIC : IIOD_OP_TRANSFER_BLOCK;
 	cmd.dev = (uint8_t) iio_device_get_index(pdata->dev);
 	cmd.code = pdata->idx | (block->idx << 16);
 
-	block->bytes_used = bytes_used;
+	block->bytes_used = cached ? 0 : bytes_used;
 	buf[0].ptr = &block->bytes_used;
 	buf[0].size = 8;
 	buf[1].ptr = block->data;
 
 	if (is_rx) {
 		buf[1].size = block->size;
-	} else if (bytes_used) {
+	} else if (bytes_used && !cached && !client->oob && !block->shared) {
 		buf[1].size = bytes_used;
 		nb_buf++;
 	}
 
+	if (pdata->pack && is_rx) {
+		/* The response carries the packed payload; it is unpacked
+		 * into the block in iiod_client_dequeue_block(). */
+		buf[1].ptr = block->pack_buf;
+		buf[1].size = iio_packed_size(block->size, pdata->pack_bits,
+					      pdata->pack_length);
+	} else if (pdata->pack && bytes_used && !cached) {
+		iio_pack_samples(block->pack_buf, block->data, bytes_used,
+				 pdata->pack_bits, pdata->pack_length,
+				 pdata->pack_shift);
+
+		buf[1].ptr = block->pack_buf;
+		buf[1].size = iio_packed_size(bytes_used, pdata->pack_bits,
+					      pdata->pack_length);
+		nb_buf = 2;
+	}
+
+#if WITH_ZSTD
+	if (client->zstd_blocks && is_rx && !block->shared) {
+		/* The response carries a compressed payload of up to
+		 * ZSTD_compressBound(size) bytes; it is inflated into the
+		 * block in iiod_client_dequeue_block(). */
+		buf[1].ptr = block->zstd_buf;
+		buf[1].size = block->zstd_buf_len;
+	} else if (client->zstd_blocks && bytes_used && !cached &&
+		   !block->shared) {
+		iiod_client_mutex_lock(client);
+		block->zstd_csize =
+			iiod_client_compress_block(client, block, bytes_used);
+		iiod_client_mutex_unlock(client);
+
+		buf[1].ptr = &block->zstd_csize;
+		buf[1].size = 8;
+
+		if (block->zstd_csize) {
+			buf[2].ptr = block->zstd_buf;
+			buf[2].size = (size_t) block->zstd_csize;
+		} else {
+			/* Incompressible; send it raw */
+			buf[2].ptr = block->data;
+			buf[2].size = bytes_used;
+		}
+
+		nb_buf = 3;
+	}
+#endif
+
 	iio_mutex_lock(block->lock);
 
 	if (block->enqueued) {
@@ -1670,7 +3068,13 @@ int iiod_client_enqueue_block(struct iio_block_pdata *block,
 		goto out_unlock;
 	}
 
-	iiod_io_get_response_async(block->io, &buf[1], is_rx);
+	/* With striped or UDP transfers the payload moves out-of-band, and
+	 * with shared-memory blocks it does not move at all; register the
+	 * response without a data buffer, the payload is collected in
+	 * iiod_client_dequeue_block() or already sits in the mapping. */
+	iiod_io_get_response_async(block->io, &buf[1],
+				   is_rx && !client->oob && !block->shared &&
+				   !block->buffer->udp);
 
 	ret = iiod_io_send_command_async(block->io, &cmd, buf, nb_buf);
 	if (ret < 0) {
@@ -1678,6 +3082,21 @@ int iiod_client_enqueue_block(struct iio_block_pdata *block,
 		goto out_unlock;
 	}
 
+	if (!is_rx && client->oob && bytes_used) {
+		ret = (int) client->ops->write_block_oob(client->desc,
+							 (uint64_t)(uint32_t) cmd.code,
+							 block->data,
+							 bytes_used);
+		if (ret >= 0)
+			ret = 0;
+	}
+
+	/* Remember what the server now holds in this block */
+	if (ret == 0 && !is_rx) {
+		block->uploaded = bytes_used != 0;
+		block->uploaded_bytes_used = bytes_used;
+	}
+
 	block->enqueued = true;
 
 out_unlock:
@@ -1716,6 +3135,56 @@ int iiod_client_dequeue_block(struct iio_block_pdata *block, bool nonblock)
 
 	block->enqueued = false;
 
+	if (ret > 0 && block->buffer->pack &&
+	    !iio_device_is_tx(block->buffer->dev)) {
+		struct iiod_client_buffer_pdata *pdata = block->buffer;
+
+		if ((size_t) ret != iio_packed_size(block->size,
+						    pdata->pack_bits,
+						    pdata->pack_length)) {
+			ret = -EPROTO;
+		} else {
+			iio_unpack_samples(block->data, block->pack_buf,
+					   block->size, pdata->pack_bits,
+					   pdata->pack_length,
+					   pdata->pack_shift);
+			ret = (int) block->size;
+		}
+	}
+
+#if WITH_ZSTD
+	if (ret > 0 && block->buffer->client->zstd_blocks && !block->shared &&
+	    !iio_device_is_tx(block->buffer->dev)) {
+		struct iiod_client *client = block->buffer->client;
+		size_t len;
+
+		iiod_client_mutex_lock(client);
+		len = ZSTD_decompressDCtx(client->dctx,
+					  block->data, block->size,
+					  block->zstd_buf, (size_t) ret);
+		iiod_client_mutex_unlock(client);
+
+		ret = ZSTD_isError(len) ? -EIO : (int) len;
+	}
+#endif
+
+	if (ret >= 0 && (block->buffer->client->oob || block->buffer->udp) &&
+	    !iio_device_is_tx(block->buffer->dev)) {
+		struct iiod_client *client = block->buffer->client;
+		uint64_t tag = block->buffer->idx | (block->idx << 16);
+
+		ret = (int) client->ops->read_block_oob(client->desc, tag,
+							block->data,
+							block->size);
+		if (ret > 0 && !block->buffer->udp)
+			ret = (int) block->size;
+		else if (ret == 0 && block->buffer->udp) {
+			/* Every datagram of the block was lost; report the
+			 * same way as a kernel overflow. */
+			ret = -EIO;
+		}
+	}
+
 out_unlock:
 	iio_mutex_unlock(block->lock);
 
@@ -7,6 +7,7 @@
  */
 
 #include "iiod-responder.h"
+#include "iio-trace.h"
 
 #include <errno.h>
 #include <iio/iio.h>
@@ -21,6 +22,20 @@
 
 #define NB_BUFS_MAX 2
 
+/* Response frames up to this total payload size count as control traffic
+ * and are written ahead of queued bulk frames (block payloads), so that
+ * e.g. an attribute read does not wait behind megabytes of capture data
+ * already sitting in the write queue. Only responses are classified:
+ * commands must reach the remote in issue order. */
+#define PRIO_FRAME_MAX_SIZE 4096
+
+/* Frames up to this total size (header included) may be coalesced with
+ * the frames queued behind them, so that bursts of small frames (e.g.
+ * the blocks of a fast control loop) leave in one write and one packet
+ * instead of one each. Larger frames are not worth the extra copy. */
+#define COALESCE_FRAME_MAX_SIZE 4096
+#define COALESCE_STAGE_SIZE (16 * 1024)
+
 struct iiod_client_data {
 	/*
 	 * Structure for the command to send.
@@ -32,6 +47,10 @@ struct iiod_client_data {
 	struct iiod_buf buf[NB_BUFS_MAX];
 	size_t nb_buf;
 
+	/* File descriptor to attach to the command bytes as ancillary
+	 * data, or -1 */
+	int fd;
+
 	/* Value representing the time at which the command was sent. */
 	uint64_t start_time;
 };
@@ -68,11 +87,23 @@ struct iiod_responder {
 	struct iiod_io *readers, *writers, *default_io;
 	uint16_t next_client_id;
 
+	/* Freelist of iiod_io objects (linked through r_next), so that the
+	 * steady-state command path does not allocate: an unref'd io keeps
+	 * its mutex and cond and is handed out again by the next
+	 * iiod_responder_create_io() call. Protected by "lock". */
+	struct iiod_io *io_pool;
+	unsigned int io_pool_size;
+
 	struct iio_mutex *lock;
 	struct iio_thrd *read_thrd;
 	struct iio_task *write_task;
 	struct iio_thrd *write_thrd;
 
+	/* Staging buffer of the writer task, used to coalesce consecutive
+	 * small frames; only ever touched by the task's single worker. */
+	char *stage;
+	size_t stage_len;
+
 	bool thrd_stop;
 	int thrd_err_code;
 	unsigned int timeout_ms;
@@ -126,7 +157,7 @@ static void __iiod_io_cancel_unlocked(struct iiod_io *io)
 static ssize_t iiod_rw_all(struct iiod_responder *priv,
 			   const struct iiod_buf *cmd_buf,
 			   const struct iiod_buf *buf, size_t nb,
-			   size_t bytes, bool is_read)
+			   size_t bytes, bool is_read, int fd)
 {
 	ssize_t ret, count = 0;
 	struct iiod_buf bufs[32], *curr = &bufs[0];
@@ -151,10 +182,21 @@ static ssize_t iiod_rw_all(struct iiod_responder *priv,
 			nb = 1;
 		}
 
-		if (is_read)
+		if (is_read) {
 			ret = priv->ops->read(priv->d, curr, nb);
-		else
+			iio_trace2(responder_recv, priv, ret);
+		} else if (fd >= 0 && priv->ops->write_fd) {
+			ret = priv->ops->write_fd(priv->d, curr, nb, fd);
+			iio_trace2(responder_send, priv, ret);
+			if (ret > 0) {
+				/* The descriptor rides with the first bytes
+				 * written; don't send it again. */
+				fd = -1;
+			}
+		} else {
 			ret = priv->ops->write(priv->d, curr, nb);
+			iio_trace2(responder_send, priv, ret);
+		}
 		if (ret <= 0)
 			return ret;
 
@@ -197,7 +239,7 @@ int iiod_command_data_read(struct iiod_command_data *data,
 	struct iiod_responder *priv = (struct iiod_responder *) data;
 	ssize_t ret;
 
-	ret = iiod_rw_all(priv, NULL, buf, 1, buf->size, true);
+	ret = iiod_rw_all(priv, NULL, buf, 1, buf->size, true, -1);
 	if (ret < 0)
 		return (int) ret;
 	if (ret != buf->size)
@@ -252,7 +294,7 @@ static int iiod_responder_reader_thrd(void *d)
 	while (!priv->thrd_stop) {
 		iio_mutex_unlock(priv->lock);
 
-		ret = iiod_rw_all(priv, NULL, &cmd_buf, 1, sizeof(cmd), true);
+		ret = iiod_rw_all(priv, NULL, &cmd_buf, 1, sizeof(cmd), true, -1);
 
 		iio_mutex_lock(priv->lock);
 		if (ret <= 0)
@@ -292,7 +334,7 @@ static int iiod_responder_reader_thrd(void *d)
 
 		if (io->r_io.nb_buf && cmd.code > 0) {
 			ret = iiod_rw_all(priv, NULL, io->r_io.buf,
-					  io->r_io.nb_buf, cmd.code, true);
+					  io->r_io.nb_buf, cmd.code, true, -1);
 
 			if (ret > 0 && (size_t) ret < (size_t) cmd.code)
 				iiod_discard_data(priv, cmd.code - ret);
@@ -327,34 +369,123 @@ static int iiod_responder_write(void *p, void *elm)
 {
 	struct iiod_responder *priv = p;
 	struct iiod_io *writer = elm;
+	struct iiod_buf bufs[NB_BUFS_MAX + 2];
 	struct iiod_command cmd;
-	struct iiod_buf cmd_buf;
+	size_t i, nb = 0, bytes = sizeof(cmd);
 	ssize_t ret;
 
-	cmd_buf.ptr = &writer->w_io.cmd;
-	cmd_buf.size = sizeof(cmd);
+	if (!writer) {
+		/* Stage-flush sentinel (see iiod_responder_flush_stage) */
+		if (!priv->stage_len)
+			return 0;
+
+		bufs[0].ptr = priv->stage;
+		bufs[0].size = priv->stage_len;
+
+		iiod_rw_all(priv, NULL, bufs, 1, 0, false, -1);
+		priv->stage_len = 0;
+
+		return 0;
+	}
+
+	for (i = 0; i < writer->w_io.nb_buf; i++)
+		bytes += writer->w_io.buf[i].size;
+
+	/* Coalesce small frames: when more writes are already queued
+	 * behind this one, stage the frame instead of writing it. The
+	 * writer task has a single worker, so the next element is
+	 * dispatched right after this one and will either join the stage
+	 * or flush it in one write; frames are never delayed waiting for
+	 * work that is not already queued, so no timer is needed. */
+	if (priv->stage && writer->w_io.fd < 0
+	    && bytes <= COALESCE_FRAME_MAX_SIZE
+	    && priv->stage_len + bytes <= COALESCE_STAGE_SIZE
+	    && iio_task_has_pending(priv->write_task)) {
+		memcpy(priv->stage + priv->stage_len,
+		       &writer->w_io.cmd, sizeof(cmd));
+		priv->stage_len += sizeof(cmd);
+
+		for (i = 0; i < writer->w_io.nb_buf; i++) {
+			memcpy(priv->stage + priv->stage_len,
+			       writer->w_io.buf[i].ptr,
+			       writer->w_io.buf[i].size);
+			priv->stage_len += writer->w_io.buf[i].size;
+		}
+
+		writer->w_io.cmd.code = (int32_t) bytes;
+		return 0;
+	}
+
+	if (priv->stage_len && writer->w_io.fd >= 0) {
+		/* An attached descriptor rides with the first bytes of its
+		 * own frame; flush the staged frames separately. */
+		bufs[0].ptr = priv->stage;
+		bufs[0].size = priv->stage_len;
+
+		ret = iiod_rw_all(priv, NULL, bufs, 1, 0, false, -1);
+		priv->stage_len = 0;
+		if (ret <= 0) {
+			writer->w_io.cmd.code = (int32_t) ret;
+			return 0;
+		}
+	}
 
-	ret = iiod_rw_all(priv, &cmd_buf, writer->w_io.buf,
-			  writer->w_io.nb_buf, 0, false);
+	if (priv->stage_len) {
+		bufs[nb].ptr = priv->stage;
+		bufs[nb++].size = priv->stage_len;
+	}
+
+	bufs[nb].ptr = &writer->w_io.cmd;
+	bufs[nb++].size = sizeof(cmd);
+
+	for (i = 0; i < writer->w_io.nb_buf; i++)
+		bufs[nb++] = writer->w_io.buf[i];
+
+	ret = iiod_rw_all(priv, NULL, bufs, nb, 0, false, writer->w_io.fd);
+	if (ret > 0)
+		ret -= (ssize_t) priv->stage_len;
+	priv->stage_len = 0;
 	writer->w_io.cmd.code = (int32_t) ret;
 
 	return 0;
 }
 
+/* A cancelled write token is completed without running the write fn, so
+ * the frame whose pending neighbor made iiod_responder_write() stage it
+ * for coalescing would be stranded in the stage buffer forever. Push a
+ * no-op element through the write task: it runs the write fn once more
+ * on the writer thread, which flushes whatever the cancelled element
+ * left behind. */
+static void iiod_responder_flush_stage(struct iiod_responder *priv)
+{
+	iio_mutex_lock(priv->lock);
+	if (!priv->thrd_stop && priv->stage)
+		iio_task_enqueue_autoclear(priv->write_task, NULL);
+	iio_mutex_unlock(priv->lock);
+}
+
 static int iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
 				uint8_t dev, int32_t code,
-				const struct iiod_buf *buf, size_t nb)
+				const struct iiod_buf *buf, size_t nb, int fd)
 {
 	struct iiod_responder *priv = writer->responder;
+	size_t i, bytes = 0;
+	bool prio;
 
 	if (nb > NB_BUFS_MAX)
 		return -EINVAL;
 
+	for (i = 0; i < nb; i++)
+		bytes += buf[i].size;
+
+	prio = op == IIOD_OP_RESPONSE && bytes <= PRIO_FRAME_MAX_SIZE;
+
 	writer->w_io.start_time = read_counter_us();
 	writer->w_io.cmd.op = op;
 	writer->w_io.cmd.dev = dev;
 	writer->w_io.cmd.client_id = writer->client_id;
 	writer->w_io.cmd.code = code;
+	writer->w_io.fd = fd;
 	if (nb)
 		memcpy(writer->w_io.buf, buf, sizeof(*buf) * nb);
 	writer->w_io.nb_buf = nb;
@@ -368,7 +499,11 @@ static int iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
 		return priv->thrd_err_code;
 	}
 
-	writer->write_token = iio_task_enqueue(priv->write_task, writer);
+	if (prio)
+		writer->write_token = iio_task_enqueue_prio(priv->write_task,
+							    writer);
+	else
+		writer->write_token = iio_task_enqueue(priv->write_task, writer);
 	iio_mutex_unlock(priv->lock);
 
 	return iio_err(writer->write_token);
@@ -398,6 +533,7 @@ int iiod_io_wait_for_command_done(struct iiod_io *io)
 {
 	uint64_t diff_ms = 0, timeout_ms = io->timeout_ms;
 	struct iio_task_token *token;
+	int ret;
 
 	iio_mutex_lock(io->lock);
 	token = io->write_token;
@@ -414,7 +550,14 @@ int iiod_io_wait_for_command_done(struct iiod_io *io)
 			iio_task_cancel(token);
 	}
 
-	return iio_task_sync(token, (unsigned int)(timeout_ms - diff_ms));
+	ret = iio_task_sync(token, (unsigned int)(timeout_ms - diff_ms));
+
+	/* The write fn itself always returns zero, so a non-zero code
+	 * means the token was cancelled without the write fn running */
+	if (ret)
+		iiod_responder_flush_stage(io->responder);
+
+	return ret;
 }
 
 bool iiod_io_has_response(struct iiod_io *io)
@@ -479,7 +622,7 @@ int iiod_io_send_command_async(struct iiod_io *io,
 			       const struct iiod_buf *buf, size_t nb)
 {
 	return iiod_enqueue_command(io, cmd->op, cmd->dev,
-				    cmd->code, buf, nb);
+				    cmd->code, buf, nb, -1);
 }
 
 int iiod_io_send_command(struct iiod_io *io,
@@ -495,10 +638,27 @@ int iiod_io_send_command(struct iiod_io *io,
 	return iiod_io_wait_for_command_done(io);
 }
 
+int iiod_io_send_command_fd(struct iiod_io *io,
+			    const struct iiod_command *cmd,
+			    const struct iiod_buf *buf, size_t nb, int fd)
+{
+	int ret;
+
+	if (!io->responder->ops->write_fd)
+		return -ENOSYS;
+
+	ret = iiod_enqueue_command(io, cmd->op, cmd->dev,
+				   cmd->code, buf, nb, fd);
+	if (ret)
+		return ret;
+
+	return iiod_io_wait_for_command_done(io);
+}
+
 int iiod_io_send_response_async(struct iiod_io *io, intptr_t code,
 				const struct iiod_buf *buf, size_t nb)
 {
-	return iiod_enqueue_command(io, IIOD_OP_RESPONSE, 0, code, buf, nb);
+	return iiod_enqueue_command(io, IIOD_OP_RESPONSE, 0, code, buf, nb, -1);
 }
 
 int iiod_io_send_response(struct iiod_io *io, intptr_t code,
@@ -570,12 +730,62 @@ int iiod_io_exec_command(struct iiod_io *io,
 	return (int) iiod_io_wait_for_response(io);
 }
 
+static void iiod_io_destroy(struct iiod_io *io)
+{
+	iio_mutex_destroy(io->lock);
+	iio_cond_destroy(io->cond);
+	free(io);
+}
+
+static void iiod_responder_drain_io_pool(struct iiod_responder *priv)
+{
+	struct iiod_io *io, *next;
+
+	for (io = priv->io_pool; io; io = next) {
+		next = io->r_next;
+		iiod_io_destroy(io);
+	}
+
+	priv->io_pool = NULL;
+	priv->io_pool_size = 0;
+}
+
+/* Bounds how many idle iiod_io objects a responder keeps around. The
+ * pool converges to the command concurrency, which is far below this. */
+#define IO_POOL_MAX 64
+
 struct iiod_io *
 iiod_responder_create_io(struct iiod_responder *priv, uint16_t id)
 {
-	struct iiod_io *io;
+	struct iiod_io *io = NULL;
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
 	int err;
 
+	iio_mutex_lock(priv->lock);
+	if (priv->io_pool) {
+		io = priv->io_pool;
+		priv->io_pool = io->r_next;
+		priv->io_pool_size--;
+	}
+	iio_mutex_unlock(priv->lock);
+
+	if (io) {
+		lock = io->lock;
+		cond = io->cond;
+
+		memset(io, 0, sizeof(*io));
+
+		io->lock = lock;
+		io->cond = cond;
+		io->responder = priv;
+		io->refcnt = 1;
+		io->timeout_ms = priv->timeout_ms;
+		io->client_id = id;
+
+		return io;
+	}
+
 	io = zalloc(sizeof(*io));
 	if (!io)
 		return iio_ptr(-ENOMEM);
@@ -625,6 +835,10 @@ iiod_responder_create(const struct iiod_responder_ops *ops, void *d)
 	priv->ops = ops;
 	priv->d = d;
 
+	/* Best-effort: without the staging buffer, small frames are
+	 * simply not coalesced. */
+	priv->stage = malloc(COALESCE_STAGE_SIZE);
+
 	priv->lock = iio_mutex_create();
 	err = iio_err(priv->lock);
 	if (err)
@@ -655,9 +869,11 @@ err_free_write_task:
 	iio_task_destroy(priv->write_task);
 err_free_io:
 	iiod_io_unref(priv->default_io);
+	iiod_responder_drain_io_pool(priv);
 err_free_lock:
 	iio_mutex_destroy(priv->lock);
 err_free_priv:
+	free(priv->stage);
 	free(priv);
 	return iio_ptr(err);
 }
@@ -670,7 +886,9 @@ void iiod_responder_destroy(struct iiod_responder *priv)
 	iio_task_destroy(priv->write_task);
 
 	iiod_io_unref(priv->default_io);
+	iiod_responder_drain_io_pool(priv);
 	iio_mutex_destroy(priv->lock);
+	free(priv->stage);
 	free(priv);
 }
 
@@ -704,20 +922,14 @@ void iiod_io_cancel(struct iiod_io *io)
 	/* Discard the entry from the writers list */
 	if (token) {
 		iio_task_cancel(token);
-		iio_task_sync(token, 0);
+		if (iio_task_sync(token, 0))
+			iiod_responder_flush_stage(priv);
 	}
 
 	/* Cancel any pending response request */
 	iiod_io_cancel_response(io);
 }
 
-static void iiod_io_destroy(struct iiod_io *io)
-{
-	iio_mutex_destroy(io->lock);
-	iio_cond_destroy(io->cond);
-	free(io);
-}
-
 void iiod_io_ref(struct iiod_io *io)
 {
 	struct iiod_responder *priv = io->responder;
@@ -737,8 +949,15 @@ void iiod_io_unref(struct iiod_io *io)
 	iio_mutex_lock(priv->lock);
 
 	io->refcnt -= 1;
-	if (io->refcnt == 0)
-		iiod_io_destroy(io);
+	if (io->refcnt == 0) {
+		if (priv->io_pool_size < IO_POOL_MAX) {
+			io->r_next = priv->io_pool;
+			priv->io_pool = io;
+			priv->io_pool_size++;
+		} else {
+			iiod_io_destroy(io);
+		}
+	}
 
 	iio_mutex_unlock(priv->lock);
 }
@@ -50,9 +50,143 @@ enum iiod_opcode {
 	IIOD_OP_TRANSFER_BLOCK,
 	IIOD_OP_ENQUEUE_BLOCK_CYCLIC,
 
+	IIOD_OP_READ_ATTRS,
+	IIOD_OP_WRITE_ATTRS,
+
+	/* Same as IIOD_OP_PRINT, but responds with the compact binary
+	 * context description instead of the ZSTD-compressed XML. */
+	IIOD_OP_PRINT_BIN,
+
+	/* Enable striped block transfers on this connection: "code" holds
+	 * the number of stripe connections the client will attach, and the
+	 * payload an 8-byte token. The stripe connections attach with the
+	 * ASCII "STRIPE <token> <index>" command and then carry only block
+	 * payloads: each transfer is split into one contiguous chunk of
+	 * ceil(size / nb) bytes per stripe, in offset order, each chunk
+	 * prefixed with the 8-byte tag of the transfer command. */
+	IIOD_OP_STRIPE_ENABLE,
+
+	/* Enable zstd-compressed block transfers on this connection:
+	 * "dev" holds the compression level, "code" the size of an
+	 * optional trained dictionary carried in the payload. Once
+	 * enabled, TX payloads are prefixed with a 64-bit compressed
+	 * size (zero meaning the data is sent raw), and RX responses
+	 * carry the compressed size in their code. */
+	IIOD_OP_ZSTD_ENABLE,
+
+	/* Enable the bit-packing codec on one buffer: "dev" holds the
+	 * device index and "code" the buffer index, like the other
+	 * buffer commands. The 4-byte payload carries the sample format
+	 * the client derived from the enabled channels (valuable bits,
+	 * sample length in bits, right-shift); the server verifies it
+	 * against its own view of the buffer's mask. Once enabled, block
+	 * payloads of that buffer only carry the valuable bits of each
+	 * sample (see bit-pack.h). */
+	IIOD_OP_PACK_ENABLE,
+
+	/* Same as IIOD_OP_CREATE_BLOCK, but the block's payload lives in
+	 * shared memory: the client creates a memfd of the block's size and
+	 * attaches it to the command bytes as SCM_RIGHTS ancillary data.
+	 * Both ends map it, and later transfers of that block only carry
+	 * the 8-byte bytes_used field; the payload itself never crosses
+	 * the socket. Only available on Unix-domain connections (see
+	 * IIOD_FEAT_MEMFD). */
+	IIOD_OP_CREATE_BLOCK_MEMFD,
+
+	/* Read this connection's throughput counters. The response payload
+	 * is six uint64_t values: bytes received from the client, bytes
+	 * sent to the client, capture blocks transferred, output blocks
+	 * transferred, commands processed, and block dequeues that had to
+	 * wait for the hardware. */
+	IIOD_OP_GETSTATS,
+
+	/* Batch register access: "dev" holds the device index and "code"
+	 * the number of registers. The payload of IIOD_OP_REG_READ_MULTI
+	 * is that many uint32_t addresses, and the response payload one
+	 * uint32_t value per address. The payload of IIOD_OP_REG_WRITE_MULTI
+	 * is the addresses followed by the values; the response only
+	 * carries a return code. Processing stops at the first register
+	 * that fails. */
+	IIOD_OP_REG_READ_MULTI,
+	IIOD_OP_REG_WRITE_MULTI,
+
+	/* Subscribe to an attribute: "dev" and "code" address the
+	 * attribute like the IIOD_OP_READ_*ATTR commands, and the payload
+	 * is a struct iiod_watch_params naming the read opcode, the watch
+	 * ID chosen by the client and the poll period. The server then
+	 * reads the attribute periodically and, whenever the value (or
+	 * the read's error code) changes, pushes a command back to the
+	 * client: op IIOD_OP_WATCH_ATTR, client_id the watch ID, code the
+	 * value length (or the negative error), and the value as payload.
+	 * The first read after subscribing always pushes, so the client
+	 * gets an initial snapshot. Values are capped to
+	 * IIOD_WATCH_MAX_LEN bytes.
+	 *
+	 * IIOD_OP_UNWATCH_ATTR cancels the watch whose ID is in "code";
+	 * pushes already in flight may still arrive after its response. */
+	IIOD_OP_WATCH_ATTR,
+	IIOD_OP_UNWATCH_ATTR,
+
+	/* Switch one capture buffer's block payloads to an unreliable UDP
+	 * data plane: "dev" holds the device index, "code" the buffer
+	 * index, and the payload an 8-byte token. The server binds a UDP
+	 * socket on its side of the connection and responds with its port
+	 * number; the client then sends the token as a datagram to that
+	 * port and the server echoes it back, which pins both endpoint
+	 * addresses. Transfer responses are sent first (carrying the
+	 * payload size in their code) and the payload follows as
+	 * datagrams of a struct iiod_udp_hdr plus up to
+	 * IIOD_UDP_CHUNK_SIZE bytes. Lost datagrams are never resent:
+	 * the client fills what arrives and accounts the rest as lost,
+	 * so one dropped packet delays nothing behind it. */
+	IIOD_OP_UDP_ENABLE,
+
+	/* Same as IIOD_OP_PRINT_BIN, but restricted to a subset of the
+	 * devices: "code" holds the length of the command payload, which
+	 * is a comma-separated list of device IDs, names or labels. The
+	 * response is the compact binary description of just those
+	 * devices, so single-device clients neither transfer nor parse
+	 * the rest of the context. */
+	IIOD_OP_PRINT_BIN_FILTERED,
+
 	IIOD_NB_OPCODES,
 };
 
+/* Optional features of the binary protocol. The mask of features that a
+ * server supports is advertised through the ASCII "FEATURES" command,
+ * before the interface switch; servers too old to know that command
+ * simply report an error, i.e. an empty mask. */
+#define IIOD_FEAT_ATTRS_BULK	(1 << 0)
+#define IIOD_FEAT_PRINT_BIN	(1 << 1)
+#define IIOD_FEAT_STRIPE	(1 << 2)
+#define IIOD_FEAT_ZSTD_BLOCKS	(1 << 3)
+#define IIOD_FEAT_PACK		(1 << 4)
+/* The server understands a cyclic enqueue with bytes_used == 0 as "loop
+ * the payload the block already holds", so that an unmodified waveform
+ * does not have to be re-uploaded when it is restarted. */
+#define IIOD_FEAT_CYCLIC_CACHE	(1 << 5)
+/* The server accepts IIOD_OP_CREATE_BLOCK_MEMFD. Only advertised on
+ * Unix-domain connections, which can carry file descriptors. */
+#define IIOD_FEAT_MEMFD		(1 << 6)
+/* The server accepts IIOD_OP_GETSTATS */
+#define IIOD_FEAT_STATS		(1 << 7)
+/* The server accepts IIOD_OP_REG_READ_MULTI / IIOD_OP_REG_WRITE_MULTI */
+#define IIOD_FEAT_REG_MULTI	(1 << 8)
+/* The server accepts IIOD_OP_WATCH_ATTR / IIOD_OP_UNWATCH_ATTR */
+#define IIOD_FEAT_ATTR_WATCH	(1 << 9)
+/* The server accepts IIOD_OP_UDP_ENABLE */
+#define IIOD_FEAT_UDP		(1 << 10)
+/* The server accepts IIOD_OP_PRINT_BIN_FILTERED */
+#define IIOD_FEAT_DEV_FILTER	(1 << 11)
+
+/* IIOD_FEAT_ZSTD_BLOCKS is added by the server when built WITH_ZSTD,
+ * IIOD_FEAT_MEMFD on AF_UNIX connections only */
+#define IIOD_FEATURES		(IIOD_FEAT_ATTRS_BULK | IIOD_FEAT_PRINT_BIN \
+				 | IIOD_FEAT_STRIPE | IIOD_FEAT_PACK \
+				 | IIOD_FEAT_CYCLIC_CACHE | IIOD_FEAT_STATS \
+				 | IIOD_FEAT_REG_MULTI | IIOD_FEAT_ATTR_WATCH \
+				 | IIOD_FEAT_UDP | IIOD_FEAT_DEV_FILTER)
+
 struct iiod_command {
 	uint16_t client_id;
 	uint8_t op;
@@ -60,17 +194,77 @@ struct iiod_command {
 	int32_t code;
 };
 
+/* Header of each datagram of the UDP data plane (see
+ * IIOD_OP_UDP_ENABLE). "tag" identifies the transfer like the striped
+ * chunks do, "total" is the payload size of the whole transfer and
+ * "offset" the position of this datagram's bytes within it. The chunk
+ * size keeps datagrams under the common 1500-byte Ethernet MTU, as a
+ * fragmented datagram is lost whenever any of its fragments is. */
+struct iiod_udp_hdr {
+	uint64_t tag;
+	uint32_t total;
+	uint32_t offset;
+};
+
+#define IIOD_UDP_CHUNK_SIZE	(1400 - sizeof(struct iiod_udp_hdr))
+
 struct iiod_buf {
 	void *ptr;
 	size_t size;
 };
 
+/* Upper bound on the number of stripe connections per data connection */
+#define IIOD_MAX_STRIPES 8
+
+/* One entry of the payload of a IIOD_OP_READ_ATTRS or IIOD_OP_WRITE_ATTRS
+ * command, whose code field contains the number of entries. The "op", "dev",
+ * "arg1" and "arg2" fields have the same meaning as for the corresponding
+ * single-attribute commands. For writes, the attribute values follow the
+ * entries, each one padded to the next multiple of four bytes.
+ *
+ * The response to IIOD_OP_READ_ATTRS is a sequence of one int32_t return
+ * code per entry, each positive code being followed by that many bytes of
+ * value (padded to the next multiple of four bytes). The response to
+ * IIOD_OP_WRITE_ATTRS is one int32_t return code per entry. */
+struct iiod_attrs_entry {
+	uint8_t op;
+	uint8_t dev;
+	uint16_t arg1;
+	uint16_t arg2;
+
+	/* Max length to read for IIOD_OP_READ_ATTRS,
+	 * length of the value for IIOD_OP_WRITE_ATTRS */
+	uint16_t len;
+};
+
+#define IIOD_ATTRS_PAD(len) (((len) + 3) & ~(size_t)3)
+
+/* Payload of a IIOD_OP_WATCH_ATTR command. "op" is the
+ * IIOD_OP_READ_*ATTR opcode identifying the kind of attribute, "id" the
+ * client-chosen watch ID echoed in the pushes' client_id field, and
+ * "period_ms" the requested poll period. */
+struct iiod_watch_params {
+	uint8_t op;
+	uint8_t pad;
+	uint16_t id;
+	uint32_t period_ms;
+};
+
+/* Upper bound on the length of a pushed attribute value */
+#define IIOD_WATCH_MAX_LEN 0x400
+
 struct iiod_responder_ops {
 	int (*cmd)(const struct iiod_command *cmd,
 		   struct iiod_command_data *data, void *d);
 	ssize_t (*read)(void *d, const struct iiod_buf *buf, size_t nb);
 	ssize_t (*write)(void *d, const struct iiod_buf *buf, size_t nb);
 	ssize_t (*discard)(void *d, size_t bytes);
+
+	/* Optional: write the buffers with the given file descriptor
+	 * attached to the first bytes as SCM_RIGHTS ancillary data.
+	 * Only meaningful on Unix-domain socket transports. */
+	ssize_t (*write_fd)(void *d, const struct iiod_buf *buf, size_t nb,
+			    int fd);
 };
 
 /* Create / Destroy IIOD Responder. */
@@ -121,6 +315,13 @@ int iiod_command_data_read(struct iiod_command_data *data,
 int iiod_io_send_command(struct iiod_io *io,
 			 const struct iiod_command *cmd,
 			 const struct iiod_buf *buf, size_t nb);
+
+/* Same as iiod_io_send_command, but pass the given file descriptor to
+ * the remote, attached to the command bytes as ancillary data. Returns
+ * -ENOSYS if the transport cannot carry file descriptors. */
+int iiod_io_send_command_fd(struct iiod_io *io,
+			    const struct iiod_command *cmd,
+			    const struct iiod_buf *buf, size_t nb, int fd);
 int iiod_io_send_response(struct iiod_io *io, intptr_t code,
 			  const struct iiod_buf *buf, size_t nb);
 
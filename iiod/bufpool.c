@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "bufpool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Size classes are powers of two, from 4 KiB to 16 MiB. Requests above
+ * the largest class fall through to plain malloc/free. */
+#define BUFPOOL_MIN_SHIFT	12
+#define BUFPOOL_MAX_SHIFT	24
+#define BUFPOOL_NB_CLASSES	(BUFPOOL_MAX_SHIFT - BUFPOOL_MIN_SHIFT + 1)
+
+/* Total bytes kept parked in the freelists. Releases beyond this are
+ * freed outright, so an idle daemon gives the memory back. */
+#define BUFPOOL_MAX_RETAINED	(64 * 1024 * 1024)
+
+/* Prepended to every buffer; "next" links it in its class freelist while
+ * parked. The header is sized to preserve maximum alignment of the
+ * payload. */
+union bufpool_hdr {
+	struct {
+		union bufpool_hdr *next;
+		unsigned int class;
+	} h;
+	long long align_ll;
+	long double align_ld;
+};
+
+static union bufpool_hdr *bufpool_freelists[BUFPOOL_NB_CLASSES];
+static size_t bufpool_retained;
+static pthread_mutex_t bufpool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t bufpool_class_size(unsigned int class)
+{
+	return (size_t) 1 << (BUFPOOL_MIN_SHIFT + class);
+}
+
+void * bufpool_get(size_t len)
+{
+	union bufpool_hdr *hdr = NULL;
+	unsigned int class = 0;
+
+	while (class < BUFPOOL_NB_CLASSES && bufpool_class_size(class) < len)
+		class++;
+
+	if (class == BUFPOOL_NB_CLASSES) {
+		/* Oversized: not pooled */
+		hdr = malloc(sizeof(*hdr) + len);
+		if (!hdr)
+			return NULL;
+
+		hdr->h.class = class;
+		return hdr + 1;
+	}
+
+	pthread_mutex_lock(&bufpool_lock);
+	if (bufpool_freelists[class]) {
+		hdr = bufpool_freelists[class];
+		bufpool_freelists[class] = hdr->h.next;
+		bufpool_retained -= bufpool_class_size(class);
+	}
+	pthread_mutex_unlock(&bufpool_lock);
+
+	if (!hdr) {
+		hdr = malloc(sizeof(*hdr) + bufpool_class_size(class));
+		if (!hdr)
+			return NULL;
+
+		hdr->h.class = class;
+	}
+
+	return hdr + 1;
+}
+
+void bufpool_put(void *ptr)
+{
+	union bufpool_hdr *hdr;
+	size_t size;
+
+	if (!ptr)
+		return;
+
+	hdr = (union bufpool_hdr *) ptr - 1;
+	if (hdr->h.class == BUFPOOL_NB_CLASSES) {
+		free(hdr);
+		return;
+	}
+
+	size = bufpool_class_size(hdr->h.class);
+
+	pthread_mutex_lock(&bufpool_lock);
+	if (bufpool_retained + size <= BUFPOOL_MAX_RETAINED) {
+		hdr->h.next = bufpool_freelists[hdr->h.class];
+		bufpool_freelists[hdr->h.class] = hdr;
+		bufpool_retained += size;
+		hdr = NULL;
+	}
+	pthread_mutex_unlock(&bufpool_lock);
+
+	free(hdr);
+}
+
+void bufpool_cleanup(void)
+{
+	union bufpool_hdr *hdr, *next;
+	unsigned int class;
+
+	pthread_mutex_lock(&bufpool_lock);
+	for (class = 0; class < BUFPOOL_NB_CLASSES; class++) {
+		for (hdr = bufpool_freelists[class]; hdr; hdr = next) {
+			next = hdr->h.next;
+			free(hdr);
+		}
+
+		bufpool_freelists[class] = NULL;
+	}
+	bufpool_retained = 0;
+	pthread_mutex_unlock(&bufpool_lock);
+}
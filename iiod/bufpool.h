@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __BUFPOOL_H__
+#define __BUFPOOL_H__
+
+#include <stddef.h>
+
+/* Daemon-wide pool of transfer buffers, with per-size-class freelists.
+ *
+ * The staging buffers of the data path (demux/pack scratch, compression
+ * scratch, attribute payloads) used to be plain malloc'd per connection,
+ * so the daemon's resident memory scaled with the number of clients even
+ * though the payloads are transient. Buffers obtained here are rounded
+ * up to a power-of-two size class and recycled through shared freelists
+ * when released, so memory scales with peak concurrency instead, and a
+ * client connecting after another left reuses the same slabs rather than
+ * growing the heap. */
+
+/* Get a buffer of at least "len" bytes. Returns NULL on allocation
+ * failure. */
+void * bufpool_get(size_t len);
+
+/* Release a buffer obtained from bufpool_get(). NULL is a no-op. */
+void bufpool_put(void *ptr);
+
+/* Free all buffers parked in the freelists. */
+void bufpool_cleanup(void);
+
+#endif /* __BUFPOOL_H__ */
@@ -7,6 +7,7 @@
  */
 
 #include "../iio-config.h"
+#include "bufpool.h"
 #include "debug.h"
 #include "dns-sd.h"
 #include "ops.h"
@@ -28,6 +29,7 @@
 #include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #if WITH_ZSTD
 #include <zstd.h>
@@ -46,18 +48,20 @@
 
 static int start_iiod(const char *uri, const char *ffs_mountpoint,
 		      const char *uart_params, bool debug, bool interactive,
-		      bool use_aio, uint16_t port, unsigned int nb_pipes,
-		      int ep0_fd);
+		      bool use_aio, uint16_t port, const char *uds_path,
+		      const char *metrics_path,
+		      unsigned int nb_pipes, int ep0_fd);
 
 struct client_data {
 	int fd;
 	bool debug;
 	struct iio_context *ctx;
-	const void *xml_zstd;
-	size_t xml_zstd_len;
+	const struct iiod_xml_cache *xml_cache;
 };
 
 bool server_demux;
+bool server_zerocopy;
+struct iio_sockopts server_sockopts;
 
 struct thread_pool *main_thread_pool;
 
@@ -78,6 +82,7 @@ static const struct option options[] = {
 	  {"version", no_argument, 0, 'V'},
 	  {"debug", no_argument, 0, 'd'},
 	  {"demux", no_argument, 0, 'D'},
+	  {"zerocopy", no_argument, 0, 'z'},
 	  {"interactive", no_argument, 0, 'i'},
 	  {"aio", no_argument, 0, 'a'},
 	  {"ffs", required_argument, 0, 'F'},
@@ -85,6 +90,9 @@ static const struct option options[] = {
 	  {"serial", required_argument, 0, 's'},
 	  {"port", required_argument, 0, 'p'},
 	  {"uri", required_argument, 0, 'u'},
+	  {"uds", required_argument, 0, 'U'},
+	  {"metrics", required_argument, 0, 'm'},
+	  {"sockopts", required_argument, 0, 'o'},
 	  {0, 0, 0, 0},
 };
 
@@ -93,17 +101,25 @@ static const char *options_descriptions[] = {
 	"Display the version of this program.",
 	"Use alternative (incompatible) debug interface.",
 	"Demux channels directly on the server.",
+	"Send buffer data with MSG_ZEROCOPY when possible.",
 	"Run " MY_NAME " in the controlling terminal.",
 	"Use asynchronous I/O.",
 	"Use the given FunctionFS mountpoint to serve over USB",
 	"Specify the number of USB pipes (ep couples) to use",
-	"Run " MY_NAME " on the specified UART.",
+	("Run " MY_NAME " on the specified UART."
+		"\n\t\t\tAppend ',arq' for framed mode with retransmissions."),
 	"Port to listen on (default = " STRINGIFY(IIOD_PORT) ").",
 	("Use the context at the provided URI."
 		"\n\t\t\teg: 'ip:192.168.2.1', 'ip:pluto.local', or 'ip:'"
 		"\n\t\t\t    'usb:1.2.3', or 'usb:'"
 		"\n\t\t\t    'serial:/dev/ttyUSB0,115200,8n1'"
 		"\n\t\t\t    'local:' (default)"),
+	("Also listen on the given Unix-domain socket path."
+		"\n\t\t\teg: '/run/iiod.sock'"),
+	("Serve per-client metrics in Prometheus text format on the given"
+		"\n\t\t\tUnix-domain socket path."),
+	("Tune the sockets of client connections."
+		"\n\t\t\teg: 'rcvbuf=8M,busypoll=50,tos=0x2e'"),
 };
 
 static void usage(void)
@@ -122,8 +138,7 @@ static void client_thd(struct thread_pool *pool, void *d)
 	struct client_data *cdata = d;
 
 	interpreter(cdata->ctx, cdata->fd, cdata->fd, cdata->debug,
-			true, false, false, pool,
-			cdata->xml_zstd, cdata->xml_zstd_len);
+			true, false, false, pool, cdata->xml_cache);
 
 	IIO_INFO("Client exited\n");
 	close(cdata->fd);
@@ -152,7 +167,7 @@ static void sig_handler_usr1(int sig)
 }
 
 static int main_interactive(struct iio_context *ctx, bool verbose, bool use_aio,
-			    const void *xml_zstd, size_t xml_zstd_len)
+			    const struct iiod_xml_cache *xml_cache)
 {
 	int flags;
 
@@ -179,20 +194,68 @@ static int main_interactive(struct iio_context *ctx, bool verbose, bool use_aio,
 	}
 
 	interpreter(ctx, STDIN_FILENO, STDOUT_FILENO, verbose,
-			false, false, use_aio, main_thread_pool,
-			xml_zstd, xml_zstd_len);
+			false, false, use_aio, main_thread_pool, xml_cache);
 	return EXIT_SUCCESS;
 }
 
+/* Create a listening Unix-domain socket for clients running on the same
+ * host (the "uds:" backend), removing any stale socket file left over
+ * from a previous run. */
+static int create_uds_socket(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	char err_str[1024];
+	int ret, fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		IIO_ERROR("Unix-domain socket path too long: %s\n", path);
+		return -EINVAL;
+	}
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Unable to create socket: %s\n", err_str);
+		return ret;
+	}
+
+	unlink(path);
+
+	ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	if (ret < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Bind failed: %s\n", err_str);
+		goto err_close_socket;
+	}
+
+	if (listen(fd, 16) < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Unable to mark as passive socket: %s\n", err_str);
+		goto err_close_socket;
+	}
+
+	return fd;
+
+err_close_socket:
+	close(fd);
+	return ret;
+}
+
 static int main_server(struct iio_context *ctx, bool debug,
-		       const void *xml_zstd, size_t xml_zstd_len,
-		       uint16_t port)
+		       const struct iiod_xml_cache *xml_cache,
+		       uint16_t port, const char *uds_path)
 {
-	int ret, fd = -1, yes = 1,
+	int ret, fd = -1, uds_fd = -1, yes = 1,
 	    keepalive_time = 10,
 	    keepalive_intvl = 10,
 	    keepalive_probes = 6;
-	struct pollfd pfd[2];
+	struct pollfd pfd[3];
+	unsigned int nfds = 2;
 	char err_str[1024];
 	bool ipv6;
 
@@ -260,6 +323,14 @@ static int main_server(struct iio_context *ctx, bool debug,
 		goto err_close_socket;
 	}
 
+	if (uds_path) {
+		uds_fd = create_uds_socket(uds_path);
+		if (uds_fd < 0)
+			goto err_close_socket;
+
+		IIO_INFO("Listening on Unix-domain socket %s\n", uds_path);
+	}
+
 	if (HAVE_AVAHI)
 		start_avahi(main_thread_pool, port);
 
@@ -269,6 +340,12 @@ static int main_server(struct iio_context *ctx, bool debug,
 	pfd[1].fd = thread_pool_get_poll_fd(main_thread_pool);
 	pfd[1].events = POLLIN;
 	pfd[1].revents = 0;
+	if (uds_fd >= 0) {
+		pfd[2].fd = uds_fd;
+		pfd[2].events = POLLIN;
+		pfd[2].revents = 0;
+		nfds = 3;
+	}
 
 	while (true) {
 		struct client_data *cdata;
@@ -279,14 +356,21 @@ static int main_server(struct iio_context *ctx, bool debug,
 #endif
 
 		socklen_t addr_len = sizeof(caddr);
+		bool uds_client;
 		int new;
 
-		poll_nointr(pfd, 2);
+		poll_nointr(pfd, nfds);
 
 		if (pfd[1].revents & POLLIN) /* STOP event */
 			break;
 
-		new = accept4(fd, (struct sockaddr *) &caddr, &addr_len,
+		/* If both listening sockets are ready, serve the Unix-domain
+		 * one first; the TCP socket stays readable and will be picked
+		 * up on the next loop iteration. */
+		uds_client = nfds == 3 && (pfd[2].revents & POLLIN);
+
+		new = accept4(uds_client ? uds_fd : fd,
+			(struct sockaddr *) &caddr, &addr_len,
 			SOCK_NONBLOCK);
 		if (new == -1) {
 			if (errno == EAGAIN || errno == EINTR)
@@ -306,43 +390,48 @@ static int main_server(struct iio_context *ctx, bool debug,
 
 		/* Configure the socket to send keep-alive packets every 10s,
 		 * and disconnect the client if no reply was received for one
-		 * minute. */
-		ret = setsockopt(new, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
-		if (ret < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_WARNING("setsockopt SO_KEEPALIVE : %s", err_str);
-		}
-		ret = setsockopt(new, IPPROTO_TCP, TCP_KEEPCNT, &keepalive_probes,
-				sizeof(keepalive_probes));
-		if (ret < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_WARNING("setsockopt TCP_KEEPCNT : %s", err_str);
-		}
-		ret = setsockopt(new, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_time,
-				sizeof(keepalive_time));
-		if (ret < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_WARNING("setsockopt TCP_KEEPIDLE : %s", err_str);
-		}
-		ret = setsockopt(new, IPPROTO_TCP, TCP_KEEPINTVL, &keepalive_intvl,
-				sizeof(keepalive_intvl));
-		if (ret < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_WARNING("setsockopt TCP_KEEPINTVL : %s", err_str);
-		}
-		ret = setsockopt(new, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
-		if (ret < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_WARNING("setsockopt TCP_NODELAY : %s", err_str);
+		 * minute. Unix-domain sockets don't need any of this. */
+		if (!uds_client) {
+			ret = setsockopt(new, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
+			if (ret < 0) {
+				iio_strerror(errno, err_str, sizeof(err_str));
+				IIO_WARNING("setsockopt SO_KEEPALIVE : %s", err_str);
+			}
+			ret = setsockopt(new, IPPROTO_TCP, TCP_KEEPCNT, &keepalive_probes,
+					sizeof(keepalive_probes));
+			if (ret < 0) {
+				iio_strerror(errno, err_str, sizeof(err_str));
+				IIO_WARNING("setsockopt TCP_KEEPCNT : %s", err_str);
+			}
+			ret = setsockopt(new, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_time,
+					sizeof(keepalive_time));
+			if (ret < 0) {
+				iio_strerror(errno, err_str, sizeof(err_str));
+				IIO_WARNING("setsockopt TCP_KEEPIDLE : %s", err_str);
+			}
+			ret = setsockopt(new, IPPROTO_TCP, TCP_KEEPINTVL, &keepalive_intvl,
+					sizeof(keepalive_intvl));
+			if (ret < 0) {
+				iio_strerror(errno, err_str, sizeof(err_str));
+				IIO_WARNING("setsockopt TCP_KEEPINTVL : %s", err_str);
+			}
+			ret = setsockopt(new, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+			if (ret < 0) {
+				iio_strerror(errno, err_str, sizeof(err_str));
+				IIO_WARNING("setsockopt TCP_NODELAY : %s", err_str);
+			}
+
+			iio_sockopts_apply(new, &server_sockopts);
 		}
 
 		cdata->fd = new;
 		cdata->ctx = ctx;
 		cdata->debug = debug;
-		cdata->xml_zstd = xml_zstd;
-		cdata->xml_zstd_len = xml_zstd_len;
+		cdata->xml_cache = xml_cache;
 
-		if (LOG_LEVEL >= Info_L) {
+		if (uds_client) {
+			IIO_INFO("New client connected on Unix-domain socket\n");
+		} else if (LOG_LEVEL >= Info_L) {
 			struct sockaddr_in *caddr4 = (struct sockaddr_in *)&caddr;
 			char ipaddr[IP_ADDR_LEN];
 			int zone = 0;
@@ -393,41 +482,103 @@ static int main_server(struct iio_context *ctx, bool debug,
 	IIO_DEBUG("Cleaning up\n");
 	if (HAVE_AVAHI)
 		stop_avahi();
+	if (uds_fd >= 0) {
+		close(uds_fd);
+		unlink(uds_path);
+	}
 	close(fd);
 	return EXIT_SUCCESS;
 
 err_close_socket:
+	if (uds_fd >= 0) {
+		close(uds_fd);
+		unlink(uds_path);
+	}
 	close(fd);
 	return EXIT_FAILURE;
 }
 
-static void *get_xml_zstd_data(const struct iio_context *ctx, size_t *out_len)
+static void iiod_xml_cache_compress(struct iiod_xml_cache *cache)
 {
 #if WITH_ZSTD
-	const char *xml = iio_context_get_xml(ctx);
-	size_t len, xml_len = strlen(xml);
 	void *buf;
-	size_t ret;
+	size_t len, ret;
 
-	len = ZSTD_compressBound(xml_len);
+	len = ZSTD_compressBound(cache->xml_len);
 	buf = malloc(len);
 	if (!buf)
-		return NULL;
+		return;
 
-	ret = ZSTD_compress(buf, len, xml, xml_len, 3);
+	ret = ZSTD_compress(buf, len, cache->xml, cache->xml_len, 3);
 	if (ZSTD_isError(ret)) {
 		IIO_WARNING("Unable to compress XML string: %s\n",
-			    ZSTD_getErrorName(xml_len));
+			    ZSTD_getErrorName(ret));
 		free(buf);
+		return;
+	}
+
+	cache->zstd = buf;
+	cache->zstd_len = ret;
+#endif
+}
+
+int iiod_xml_cache_refresh(struct iiod_xml_cache *cache,
+			   const struct iio_context *ctx)
+{
+	const char *xml = iio_context_get_xml(ctx);
+	ssize_t len;
+
+	if (!xml)
+		return -EINVAL;
+
+	cache->xml = xml;
+	cache->xml_len = strlen(xml);
+
+	free(cache->zstd);
+	cache->zstd = NULL;
+	cache->zstd_len = 0;
+
+	/* Clients fall back to the uncompressed XML if compression failed */
+	iiod_xml_cache_compress(cache);
+
+	free(cache->bin);
+	cache->bin = NULL;
+	cache->bin_len = 0;
+
+	/* Same story for the compact binary description */
+	len = iio_context_serialize_binary(ctx, &cache->bin);
+	if (len < 0)
+		IIO_WARNING("Unable to serialize binary context description\n");
+	else
+		cache->bin_len = (size_t) len;
+
+	return 0;
+}
+
+struct iiod_xml_cache * iiod_xml_cache_new(const struct iio_context *ctx)
+{
+	struct iiod_xml_cache *cache;
+
+	cache = zalloc(sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	if (iiod_xml_cache_refresh(cache, ctx)) {
+		free(cache);
 		return NULL;
 	}
 
-	*out_len = ret;
+	return cache;
+}
+
+void iiod_xml_cache_free(struct iiod_xml_cache *cache)
+{
+	if (!cache)
+		return;
 
-	return buf;
-#else
-	return NULL;
-#endif
+	free(cache->zstd);
+	free(cache->bin);
+	free(cache);
 }
 
 static void free_device_pdata(struct iio_context *ctx)
@@ -477,11 +628,13 @@ int main(int argc, char **argv)
 	int c, option_index = 0;
 	char *ffs_mountpoint = NULL;
 	char *uart_params = NULL;
+	char *uds_path = NULL;
+	char *metrics_path = NULL;
 	char err_str[1024];
 	uint16_t port = IIOD_PORT;
 	int ret, ep0_fd = 0;
 
-	while ((c = getopt_long(argc, argv, "+hVdDiaF:n:s:p:u:",
+	while ((c = getopt_long(argc, argv, "+hVdDziaF:n:s:p:u:U:m:o:",
 					options, &option_index)) != -1) {
 		switch (c) {
 		case 'd':
@@ -490,6 +643,9 @@ int main(int argc, char **argv)
 		case 'D':
 			server_demux = true;
 			break;
+		case 'z':
+			server_zerocopy = true;
+			break;
 		case 'i':
 			interactive = true;
 			break;
@@ -542,6 +698,18 @@ int main(int argc, char **argv)
 		case 'u':
 			uri = optarg;
 			break;
+		case 'U':
+			uds_path = optarg;
+			break;
+		case 'm':
+			metrics_path = optarg;
+			break;
+		case 'o':
+			if (iio_sockopts_parse(&server_sockopts, optarg)) {
+				IIO_ERROR("--sockopts: Invalid parameter\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'h':
 			usage();
 			return EXIT_SUCCESS;
@@ -585,7 +753,8 @@ int main(int argc, char **argv)
 		restart_usr1 = false;
 
 		ret = start_iiod(uri, ffs_mountpoint, uart_params, debug,
-				 interactive, use_aio, port, nb_pipes, ep0_fd);
+				 interactive, use_aio, port, uds_path,
+				 metrics_path, nb_pipes, ep0_fd);
 	} while (!ret && restart_usr1);
 
 	thread_pool_destroy(main_thread_pool);
@@ -598,13 +767,13 @@ int main(int argc, char **argv)
 
 static int start_iiod(const char *uri, const char *ffs_mountpoint,
 		      const char *uart_params, bool debug, bool interactive,
-		      bool use_aio, uint16_t port, unsigned int nb_pipes,
-		      int ep0_fd)
+		      bool use_aio, uint16_t port, const char *uds_path,
+		      const char *metrics_path,
+		      unsigned int nb_pipes, int ep0_fd)
 {
 	struct iio_context *ctx;
 	char err_str[1024];
-	void *xml_zstd;
-	size_t xml_zstd_len = 0;
+	struct iiod_xml_cache *xml_cache;
 	int ret;
 
 	ctx = iio_create_context(NULL, uri);
@@ -620,14 +789,19 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 		goto out_destroy_context;
 	}
 
-	xml_zstd = get_xml_zstd_data(ctx, &xml_zstd_len);
+	xml_cache = iiod_xml_cache_new(ctx);
+	if (!xml_cache) {
+		IIO_ERROR("Unable to cache context XML\n");
+		ret = EXIT_FAILURE;
+		goto out_destroy_context;
+	}
 
 	if (WITH_IIOD_USBD && ffs_mountpoint) {
 		/* We pass use_aio == true directly, this is ensured to be true
 		 * by the CMake script. */
 		ret = start_usb_daemon(ctx, ffs_mountpoint,
 				debug, true, (unsigned int) nb_pipes, ep0_fd,
-				main_thread_pool, xml_zstd, xml_zstd_len);
+				main_thread_pool, xml_cache);
 		if (ret) {
 			iio_strerror(-ret, err_str, sizeof(err_str));
 			IIO_ERROR("Unable to start USB daemon: %s\n", err_str);
@@ -638,8 +812,7 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 
 	if (WITH_IIOD_SERIAL && uart_params) {
 		ret = start_serial_daemon(ctx, uart_params,
-					  debug, main_thread_pool,
-					  xml_zstd, xml_zstd_len);
+					  debug, main_thread_pool, xml_cache);
 		if (ret) {
 			iio_strerror(-ret, err_str, sizeof(err_str));
 			IIO_ERROR("Unable to start serial daemon: %s\n", err_str);
@@ -648,10 +821,20 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 		}
 	}
 
+	if (metrics_path) {
+		ret = start_metrics_daemon(metrics_path, main_thread_pool);
+		if (ret) {
+			iio_strerror(-ret, err_str, sizeof(err_str));
+			IIO_ERROR("Unable to start metrics daemon: %s\n", err_str);
+			ret = EXIT_FAILURE;
+			goto out_thread_pool_stop;
+		}
+	}
+
 	if (interactive)
-		ret = main_interactive(ctx, debug, use_aio, xml_zstd, xml_zstd_len);
+		ret = main_interactive(ctx, debug, use_aio, xml_cache);
 	else
-		ret = main_server(ctx, debug, xml_zstd, xml_zstd_len, port);
+		ret = main_server(ctx, debug, xml_cache, port, uds_path);
 
 out_thread_pool_stop:
 	/*
@@ -660,9 +843,10 @@ out_thread_pool_stop:
 	 */
 	thread_pool_stop_and_wait(main_thread_pool);
 out_free_xml_data:
-	free(xml_zstd);
+	iiod_xml_cache_free(xml_cache);
 out_destroy_context:
 	iio_context_destroy(ctx);
+	bufpool_cleanup();
 
 	return ret;
 }
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "debug.h"
+#include "metrics.h"
+#include "ops.h"
+#include "thread-pool.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define ARRAY_SIZE(x) (sizeof(x) ? sizeof(x) / sizeof((x)[0]) : 0)
+
+/* Per-client counters exported through the Prometheus endpoint, in the
+ * order they appear in the IIOD_OP_GETSTATS response. */
+static const struct {
+	const char *name;
+	const char *help;
+	size_t offset;
+} metrics_descs[] = {
+	{ "iiod_client_bytes_in_total",
+	  "Bytes received from the client.",
+	  offsetof(struct iiod_client_stats, bytes_in) },
+	{ "iiod_client_bytes_out_total",
+	  "Bytes sent to the client.",
+	  offsetof(struct iiod_client_stats, bytes_out) },
+	{ "iiod_client_blocks_rx_total",
+	  "Capture blocks transferred to the client.",
+	  offsetof(struct iiod_client_stats, blocks_rx) },
+	{ "iiod_client_blocks_tx_total",
+	  "Output blocks transferred from the client.",
+	  offsetof(struct iiod_client_stats, blocks_tx) },
+	{ "iiod_client_commands_total",
+	  "Commands processed for the client.",
+	  offsetof(struct iiod_client_stats, commands) },
+	{ "iiod_client_queue_stalls_total",
+	  "Block dequeues that had to wait for the hardware.",
+	  offsetof(struct iiod_client_stats, queue_stalls) },
+};
+
+static SLIST_HEAD(MetricsClientList, parser_pdata) clients_list =
+	SLIST_HEAD_INITIALIZER(clients_list);
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int next_client_id = 1;
+
+/* Counters of disconnected clients, folded in at unregistration so that
+ * the server-wide totals keep growing monotonically. */
+static struct iiod_client_stats closed_stats;
+static uint64_t nb_clients_total;
+
+static const atomic_uint_fast64_t *
+metrics_counter(const struct iiod_client_stats *stats, size_t offset)
+{
+	return (const atomic_uint_fast64_t *)((uintptr_t) stats + offset);
+}
+
+void iiod_metrics_register_client(struct parser_pdata *pdata)
+{
+	pthread_mutex_lock(&clients_lock);
+
+	pdata->client_id = next_client_id++;
+	SLIST_INSERT_HEAD(&clients_list, pdata, metrics_entry);
+	nb_clients_total++;
+
+	pthread_mutex_unlock(&clients_lock);
+}
+
+void iiod_metrics_unregister_client(struct parser_pdata *pdata)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&clients_lock);
+
+	SLIST_REMOVE(&clients_list, pdata, parser_pdata, metrics_entry);
+
+	for (i = 0; i < ARRAY_SIZE(metrics_descs); i++) {
+		iiod_stats_add((atomic_uint_fast64_t *)
+			       metrics_counter(&closed_stats,
+					       metrics_descs[i].offset),
+			       iiod_stats_read(
+				       metrics_counter(&pdata->stats,
+						       metrics_descs[i].offset)));
+	}
+
+	pthread_mutex_unlock(&clients_lock);
+}
+
+static void metrics_render(FILE *f)
+{
+	const struct parser_pdata *pdata;
+	unsigned int i, nb_clients = 0;
+	uint64_t total;
+
+	pthread_mutex_lock(&clients_lock);
+
+	for (i = 0; i < ARRAY_SIZE(metrics_descs); i++) {
+		fprintf(f, "# HELP %s %s\n", metrics_descs[i].name,
+			metrics_descs[i].help);
+		fprintf(f, "# TYPE %s counter\n", metrics_descs[i].name);
+
+		total = iiod_stats_read(metrics_counter(&closed_stats,
+							metrics_descs[i].offset));
+
+		for (pdata = SLIST_FIRST(&clients_list);
+		     pdata; pdata = SLIST_NEXT(pdata, metrics_entry)) {
+			uint64_t val = iiod_stats_read(
+					metrics_counter(&pdata->stats,
+							metrics_descs[i].offset));
+
+			fprintf(f, "%s{client=\"%u\"} %llu\n",
+				metrics_descs[i].name, pdata->client_id,
+				(unsigned long long) val);
+			total += val;
+		}
+
+		/* Server-wide total, disconnected clients included */
+		fprintf(f, "%s{client=\"all\"} %llu\n",
+			metrics_descs[i].name, (unsigned long long) total);
+	}
+
+	for (pdata = SLIST_FIRST(&clients_list);
+	     pdata; pdata = SLIST_NEXT(pdata, metrics_entry)) {
+		nb_clients++;
+	}
+
+	fprintf(f, "# HELP iiod_clients_connected Number of connected clients.\n");
+	fprintf(f, "# TYPE iiod_clients_connected gauge\n");
+	fprintf(f, "iiod_clients_connected %u\n", nb_clients);
+
+	fprintf(f, "# HELP iiod_clients_total Clients served since startup.\n");
+	fprintf(f, "# TYPE iiod_clients_total counter\n");
+	fprintf(f, "iiod_clients_total %llu\n",
+		(unsigned long long) nb_clients_total);
+
+	pthread_mutex_unlock(&clients_lock);
+}
+
+struct metrics_daemon_data {
+	const char *path;
+	int fd;
+};
+
+static void metrics_thd(struct thread_pool *pool, void *d)
+{
+	struct metrics_daemon_data *mdata = d;
+	struct pollfd pfd[2];
+	FILE *f;
+	int fd;
+
+	pfd[0].fd = mdata->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = thread_pool_get_poll_fd(pool);
+	pfd[1].events = POLLIN;
+
+	while (true) {
+		pfd[0].revents = 0;
+		pfd[1].revents = 0;
+
+		poll_nointr(pfd, 2);
+
+		if (pfd[1].revents & POLLIN)
+			break;
+
+		fd = accept4(mdata->fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		/* One scrape per connection: emit the counters in
+		 * Prometheus text format, then hang up. */
+		f = fdopen(fd, "w");
+		if (!f) {
+			close(fd);
+			continue;
+		}
+
+		metrics_render(f);
+		fclose(f);
+	}
+
+	close(mdata->fd);
+	unlink(mdata->path);
+	free(mdata);
+}
+
+int start_metrics_daemon(const char *path, struct thread_pool *pool)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct metrics_daemon_data *mdata;
+	char err_str[1024];
+	int ret, fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		IIO_ERROR("Metrics socket path too long: %s\n", path);
+		return -EINVAL;
+	}
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Unable to create metrics socket: %s\n", err_str);
+		return ret;
+	}
+
+	unlink(path);
+
+	ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	if (ret < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Metrics socket bind failed: %s\n", err_str);
+		goto err_close_socket;
+	}
+
+	if (listen(fd, 4) < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Unable to listen on metrics socket: %s\n", err_str);
+		goto err_close_socket;
+	}
+
+	mdata = zalloc(sizeof(*mdata));
+	if (!mdata) {
+		ret = -ENOMEM;
+		goto err_close_socket;
+	}
+
+	mdata->path = path;
+	mdata->fd = fd;
+
+	ret = thread_pool_add_thread(pool, metrics_thd, mdata, "metrics_thd");
+	if (ret) {
+		free(mdata);
+		goto err_close_socket;
+	}
+
+	IIO_INFO("Serving metrics on Unix-domain socket %s\n", path);
+
+	return 0;
+
+err_close_socket:
+	close(fd);
+	return ret;
+}
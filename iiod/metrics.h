@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __IIOD_METRICS_H__
+#define __IIOD_METRICS_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct parser_pdata;
+struct thread_pool;
+
+/* Per-connection throughput counters, incremented with relaxed atomics on
+ * the data path so that they are cheap enough to always stay on. Read by
+ * the IIOD_OP_GETSTATS command handler and the Prometheus endpoint. */
+struct iiod_client_stats {
+	atomic_uint_fast64_t bytes_in, bytes_out;
+	atomic_uint_fast64_t blocks_rx, blocks_tx;
+	atomic_uint_fast64_t commands;
+	atomic_uint_fast64_t queue_stalls;
+};
+
+static inline void iiod_stats_add(atomic_uint_fast64_t *counter, uint64_t val)
+{
+	atomic_fetch_add_explicit(counter, val, memory_order_relaxed);
+}
+
+static inline void iiod_stats_inc(atomic_uint_fast64_t *counter)
+{
+	iiod_stats_add(counter, 1);
+}
+
+static inline uint64_t iiod_stats_read(const atomic_uint_fast64_t *counter)
+{
+	return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/* Make the connection's counters visible to the metrics endpoint. The
+ * counters of unregistered (i.e. disconnected) clients are folded into
+ * server-wide totals. */
+void iiod_metrics_register_client(struct parser_pdata *pdata);
+void iiod_metrics_unregister_client(struct parser_pdata *pdata);
+
+int start_metrics_daemon(const char *path, struct thread_pool *pool);
+
+#endif /* __IIOD_METRICS_H__ */
@@ -6,27 +6,66 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#include "bufpool.h"
 #include "debug.h"
 #include "ops.h"
 #include "parser.h"
 #include "thread-pool.h"
+#if WITH_IIOD_URING
+#include "uring.h"
+#endif
+
+#include "../iiod-responder.h"
+#include "../iio-trace.h"
 
 #include <errno.h>
 #include <limits.h>
+#include <netinet/in.h>
 #include <pthread.h>
 #include <poll.h>
 #include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/eventfd.h>
 #include <time.h>
 #include <fcntl.h>
 #include <signal.h>
 
+#define ARRAY_SIZE(x) (sizeof(x) ? sizeof(x) / sizeof((x)[0]) : 0)
+
+/* Zero-copy sends of buffer data, same guard as in network.c */
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) \
+	&& defined(SO_EE_ORIGIN_ZEROCOPY)
+#define WITH_IIOD_ZEROCOPY 1
+#else
+#define WITH_IIOD_ZEROCOPY 0
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0
+#endif
+#endif
+
+#define ZEROCOPY_THRESHOLD (64 * 1024)
+
+#if WITH_IIOD_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+
 int yyparse(yyscan_t scanner);
 
 struct DevEntry;
 
 /* Corresponds to a thread reading from a device */
+/* Per-subscriber decimation modes (see OPEN ... DECIM) */
+enum decim_mode {
+	DECIM_NONE,
+	DECIM_DROP,	/* keep the first sample of each bin */
+	DECIM_AVG,	/* boxcar average of each bin */
+	DECIM_PEAK,	/* min/max sample pair of each bin */
+};
+
 struct ThdEntry {
 	SLIST_ENTRY(ThdEntry) parser_list_entry;
 	SLIST_ENTRY(ThdEntry) dev_list_entry;
@@ -41,6 +80,18 @@ struct ThdEntry {
 
 	struct iio_channels_mask *mask;
 	bool active, is_writer, new_client, wait_for_open;
+
+	/* Subscriber opened with DROP: skip blocks instead of stalling
+	 * the device stream when this client's socket backs up. */
+	bool drop;
+	unsigned int nb_dropped;
+
+	/* Subscriber opened with DECIM: reduce the sample rate by
+	 * "decim_factor" before sending, so that monitoring clients can
+	 * subscribe at a fraction of the device rate while full-rate
+	 * consumers of the same device are unaffected. */
+	enum decim_mode decim_mode;
+	unsigned int decim_factor;
 };
 
 static void thd_entry_event_signal(struct ThdEntry *thd)
@@ -87,6 +138,15 @@ static int thd_entry_event_wait(struct ThdEntry *thd, pthread_mutex_t *mutex,
 	return 0;
 }
 
+/* A block travelling through the capture pipeline, plus what the
+ * capture thread needs to put it back into the kernel queue. */
+struct block_xfer {
+	struct iio_block *block;
+	size_t bytes_used;
+	unsigned int idx;
+	int ret;
+};
+
 /* Corresponds to an opened device */
 struct DevEntry {
 	unsigned int ref_count;
@@ -103,6 +163,18 @@ struct DevEntry {
 
 	unsigned int nb_blocks, curr_block;
 
+	/* Read-ahead pipeline (see dev_capture_thd()): a dedicated thread
+	 * owns the kernel queue, re-enqueueing served blocks and pulling
+	 * completed ones ahead of time, so that the device keeps capturing
+	 * (or draining) while the R/W thread is busy on the sockets. The
+	 * pipeline depth follows the client-set buffers count. */
+	struct block_xfer *xfers;
+	struct block_xfer err_xfer;
+	struct block_xfer **kfifo;
+	struct spsc_queue filled, to_dev;
+	pthread_t capture_thd;
+	bool pipeline_started;
+
 	/* Linked list of ThdEntry structures corresponding
 	 * to all the threads who opened the device */
 	SLIST_HEAD(ThdHead, ThdEntry) thdlist_head;
@@ -111,11 +183,12 @@ struct DevEntry {
 	pthread_cond_t rw_ready_cond;
 
 	struct iio_channels_mask *mask;
-};
 
-struct sample_cb_info {
-	struct parser_pdata *pdata;
-	unsigned int nb_bytes, cpt;
+	/* Scratch buffer for demuxing samples before they are sent (or
+	 * muxing them after they are received), grown on demand. Only
+	 * ever used from the device's R/W thread. */
+	void *demux_scratch;
+	size_t demux_scratch_len;
 };
 
 /* Protects iio_device_{set,get}_data() from concurrent access from multiple
@@ -153,34 +226,58 @@ static inline const char *dev_label_or_name_or_id(const struct iio_device *dev)
 }
 
 #if WITH_AIO
+#define MAX_AIO_REQ_SIZE (1024 * 1024)
+
+/* Number of aio requests kept queued per endpoint: with a single request
+ * in flight the endpoint idles between a request completing and the next
+ * submission. */
+#define AIO_QUEUE_DEPTH 4
+
 static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 	bool do_read)
 {
-	ssize_t ret;
+	ssize_t ret, total;
 	struct pollfd pfd[2];
-	unsigned int num_pfds;
-	struct iocb iocb;
-	struct iocb *ios[1];
-	struct io_event e[1];
-
-	ios[0] = &iocb;
-
-	if (do_read)
-		io_prep_pread(&iocb, pdata->fd_in, buf, len, 0);
-	else
-		io_prep_pwrite(&iocb, pdata->fd_out, buf, len, 0);
+	unsigned int i, nb, pending, num_pfds;
+	struct iocb iocb[AIO_QUEUE_DEPTH];
+	struct iocb *ios[AIO_QUEUE_DEPTH];
+	struct io_event e[AIO_QUEUE_DEPTH];
+	ssize_t res[AIO_QUEUE_DEPTH];
+	size_t chunk, offset = 0;
+	long j;
+
+	/* Split the transfer into multiple requests submitted as one batch,
+	 * so that the endpoint always has a queued buffer to service while
+	 * a completed one is being collected. */
+	for (nb = 0; nb < AIO_QUEUE_DEPTH && offset < len; nb++) {
+		chunk = len - offset;
+		if (chunk > MAX_AIO_REQ_SIZE)
+			chunk = MAX_AIO_REQ_SIZE;
+
+		if (do_read) {
+			io_prep_pread(&iocb[nb], pdata->fd_in,
+				      (char *) buf + offset, chunk, 0);
+		} else {
+			io_prep_pwrite(&iocb[nb], pdata->fd_out,
+				       (char *) buf + offset, chunk, 0);
+		}
 
-	io_set_eventfd(&iocb, pdata->aio_eventfd[do_read]);
+		io_set_eventfd(&iocb[nb], pdata->aio_eventfd[do_read]);
+		ios[nb] = &iocb[nb];
+		offset += chunk;
+	}
 
 	pthread_mutex_lock(&pdata->aio_mutex[do_read]);
 
-	ret = io_submit(pdata->aio_ctx[do_read], 1, ios);
-	if (ret != 1) {
+	ret = io_submit(pdata->aio_ctx[do_read], nb, ios);
+	if (ret != (ssize_t) nb) {
 		pthread_mutex_unlock(&pdata->aio_mutex[do_read]);
 		IIO_ERROR("Failed to submit IO operation: %zd\n", ret);
 		return -EIO;
 	}
 
+	pending = nb;
+
 	pfd[0].fd = pdata->aio_eventfd[do_read];
 	pfd[0].events = POLLIN;
 	pfd[0].revents = 0;
@@ -202,26 +299,41 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 				break;
 			}
 
-			ret = io_getevents(pdata->aio_ctx[do_read], 0, 1, e, NULL);
-			if (ret != 1) {
+			ret = io_getevents(pdata->aio_ctx[do_read], 0,
+					   pending, e, NULL);
+			if (ret <= 0) {
 				IIO_ERROR("Failed to read IO events: %zd\n", ret);
 				ret = -EIO;
 				break;
-			} else {
-				ret = (long)e[0].res;
 			}
+
+			for (j = 0; j < ret; j++) {
+				i = (unsigned int) (e[j].obj - iocb);
+				res[i] = (long) e[j].res;
+			}
+
+			pending -= (unsigned int) ret;
+			if (!pending) {
+				ret = 0;
+				break;
+			}
+
+			pfd[0].revents = 0;
 		} else if ((num_pfds > 1 && pfd[1].revents & POLLIN)) {
 			/* Got a STOP event to abort this whole session */
-			ret = io_cancel(pdata->aio_ctx[do_read], &iocb, e);
-			if (ret != -EINPROGRESS && ret != -EINVAL) {
-				IIO_ERROR("Failed to cancel IO transfer: %zd\n", ret);
-				ret = -EIO;
-				break;
+			for (i = 0; i < nb; i++) {
+				ret = io_cancel(pdata->aio_ctx[do_read],
+						&iocb[i], e);
+				if (ret != -EINPROGRESS && ret != -EINVAL) {
+					IIO_ERROR("Failed to cancel IO transfer: %zd\n",
+						  ret);
+					break;
+				}
 			}
-			/* It should not be long now until we get the cancellation event */
+			/* It should not be long now until we get the cancellation events */
 			num_pfds = 1;
 		}
-	} while (!(pfd[0].revents & POLLIN));
+	} while (true);
 
 	pthread_mutex_unlock(&pdata->aio_mutex[do_read]);
 
@@ -229,27 +341,122 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 	if (num_pfds == 1)
 		return 0;
 
-	return ret;
-}
+	if (ret < 0)
+		return ret;
 
-#define MAX_AIO_REQ_SIZE (1024 * 1024)
+	/* Walk the requests in submission order; the first error ends the
+	 * transfer. A short request that is not the last of the batch means
+	 * the data queued into the following requests would leave a hole in
+	 * the byte stream, so give up on the whole transfer. */
+	for (i = 0, total = 0; i < nb; i++) {
+		if (res[i] < 0)
+			return res[i];
+
+		total += res[i];
+
+		if ((size_t) res[i] < iocb[i].u.c.nbytes && i < nb - 1)
+			return -EIO;
+	}
+
+	return total;
+}
 
 static ssize_t readfd_aio(struct parser_pdata *pdata, void *dest, size_t len)
 {
-	if (len > MAX_AIO_REQ_SIZE)
-		len = MAX_AIO_REQ_SIZE;
+	if (len > AIO_QUEUE_DEPTH * MAX_AIO_REQ_SIZE)
+		len = AIO_QUEUE_DEPTH * MAX_AIO_REQ_SIZE;
 	return async_io(pdata, dest, len, true);
 }
 
 static ssize_t writefd_aio(struct parser_pdata *pdata, const void *dest,
 		size_t len)
 {
-	if (len > MAX_AIO_REQ_SIZE)
-		len = MAX_AIO_REQ_SIZE;
+	if (len > AIO_QUEUE_DEPTH * MAX_AIO_REQ_SIZE)
+		len = AIO_QUEUE_DEPTH * MAX_AIO_REQ_SIZE;
 	return async_io(pdata, (void *)dest, len, false);
 }
 #endif /* WITH_AIO */
 
+#if WITH_IIOD_URING
+static ssize_t readfd_uring(struct parser_pdata *pdata, void *dest, size_t len)
+{
+	return iiod_uring_rw(pdata->uring[1], pdata->fd_in, dest, len, true,
+			     thread_pool_get_poll_fd(pdata->pool));
+}
+
+static ssize_t writefd_uring(struct parser_pdata *pdata, const void *src,
+		size_t len)
+{
+	return iiod_uring_rw(pdata->uring[0], pdata->fd_out, (void *) src, len,
+			     false, thread_pool_get_poll_fd(pdata->pool));
+}
+#endif /* WITH_IIOD_URING */
+
+/* Like recv(), but collect file descriptors attached to the byte stream
+ * as SCM_RIGHTS ancillary data; they are stashed in the parser_pdata for
+ * the IIOD_OP_CREATE_BLOCK_MEMFD handler to pick up. */
+static ssize_t recv_uds(struct parser_pdata *pdata, void *dest, size_t len)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * 4)];
+		struct cmsghdr align;
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	unsigned int i, nb;
+	ssize_t ret;
+	int *fds;
+
+	iov.iov_base = dest;
+	iov.iov_len = len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ret = recvmsg(pdata->fd_in, &msg, MSG_NOSIGNAL | MSG_CMSG_CLOEXEC);
+	if (ret == -1)
+		return ret;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET
+		    || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		fds = (int *) CMSG_DATA(cmsg);
+		nb = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+		for (i = 0; i < nb; i++) {
+			if (pdata->nb_recv_fds < ARRAY_SIZE(pdata->recv_fds))
+				pdata->recv_fds[pdata->nb_recv_fds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+
+	return ret;
+}
+
+int take_received_fd(struct parser_pdata *pdata)
+{
+	unsigned int i;
+	int fd;
+
+	if (!pdata->nb_recv_fds)
+		return -1;
+
+	fd = pdata->recv_fds[0];
+
+	for (i = 1; i < pdata->nb_recv_fds; i++)
+		pdata->recv_fds[i - 1] = pdata->recv_fds[i];
+	pdata->nb_recv_fds--;
+
+	return fd;
+}
+
 static ssize_t readfd_io(struct parser_pdata *pdata, void *dest, size_t len)
 {
 	ssize_t ret;
@@ -274,7 +481,9 @@ static ssize_t readfd_io(struct parser_pdata *pdata, void *dest, size_t len)
 			continue;
 
 		do {
-			if (pdata->fd_in_is_socket)
+			if (pdata->is_uds)
+				ret = recv_uds(pdata, dest, len);
+			else if (pdata->fd_in_is_socket)
 				ret = recv(pdata->fd_in, dest, len, MSG_NOSIGNAL);
 			else
 				ret = read(pdata->fd_in, dest, len);
@@ -302,150 +511,907 @@ static ssize_t writefd_io(struct parser_pdata *pdata, const void *src, size_t le
 	pfd[1].events = POLLIN;
 	pfd[1].revents = 0;
 
-	do {
+	do {
+		poll_nointr(pfd, 2);
+
+		/* Got STOP event, or client closed the socket: treat it as EOF */
+		if (pfd[1].revents & POLLIN || pfd[0].revents & POLLHUP)
+			return 0;
+		if (pfd[0].revents & POLLERR)
+			return -EIO;
+		if (!(pfd[0].revents & POLLOUT))
+			continue;
+
+		do {
+			if (pdata->fd_out_is_socket)
+				ret = send(pdata->fd_out, src, len, MSG_NOSIGNAL);
+			else
+				ret = write(pdata->fd_out, src, len);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret != -1 || errno != EAGAIN)
+			break;
+	} while (true);
+
+	if (ret == -1)
+		return -errno;
+
+	return ret;
+}
+
+static void print_value(struct parser_pdata *pdata, long value);
+
+/* Registry binding stripe connections to the binary connection that
+ * negotiated them. Primaries register a token; stripe connections look
+ * the token up, hand their socket over, and park until the primary
+ * goes away. */
+static SLIST_HEAD(StripePrimaryList, stripe_primary) stripe_primaries =
+	SLIST_HEAD_INITIALIZER(stripe_primaries);
+static pthread_mutex_t stripe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stripe_cond = PTHREAD_COND_INITIALIZER;
+
+struct stripe_primary {
+	SLIST_ENTRY(stripe_primary) entry;
+	struct parser_pdata *pdata;
+	uint64_t token;
+	bool released;
+	unsigned int parked;
+};
+
+int stripe_enable(struct parser_pdata *pdata, uint64_t token, unsigned int nb)
+{
+	struct stripe_primary *primary;
+
+	if (!nb || nb > ARRAY_SIZE(pdata->stripe_fds))
+		return -EINVAL;
+	if (!pdata->fd_in_is_socket || pdata->nb_stripes_expected)
+		return -EINVAL;
+
+	primary = zalloc(sizeof(*primary));
+	if (!primary)
+		return -ENOMEM;
+
+	primary->pdata = pdata;
+	primary->token = token;
+
+	pdata->stripe_token = token;
+	pdata->nb_stripes_expected = nb;
+
+	pthread_mutex_lock(&stripe_lock);
+	SLIST_INSERT_HEAD(&stripe_primaries, primary, entry);
+	pthread_mutex_unlock(&stripe_lock);
+
+	return 0;
+}
+
+int stripe_attach(struct parser_pdata *pdata, uint64_t token, unsigned int idx)
+{
+	struct stripe_primary *primary;
+	int ret = -ENOENT;
+
+	if (!pdata->fd_in_is_socket || pdata->fd_in != pdata->fd_out)
+		return -EINVAL;
+
+	pthread_mutex_lock(&stripe_lock);
+
+	SLIST_FOREACH(primary, &stripe_primaries, entry) {
+		if (primary->token != token || primary->released)
+			continue;
+
+		if (idx >= primary->pdata->nb_stripes_expected) {
+			ret = -EINVAL;
+			break;
+		}
+
+		primary->pdata->stripe_fds[idx] = pdata->fd_in;
+		if (primary->pdata->nb_stripes < idx + 1)
+			primary->pdata->nb_stripes = idx + 1;
+		ret = 0;
+		break;
+	}
+
+	pthread_mutex_unlock(&stripe_lock);
+
+	if (ret)
+		return ret;
+
+	/* Acknowledge before parking, the client waits for it */
+	print_value(pdata, 0);
+
+	/* This connection now only carries payload chunks, driven by the
+	 * primary's threads; park here until the primary goes away, then
+	 * let the interpreter tear the connection down normally. */
+	pthread_mutex_lock(&stripe_lock);
+
+	primary->parked++;
+
+	while (!primary->released)
+		pthread_cond_wait(&stripe_cond, &stripe_lock);
+
+	primary->parked--;
+	if (!primary->parked) {
+		SLIST_REMOVE(&stripe_primaries, primary, stripe_primary, entry);
+		free(primary);
+	}
+
+	pthread_mutex_unlock(&stripe_lock);
+
+	pdata->stop = true;
+
+	return 0;
+}
+
+void stripe_release(struct parser_pdata *pdata)
+{
+	struct stripe_primary *primary;
+
+	if (!pdata->nb_stripes_expected)
+		return;
+
+	pthread_mutex_lock(&stripe_lock);
+
+	SLIST_FOREACH(primary, &stripe_primaries, entry) {
+		if (primary->pdata != pdata)
+			continue;
+
+		primary->released = true;
+
+		/* No stripe parked yet: nobody will free it but us */
+		if (!primary->parked) {
+			SLIST_REMOVE(&stripe_primaries, primary,
+				     stripe_primary, entry);
+			free(primary);
+		}
+
+		break;
+	}
+
+	pthread_cond_broadcast(&stripe_cond);
+	pthread_mutex_unlock(&stripe_lock);
+
+	pdata->nb_stripes = 0;
+	pdata->nb_stripes_expected = 0;
+}
+
+static ssize_t stripe_rw_all(int fd, void *ptr, size_t len, bool is_read)
+{
+	uintptr_t p = (uintptr_t) ptr;
+	ssize_t ret;
+
+	while (len) {
+		do {
+			if (is_read)
+				ret = recv(fd, (void *) p, len, MSG_NOSIGNAL);
+			else
+				ret = send(fd, (const void *) p, len,
+					   MSG_NOSIGNAL);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == 0)
+			return -EPIPE;
+		if (ret < 0)
+			return -errno;
+
+		p += ret;
+		len -= ret;
+	}
+
+	return (ssize_t) (p - (uintptr_t) ptr);
+}
+
+/* Move one block payload over the stripe connections: one contiguous
+ * chunk of ceil(len / nb) bytes per stripe, in offset order, each
+ * prefixed with the transfer's tag. The sockets are serviced
+ * sequentially; the chunks still travel in parallel on the wire since
+ * the kernel fills / drains all the socket buffers concurrently. */
+static ssize_t stripe_rw_block(struct parser_pdata *pdata, uint64_t tag,
+			       void *ptr, size_t len, bool is_read)
+{
+	size_t i, chunk, count, offset = 0;
+	uint64_t chunk_tag;
+	ssize_t ret;
+
+	if (pdata->nb_stripes < pdata->nb_stripes_expected)
+		return -EPIPE;
+
+	chunk = (len + pdata->nb_stripes - 1) / pdata->nb_stripes;
+
+	for (i = 0; i < pdata->nb_stripes; i++) {
+		if (is_read) {
+			ret = stripe_rw_all(pdata->stripe_fds[i], &chunk_tag,
+					    sizeof(chunk_tag), true);
+			if (ret < 0)
+				return ret;
+			if (chunk_tag != tag)
+				return -EPROTO;
+		} else {
+			chunk_tag = tag;
+			ret = stripe_rw_all(pdata->stripe_fds[i], &chunk_tag,
+					    sizeof(chunk_tag), false);
+			if (ret < 0)
+				return ret;
+		}
+
+		if (offset < len)
+			count = chunk < len - offset ? chunk : len - offset;
+		else
+			count = 0;
+
+		if (count) {
+			ret = stripe_rw_all(pdata->stripe_fds[i],
+					    (char *) ptr + offset, count,
+					    is_read);
+			if (ret < 0)
+				return ret;
+		}
+
+		offset += count;
+	}
+
+	return (ssize_t) len;
+}
+
+ssize_t stripe_read_block(struct parser_pdata *pdata, uint64_t tag,
+			  void *dst, size_t len)
+{
+	return stripe_rw_block(pdata, tag, dst, len, true);
+}
+
+ssize_t stripe_write_block(struct parser_pdata *pdata, uint64_t tag,
+			   const void *src, size_t len)
+{
+	return stripe_rw_block(pdata, tag, (void *) src, len, false);
+}
+
+/* UDP data plane (see IIOD_OP_UDP_ENABLE): bind a datagram socket next
+ * to the control socket and return its port number, to be sent as the
+ * enable command's response. */
+int udp_enable(struct parser_pdata *pdata, uint64_t token)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	int fd, err;
+
+	if (!pdata->fd_in_is_socket || pdata->udp_fd >= 0)
+		return -EINVAL;
+
+	if (getsockname(pdata->fd_in, (struct sockaddr *) &addr, &addrlen) < 0)
+		return -errno;
+
+	if (addr.ss_family != AF_INET && addr.ss_family != AF_INET6)
+		return -EAFNOSUPPORT;
+
+	fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -errno;
+
+	iio_sockopts_apply(fd, &server_sockopts);
+
+	if (addr.ss_family == AF_INET6)
+		((struct sockaddr_in6 *) &addr)->sin6_port = 0;
+	else
+		((struct sockaddr_in *) &addr)->sin_port = 0;
+
+	if (bind(fd, (struct sockaddr *) &addr, addrlen) < 0)
+		goto err_close;
+
+	addrlen = sizeof(addr);
+	if (getsockname(fd, (struct sockaddr *) &addr, &addrlen) < 0)
+		goto err_close;
+
+	pdata->udp_fd = fd;
+	pdata->udp_token = token;
+
+	if (addr.ss_family == AF_INET6)
+		return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+
+	return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+
+err_close:
+	err = -errno;
+	close(fd);
+	return err;
+}
+
+/* Wait for the client's hello datagram, pin its address and echo the
+ * token back. Called after the port number response has been sent. On
+ * failure the socket stays unconnected: payload sends then fail
+ * silently and the client accounts the stream as lost, which beats
+ * desynchronizing the command stream. */
+void udp_wait_hello(struct parser_pdata *pdata)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	struct pollfd pfd;
+	uint64_t token;
+	ssize_t ret;
+	int err;
+
+	pfd.fd = pdata->udp_fd;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		do {
+			err = poll(&pfd, 1, 5000);
+		} while (err == -1 && errno == EINTR);
+		if (err <= 0)
+			return;
+
+		addrlen = sizeof(addr);
+		ret = recvfrom(pdata->udp_fd, &token, sizeof(token), 0,
+			       (struct sockaddr *) &addr, &addrlen);
+		if (ret < 0)
+			return;
+
+		if (ret == sizeof(token) && token == pdata->udp_token)
+			break;
+	}
+
+	if (connect(pdata->udp_fd, (struct sockaddr *) &addr, addrlen) < 0)
+		return;
+
+	send(pdata->udp_fd, &token, sizeof(token), 0);
+}
+
+/* Send one capture payload as sequenced datagrams. Losses are the whole
+ * point of this data plane: send errors never block or fail the
+ * stream, the client accounts whatever did not arrive. */
+void udp_send_block(struct parser_pdata *pdata, uint64_t tag,
+		    const void *src, size_t len)
+{
+	struct iiod_udp_hdr hdr;
+	struct iovec iov[2];
+	struct msghdr msg = { 0 };
+	size_t offset = 0, chunk;
+
+	hdr.tag = tag;
+	hdr.total = (uint32_t) len;
+
+	msg.msg_iov = iov;
+
+	while (offset < len) {
+		chunk = len - offset;
+		if (chunk > IIOD_UDP_CHUNK_SIZE)
+			chunk = IIOD_UDP_CHUNK_SIZE;
+
+		hdr.offset = (uint32_t) offset;
+
+		iov[0].iov_base = &hdr;
+		iov[0].iov_len = sizeof(hdr);
+		iov[1].iov_base = (char *) src + offset;
+		iov[1].iov_len = chunk;
+		msg.msg_iovlen = 2;
+
+		sendmsg(pdata->udp_fd, &msg, MSG_NOSIGNAL);
+
+		offset += chunk;
+	}
+}
+
+static ssize_t writev_io(struct parser_pdata *pdata,
+			 const struct iovec *iov, size_t nb)
+{
+	struct msghdr msg;
+	ssize_t ret;
+	struct pollfd pfd[2];
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *) iov;
+	msg.msg_iovlen = nb;
+
+	pfd[0].fd = pdata->fd_out;
+	pfd[0].events = POLLOUT;
+	pfd[0].revents = 0;
+	pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	do {
+		poll_nointr(pfd, 2);
+
+		/* Got STOP event, or client closed the socket: treat it as EOF */
+		if (pfd[1].revents & POLLIN || pfd[0].revents & POLLHUP)
+			return 0;
+		if (pfd[0].revents & POLLERR)
+			return -EIO;
+		if (!(pfd[0].revents & POLLOUT))
+			continue;
+
+		do {
+			if (pdata->fd_out_is_socket)
+				ret = sendmsg(pdata->fd_out, &msg, MSG_NOSIGNAL);
+			else
+				ret = writev(pdata->fd_out, iov, (int) nb);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret != -1 || errno != EAGAIN)
+			break;
+	} while (true);
+
+	if (ret == -1)
+		return -errno;
+
+	return ret;
+}
+
+ssize_t writev_all(struct parser_pdata *pdata,
+		   const struct iiod_buf *bufs, size_t nb)
+{
+	struct iovec iov[32], *curr = iov;
+	ssize_t ret, count = 0;
+	size_t i;
+
+	/* The AIO path has no vectored variant; send the buffers one by
+	 * one there, as before. */
+	if (nb > ARRAY_SIZE(iov) || pdata->writefd != writefd_io) {
+		for (i = 0; i < nb; i++) {
+			ret = write_all(pdata, bufs[i].ptr, bufs[i].size);
+			if (ret <= 0)
+				return ret;
+
+			count += ret;
+		}
+
+		return count;
+	}
+
+	for (i = 0; i < nb; i++) {
+		iov[i].iov_base = bufs[i].ptr;
+		iov[i].iov_len = bufs[i].size;
+	}
+
+	while (nb) {
+		ret = writev_io(pdata, curr, nb);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EPIPE;
+
+		count += ret;
+
+		while (nb && (size_t) ret >= curr->iov_len) {
+			ret -= curr->iov_len;
+			curr++;
+			nb--;
+		}
+
+		if (nb) {
+			curr->iov_base = (char *) curr->iov_base + ret;
+			curr->iov_len -= ret;
+		}
+	}
+
+	iiod_stats_add(&pdata->stats.bytes_out, count);
+
+	return count;
+}
+
+ssize_t write_all(struct parser_pdata *pdata, const void *src, size_t len)
+{
+	uintptr_t ptr = (uintptr_t) src;
+
+	while (len) {
+		ssize_t ret = pdata->writefd(pdata, (void *) ptr, len);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EPIPE;
+		ptr += ret;
+		len -= ret;
+	}
+
+	iiod_stats_add(&pdata->stats.bytes_out, ptr - (uintptr_t) src);
+
+	return ptr - (uintptr_t) src;
+}
+
+ssize_t read_all(struct parser_pdata *pdata, void *dst, size_t len)
+{
+	uintptr_t ptr = (uintptr_t) dst;
+
+	while (len) {
+		ssize_t ret = pdata->readfd(pdata, (void *) ptr, len);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EPIPE;
+		ptr += ret;
+		len -= ret;
+	}
+
+	iiod_stats_add(&pdata->stats.bytes_in, ptr - (uintptr_t) dst);
+
+	return ptr - (uintptr_t) dst;
+}
+
+static void print_value(struct parser_pdata *pdata, long value)
+{
+	if (pdata->verbose && value < 0) {
+		char buf[1024];
+		iio_strerror(-value, buf, sizeof(buf));
+		output(pdata, "ERROR: ");
+		output(pdata, buf);
+		output(pdata, "\n");
+	} else {
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%li\n", value);
+		output(pdata, buf);
+	}
+}
+
+/* Callbacks for iio_block_foreach_sample(): instead of moving each
+ * sample through the file descriptor individually, they assemble (or
+ * consume) the whole demuxed stream in a scratch buffer, so that the
+ * actual I/O happens in one call. */
+ssize_t iiod_demux_sample(const struct iio_channel *chn,
+			  void *src, size_t length, void *d)
+{
+	struct mem_sample_cb_info *info = d;
+
+	/* Insert the padding if needed */
+	if (info->cpt % length) {
+		size_t goal = length - info->cpt % length;
+
+		if (info->nb_bytes - info->cpt < goal)
+			return 0;
+
+		memset(info->ptr + info->cpt, 0, goal);
+		info->cpt += goal;
+	}
+
+	if (info->nb_bytes - info->cpt < length)
+		return 0;
+
+	memcpy(info->ptr + info->cpt, src, length);
+	info->cpt += length;
+	return (ssize_t) length;
+}
+
+ssize_t iiod_mux_sample(const struct iio_channel *chn,
+			void *dst, size_t length, void *d)
+{
+	struct mem_sample_cb_info *info = d;
+
+	/* Skip the padding if needed */
+	if (info->cpt % length)
+		info->cpt += length - info->cpt % length;
+
+	if (info->nb_bytes < info->cpt ||
+	    info->nb_bytes - info->cpt < length)
+		return 0;
+
+	memcpy(dst, info->ptr + info->cpt, length);
+	info->cpt += length;
+	return (ssize_t) length;
+}
+
+#if WITH_IIOD_ZEROCOPY
+static void iiod_zc_reap(struct parser_pdata *pdata, bool wait)
+{
+	struct sock_extended_err *serr;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	char control[128];
+	struct pollfd pfd;
+	ssize_t ret;
+
+	while (pdata->zc_pending) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ret = recvmsg(pdata->fd_out, &msg, MSG_ERRQUEUE);
+		if (ret < 0) {
+			if (errno != EAGAIN || !wait)
+				return;
+
+			/* POLLERR is reported when the error queue is
+			 * non-empty, no events need to be requested. */
+			pfd.fd = pdata->fd_out;
+			pfd.events = 0;
+			pfd.revents = 0;
+			poll_nointr(&pfd, 1);
+			continue;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level != SOL_IP && cm->cmsg_level != SOL_IPV6)
+				continue;
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (serr->ee_errno != 0 ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			ret = serr->ee_data - serr->ee_info + 1;
+			if ((size_t) ret > pdata->zc_pending)
+				pdata->zc_pending = 0;
+			else
+				pdata->zc_pending -= (unsigned int) ret;
+		}
+	}
+}
+
+/* Send a block's payload without copying it into the socket buffers.
+ * The kernel pins the pages until the data has been acknowledged, so
+ * before returning we wait for all completion notifications: the block
+ * is refilled as soon as we return, and a page still in flight would
+ * leak the new samples into the old transfer. */
+static ssize_t write_all_zerocopy(struct parser_pdata *pdata,
+				  const void *src, size_t len)
+{
+	uintptr_t ptr = (uintptr_t) src;
+	struct pollfd pfd[2];
+	ssize_t ret;
+
+	pfd[0].fd = pdata->fd_out;
+	pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
+	pfd[1].events = POLLIN;
+
+	while (len) {
+		do {
+			ret = send(pdata->fd_out, (const void *) ptr, len,
+				   MSG_NOSIGNAL | MSG_ZEROCOPY);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret > 0) {
+			pdata->zc_pending++;
+			iiod_stats_add(&pdata->stats.bytes_out, ret);
+			ptr += ret;
+			len -= ret;
+			continue;
+		}
+
+		if (ret == 0)
+			break;
+
+		if (errno == ENOBUFS) {
+			/* Out of pinnable memory: wait for in-flight
+			 * completions and send this chunk copied. */
+			iiod_zc_reap(pdata, true);
+
+			ret = write_all(pdata, (const void *) ptr, len);
+			if (ret < 0)
+				return ret;
+
+			ptr += ret;
+			len -= ret;
+			continue;
+		}
+
+		if (errno != EAGAIN)
+			return -errno;
+
+		pfd[0].events = POLLOUT;
+		pfd[0].revents = 0;
+		pfd[1].revents = 0;
+
 		poll_nointr(pfd, 2);
 
-		/* Got STOP event, or client closed the socket: treat it as EOF */
+		/* Got STOP event, or client closed the socket */
 		if (pfd[1].revents & POLLIN || pfd[0].revents & POLLHUP)
 			return 0;
-		if (pfd[0].revents & POLLERR)
-			return -EIO;
-		if (!(pfd[0].revents & POLLOUT))
-			continue;
-
-		do {
-			if (pdata->fd_out_is_socket)
-				ret = send(pdata->fd_out, src, len, MSG_NOSIGNAL);
-			else
-				ret = write(pdata->fd_out, src, len);
-		} while (ret == -1 && errno == EINTR);
 
-		if (ret != -1 || errno != EAGAIN)
-			break;
-	} while (true);
+		/* POLLERR here just signals a non-empty error queue */
+		if (pfd[0].revents & POLLERR)
+			iiod_zc_reap(pdata, false);
+	}
 
-	if (ret == -1)
-		return -errno;
+	iiod_zc_reap(pdata, true);
 
-	return ret;
+	return (ssize_t) (ptr - (uintptr_t) src);
 }
+#endif
 
-ssize_t write_all(struct parser_pdata *pdata, const void *src, size_t len)
+/* Per-channel layout of a demuxed sample, used by the decimation stage
+ * to locate and convert the individual values */
+struct decim_chn {
+	const struct iio_channel *chn;
+	const struct iio_data_format *fmt;
+	unsigned int offset;
+};
+
+static unsigned int decim_build_layout(const struct ThdEntry *thd,
+				       struct decim_chn *chns)
 {
-	uintptr_t ptr = (uintptr_t) src;
+	const struct iio_channel *chn;
+	const struct iio_data_format *fmt;
+	unsigned int i, nb = 0, cpt = 0, bytes;
 
-	while (len) {
-		ssize_t ret = pdata->writefd(pdata, (void *) ptr, len);
-		if (ret < 0)
-			return ret;
-		if (!ret)
-			return -EPIPE;
-		ptr += ret;
-		len -= ret;
+	for (i = 0; i < iio_device_get_channels_count(thd->dev); i++) {
+		chn = iio_device_get_channel(thd->dev, i);
+
+		if (iio_channel_get_index(chn) < 0 ||
+		    !iio_channel_is_enabled(chn, thd->mask))
+			continue;
+
+		fmt = iio_channel_get_data_format(chn);
+		bytes = fmt->length / 8;
+
+		if (cpt % bytes)
+			cpt += bytes - cpt % bytes;
+
+		chns[nb].chn = chn;
+		chns[nb].fmt = fmt;
+		chns[nb].offset = cpt;
+
+		cpt += bytes * fmt->repeat;
+		nb++;
 	}
 
-	return ptr - (uintptr_t) src;
+	return nb;
 }
 
-ssize_t read_all(struct parser_pdata *pdata, void *dst, size_t len)
+static int64_t decim_get_value(const struct decim_chn *c, const uint8_t *src)
 {
-	uintptr_t ptr = (uintptr_t) dst;
+	union {
+		int8_t s8; uint8_t u8;
+		int16_t s16; uint16_t u16;
+		int32_t s32; uint32_t u32;
+		int64_t s64;
+	} v;
+
+	iio_channel_convert(c->chn, &v, src);
+
+	switch (c->fmt->length) {
+	case 8:
+		return c->fmt->is_signed ? v.s8 : (int64_t) v.u8;
+	case 16:
+		return c->fmt->is_signed ? v.s16 : (int64_t) v.u16;
+	case 32:
+		return c->fmt->is_signed ? v.s32 : (int64_t) v.u32;
+	default:
+		return v.s64;
+	}
+}
 
-	while (len) {
-		ssize_t ret = pdata->readfd(pdata, (void *) ptr, len);
-		if (ret < 0)
-			return ret;
-		if (!ret)
-			return -EPIPE;
-		ptr += ret;
-		len -= ret;
+static void decim_set_value(const struct decim_chn *c, uint8_t *dst,
+			    int64_t value)
+{
+	union {
+		int8_t s8;
+		int16_t s16;
+		int32_t s32;
+		int64_t s64;
+	} v;
+
+	switch (c->fmt->length) {
+	case 8:
+		v.s8 = (int8_t) value;
+		break;
+	case 16:
+		v.s16 = (int16_t) value;
+		break;
+	case 32:
+		v.s32 = (int32_t) value;
+		break;
+	default:
+		v.s64 = value;
+		break;
 	}
 
-	return ptr - (uintptr_t) dst;
+	iio_channel_convert_inverse(c->chn, dst, &v);
 }
 
-static void print_value(struct parser_pdata *pdata, long value)
+static size_t decim_out_samples(const struct ThdEntry *thd, size_t in_samples)
 {
-	if (pdata->verbose && value < 0) {
-		char buf[1024];
-		iio_strerror(-value, buf, sizeof(buf));
-		output(pdata, "ERROR: ");
-		output(pdata, buf);
-		output(pdata, "\n");
-	} else {
-		char buf[128];
-		snprintf(buf, sizeof(buf), "%li\n", value);
-		output(pdata, buf);
-	}
+	size_t nb_bins = in_samples / thd->decim_factor;
+
+	return thd->decim_mode == DECIM_PEAK ? nb_bins * 2 : nb_bins;
 }
 
-static ssize_t send_sample(const struct iio_channel *chn,
-		void *src, size_t length, void *d)
+/* Reduce "in_samples" demuxed samples in "buf" (laid out with the
+ * client's sample size) in place, one output per bin of "decim_factor"
+ * input samples. Returns the number of output bytes. */
+static ssize_t decimate_samples(const struct ThdEntry *thd, uint8_t *buf,
+				size_t in_samples)
 {
-	struct sample_cb_info *info = d;
+	size_t b, k, ss = thd->sample_size;
+	size_t nb_bins = in_samples / thd->decim_factor;
+	struct decim_chn *chns;
+	const uint8_t *in;
+	uint8_t *tmp, *out = buf;
+	unsigned int i, nb_chns;
+	int64_t val, min, max, sum;
+
+	if (thd->decim_mode == DECIM_DROP) {
+		/* Pure sample selection, no conversion needed */
+		for (b = 0; b < nb_bins; b++)
+			memmove(buf + b * ss,
+				buf + b * thd->decim_factor * ss, ss);
+
+		return nb_bins * ss;
+	}
 
-	if (info->nb_bytes < length)
-		return 0;
+	chns = malloc(iio_device_get_channels_count(thd->dev) * sizeof(*chns));
+	tmp = malloc(2 * ss);
+	if (!chns || !tmp) {
+		free(chns);
+		free(tmp);
+		return -ENOMEM;
+	}
 
-	if (info->cpt % length) {
-		unsigned int i, goal = length - info->cpt % length;
-		char zero = 0;
-		ssize_t ret;
+	nb_chns = decim_build_layout(thd, chns);
 
-		for (i = 0; i < goal; i++) {
-			ret = info->pdata->writefd(info->pdata, &zero, 1);
-			if (ret < 0)
-				return ret;
+	for (b = 0; b < nb_bins; b++) {
+		in = buf + b * thd->decim_factor * ss;
+
+		memset(tmp, 0, 2 * ss);
+
+		for (i = 0; i < nb_chns; i++) {
+			const struct decim_chn *c = &chns[i];
+
+			sum = 0;
+			min = INT64_MAX;
+			max = INT64_MIN;
+
+			for (k = 0; k < thd->decim_factor; k++) {
+				val = decim_get_value(c, in + k * ss
+						      + c->offset);
+
+				sum += val;
+				if (val < min)
+					min = val;
+				if (val > max)
+					max = val;
+			}
+
+			if (thd->decim_mode == DECIM_AVG) {
+				decim_set_value(c, tmp + c->offset, sum
+						/ (int64_t) thd->decim_factor);
+			} else {
+				decim_set_value(c, tmp + c->offset, min);
+				decim_set_value(c, tmp + ss + c->offset, max);
+			}
+		}
+
+		if (thd->decim_mode == DECIM_AVG) {
+			memcpy(out, tmp, ss);
+			out += ss;
+		} else {
+			memcpy(out, tmp, 2 * ss);
+			out += 2 * ss;
 		}
-		info->cpt += goal;
 	}
 
-	info->cpt += length;
-	info->nb_bytes -= length;
-	return write_all(info->pdata, src, length);
+	free(tmp);
+	free(chns);
+
+	return out - buf;
 }
 
-static ssize_t receive_sample(const struct iio_channel *chn,
-		void *dst, size_t length, void *d)
+static int dev_demux_grow_scratch(struct DevEntry *dev, size_t len)
 {
-	struct sample_cb_info *info = d;
-
-	if (info->cpt == info->nb_bytes)
+	if (dev->demux_scratch_len >= len)
 		return 0;
 
-	/* Skip the padding if needed */
-	if (info->cpt % length) {
-		unsigned int i, goal = length - info->cpt % length;
-		char foo;
-		ssize_t ret;
-
-		for (i = 0; i < goal; i++) {
-			ret = info->pdata->readfd(info->pdata, &foo, 1);
-			if (ret < 0)
-				return ret;
-		}
-		info->cpt += goal;
-	}
+	bufpool_put(dev->demux_scratch);
+	dev->demux_scratch = bufpool_get(len);
+	dev->demux_scratch_len = dev->demux_scratch ? len : 0;
 
-	info->cpt += length;
-	return read_all(info->pdata, dst, length);
+	return dev->demux_scratch ? 0 : -ENOMEM;
 }
 
 static ssize_t send_data(struct DevEntry *dev, struct ThdEntry *thd, size_t len)
 {
 	struct parser_pdata *pdata = thd->pdata;
-	bool demux = server_demux && dev->sample_size != thd->sample_size;
+	bool decim = thd->decim_mode != DECIM_NONE;
+	bool demux = decim ||
+		(server_demux && dev->sample_size != thd->sample_size);
 	unsigned int i, nb_channels = iio_device_get_channels_count(dev->dev);
 	unsigned int nb_words = (nb_channels + 31) / 32;
 	struct iio_block *block = dev->blocks[dev->curr_block];
 	const struct iio_channels_mask *mask;
 	const struct iio_channel *chn;
+	size_t in_samples = len / dev->sample_size;
 	uint32_t *words;
 	ssize_t ret, length;
 	void *start;
 
 	if (demux)
-		len = (len / dev->sample_size) * thd->sample_size;
+		len = in_samples * thd->sample_size;
+	if (decim)
+		len = decim_out_samples(thd, in_samples) * thd->sample_size;
 	if (len > thd->nb)
 		len = thd->nb;
 
@@ -495,16 +1461,61 @@ static ssize_t send_data(struct DevEntry *dev, struct ThdEntry *thd, size_t len)
 	if (!demux) {
 		/* Short path */
 		start = iio_block_start(block);
+
+#if WITH_IIOD_ZEROCOPY
+		if (pdata->zerocopy && len >= ZEROCOPY_THRESHOLD)
+			return write_all_zerocopy(pdata, start, len);
+#endif
+
 		return write_all(pdata, start, len);
 	} else {
-		struct sample_cb_info info = {
-			.pdata = pdata,
-			.cpt = 0,
-			.nb_bytes = len,
+		struct mem_sample_cb_info info = {
+			/* The decimation stage needs the whole block; the
+			 * result is capped to the announced length below */
+			.nb_bytes = decim ?
+				in_samples * thd->sample_size : len,
 		};
+		size_t send_len;
+		ssize_t err;
 
-		return iio_block_foreach_sample(block, thd->mask,
-						send_sample, &info);
+		/* Demux into the scratch buffer, so that the samples can
+		 * be sent with a single write instead of one per sample. */
+		ret = dev_demux_grow_scratch(dev, info.nb_bytes);
+		if (ret < 0)
+			return ret;
+
+		info.ptr = dev->demux_scratch;
+
+		ret = iio_block_foreach_sample(block, thd->mask,
+					       iiod_demux_sample, &info);
+		if (ret < 0)
+			return ret;
+
+		send_len = info.cpt;
+
+		if (decim) {
+			ret = decimate_samples(thd, dev->demux_scratch,
+					       in_samples);
+			if (ret < 0)
+				return ret;
+
+			send_len = (size_t) ret;
+			if (send_len > len)
+				send_len = len;
+
+			ret = send_len;
+		}
+
+#if WITH_IIOD_ZEROCOPY
+		if (pdata->zerocopy && send_len >= ZEROCOPY_THRESHOLD)
+			err = write_all_zerocopy(pdata, info.ptr, send_len);
+		else
+#endif
+			err = write_all(pdata, info.ptr, send_len);
+		if (err < 0)
+			return err;
+
+		return ret;
 	}
 }
 
@@ -514,6 +1525,10 @@ static ssize_t receive_data(struct DevEntry *dev, struct ThdEntry *thd)
 	struct iio_block *block = dev->blocks[dev->curr_block];
 	void *ptr;
 
+	/* Decimation applies to captured data only */
+	if (thd->decim_mode != DECIM_NONE)
+		return -EINVAL;
+
 	/* Inform that no error occurred, and that we'll start reading data */
 	if (thd->new_client) {
 		print_value(thd->pdata, 0);
@@ -531,16 +1546,30 @@ static ssize_t receive_data(struct DevEntry *dev, struct ThdEntry *thd)
 
 		return read_all(pdata, ptr, len);
 	} else {
-		/* Long path: Mux the samples to the buffer */
+		/* Long path: Read the demuxed stream in one call into the
+		 * scratch buffer, then mux the samples to the buffer */
 
-		struct sample_cb_info info = {
-			.pdata = pdata,
-			.cpt = 0,
-			.nb_bytes = thd->nb,
-		};
+		struct mem_sample_cb_info info;
+		size_t len = thd->sample_size * dev->samples_count;
+		ssize_t ret;
+
+		if (thd->nb < len)
+			len = thd->nb;
+
+		ret = dev_demux_grow_scratch(dev, len);
+		if (ret < 0)
+			return ret;
+
+		ret = read_all(pdata, dev->demux_scratch, len);
+		if (ret < 0)
+			return ret;
+
+		info.ptr = dev->demux_scratch;
+		info.nb_bytes = len;
+		info.cpt = 0;
 
 		return iio_block_foreach_sample(block, thd->mask,
-						receive_sample, &info);
+						iiod_mux_sample, &info);
 	}
 }
 
@@ -558,6 +1587,7 @@ static void dev_entry_put(struct DevEntry *entry)
 		pthread_mutex_destroy(&entry->thdlist_lock);
 		pthread_cond_destroy(&entry->rw_ready_cond);
 
+		bufpool_put(entry->demux_scratch);
 		free(entry->mask);
 		free(entry);
 	}
@@ -641,6 +1671,166 @@ static void free_buf_and_blocks(struct DevEntry *entry)
 	entry->nb_blocks = 0;
 }
 
+/* Owner of the kernel block queue while the pipeline runs. Served blocks
+ * handed back by the R/W thread (via "to_dev") are re-enqueued at once,
+ * and completed blocks are pulled out of the kernel as soon as they are
+ * ready (via "filled"), without waiting for the R/W thread to be done
+ * with the previous one - so the device never sits idle during a slow
+ * network send. The kernel FIFO mirrors the enqueue order, since blocks
+ * complete in the order they were enqueued. */
+/* Put a block the R/W thread is done with back into the kernel queue.
+ * Returns non-zero when the pipeline is being stopped. */
+static int capture_requeue(struct DevEntry *entry, struct block_xfer *xfer,
+			   unsigned int *khead, unsigned int *in_kernel)
+{
+	int ret;
+
+	ret = iio_block_enqueue(xfer->block, xfer->bytes_used, entry->cyclic);
+	if (ret < 0) {
+		entry->err_xfer.ret = ret;
+		return spsc_queue_push(&entry->filled, &entry->err_xfer);
+	}
+
+	/* Cyclic blocks repeat in the kernel forever, never dequeued */
+	if (entry->cyclic)
+		return 0;
+
+	entry->kfifo[*khead] = xfer;
+	*khead = (*khead + 1) % entry->nb_blocks;
+	(*in_kernel)++;
+
+	return 0;
+}
+
+static void * dev_capture_thd(void *d)
+{
+	struct DevEntry *entry = d;
+	unsigned int khead = 0, ktail = 0, in_kernel = entry->nb_blocks;
+	unsigned int i, nb_blocks = entry->nb_blocks;
+	struct block_xfer *xfer;
+	void *elm;
+	int ret;
+
+#ifdef HAS_PTHREAD_SETNAME_NP
+	pthread_setname_np(pthread_self(), "capture_thd");
+#endif
+
+	/* All the blocks were enqueued before the pipeline started */
+	for (i = 0; i < nb_blocks; i++)
+		entry->kfifo[i] = &entry->xfers[i];
+
+	for (;;) {
+		if (!in_kernel) {
+			/* Everything is on the R/W side; wait for it */
+			if (spsc_queue_pop(&entry->to_dev, &elm))
+				return NULL;
+			if (capture_requeue(entry, elm, &khead, &in_kernel))
+				return NULL;
+			continue;
+		}
+
+		/* Re-enqueue whatever the R/W thread handed back so far */
+		while (!spsc_queue_try_pop(&entry->to_dev, &elm)) {
+			if (capture_requeue(entry, elm, &khead, &in_kernel))
+				return NULL;
+		}
+
+		/* Read ahead: pull the oldest block out of the kernel as
+		 * soon as it completes */
+		xfer = entry->kfifo[ktail];
+
+		ret = iio_block_dequeue(xfer->block, false);
+		if (ret < 0) {
+			/* Tell the clients, and retry the same block; when
+			 * the buffer got cancelled, the R/W thread stops us
+			 * once the last client is gone. */
+			entry->err_xfer.ret = ret;
+			if (spsc_queue_push(&entry->filled, &entry->err_xfer))
+				return NULL;
+			continue;
+		}
+
+		ktail = (ktail + 1) % nb_blocks;
+		in_kernel--;
+
+		xfer->ret = 0;
+		if (spsc_queue_push(&entry->filled, xfer))
+			return NULL;
+	}
+}
+
+static int dev_pipeline_start(struct DevEntry *entry)
+{
+	unsigned int i;
+	int ret;
+
+	entry->xfers = calloc(entry->nb_blocks, sizeof(*entry->xfers));
+	entry->kfifo = calloc(entry->nb_blocks, sizeof(*entry->kfifo));
+	if (!entry->xfers || !entry->kfifo)
+		goto err_free;
+
+	for (i = 0; i < entry->nb_blocks; i++) {
+		entry->xfers[i].block = entry->blocks[i];
+		entry->xfers[i].idx = i;
+	}
+
+	entry->err_xfer.block = NULL;
+	entry->err_xfer.ret = 0;
+
+	spsc_queue_init(&entry->filled);
+	spsc_queue_init(&entry->to_dev);
+
+	ret = pthread_create(&entry->capture_thd, NULL,
+			     dev_capture_thd, entry);
+	if (ret)
+		goto err_free;
+
+	entry->pipeline_started = true;
+
+	return 0;
+
+err_free:
+	free(entry->xfers);
+	free(entry->kfifo);
+	entry->xfers = NULL;
+	entry->kfifo = NULL;
+	return ret ? -ret : -ENOMEM;
+}
+
+static void dev_pipeline_stop(struct DevEntry *entry)
+{
+	if (!entry->pipeline_started)
+		return;
+
+	/* The capture thread bails out at its next queue operation; when
+	 * it sits in iio_block_dequeue(), the buffer cancellation (or the
+	 * next completed block) kicks it out of the kernel first. */
+	spsc_queue_stop(&entry->filled);
+	spsc_queue_stop(&entry->to_dev);
+
+	pthread_join(entry->capture_thd, NULL);
+
+	free(entry->xfers);
+	free(entry->kfifo);
+	entry->xfers = NULL;
+	entry->kfifo = NULL;
+	entry->pipeline_started = false;
+}
+
+/* Writability of the socket is used as the back-pressure signal for
+ * subscribers in drop mode: room left in the socket buffer means the
+ * client is keeping up. */
+static bool socket_has_room(int fd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLOUT);
+}
+
 static void rw_thd(struct thread_pool *pool, void *d)
 {
 	struct DevEntry *entry = d;
@@ -650,6 +1840,8 @@ static void rw_thd(struct thread_pool *pool, void *d)
 	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
 	struct iio_channel *chn;
 	struct iio_block *block;
+	struct block_xfer *xfer;
+	void *elm;
 	ssize_t nb_bytes, ret = 0;
 
 	IIO_DEBUG("R/W thread started for device %s\n",
@@ -670,6 +1862,7 @@ static void rw_thd(struct thread_pool *pool, void *d)
 			unsigned int i;
 			unsigned int samples_count = 0;
 
+			dev_pipeline_stop(entry);
 			free_buf_and_blocks(entry);
 
 			for (i = 0; i < nb_channels; i++) {
@@ -711,6 +1904,12 @@ static void rw_thd(struct thread_pool *pool, void *d)
 				break;
 			}
 
+			ret = dev_pipeline_start(entry);
+			if (ret) {
+				IIO_ERROR("Unable to start the capture pipeline\n");
+				break;
+			}
+
 			/* Signal the threads that we opened the device */
 			SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
 				if (thd->wait_for_open) {
@@ -751,22 +1950,26 @@ static void rw_thd(struct thread_pool *pool, void *d)
 		if (!has_readers && !has_writers)
 			continue;
 
-		block = entry->blocks[entry->curr_block];
-
-		ret = iio_block_dequeue(block, false);
+		/* Next completed block, read ahead by the capture thread.
+		 * A failed pop means the pipeline is shutting down; treat
+		 * it like a device error, the loop exits at the top. */
+		ret = spsc_queue_pop(&entry->filled, &elm);
+		xfer = ret ? NULL : elm;
+		if (xfer)
+			ret = xfer->ret;
 
 		pthread_mutex_lock(&entry->thdlist_lock);
 
 		if (ret < 0) {
-			/* Reading from the device failed - signal the
-			 * error to all connected clients. */
+			/* Reading from (or feeding) the device failed -
+			 * signal the error to all connected clients. */
 
 			/* Don't use SLIST_FOREACH - see comment below */
 			for (thd = SLIST_FIRST(&entry->thdlist_head);
 			     thd; thd = next_thd) {
 				next_thd = SLIST_NEXT(thd, dev_list_entry);
 
-				if (!thd->active || thd->is_writer)
+				if (!thd->active)
 					continue;
 
 				signal_thread(thd, ret);
@@ -776,6 +1979,9 @@ static void rw_thd(struct thread_pool *pool, void *d)
 			continue;
 		}
 
+		entry->curr_block = xfer->idx;
+		block = xfer->block;
+
 		/*
 		 * When the last client disconnects the buffer is
 		 * cancelled and iio_buffer_refill() returns an error. A
@@ -803,6 +2009,16 @@ static void rw_thd(struct thread_pool *pool, void *d)
 				if (!thd->active || thd->is_writer)
 					continue;
 
+				/* A subscriber in drop mode whose socket
+				 * has no room left is falling behind: skip
+				 * it for this block instead of stalling
+				 * the other subscribers. */
+				if (thd->drop && thd->pdata->fd_out_is_socket &&
+				    !socket_has_room(thd->pdata->fd_out)) {
+					thd->nb_dropped++;
+					continue;
+				}
+
 				ret = send_data(entry, thd, nb_bytes);
 				if (ret > 0)
 					thd->nb -= ret;
@@ -848,8 +2064,11 @@ static void rw_thd(struct thread_pool *pool, void *d)
 			}
 		}
 
-		ret = iio_block_enqueue(block, nb_bytes, entry->cyclic);
-		entry->curr_block = (entry->curr_block + 1) % entry->nb_blocks;
+		/* Hand the served block back to the capture thread, which
+		 * re-enqueues it; by now it has typically already pulled
+		 * the next completed block for us. */
+		xfer->bytes_used = (size_t) nb_bytes;
+		ret = spsc_queue_push(&entry->to_dev, xfer);
 
 		if (entry->cancelled) {
 			pthread_mutex_unlock(&entry->thdlist_lock);
@@ -882,6 +2101,7 @@ static void rw_thd(struct thread_pool *pool, void *d)
 		thd->wait_for_open = false;
 		signal_thread(thd, ret);
 	}
+	dev_pipeline_stop(entry);
 	free_buf_and_blocks(entry);
 	entry->closed = true;
 	pthread_mutex_unlock(&entry->thdlist_lock);
@@ -920,6 +2140,8 @@ static ssize_t rw_buffer(struct parser_pdata *pdata,
 	struct ThdEntry *thd;
 	ssize_t ret;
 
+	iio_trace3(dev_rw_start, dev, nb, is_write);
+
 	if (!dev)
 		return -ENODEV;
 
@@ -965,6 +2187,7 @@ static ssize_t rw_buffer(struct parser_pdata *pdata,
 		print_value(thd->pdata, 0);
 
 	IIO_DEBUG("Exiting rw_buffer with code %li\n", (long) ret);
+	iio_trace3(dev_rw_done, dev, ret, is_write);
 	if (ret < 0)
 		return ret;
 	else
@@ -997,6 +2220,11 @@ static void remove_thd_entry(struct ThdEntry *t)
 {
 	struct DevEntry *entry = t->entry;
 
+	if (t->nb_dropped) {
+		IIO_DEBUG("Dropped %u blocks for slow client of device %s\n",
+			  t->nb_dropped, dev_label_or_name_or_id(t->dev));
+	}
+
 	pthread_mutex_lock(&entry->thdlist_lock);
 	if (!entry->closed) {
 		entry->update_mask = true;
@@ -1057,7 +2285,9 @@ static ssize_t get_dev_sample_size_mask(const struct iio_device *dev,
 }
 
 static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
-			   size_t samples_count, uint32_t *words, bool cyclic)
+			   size_t samples_count, uint32_t *words, bool cyclic,
+			   bool drop, enum decim_mode decim_mode,
+			   unsigned int decim_factor)
 {
 	int ret = -ENOMEM;
 	struct DevEntry *entry;
@@ -1079,6 +2309,27 @@ static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
 			iio_channel_enable(chn, mask);
 	}
 
+	if (decim_mode == DECIM_AVG || decim_mode == DECIM_PEAK) {
+		const struct iio_data_format *fmt;
+
+		/* The converting modes only handle scalar samples of a
+		 * power-of-two length */
+		for (i = 0; i < nb_channels; i++) {
+			chn = iio_device_get_channel(dev, i);
+
+			if (!iio_channel_is_enabled(chn, mask))
+				continue;
+
+			fmt = iio_channel_get_data_format(chn);
+			if (fmt->repeat > 1 ||
+			    (fmt->length != 8 && fmt->length != 16 &&
+			     fmt->length != 32 && fmt->length != 64)) {
+				ret = -EINVAL;
+				goto err_free_mask;
+			}
+		}
+	}
+
 	thd = zalloc(sizeof(*thd));
 	if (!thd)
 		goto err_free_mask;
@@ -1090,6 +2341,9 @@ static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
 	thd->sample_size = iio_device_get_sample_size(dev, mask);
 	thd->pdata = pdata;
 	thd->dev = dev;
+	thd->drop = drop;
+	thd->decim_mode = decim_mode;
+	thd->decim_factor = decim_factor;
 	thd->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 
 	dev_pdata = iio_device_get_data(dev);
@@ -1259,15 +2513,29 @@ static int close_dev_helper(struct parser_pdata *pdata, struct iio_device *dev)
 }
 
 int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
-		size_t samples_count, const char *mask, bool cyclic)
+		size_t samples_count, const char *mask, bool cyclic,
+		bool drop, const char *decim, unsigned int decim_factor)
 {
 	size_t nb_channels, nb_words, len = strlen(mask);
+	enum decim_mode decim_mode = DECIM_NONE;
 	uint32_t *words;
 	int ret;
 
 	if (!dev)
 		return -ENODEV;
 
+	if (decim) {
+		if (!strcasecmp(decim, "DROP"))
+			decim_mode = DECIM_DROP;
+		else if (!strcasecmp(decim, "AVG"))
+			decim_mode = DECIM_AVG;
+		else if (!strcasecmp(decim, "PEAK"))
+			decim_mode = DECIM_PEAK;
+
+		if (decim_mode == DECIM_NONE || decim_factor < 2)
+			return -EINVAL;
+	}
+
 	nb_channels = iio_device_get_channels_count(dev);
 	nb_words = (nb_channels + 31) / 32;
 	if (len != nb_words * 8)
@@ -1279,7 +2547,8 @@ int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
 
 	get_mask(mask, len, words);
 
-	ret = open_dev_helper(pdata, dev, samples_count, words, cyclic);
+	ret = open_dev_helper(pdata, dev, samples_count, words, cyclic, drop,
+			      decim_mode, decim_factor);
 	free(words);
 
 	print_value(pdata, ret);
@@ -1351,7 +2620,7 @@ ssize_t write_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
 		goto err_print_value;
 	}
 
-	buf = malloc(len);
+	buf = bufpool_get(len);
 	if (!buf)
 		goto err_print_value;
 
@@ -1375,7 +2644,7 @@ ssize_t write_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
 	}
 
 err_free_buffer:
-	free(buf);
+	bufpool_put(buf);
 err_print_value:
 	print_value(pdata, ret);
 	return ret;
@@ -1403,7 +2672,7 @@ ssize_t write_chn_attr(struct parser_pdata *pdata,
 		struct iio_channel *chn, const char *attr, size_t len)
 {
 	ssize_t ret = -ENOMEM;
-	char *buf = malloc(len);
+	char *buf = bufpool_get(len);
 	if (!buf)
 		goto err_print_value;
 
@@ -1418,7 +2687,7 @@ ssize_t write_chn_attr(struct parser_pdata *pdata,
 	else
 		ret = -ENODEV;
 err_free_buffer:
-	free(buf);
+	bufpool_put(buf);
 err_print_value:
 	print_value(pdata, ret);
 	return ret;
@@ -1511,8 +2780,14 @@ ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len)
 	ssize_t ret;
 	bool found;
 
-	if (pdata->is_usb)
-	      return pdata->readfd(pdata, buf, len);
+	if (pdata->is_usb) {
+		ret = pdata->readfd(pdata, buf, len);
+		if (ret > 0) {
+			iiod_stats_add(&pdata->stats.bytes_in, ret);
+			iiod_stats_inc(&pdata->stats.commands);
+		}
+		return ret;
+	}
 
 	if (pdata->fd_in_is_socket) {
 		struct pollfd pfd[2];
@@ -1578,13 +2853,28 @@ ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len)
 		found = !!len;
 	}
 
-	return found ? (ssize_t) bytes_read : -EIO;
+	if (!found)
+		return -EIO;
+
+	iiod_stats_add(&pdata->stats.bytes_in, bytes_read);
+	iiod_stats_inc(&pdata->stats.commands);
+
+	return (ssize_t) bytes_read;
+}
+
+static bool fd_is_unix_socket(int fd)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+
+	return !getsockname(fd, (struct sockaddr *) &ss, &len)
+		&& ss.ss_family == AF_UNIX;
 }
 
 void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 		 bool is_socket, bool is_usb, bool use_aio,
-		 struct thread_pool *pool, const void *xml_zstd,
-		 size_t xml_zstd_len)
+		 struct thread_pool *pool,
+		 const struct iiod_xml_cache *xml_cache)
 {
 	struct parser_pdata pdata = { 0 };
 	yyscan_t scanner;
@@ -1597,12 +2887,22 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 	pdata.verbose = verbose;
 	pdata.pool = pool;
 
-	pdata.xml_zstd = xml_zstd;
-	pdata.xml_zstd_len = xml_zstd_len;
+	pdata.xml_cache = xml_cache;
 
 	pdata.fd_in_is_socket = is_socket;
 	pdata.fd_out_is_socket = is_socket;
 	pdata.is_usb = is_usb;
+	pdata.is_uds = is_socket && fd_is_unix_socket(fd_in);
+	pdata.udp_fd = -1;
+
+#if WITH_IIOD_ZEROCOPY
+	if (server_zerocopy && is_socket && !use_aio) {
+		int one = 1;
+
+		pdata.zerocopy = !setsockopt(fd_out, SOL_SOCKET, SO_ZEROCOPY,
+					     &one, sizeof(one));
+	}
+#endif
 
 	SLIST_INIT(&pdata.thdlist_head);
 
@@ -1612,34 +2912,59 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 #if WITH_AIO
 		char err_str[1024];
 
+#if WITH_IIOD_URING
+		/* Prefer the io_uring engine: the transfer chunks move as a
+		 * chain of linked requests, queued back to back by the kernel
+		 * without the eventfd + getevents round trips of the libaio
+		 * path. Old kernels fail the ring setup and we fall back. */
 		for (i = 0; i < 2; i++) {
-			pdata.aio_eventfd[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
-			if (pdata.aio_eventfd[i] < 0) {
-				iio_strerror(errno, err_str, sizeof(err_str));
-				IIO_ERROR("Failed to create AIO eventfd: %s\n", err_str);
-				goto err_free_aio;
+			pdata.uring[i] = iiod_uring_create();
+			if (iio_err(pdata.uring[i])) {
+				if (i)
+					iiod_uring_destroy(pdata.uring[0]);
+				pdata.uring[0] = NULL;
+				pdata.uring[1] = NULL;
+				break;
 			}
+		}
+
+		if (pdata.uring[0]) {
+			pdata.readfd = readfd_uring;
+			pdata.writefd = writefd_uring;
+		} else
+#endif
+		{
+			for (i = 0; i < 2; i++) {
+				pdata.aio_eventfd[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+				if (pdata.aio_eventfd[i] < 0) {
+					iio_strerror(errno, err_str, sizeof(err_str));
+					IIO_ERROR("Failed to create AIO eventfd: %s\n", err_str);
+					goto err_free_aio;
+				}
+
+				pdata.aio_ctx[i] = 0;
+				ret = io_setup(AIO_QUEUE_DEPTH, &pdata.aio_ctx[i]);
+				if (ret < 0) {
+					iio_strerror(-ret, err_str, sizeof(err_str));
+					IIO_ERROR("Failed to create AIO context: %s\n", err_str);
+					close(pdata.aio_eventfd[i]);
+					goto err_free_aio;
+				}
 
-			pdata.aio_ctx[i] = 0;
-			ret = io_setup(1, &pdata.aio_ctx[i]);
-			if (ret < 0) {
-				iio_strerror(-ret, err_str, sizeof(err_str));
-				IIO_ERROR("Failed to create AIO context: %s\n", err_str);
-				close(pdata.aio_eventfd[i]);
-				goto err_free_aio;
+				pthread_mutex_init(&pdata.aio_mutex[i], NULL);
 			}
 
-			pthread_mutex_init(&pdata.aio_mutex[i], NULL);
+			pdata.readfd = readfd_aio;
+			pdata.writefd = writefd_aio;
 		}
-
-		pdata.readfd = readfd_aio;
-		pdata.writefd = writefd_aio;
 #endif
 	} else {
 		pdata.readfd = readfd_io;
 		pdata.writefd = writefd_io;
 	}
 
+	iiod_metrics_register_client(&pdata);
+
 	yylex_init_extra(&pdata, &scanner);
 
 	do {
@@ -1653,12 +2978,23 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 	if (pdata.binary)
 		binary_parse(&pdata);
 
+	stripe_release(&pdata);
+
+	if (pdata.udp_fd >= 0)
+		close(pdata.udp_fd);
+
+	/* Drop any received descriptor that no handler collected */
+	for (i = 0; i < pdata.nb_recv_fds; i++)
+		close(pdata.recv_fds[i]);
+
 	/* Close all opened devices */
 	for (i = 0; i < iio_context_get_devices_count(ctx); i++)
 		close_dev_helper(&pdata, iio_context_get_device(ctx, i));
 
+	iiod_metrics_unregister_client(&pdata);
+
 #if WITH_AIO
-	i = use_aio ? 2 : 0;
+	i = (use_aio && pdata.readfd == readfd_aio) ? 2 : 0;
 
 err_free_aio:
 	for (; i > 0; i--) {
@@ -1667,6 +3003,12 @@ err_free_aio:
 		pthread_mutex_destroy(&pdata.aio_mutex[i - 1]);
 	}
 #endif
+#if WITH_IIOD_URING
+	for (i = 0; i < 2; i++) {
+		if (pdata.uring[i])
+			iiod_uring_destroy(pdata.uring[i]);
+	}
+#endif
 }
 
 void enable_binary(struct parser_pdata *pdata)
@@ -10,7 +10,10 @@
 #define __OPS_H__
 
 #include "../iio-config.h"
+#include "../sockopts.h"
+#include "metrics.h"
 #include "queue.h"
+#include "spsc-queue.h"
 
 #include <endian.h>
 #include <errno.h>
@@ -19,6 +22,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -45,7 +49,6 @@
 #define TEST_BIT(addr, bit) (!!(*(((uint32_t *) addr) + BIT_WORD(bit)) \
 		& BIT_MASK(bit)))
 
-struct iio_task;
 struct iiod_io;
 struct thread_pool;
 extern struct thread_pool *main_thread_pool;
@@ -62,19 +65,80 @@ struct block_entry {
 	struct iio_block *block;
 	struct iiod_io *io;
 	uint64_t bytes_used;
+	uint32_t tag;
 	uint16_t client_id;
 	bool cyclic;
+
+	/* Shared-memory blocks (IIOD_OP_CREATE_BLOCK_MEMFD): mapping of the
+	 * client's memfd, in the client's sample layout. Transfers then copy
+	 * between the mapping and the iio_block instead of the socket. NULL
+	 * for regular blocks. */
+	void *memfd_ptr;
+	size_t memfd_len;
 };
 
 struct buffer_entry {
 	SLIST_ENTRY(buffer_entry) entry;
+	struct parser_pdata *pdata;
 	struct iio_device *dev;
 	struct iio_buffer *buf;
-	struct iio_task *enqueue_task, *dequeue_task;
+	/* One single-producer/single-consumer worker per direction: the
+	 * command thread feeds the enqueue worker, which in turn feeds
+	 * the dequeue worker (see responder.c). */
+	struct spsc_worker enqueue_worker, dequeue_worker;
 	uint32_t *words;
 	uint16_t idx;
+
+	/* Bit-packing codec parameters (see bit-pack.h), valid when
+	 * "pack" has been negotiated for this buffer. The scratch is
+	 * grown on demand; TX and RX use it from different threads but
+	 * a buffer only ever moves data in one direction. */
+	void *pack_buf;
+	size_t pack_buf_len;
+	unsigned int pack_bits, pack_length, pack_shift;
+	bool pack;
+
+	/* Server-side demuxing (see --demux): when the hardware rounded
+	 * the requested channel mask up, blocks are converted between the
+	 * device layout and the client's requested layout, so that only
+	 * the requested channels cross the wire. NULL when the hardware
+	 * honored the mask exactly. */
+	struct iio_channels_mask *demux_mask;
+	size_t dev_sample_size, client_sample_size;
+	void *demux_buf;
+	size_t demux_buf_len;
 };
 
+/* Pre-serialized context description, built once at startup and then
+ * served from memory on every PRINT command instead of being re-generated
+ * for each client. Refresh it (with no clients connected) if the context
+ * ever changes, e.g. on device hotplug. */
+struct iiod_xml_cache {
+	const char *xml;	/* owned by the context */
+	size_t xml_len;
+
+	void *zstd;		/* NULL if ZSTD is disabled */
+	size_t zstd_len;
+
+	void *bin;		/* compact binary description */
+	size_t bin_len;
+};
+
+/* Exported by libiio; declared in iio-backend.h, which cannot be
+ * included here as it clashes with local definitions. */
+ssize_t iio_context_serialize_binary(const struct iio_context *ctx, void **out);
+ssize_t iio_context_serialize_binary_filtered(const struct iio_context *ctx,
+					      void **out, const char *devs);
+
+struct iiod_xml_cache * iiod_xml_cache_new(const struct iio_context *ctx);
+int iiod_xml_cache_refresh(struct iiod_xml_cache *cache,
+			   const struct iio_context *ctx);
+void iiod_xml_cache_free(struct iiod_xml_cache *cache);
+
+struct iiod_buf;
+struct iiod_responder;
+struct iiod_uring;
+
 struct parser_pdata {
 	struct iio_context *ctx;
 	bool stop, binary, verbose;
@@ -92,16 +156,73 @@ struct parser_pdata {
 	bool channel_is_output;
 	bool fd_in_is_socket, fd_out_is_socket;
 	bool is_usb;
+	bool is_uds;
+
+	/* File descriptors received as SCM_RIGHTS ancillary data alongside
+	 * the byte stream (Unix-domain connections only), pending collection
+	 * by the IIOD_OP_CREATE_BLOCK_MEMFD handler. */
+	int recv_fds[4];
+	unsigned int nb_recv_fds;
 #if WITH_AIO
 	io_context_t aio_ctx[2];
 	int aio_eventfd[2];
 	pthread_mutex_t aio_mutex[2];
+#endif
+#if WITH_IIOD_URING
+	/* io_uring engines (one per direction) used for the endpoint I/O
+	 * instead of the libaio contexts above, when the kernel supports
+	 * them. Indexed by "do_read" like the aio arrays. */
+	struct iiod_uring *uring[2];
 #endif
 	struct thread_pool *pool;
 	struct iiod_io *io;
 
-	const void *xml_zstd;
-	size_t xml_zstd_len;
+	const struct iiod_xml_cache *xml_cache;
+
+	/* Striped block transfers: data sockets attached by secondary
+	 * connections with the ASCII STRIPE command. Only set on binary
+	 * connections that negotiated IIOD_OP_STRIPE_ENABLE. */
+	int stripe_fds[8];
+	unsigned int nb_stripes, nb_stripes_expected;
+	uint64_t stripe_token;
+
+	/* UDP data plane (IIOD_OP_UDP_ENABLE): datagram socket carrying
+	 * this connection's capture payloads, or -1. Connected to the
+	 * client by the hello handshake; stays unconnected if that never
+	 * completes, in which case the sends fail silently and the client
+	 * accounts the payloads as lost. */
+	int udp_fd;
+	uint64_t udp_token;
+
+	/* Compressed block transfers (IIOD_OP_ZSTD_ENABLE). The contexts
+	 * and scratch buffer are shared by all this connection's buffers
+	 * and protected by zstd_lock. NULL if ZSTD is disabled. */
+	void *zstd_cctx, *zstd_dctx;
+	void *zstd_scratch;
+	size_t zstd_scratch_len;
+	pthread_mutex_t zstd_lock;
+
+	/* MSG_ZEROCOPY sends (--zerocopy): completion notifications
+	 * still pending on the socket's error queue. */
+	bool zerocopy;
+	unsigned int zc_pending;
+
+	/* Attribute watches (IIOD_OP_WATCH_ATTR): one poller thread per
+	 * connection, started on the first subscription, reads the
+	 * watched attributes periodically and pushes the values that
+	 * changed. The list, lock and condition belong to responder.c. */
+	SLIST_HEAD(WatchList, watch_entry) watchlist;
+	pthread_mutex_t watch_lock;
+	pthread_cond_t watch_cond;
+	pthread_t watch_thd;
+	bool watch_thd_started, watch_stop;
+	struct iiod_responder *responder;
+
+	/* Throughput counters and their registration in the server-wide
+	 * client list (see metrics.c). */
+	struct iiod_client_stats stats;
+	SLIST_ENTRY(parser_pdata) metrics_entry;
+	unsigned int client_id;
 
 	ssize_t (*writefd)(struct parser_pdata *pdata, const void *buf, size_t len);
 	ssize_t (*readfd)(struct parser_pdata *pdata, void *buf, size_t len);
@@ -113,6 +234,8 @@ struct iio_device_pdata {
 };
 
 extern bool server_demux; /* Defined in iiod.c */
+extern bool server_zerocopy; /* Defined in iiod.c */
+extern struct iio_sockopts server_sockopts; /* Defined in iiod.c */
 
 static inline void *zalloc(size_t size)
 {
@@ -121,23 +244,37 @@ static inline void *zalloc(size_t size)
 
 void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 		 bool is_socket, bool is_usb, bool use_aio, struct thread_pool *pool,
-		 const void *xml_zstd, size_t xml_zstd_len);
+		 const struct iiod_xml_cache *xml_cache);
 
 int init_usb_daemon(const char *ffs, unsigned int nb_pipes);
 int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 		bool debug, bool use_aio, unsigned int nb_pipes,
 		int ep0_fd, struct thread_pool *pool,
-		const void *xml_zstd, size_t xml_zstd_len);
+		const struct iiod_xml_cache *xml_cache);
 int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 			bool debug, struct thread_pool *pool,
-			const void *xml_zstd, size_t xml_zstd_len);
+			const struct iiod_xml_cache *xml_cache);
 
 int binary_parse(struct parser_pdata *pdata);
 
 void enable_binary(struct parser_pdata *pdata);
 
+int stripe_enable(struct parser_pdata *pdata, uint64_t token, unsigned int nb);
+int stripe_attach(struct parser_pdata *pdata, uint64_t token, unsigned int idx);
+void stripe_release(struct parser_pdata *pdata);
+ssize_t stripe_read_block(struct parser_pdata *pdata, uint64_t tag,
+			  void *dst, size_t len);
+ssize_t stripe_write_block(struct parser_pdata *pdata, uint64_t tag,
+			   const void *src, size_t len);
+
+int udp_enable(struct parser_pdata *pdata, uint64_t token);
+void udp_wait_hello(struct parser_pdata *pdata);
+void udp_send_block(struct parser_pdata *pdata, uint64_t tag,
+		    const void *src, size_t len);
+
 int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
-		size_t samples_count, const char *mask, bool cyclic);
+		size_t samples_count, const char *mask, bool cyclic,
+		bool drop, const char *decim, unsigned int decim_factor);
 int close_dev(struct parser_pdata *pdata, struct iio_device *dev);
 
 ssize_t rw_dev(struct parser_pdata *pdata, struct iio_device *dev,
@@ -161,9 +298,29 @@ int set_timeout(struct parser_pdata *pdata, unsigned int timeout);
 int set_buffers_count(struct parser_pdata *pdata,
 		struct iio_device *dev, long value);
 
+/* Callbacks for iio_block_foreach_sample() which demux samples into, or
+ * mux samples from, a memory stream laid out with the client's sample
+ * size, padding included. "ptr" points to the start of the stream,
+ * "nb_bytes" is its total size, and "cpt" tracks the current offset. */
+struct mem_sample_cb_info {
+	uint8_t *ptr;
+	size_t nb_bytes, cpt;
+};
+
+ssize_t iiod_demux_sample(const struct iio_channel *chn,
+			  void *src, size_t length, void *d);
+ssize_t iiod_mux_sample(const struct iio_channel *chn,
+			void *dst, size_t length, void *d);
+
 ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len);
 ssize_t read_all(struct parser_pdata *pdata, void *dst, size_t len);
 ssize_t write_all(struct parser_pdata *pdata, const void *src, size_t len);
+ssize_t writev_all(struct parser_pdata *pdata,
+		   const struct iiod_buf *bufs, size_t nb);
+
+/* Pop the oldest file descriptor received as ancillary data, or -1 if
+ * none is pending. */
+int take_received_fd(struct parser_pdata *pdata);
 
 static __inline__ void output(struct parser_pdata *pdata, const char *text)
 {
@@ -10,6 +10,8 @@
 #include "ops.h"
 #include "parser.h"
 
+#include "../iiod-responder.h"
+
 #include <errno.h>
 #include <string.h>
 
@@ -61,6 +63,8 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size);
 %token END
 
 %token VERSION
+%token FEATURES
+%token STRIPE
 %token EXIT
 %token HELP
 %token OPEN
@@ -78,6 +82,8 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size);
 %token BUFFER_ATTR
 %token IN_OUT
 %token CYCLIC
+%token DROP
+%token DECIM
 %token SET
 %token BUFFERS_COUNT
 %token BINARY
@@ -120,8 +126,13 @@ Line:
 		"\t\tEnable binary protocol\n"
 		"\tTIMEOUT <timeout_ms>\n"
 		"\t\tSet the timeout (in ms) for I/O operations\n"
-		"\tOPEN <device> <samples_count> <mask> [CYCLIC]\n"
-		"\t\tOpen the specified device with the given mask of channels\n"
+		"\tOPEN <device> <samples_count> <mask> [CYCLIC|DROP|DECIM <mode> <factor>]\n"
+		"\t\tOpen the specified device with the given mask of channels.\n"
+		"\t\tWith DROP, blocks are skipped instead of stalling the\n"
+		"\t\tstream when this client reads too slowly.\n"
+		"\t\tWith DECIM, samples are decimated by <factor> before\n"
+		"\t\tbeing sent; <mode> is DROP (keep one sample per bin),\n"
+		"\t\tAVG (boxcar average) or PEAK (min/max pair per bin)\n"
 		"\tCLOSE <device>\n"
 		"\t\tClose the specified device\n"
 		"\tREAD <device> DEBUG|BUFFER|[INPUT|OUTPUT <channel>] [<attribute>]\n"
@@ -148,27 +159,41 @@ Line:
 		output(pdata, buf);
 		YYACCEPT;
 	}
+	| FEATURES END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		int features = IIOD_FEATURES;
+		char buf[128];
+		if (WITH_ZSTD)
+			features |= IIOD_FEAT_ZSTD_BLOCKS;
+		if (pdata->is_uds)
+			features |= IIOD_FEAT_MEMFD;
+		snprintf(buf, sizeof(buf), "%i\n", features);
+		output(pdata, buf);
+		YYACCEPT;
+	}
 	| PRINT END {
 		struct parser_pdata *pdata = yyget_extra(scanner);
-		const char *xml = iio_context_get_xml(pdata->ctx);
+		const struct iiod_xml_cache *cache = pdata->xml_cache;
 		if (!pdata->verbose) {
 			char buf[128];
-			snprintf(buf, sizeof(buf), "%lu\n", (unsigned long) strlen(xml));
+			snprintf(buf, sizeof(buf), "%lu\n", (unsigned long) cache->xml_len);
 			output(pdata, buf);
 		}
-		output(pdata, xml);
+		if (write_all(pdata, cache->xml, cache->xml_len) <= 0)
+			pdata->stop = true;
 		output(pdata, "\n");
 		YYACCEPT;
 	}
 	| ZPRINT END {
 		struct parser_pdata *pdata = yyget_extra(scanner);
-		if (pdata->xml_zstd) {
+		const struct iiod_xml_cache *cache = pdata->xml_cache;
+		if (cache->zstd) {
 			if (!pdata->verbose) {
 				char buf[128];
-				snprintf(buf, sizeof(buf), "%lu\n", (unsigned long)pdata->xml_zstd_len);
+				snprintf(buf, sizeof(buf), "%lu\n", (unsigned long) cache->zstd_len);
 				output(pdata, buf);
 			}
-			if (write_all(pdata, pdata->xml_zstd, pdata->xml_zstd_len) <= 0)
+			if (write_all(pdata, cache->zstd, cache->zstd_len) <= 0)
 				pdata->stop = true;
 			output(pdata, "\n");
 			YYACCEPT;
@@ -179,6 +204,23 @@ Line:
 			YYABORT;
 		}
 	}
+	| STRIPE SPACE WORD SPACE WORD END {
+		char *token_str = $3, *idx_str = $5;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		uint64_t token = strtoull(token_str, NULL, 16);
+		unsigned int idx = (unsigned int) atoi(idx_str);
+		int ret;
+		free(token_str);
+		free(idx_str);
+		ret = stripe_attach(pdata, token, idx);
+		if (ret < 0) {
+			char buf[128];
+			snprintf(buf, sizeof(buf), "%d\n", ret);
+			output(pdata, buf);
+			YYABORT;
+		}
+		YYACCEPT;
+	}
 	| TIMEOUT SPACE WORD END {
 		char *word = $3;
 		struct parser_pdata *pdata = yyget_extra(scanner);
@@ -194,9 +236,38 @@ Line:
 		char *nb = $5, *mask = $7;
 		struct parser_pdata *pdata = yyget_extra(scanner);
 		unsigned long samples_count = atol(nb);
-		int ret = open_dev(pdata, $3, samples_count, mask, true);
+		int ret = open_dev(pdata, $3, samples_count, mask, true, false,
+				   NULL, 0);
+		free(nb);
+		free(mask);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| OPEN SPACE DEVICE SPACE WORD SPACE WORD SPACE DROP END {
+		char *nb = $5, *mask = $7;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		unsigned long samples_count = atol(nb);
+		int ret = open_dev(pdata, $3, samples_count, mask, false, true,
+				   NULL, 0);
+		free(nb);
+		free(mask);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| OPEN SPACE DEVICE SPACE WORD SPACE WORD SPACE DECIM SPACE WORD SPACE WORD END {
+		char *nb = $5, *mask = $7, *mode = $11, *factor = $13;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		unsigned long samples_count = atol(nb);
+		int ret = open_dev(pdata, $3, samples_count, mask, false,
+				   false, mode, (unsigned int) atoi(factor));
 		free(nb);
 		free(mask);
+		free(mode);
+		free(factor);
 		if (ret < 0)
 			YYABORT;
 		else
@@ -206,7 +277,8 @@ Line:
 		char *nb = $5, *mask = $7;
 		struct parser_pdata *pdata = yyget_extra(scanner);
 		unsigned long samples_count = atol(nb);
-		int ret = open_dev(pdata, $3, samples_count, mask, false);
+		int ret = open_dev(pdata, $3, samples_count, mask, false,
+				   false, NULL, 0);
 		free(nb);
 		free(mask);
 		if (ret < 0)
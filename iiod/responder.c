@@ -6,19 +6,27 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#include "bufpool.h"
 #include "debug.h"
 #include "ops.h"
 #include "thread-pool.h"
 
 #include "../iiod-responder.h"
+#include "../bit-pack.h"
 
 #include <fcntl.h>
-#include <iio/iio-lock.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#if WITH_ZSTD
+#include <zstd.h>
+#endif
+
 #define ARRAY_SIZE(x) (sizeof(x) ? sizeof(x) / sizeof((x)[0]) : 0)
 
 /* Protect parser_pdata->bufferlist from parallel access */
@@ -29,18 +37,24 @@ static void free_block_entry(struct block_entry *entry)
 	iiod_io_cancel(entry->io);
 	iiod_io_unref(entry->io);
 	iio_block_destroy(entry->block);
+	if (entry->memfd_ptr)
+		munmap(entry->memfd_ptr, entry->memfd_len);
 	free(entry);
 }
 
 static void free_buffer_tasks(struct buffer_entry *entry)
 {
-	iio_task_destroy(entry->enqueue_task);
-	iio_task_destroy(entry->dequeue_task);
+	spsc_worker_destroy(&entry->enqueue_worker);
+	spsc_worker_destroy(&entry->dequeue_worker);
 }
 
 static void free_buffer_entry(struct buffer_entry *entry)
 {
 	iio_buffer_destroy(entry->buf);
+	if (entry->demux_mask)
+		iio_channels_mask_destroy(entry->demux_mask);
+	bufpool_put(entry->demux_buf);
+	bufpool_put(entry->pack_buf);
 	free(entry->words);
 	free(entry);
 }
@@ -52,16 +66,83 @@ static void handle_print(struct parser_pdata *pdata,
 	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
 	struct iiod_buf buf;
 
-	if (pdata->xml_zstd) {
-		buf.ptr = (void *) pdata->xml_zstd;
-		buf.size = pdata->xml_zstd_len;
+	if (pdata->xml_cache->zstd) {
+		buf.ptr = pdata->xml_cache->zstd;
+		buf.size = pdata->xml_cache->zstd_len;
+
+		iiod_io_send_response(io, buf.size, &buf, 1);
+	} else {
+		iiod_io_send_response_code(io, -EINVAL);
+	}
+}
+
+static void handle_print_bin(struct parser_pdata *pdata,
+			     const struct iiod_command *cmd,
+			     struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_buf buf;
+
+	if (pdata->xml_cache->bin) {
+		buf.ptr = pdata->xml_cache->bin;
+		buf.size = pdata->xml_cache->bin_len;
 
-		iiod_io_send_response(io, pdata->xml_zstd_len, &buf, 1);
+		iiod_io_send_response(io, buf.size, &buf, 1);
 	} else {
 		iiod_io_send_response_code(io, -EINVAL);
 	}
 }
 
+static void handle_print_bin_filtered(struct parser_pdata *pdata,
+				      const struct iiod_command *cmd,
+				      struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	uint32_t len = (uint32_t) cmd->code;
+	struct iiod_buf buf;
+	void *bin = NULL;
+	char *devs;
+	ssize_t ret;
+
+	if (!len || len > 0xffff) {
+		iiod_io_send_response_code(io, -EINVAL);
+		return;
+	}
+
+	devs = bufpool_get(len + 1);
+	if (!devs) {
+		iiod_io_send_response_code(io, -ENOMEM);
+		return;
+	}
+
+	buf.ptr = devs;
+	buf.size = len;
+
+	ret = iiod_command_data_read(cmd_data, &buf);
+	if (ret < 0)
+		goto out_free_devs;
+
+	devs[len] = '\0';
+
+	/* The subset changes with every filter, so unlike the full
+	 * description it is serialized per-request. */
+	ret = iio_context_serialize_binary_filtered(pdata->ctx, &bin, devs);
+	if (ret < 0)
+		goto out_free_devs;
+
+	buf.ptr = bin;
+	buf.size = (size_t) ret;
+
+	ret = iiod_io_send_response(io, buf.size, &buf, 1);
+	free(bin);
+	bufpool_put(devs);
+	return;
+
+out_free_devs:
+	bufpool_put(devs);
+	iiod_io_send_response_code(io, ret);
+}
+
 static void handle_timeout(struct parser_pdata *pdata,
 			   const struct iiod_command *cmd,
 			   struct iiod_command_data *cmd_data)
@@ -210,7 +291,7 @@ static void handle_write_attr(struct parser_pdata *pdata,
 	if (ret < 0)
 		goto out_send_response;
 
-	buf.ptr = malloc(len);
+	buf.ptr = bufpool_get(len);
 	if (!buf.ptr) {
 		ret = -ENOMEM;
 		goto out_send_response;
@@ -225,7 +306,454 @@ static void handle_write_attr(struct parser_pdata *pdata,
 	ret = attr_write(pdata, cmd, attr, buf.ptr, (size_t) len);
 
 out_free_buf:
-	free(buf.ptr);
+	bufpool_put(buf.ptr);
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static int iiod_command_data_drain(struct iiod_command_data *cmd_data,
+				   size_t len)
+{
+	struct iiod_buf buf;
+	char drain[256];
+	int ret;
+
+	buf.ptr = drain;
+
+	while (len) {
+		buf.size = len > sizeof(drain) ? sizeof(drain) : len;
+
+		ret = iiod_command_data_read(cmd_data, &buf);
+		if (ret < 0)
+			return ret;
+
+		len -= buf.size;
+	}
+
+	return 0;
+}
+
+struct watch_entry {
+	SLIST_ENTRY(watch_entry) entry;
+
+	/* Synthesized IIOD_OP_READ_*ATTR command addressing the
+	 * watched attribute, fed to get_attr() / attr_read(). */
+	struct iiod_command cmd;
+
+	/* Dedicated writer whose client_id is the watch ID, so that the
+	 * pushes carry it without a wire format of their own. */
+	struct iiod_io *io;
+
+	uint16_t id;
+	unsigned int period_ms;
+	uint64_t next_due_us;
+
+	/* Last pushed value (or negative read error), for the change
+	 * detection. Starts at -ENODATA so that the first read always
+	 * pushes an initial snapshot. */
+	char value[IIOD_WATCH_MAX_LEN];
+	ssize_t value_len;
+};
+
+static void watch_push(struct watch_entry *watch)
+{
+	struct iiod_command cmd;
+	struct iiod_buf buf;
+
+	cmd.op = IIOD_OP_WATCH_ATTR;
+	cmd.dev = watch->cmd.dev;
+	cmd.code = (int32_t) watch->value_len;
+
+	buf.ptr = watch->value;
+	buf.size = watch->value_len > 0 ? (size_t) watch->value_len : 0;
+
+	iiod_io_send_command(watch->io, &cmd, &buf, buf.size ? 1 : 0);
+}
+
+static void * watch_thd(void *d)
+{
+	struct parser_pdata *pdata = d;
+	struct watch_entry *watch;
+	char buf[IIOD_WATCH_MAX_LEN];
+	const char *attr;
+	struct timespec ts;
+	uint64_t now, due;
+	ssize_t ret;
+
+	pthread_mutex_lock(&pdata->watch_lock);
+
+	while (!pdata->watch_stop) {
+		if (SLIST_EMPTY(&pdata->watchlist)) {
+			pthread_cond_wait(&pdata->watch_cond,
+					  &pdata->watch_lock);
+			continue;
+		}
+
+		now = iiod_responder_read_counter_us();
+		due = now + UINT32_MAX;
+
+		SLIST_FOREACH(watch, &pdata->watchlist, entry) {
+			if (watch->next_due_us <= now) {
+				attr = get_attr(pdata, &watch->cmd);
+				ret = -EINVAL;
+				if (attr)
+					ret = attr_read(pdata, &watch->cmd,
+							attr, buf, sizeof(buf));
+
+				if (ret != watch->value_len ||
+				    (ret > 0 && memcmp(buf, watch->value,
+						       (size_t) ret))) {
+					if (ret > 0)
+						memcpy(watch->value, buf,
+						       (size_t) ret);
+					watch->value_len = ret;
+					watch_push(watch);
+				}
+
+				watch->next_due_us = now +
+					watch->period_ms * 1000ull;
+			}
+
+			if (watch->next_due_us < due)
+				due = watch->next_due_us;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += (time_t) ((due - now) / 1000000);
+		ts.tv_nsec += (long) ((due - now) % 1000000) * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+
+		pthread_cond_timedwait(&pdata->watch_cond,
+				       &pdata->watch_lock, &ts);
+	}
+
+	pthread_mutex_unlock(&pdata->watch_lock);
+
+	return NULL;
+}
+
+static int watch_thd_start(struct parser_pdata *pdata)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	if (pdata->watch_thd_started)
+		return 0;
+
+	pthread_mutex_init(&pdata->watch_lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pdata->watch_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	ret = pthread_create(&pdata->watch_thd, NULL, watch_thd, pdata);
+	if (ret) {
+		pthread_cond_destroy(&pdata->watch_cond);
+		pthread_mutex_destroy(&pdata->watch_lock);
+		return -ret;
+	}
+
+	pdata->watch_thd_started = true;
+
+	return 0;
+}
+
+static void handle_watch_attr(struct parser_pdata *pdata,
+			      const struct iiod_command *cmd,
+			      struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_watch_params params;
+	struct watch_entry *watch;
+	struct iiod_buf readbuf;
+	int ret;
+
+	readbuf.ptr = &params;
+	readbuf.size = sizeof(params);
+
+	ret = iiod_command_data_read(cmd_data, &readbuf);
+	if (ret < 0)
+		goto out_send_response;
+
+	watch = zalloc(sizeof(*watch));
+	if (!watch) {
+		ret = -ENOMEM;
+		goto out_send_response;
+	}
+
+	watch->cmd.op = params.op;
+	watch->cmd.dev = cmd->dev;
+	watch->cmd.code = cmd->code;
+	watch->id = params.id;
+	watch->period_ms = params.period_ms ? params.period_ms : 100;
+	watch->value_len = -ENODATA;
+
+	switch (params.op) {
+	case IIOD_OP_READ_ATTR:
+	case IIOD_OP_READ_DBG_ATTR:
+	case IIOD_OP_READ_BUF_ATTR:
+	case IIOD_OP_READ_CHN_ATTR:
+		break;
+	default:
+		ret = -EINVAL;
+		goto out_free_watch;
+	}
+
+	if (!get_attr(pdata, &watch->cmd)) {
+		ret = -ENOENT;
+		goto out_free_watch;
+	}
+
+	ret = watch_thd_start(pdata);
+	if (ret)
+		goto out_free_watch;
+
+	watch->io = iiod_responder_create_io(pdata->responder, watch->id);
+	ret = iio_err(watch->io);
+	if (ret) {
+		watch->io = NULL;
+		goto out_free_watch;
+	}
+
+	pthread_mutex_lock(&pdata->watch_lock);
+	SLIST_INSERT_HEAD(&pdata->watchlist, watch, entry);
+	pthread_cond_signal(&pdata->watch_cond);
+	pthread_mutex_unlock(&pdata->watch_lock);
+
+	ret = 0;
+	goto out_send_response;
+
+out_free_watch:
+	free(watch);
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static void handle_unwatch_attr(struct parser_pdata *pdata,
+				const struct iiod_command *cmd,
+				struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct watch_entry *watch;
+	int ret = -ENOENT;
+
+	if (!pdata->watch_thd_started)
+		goto out_send_response;
+
+	pthread_mutex_lock(&pdata->watch_lock);
+
+	SLIST_FOREACH(watch, &pdata->watchlist, entry) {
+		if (watch->id == (uint16_t) cmd->code) {
+			SLIST_REMOVE(&pdata->watchlist, watch,
+				     watch_entry, entry);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pdata->watch_lock);
+
+	if (watch) {
+		iiod_io_unref(watch->io);
+		free(watch);
+		ret = 0;
+	}
+
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static void watch_free_resources(struct parser_pdata *pdata)
+{
+	struct watch_entry *watch, *next;
+
+	if (!pdata->watch_thd_started)
+		return;
+
+	pthread_mutex_lock(&pdata->watch_lock);
+	pdata->watch_stop = true;
+	pthread_cond_signal(&pdata->watch_cond);
+	pthread_mutex_unlock(&pdata->watch_lock);
+
+	pthread_join(pdata->watch_thd, NULL);
+
+	for (watch = SLIST_FIRST(&pdata->watchlist); watch; watch = next) {
+		next = SLIST_NEXT(watch, entry);
+		iiod_io_unref(watch->io);
+		free(watch);
+	}
+
+	SLIST_INIT(&pdata->watchlist);
+	pthread_cond_destroy(&pdata->watch_cond);
+	pthread_mutex_destroy(&pdata->watch_lock);
+	pdata->watch_thd_started = false;
+}
+
+static void handle_read_attrs(struct parser_pdata *pdata,
+			      const struct iiod_command *cmd,
+			      struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_command attr_cmd = { 0 };
+	struct iiod_attrs_entry *entries;
+	struct iiod_buf buf;
+	uint8_t *resp;
+	char attr_buf[0x10000];
+	const char *attr;
+	size_t i, nb = (uint32_t) cmd->code, len, pos = 0, resp_len = 0;
+	ssize_t ret = -EINVAL;
+	int32_t code;
+
+	if (!nb || nb > 0xffff)
+		goto out_send_response;
+
+	entries = calloc(nb, sizeof(*entries));
+	if (!entries) {
+		/* Drain the command data to keep the stream in sync */
+		iiod_command_data_drain(cmd_data, nb * sizeof(*entries));
+		ret = -ENOMEM;
+		goto out_send_response;
+	}
+
+	buf.ptr = entries;
+	buf.size = nb * sizeof(*entries);
+
+	ret = iiod_command_data_read(cmd_data, &buf);
+	if (ret < 0)
+		goto out_free_entries;
+
+	for (i = 0; i < nb; i++)
+		resp_len += sizeof(int32_t) + IIOD_ATTRS_PAD(entries[i].len);
+
+	resp = calloc(1, resp_len);
+	if (!resp) {
+		ret = -ENOMEM;
+		goto out_free_entries;
+	}
+
+	for (i = 0; i < nb; i++) {
+		attr_cmd.op = entries[i].op;
+		attr_cmd.dev = entries[i].dev;
+		attr_cmd.code = (entries[i].arg1 << 16) | entries[i].arg2;
+
+		len = entries[i].len;
+		if (len > sizeof(attr_buf))
+			len = sizeof(attr_buf);
+
+		attr = get_attr(pdata, &attr_cmd);
+		if (attr)
+			ret = attr_read(pdata, &attr_cmd, attr, attr_buf, len);
+		else
+			ret = -EINVAL;
+
+		code = (int32_t) ret;
+		memcpy(&resp[pos], &code, sizeof(code));
+		pos += sizeof(code);
+
+		if (code > 0) {
+			memcpy(&resp[pos], attr_buf, (size_t) code);
+			pos += IIOD_ATTRS_PAD(code);
+		}
+	}
+
+	buf.ptr = resp;
+	buf.size = pos;
+
+	iiod_io_send_response(io, pos, &buf, 1);
+
+	free(resp);
+	free(entries);
+	return;
+
+out_free_entries:
+	free(entries);
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static void handle_write_attrs(struct parser_pdata *pdata,
+			       const struct iiod_command *cmd,
+			       struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_command attr_cmd = { 0 };
+	struct iiod_attrs_entry *entries;
+	struct iiod_buf buf;
+	uint8_t *values, *ptr;
+	int32_t *codes;
+	const char *attr;
+	size_t i, nb = (uint32_t) cmd->code, values_len = 0;
+	ssize_t ret = -EINVAL;
+
+	if (!nb || nb > 0xffff)
+		goto out_send_response;
+
+	entries = calloc(nb, sizeof(*entries));
+	if (!entries) {
+		iiod_command_data_drain(cmd_data, nb * sizeof(*entries));
+		ret = -ENOMEM;
+		goto out_send_response;
+	}
+
+	buf.ptr = entries;
+	buf.size = nb * sizeof(*entries);
+
+	ret = iiod_command_data_read(cmd_data, &buf);
+	if (ret < 0)
+		goto out_free_entries;
+
+	for (i = 0; i < nb; i++)
+		values_len += IIOD_ATTRS_PAD(entries[i].len);
+
+	values = malloc(values_len);
+	codes = calloc(nb, sizeof(*codes));
+	if (!values || !codes) {
+		iiod_command_data_drain(cmd_data, values_len);
+		ret = -ENOMEM;
+		goto out_free_values;
+	}
+
+	buf.ptr = values;
+	buf.size = values_len;
+
+	ret = iiod_command_data_read(cmd_data, &buf);
+	if (ret < 0)
+		goto out_free_values;
+
+	for (i = 0, ptr = values; i < nb; i++) {
+		attr_cmd.op = entries[i].op;
+		attr_cmd.dev = entries[i].dev;
+		attr_cmd.code = (entries[i].arg1 << 16) | entries[i].arg2;
+
+		attr = get_attr(pdata, &attr_cmd);
+		if (attr) {
+			ret = attr_write(pdata, &attr_cmd, attr, ptr,
+					 entries[i].len);
+		} else {
+			ret = -EINVAL;
+		}
+
+		codes[i] = (int32_t) ret;
+		ptr += IIOD_ATTRS_PAD(entries[i].len);
+	}
+
+	buf.ptr = codes;
+	buf.size = nb * sizeof(*codes);
+
+	iiod_io_send_response(io, buf.size, &buf, 1);
+
+	free(codes);
+	free(values);
+	free(entries);
+	return;
+
+out_free_values:
+	free(codes);
+	free(values);
+out_free_entries:
+	free(entries);
 out_send_response:
 	iiod_io_send_response_code(io, ret);
 }
@@ -293,15 +821,202 @@ static bool iio_buffer_is_tx(const struct iio_buffer *buf)
 	const struct iio_channel *ch;
 	unsigned int i;
 
-	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
-		ch = iio_device_get_channel(dev, i);
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		ch = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_output(ch) &&
+		    iio_channel_is_scan_element(ch))
+			return true;
+	}
+
+	return false;
+}
+
+#if WITH_ZSTD
+/* Read a compressed TX payload: a 64-bit compressed size (zero if the
+ * client sent the data raw), then the payload itself. */
+static ssize_t zstd_read_block(struct parser_pdata *pdata,
+			       struct iiod_command_data *cmd_data,
+			       void *dst, size_t max_len, size_t bytes_used)
+{
+	struct iiod_buf readbuf;
+	uint64_t csize;
+	size_t len;
+	ssize_t ret;
+
+	readbuf.ptr = &csize;
+	readbuf.size = sizeof(csize);
+
+	ret = iiod_command_data_read(cmd_data, &readbuf);
+	if (ret < 0)
+		return ret;
+
+	if (!csize) {
+		readbuf.ptr = dst;
+		readbuf.size = bytes_used < max_len ? bytes_used : max_len;
+
+		return iiod_command_data_read(cmd_data, &readbuf);
+	}
+
+	pthread_mutex_lock(&pdata->zstd_lock);
+
+	if (pdata->zstd_scratch_len < csize) {
+		bufpool_put(pdata->zstd_scratch);
+		pdata->zstd_scratch = bufpool_get(csize);
+		pdata->zstd_scratch_len = pdata->zstd_scratch ? csize : 0;
+	}
+
+	if (!pdata->zstd_scratch) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	readbuf.ptr = pdata->zstd_scratch;
+	readbuf.size = csize;
+
+	ret = iiod_command_data_read(cmd_data, &readbuf);
+	if (ret < 0)
+		goto out_unlock;
+
+	len = ZSTD_decompressDCtx(pdata->zstd_dctx, dst, max_len,
+				  pdata->zstd_scratch, csize);
+	ret = ZSTD_isError(len) ? -EIO : (ssize_t) len;
+
+out_unlock:
+	pthread_mutex_unlock(&pdata->zstd_lock);
+	return ret;
+}
+
+/* Compress a RX payload and send it as the response, with the compressed
+ * size in the response code. The scratch buffer is reused until the
+ * response has been written out, so the lock is held across the send. */
+static void zstd_send_block(struct parser_pdata *pdata, struct iiod_io *io,
+			    void *ptr, size_t len)
+{
+	struct iiod_buf data;
+	size_t bound, csize;
+
+	pthread_mutex_lock(&pdata->zstd_lock);
+
+	bound = ZSTD_compressBound(len);
+
+	if (pdata->zstd_scratch_len < bound) {
+		bufpool_put(pdata->zstd_scratch);
+		pdata->zstd_scratch = bufpool_get(bound);
+		pdata->zstd_scratch_len = pdata->zstd_scratch ? bound : 0;
+	}
+
+	if (!pdata->zstd_scratch) {
+		iiod_io_send_response_code(io, -ENOMEM);
+		goto out_unlock;
+	}
+
+	csize = ZSTD_compress2(pdata->zstd_cctx, pdata->zstd_scratch,
+			       bound, ptr, len);
+	if (ZSTD_isError(csize)) {
+		iiod_io_send_response_code(io, -EIO);
+		goto out_unlock;
+	}
+
+	data.ptr = pdata->zstd_scratch;
+	data.size = csize;
+
+	iiod_io_send_response(io, csize, &data, 1);
+
+out_unlock:
+	pthread_mutex_unlock(&pdata->zstd_lock);
+}
+
+static void zstd_release(struct parser_pdata *pdata)
+{
+	if (!pdata->zstd_cctx)
+		return;
+
+	ZSTD_freeCCtx(pdata->zstd_cctx);
+	ZSTD_freeDCtx(pdata->zstd_dctx);
+	bufpool_put(pdata->zstd_scratch);
+	pthread_mutex_destroy(&pdata->zstd_lock);
+
+	pdata->zstd_cctx = NULL;
+	pdata->zstd_dctx = NULL;
+	pdata->zstd_scratch = NULL;
+	pdata->zstd_scratch_len = 0;
+}
+#endif
+
+static int pack_grow_scratch(struct buffer_entry *entry, size_t len)
+{
+	if (entry->pack_buf_len >= len)
+		return 0;
+
+	bufpool_put(entry->pack_buf);
+	entry->pack_buf = bufpool_get(len);
+	entry->pack_buf_len = entry->pack_buf ? len : 0;
+
+	return entry->pack_buf ? 0 : -ENOMEM;
+}
+
+static int demux_grow_scratch(struct buffer_entry *entry, size_t len)
+{
+	if (entry->demux_buf_len >= len)
+		return 0;
+
+	bufpool_put(entry->demux_buf);
+	entry->demux_buf = bufpool_get(len);
+	entry->demux_buf_len = entry->demux_buf ? len : 0;
+
+	return entry->demux_buf ? 0 : -ENOMEM;
+}
+
+/* If the hardware could not honor the channel mask the client requested,
+ * and server-side demuxing is enabled, keep the requested mask around:
+ * blocks will be converted between the device layout and the requested
+ * layout on their way through, the client is told that its mask was
+ * honored, and only the channels it asked for cross the wire. */
+static void buffer_entry_setup_demux(struct buffer_entry *entry,
+				     const struct iio_channels_mask *mask,
+				     const uint32_t *req_words,
+				     unsigned int nb_channels)
+{
+	struct iio_channels_mask *demux_mask;
+	struct iio_channel *chn;
+	ssize_t dev_ss, client_ss;
+	unsigned int i;
+
+	/* Demuxing can only remove channels; if one of the requested
+	 * channels did not make it into the hardware mask, report the
+	 * hardware mask as usual. */
+	for (i = 0; i < nb_channels; i++) {
+		if (TEST_BIT(req_words, i) && !TEST_BIT(entry->words, i))
+			return;
+	}
 
-		if (iio_channel_is_output(ch) &&
-		    iio_channel_is_scan_element(ch))
-			return true;
+	demux_mask = iio_create_channels_mask(nb_channels);
+	if (!demux_mask)
+		return;
+
+	for (i = 0; i < nb_channels; i++) {
+		chn = iio_device_get_channel(entry->dev, i);
+
+		if (TEST_BIT(req_words, i))
+			iio_channel_enable(chn, demux_mask);
+		else
+			iio_channel_disable(chn, demux_mask);
 	}
 
-	return false;
+	dev_ss = iio_device_get_sample_size(entry->dev, mask);
+	client_ss = iio_device_get_sample_size(entry->dev, demux_mask);
+	if (dev_ss <= 0 || client_ss <= 0) {
+		iio_channels_mask_destroy(demux_mask);
+		return;
+	}
+
+	entry->demux_mask = demux_mask;
+	entry->dev_sample_size = (size_t) dev_ss;
+	entry->client_sample_size = (size_t) client_ss;
+
+	/* Report the requested mask back to the client */
+	memcpy(entry->words, req_words, ((nb_channels + 31) / 32) * 4);
 }
 
 static int buffer_enqueue_block(void *priv, void *d)
@@ -315,10 +1030,13 @@ static int buffer_enqueue_block(void *priv, void *d)
 	if (ret)
 		goto out_send_response;
 
-	if (entry->cyclic)
+	if (entry->cyclic) {
+		/* Cyclic blocks are never dequeued; count them here. */
+		iiod_stats_inc(&buffer->pdata->stats.blocks_tx);
 		goto out_send_response;
+	}
 
-	ret = iio_task_enqueue_autoclear(buffer->dequeue_task, entry);
+	ret = spsc_worker_push(&buffer->dequeue_worker, entry);
 	if (ret)
 		goto out_send_response;
 
@@ -337,13 +1055,135 @@ static int buffer_dequeue_block(void *priv, void *d)
 	unsigned int nb_data = 0;
 	intptr_t ret;
 
-	ret = iio_block_dequeue(entry->block, false);
+	/* Try without blocking first, so that dequeues which have to wait
+	 * for the hardware show up in the queue_stalls counter. */
+	ret = iio_block_dequeue(entry->block, true);
+	if (ret == -EBUSY) {
+		iiod_stats_inc(&buffer->pdata->stats.queue_stalls);
+		ret = iio_block_dequeue(entry->block, false);
+	}
 	if (ret < 0)
 		goto out_send_response;
 
+	if (iio_buffer_is_tx(buffer->buf))
+		iiod_stats_inc(&buffer->pdata->stats.blocks_tx);
+	else
+		iiod_stats_inc(&buffer->pdata->stats.blocks_rx);
+
 	if (!iio_buffer_is_tx(buffer->buf)) {
 		data.ptr = iio_block_start(entry->block);
 		data.size = iio_block_end(entry->block) - data.ptr;
+
+		/* Shared-memory block: land the payload straight in the
+		 * client's mapping; the response only carries the code. */
+		if (entry->memfd_ptr) {
+			if (buffer->demux_mask) {
+				struct mem_sample_cb_info info;
+				size_t len = data.size / buffer->dev_sample_size
+					* buffer->client_sample_size;
+
+				if (len > entry->memfd_len) {
+					ret = -EINVAL;
+					goto out_send_response;
+				}
+
+				info.ptr = entry->memfd_ptr;
+				info.nb_bytes = len;
+				info.cpt = 0;
+
+				ret = iio_block_foreach_sample(entry->block,
+							       buffer->demux_mask,
+							       iiod_demux_sample,
+							       &info);
+				if (ret < 0)
+					goto out_send_response;
+
+				ret = info.cpt;
+			} else {
+				if (data.size > entry->memfd_len)
+					data.size = entry->memfd_len;
+
+				memcpy(entry->memfd_ptr, data.ptr, data.size);
+				ret = data.size;
+			}
+
+			goto out_send_response;
+		}
+
+		if (buffer->demux_mask) {
+			struct mem_sample_cb_info info;
+			size_t len = data.size / buffer->dev_sample_size
+				* buffer->client_sample_size;
+
+			ret = demux_grow_scratch(buffer, len);
+			if (ret)
+				goto out_send_response;
+
+			info.ptr = buffer->demux_buf;
+			info.nb_bytes = len;
+			info.cpt = 0;
+
+			ret = iio_block_foreach_sample(entry->block,
+						       buffer->demux_mask,
+						       iiod_demux_sample,
+						       &info);
+			if (ret < 0)
+				goto out_send_response;
+
+			data.ptr = buffer->demux_buf;
+			data.size = info.cpt;
+		}
+
+		if (buffer->pdata->nb_stripes) {
+			/* Payload goes out-of-band on the stripe
+			 * connections. Send the response first: the client
+			 * waits for it before draining the stripes. */
+			iiod_io_send_response_code(entry->io, data.size);
+			stripe_write_block(buffer->pdata, entry->tag,
+					   data.ptr, data.size);
+			return 0;
+		}
+
+		if (buffer->pdata->udp_fd >= 0) {
+			/* Payload goes out as datagrams; the response
+			 * first, it carries the size the client should
+			 * expect. */
+			iiod_io_send_response_code(entry->io, data.size);
+			udp_send_block(buffer->pdata, entry->tag,
+				       data.ptr, data.size);
+			return 0;
+		}
+
+		if (buffer->pack) {
+			size_t packed = iio_packed_size(data.size,
+							buffer->pack_bits,
+							buffer->pack_length);
+
+			ret = pack_grow_scratch(buffer, packed);
+			if (ret)
+				goto out_send_response;
+
+			iio_pack_samples(buffer->pack_buf, data.ptr, data.size,
+					 buffer->pack_bits,
+					 buffer->pack_length,
+					 buffer->pack_shift);
+
+			data.ptr = buffer->pack_buf;
+			data.size = packed;
+			nb_data++;
+
+			ret = packed;
+			goto out_send_response;
+		}
+
+#if WITH_ZSTD
+		if (buffer->pdata->zstd_cctx) {
+			zstd_send_block(buffer->pdata, entry->io,
+					data.ptr, data.size);
+			return 0;
+		}
+#endif
+
 		nb_data++;
 
 		ret = data.size;
@@ -366,6 +1206,7 @@ static void handle_create_buffer(struct parser_pdata *pdata,
 	struct buffer_entry *entry;
 	struct iio_buffer *buf;
 	struct iiod_buf data;
+	uint32_t *req_words = NULL;
 	unsigned int i, nb_channels;
 	size_t nb_words;
 	int ret = -EINVAL;
@@ -397,6 +1238,14 @@ static void handle_create_buffer(struct parser_pdata *pdata,
 	if (ret < 0)
 		goto err_free_words;
 
+	/* Keep a copy of the requested bitmask, to detect whether the
+	 * hardware rounded it up when creating the buffer. */
+	if (server_demux) {
+		req_words = malloc(nb_words * 4);
+		if (req_words)
+			memcpy(req_words, entry->words, nb_words * 4);
+	}
+
 	/* Create a temporary mask object */
 	mask = iio_create_channels_mask(nb_channels);
 	if (!mask) {
@@ -414,25 +1263,24 @@ static void handle_create_buffer(struct parser_pdata *pdata,
 			iio_channel_disable(chn, mask);
 	}
 
-	entry->enqueue_task = iio_task_create(buffer_enqueue_block, entry,
-					      "buffer-enqueue-thd");
-	ret = iio_err(entry->enqueue_task);
+	ret = spsc_worker_init(&entry->enqueue_worker, buffer_enqueue_block,
+			       entry, "buffer-enqueue-thd");
 	if (ret)
 		goto err_free_mask;
 
-	entry->dequeue_task = iio_task_create(buffer_dequeue_block, entry,
-					      "buffer-dequeue-thd");
-	ret = iio_err(entry->dequeue_task);
+	ret = spsc_worker_init(&entry->dequeue_worker, buffer_dequeue_block,
+			       entry, "buffer-dequeue-thd");
 	if (ret)
-		goto err_destroy_enqueue_task;
+		goto err_destroy_enqueue_worker;
 
+	entry->pdata = pdata;
 	entry->dev = dev;
 	entry->idx = (uint16_t) cmd->code;
 
 	buf = iio_device_create_buffer(dev, entry->idx, mask);
 	ret = iio_err(buf);
 	if (ret)
-		goto err_destroy_dequeue_task;
+		goto err_destroy_dequeue_worker;
 
 	/* Rewrite the "words" bitmask according to the mask object,
 	 * which may have been modified when creating the buffer. */
@@ -445,6 +1293,11 @@ static void handle_create_buffer(struct parser_pdata *pdata,
 			entry->words[BIT_WORD(i)] &= ~BIT_MASK(i);
 	}
 
+	if (req_words && memcmp(req_words, entry->words, nb_words * 4))
+		buffer_entry_setup_demux(entry, mask, req_words, nb_channels);
+
+	free(req_words);
+
 	/* Success, destroy the temporary mask object */
 	iio_channels_mask_destroy(mask);
 
@@ -460,13 +1313,14 @@ static void handle_create_buffer(struct parser_pdata *pdata,
 	iiod_io_send_response(io, data.size, &data, 1);
 	return;
 
-err_destroy_dequeue_task:
-	iio_task_destroy(entry->dequeue_task);
-err_destroy_enqueue_task:
-	iio_task_destroy(entry->enqueue_task);
+err_destroy_dequeue_worker:
+	spsc_worker_destroy(&entry->dequeue_worker);
+err_destroy_enqueue_worker:
+	spsc_worker_destroy(&entry->enqueue_worker);
 err_free_mask:
 	iio_channels_mask_destroy(mask);
 err_free_words:
+	free(req_words);
 	free(entry->words);
 err_free_entry:
 	free(entry);
@@ -598,13 +1452,17 @@ static void handle_set_enabled_buffer(struct parser_pdata *pdata,
 		goto out_send_response;
 
 	if (enabled) {
-		iio_task_start(entry->enqueue_task);
-		iio_task_start(entry->dequeue_task);
+		spsc_worker_start(&entry->enqueue_worker);
+		spsc_worker_start(&entry->dequeue_worker);
 		ret = iio_buffer_enable(buf);
 	} else {
 		ret = iio_buffer_disable(buf);
-		iio_task_stop(entry->dequeue_task);
-		iio_task_stop(entry->enqueue_task);
+		/* Stop the enqueue side first: its handler pushes into the
+		 * dequeue ring, and parking that worker while the dequeue
+		 * side still consumes lets any in-flight enqueue finish
+		 * instead of failing against a paused ring. */
+		spsc_worker_stop(&entry->enqueue_worker);
+		spsc_worker_stop(&entry->dequeue_worker);
 	}
 
 out_send_response:
@@ -629,13 +1487,15 @@ static void handle_create_block(struct parser_pdata *pdata,
 				const struct iiod_command *cmd,
 				struct iiod_command_data *cmd_data)
 {
+	struct buffer_entry *buf_entry;
 	struct block_entry *entry;
 	struct iio_block *block;
 	struct iio_buffer *buf;
 	struct iiod_buf data;
 	uint64_t block_size;
+	size_t memfd_len = 0;
 	struct iiod_io *io;
-	int ret;
+	int ret, memfd = -1;
 
 	io = iiod_command_create_io(cmd, cmd_data);
 	ret = iio_err(io);
@@ -651,11 +1511,42 @@ static void handle_create_block(struct parser_pdata *pdata,
 	if (ret < 0)
 		goto out_send_response;
 
-	buf = get_iio_buffer(pdata, cmd, NULL);
+	/* Shared-memory block: the client attached a memfd of the block's
+	 * size (in its own sample layout) to the command bytes. */
+	if (cmd->op == IIOD_OP_CREATE_BLOCK_MEMFD) {
+		struct stat st;
+
+		memfd = take_received_fd(pdata);
+		if (memfd < 0) {
+			ret = -EPROTO;
+			goto out_send_response;
+		}
+
+		memfd_len = (size_t) block_size;
+
+		if (fstat(memfd, &st) < 0 || st.st_size < (off_t) memfd_len) {
+			ret = -EINVAL;
+			goto out_send_response;
+		}
+	}
+
+	buf = get_iio_buffer(pdata, cmd, &buf_entry);
 	ret = iio_err(buf);
 	if (ret)
 		goto out_send_response;
 
+	/* When demuxing, the client sized its block for the channels it
+	 * requested; scale it up to the device's sample size. */
+	if (buf_entry->demux_mask) {
+		if (block_size % buf_entry->client_sample_size) {
+			ret = -EINVAL;
+			goto out_send_response;
+		}
+
+		block_size = block_size / buf_entry->client_sample_size
+			* buf_entry->dev_sample_size;
+	}
+
 	block = get_iio_block(pdata, cmd, NULL);
 	ret = iio_err(block);
 	if (ret == 0) {
@@ -681,6 +1572,21 @@ static void handle_create_block(struct parser_pdata *pdata,
 	entry->io = io;
 	entry->client_id = cmd->client_id;
 
+	if (memfd >= 0) {
+		entry->memfd_ptr = mmap(NULL, memfd_len,
+					PROT_READ | PROT_WRITE, MAP_SHARED,
+					memfd, 0);
+		if (entry->memfd_ptr == MAP_FAILED) {
+			ret = -errno;
+			entry->memfd_ptr = NULL;
+			iio_block_destroy(block);
+			free(entry);
+			goto out_send_response;
+		}
+
+		entry->memfd_len = memfd_len;
+	}
+
 	/* Keep a reference to the iiod_io until the block is freed. */
 	iiod_io_ref(io);
 
@@ -689,6 +1595,11 @@ static void handle_create_block(struct parser_pdata *pdata,
 	pthread_mutex_unlock(&buflist_lock);
 
 out_send_response:
+	/* The mapping keeps the memory alive, the descriptor is not
+	 * needed anymore. */
+	if (memfd >= 0)
+		close(memfd);
+
 	iiod_io_send_response_code(io, ret);
 	iiod_io_unref(io);
 }
@@ -768,20 +1679,125 @@ static void handle_transfer_block(struct parser_pdata *pdata,
 	if (ret < 0)
 		goto out_send_response;
 
-	/* Read the data into the block if we are dealing with a TX buffer */
-	if (iio_buffer_is_tx(buf)) {
+	/* A cyclic enqueue without payload references the waveform the
+	 * block already holds from a previous transfer: loop it from the
+	 * local kernel buffer, nothing crosses the wire again. */
+	if (iio_buffer_is_tx(buf) && !bytes_used && block_entry->bytes_used &&
+	    cmd->op == IIOD_OP_ENQUEUE_BLOCK_CYCLIC) {
+		bytes_used = block_entry->bytes_used;
+	} else if (iio_buffer_is_tx(buf) && block_entry->memfd_ptr) {
+		/* Shared-memory block: the payload already sits in the
+		 * client's mapping, nothing crosses the socket. */
 		readbuf.ptr = iio_block_start(block);
 		readbuf.size = iio_block_end(block) - readbuf.ptr;
 
-		ret = iiod_command_data_read(cmd_data, &readbuf);
+		if (entry->demux_mask) {
+			struct mem_sample_cb_info info = {
+				.ptr = block_entry->memfd_ptr,
+				.nb_bytes = block_entry->memfd_len,
+			};
+
+			ret = iio_block_foreach_sample(block, entry->demux_mask,
+						       iiod_mux_sample, &info);
+			if (ret < 0)
+				goto out_send_response;
+
+			/* Scale bytes_used back to the device layout */
+			bytes_used = (bytes_used + entry->client_sample_size - 1)
+				/ entry->client_sample_size
+				* entry->dev_sample_size;
+		} else {
+			if (bytes_used > readbuf.size)
+				bytes_used = readbuf.size;
+			if (bytes_used > block_entry->memfd_len)
+				bytes_used = block_entry->memfd_len;
+
+			memcpy(readbuf.ptr, block_entry->memfd_ptr,
+			       (size_t) bytes_used);
+		}
+	} else if (iio_buffer_is_tx(buf)) {
+		/* Read the data into the block */
+		readbuf.ptr = iio_block_start(block);
+		readbuf.size = iio_block_end(block) - readbuf.ptr;
+
+		if (entry->demux_mask) {
+			/* The payload is laid out with the client's sample
+			 * size; receive it into the scratch buffer, and mux
+			 * it into the block afterwards. */
+			size_t len = readbuf.size / entry->dev_sample_size
+				* entry->client_sample_size;
+
+			ret = demux_grow_scratch(entry, len);
+			if (ret)
+				goto out_send_response;
+
+			readbuf.ptr = entry->demux_buf;
+			readbuf.size = len;
+		}
+
+		if (pdata->nb_stripes) {
+			ret = stripe_read_block(pdata,
+						(uint64_t)(uint32_t) cmd->code,
+						readbuf.ptr, readbuf.size);
+		} else if (entry->pack && bytes_used &&
+			   bytes_used <= readbuf.size) {
+			struct iiod_buf packbuf;
+
+			packbuf.size = iio_packed_size((size_t) bytes_used,
+						       entry->pack_bits,
+						       entry->pack_length);
+
+			ret = pack_grow_scratch(entry, packbuf.size);
+			if (ret)
+				goto out_send_response;
+
+			packbuf.ptr = entry->pack_buf;
+
+			ret = iiod_command_data_read(cmd_data, &packbuf);
+			if (ret < 0)
+				goto out_send_response;
+
+			iio_unpack_samples(readbuf.ptr, entry->pack_buf,
+					   (size_t) bytes_used,
+					   entry->pack_bits,
+					   entry->pack_length,
+					   entry->pack_shift);
+#if WITH_ZSTD
+		} else if (pdata->zstd_dctx && bytes_used) {
+			ret = zstd_read_block(pdata, cmd_data, readbuf.ptr,
+					      readbuf.size,
+					      (size_t) bytes_used);
+#endif
+		} else {
+			ret = iiod_command_data_read(cmd_data, &readbuf);
+		}
 		if (ret < 0)
 			goto out_send_response;
+
+		if (entry->demux_mask) {
+			struct mem_sample_cb_info info = {
+				.ptr = entry->demux_buf,
+				.nb_bytes = readbuf.size,
+			};
+
+			ret = iio_block_foreach_sample(block,
+						       entry->demux_mask,
+						       iiod_mux_sample, &info);
+			if (ret < 0)
+				goto out_send_response;
+
+			/* Scale bytes_used back to the device layout */
+			bytes_used = (bytes_used + entry->client_sample_size - 1)
+				/ entry->client_sample_size
+				* entry->dev_sample_size;
+		}
 	}
 
+	block_entry->tag = (uint32_t) cmd->code;
 	block_entry->bytes_used = bytes_used;
 	block_entry->cyclic = cmd->op == IIOD_OP_ENQUEUE_BLOCK_CYCLIC;
 
-	ret = iio_task_enqueue_autoclear(entry->enqueue_task, block_entry);
+	ret = spsc_worker_push(&entry->enqueue_worker, block_entry);
 	if (ret)
 		goto out_send_response;
 
@@ -792,6 +1808,310 @@ out_send_response:
 	iiod_io_send_response_code(block_entry->io, ret);
 }
 
+static void handle_pack_enable(struct parser_pdata *pdata,
+			       const struct iiod_command *cmd,
+			       struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	unsigned int i, bits = 0, length = 0, shift = 0, nb_enabled = 0;
+	struct buffer_entry *entry;
+	const struct iio_channel *chn;
+	struct iio_buffer *buf;
+	struct iiod_buf readbuf;
+	uint8_t fmt[4];
+	int ret;
+
+	readbuf.ptr = fmt;
+	readbuf.size = sizeof(fmt);
+
+	ret = (int) iiod_command_data_read(cmd_data, &readbuf);
+	if (ret < 0)
+		goto out_send_response;
+
+	buf = get_iio_buffer(pdata, cmd, &entry);
+	ret = iio_err(buf);
+	if (ret)
+		goto out_send_response;
+
+	/* Verify the client's view of the sample format against our own,
+	 * derived from the buffer's channel mask. */
+	ret = -EINVAL;
+
+	for (i = 0; i < iio_device_get_channels_count(entry->dev); i++) {
+		chn = iio_device_get_channel(entry->dev, i);
+
+		if (!TEST_BIT(entry->words, i))
+			continue;
+
+		if (!iio_pack_format_ok(iio_channel_get_data_format(chn),
+					&bits, &length, &shift))
+			goto out_send_response;
+
+		nb_enabled++;
+	}
+
+	if (!nb_enabled || fmt[0] != bits || fmt[1] != length ||
+	    fmt[2] != shift)
+		goto out_send_response;
+
+	entry->pack_bits = bits;
+	entry->pack_length = length;
+	entry->pack_shift = shift;
+	entry->pack = true;
+	ret = 0;
+
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static void handle_zstd_enable(struct parser_pdata *pdata,
+			       const struct iiod_command *cmd,
+			       struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	int ret = -ENOSYS;
+#if WITH_ZSTD
+	struct iiod_buf readbuf;
+	size_t dict_len = (size_t)(uint32_t) cmd->code;
+	unsigned int level = cmd->dev;
+	void *dict = NULL;
+
+	ret = -EINVAL;
+	if (!level || level > (unsigned int) ZSTD_maxCLevel() ||
+	    pdata->zstd_cctx)
+		goto out_send_response;
+
+	if (dict_len) {
+		dict = malloc(dict_len);
+		if (!dict) {
+			ret = -ENOMEM;
+			goto out_send_response;
+		}
+
+		readbuf.ptr = dict;
+		readbuf.size = dict_len;
+
+		ret = (int) iiod_command_data_read(cmd_data, &readbuf);
+		if (ret < 0)
+			goto out_free_dict;
+	}
+
+	pdata->zstd_cctx = ZSTD_createCCtx();
+	pdata->zstd_dctx = ZSTD_createDCtx();
+	if (!pdata->zstd_cctx || !pdata->zstd_dctx) {
+		ret = -ENOMEM;
+		goto out_free_ctx;
+	}
+
+	ZSTD_CCtx_setParameter(pdata->zstd_cctx,
+			       ZSTD_c_compressionLevel, (int) level);
+
+	/* The dictionary is copied into the contexts and sticks to all
+	 * future frames. */
+	if (dict &&
+	    (ZSTD_isError(ZSTD_CCtx_loadDictionary(pdata->zstd_cctx,
+						   dict, dict_len)) ||
+	     ZSTD_isError(ZSTD_DCtx_loadDictionary(pdata->zstd_dctx,
+						   dict, dict_len)))) {
+		ret = -EINVAL;
+		goto out_free_ctx;
+	}
+
+	pthread_mutex_init(&pdata->zstd_lock, NULL);
+	free(dict);
+	ret = 0;
+
+	goto out_send_response;
+
+out_free_ctx:
+	ZSTD_freeCCtx(pdata->zstd_cctx);
+	ZSTD_freeDCtx(pdata->zstd_dctx);
+	pdata->zstd_cctx = NULL;
+	pdata->zstd_dctx = NULL;
+out_free_dict:
+	free(dict);
+out_send_response:
+#endif
+	iiod_io_send_response_code(io, ret);
+}
+
+static void handle_stripe_enable(struct parser_pdata *pdata,
+				 const struct iiod_command *cmd,
+				 struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_buf readbuf;
+	uint64_t token;
+	int ret;
+
+	readbuf.ptr = &token;
+	readbuf.size = sizeof(token);
+
+	ret = iiod_command_data_read(cmd_data, &readbuf);
+	if (ret < 0)
+		goto out_send_response;
+
+	ret = stripe_enable(pdata, token, (unsigned int) cmd->code);
+
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static void handle_udp_enable(struct parser_pdata *pdata,
+			      const struct iiod_command *cmd,
+			      struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_buf readbuf;
+	uint64_t token;
+	int ret;
+
+	readbuf.ptr = &token;
+	readbuf.size = sizeof(token);
+
+	ret = iiod_command_data_read(cmd_data, &readbuf);
+	if (ret < 0) {
+		iiod_io_send_response_code(io, ret);
+		return;
+	}
+
+	ret = udp_enable(pdata, token);
+
+	/* The response carries the port number; the hello handshake can
+	 * only start once the client has read it. */
+	iiod_io_send_response_code(io, ret);
+
+	if (ret > 0)
+		udp_wait_hello(pdata);
+}
+
+static void handle_get_stats(struct parser_pdata *pdata,
+			     const struct iiod_command *cmd,
+			     struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	uint64_t counters[6];
+	struct iiod_buf buf = {
+		.ptr = counters,
+		.size = sizeof(counters),
+	};
+
+	counters[0] = iiod_stats_read(&pdata->stats.bytes_in);
+	counters[1] = iiod_stats_read(&pdata->stats.bytes_out);
+	counters[2] = iiod_stats_read(&pdata->stats.blocks_rx);
+	counters[3] = iiod_stats_read(&pdata->stats.blocks_tx);
+	counters[4] = iiod_stats_read(&pdata->stats.commands);
+	counters[5] = iiod_stats_read(&pdata->stats.queue_stalls);
+
+	iiod_io_send_response(io, sizeof(counters), &buf, 1);
+}
+
+static void handle_reg_read_multi(struct parser_pdata *pdata,
+				  const struct iiod_command *cmd,
+				  struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iio_device *dev;
+	struct iiod_buf buf;
+	uint32_t *addrs = NULL, *values = NULL;
+	size_t i, nb = (uint32_t) cmd->code;
+	ssize_t ret = -EINVAL;
+
+	if (!nb || nb > 0xffff)
+		goto out_send_response;
+
+	addrs = calloc(nb, sizeof(*addrs));
+	values = calloc(nb, sizeof(*values));
+	if (!addrs || !values) {
+		iiod_command_data_drain(cmd_data, nb * sizeof(*addrs));
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	buf.ptr = addrs;
+	buf.size = nb * sizeof(*addrs);
+
+	ret = iiod_command_data_read(cmd_data, &buf);
+	if (ret < 0)
+		goto out_free;
+
+	dev = iio_context_get_device(pdata->ctx, cmd->dev);
+	if (!dev) {
+		ret = -ENODEV;
+		goto out_free;
+	}
+
+	for (i = 0; i < nb; i++) {
+		ret = iio_device_reg_read(dev, addrs[i], &values[i]);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	buf.ptr = values;
+	buf.size = nb * sizeof(*values);
+
+	iiod_io_send_response(io, buf.size, &buf, 1);
+
+	free(values);
+	free(addrs);
+	return;
+
+out_free:
+	free(values);
+	free(addrs);
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
+static void handle_reg_write_multi(struct parser_pdata *pdata,
+				   const struct iiod_command *cmd,
+				   struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iio_device *dev;
+	struct iiod_buf buf;
+	uint32_t *payload = NULL;
+	size_t i, nb = (uint32_t) cmd->code;
+	ssize_t ret = -EINVAL;
+
+	if (!nb || nb > 0xffff)
+		goto out_send_response;
+
+	/* Payload: the addresses, followed by the values */
+	payload = calloc(2 * nb, sizeof(*payload));
+	if (!payload) {
+		iiod_command_data_drain(cmd_data, 2 * nb * sizeof(*payload));
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	buf.ptr = payload;
+	buf.size = 2 * nb * sizeof(*payload);
+
+	ret = iiod_command_data_read(cmd_data, &buf);
+	if (ret < 0)
+		goto out_free;
+
+	dev = iio_context_get_device(pdata->ctx, cmd->dev);
+	if (!dev) {
+		ret = -ENODEV;
+		goto out_free;
+	}
+
+	for (i = 0; i < nb; i++) {
+		ret = iio_device_reg_write(dev, payload[i], payload[nb + i]);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	ret = 0;
+
+out_free:
+	free(payload);
+out_send_response:
+	iiod_io_send_response_code(io, ret);
+}
+
 typedef void (*iiod_opcode_fn)(struct parser_pdata *,
 			       const struct iiod_command *,
 			       struct iiod_command_data *cmd_data);
@@ -819,6 +2139,27 @@ static const iiod_opcode_fn iiod_op_functions[] = {
 	[IIOD_OP_FREE_BLOCK]		= handle_free_block,
 	[IIOD_OP_TRANSFER_BLOCK]	= handle_transfer_block,
 	[IIOD_OP_ENQUEUE_BLOCK_CYCLIC]	= handle_transfer_block,
+
+	[IIOD_OP_READ_ATTRS]		= handle_read_attrs,
+	[IIOD_OP_WRITE_ATTRS]		= handle_write_attrs,
+
+	[IIOD_OP_PRINT_BIN]		= handle_print_bin,
+	[IIOD_OP_PRINT_BIN_FILTERED]	= handle_print_bin_filtered,
+
+	[IIOD_OP_STRIPE_ENABLE]		= handle_stripe_enable,
+	[IIOD_OP_ZSTD_ENABLE]		= handle_zstd_enable,
+	[IIOD_OP_PACK_ENABLE]		= handle_pack_enable,
+
+	[IIOD_OP_CREATE_BLOCK_MEMFD]	= handle_create_block,
+	[IIOD_OP_GETSTATS]		= handle_get_stats,
+
+	[IIOD_OP_REG_READ_MULTI]	= handle_reg_read_multi,
+	[IIOD_OP_REG_WRITE_MULTI]	= handle_reg_write_multi,
+
+	[IIOD_OP_WATCH_ATTR]		= handle_watch_attr,
+	[IIOD_OP_UNWATCH_ATTR]		= handle_unwatch_attr,
+
+	[IIOD_OP_UDP_ENABLE]		= handle_udp_enable,
 };
 
 static int iiod_cmd(const struct iiod_command *cmd,
@@ -831,6 +2172,8 @@ static int iiod_cmd(const struct iiod_command *cmd,
 		return -EINVAL;
 	}
 
+	iiod_stats_inc(&pdata->stats.commands);
+
 	iiod_op_functions[cmd->op](pdata, cmd, data);
 
 	return 0;
@@ -843,7 +2186,7 @@ static ssize_t iiod_read(void *d, const struct iiod_buf *buf, size_t nb)
 
 static ssize_t iiod_write(void *d, const struct iiod_buf *buf, size_t nb)
 {
-	return write_all(d, buf->ptr, buf->size);
+	return writev_all(d, buf, nb);
 }
 
 static const struct iiod_responder_ops iiod_responder_ops = {
@@ -857,6 +2200,8 @@ static void iiod_responder_free_resources(struct parser_pdata *pdata)
 	struct block_entry *block_entry, *block_next;
 	struct buffer_entry *buf_entry, *buf_next;
 
+	watch_free_resources(pdata);
+
 	pthread_mutex_lock(&buflist_lock);
 
 	for (buf_entry = SLIST_FIRST(&pdata->bufferlist);
@@ -887,10 +2232,16 @@ int binary_parse(struct parser_pdata *pdata)
 	if (!responder)
 		return -ENOMEM;
 
+	pdata->responder = responder;
+	SLIST_INIT(&pdata->watchlist);
+
 	/* TODO: poll main thread pool FD */
 
 	iiod_responder_wait_done(responder);
 	iiod_responder_free_resources(pdata);
+#if WITH_ZSTD
+	zstd_release(pdata);
+#endif
 	iiod_responder_destroy(responder);
 
 	return 0;
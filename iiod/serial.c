@@ -10,6 +10,8 @@
 #include "ops.h"
 #include "thread-pool.h"
 
+#include "../serial-frame.h"
+
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/serial.h>
@@ -23,16 +25,207 @@ struct serial_pdata {
 	struct iio_context *ctx;
 	bool debug;
 	int fd;
-	const void *xml_zstd;
-	size_t xml_zstd_len;
+	const struct iiod_xml_cache *xml_cache;
+
+	/* Sliding-window framing (",arq" option). The interpreter keeps
+	 * reading and writing a plain byte stream; a pair of pipes and
+	 * two shim threads bridge it to the framer, which multiplexes
+	 * and retransmits frames over the UART. */
+	bool framed;
+	struct serial_framer *framer;
+	int up_fd[2];	/* framer -> interpreter */
+	int down_fd[2];	/* interpreter -> framer */
+
+	/* The shim threads outlive serial_main() by a few cycles at
+	 * shutdown; the last reference tears everything down. */
+	pthread_mutex_t ref_lock;
+	unsigned int refs;
+};
+
+static void serial_pdata_unref(struct serial_pdata *pdata)
+{
+	bool last;
+
+	pthread_mutex_lock(&pdata->ref_lock);
+	last = --pdata->refs == 0;
+	pthread_mutex_unlock(&pdata->ref_lock);
+
+	if (!last)
+		return;
+
+	if (pdata->framer)
+		serial_framer_destroy(pdata->framer);
+	pthread_mutex_destroy(&pdata->ref_lock);
+	close(pdata->fd);
+	free(pdata);
+}
+
+static ssize_t uart_frame_read(void *d, void *buf, size_t len,
+			       unsigned int timeout_ms)
+{
+	struct serial_pdata *pdata = d;
+	struct pollfd pfd = { .fd = pdata->fd, .events = POLLIN };
+	ssize_t ret;
+
+	ret = poll(&pfd, 1, timeout_ms ? (int) timeout_ms : -1);
+	if (ret < 0)
+		return -errno;
+	if (!ret)
+		return 0;
+
+	ret = read(pdata->fd, buf, len);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static ssize_t uart_frame_write(void *d, const void *buf, size_t len)
+{
+	struct serial_pdata *pdata = d;
+	ssize_t ret;
+
+	ret = write(pdata->fd, buf, len);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static const struct serial_framer_ops uart_frame_ops = {
+	.read = uart_frame_read,
+	.write = uart_frame_write,
 };
 
+/* Drain in-order bytes from the framer into the interpreter's input
+ * pipe. This thread also services the framer's acknowledgment and
+ * retransmission timers, hence the short receive timeout. */
+static void serial_uplink_thd(struct thread_pool *pool, void *d)
+{
+	struct serial_pdata *pdata = d;
+	char buf[4096];
+	const char *ptr;
+	ssize_t ret, count;
+
+	for (;;) {
+		ret = serial_framer_recv(pdata->framer, buf, sizeof(buf), 100);
+		if (ret == -ETIMEDOUT) {
+			if (thread_pool_is_stopped(pool))
+				break;
+			continue;
+		}
+		if (ret <= 0)
+			break;
+
+		for (ptr = buf; ret > 0; ptr += count, ret -= count) {
+			count = write(pdata->up_fd[1], ptr, (size_t) ret);
+			if (count <= 0)
+				goto out;
+		}
+	}
+
+out:
+	close(pdata->up_fd[1]);
+	serial_pdata_unref(pdata);
+}
+
+/* Feed the interpreter's output into the framer */
+static void serial_downlink_thd(struct thread_pool *pool, void *d)
+{
+	struct serial_pdata *pdata = d;
+	struct pollfd pfd[2];
+	char buf[4096];
+	ssize_t ret;
+
+	pfd[0].fd = pdata->down_fd[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = thread_pool_get_poll_fd(pool);
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		do {
+			ret = poll(pfd, 2, -1);
+		} while (ret == -1 && errno == EINTR);
+		if (ret == -1)
+			break;
+
+		if (pfd[1].revents & POLLIN)
+			break;
+
+		ret = read(pdata->down_fd[0], buf, sizeof(buf));
+		if (ret <= 0)
+			break;
+
+		if (serial_framer_send(pdata->framer, buf, (size_t) ret) < 0)
+			break;
+	}
+
+	close(pdata->down_fd[0]);
+	serial_pdata_unref(pdata);
+}
+
+static int serial_framed_start(struct serial_pdata *pdata,
+			       struct thread_pool *pool)
+{
+	int err;
+
+	pdata->framer = serial_framer_create(&uart_frame_ops, pdata);
+	if (!pdata->framer)
+		return -ENOMEM;
+
+	if (pipe2(pdata->up_fd, O_CLOEXEC)) {
+		err = -errno;
+		goto err_destroy_framer;
+	}
+
+	if (pipe2(pdata->down_fd, O_CLOEXEC)) {
+		err = -errno;
+		goto err_close_up_fd;
+	}
+
+	pthread_mutex_lock(&pdata->ref_lock);
+	pdata->refs++;
+	pthread_mutex_unlock(&pdata->ref_lock);
+
+	err = thread_pool_add_thread(pool, serial_uplink_thd, pdata,
+				     "iiod_serial_rx_thd");
+	if (err)
+		goto err_unref;
+
+	pthread_mutex_lock(&pdata->ref_lock);
+	pdata->refs++;
+	pthread_mutex_unlock(&pdata->ref_lock);
+
+	err = thread_pool_add_thread(pool, serial_downlink_thd, pdata,
+				     "iiod_serial_tx_thd");
+	if (err) {
+		/* The uplink thread owns up_fd[1] and one reference; it
+		 * will exit once the thread pool stops. */
+		serial_pdata_unref(pdata);
+		close(pdata->up_fd[0]);
+		close(pdata->down_fd[0]);
+		close(pdata->down_fd[1]);
+		return err;
+	}
+
+	return 0;
+
+err_unref:
+	serial_pdata_unref(pdata);
+	close(pdata->down_fd[0]);
+	close(pdata->down_fd[1]);
+err_close_up_fd:
+	close(pdata->up_fd[0]);
+	close(pdata->up_fd[1]);
+err_destroy_framer:
+	serial_framer_destroy(pdata->framer);
+	pdata->framer = NULL;
+	return err;
+}
+
 static char *get_uart_params(const char *str,
 			     unsigned int *bps, unsigned int *bits,
-			     char *parity, unsigned int *stop, char *flow)
+			     char *parity, unsigned int *stop, char *flow,
+			     bool *framed)
 {
-	const char *ptr;
-	char *dev_name;
+	char *copy, *ptr, *dev_name;
+	size_t len;
 
 	/* Default values when unspecified */
 	*bps = 57600;
@@ -41,13 +234,23 @@ static char *get_uart_params(const char *str,
 	*stop = 1;
 	*flow = '\0';
 
-	ptr = strchr(str, ',');
-	if (!ptr) {
-		dev_name = strdup(str);
-	} else {
-		dev_name = strndup(str, ptr - str);
-		sscanf(ptr, ",%u,%u%c%u%c", bps, bits, parity, stop, flow);
-	}
+	/* Strip the trailing ",arq" before parsing the line settings */
+	len = strlen(str);
+	*framed = len >= 4 && !strcmp(str + len - 4, ",arq");
+	if (*framed)
+		len -= 4;
+
+	copy = strndup(str, len);
+	if (!copy)
+		return NULL;
+
+	ptr = strchr(copy, ',');
+	if (!ptr)
+		return copy;
+
+	dev_name = strndup(copy, ptr - copy);
+	sscanf(ptr, ",%u,%u%c%u%c", bps, bits, parity, stop, flow);
+	free(copy);
 
 	return dev_name;
 }
@@ -55,15 +258,42 @@ static char *get_uart_params(const char *str,
 static void serial_main(struct thread_pool *pool, void *d)
 {
 	struct serial_pdata *pdata = d;
+	int fd_in = pdata->fd, fd_out = pdata->fd;
+	int err;
+
+	if (pdata->framed) {
+		err = serial_framed_start(pdata, pool);
+		if (err) {
+			IIO_ERROR("Unable to start serial framing: %i\n", err);
+			serial_pdata_unref(pdata);
+			return;
+		}
+
+		fd_in = pdata->up_fd[0];
+		fd_out = pdata->down_fd[1];
+	}
 
 	do {
-		interpreter(pdata->ctx, pdata->fd, pdata->fd, pdata->debug,
-			    false, false, false, pool,
-			    pdata->xml_zstd, pdata->xml_zstd_len);
+		interpreter(pdata->ctx, fd_in, fd_out, pdata->debug,
+			    false, false, false, pool, pdata->xml_cache);
+
+		if (pdata->framed) {
+			struct pollfd pfd = { .fd = fd_in, .events = POLLIN };
+
+			/* If the uplink shim closed its pipe, the framed
+			 * link is dead; don't spin on the EOF. */
+			if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLHUP)
+			    && !(pfd.revents & POLLIN))
+				break;
+		}
 	} while (!thread_pool_is_stopped(pool));
 
-	close(pdata->fd);
-	free(pdata);
+	if (pdata->framed) {
+		close(pdata->up_fd[0]);
+		close(pdata->down_fd[1]);
+	}
+
+	serial_pdata_unref(pdata);
 }
 
 static int serial_configure(int fd, unsigned int uart_bps,
@@ -230,15 +460,16 @@ static int serial_configure(int fd, unsigned int uart_bps,
 
 int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 			bool debug, struct thread_pool *pool,
-			const void *xml_zstd, size_t xml_zstd_len)
+			const struct iiod_xml_cache *xml_cache)
 {
 	struct serial_pdata *pdata;
 	char *dev, uart_parity, uart_flow;
 	unsigned int uart_bps, uart_bits, uart_stop;
 	int fd, err = -ENOMEM;
+	bool framed;
 
 	dev = get_uart_params(uart_params, &uart_bps, &uart_bits,
-			      &uart_parity, &uart_stop, &uart_flow);
+			      &uart_parity, &uart_stop, &uart_flow, &framed);
 	if (!dev)
 		return -ENOMEM;
 
@@ -260,11 +491,13 @@ int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 	pdata->ctx = ctx;
 	pdata->debug = debug;
 	pdata->fd = fd;
-	pdata->xml_zstd = xml_zstd;
-	pdata->xml_zstd_len = xml_zstd_len;
+	pdata->xml_cache = xml_cache;
+	pdata->framed = framed;
+	pdata->refs = 1;
+	pthread_mutex_init(&pdata->ref_lock, NULL);
 
-	IIO_DEBUG("Serving over UART on %s at %u bps, %u bits\n",
-		  dev, uart_bps, uart_bits);
+	IIO_DEBUG("Serving over UART on %s at %u bps, %u bits%s\n",
+		  dev, uart_bps, uart_bits, framed ? ", framed" : "");
 
 	err = thread_pool_add_thread(pool, serial_main, pdata, "iiod_serial_thd");
 	if (err)
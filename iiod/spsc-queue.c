@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "spsc-queue.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SPSC_WORKER_PAUSED	0
+#define SPSC_WORKER_RUNNING	1
+#define SPSC_WORKER_EXIT	2
+
+static void spsc_futex_wait(_Atomic uint32_t *addr, uint32_t val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void spsc_futex_wake(_Atomic uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Bump the event word, then wake its sleepers. The bump is what makes
+ * the wake race-free: a sleeper which snapshotted the word before the
+ * bump will not block in FUTEX_WAIT at all. */
+static void spsc_queue_signal(_Atomic uint32_t *event)
+{
+	atomic_fetch_add(event, 1);
+	spsc_futex_wake(event);
+}
+
+void spsc_queue_init(struct spsc_queue *queue)
+{
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+	atomic_init(&queue->data_event, 0);
+	atomic_init(&queue->room_event, 0);
+	atomic_init(&queue->cons_parked, 0);
+	atomic_init(&queue->prod_parked, 0);
+	atomic_init(&queue->stopped, 0);
+}
+
+int spsc_queue_push(struct spsc_queue *queue, void *elm)
+{
+	uint32_t head = atomic_load_explicit(&queue->head,
+					     memory_order_relaxed);
+	uint32_t tail;
+
+	if (atomic_load_explicit(&queue->stopped, memory_order_relaxed))
+		return -EBADF;
+
+	tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	if (head - tail >= SPSC_QUEUE_SIZE)
+		return -EAGAIN;
+
+	queue->slots[head & (SPSC_QUEUE_SIZE - 1)] = elm;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+	/* Only wake the consumer when it flagged itself parked; the fence
+	 * pairs with the one in the consumer's park sequence, so that one
+	 * of the two sides always notices the other. */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&queue->cons_parked, memory_order_relaxed))
+		spsc_queue_signal(&queue->data_event);
+
+	return 0;
+}
+
+int spsc_queue_try_pop(struct spsc_queue *queue, void **elm)
+{
+	uint32_t tail = atomic_load_explicit(&queue->tail,
+					     memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&queue->head,
+					     memory_order_acquire);
+
+	if (head == tail)
+		return -EAGAIN;
+
+	*elm = queue->slots[tail & (SPSC_QUEUE_SIZE - 1)];
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+	/* Same dance as in spsc_queue_push(), mirrored */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&queue->prod_parked, memory_order_relaxed))
+		spsc_queue_signal(&queue->room_event);
+
+	return 0;
+}
+
+int spsc_queue_pop(struct spsc_queue *queue, void **elm)
+{
+	uint32_t event;
+
+	while (spsc_queue_try_pop(queue, elm)) {
+		if (atomic_load_explicit(&queue->stopped,
+					 memory_order_relaxed))
+			return -EBADF;
+
+		/* Empty: park until the producer pushes. Same snapshot /
+		 * re-check sequence as in spsc_queue_push(). */
+		atomic_store_explicit(&queue->cons_parked, 1,
+				      memory_order_relaxed);
+		event = atomic_load_explicit(&queue->data_event,
+					     memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		if (atomic_load_explicit(&queue->head,
+					 memory_order_relaxed) ==
+		    atomic_load_explicit(&queue->tail,
+					 memory_order_relaxed) &&
+		    !atomic_load_explicit(&queue->stopped,
+					  memory_order_relaxed))
+			spsc_futex_wait(&queue->data_event, event);
+
+		atomic_store_explicit(&queue->cons_parked, 0,
+				      memory_order_relaxed);
+	}
+
+	return 0;
+}
+
+void spsc_queue_stop(struct spsc_queue *queue)
+{
+	atomic_store(&queue->stopped, 1);
+	spsc_queue_signal(&queue->data_event);
+	spsc_queue_signal(&queue->room_event);
+}
+
+static void * spsc_worker_thd(void *d)
+{
+	struct spsc_worker *worker = d;
+	struct spsc_queue *queue = &worker->queue;
+	uint32_t state, event;
+	bool popped;
+	void *elm;
+
+#ifdef HAS_PTHREAD_SETNAME_NP
+	pthread_setname_np(pthread_self(), worker->name);
+#endif
+
+	for (;;) {
+		state = atomic_load_explicit(&worker->state,
+					     memory_order_acquire);
+		if (state == SPSC_WORKER_EXIT)
+			break;
+
+		if (state == SPSC_WORKER_RUNNING) {
+			/* The "busy" flag is raised before re-checking the
+			 * state, so that spsc_worker_stop() either sees it
+			 * and waits for fn() to return, or paused us before
+			 * we committed to popping the element. */
+			atomic_store(&worker->busy, 1);
+
+			popped = atomic_load(&worker->state) == SPSC_WORKER_RUNNING
+				&& !spsc_queue_try_pop(queue, &elm);
+			if (popped)
+				(*worker->fn)(worker->priv, elm);
+
+			atomic_store(&worker->busy, 0);
+			if (atomic_load(&worker->state) != SPSC_WORKER_RUNNING)
+				spsc_futex_wake(&worker->busy);
+
+			if (popped)
+				continue;
+		}
+
+		/* Paused, or nothing queued: park on the data event, which
+		 * is bumped on state changes as well as on pushes. */
+		atomic_store_explicit(&queue->cons_parked, 1,
+				      memory_order_relaxed);
+		event = atomic_load_explicit(&queue->data_event,
+					     memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		if (atomic_load_explicit(&worker->state,
+					 memory_order_relaxed) == state &&
+		    (state == SPSC_WORKER_PAUSED ||
+		     atomic_load_explicit(&queue->head, memory_order_relaxed)
+		     == atomic_load_explicit(&queue->tail,
+					     memory_order_relaxed)))
+			spsc_futex_wait(&queue->data_event, event);
+
+		atomic_store_explicit(&queue->cons_parked, 0,
+				      memory_order_relaxed);
+	}
+
+	return NULL;
+}
+
+int spsc_worker_init(struct spsc_worker *worker,
+		     int (*fn)(void *, void *), void *priv, const char *name)
+{
+	int ret;
+
+	spsc_queue_init(&worker->queue);
+	worker->fn = fn;
+	worker->priv = priv;
+	worker->name = name;
+	atomic_init(&worker->state, SPSC_WORKER_PAUSED);
+	atomic_init(&worker->busy, 0);
+
+	ret = pthread_create(&worker->thd, NULL, spsc_worker_thd, worker);
+
+	return ret ? -ret : 0;
+}
+
+int spsc_worker_push(struct spsc_worker *worker, void *elm)
+{
+	struct spsc_queue *queue = &worker->queue;
+	uint32_t event;
+	int ret;
+
+	for (;;) {
+		ret = spsc_queue_push(queue, elm);
+		if (ret != -EAGAIN)
+			return ret;
+
+		/* Parking on a full ring is only safe while the worker is
+		 * actually consuming; when it is paused or exiting nothing
+		 * will ever make room, so fail instead of waiting for a
+		 * wake-up that cannot come. */
+		if (atomic_load_explicit(&worker->state,
+					 memory_order_relaxed)
+		    != SPSC_WORKER_RUNNING)
+			return -EAGAIN;
+
+		/* Full: park until the consumer makes room. The event
+		 * word is snapshotted before the re-check, so a pop (or a
+		 * stop, or a state change) slipping in between either
+		 * shows up in the re-check or fails the FUTEX_WAIT
+		 * comparison. */
+		atomic_store_explicit(&queue->prod_parked, 1,
+				      memory_order_relaxed);
+		event = atomic_load_explicit(&queue->room_event,
+					     memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		if (atomic_load_explicit(&queue->head,
+					 memory_order_relaxed)
+		    - atomic_load_explicit(&queue->tail,
+					   memory_order_relaxed)
+		    >= SPSC_QUEUE_SIZE &&
+		    atomic_load_explicit(&worker->state,
+					 memory_order_relaxed)
+		    == SPSC_WORKER_RUNNING &&
+		    !atomic_load_explicit(&queue->stopped,
+					  memory_order_relaxed))
+			spsc_futex_wait(&queue->room_event, event);
+
+		atomic_store_explicit(&queue->prod_parked, 0,
+				      memory_order_relaxed);
+	}
+}
+
+void spsc_worker_start(struct spsc_worker *worker)
+{
+	atomic_store(&worker->state, SPSC_WORKER_RUNNING);
+	spsc_queue_signal(&worker->queue.data_event);
+}
+
+void spsc_worker_stop(struct spsc_worker *worker)
+{
+	atomic_store(&worker->state, SPSC_WORKER_PAUSED);
+	spsc_queue_signal(&worker->queue.data_event);
+
+	/* A producer parked on a full ring must re-check the state and
+	 * bail out, as the paused worker will not make room anymore */
+	spsc_queue_signal(&worker->queue.room_event);
+
+	/* Wait until the element being processed (if any) is done */
+	while (atomic_load(&worker->busy))
+		spsc_futex_wait(&worker->busy, 1);
+}
+
+void spsc_worker_destroy(struct spsc_worker *worker)
+{
+	void *elm;
+
+	atomic_store(&worker->state, SPSC_WORKER_EXIT);
+	spsc_queue_stop(&worker->queue);
+
+	pthread_join(worker->thd, NULL);
+
+	/* Drop whatever was still queued */
+	while (!spsc_queue_try_pop(&worker->queue, &elm))
+		continue;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Bounded lock-free single-producer/single-consumer ring of pointers.
+ *
+ * As long as the ring is neither empty nor full, pushing and popping are
+ * wait-free: each side only ever writes its own position word, so the hot
+ * path is a couple of atomic loads and one store, with no lock word being
+ * bounced between the two threads on every operation. A side that finds
+ * the ring empty (resp. full) parks on a futex, and is only woken on the
+ * empty -> non-empty (resp. full -> non-full) transition; at high block
+ * rates neither side enters the kernel at all.
+ */
+
+/* Must be a power of two. Bounds how many operations can pile up while
+ * the consumer is paused; sized generously, since pushing to a full
+ * ring fails (or waits, see spsc_worker_push()) until the consumer runs
+ * again. */
+#define SPSC_QUEUE_SIZE 1024u
+
+struct spsc_queue {
+	void *slots[SPSC_QUEUE_SIZE];
+
+	/* Free-running positions: the ring is empty when they are equal,
+	 * and full when they are SPSC_QUEUE_SIZE apart. Each one is only
+	 * ever written by its own side. */
+	_Atomic uint32_t head, tail;
+
+	/* Futex words, bumped on the transitions described above (and on
+	 * stop), plus the "about to sleep" flags which let the other side
+	 * skip the wake syscall entirely when nobody is parked. */
+	_Atomic uint32_t data_event, room_event;
+	_Atomic uint32_t cons_parked, prod_parked;
+
+	_Atomic uint32_t stopped;
+};
+
+void spsc_queue_init(struct spsc_queue *queue);
+/* Non-blocking: returns -EAGAIN when the ring is full, -EBADF when the
+ * queue was stopped. */
+int spsc_queue_push(struct spsc_queue *queue, void *elm);
+int spsc_queue_pop(struct spsc_queue *queue, void **elm);
+int spsc_queue_try_pop(struct spsc_queue *queue, void **elm);
+void spsc_queue_stop(struct spsc_queue *queue);
+
+/* Consumer thread bound to a SPSC queue: calls fn(priv, elm) for each
+ * pushed element, in order. Workers are created paused; elements pushed
+ * before spsc_worker_start() are kept queued until the worker runs. */
+struct spsc_worker {
+	struct spsc_queue queue;
+	pthread_t thd;
+	int (*fn)(void *, void *);
+	void *priv;
+	const char *name;
+
+	/* Paused / running / exiting; futex word. */
+	_Atomic uint32_t state;
+
+	/* Set while fn() runs; futex word for spsc_worker_stop(). */
+	_Atomic uint32_t busy;
+};
+
+int spsc_worker_init(struct spsc_worker *worker,
+		     int (*fn)(void *, void *), void *priv, const char *name);
+/* When the ring is full, waits for room only while the worker is
+ * running; on a paused or exiting worker it fails with -EAGAIN instead,
+ * as nothing would ever make room. */
+int spsc_worker_push(struct spsc_worker *worker, void *elm);
+void spsc_worker_start(struct spsc_worker *worker);
+void spsc_worker_stop(struct spsc_worker *worker);
+void spsc_worker_destroy(struct spsc_worker *worker);
+
+#endif /* __SPSC_QUEUE_H__ */
@@ -7,6 +7,7 @@
  */
 
 #include "thread-pool.h"
+#include "queue.h"
 
 #include <errno.h>
 #include <pthread.h>
@@ -14,8 +15,20 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <unistd.h>
 
+/* Finished workers park for a while instead of exiting, so that a burst
+ * of short-lived clients does not pay one pthread_create() each; with
+ * many automation setups fanning hundreds of connections at one daemon,
+ * thread churn and stack memory dominate otherwise. */
+#define MAX_IDLE_WORKERS	16
+#define WORKER_IDLE_TIMEOUT	10 /* seconds */
+
+/* Client threads hold little state; the glibc default of 8 MiB per
+ * stack is way oversized. */
+#define WORKER_STACK_SIZE	(512 * 1024)
+
 /*
  * This is used to make sure that all active threads have finished cleanup when
  * a STOP event is received. We don't use pthread_join() since for most threads
@@ -26,18 +39,26 @@
  * iio_context_destroy() is called.
  */
 
+struct thread_body_data {
+	SLIST_ENTRY(thread_body_data) entry;
+	struct thread_pool *pool;
+	void (*f)(struct thread_pool *, void *);
+	void *d;
+	const char *name;
+};
+
 struct thread_pool {
 	pthread_mutex_t thread_count_lock;
 	pthread_cond_t thread_count_cond;
 	unsigned int thread_count;
 	int stop_fd;
 	bool stop;
-};
 
-struct thread_body_data {
-	struct thread_pool *pool;
-	void (*f)(struct thread_pool *, void *);
-	void *d;
+	/* Jobs claimed by (or waiting for) a parked worker */
+	pthread_mutex_t jobs_lock;
+	pthread_cond_t jobs_cond;
+	SLIST_HEAD(JobsList, thread_body_data) jobs;
+	unsigned int nb_idle;
 };
 
 static void thread_pool_thread_started(struct thread_pool *pool)
@@ -55,14 +76,71 @@ static void thread_pool_thread_stopped(struct thread_pool *pool)
 	pthread_mutex_unlock(&pool->thread_count_lock);
 }
 
+static void thread_run_job(struct thread_body_data *pdata)
+{
+#ifdef HAS_PTHREAD_SETNAME_NP
+	pthread_setname_np(pthread_self(), pdata->name);
+#endif
+	(*pdata->f)(pdata->pool, pdata->d);
+	free(pdata);
+}
+
 static void * thread_body(void *d)
 {
 	struct thread_body_data *pdata = d;
+	struct thread_pool *pool = pdata->pool;
+	struct timespec ts;
+	int ret;
 
-	(*pdata->f)(pdata->pool, pdata->d);
+	thread_run_job(pdata);
+
+	pthread_mutex_lock(&pool->jobs_lock);
+
+	for (;;) {
+		pdata = SLIST_FIRST(&pool->jobs);
+		if (pdata) {
+			SLIST_REMOVE_HEAD(&pool->jobs, entry);
+			pthread_mutex_unlock(&pool->jobs_lock);
+
+			/* Queued jobs are run even when the pool is being
+			 * stopped: the payload belongs to f(), which
+			 * notices the stop through the pool's poll fd and
+			 * returns early. Retiring with the job still
+			 * queued would drop it, where a freshly created
+			 * thread would have run it. */
+			thread_run_job(pdata);
+
+			pthread_mutex_lock(&pool->jobs_lock);
+			continue;
+		}
+
+		if (pool->stop || pool->nb_idle >= MAX_IDLE_WORKERS)
+			break;
+
+		pool->nb_idle++;
+
+		ret = 0;
+		while (SLIST_EMPTY(&pool->jobs) && !pool->stop &&
+		       ret != ETIMEDOUT) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += WORKER_IDLE_TIMEOUT;
+
+			ret = pthread_cond_timedwait(&pool->jobs_cond,
+						     &pool->jobs_lock, &ts);
+		}
+
+		if (SLIST_EMPTY(&pool->jobs)) {
+			/* Timed out or stopping: retire. When a job was
+			 * posted, the poster already took us off the idle
+			 * count. */
+			pool->nb_idle--;
+			break;
+		}
+	}
 
-	thread_pool_thread_stopped(pdata->pool);
-	free(pdata);
+	pthread_mutex_unlock(&pool->jobs_lock);
+
+	thread_pool_thread_stopped(pool);
 
 	return NULL;
 }
@@ -84,12 +162,25 @@ int thread_pool_add_thread(struct thread_pool *pool,
 	pdata->f = f;
 	pdata->d = d;
 	pdata->pool = pool;
+	pdata->name = name;
+
+	/* Hand the job to a parked worker when one is available */
+	pthread_mutex_lock(&pool->jobs_lock);
+	if (pool->nb_idle) {
+		pool->nb_idle--;
+		SLIST_INSERT_HEAD(&pool->jobs, pdata, entry);
+		pthread_cond_signal(&pool->jobs_cond);
+		pthread_mutex_unlock(&pool->jobs_lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&pool->jobs_lock);
 
 	sigfillset(&sigmask);
 	pthread_sigmask(SIG_BLOCK, &sigmask, &oldsigmask);
 
 	pthread_attr_init(&attr);
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
 
 	/* In order to avoid race conditions thread_pool_thread_started() must
 	 * be called before the thread is created and
@@ -101,10 +192,6 @@ int thread_pool_add_thread(struct thread_pool *pool,
 	if (ret) {
 		free(pdata);
 		thread_pool_thread_stopped(pool);
-	} else {
-#ifdef HAS_PTHREAD_SETNAME_NP
-		pthread_setname_np(thd, name);
-#endif
 	}
 
 	pthread_attr_destroy(&attr);
@@ -137,6 +224,11 @@ struct thread_pool * thread_pool_new(void)
 	pthread_cond_init(&pool->thread_count_cond, NULL);
 	pool->thread_count = 0;
 
+	pthread_mutex_init(&pool->jobs_lock, NULL);
+	pthread_cond_init(&pool->jobs_cond, NULL);
+	SLIST_INIT(&pool->jobs);
+	pool->nb_idle = 0;
+
 	return pool;
 }
 
@@ -152,6 +244,11 @@ void thread_pool_stop(struct thread_pool *pool)
 
 	pool->stop = true;
 
+	/* Wake up the parked workers so that they retire */
+	pthread_mutex_lock(&pool->jobs_lock);
+	pthread_cond_broadcast(&pool->jobs_cond);
+	pthread_mutex_unlock(&pool->jobs_lock);
+
 	do {
 		ret = write(pool->stop_fd, &e, sizeof(e));
 	} while (ret == -1 && errno == EINTR);
@@ -185,18 +282,38 @@ bool thread_pool_is_stopped(const struct thread_pool *pool)
 	return pool->stop;
 }
 
+/* Run jobs that were handed to a parked worker but never picked up, e.g.
+ * when the worker was woken by thread_pool_stop() instead. The payload
+ * is owned by f(), so it cannot simply be freed here; with the pool
+ * stopped, f() returns as soon as it polls the stop fd. */
+static void thread_pool_run_leftover_jobs(struct thread_pool *pool)
+{
+	struct thread_body_data *pdata;
+
+	while ((pdata = SLIST_FIRST(&pool->jobs))) {
+		SLIST_REMOVE_HEAD(&pool->jobs, entry);
+		(*pdata->f)(pdata->pool, pdata->d);
+		free(pdata);
+	}
+}
+
 void thread_pool_restart(struct thread_pool *pool)
 {
 	if (pool->stop) {
 		thread_pool_purge_events(pool);
+		thread_pool_run_leftover_jobs(pool);
 		pool->stop = false;
 	}
 }
 
 void thread_pool_destroy(struct thread_pool *pool)
 {
+	thread_pool_run_leftover_jobs(pool);
+
 	pthread_mutex_destroy(&pool->thread_count_lock);
 	pthread_cond_destroy(&pool->thread_count_cond);
+	pthread_mutex_destroy(&pool->jobs_lock);
+	pthread_cond_destroy(&pool->jobs_cond);
 
 	close(pool->stop_fd);
 	free(pool);
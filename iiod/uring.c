@@ -0,0 +1,348 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2025 Analog Devices, Inc.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for syscall() and MAP_POPULATE */
+#endif
+
+#include "uring.h"
+
+#include <iio/iio.h>
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Room for the R/W chain, the stop poll, and one cancel per chain entry */
+#define URING_ENTRIES	16
+
+#define UD_STOP_POLL	0x100
+#define UD_CANCEL	0x200
+#define UD_RW_BASE	0x300
+
+struct iiod_uring {
+	int fd;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+
+	unsigned int to_submit;
+	bool stop_armed, stopped;
+
+	pthread_mutex_t lock;
+};
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	int ret;
+
+	ret = (int) syscall(__NR_io_uring_setup, entries, p);
+
+	return ret == -1 ? -errno : ret;
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags)
+{
+	int ret;
+
+	ret = (int) syscall(__NR_io_uring_enter, fd, to_submit,
+			    min_complete, flags, NULL, 0);
+
+	return ret == -1 ? -errno : ret;
+}
+
+struct iiod_uring * iiod_uring_create(void)
+{
+	struct io_uring_params params;
+	struct iiod_uring *ur;
+	int ret, fd;
+
+	ur = calloc(1, sizeof(*ur));
+	if (!ur)
+		return iio_ptr(-ENOMEM);
+
+	memset(&params, 0, sizeof(params));
+
+	fd = io_uring_setup(URING_ENTRIES, &params);
+	if (fd < 0) {
+		ret = fd;
+		goto err_free_ur;
+	}
+
+	/* IORING_OP_READ/WRITE (5.6) is the oldest opcode we use; NODROP
+	 * (5.5) is from the same era and saves us from having to handle
+	 * CQ ring overflow. Older kernels fall back to the libaio path. */
+	if (!(params.features & IORING_FEAT_NODROP)) {
+		ret = -ENOSYS;
+		goto err_close_fd;
+	}
+
+	ur->fd = fd;
+
+	ur->sq_ring_sz = params.sq_off.array
+		+ params.sq_entries * sizeof(unsigned int);
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ur->sq_ring == MAP_FAILED) {
+		ret = -errno;
+		goto err_close_fd;
+	}
+
+	ur->cq_ring_sz = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	if (ur->cq_ring == MAP_FAILED) {
+		ret = -errno;
+		goto err_unmap_sq;
+	}
+
+	ur->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED) {
+		ret = -errno;
+		goto err_unmap_cq;
+	}
+
+	ur->sq_head = (unsigned int *)((uintptr_t) ur->sq_ring
+				       + params.sq_off.head);
+	ur->sq_tail = (unsigned int *)((uintptr_t) ur->sq_ring
+				       + params.sq_off.tail);
+	ur->sq_mask = (unsigned int *)((uintptr_t) ur->sq_ring
+				       + params.sq_off.ring_mask);
+	ur->sq_array = (unsigned int *)((uintptr_t) ur->sq_ring
+					+ params.sq_off.array);
+
+	ur->cq_head = (unsigned int *)((uintptr_t) ur->cq_ring
+				       + params.cq_off.head);
+	ur->cq_tail = (unsigned int *)((uintptr_t) ur->cq_ring
+				       + params.cq_off.tail);
+	ur->cq_mask = (unsigned int *)((uintptr_t) ur->cq_ring
+				       + params.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe *)((uintptr_t) ur->cq_ring
+					   + params.cq_off.cqes);
+
+	pthread_mutex_init(&ur->lock, NULL);
+
+	return ur;
+
+err_unmap_cq:
+	munmap(ur->cq_ring, ur->cq_ring_sz);
+err_unmap_sq:
+	munmap(ur->sq_ring, ur->sq_ring_sz);
+err_close_fd:
+	close(fd);
+err_free_ur:
+	free(ur);
+	return iio_ptr(ret);
+}
+
+void iiod_uring_destroy(struct iiod_uring *ur)
+{
+	pthread_mutex_destroy(&ur->lock);
+	munmap(ur->sqes, ur->sqes_sz);
+	munmap(ur->cq_ring, ur->cq_ring_sz);
+	munmap(ur->sq_ring, ur->sq_ring_sz);
+	close(ur->fd);
+	free(ur);
+}
+
+static struct io_uring_sqe * iiod_uring_get_sqe(struct iiod_uring *ur)
+{
+	unsigned int tail = *ur->sq_tail + ur->to_submit;
+	unsigned int idx = tail & *ur->sq_mask;
+	struct io_uring_sqe *sqe = &ur->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	ur->sq_array[idx] = idx;
+	ur->to_submit++;
+
+	return sqe;
+}
+
+static int iiod_uring_enter(struct iiod_uring *ur, unsigned int min_complete)
+{
+	int ret;
+
+	atomic_store_explicit((_Atomic unsigned int *) ur->sq_tail,
+			      *ur->sq_tail + ur->to_submit,
+			      memory_order_release);
+
+	do {
+		ret = io_uring_enter(ur->fd, ur->to_submit, min_complete,
+				     IORING_ENTER_GETEVENTS);
+	} while (ret == -EINTR);
+
+	if (ret >= 0)
+		ur->to_submit -= ret;
+
+	return ret;
+}
+
+static bool iiod_uring_reap(struct iiod_uring *ur,
+			    unsigned long long *user_data, int *res)
+{
+	unsigned int head = *ur->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if (head == atomic_load_explicit((_Atomic unsigned int *) ur->cq_tail,
+					 memory_order_acquire))
+		return false;
+
+	cqe = &ur->cqes[head & *ur->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+
+	atomic_store_explicit((_Atomic unsigned int *) ur->cq_head,
+			      head + 1, memory_order_release);
+
+	return true;
+}
+
+static ssize_t iiod_uring_do_rw(struct iiod_uring *ur, int fd, void *buf,
+				size_t len, bool do_read, int stop_fd)
+{
+	int res_val, res[IIOD_URING_QUEUE_DEPTH];
+	size_t lens[IIOD_URING_QUEUE_DEPTH];
+	unsigned int i, nb, pending, cancels = 0;
+	struct io_uring_sqe *sqe;
+	unsigned long long ud;
+	bool cancel_sent = false;
+	size_t chunk, offset = 0;
+	ssize_t total;
+	int ret;
+
+	if (ur->stopped || !len)
+		return 0;
+
+	if (!ur->stop_armed) {
+		/* Arm a single-shot poll on the thread pool's stop fd; it
+		 * only ever completes when the session is torn down, so it
+		 * is submitted once and left in flight. */
+		sqe = iiod_uring_get_sqe(ur);
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = stop_fd;
+		sqe->poll_events = POLLIN;
+		sqe->user_data = UD_STOP_POLL;
+
+		ur->stop_armed = true;
+	}
+
+	/* Split the transfer into a chain of linked requests: the kernel
+	 * queues the next one to the endpoint straight from the completion
+	 * of the previous, so ordering of the byte stream is preserved
+	 * without a userspace round trip between chunks. */
+	for (nb = 0; nb < IIOD_URING_QUEUE_DEPTH && offset < len; nb++) {
+		chunk = len - offset;
+		if (chunk > IIOD_URING_MAX_REQ_SIZE)
+			chunk = IIOD_URING_MAX_REQ_SIZE;
+
+		sqe = iiod_uring_get_sqe(ur);
+		sqe->opcode = do_read ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (uintptr_t)((char *) buf + offset);
+		sqe->len = (unsigned int) chunk;
+		sqe->user_data = UD_RW_BASE + nb;
+		sqe->flags = IOSQE_IO_LINK;
+
+		lens[nb] = chunk;
+		offset += chunk;
+	}
+
+	/* The last request of the chain ends the link */
+	sqe->flags &= ~IOSQE_IO_LINK;
+
+	pending = nb;
+
+	while (pending || cancels) {
+		while (iiod_uring_reap(ur, &ud, &res_val)) {
+			if (ud >= UD_RW_BASE) {
+				res[ud - UD_RW_BASE] = res_val;
+				pending--;
+			} else if (ud == UD_STOP_POLL) {
+				ur->stopped = true;
+			} else if (ud == UD_CANCEL) {
+				cancels--;
+			}
+		}
+
+		if (ur->stopped && pending && !cancel_sent) {
+			/* Got a STOP event to abort this whole session.
+			 * Cancelling the chain's head is enough: the linked
+			 * requests behind it complete with -ECANCELED. */
+			for (i = 0; i < nb; i++) {
+				sqe = iiod_uring_get_sqe(ur);
+				sqe->opcode = IORING_OP_ASYNC_CANCEL;
+				sqe->fd = -1;
+				sqe->addr = UD_RW_BASE + i;
+				sqe->user_data = UD_CANCEL;
+				cancels++;
+			}
+			cancel_sent = true;
+		}
+
+		if (!pending && !cancels)
+			break;
+
+		ret = iiod_uring_enter(ur, 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* Got STOP event, treat it as EOF */
+	if (ur->stopped)
+		return 0;
+
+	/* Walk the requests in submission order; a short or failed request
+	 * breaks the link, so the chained requests behind it never started
+	 * and completed with -ECANCELED: unlike the libaio engine, a short
+	 * chunk cannot leave a hole in the byte stream. */
+	for (i = 0, total = 0; i < nb; i++) {
+		if (res[i] < 0) {
+			if (i > 0 && res[i] == -ECANCELED)
+				break;
+			return res[i];
+		}
+
+		total += res[i];
+
+		if ((size_t) res[i] < lens[i])
+			break;
+	}
+
+	return total;
+}
+
+ssize_t iiod_uring_rw(struct iiod_uring *ur, int fd, void *buf, size_t len,
+		      bool do_read, int stop_fd)
+{
+	ssize_t ret;
+
+	if (len > IIOD_URING_QUEUE_DEPTH * IIOD_URING_MAX_REQ_SIZE)
+		len = IIOD_URING_QUEUE_DEPTH * IIOD_URING_MAX_REQ_SIZE;
+
+	pthread_mutex_lock(&ur->lock);
+	ret = iiod_uring_do_rw(ur, fd, buf, len, do_read, stop_fd);
+	pthread_mutex_unlock(&ur->lock);
+
+	return ret;
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2025 Analog Devices, Inc.
+ */
+
+#ifndef __IIOD_URING_H__
+#define __IIOD_URING_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* io_uring engine for the FunctionFS endpoint I/O. A transfer is split
+ * into chunks like the libaio path, but the chunks are submitted as a
+ * chain of linked SQEs: the kernel starts the next USB request from the
+ * completion of the previous one, without a round trip through
+ * userspace, and the whole batch costs a single io_uring_enter() call
+ * instead of submit + eventfd read + getevents. */
+
+#define IIOD_URING_MAX_REQ_SIZE	(1024 * 1024)
+#define IIOD_URING_QUEUE_DEPTH	4
+
+struct iiod_uring;
+
+/* Create one engine per transfer direction. Returns an error pointer if
+ * the kernel does not support io_uring (the caller then falls back to
+ * the libaio engine). */
+struct iiod_uring * iiod_uring_create(void);
+void iiod_uring_destroy(struct iiod_uring *ur);
+
+/* Transfer up to QUEUE_DEPTH * MAX_REQ_SIZE bytes to/from the endpoint
+ * file descriptor "fd". "stop_fd" is the thread pool's stop event fd;
+ * when it fires, the in-flight requests are cancelled and 0 is returned
+ * (EOF), matching the libaio engine's semantics. */
+ssize_t iiod_uring_rw(struct iiod_uring *ur, int fd, void *buf, size_t len,
+		      bool do_read, int stop_fd);
+
+#endif /* __IIOD_URING_H__ */
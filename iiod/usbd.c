@@ -45,8 +45,7 @@ struct usbd_pdata {
 	struct thread_pool **pool;
 	unsigned int nb_pipes;
 
-	const void *xml_zstd;
-	size_t xml_zstd_len;
+	const struct iiod_xml_cache *xml_cache;
 };
 
 struct usbd_client_pdata {
@@ -72,8 +71,7 @@ static void usbd_client_thread(struct thread_pool *pool, void *d)
 
 	interpreter(pdata->pdata->ctx, pdata->ep_in, pdata->ep_out,
 			pdata->pdata->debug, false, true,
-			pdata->pdata->use_aio, pool,
-			pdata->pdata->xml_zstd, pdata->pdata->xml_zstd_len);
+			pdata->pdata->use_aio, pool, pdata->pdata->xml_cache);
 
 	close(pdata->ep_in);
 	close(pdata->ep_out);
@@ -351,7 +349,7 @@ int init_usb_daemon(const char *ffs, unsigned int nb_pipes)
 int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 		bool debug, bool use_aio, unsigned int nb_pipes,
 		int ep0_fd, struct thread_pool *pool,
-		const void *xml_zstd, size_t xml_zstd_len)
+		const struct iiod_xml_cache *xml_cache)
 {
 	struct usbd_pdata *pdata;
 	unsigned int i;
@@ -386,8 +384,7 @@ int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 	pdata->ctx = ctx;
 	pdata->debug = debug;
 	pdata->use_aio = use_aio;
-	pdata->xml_zstd = xml_zstd;
-	pdata->xml_zstd_len = xml_zstd_len;
+	pdata->xml_cache = xml_cache;
 	pdata->ep0_fd = ep0_fd;
 
 	ret = thread_pool_add_thread(pool, usbd_main, pdata, "usbd_main_thd");
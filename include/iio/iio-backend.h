@@ -93,14 +93,54 @@ struct iio_backend_ops {
 
 	int (*set_timeout)(struct iio_context *ctx, unsigned int timeout);
 
+	/* Device hotplug notification. Optional; when absent,
+	 * iio_context_watch_devices() returns -ENOSYS. */
+	int (*watch_devices)(struct iio_context *ctx,
+			     void (*cb)(const struct iio_context *ctx,
+					const char *id, bool added, void *d),
+			     void *d);
+	void (*unwatch_devices)(struct iio_context *ctx);
+
+	/* Incremental topology updates. insert_device enumerates the given
+	 * device and returns it without adding it to the context; the core
+	 * does that. remove_device frees the backend data of a device about
+	 * to be removed. Both optional. */
+	struct iio_device *(*insert_device)(struct iio_context *ctx,
+					    const char *id);
+	void (*remove_device)(struct iio_device *dev);
+
 	struct iio_buffer_pdata *(*create_buffer)(const struct iio_device *dev,
 						  unsigned int idx,
 						  struct iio_channels_mask *mask);
 	void (*free_buffer)(struct iio_buffer_pdata *pdata);
 	int (*enable_buffer)(struct iio_buffer_pdata *pdata,
 			     size_t nb_samples, bool enable);
+
+	/* Enable a group of buffers as one batch, so that the individual
+	 * starts happen back to back. Optional; when absent or returning
+	 * -ENOSYS, the core enables the buffers one by one. */
+	int (*enable_buffers)(struct iio_buffer_pdata **pdatas, size_t nb);
+
+	/* Tune the wakeup behaviour of the buffer's transfers: minimum
+	 * number of samples before a transfer wakes up (zero = one block),
+	 * and an upper bound on how long it waits for that threshold.
+	 * Optional. */
+	int (*set_wakeup)(struct iio_buffer_pdata *pdata, size_t min_samples,
+			  unsigned int max_wait_ms);
+
 	void (*cancel_buffer)(struct iio_buffer_pdata *pdata);
 
+	/* Rewrite the set of enabled channels of a disabled buffer.
+	 * Like create_buffer, the backend may enable extra bits in the mask
+	 * for channels that are coupled together. */
+	int (*update_mask)(struct iio_buffer_pdata *pdata,
+			   struct iio_channels_mask *mask);
+
+	/* Report which transfer mechanism the blocks of this buffer use.
+	 * Optional; when absent, IIO_BUFFER_MECHANISM_UNKNOWN is assumed. */
+	enum iio_buffer_mechanism
+	(*get_mechanism)(const struct iio_buffer_pdata *pdata);
+
 	ssize_t (*readbuf)(struct iio_buffer_pdata *pdata,
 			   void *dst, size_t len);
 	ssize_t (*writebuf)(struct iio_buffer_pdata *pdata,
@@ -115,6 +155,23 @@ struct iio_backend_ops {
 	int (*dequeue_block)(struct iio_block_pdata *pdata, bool nonblock);
 
 	int (*get_dmabuf_fd)(struct iio_block_pdata *pdata);
+
+	int (*read_attrs_bulk)(const struct iio_context *ctx,
+			       struct iio_bulk_attr *attrs, size_t nb);
+	int (*write_attrs_bulk)(const struct iio_context *ctx,
+				struct iio_bulk_attr *attrs, size_t nb);
+
+	/* Batch register access in one protocol command. Backends that
+	 * don't support it (or talk to a server that doesn't) return
+	 * -ENOSYS; the core then falls back to one access per register. */
+	int (*reg_read_multi)(struct iio_device *dev, const uint32_t *addrs,
+			      uint32_t *values, size_t nb);
+	int (*reg_write_multi)(struct iio_device *dev, const uint32_t *addrs,
+			       const uint32_t *values, size_t nb);
+
+	/* Discover the channels and attributes of a device that was
+	 * registered lazily (see iio_context_params.lazy). */
+	int (*hydrate)(struct iio_device *dev);
 };
 
 /**
@@ -176,6 +233,18 @@ iio_create_context_from_xml(const struct iio_context_params *params,
 			    const char *description, const char **ctx_attr,
 			    const char **ctx_values, unsigned int nb_ctx_attrs);
 
+/* Serialize the context description to the compact binary format.
+ * On success, *out points to a newly allocated buffer (to be freed by the
+ * caller) and the number of bytes is returned. */
+__api __check_ret ssize_t
+iio_context_serialize_binary(const struct iio_context *ctx, void **out);
+
+/* Same, restricted to the devices whose ID, name or label appears in the
+ * comma-separated list "devs". Returns -ENODEV if nothing matches. */
+__api __check_ret ssize_t
+iio_context_serialize_binary_filtered(const struct iio_context *ctx,
+				      void **out, const char *devs);
+
 /* Allocate zeroed out memory */
 static inline void *zalloc(size_t size)
 {
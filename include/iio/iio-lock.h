@@ -36,17 +36,34 @@ __api struct iio_thrd * iio_thrd_create(int (*thrd)(void *),
 					void *d, const char *name);
 __api int iio_thrd_join_and_destroy(struct iio_thrd *thrd);
 
+__api int iio_thrd_set_affinity(struct iio_thrd *thrd, unsigned int cpu);
+__api int iio_thrd_set_priority(struct iio_thrd *thrd, int priority);
+
 __api struct iio_task * iio_task_create(int (*task)(void *firstarg, void *d),
 					void *firstarg, const char *name);
+__api struct iio_task * iio_task_create_pool(int (*task)(void *firstarg, void *d),
+					     void *firstarg, const char *name,
+					     unsigned int nb_workers);
 __api void iio_task_flush(struct iio_task *task);
 __api int iio_task_destroy(struct iio_task *task);
 
 __api void iio_task_start(struct iio_task *task);
 __api void iio_task_stop(struct iio_task *task);
 
+__api int iio_task_set_affinity(struct iio_task *task, unsigned int cpu);
+__api int iio_task_set_priority(struct iio_task *task, int priority);
+
 __api struct iio_task_token * iio_task_enqueue(struct iio_task *task, void *elm);
+/* Same as iio_task_enqueue(), but the element joins a high-priority class
+ * that is always dispatched before normally enqueued elements. Elements
+ * of the same class never overtake each other. */
+__api struct iio_task_token * iio_task_enqueue_prio(struct iio_task *task, void *elm);
 __api int iio_task_enqueue_autoclear(struct iio_task *task, void *elm);
 
+/* Returns true if at least one enqueued element has not been dispatched
+ * to a worker yet. Useful for task callbacks that can batch their work
+ * with what is already queued behind them. */
+__api _Bool iio_task_has_pending(struct iio_task *task);
 __api _Bool iio_task_is_done(struct iio_task_token *token);
 __api int iio_task_sync(struct iio_task_token *token, unsigned int timeout_ms);
 __api void iio_task_cancel(struct iio_task_token *token);
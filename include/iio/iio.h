@@ -88,11 +88,13 @@ typedef ptrdiff_t ssize_t;
 
 struct iio_block;
 struct iio_context;
+struct iio_context_future;
 struct iio_device;
 struct iio_channel;
 struct iio_channels_mask;
 struct iio_buffer;
 struct iio_scan;
+struct iio_scan_monitor;
 struct iio_stream;
 
 /**
@@ -142,6 +144,15 @@ struct iio_context_params {
 	 * sent to the standard output.
 	 * If zero, defaults to LEVEL_WARNING. */
 	enum iio_log_level stderr_level;
+
+	/** @brief If true, backends that support it will register devices
+	 * from the directory listing only; the discovery of each device's
+	 * channels and attributes is deferred to the first access to that
+	 * device, and the context description is generated on demand.
+	 * The deferred discovery is serialized internally, so a device may
+	 * be accessed from several threads; the first access may block
+	 * while another thread performs the discovery. */
+	bool lazy;
 };
 
 /*
@@ -348,6 +359,34 @@ __api __check_ret struct iio_scan *
 iio_scan(const struct iio_context_params *params, const char *backends);
 
 
+/** @brief Start scanning backends for IIO contexts, without blocking
+ * @param params A pointer to a iio_context_params structure that contains
+ *   context creation information; can be NULL
+ * @param backends a NULL-terminated string containing a comma-separated list
+ *   of the backends to be scanned for contexts. If NULL, all the available
+ *   backends are scanned.
+ * @return On success, a pointer to an iio_scan structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> Each backend is scanned in its own thread, so a slow
+ * backend does not delay the results of the others. Use iio_scan_poll()
+ * to wait for results; they can be read with the regular accessors as
+ * they arrive. */
+__api __check_ret struct iio_scan *
+iio_scan_start(const struct iio_context_params *params, const char *backends);
+
+
+/** @brief Wait for new results of an ongoing scan
+ * @param ctx A pointer to an iio_scan structure
+ * @param timeout_ms Maximum time to wait for a new result, in milliseconds.
+ *   A value of 0 means no timeout.
+ * @return 1 if new results may still arrive (some backends are still
+ *   scanning)
+ * @return 0 once all backends completed their scan
+ * @return -ETIMEDOUT if the timeout expired before any new result arrived */
+__api int iio_scan_poll(struct iio_scan *ctx, unsigned int timeout_ms);
+
+
 /** @brief Destroy the given scan context
  * @param ctx A pointer to an iio_scan structure
  *
@@ -358,8 +397,10 @@ __api void iio_scan_destroy(struct iio_scan *ctx);
 /** @brief Get number of results of a scan operation
  * @param ctx A pointer to an iio_scan structure
  * @return The number of results of the scan operation
- */
-__api __check_ret __pure size_t
+ *
+ * <b>NOTE:</b> The count may still increase while backends started with
+ * iio_scan_start() are scanning. */
+__api __check_ret size_t
 iio_scan_get_results_count(const struct iio_scan *ctx);
 
 
@@ -368,7 +409,7 @@ iio_scan_get_results_count(const struct iio_scan *ctx);
  * @param idx The index of the scanned context
  * @return On success, a pointer to a NULL-terminated string
  * @return If the index is invalid, NULL is returned */
-__api __check_ret __pure const char *
+__api __check_ret const char *
 iio_scan_get_description(const struct iio_scan *ctx, size_t idx);
 
 
@@ -377,10 +418,52 @@ iio_scan_get_description(const struct iio_scan *ctx, size_t idx);
  * @param idx The index of the scanned context
  * @return On success, a pointer to a NULL-terminated string
  * @return If the index is invalid, NULL is returned */
-__api __check_ret __pure const char *
+__api __check_ret const char *
 iio_scan_get_uri(const struct iio_scan *ctx, size_t idx);
 
 
+/** @brief Create a scan monitor
+ * @param params A pointer to a iio_context_params structure that contains
+ *   context creation information; can be NULL
+ * @param backends a NULL-terminated string containing a comma-separated list
+ *   of the backends to be scanned for contexts. If NULL, all the available
+ *   backends are scanned.
+ * @param interval_ms Delay between two background scans, in milliseconds.
+ *   A value of 0 selects a default interval.
+ * @param cb Optional callback, invoked each time a context appears
+ *   ("connected" set) or disappears ("connected" cleared); can be NULL
+ * @param d A pointer that will be passed to the callback function
+ * @return On success, a pointer to an iio_scan_monitor structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> The monitor keeps scanning in the background and caches
+ * the results, so that iio_scan_monitor_get_results() answers instantly
+ * instead of paying the full scan latency on every call. */
+__api __check_ret struct iio_scan_monitor *
+iio_scan_monitor_create(const struct iio_context_params *params,
+			const char *backends, unsigned int interval_ms,
+			void (*cb)(void *d, const char *description,
+				   const char *uri, _Bool connected),
+			void *d);
+
+
+/** @brief Get a snapshot of the monitor's cached scan results
+ * @param mon A pointer to an iio_scan_monitor structure
+ * @return On success, a pointer to an iio_scan structure, to be disposed
+ *   of with iio_scan_destroy()
+ * @return On failure, a pointer-encoded error is returned */
+__api __check_ret struct iio_scan *
+iio_scan_monitor_get_results(struct iio_scan_monitor *mon);
+
+
+/** @brief Destroy the given scan monitor
+ * @param mon A pointer to an iio_scan_monitor structure
+ *
+ * <b>NOTE:</b> This function may block until the ongoing background
+ * scan completes. */
+__api void iio_scan_monitor_destroy(struct iio_scan_monitor *mon);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Top-level functions -----------------------------*/
 /** @defgroup TopLevel Top-level functions
@@ -479,6 +562,44 @@ __api __check_ret struct iio_context *
 iio_create_context(const struct iio_context_params *params, const char *uri);
 
 
+/** @brief Start creating an IIO context in the background
+ * @param params A pointer to a iio_context_params structure that contains
+ *   context creation information; can be NULL
+ * @param uri A URI describing the context location, as understood by
+ *   iio_create_context()
+ * @return On success, a pointer to an iio_context_future structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * The DNS resolution, connection and description transfer run in a worker
+ * thread; many contexts can therefore be brought up concurrently by starting
+ * their futures first and collecting them afterwards. Each future must
+ * eventually be passed to iio_context_future_get(), which is also the
+ * only way to dispose of it. */
+__api __check_ret struct iio_context_future *
+iio_create_context_async(const struct iio_context_params *params,
+			 const char *uri);
+
+
+/** @brief Check whether a context future has completed
+ * @param future A pointer to an iio_context_future structure
+ * @return True if iio_context_future_get() will return without blocking
+ *
+ * Note that a completed future may hold a pointer-encoded error rather
+ * than a context. */
+__api bool iio_context_future_done(struct iio_context_future *future);
+
+
+/** @brief Wait for a context future and collect its result
+ * @param future A pointer to an iio_context_future structure
+ * @return On success, a pointer to an iio_context structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> This function destroys the future; the pointer shall be
+ * considered invalid afterwards. */
+__api __check_ret struct iio_context *
+iio_context_future_get(struct iio_context_future *future);
+
+
 /** @brief Destroy the given context
  * @param ctx A pointer to an iio_context structure
  *
@@ -612,6 +733,88 @@ __api __check_ret int iio_context_set_timeout(
 		struct iio_context *ctx, unsigned int timeout_ms);
 
 
+/** @brief Set the time-to-live of the context's attribute value cache
+ * @param ctx A pointer to an iio_context structure
+ * @param ttl_ms The time in milliseconds during which a value read from an
+ * attribute may be served again from memory instead of being re-read from
+ * the hardware. A value of 0 (the default) disables the cache.
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * Useful when many attributes are static after boot (scale, name,
+ * available-lists...) but are polled repeatedly, as every read otherwise
+ * costs a syscall or a network round trip. A successful attribute write
+ * through the library invalidates the cached value of that attribute;
+ * values changed behind the library's back (e.g. by another process) are
+ * only picked up once the TTL expires. Debug attributes are never cached.
+ * Changing the TTL flushes the cache. The IIO_ATTR_CACHE environment
+ * variable provides the initial TTL, in milliseconds. */
+__api __check_ret int iio_context_set_attr_cache_ttl(
+		struct iio_context *ctx, unsigned int ttl_ms);
+
+
+/** @brief Get notified when devices appear on or disappear from the bus
+ * @param ctx A pointer to an iio_context structure
+ * @param cb A callback invoked with the kernel ID of the device (e.g.
+ * "iio:device3" or "trigger2") each time a device is added or removed
+ * @param d A pointer that will be passed to the callback
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned. Backends without
+ * hotplug support return -ENOSYS.
+ *
+ * With the local backend, the callback is driven by kernel uevents and
+ * fires within milliseconds of the device being probed or removed, from a
+ * dedicated thread. The context's own device list is not modified: the
+ * callback tells the application that a device appeared or disappeared, so
+ * that it can e.g. re-create its context instead of polling with full
+ * re-enumerations. Only one watcher can be active per context. */
+__api __check_ret int iio_context_watch_devices(
+		struct iio_context *ctx,
+		void (*cb)(const struct iio_context *ctx, const char *id,
+			   bool added, void *d),
+		void *d);
+
+
+/** @brief Stop watching for device hotplug events
+ * @param ctx A pointer to an iio_context structure
+ *
+ * The watcher thread is stopped and joined; once this function returns,
+ * the callback registered with iio_context_watch_devices() will not be
+ * called anymore. Called automatically when the context is destroyed. */
+__api void iio_context_unwatch_devices(struct iio_context *ctx);
+
+
+/** @brief Add a newly probed device to a live context
+ * @param ctx A pointer to an iio_context structure
+ * @param id The kernel ID of the device (e.g. "iio:device3" or
+ * "trigger2"), as reported by iio_context_watch_devices()
+ * @return On success, a pointer to the new iio_device structure
+ * @return On failure, a pointer-encoded error is returned. Backends
+ * without support return -ENOSYS; a device with that ID already present
+ * returns -EEXIST.
+ *
+ * The device is appended to the context's device list: the pointers and
+ * indices of the existing devices, channels and buffers are unaffected,
+ * so long-running applications keep their handles instead of paying a
+ * full context re-creation on every hotplug event. */
+__api __check_ret struct iio_device *
+iio_context_insert_device(struct iio_context *ctx, const char *id);
+
+
+/** @brief Remove a device from a live context
+ * @param ctx A pointer to an iio_context structure
+ * @param dev A pointer to the iio_device structure to remove
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * The device structure and its channels are freed; all pointers to them
+ * become invalid, while the other devices of the context are unaffected.
+ * Any buffer or stream created on the device must be destroyed first, and
+ * the device must not be set as the trigger of another device. */
+__api __check_ret int
+iio_context_remove_device(struct iio_context *ctx, struct iio_device *dev);
+
+
 /** @brief Get a pointer to the params structure
  * @param ctx A pointer to an iio_context structure
  * @return A pointer to the context's iio_context_params structure */
@@ -809,6 +1012,100 @@ iio_device_attr_write_raw(const struct iio_device *dev,
 		 double: iio_device_attr_write_double)(dev, attr, val)
 
 
+/**
+ * @struct iio_bulk_attr
+ * @brief Describes one attribute access of a bulk read or write operation.
+ */
+struct iio_bulk_attr {
+	/** @brief Device the attribute belongs to */
+	const struct iio_device *dev;
+
+	/** @brief Channel, for channel-specific attributes; NULL otherwise */
+	const struct iio_channel *chn;
+
+	/** @brief Name of the attribute */
+	const char *attr;
+
+	/** @brief Type of the attribute when "chn" is NULL: 0 for
+	 * device-specific, 1 for debug, 2 for buffer-specific attributes */
+	unsigned int type;
+
+	/** @brief Index of the hardware buffer, for buffer-specific
+	 * attributes */
+	unsigned int buf_id;
+
+	/** @brief Value buffer, where the value read is stored, or
+	 * containing the value to write */
+	char *value;
+
+	/** @brief Size of the value buffer for reads, length of the value
+	 * for writes, in bytes */
+	size_t len;
+
+	/** @brief Per-attribute result: on success, the number of bytes
+	 * read or written; on error, a negative errno code */
+	ssize_t ret;
+};
+
+
+/** @brief Read several attributes in one operation
+ * @param attrs An array of iio_bulk_attr structures, all referring to
+ * devices of the same context
+ * @param nb Number of entries in the array
+ * @return On success, 0 is returned and the "ret" field of each entry
+ * contains the result of the individual read
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> With the network backend and a recent iiod, all attributes
+ * are read in a single command / response round trip. Other backends fall
+ * back to reading the attributes one by one. */
+__api __check_ret int iio_attrs_read_bulk(struct iio_bulk_attr *attrs,
+					  size_t nb);
+
+
+/** @brief Write several attributes in one operation
+ * @param attrs An array of iio_bulk_attr structures, all referring to
+ * devices of the same context
+ * @param nb Number of entries in the array
+ * @return On success, 0 is returned and the "ret" field of each entry
+ * contains the result of the individual write
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> With the network backend and a recent iiod, all attributes
+ * are written in a single command / response round trip. Other backends
+ * fall back to writing the attributes one by one. */
+__api __check_ret int iio_attrs_write_bulk(struct iio_bulk_attr *attrs,
+					   size_t nb);
+
+
+/** @brief Queue an attribute write without waiting for its completion
+ * @param attr A pointer to an iio_bulk_attr structure describing the
+ * write; the attribute name and value are copied, so the caller's
+ * structure and buffers can be reused as soon as the call returns
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * The write is only performed at the next iio_attrs_write_flush() call,
+ * which also reports its outcome; destroying the context discards any
+ * write still queued. The "ret" field of the structure is ignored.
+ *
+ * <b>NOTE:</b> Queued writes are pipelined through iio_attrs_write_bulk()
+ * at the flush, so with the network backend a whole burst of writes
+ * costs a single command / response round trip. */
+__api int iio_attr_write_async(const struct iio_bulk_attr *attr);
+
+
+/** @brief Perform all the attribute writes queued on the given context
+ * @param ctx A pointer to an iio_context structure
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned; if several queued
+ * writes failed, the error of the first one is reported
+ *
+ * This call acts as the write barrier of iio_attr_write_async(): when it
+ * returns, all previously queued writes have been performed. */
+__api __check_ret int iio_attrs_write_flush(const struct iio_context *ctx);
+
+
 /** @brief Read the content of the given buffer-specific attribute
  * @param dev A pointer to an iio_device structure
  * @param buf_id The index of the hardware buffer (generally 0)
@@ -1207,6 +1504,24 @@ __api void iio_buffer_cancel(struct iio_buffer *buf);
 __api __check_ret int iio_buffer_enable(struct iio_buffer *buf);
 
 
+/** @brief Enable a group of buffers with minimal skew between the starts
+ * @param buffers An array of pointers to iio_buffer structures, all
+ * belonging to the same context
+ * @param nb The number of buffers in the array
+ * @return On success, 0
+ * @return On error, a negative error code is returned; no buffer of the
+ * group is left enabled
+ *
+ * <b>NOTE:</b> All per-buffer preparation (validation, channel setup) is
+ * performed first, then the actual enables are triggered back to back.
+ * Over the binary network protocol the enable commands are pipelined into
+ * a single batch, so the server performs the starts immediately after one
+ * another instead of one network round trip apart. Useful for
+ * phase-coherent multi-device capture. */
+__api __check_ret int iio_buffers_enable_sync(struct iio_buffer **buffers,
+					      size_t nb);
+
+
 /** @brief Disable the buffer
  * @param buf A pointer to an iio_buffer structure
  * @return On success, 0
@@ -1224,6 +1539,160 @@ __api const struct iio_channels_mask *
 iio_buffer_get_channels_mask(const struct iio_buffer *buf);
 
 
+/** @brief Change the channels enabled for the given buffer, in place
+ * @param buf A pointer to an iio_buffer structure
+ * @param mask A pointer to an iio_channels_mask structure
+ * @return On success, 0
+ * @return On error, a negative error code is returned
+ *
+ * Avoids the full teardown/re-creation cycle that changing channels
+ * otherwise requires: the buffer is disabled, the new set of channels is
+ * written to the hardware, and the existing blocks are reused. All blocks
+ * must have been dequeued first, and the size of the blocks must be a
+ * multiple of the new sample size. The buffer is left disabled; re-enqueue
+ * blocks and call iio_buffer_enable() to resume streaming.
+ *
+ * <b>NOTE:</b> Only supported by backends that provide a mask update
+ * operation; others return -ENOSYS. */
+__api __check_ret int
+iio_buffer_update_mask(struct iio_buffer *buf,
+		       const struct iio_channels_mask *mask);
+
+
+/**
+ * @enum iio_buffer_mechanism
+ * @brief Transfer mechanism used by the blocks of a buffer
+ */
+enum iio_buffer_mechanism {
+	IIO_BUFFER_MECHANISM_UNKNOWN,
+	IIO_BUFFER_MECHANISM_FILEIO,
+	IIO_BUFFER_MECHANISM_MMAP,
+	IIO_BUFFER_MECHANISM_DMABUF,
+};
+
+
+/** @brief Report the transfer mechanism used by the given buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @return The active transfer mechanism
+ *
+ * The local backend silently falls back to read() / write() based file I/O
+ * when the kernel does not support the high-speed mmap or DMABUF
+ * interfaces; this function tells which path is actually in use. The
+ * mechanism is only determined when the first block of the buffer is
+ * created; before that, or with backends that do not report it,
+ * IIO_BUFFER_MECHANISM_UNKNOWN is returned. */
+__api enum iio_buffer_mechanism
+iio_buffer_get_mechanism(const struct iio_buffer *buf);
+
+
+/** @brief Get a pollable event file descriptor for the given buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @return On success, a file descriptor that becomes readable each time a
+ * block of this buffer completes
+ * @return On failure (or on platforms or backends without support), a
+ * negative errno code is returned
+ *
+ * <b>NOTE:</b> The descriptor is a counting eventfd: each completed block
+ * increments the counter, and reading eight bytes from the descriptor
+ * resets it. Combine it with non-blocking calls to iio_block_dequeue() or
+ * iio_stream_get_any_block() to stream from an event loop. Blocks that are
+ * enqueued directly to a kernel-managed queue (e.g. the local backend's
+ * mmap or DMABUF interfaces) do not signal the descriptor. */
+__api __check_ret int iio_buffer_get_event_fd(const struct iio_buffer *buf);
+
+
+/** @brief Set the scheduling attributes of the buffer's worker thread
+ * @param buf A pointer to an iio_buffer structure
+ * @param cpu The index of the CPU the worker should be pinned to, or a
+ * negative value to leave the affinity unchanged
+ * @param priority A positive SCHED_FIFO priority for the worker, or zero
+ * to keep the default scheduling policy
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Real-time priorities usually require elevated privileges
+ * (e.g. CAP_SYS_NICE on Linux). Call this before iio_buffer_enable() so
+ * that the very first block is already processed with the new
+ * attributes. */
+__api int iio_buffer_set_worker_attrs(struct iio_buffer *buf,
+				      int cpu, int priority);
+
+
+/** @brief Tune the wakeup behaviour of the buffer's transfers
+ * @param buf A pointer to an iio_buffer structure
+ * @param min_bytes Minimum number of bytes that should be ready before a
+ * transfer wakes up, or zero to wake once per full block (the default)
+ * @param max_wait_ms Upper bound, in milliseconds, on how long a transfer
+ * waits for the threshold before proceeding with the data already
+ * available, or zero to wait until the buffer's timeout
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned (-ENOSYS if the
+ * backend does not support tuning the wakeup behaviour)
+ *
+ * By default the kernel watermark is driven from the block size, so the
+ * transfer loop wakes once per block instead of once per sample batch.
+ * "min_bytes" lowers that threshold (it is rounded down to a whole
+ * number of samples and clamped to the block size) for configurations
+ * that want data earlier. Call this before iio_buffer_enable(); the
+ * threshold is programmed when the buffer is enabled. */
+__api int iio_buffer_set_wakeup(struct iio_buffer *buf, size_t min_bytes,
+				unsigned int max_wait_ms);
+
+
+/**
+ * @struct iio_buffer_stats
+ * @brief Transfer statistics of a buffer.
+ *
+ * All counters accumulate from the creation of the buffer; latencies are
+ * measured from iio_block_enqueue() to the completion of the transfer.
+ */
+struct iio_buffer_stats {
+	/** @brief Number of blocks transferred successfully */
+	uint64_t blocks_transferred;
+
+	/** @brief Number of payload bytes transferred successfully */
+	uint64_t bytes_transferred;
+
+	/** @brief Number of transfers that failed with an I/O error, which
+	 * typically corresponds to an overflow or underflow reported by the
+	 * kernel */
+	uint64_t xruns;
+
+	/** @brief Shortest enqueue-to-completion latency seen, in microseconds */
+	uint64_t latency_min_us;
+
+	/** @brief Longest enqueue-to-completion latency seen, in microseconds */
+	uint64_t latency_max_us;
+
+	/** @brief Latency histogram: bucket N counts the transfers whose
+	 * enqueue-to-completion latency was in [2^N, 2^(N+1)) microseconds
+	 * (bucket 0 also counts sub-microsecond transfers) */
+	uint64_t latency_buckets[32];
+
+	/** @brief Highest number of blocks that were enqueued simultaneously */
+	unsigned int queue_depth_hwm;
+
+	/** @brief Payload bytes missing from completed transfers, e.g.
+	 * datagrams dropped by the network backend's UDP streaming mode.
+	 * A transfer where nothing arrived counts as an xrun instead. */
+	uint64_t bytes_lost;
+};
+
+
+/** @brief Take a snapshot of the buffer's transfer statistics
+ * @param buf A pointer to an iio_buffer structure
+ * @param stats A pointer to an iio_buffer_stats structure, filled with a
+ * consistent snapshot of the counters
+ * @return On success, 0
+ * @return On error, a negative error code is returned
+ *
+ * <b>NOTE:</b> The counters are updated as part of the regular block
+ * enqueue/dequeue path and are cheap enough to leave on in production;
+ * there is no knob to disable them. */
+__api int iio_buffer_get_stats(const struct iio_buffer *buf,
+			       struct iio_buffer_stats *stats);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* -------------------------- Block functions --------------------------------*/
 /** @defgroup Block Block
@@ -1241,6 +1710,22 @@ __api __check_ret struct iio_block *
 iio_buffer_create_block(struct iio_buffer *buffer, size_t size);
 
 
+/** @brief Create a data block that may be split into segments
+ * @param buf A pointer to an iio_buffer structure
+ * @param size The size of the block to create, in bytes
+ * @return On success, a pointer to an iio_block structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> Behaves like iio_buffer_create_block(), except that when a
+ * large contiguous allocation fails (e.g. on fragmented long-uptime
+ * systems), the block is created from several page-aligned segments
+ * instead of failing with -ENOMEM. Callers must then be prepared for
+ * iio_block_start(), iio_block_end() and iio_block_first() to return
+ * NULL, and access the samples through iio_block_get_segments(). */
+__api __check_ret struct iio_block *
+iio_buffer_create_block_segmented(struct iio_buffer *buffer, size_t size);
+
+
 /** @brief Destroy the given block
  * @param block A pointer to an iio_block structure */
 __api void iio_block_destroy(struct iio_block *block);
@@ -1248,7 +1733,8 @@ __api void iio_block_destroy(struct iio_block *block);
 
 /** @brief Get the start address of the block
  * @param buf A pointer to an iio_block structure
- * @return A pointer corresponding to the start address of the block */
+ * @return A pointer corresponding to the start address of the block, or
+ * NULL if the block is not contiguous (see iio_block_get_segments()) */
 __api void *iio_block_start(const struct iio_block *block);
 
 
@@ -1284,6 +1770,47 @@ __api void *iio_block_first(const struct iio_block *block,
 __api void *iio_block_end(const struct iio_block *block);
 
 
+/** @struct iio_block_segment
+ * @brief One contiguous segment of a block's memory */
+struct iio_block_segment {
+	/** Start address of the segment */
+	void *data;
+
+	/** Length of the segment, in bytes */
+	size_t len;
+};
+
+
+/** @brief Get the list of memory segments composing the block
+ * @param block A pointer to an iio_block structure
+ * @param segments On success, set to the block's array of segments. The
+ *   array is owned by the block and stays valid until it is destroyed.
+ * @return The number of segments in the array
+ *
+ * <b>NOTE:</b> Blocks are contiguous whenever possible, in which case a
+ * single segment covering the whole block is returned. Only blocks
+ * created with iio_buffer_create_block_segmented() may be composed of
+ * several page-aligned segments, when a large contiguous allocation
+ * fails; iio_block_start(), iio_block_end() and iio_block_first() then
+ * return NULL and the samples must be accessed through the segment
+ * list. */
+__api size_t iio_block_get_segments(const struct iio_block *block,
+				    const struct iio_block_segment **segments);
+
+
+/** @brief Get the file descriptor of the DMABUF backing the block
+ * @param block A pointer to an iio_block structure
+ * @return On success, the file descriptor of the DMABUF
+ * @return On error, a negative errno code is returned. -ENOSYS is returned
+ * if the block is not backed by a DMABUF.
+ *
+ * <b>NOTE:</b> The file descriptor is owned by the block and stays valid
+ * until the block is destroyed. It can be used to import the block's memory
+ * into GPU or accelerator pipelines (CUDA, Vulkan, V4L2...) without copying
+ * the data. */
+__api __check_ret int iio_block_get_dmabuf_fd(const struct iio_block *block);
+
+
 /** @brief Call the supplied callback for each sample found in a block
  * @param block A pointer to an iio_block structure
  * @param callback A pointer to a function to call for each sample found
@@ -1303,6 +1830,34 @@ iio_block_foreach_sample(const struct iio_block *block,
 			 void *data);
 
 
+/** @brief Call the supplied callback once per channel, with the channel's
+ * whole run of samples
+ * @param block A pointer to an iio_block structure
+ * @param mask The channels mask describing the channels to process
+ * @param callback A pointer to a function to call for each enabled channel
+ * @param data A user-specified pointer that will be passed to the callback
+ * @return number of bytes processed.
+ *
+ * <b>NOTE:</b> The callback receives five arguments:
+ * * A pointer to the iio_channel structure corresponding to the run,
+ * * A pointer to the channel's first sample in the block,
+ * * The number of samples in the run,
+ * * The distance between two consecutive samples, in bytes,
+ * * The user-specified pointer passed to iio_block_foreach_chunk.
+ *
+ * Unlike iio_block_foreach_sample, which performs one indirect call per
+ * sample per channel, this variant hands out one strided span per channel,
+ * so the callback can process samples in bulk. When a single channel is
+ * enabled, the stride equals the sample length and the run is contiguous. */
+__api __check_ret ssize_t
+iio_block_foreach_chunk(const struct iio_block *block,
+			const struct iio_channels_mask *mask,
+			ssize_t (*callback)(const struct iio_channel *chn,
+					    void *first, size_t nb_samples,
+					    size_t stride, void *d),
+			void *data);
+
+
 /** @brief Enqueue the given iio_block to the buffer's queue
  * @param block A pointer to an iio_block structure
  * @param bytes_used The size of the data from the iio_block to be written,
@@ -1332,6 +1887,21 @@ __api int iio_block_dequeue(struct iio_block *block, bool nonblock);
 __api struct iio_buffer * iio_block_get_buffer(const struct iio_block *block);
 
 
+/** @brief Get the capture timestamp of the given iio_block
+ * @param block A pointer to an iio_block structure
+ * @return The monotonic timestamp, in microseconds, taken when the
+ *   block's last transfer completed, or 0 if the block has not completed
+ *   a transfer yet
+ *
+ * <b>NOTE:</b> The timestamp is taken as close to the hardware transfer
+ * completion as the backend allows: on the local backend when the device
+ * read or write returns, on remote backends when the block's payload has
+ * been fully received. It shares its epoch with the buffer statistics
+ * counters, so blocks captured from different devices of the same context
+ * can be ordered and aligned against each other. */
+__api uint64_t iio_block_get_timestamp(const struct iio_block *block);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Stream functions --------------------------------*/
 /** @defgroup Stream Stream
@@ -1343,7 +1913,13 @@ __api struct iio_buffer * iio_block_get_buffer(const struct iio_block *block);
 /** @brief Create a iio_stream object for the given iio_buffer
  * @param buffer A pointer to an iio_buffer structure
  * @param nb_blocks The number of iio_block objects to create, internally.
- *   In doubt, a good value is 4.
+ *   In doubt, a good value is 4. Pass zero to let the library tune the
+ *   block count automatically: the stream then starts with a conservative
+ *   number of blocks in flight and adjusts it online from the observed
+ *   underruns and completion latency jitter, converging to the smallest
+ *   count that sustains zero underruns. The automatic tuning only applies
+ *   to iio_stream_get_next_block(); iio_stream_get_any_block() always
+ *   uses the full ring.
  * @param samples_count The size of the iio_block objects, in samples
  * @return On success, a pointer to an iio_stream structure
  * @return On failure, a pointer-encoded error is returned */
@@ -1366,6 +1942,30 @@ __api __check_ret const struct iio_block *
 iio_stream_get_next_block(struct iio_stream *stream);
 
 
+/** @brief Get a pointer to the first data block that completed
+ * @param stream A pointer to an iio_stream structure
+ * @param seqno If not NULL, set on success to a monotonic sequence number
+ * that reflects the order of the blocks' data, so that consumers can
+ * reorder blocks that completed out of order
+ * @return On success, a pointer to an iio_block structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> Unlike iio_stream_get_next_block(), this function returns
+ * whichever enqueued block completes first, which avoids stalling on one
+ * slow block when later blocks already completed. The two functions cannot
+ * be mixed on the same stream; the first one called selects the scheme. */
+__api __check_ret const struct iio_block *
+iio_stream_get_any_block(struct iio_stream *stream, uint64_t *seqno);
+
+
+/** @brief Get a pollable event file descriptor for the stream's buffer
+ * @param stream A pointer to an iio_stream structure
+ * @return On success, a file descriptor that becomes readable each time a
+ * block completes; see iio_buffer_get_event_fd()
+ * @return On failure, a negative errno code is returned */
+__api __check_ret int iio_stream_get_event_fd(const struct iio_stream *stream);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ---------------------------- HWMON support --------------------------------*/
 /** @defgroup Hwmon Compatibility with hardware monitoring (hwmon) devices
@@ -1517,6 +2117,34 @@ __api void iio_channel_convert_inverse(const struct iio_channel *chn,
 		void *dst, const void *src);
 
 
+/** @brief Convert an array of samples from hardware format to host format
+ * @param chn A pointer to an iio_channel structure
+ * @param dst A pointer to the destination buffer where the converted samples
+ * should be written
+ * @param src A pointer to the source buffer containing the samples
+ * @param nb_samples Number of samples to convert
+ *
+ * <b>NOTE:</b> For the common 16-bit and 32-bit sample formats the
+ * conversion is performed with vectorized (SIMD) kernels selected at
+ * runtime; other layouts fall back to per-sample conversion. */
+__api void iio_channel_convert_array(const struct iio_channel *chn,
+		void *dst, const void *src, size_t nb_samples);
+
+
+/** @brief Convert an array of samples from host format to hardware format
+ * @param chn A pointer to an iio_channel structure
+ * @param dst A pointer to the destination buffer where the converted samples
+ * should be written
+ * @param src A pointer to the source buffer containing the samples
+ * @param nb_samples Number of samples to convert
+ *
+ * <b>NOTE:</b> For the common 16-bit and 32-bit sample formats the
+ * conversion is performed with vectorized (SIMD) kernels selected at
+ * runtime; other layouts fall back to per-sample conversion. */
+__api void iio_channel_convert_array_inverse(const struct iio_channel *chn,
+		void *dst, const void *src, size_t nb_samples);
+
+
 /** @brief Enumerate the debug attributes of the given device
  * @param dev A pointer to an iio_device structure
  * @return The number of debug attributes found */
@@ -1626,6 +2254,36 @@ __api __check_ret int iio_device_reg_read(struct iio_device *dev,
 		uint32_t address, uint32_t *value);
 
 
+/** @brief Set the value of several hardware registers
+ * @param dev A pointer to an iio_device structure
+ * @param addrs The addresses of the registers
+ * @param values The values to set the registers to
+ * @param nb The number of registers to write
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * On remote contexts the whole batch travels in a single protocol
+ * command when the server supports it, instead of one round trip per
+ * register. Processing stops at the first register that fails. */
+__api __check_ret int iio_device_reg_write_multi(struct iio_device *dev,
+		const uint32_t *addrs, const uint32_t *values, size_t nb);
+
+
+/** @brief Get the value of several hardware registers
+ * @param dev A pointer to an iio_device structure
+ * @param addrs The addresses of the registers
+ * @param values A pointer to the array where the values will be written
+ * @param nb The number of registers to read
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * On remote contexts the whole batch travels in a single protocol
+ * command when the server supports it, instead of one round trip per
+ * register. Processing stops at the first register that fails. */
+__api __check_ret int iio_device_reg_read_multi(struct iio_device *dev,
+		const uint32_t *addrs, uint32_t *values, size_t nb);
+
+
 /** @} */
 
 #ifndef DOXYGEN
@@ -14,12 +14,36 @@
 #define __api __iio_api
 
 struct iiod_client;
+struct iiod_client_buffer_pdata;
 struct iiod_client_io;
 struct iiod_client_pdata;
 
+struct iiod_buf;
+
 struct iiod_client_ops {
 	ssize_t (*write)(struct iiod_client_pdata *desc,
 			 const char *src, size_t len, unsigned int timeout_ms);
+	/* Optional scatter-gather write. May send fewer buffers than
+	 * requested; returns the number of bytes written. Transports that
+	 * can coalesce a command header and its payload into one packet
+	 * should provide it. */
+	ssize_t (*writev)(struct iiod_client_pdata *desc,
+			  const struct iiod_buf *bufs, size_t nb,
+			  unsigned int timeout_ms);
+	/* Optional: write the buffers with the given file descriptor
+	 * attached to the first bytes as SCM_RIGHTS ancillary data. Only
+	 * Unix-domain socket transports can provide it. */
+	ssize_t (*write_fd)(struct iiod_client_pdata *desc,
+			    const struct iiod_buf *bufs, size_t nb, int fd,
+			    unsigned int timeout_ms);
+	/* Optional out-of-band block payload transfer, used when striped
+	 * transfers have been negotiated (see iiod_client_enable_stripes).
+	 * The whole payload is moved in one call; "tag" identifies the
+	 * transfer and must match on both ends. */
+	ssize_t (*write_block_oob)(struct iiod_client_pdata *desc,
+				   uint64_t tag, const void *src, size_t len);
+	ssize_t (*read_block_oob)(struct iiod_client_pdata *desc,
+				  uint64_t tag, void *dst, size_t len);
 	ssize_t (*read)(struct iiod_client_pdata *desc,
 			char *dst, size_t len, unsigned int timeout_ms);
 	ssize_t (*read_line)(struct iiod_client_pdata *desc,
@@ -39,6 +63,88 @@ __api void iiod_client_destroy(struct iiod_client *client);
 
 __api bool iiod_client_uses_binary_interface(const struct iiod_client *client);
 
+/* One command of a pipelined batch. The "op", "dev" and "code" fields
+ * have the same meaning as in struct iiod_command; "cmd_buf" optionally
+ * points to the command's payload and "resp_buf" to a buffer receiving
+ * the response's payload. On return, "ret" contains the response code
+ * of the command. */
+struct iiod_client_command {
+	uint8_t op;
+	uint8_t dev;
+	int32_t code;
+
+	const struct iiod_buf *cmd_buf;
+	const struct iiod_buf *resp_buf;
+
+	intptr_t ret;
+};
+
+/* Execute a batch of commands over the binary interface. All commands
+ * are sent back to back without waiting for any response, so a batch
+ * costs a single round trip instead of one per command. Returns a
+ * negative errno code if the batch could not be sent; the per-command
+ * response codes are returned in the entries' "ret" fields. */
+__api int iiod_client_exec_commands(struct iiod_client *client,
+				    struct iiod_client_command *cmds,
+				    size_t nb);
+
+/* Negotiate striped block transfers: the server is told that "nb"
+ * stripe connections identified by "token" will attach, and block
+ * payloads then move through the transport's out-of-band ops instead
+ * of the command stream. Requires the IIOD_FEAT_STRIPE server feature
+ * and a transport providing the oob ops. */
+__api int iiod_client_enable_stripes(struct iiod_client *client,
+				     uint64_t token, unsigned int nb);
+__api int iiod_client_enable_zstd(struct iiod_client *client, int level,
+				  const void *dict, size_t dict_len);
+__api int iiod_client_enable_pack(struct iiod_client_buffer_pdata *pdata);
+/* Allow cyclic re-enqueues of an unmodified waveform to skip the payload
+ * upload; the server then loops its local copy. Once enabled, the
+ * application must not modify a block's contents between enqueues. */
+__api int iiod_client_enable_cyclic_cache(struct iiod_client_buffer_pdata *pdata);
+/* Move block payloads of this buffer through shared memory instead of
+ * the socket: blocks are created in a memfd that both ends map, and
+ * transfers only carry the bytes_used field. Requires the
+ * IIOD_FEAT_MEMFD server feature and a transport that can pass file
+ * descriptors (Unix-domain sockets). */
+__api int iiod_client_enable_memfd(struct iiod_client_buffer_pdata *pdata);
+/* Switch a capture buffer's block payloads to an unreliable UDP data
+ * plane: lost datagrams are accounted instead of resent, so a drop
+ * never stalls the blocks behind it. The server commits at enable time
+ * and the transport must then complete the datagram handshake with the
+ * port number this returns. Requires the IIOD_FEAT_UDP server feature;
+ * rejected on TX buffers and with packed, compressed, striped or
+ * shared-memory payloads. */
+__api int iiod_client_enable_udp(struct iiod_client_buffer_pdata *pdata,
+				 uint64_t token);
+__api uint32_t iiod_client_get_server_features(const struct iiod_client *client);
+
+/* Restrict the context description to the devices whose ID, name or
+ * label appears in the comma-separated list "devs" (NULL removes the
+ * filter). Must be set before iiod_client_create_context(); ignored by
+ * servers without the IIOD_FEAT_DEV_FILTER feature, which then send
+ * the full description. */
+__api int iiod_client_set_device_filter(struct iiod_client *client,
+					const char *devs);
+
+/* Subscribe to an attribute: the server polls it every "period_ms"
+ * milliseconds (0 picks the server's default) and pushes the value
+ * whenever it changes, starting with an initial snapshot. The callback
+ * runs on the binary protocol's reader thread, with "len" the value
+ * length or a negative read error; it must not issue commands on the
+ * same client. Returns the watch ID to pass to
+ * iiod_client_unwatch_attr(), or a negative error code. Requires the
+ * IIOD_FEAT_ATTR_WATCH server feature. */
+__api int iiod_client_watch_attr(struct iiod_client *client,
+				 const struct iio_device *dev,
+				 const struct iio_channel *chn,
+				 const char *attr, enum iio_attr_type type,
+				 unsigned int buf_id, unsigned int period_ms,
+				 void (*cb)(void *d, ssize_t len,
+					    const char *value),
+				 void *d);
+__api int iiod_client_unwatch_attr(struct iiod_client *client, int watch_id);
+
 __api int iiod_client_get_trigger(struct iiod_client *client,
 				  const struct iio_device *dev,
 				  const struct iio_device **trigger);
@@ -54,6 +160,11 @@ __api int iiod_client_set_kernel_buffers_count(struct iiod_client *client,
 __api int iiod_client_set_timeout(struct iiod_client *client,
 				  unsigned int timeout);
 
+/* Re-point the client's context parameters, e.g. when it outlives the
+ * context it was attached to. */
+__api void iiod_client_set_params(struct iiod_client *client,
+				  const struct iio_context_params *params);
+
 __api ssize_t iiod_client_read_attr(struct iiod_client *client,
 				    const struct iio_device *dev,
 				    const struct iio_channel *chn,
@@ -68,6 +179,22 @@ __api ssize_t iiod_client_write_attr(struct iiod_client *client,
 				     size_t len, enum iio_attr_type type,
 				     unsigned int buf_id);
 
+__api int iiod_client_read_attrs_bulk(struct iiod_client *client,
+				      struct iio_bulk_attr *attrs, size_t nb);
+
+__api int iiod_client_write_attrs_bulk(struct iiod_client *client,
+				       struct iio_bulk_attr *attrs, size_t nb);
+
+__api int iiod_client_reg_read_multi(struct iiod_client *client,
+				     const struct iio_device *dev,
+				     const uint32_t *addrs, uint32_t *values,
+				     size_t nb);
+
+__api int iiod_client_reg_write_multi(struct iiod_client *client,
+				      const struct iio_device *dev,
+				      const uint32_t *addrs,
+				      const uint32_t *values, size_t nb);
+
 __api struct iio_context *
 iiod_client_create_context(struct iiod_client *client,
 			   const struct iio_backend *backend,
@@ -83,6 +210,13 @@ iiod_client_create_buffer(struct iiod_client *client,
 __api void iiod_client_free_buffer(struct iiod_client_buffer_pdata *pdata);
 __api int iiod_client_enable_buffer(struct iiod_client_buffer_pdata *pdata,
 				    size_t nb_samples, bool enable);
+/* Enable a group of buffers with one pipelined batch of commands: all
+ * the enables are sent back to back before waiting for any response, so
+ * the server starts the buffers microseconds apart. The buffers may
+ * share one connection or have one each. Requires the binary
+ * interface. */
+__api int iiod_client_enable_buffers(struct iiod_client_buffer_pdata **pdatas,
+				     size_t nb);
 
 __api struct iio_block_pdata *
 iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
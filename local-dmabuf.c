@@ -92,6 +92,11 @@ err_free_priv:
 	return iio_ptr(ret);
 }
 
+int local_get_dmabuf_fd(struct iio_block_pdata *pdata)
+{
+	return (int)(intptr_t) pdata->pdata;
+}
+
 void local_free_dmabuf(struct iio_block_pdata *pdata)
 {
 	int fd = (int)(intptr_t) pdata->pdata;
@@ -149,7 +154,7 @@ int local_dequeue_dmabuf(struct iio_block_pdata *pdata, bool nonblock)
 		time_ptr = &start;
 	}
 
-	ret = buffer_check_ready(buf_pdata, fd, POLLOUT, time_ptr);
+	ret = buffer_check_ready(buf_pdata, fd, POLLOUT, time_ptr, false);
 	if (ret < 0)
 		return ret;
 
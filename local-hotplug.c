@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "local.h"
+
+#include <errno.h>
+#include <iio/iio.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-lock.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Device hotplug watcher. A netlink socket subscribed to kernel uevents
+ * is polled from a dedicated thread; add / remove events of the "iio"
+ * subsystem are turned into callbacks, so applications learn about a
+ * newly probed (or removed) device within milliseconds instead of
+ * polling with full context re-enumerations.
+ */
+
+struct iio_context_pdata {
+	struct iio_context *ctx;
+	int nl_fd, cancel_fd;
+	struct iio_thrd *thrd;
+
+	void (*cb)(const struct iio_context *ctx, const char *id,
+		   bool added, void *d);
+	void *d;
+};
+
+static void local_hotplug_parse(struct iio_context_pdata *pdata,
+				const char *buf, size_t len)
+{
+	const char *devpath, *subsystem = NULL, *id;
+	size_t pos;
+	bool added;
+
+	/* Kernel uevents look like "action@devpath\0KEY=VALUE\0..." */
+	devpath = strchr(buf, '@');
+	if (!devpath)
+		return;
+	devpath++;
+
+	if (!strncmp(buf, "add@", sizeof("add@") - 1))
+		added = true;
+	else if (!strncmp(buf, "remove@", sizeof("remove@") - 1))
+		added = false;
+	else
+		return;
+
+	for (pos = strlen(buf) + 1; pos < len; pos += strlen(&buf[pos]) + 1) {
+		if (!strncmp(&buf[pos], "SUBSYSTEM=", sizeof("SUBSYSTEM=") - 1))
+			subsystem = &buf[pos] + sizeof("SUBSYSTEM=") - 1;
+	}
+
+	if (!subsystem || strcmp(subsystem, "iio"))
+		return;
+
+	id = strrchr(devpath, '/');
+	if (!id)
+		return;
+	id++;
+
+	/* Devices and triggers only; skip e.g. buffer sub-directories */
+	if (strncmp(id, "iio:device", sizeof("iio:device") - 1)
+	    && strncmp(id, "trigger", sizeof("trigger") - 1))
+		return;
+
+	pdata->cb(pdata->ctx, id, added, pdata->d);
+}
+
+static int local_hotplug_thrd(void *d)
+{
+	struct iio_context_pdata *pdata = d;
+	struct pollfd pfd[2];
+	char buf[4096];
+	ssize_t nb;
+	int ret;
+
+	pfd[0].fd = pdata->nl_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = pdata->cancel_fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		ret = poll(pfd, 2, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (pfd[1].revents & POLLIN)
+			break;
+
+		nb = recv(pdata->nl_fd, buf, sizeof(buf) - 1, 0);
+		if (nb <= 0)
+			continue;
+
+		buf[nb] = '\0';
+		local_hotplug_parse(pdata, buf, (size_t) nb);
+	}
+
+	return 0;
+}
+
+int local_watch_devices(struct iio_context *ctx,
+			void (*cb)(const struct iio_context *ctx,
+				   const char *id, bool added, void *d),
+			void *d)
+{
+	struct sockaddr_nl addr = { 0 };
+	struct iio_context_pdata *pdata;
+	int err;
+
+	if (iio_context_get_pdata(ctx))
+		return -EBUSY;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return -ENOMEM;
+
+	pdata->ctx = ctx;
+	pdata->cb = cb;
+	pdata->d = d;
+
+	pdata->nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+			      NETLINK_KOBJECT_UEVENT);
+	if (pdata->nl_fd < 0) {
+		err = -errno;
+		goto err_free_pdata;
+	}
+
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; /* Kernel events only, no libudev multicasts */
+
+	if (bind(pdata->nl_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err = -errno;
+		goto err_close_nl;
+	}
+
+	pdata->cancel_fd = eventfd(0, EFD_CLOEXEC);
+	if (pdata->cancel_fd < 0) {
+		err = -errno;
+		goto err_close_nl;
+	}
+
+	pdata->thrd = iio_thrd_create(local_hotplug_thrd, pdata,
+				      "iio-hotplug");
+	err = iio_err(pdata->thrd);
+	if (err)
+		goto err_close_eventfd;
+
+	iio_context_set_pdata(ctx, pdata);
+
+	return 0;
+
+err_close_eventfd:
+	close(pdata->cancel_fd);
+err_close_nl:
+	close(pdata->nl_fd);
+err_free_pdata:
+	free(pdata);
+	return err;
+}
+
+void local_unwatch_devices(struct iio_context *ctx)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	uint64_t event = 1;
+	ssize_t ret;
+
+	if (!pdata)
+		return;
+
+	ret = write(pdata->cancel_fd, &event, sizeof(event));
+	if (ret == sizeof(event))
+		iio_thrd_join_and_destroy(pdata->thrd);
+
+	close(pdata->cancel_fd);
+	close(pdata->nl_fd);
+	free(pdata);
+
+	iio_context_set_pdata(ctx, NULL);
+}
@@ -35,6 +35,15 @@
 
 #define BLOCK_FLAG_CYCLIC	BIT(1)
 
+#define MMAP_MAX_BLOCKS		64
+
+/* Blocks at least this big are worth backing with huge pages */
+#define MMAP_HUGEPAGE_MIN_SIZE	(2 * 1024 * 1024)
+
+/* Cached mappings of blocks at least this big get their resident pages
+ * released while idle */
+#define MMAP_DONTNEED_MIN_SIZE	(8 * 1024 * 1024)
+
 struct block_alloc_req {
 	uint32_t type,
 		 size,
@@ -58,6 +67,12 @@ struct iio_buffer_impl_pdata {
 	bool mmap_check_done;
 	bool cyclic_buffer_enqueued;
 	unsigned int nb_blocks;
+
+	/* Mappings are kept alive until the buffer itself is freed, so that
+	 * a stream restart re-uses them instead of churning the TLB with
+	 * munmap / mmap cycles. */
+	void *addrs[MMAP_MAX_BLOCKS];
+	size_t block_size;
 };
 
 struct iio_block_impl_pdata {
@@ -85,6 +100,24 @@ static bool local_is_mmap_api_supported(int fd)
 	return !ioctl_nointr(fd, BLOCK_FREE_IOCTL, NULL);
 }
 
+static void local_flush_mmap_mappings(struct iio_buffer_pdata *pdata)
+{
+	struct iio_buffer_impl_pdata *ppdata = pdata->pdata;
+	unsigned int i;
+
+	for (i = 0; i < ppdata->nb_blocks; i++) {
+		if (ppdata->addrs[i]) {
+			munmap(ppdata->addrs[i], ppdata->block_size);
+			ppdata->addrs[i] = NULL;
+		}
+	}
+
+	if (ppdata->nb_blocks)
+		ioctl_nointr(pdata->fd, BLOCK_FREE_IOCTL, NULL);
+
+	ppdata->nb_blocks = 0;
+}
+
 struct iio_block_pdata *
 local_create_mmap_block(struct iio_buffer_pdata *pdata,
 			size_t size, void **data)
@@ -102,6 +135,13 @@ local_create_mmap_block(struct iio_buffer_pdata *pdata,
 	if (!pdata->mmap_supported)
 		return iio_ptr(-ENOSYS);
 
+	/* The kernel blocks (and their mappings) are kept across block
+	 * re-creation cycles, which only works as long as the size doesn't
+	 * change. When it does, with no live block, start from scratch. */
+	if (!ppdata->mmap_block_mask && ppdata->nb_blocks
+	    && ppdata->block_size != size)
+		local_flush_mmap_mappings(pdata);
+
 	priv = zalloc(sizeof(*priv));
 	if (!priv)
 		return iio_ptr(-ENOMEM);
@@ -125,12 +165,11 @@ local_create_mmap_block(struct iio_buffer_pdata *pdata,
 		if (ret < 0)
 			goto out_free_priv;
 
+		ppdata->block_size = size;
 		ppdata->nb_blocks++;
 	} else {
 		/* One of our previously allocated blocks has been freed;
 		 * re-use it now. */
-
-		/* XXX: This only works if the blocks are the same size... */
 		priv->idx = __builtin_ffsl(~ppdata->mmap_block_mask) - 1;
 	}
 
@@ -140,11 +179,24 @@ local_create_mmap_block(struct iio_buffer_pdata *pdata,
 	if (ret < 0)
 		goto out_free_priv;
 
-	priv->pdata.data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
-				pdata->fd, priv->block.offset);
-	if (priv->pdata.data == MAP_FAILED) {
-		ret = -errno;
-		goto out_free_priv;
+	if (ppdata->addrs[priv->idx]) {
+		/* Re-use the cached mapping */
+		priv->pdata.data = ppdata->addrs[priv->idx];
+	} else {
+		priv->pdata.data = mmap(0, size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, pdata->fd,
+					priv->block.offset);
+		if (priv->pdata.data == MAP_FAILED) {
+			ret = -errno;
+			goto out_free_priv;
+		}
+
+#ifdef MADV_HUGEPAGE
+		if (size >= MMAP_HUGEPAGE_MIN_SIZE)
+			madvise(priv->pdata.data, size, MADV_HUGEPAGE);
+#endif
+
+		ppdata->addrs[priv->idx] = priv->pdata.data;
 	}
 
 	priv->pdata.size = size;
@@ -165,12 +217,14 @@ void local_free_mmap_block(struct iio_block_pdata *pdata)
 	struct iio_block_impl_pdata *priv = iio_block_get_impl(pdata);
 	struct iio_buffer_pdata *buf = pdata->buf;
 
-	munmap(pdata->data, pdata->size);
+	/* The mapping is kept alive for re-use; only release the resident
+	 * pages of big blocks while they sit idle. */
+#ifdef MADV_DONTNEED
+	if (pdata->size >= MMAP_DONTNEED_MIN_SIZE)
+		madvise(pdata->data, pdata->size, MADV_DONTNEED);
+#endif
 
-	if (!atomic_fetch_xor(&buf->pdata->mmap_block_mask, BIT(priv->idx))) {
-		ioctl_nointr(pdata->buf->fd, BLOCK_FREE_IOCTL, 0);
-		pdata->buf->pdata->nb_blocks = 0;
-	}
+	atomic_fetch_xor(&buf->pdata->mmap_block_mask, BIT(priv->idx));
 
 	free(priv);
 }
@@ -229,7 +283,8 @@ int local_dequeue_mmap_block(struct iio_block_pdata *pdata, bool nonblock)
 	}
 
 	for (;;) {
-		ret = buffer_check_ready(buf, fd, POLLIN | POLLOUT, time_ptr);
+		ret = buffer_check_ready(buf, fd, POLLIN | POLLOUT, time_ptr,
+					 false);
 		if (ret < 0)
 			return ret;
 
@@ -256,3 +311,14 @@ struct iio_buffer_impl_pdata * local_alloc_mmap_buffer_impl(void)
 
 	return pdata;
 }
+
+void local_free_mmap_buffer_impl(struct iio_buffer_pdata *pdata)
+{
+	local_flush_mmap_mappings(pdata);
+	free(pdata->pdata);
+}
+
+bool local_mmap_checked(const struct iio_buffer_pdata *pdata)
+{
+	return pdata->pdata->mmap_check_done;
+}
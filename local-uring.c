@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for syscall() and MAP_POPULATE */
+#endif
+
+#include "local.h"
+#include "iio-config.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Queue depth of the ring. Two entries are enough for the buffer I/O
+ * itself (the readiness poll plus the linked R/W request); the others
+ * leave room for the cancellation poll and cancel requests. */
+#define URING_ENTRIES	8
+
+#define UD_RW		1
+#define UD_CANCEL_POLL	2
+#define UD_ASYNC_CANCEL	3
+#define UD_RW_POLL	4
+
+struct iio_uring {
+	int fd;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+
+	unsigned int to_submit;
+	bool cancel_armed, cancelled;
+};
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	int ret;
+
+	ret = (int) syscall(__NR_io_uring_setup, entries, p);
+
+	return ret == -1 ? -errno : ret;
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags,
+			  const void *arg, size_t argsz)
+{
+	int ret;
+
+	ret = (int) syscall(__NR_io_uring_enter, fd, to_submit,
+			    min_complete, flags, arg, argsz);
+
+	return ret == -1 ? -errno : ret;
+}
+
+static void local_uring_destroy(struct iio_uring *ur)
+{
+	munmap(ur->sqes, ur->sqes_sz);
+	munmap(ur->cq_ring, ur->cq_ring_sz);
+	munmap(ur->sq_ring, ur->sq_ring_sz);
+	close(ur->fd);
+	free(ur);
+}
+
+static struct iio_uring * local_uring_create(void)
+{
+	struct io_uring_params params;
+	struct iio_uring *ur;
+	int ret, fd;
+
+	ur = zalloc(sizeof(*ur));
+	if (!ur)
+		return iio_ptr(-ENOMEM);
+
+	memset(&params, 0, sizeof(params));
+
+	fd = io_uring_setup(URING_ENTRIES, &params);
+	if (fd < 0) {
+		ret = fd;
+		goto err_free_ur;
+	}
+
+	/* IORING_ENTER_EXT_ARG is needed to wait with a timeout without
+	 * burning an extra SQE per call; without it (pre-5.11 kernels) we
+	 * just fall back to the poll/read path. */
+	if (!(params.features & IORING_FEAT_EXT_ARG)) {
+		ret = -ENOSYS;
+		goto err_close_fd;
+	}
+
+	ur->fd = fd;
+
+	ur->sq_ring_sz = params.sq_off.array
+		+ params.sq_entries * sizeof(unsigned int);
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ur->sq_ring == MAP_FAILED) {
+		ret = -errno;
+		goto err_close_fd;
+	}
+
+	ur->cq_ring_sz = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	if (ur->cq_ring == MAP_FAILED) {
+		ret = -errno;
+		goto err_unmap_sq;
+	}
+
+	ur->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED) {
+		ret = -errno;
+		goto err_unmap_cq;
+	}
+
+	ur->sq_head = (unsigned int *)((uintptr_t) ur->sq_ring
+				       + params.sq_off.head);
+	ur->sq_tail = (unsigned int *)((uintptr_t) ur->sq_ring
+				       + params.sq_off.tail);
+	ur->sq_mask = (unsigned int *)((uintptr_t) ur->sq_ring
+				       + params.sq_off.ring_mask);
+	ur->sq_array = (unsigned int *)((uintptr_t) ur->sq_ring
+					+ params.sq_off.array);
+
+	ur->cq_head = (unsigned int *)((uintptr_t) ur->cq_ring
+				       + params.cq_off.head);
+	ur->cq_tail = (unsigned int *)((uintptr_t) ur->cq_ring
+				       + params.cq_off.tail);
+	ur->cq_mask = (unsigned int *)((uintptr_t) ur->cq_ring
+				       + params.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe *)((uintptr_t) ur->cq_ring
+					   + params.cq_off.cqes);
+
+	return ur;
+
+err_unmap_cq:
+	munmap(ur->cq_ring, ur->cq_ring_sz);
+err_unmap_sq:
+	munmap(ur->sq_ring, ur->sq_ring_sz);
+err_close_fd:
+	close(fd);
+err_free_ur:
+	free(ur);
+	return iio_ptr(ret);
+}
+
+static struct io_uring_sqe * local_uring_get_sqe(struct iio_uring *ur)
+{
+	unsigned int tail = *ur->sq_tail + ur->to_submit;
+	unsigned int idx = tail & *ur->sq_mask;
+	struct io_uring_sqe *sqe = &ur->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	ur->sq_array[idx] = idx;
+	ur->to_submit++;
+
+	return sqe;
+}
+
+static int local_uring_enter(struct iio_uring *ur, unsigned int min_complete,
+			     const struct timespec *ts)
+{
+	struct io_uring_getevents_arg arg;
+	unsigned int flags = IORING_ENTER_GETEVENTS;
+	const void *argp = NULL;
+	size_t argsz = 0;
+	int ret;
+
+	if (ts) {
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uintptr_t) ts;
+		argp = &arg;
+		argsz = sizeof(arg);
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	atomic_store_explicit((_Atomic unsigned int *) ur->sq_tail,
+			      *ur->sq_tail + ur->to_submit,
+			      memory_order_release);
+
+	do {
+		ret = io_uring_enter(ur->fd, ur->to_submit, min_complete,
+				     flags, argp, argsz);
+	} while (ret == -EINTR);
+
+	if (ret >= 0)
+		ur->to_submit -= ret;
+
+	return ret;
+}
+
+static bool local_uring_reap(struct iio_uring *ur,
+			     unsigned long long *user_data, int *res)
+{
+	unsigned int head = *ur->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if (head == atomic_load_explicit((_Atomic unsigned int *) ur->cq_tail,
+					 memory_order_acquire))
+		return false;
+
+	cqe = &ur->cqes[head & *ur->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+
+	atomic_store_explicit((_Atomic unsigned int *) ur->cq_head,
+			      head + 1, memory_order_release);
+
+	return true;
+}
+
+/* Cancel the in-flight R/W request and wait for both its completion and
+ * the one of the cancel requests themselves. The readiness poll shields
+ * the R/W request: while the poll is pending, the linked R/W is not yet
+ * visible to cancellation, so both have to be cancelled — whichever of
+ * the two is actually in flight completes with -ECANCELED, and the other
+ * cancel request just reports -ENOENT. */
+static void local_uring_cancel_rw(struct iio_uring *ur)
+{
+	struct io_uring_sqe *sqe;
+	unsigned long long ud;
+	unsigned int nb_cancel = 2;
+	bool rw_done = false;
+	int res;
+
+	sqe = local_uring_get_sqe(ur);
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = UD_RW_POLL;
+	sqe->user_data = UD_ASYNC_CANCEL;
+
+	sqe = local_uring_get_sqe(ur);
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = UD_RW;
+	sqe->user_data = UD_ASYNC_CANCEL;
+
+	while (!rw_done || nb_cancel) {
+		while (local_uring_reap(ur, &ud, &res)) {
+			if (ud == UD_RW)
+				rw_done = true;
+			else if (ud == UD_ASYNC_CANCEL)
+				nb_cancel--;
+			else if (ud == UD_CANCEL_POLL)
+				ur->cancelled = true;
+			/* UD_RW_POLL completions can be dropped */
+		}
+
+		if (rw_done && !nb_cancel)
+			break;
+
+		if (local_uring_enter(ur, 1, NULL) < 0)
+			break;
+	}
+}
+
+static ssize_t local_uring_do_rw(struct iio_uring *ur,
+				 struct iio_buffer_pdata *buffer,
+				 void *ptr, size_t len, bool do_read,
+				 const struct timespec *ts)
+{
+	struct io_uring_sqe *sqe;
+	unsigned long long ud;
+	int ret, res, rw_res = -EAGAIN;
+	bool rw_done = false;
+
+	if (ur->cancelled)
+		return -EBADF;
+
+	if (!ur->cancel_armed) {
+		/* Arm a single-shot poll on the buffer's cancellation
+		 * eventfd; it only ever completes when iio_buffer_cancel()
+		 * is called, so it is submitted once and left in flight. */
+		sqe = local_uring_get_sqe(ur);
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = buffer->cancel_fd;
+		sqe->poll_events = POLLIN;
+		sqe->user_data = UD_CANCEL_POLL;
+
+		ur->cancel_armed = true;
+	}
+
+	/* The buffer's fd is opened with O_NONBLOCK, which makes the READ /
+	 * WRITE request complete immediately with -EAGAIN instead of
+	 * waiting for the ring. Link a readiness poll ahead of it, so that
+	 * the pair sleeps until the fd is actually ready instead of
+	 * busy-looping on resubmission. */
+	sqe = local_uring_get_sqe(ur);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = buffer->fd;
+	sqe->poll_events = do_read ? POLLIN : POLLOUT;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = UD_RW_POLL;
+
+	sqe = local_uring_get_sqe(ur);
+	sqe->opcode = do_read ? IORING_OP_READ : IORING_OP_WRITE;
+	sqe->fd = buffer->fd;
+	sqe->addr = (uintptr_t) ptr;
+	sqe->len = (unsigned int) len;
+	sqe->user_data = UD_RW;
+
+	while (!rw_done) {
+		ret = local_uring_enter(ur, 1, ts);
+		if (ret == -ETIME) {
+			local_uring_cancel_rw(ur);
+			return ur->cancelled ? -EBADF : -ETIMEDOUT;
+		}
+		if (ret < 0)
+			return ret;
+
+		while (local_uring_reap(ur, &ud, &res)) {
+			if (ud == UD_RW) {
+				rw_done = true;
+				rw_res = res;
+			} else if (ud == UD_CANCEL_POLL) {
+				ur->cancelled = true;
+			}
+		}
+
+		if (ur->cancelled && !rw_done) {
+			local_uring_cancel_rw(ur);
+			return -EBADF;
+		}
+	}
+
+	if (ur->cancelled)
+		return -EBADF;
+
+	return rw_res;
+}
+
+ssize_t local_uring_rw(struct iio_buffer_pdata *buffer,
+		       void *dst, size_t len, bool do_read)
+{
+	unsigned int timeout_ms = buffer->dev->ctx->params.timeout_ms;
+	uintptr_t ptr = (uintptr_t) dst;
+	struct timespec ts, *tsp = NULL;
+	struct iio_uring *ur;
+	ssize_t processed, ret = 0;
+
+	if (buffer->no_uring)
+		return -ENOSYS;
+
+	if (buffer->fd == -1)
+		return -EBADF;
+
+	if (!buffer->uring) {
+		ur = local_uring_create();
+		ret = iio_err(ur);
+		if (ret) {
+			/* No io_uring support; don't try again */
+			buffer->no_uring = true;
+			return -ENOSYS;
+		}
+
+		buffer->uring = ur;
+	}
+
+	if (timeout_ms) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+		tsp = &ts;
+	}
+
+	while (len > 0) {
+		ret = local_uring_do_rw(buffer->uring, buffer, (void *) ptr,
+					len, do_read, tsp);
+		if (ret == -EAGAIN)
+			continue;
+		if (ret < 0)
+			break;
+		if (ret == 0) {
+			ret = -EIO;
+			break;
+		}
+
+		ptr += ret;
+		len -= ret;
+	}
+
+	processed = (ssize_t)(ptr - (uintptr_t) dst);
+	if ((ret > 0 || ret == -EAGAIN) && processed > 0)
+		return processed;
+	else
+		return ret;
+}
+
+void local_uring_free(struct iio_buffer_pdata *buffer)
+{
+	if (buffer->uring) {
+		local_uring_destroy(buffer->uring);
+		buffer->uring = NULL;
+	}
+}
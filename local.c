@@ -14,6 +14,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
 #include <limits.h>
 #include <poll.h>
 #include <stdbool.h>
@@ -34,6 +35,9 @@
 
 #define NB_BLOCKS 4
 
+/* Maximum number of threads used to enumerate the devices in parallel */
+#define NB_ENUM_WORKERS 8
+
 #define IIO_BUFFER_GET_FD_IOCTL		_IOWR('i', 0x91, int)
 
 /* Forward declarations */
@@ -49,6 +53,7 @@ static struct iio_context *
 local_create_context(const struct iio_context_params *params, const char *args);
 static int local_context_scan(const struct iio_context_params *params,
 			      struct iio_scan *ctx, const char *args);
+static int local_hydrate(struct iio_device *dev);
 
 struct iio_channel_pdata {
 	char *enable_fn;
@@ -109,18 +114,9 @@ static void local_shutdown(struct iio_context *ctx)
 	}
 }
 
-/** Shrinks the first nb characters of a string
- * e.g. strcut("foobar", 4) replaces the content with "ar". */
-static void strcut(char *str, int nb)
-{
-	char *ptr = str + nb;
-	while (*ptr)
-		*str++ = *ptr++;
-	*str = 0;
-}
-
 static int set_channel_name(struct iio_channel *chn)
 {
+	struct iio_str_pool *pool = chn->dev->ctx->str_pool;
 	struct iio_channel_pdata *pdata = chn->pdata;
 	size_t prefix_len = 0;
 	const char *attr0;
@@ -170,11 +166,21 @@ static int set_channel_name(struct iio_channel *chn)
 		chn->name = name;
 		chn_dbg(chn, "Setting name of channel %s to %s\n", chn->id, name);
 
-		/* Shrink the attribute name */
-		for (i = 0; i < chn->nb_attrs; i++)
-			strcut(chn->attrs[i].name, prefix_len);
-		for (i = 0; i < pdata->nb_protected_attrs; i++)
-			strcut(pdata->protected_attrs[i].name, prefix_len);
+		/* Strip the prefix from the attribute names. The names are
+		 * interned and thus shared, so re-intern the short form
+		 * instead of shrinking the string in place. */
+		for (i = 0; i < chn->nb_attrs; i++) {
+			chn->attrs[i].name = iio_str_pool_get(pool,
+					chn->attrs[i].name + prefix_len);
+			if (!chn->attrs[i].name)
+				return -ENOMEM;
+		}
+		for (i = 0; i < pdata->nb_protected_attrs; i++) {
+			pdata->protected_attrs[i].name = iio_str_pool_get(pool,
+					pdata->protected_attrs[i].name + prefix_len);
+			if (!pdata->protected_attrs[i].name)
+				return -ENOMEM;
+		}
 	}
 
 	return 0;
@@ -220,7 +226,7 @@ static int get_rel_timeout_ms(struct timespec *start, unsigned int timeout_rel)
 }
 
 int buffer_check_ready(struct iio_buffer_pdata *pdata, int fd,
-		       short events, struct timespec *start)
+		       short events, struct timespec *start, bool wake_early)
 {
 	struct pollfd pollfd[2] = {
 		{
@@ -232,7 +238,9 @@ int buffer_check_ready(struct iio_buffer_pdata *pdata, int fd,
 		}
 	};
 	unsigned int rw_timeout_ms = pdata->dev->ctx->params.timeout_ms;
+	unsigned int max_wait_ms = pdata->wakeup_max_wait_ms;
 	int timeout_rel, ret;
+	bool capped = false;
 
 	do {
 		if (start)
@@ -240,6 +248,15 @@ int buffer_check_ready(struct iio_buffer_pdata *pdata, int fd,
 		else
 			timeout_rel = 0; /* non-blocking */
 
+		/* With a reduced kernel watermark the descriptor may stay
+		 * quiet even though some data is ready; bound the wait so
+		 * the caller can grab what is already there. */
+		capped = wake_early && start && max_wait_ms &&
+			(timeout_rel < 0 ||
+			 (unsigned int) timeout_rel > max_wait_ms);
+		if (capped)
+			timeout_rel = (int) max_wait_ms;
+
 		ret = poll(pollfd, 2, timeout_rel);
 	} while (ret == -1 && errno == EINTR);
 
@@ -248,8 +265,11 @@ int buffer_check_ready(struct iio_buffer_pdata *pdata, int fd,
 
 	if (ret < 0)
 		return -errno;
-	if (!ret)
+	if (!ret) {
+		if (capped)
+			return 0;
 		return start ? -ETIMEDOUT : -EBUSY;
+	}
 	if (pollfd[0].revents & POLLNVAL)
 		return -EBADF;
 	if (!(pollfd[0].revents & events))
@@ -311,11 +331,19 @@ static int local_enable_buffer(struct iio_buffer_pdata *pdata,
 		return -EINVAL;
 
 	if (nb_samples) {
+		size_t watermark = nb_samples;
+
 		ret = local_set_buffer_size(pdata, nb_samples);
 		if (ret)
 			return ret;
 
-		ret = local_set_watermark(pdata, nb_samples);
+		/* One wakeup per block by default; a lower threshold can be
+		 * requested through iio_buffer_set_wakeup(). */
+		if (pdata->wakeup_min_samples &&
+		    pdata->wakeup_min_samples < nb_samples)
+			watermark = pdata->wakeup_min_samples;
+
+		ret = local_set_watermark(pdata, watermark);
 		if (ret)
 			return ret;
 	}
@@ -323,6 +351,15 @@ static int local_enable_buffer(struct iio_buffer_pdata *pdata,
 	return local_do_enable_buffer(pdata, true);
 }
 
+static int local_set_wakeup(struct iio_buffer_pdata *pdata,
+			    size_t min_samples, unsigned int max_wait_ms)
+{
+	pdata->wakeup_min_samples = min_samples;
+	pdata->wakeup_max_wait_ms = max_wait_ms;
+
+	return 0;
+}
+
 static ssize_t local_readbuf(struct iio_buffer_pdata *buffer,
 			     void *dst, size_t len)
 {
@@ -338,10 +375,16 @@ static ssize_t local_readbuf(struct iio_buffer_pdata *buffer,
 	if (len == 0)
 		return 0;
 
+	if (WITH_LOCAL_IO_URING) {
+		ret = local_uring_rw(buffer, dst, len, true);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	while (len > 0) {
-		ret = buffer_check_ready(buffer, fd, POLLIN, &start);
+		ret = buffer_check_ready(buffer, fd, POLLIN, &start, true);
 		if (ret < 0)
 			break;
 
@@ -385,10 +428,16 @@ local_writebuf(struct iio_buffer_pdata *buffer, const void *src, size_t len)
 	if (len == 0)
 		return 0;
 
+	if (WITH_LOCAL_IO_URING) {
+		ret = local_uring_rw(buffer, (void *) src, len, false);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	while (len > 0) {
-		ret = buffer_check_ready(buffer, fd, POLLOUT, &start);
+		ret = buffer_check_ready(buffer, fd, POLLOUT, &start, true);
 		if (ret < 0)
 			break;
 
@@ -753,9 +802,9 @@ static int add_attr_to_device(struct iio_device *dev, const char *attr)
 			return 0;
 
 	if (!strcmp(attr, "name"))
-		return read_device_name(dev);
+		return dev->name ? 0 : read_device_name(dev);
 	if (!strcmp(attr, "label"))
-		return read_device_label(dev);
+		return dev->label ? 0 : read_device_label(dev);
 
 	return add_iio_dev_attr(dev, &dev->attrs, attr, "");
 }
@@ -850,7 +899,8 @@ static int handle_scan_elements(struct iio_channel *chn)
 	return 0;
 }
 
-static int add_protected_attr(struct iio_channel *chn, char *name, char *fn)
+static int add_protected_attr(struct iio_channel *chn, const char *name,
+			      const char *fn)
 {
 	struct iio_channel_pdata *pdata = chn->pdata;
 	struct iio_channel_attr *attrs;
@@ -872,13 +922,8 @@ static int add_protected_attr(struct iio_channel *chn, char *name, char *fn)
 static void free_protected_attrs(struct iio_channel *chn)
 {
 	struct iio_channel_pdata *pdata = chn->pdata;
-	unsigned int i;
-
-	for (i = 0; i < pdata->nb_protected_attrs; i++) {
-		free(pdata->protected_attrs[i].name);
-		free(pdata->protected_attrs[i].filename);
-	}
 
+	/* The names and filenames belong to the context's string pool */
 	free(pdata->protected_attrs);
 	pdata->nb_protected_attrs = 0;
 	pdata->protected_attrs = NULL;
@@ -887,28 +932,31 @@ static void free_protected_attrs(struct iio_channel *chn)
 static int add_attr_to_channel(struct iio_channel *chn,
 		const char *attr, const char *path, bool is_scan_element)
 {
+	struct iio_str_pool *pool = chn->dev->ctx->str_pool;
 	struct iio_channel_attr *attrs;
-	char *fn, *name = get_short_attr_name(chn, attr);
+	const char *fn;
+	char *short_name = get_short_attr_name(chn, attr);
+	const char *name;
+
+	if (!short_name)
+		return -ENOMEM;
+
+	name = iio_str_pool_get(pool, short_name);
+	free(short_name);
 	if (!name)
 		return -ENOMEM;
 
-	fn = iio_strdup(path);
+	fn = iio_str_pool_get(pool, path);
 	if (!fn)
-		goto err_free_name;
-
-	if (is_scan_element) {
-		int ret = add_protected_attr(chn, name, fn);
-
-		if (ret < 0)
-			goto err_free_fn;
+		return -ENOMEM;
 
-		return 0;
-	}
+	if (is_scan_element)
+		return add_protected_attr(chn, name, fn);
 
 	attrs = realloc(chn->attrs, (1 + chn->nb_attrs) *
 			sizeof(struct iio_channel_attr));
 	if (!attrs)
-		goto err_free_fn;
+		return -ENOMEM;
 
 	attrs[chn->nb_attrs].filename = fn;
 	attrs[chn->nb_attrs++].name = name;
@@ -917,12 +965,6 @@ static int add_attr_to_channel(struct iio_channel *chn,
 	chn_dbg(chn, "Added attr \'%s\' to channel \'%s\'\n",
 		name, chn->id);
 	return 0;
-
-err_free_fn:
-	free(fn);
-err_free_name:
-	free(name);
-	return -ENOMEM;
 }
 
 static int add_channel_to_device(struct iio_device *dev,
@@ -1110,7 +1152,7 @@ static int detect_global_attr(struct iio_device *dev, const char *attr,
 static int detect_and_move_global_attrs(struct iio_device *dev)
 {
 	unsigned int i;
-	char **ptr = dev->attrs.names;
+	const char **ptr = dev->attrs.names;
 
 	for (i = 0; i < dev->attrs.num; i++) {
 		const char *attr = dev->attrs.names[i];
@@ -1127,10 +1169,8 @@ static int detect_and_move_global_attrs(struct iio_device *dev)
 				return ret;
 		}
 
-		if (match) {
-			free(dev->attrs.names[i]);
+		if (match)
 			dev->attrs.names[i] = NULL;
-		}
 	}
 
 	/* Find channels without an index */
@@ -1146,7 +1186,6 @@ static int detect_and_move_global_attrs(struct iio_device *dev)
 			if (ret)
 				return ret;
 
-			free(dev->attrs.names[i]);
 			dev->attrs.names[i] = NULL;
 		}
 	}
@@ -1293,50 +1332,40 @@ static int add_buffer_attributes(struct iio_device *dev, const char *devpath)
 	return 0;
 }
 
-static int create_device(void *d, const char *path)
+static int local_fill_device(struct iio_device *dev, const char *path)
 {
+	const struct iio_context *ctx = dev->ctx;
 	unsigned int i;
 	int ret;
-	struct iio_context *ctx = d;
-	struct iio_device *dev = zalloc(sizeof(*dev));
-	if (!dev)
-		return -ENOMEM;
-
-	dev->ctx = ctx;
-	dev->id = iio_strdup(strrchr(path, '/') + 1);
-	if (!dev->id) {
-		free(dev);
-		return -ENOMEM;
-	}
 
 	ret = foreach_in_dir(ctx, dev, path, false, add_attr_or_channel);
 	if (ret < 0)
-		goto err_free_device;
+		return ret;
 
 	ret = add_buffer_attributes(dev, path);
 	if (ret < 0)
-		goto err_free_device;
+		return ret;
 
 	ret = add_scan_elements(dev, path);
 	if (ret < 0)
-		goto err_free_scan_elements;
+		goto err_free_protected_attrs;
 
 	for (i = 0; i < dev->nb_channels; i++) {
 		struct iio_channel *chn = dev->channels[i];
 
 		ret = set_channel_name(chn);
 		if (ret < 0)
-			goto err_free_scan_elements;
+			goto err_free_protected_attrs;
 
 		ret = handle_scan_elements(chn);
 		free_protected_attrs(chn);
 		if (ret < 0)
-			goto err_free_scan_elements;
+			goto err_free_protected_attrs;
 	}
 
 	ret = detect_and_move_global_attrs(dev);
 	if (ret < 0)
-		goto err_free_device;
+		return ret;
 
 	/* sorting is done after global attrs are added */
 	for (i = 0; i < dev->nb_channels; i++) {
@@ -1347,19 +1376,252 @@ static int create_device(void *d, const char *path)
 	qsort(dev->attrs.names, dev->attrs.num, sizeof(char *),
 		iio_device_attr_compare);
 
-	ret = iio_context_add_device(ctx, dev);
-	if (!ret)
-		return 0;
+	return 0;
 
-err_free_scan_elements:
+err_free_protected_attrs:
 	for (i = 0; i < dev->nb_channels; i++)
 		free_protected_attrs(dev->channels[i]);
+	return ret;
+}
+
+static int create_device(struct iio_context *ctx, const char *path,
+			 struct iio_device **pdev)
+{
+	int ret;
+	struct iio_device *dev = zalloc(sizeof(*dev));
+	if (!dev)
+		return -ENOMEM;
+
+	dev->ctx = ctx;
+	dev->id = iio_strdup(strrchr(path, '/') + 1);
+	if (!dev->id) {
+		free(dev);
+		return -ENOMEM;
+	}
+
+	if (ctx->params.lazy) {
+		/* Lazy mode: read just the name and label, which the device
+		 * lookup functions need; the channels and attribute lists are
+		 * discovered on first access, in local_hydrate(). */
+		ret = read_device_name(dev);
+		if (ret < 0 && ret != -ENOENT)
+			goto err_free_device;
+
+		ret = read_device_label(dev);
+		if (ret < 0 && ret != -ENOENT)
+			goto err_free_device;
+
+		dev->lazy = true;
+	} else {
+		ret = local_fill_device(dev, path);
+		if (ret < 0)
+			goto err_free_device;
+	}
+
+	*pdev = dev;
+	return 0;
+
 err_free_device:
 	local_free_pdata(dev);
 	free_device(dev);
 	return ret;
 }
 
+static struct iio_device *
+local_insert_device(struct iio_context *ctx, const char *id)
+{
+	struct iio_device *dev;
+	char path[PATH_MAX];
+	struct stat st;
+	int ret;
+
+	/* IDs as reported by the hotplug watcher */
+	if (strncmp(id, "iio:device", sizeof("iio:device") - 1)
+	    && strncmp(id, "trigger", sizeof("trigger") - 1))
+		return iio_ptr(-EINVAL);
+
+	iio_snprintf(path, sizeof(path), "/sys/bus/iio/devices/%s", id);
+
+	if (stat(path, &st) < 0)
+		return iio_ptr(-errno);
+
+	dev = zalloc(sizeof(*dev));
+	if (!dev)
+		return iio_ptr(-ENOMEM);
+
+	dev->ctx = ctx;
+	dev->id = iio_strdup(id);
+	if (!dev->id) {
+		free(dev);
+		return iio_ptr(-ENOMEM);
+	}
+
+	/* Built lazily whatever the context parameters say: the channels
+	 * and attribute lists are enumerated on first access, through
+	 * local_hydrate(). */
+	ret = read_device_name(dev);
+	if (ret < 0 && ret != -ENOENT)
+		goto err_free_device;
+
+	ret = read_device_label(dev);
+	if (ret < 0 && ret != -ENOENT)
+		goto err_free_device;
+
+	dev->lazy = true;
+
+	return dev;
+
+err_free_device:
+	free_device(dev);
+	return iio_ptr(ret);
+}
+
+static void local_remove_device(struct iio_device *dev)
+{
+	local_free_pdata(dev);
+}
+
+struct local_enum_dev {
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	char *path;
+};
+
+struct local_enum_data {
+	struct iio_context *ctx;
+	struct local_enum_dev *devs;
+	unsigned int nb_devs;
+};
+
+static int add_enum_dev(void *d, const char *path)
+{
+	struct local_enum_data *data = d;
+	struct local_enum_dev *devs;
+	char *dup;
+
+	dup = iio_strdup(path);
+	if (!dup)
+		return -ENOMEM;
+
+	devs = realloc(data->devs, (data->nb_devs + 1) * sizeof(*devs));
+	if (!devs) {
+		free(dup);
+		return -ENOMEM;
+	}
+
+	devs[data->nb_devs].ctx = data->ctx;
+	devs[data->nb_devs].dev = NULL;
+	devs[data->nb_devs].path = dup;
+
+	data->devs = devs;
+	data->nb_devs++;
+
+	return 0;
+}
+
+static int create_device_task(void *unused, void *d)
+{
+	struct local_enum_dev *entry = d;
+
+	return create_device(entry->ctx, entry->path, &entry->dev);
+}
+
+/* Each device is built from its own sysfs directory, independently of the
+ * others; build them on a small thread pool so that context creation costs
+ * roughly the enumeration time of the slowest device instead of the sum of
+ * all of them. The devices are then added to the context in scan order. */
+static int local_enumerate_devices(struct iio_context *ctx)
+{
+	struct local_enum_data data = { .ctx = ctx, };
+	struct iio_task_token **tokens = NULL;
+	struct iio_task *task = NULL;
+	unsigned int i, nb_workers;
+	bool no_iio;
+	int ret, err;
+
+	ret = foreach_in_dir(ctx, &data, "/sys/bus/iio/devices",
+			     true, add_enum_dev);
+	no_iio = ret == -ENOENT;
+	if (WITH_HWMON && no_iio)
+	      ret = 0; /* Not an error, unless we also have no hwmon devices */
+	if (ret < 0)
+	      goto out_free_data;
+
+	if (WITH_HWMON) {
+		ret = foreach_in_dir(ctx, &data, "/sys/class/hwmon",
+				     true, add_enum_dev);
+		if (ret == -ENOENT && !no_iio)
+			ret = 0; /* IIO devices but no hwmon devices - not an error */
+		if (ret < 0)
+			goto out_free_data;
+	}
+
+	if (!data.nb_devs)
+		goto out_free_data;
+
+	if (data.nb_devs > 1) {
+		nb_workers = data.nb_devs < NB_ENUM_WORKERS ?
+			data.nb_devs : NB_ENUM_WORKERS;
+
+		task = iio_task_create_pool(create_device_task, NULL,
+					    "enum", nb_workers);
+		if (iio_err(task))
+			task = NULL; /* Fall back to serial enumeration */
+		else
+			tokens = calloc(data.nb_devs, sizeof(*tokens));
+	}
+
+	if (tokens) {
+		iio_task_start(task);
+
+		for (i = 0; i < data.nb_devs; i++) {
+			tokens[i] = iio_task_enqueue(task, &data.devs[i]);
+			if (iio_err(tokens[i]))
+				tokens[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < data.nb_devs; i++) {
+		if (tokens && tokens[i])
+			err = iio_task_sync(tokens[i], 0);
+		else
+			err = create_device_task(NULL, &data.devs[i]);
+
+		if (err < 0 && !ret) {
+			ret = err;
+			ctx_perror(ctx, ret, "Unable to create device");
+		}
+	}
+
+	if (ret < 0)
+		goto out_free_data;
+
+	for (i = 0; i < data.nb_devs; i++) {
+		ret = iio_context_add_device(ctx, data.devs[i].dev);
+		if (ret < 0)
+			goto out_free_data;
+
+		data.devs[i].dev = NULL;
+	}
+
+out_free_data:
+	for (i = 0; i < data.nb_devs; i++) {
+		if (data.devs[i].dev) {
+			local_free_pdata(data.devs[i].dev);
+			free_device(data.devs[i].dev);
+		}
+
+		free(data.devs[i].path);
+	}
+
+	free(data.devs);
+	free(tokens);
+	if (task)
+		iio_task_destroy(task);
+
+	return ret;
+}
+
 static int add_debug_attr(void *d, const char *path)
 {
 	struct iio_device *dev = d;
@@ -1412,15 +1674,83 @@ static char * local_get_description(const struct iio_context *ctx)
 	return description;
 }
 
+static int local_write_channels_state(const struct iio_device *dev,
+				      unsigned int idx,
+				      struct iio_channels_mask *mask)
+{
+	const struct iio_channel *chn;
+	unsigned int i;
+	int err;
+
+	/* Disable all channels */
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (chn->index >= 0) {
+			err = channel_write_state(chn, idx, false);
+			if (err < 0)
+				return err;
+		}
+	}
+
+	/* Enable channels */
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (chn->index >= 0 && iio_channel_is_enabled(chn, mask)) {
+			err = channel_write_state(chn, idx, true);
+			if (err < 0)
+				return err;
+		}
+	}
+
+	/* Finally, update the channels mask by reading the hardware again,
+	 * since some channels may be coupled together. */
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (chn->index >= 0) {
+			err = channel_read_state(chn, idx);
+			if (err < 0)
+				return err;
+
+			if (err > 0)
+				iio_channel_enable(chn, mask);
+		}
+	}
+
+	return 0;
+}
+
+static int local_update_mask(struct iio_buffer_pdata *pdata,
+			     struct iio_channels_mask *mask)
+{
+	/* The core disabled the buffer already, which is what makes the
+	 * scan_elements writes acceptable to the kernel. */
+	return local_write_channels_state(pdata->dev, pdata->idx, mask);
+}
+
+static enum iio_buffer_mechanism
+local_get_mechanism(const struct iio_buffer_pdata *pdata)
+{
+	if (WITH_LOCAL_DMABUF_API && pdata->dmabuf_supported)
+		return IIO_BUFFER_MECHANISM_DMABUF;
+
+	/* Whether the mmap interface is available is only probed when the
+	 * first block is created. */
+	if (WITH_LOCAL_MMAP_API && !local_mmap_checked(pdata))
+		return IIO_BUFFER_MECHANISM_UNKNOWN;
+
+	if (WITH_LOCAL_MMAP_API && pdata->mmap_supported)
+		return IIO_BUFFER_MECHANISM_MMAP;
+
+	return IIO_BUFFER_MECHANISM_FILEIO;
+}
+
 static struct iio_buffer_pdata *
 local_create_buffer(const struct iio_device *dev, unsigned int idx,
 		    struct iio_channels_mask *mask)
 {
 	struct iio_buffer_pdata *pdata;
-	const struct iio_channel *chn;
 	char buf[1024];
 	int err, fd, cancel_fd, new_fd = idx;
-	unsigned int i;
 
 	pdata = zalloc(sizeof(*pdata));
 	if (!pdata)
@@ -1466,39 +1796,9 @@ local_create_buffer(const struct iio_device *dev, unsigned int idx,
 	if (err < 0)
 		goto err_close;
 
-	/* Disable all channels */
-	for (i = 0; i < dev->nb_channels; i++) {
-		chn = dev->channels[i];
-		if (chn->index >= 0) {
-			err = channel_write_state(chn, idx, false);
-			if (err < 0)
-				goto err_close;
-		}
-	}
-
-	/* Enable channels */
-	for (i = 0; i < dev->nb_channels; i++) {
-		chn = dev->channels[i];
-		if (chn->index >= 0 && iio_channel_is_enabled(chn, mask)) {
-			err = channel_write_state(chn, idx, true);
-			if (err < 0)
-				goto err_close;
-		}
-	}
-
-	/* Finally, update the channels mask by reading the hardware again,
-	 * since some channels may be coupled together. */
-	for (i = 0; i < dev->nb_channels; i++) {
-		chn = dev->channels[i];
-		if (chn->index >= 0) {
-			err = channel_read_state(chn, idx);
-			if (err < 0)
-				goto err_close;
-
-			if (err > 0)
-				iio_channel_enable(chn, mask);
-		}
-	}
+	err = local_write_channels_state(dev, idx, mask);
+	if (err < 0)
+		goto err_close;
 
 	return pdata;
 
@@ -1515,7 +1815,13 @@ err_free_pdata:
 
 static void local_free_buffer(struct iio_buffer_pdata *pdata)
 {
-	free(pdata->pdata);
+	if (WITH_LOCAL_IO_URING)
+		local_uring_free(pdata);
+
+	if (WITH_LOCAL_MMAP_API)
+		local_free_mmap_buffer_impl(pdata);
+	else
+		free(pdata->pdata);
 	close(pdata->fd);
 	close(pdata->cancel_fd);
 	local_do_enable_buffer(pdata, false);
@@ -1569,6 +1875,14 @@ static int local_enqueue_block(struct iio_block_pdata *pdata,
 	return -ENOSYS;
 }
 
+static int local_get_block_dmabuf_fd(struct iio_block_pdata *pdata)
+{
+	if (WITH_LOCAL_DMABUF_API && pdata->buf->dmabuf_supported)
+		return local_get_dmabuf_fd(pdata);
+
+	return -ENOSYS;
+}
+
 int local_dequeue_block(struct iio_block_pdata *pdata, bool nonblock)
 {
 	if (WITH_LOCAL_DMABUF_API && pdata->buf->dmabuf_supported)
@@ -1590,19 +1904,29 @@ static const struct iio_backend_ops local_ops = {
 	.get_trigger = local_get_trigger,
 	.set_trigger = local_set_trigger,
 	.shutdown = local_shutdown,
+	.watch_devices = local_watch_devices,
+	.unwatch_devices = local_unwatch_devices,
+	.insert_device = local_insert_device,
+	.remove_device = local_remove_device,
 
 	.create_block = local_create_block,
 	.free_block = local_free_block,
 	.enqueue_block = local_enqueue_block,
 	.dequeue_block = local_dequeue_block,
+	.get_dmabuf_fd = local_get_block_dmabuf_fd,
 
 	.create_buffer = local_create_buffer,
 	.free_buffer = local_free_buffer,
 	.enable_buffer = local_enable_buffer,
+	.set_wakeup = local_set_wakeup,
 	.cancel_buffer = local_cancel_buffer,
+	.update_mask = local_update_mask,
+	.get_mechanism = local_get_mechanism,
 
 	.readbuf = local_readbuf,
 	.writebuf = local_writebuf,
+
+	.hydrate = local_hydrate,
 };
 
 const struct iio_backend iio_local_backend = {
@@ -1645,6 +1969,31 @@ static void init_scan_elements(struct iio_context *ctx)
 	}
 }
 
+static int local_hydrate(struct iio_device *dev)
+{
+	char path[PATH_MAX];
+	unsigned int i;
+	int ret;
+
+	iio_snprintf(path, sizeof(path), "%s/%s",
+		     WITH_HWMON && iio_device_is_hwmon(dev) ?
+		     "/sys/class/hwmon" : "/sys/bus/iio/devices",
+		     dev->id);
+
+	ret = local_fill_device(dev, path);
+	if (ret < 0)
+		return ret;
+
+	/* Missing debugfs entry (or no debugfs at all) is not an error */
+	iio_snprintf(path, sizeof(path), "/sys/kernel/debug/iio/%s", dev->id);
+	foreach_in_dir(dev->ctx, dev, path, false, add_debug_attr);
+
+	for (i = 0; i < dev->nb_channels; i++)
+		init_data_scale(dev->channels[i]);
+
+	return 0;
+}
+
 static int populate_context_attrs(struct iio_context *ctx, const char *file)
 {
 	struct INI *ini;
@@ -1699,14 +2048,325 @@ out_close_ini:
 	return ret;
 }
 
+/*
+ * Optional on-disk context cache ("local:cache" or "local:cache=<file>").
+ *
+ * The enumerated context is serialized (in the same binary format that iiod
+ * uses for its context description) into a cache file, prefixed with a cheap
+ * fingerprint of the current hardware: the kernel release plus the name and
+ * modification time of every entry in the sysfs device directories. On the
+ * next startup the file is mapped read-only and, if the fingerprint still
+ * matches, the context is decoded from it without walking sysfs at all.
+ * Any mismatch or decoding error falls back to a full re-enumeration, which
+ * then refreshes the cache.
+ */
+
+#define LOCAL_CACHE_MAGIC	"IIOC"
+#define LOCAL_CACHE_VERSION	1
+#define LOCAL_CACHE_STR_NULL	0xffff
+
+#define LOCAL_CACHE_DEFAULT_PATH "/var/cache/libiio-context.bin"
+
+struct local_cache_hdr {
+	char magic[4];
+	uint16_t version;
+	uint16_t reserved;
+	uint64_t fingerprint;
+	uint64_t ctx_len;
+
+	/* Followed by the serialized context, then by one length-prefixed
+	 * scan-element "enable" filename per channel (0xffff for none),
+	 * in device / channel order. */
+};
+
+static uint64_t local_cache_hash(uint64_t h, const void *src, size_t len)
+{
+	const uint8_t *ptr = src;
+
+	/* FNV-1a */
+	while (len--) {
+		h ^= *ptr++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+static void local_cache_fingerprint_dir(const char *path, uint64_t *fp)
+{
+	struct dirent *entry;
+	struct stat st;
+	char buf[PATH_MAX];
+	uint64_t h;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return;
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		iio_snprintf(buf, sizeof(buf), "%s/%s", path, entry->d_name);
+		if (stat(buf, &st) < 0)
+			continue;
+
+		/* XOR the per-entry hashes so that the fingerprint does not
+		 * depend on the readdir() order. */
+		h = local_cache_hash(0xcbf29ce484222325ULL, entry->d_name,
+				     strlen(entry->d_name));
+		h = local_cache_hash(h, &st.st_mtim, sizeof(st.st_mtim));
+
+		*fp ^= h;
+	}
+
+	closedir(dir);
+}
+
+static uint64_t local_cache_fingerprint(void)
+{
+	uint64_t fp = 0xcbf29ce484222325ULL;
+	struct utsname uts;
+
+	uname(&uts);
+	fp = local_cache_hash(fp, uts.release, strlen(uts.release));
+
+	local_cache_fingerprint_dir("/sys/bus/iio/devices", &fp);
+	if (WITH_HWMON)
+		local_cache_fingerprint_dir("/sys/class/hwmon", &fp);
+
+	return fp;
+}
+
+static int local_cache_write_str(FILE *f, const char *str)
+{
+	uint16_t len = str ? (uint16_t) strlen(str) : LOCAL_CACHE_STR_NULL;
+
+	if (fwrite(&len, sizeof(len), 1, f) != 1)
+		return -EIO;
+	if (str && len && fwrite(str, 1, len, f) != len)
+		return -EIO;
+
+	return 0;
+}
+
+static void local_cache_store(const struct iio_context *ctx, const char *file)
+{
+	struct local_cache_hdr hdr = { 0 };
+	const struct iio_device *dev;
+	const struct iio_channel *chn;
+	char tmp[PATH_MAX];
+	unsigned int i, j;
+	void *blob = NULL;
+	ssize_t blob_len;
+	FILE *f = NULL;
+	int ret, fd;
+
+	blob_len = iio_context_serialize_binary(ctx, &blob);
+	if (blob_len < 0) {
+		ret = (int) blob_len;
+		goto out;
+	}
+
+	memcpy(hdr.magic, LOCAL_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = LOCAL_CACHE_VERSION;
+	hdr.fingerprint = local_cache_fingerprint();
+	hdr.ctx_len = blob_len;
+
+	/* Write to a temporary file, rename into place when complete */
+	iio_snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		ret = -errno;
+		close(fd);
+		goto out_unlink;
+	}
+
+	ret = -EIO;
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		goto out_unlink;
+	if (fwrite(blob, 1, blob_len, f) != (size_t) blob_len)
+		goto out_unlink;
+
+	ret = 0;
+	for (i = 0; !ret && i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		for (j = 0; !ret && j < dev->nb_channels; j++) {
+			chn = dev->channels[j];
+
+			ret = local_cache_write_str(f, chn->pdata ?
+						    chn->pdata->enable_fn : NULL);
+		}
+	}
+	if (ret)
+		goto out_unlink;
+
+	if (fclose(f) != 0) {
+		f = NULL;
+		ret = -errno;
+		goto out_unlink;
+	}
+	f = NULL;
+
+	if (rename(tmp, file) < 0) {
+		ret = -errno;
+		goto out_unlink;
+	}
+
+	goto out;
+
+out_unlink:
+	if (f)
+		fclose(f);
+	unlink(tmp);
+out:
+	if (ret)
+		ctx_perror(ctx, ret, "Unable to write context cache");
+	free(blob);
+}
+
+static struct iio_context *
+local_create_context_from_cache(const struct iio_context_params *params,
+				const char *file)
+{
+	struct local_cache_hdr hdr;
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	const uint8_t *map, *ptr, *end;
+	unsigned int i, j;
+	struct stat st;
+	uint16_t len;
+	int ret, fd;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return iio_ptr(-errno);
+
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		close(fd);
+		return iio_ptr(ret);
+	}
+
+	if ((size_t) st.st_size < sizeof(hdr)) {
+		close(fd);
+		return iio_ptr(-EINVAL);
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return iio_ptr(-errno);
+
+	memcpy(&hdr, map, sizeof(hdr));
+
+	ret = -EINVAL;
+	if (memcmp(hdr.magic, LOCAL_CACHE_MAGIC, sizeof(hdr.magic))
+	    || hdr.version != LOCAL_CACHE_VERSION
+	    || hdr.ctx_len > st.st_size - sizeof(hdr))
+		goto err_unmap;
+
+	/* Stale cache: the hardware or the kernel changed */
+	ret = -ENOENT;
+	if (hdr.fingerprint != local_cache_fingerprint())
+		goto err_unmap;
+
+	ctx = iio_create_context_from_binary(params, &iio_local_backend, NULL,
+					     NULL, NULL, 0,
+					     map + sizeof(hdr), hdr.ctx_len);
+	ret = iio_err(ctx);
+	if (ret)
+		goto err_unmap;
+
+	/* Restore the per-channel scan-element "enable" filenames, which the
+	 * generic serialized format does not carry. */
+	ptr = map + sizeof(hdr) + hdr.ctx_len;
+	end = map + st.st_size;
+
+	ret = -EINVAL;
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			chn = dev->channels[j];
+
+			if (end - ptr < (ptrdiff_t) sizeof(len))
+				goto err_context_destroy;
+
+			memcpy(&len, ptr, sizeof(len));
+			ptr += sizeof(len);
+
+			chn->pdata = zalloc(sizeof(*chn->pdata));
+			if (!chn->pdata) {
+				ret = -ENOMEM;
+				goto err_context_destroy;
+			}
+
+			if (len == LOCAL_CACHE_STR_NULL)
+				continue;
+
+			if (end - ptr < (ptrdiff_t) len)
+				goto err_context_destroy;
+
+			chn->pdata->enable_fn = iio_strndup((const char *) ptr,
+							    len);
+			if (!chn->pdata->enable_fn) {
+				ret = -ENOMEM;
+				goto err_context_destroy;
+			}
+
+			ptr += len;
+		}
+	}
+
+	munmap((void *) map, st.st_size);
+
+	return ctx;
+
+err_context_destroy:
+	iio_context_destroy(ctx);
+err_unmap:
+	munmap((void *) map, st.st_size);
+	return iio_ptr(ret);
+}
+
 static struct iio_context *
 local_create_context(const struct iio_context_params *params, const char *args)
 {
+	const char *cache_path = NULL;
 	struct iio_context *ctx;
 	char *description;
 	int ret = -ENOMEM;
 	struct utsname uts;
-	bool no_iio;
+
+	if (args && !strncmp(args, "cache", sizeof("cache") - 1)) {
+		if (args[sizeof("cache") - 1] == '=')
+			cache_path = args + sizeof("cache");
+		else if (!args[sizeof("cache") - 1])
+			cache_path = LOCAL_CACHE_DEFAULT_PATH;
+	}
+
+	/* The cache stores a fully enumerated context */
+	if (cache_path && params->lazy)
+		cache_path = NULL;
+
+	if (cache_path) {
+		ctx = local_create_context_from_cache(params, cache_path);
+		ret = iio_err(ctx);
+		if (!ret)
+			return ctx;
+
+		prm_dbg(params, "Context cache miss (%d), enumerating\n", ret);
+	}
 
 	description = local_get_description(NULL);
 	if (!description)
@@ -1720,29 +2380,18 @@ local_create_context(const struct iio_context_params *params, const char *args)
 
 	ctx->params = *params;
 
-	ret = foreach_in_dir(ctx, ctx, "/sys/bus/iio/devices",
-			     true, create_device);
-	no_iio = ret == -ENOENT;
-	if (WITH_HWMON && no_iio)
-	      ret = 0; /* Not an error, unless we also have no hwmon devices */
+	ret = local_enumerate_devices(ctx);
 	if (ret < 0)
-	      goto err_context_destroy;
-
-	if (WITH_HWMON) {
-		ret = foreach_in_dir(ctx, ctx, "/sys/class/hwmon",
-				     true, create_device);
-		if (ret == -ENOENT && !no_iio)
-			ret = 0; /* IIO devices but no hwmon devices - not an error */
-		if (ret < 0)
-			goto err_context_destroy;
-	}
+		goto err_context_destroy;
 
 	qsort(ctx->devices, ctx->nb_devices, sizeof(struct iio_device *),
 		iio_device_compare);
 
-	foreach_in_dir(ctx, ctx, "/sys/kernel/debug/iio", true, add_debug);
+	if (!params->lazy) {
+		foreach_in_dir(ctx, ctx, "/sys/kernel/debug/iio", true, add_debug);
 
-	init_scan_elements(ctx);
+		init_scan_elements(ctx);
+	}
 
 	if (WITH_LOCAL_CONFIG) {
 		ret = populate_context_attrs(ctx, "/etc/libiio.ini");
@@ -1763,6 +2412,11 @@ local_create_context(const struct iio_context_params *params, const char *args)
 	if (ret < 0)
 		goto err_context_destroy;
 
+	/* Refresh the cache from the freshly enumerated context.
+	 * Failure to write it is not fatal. */
+	if (cache_path)
+		local_cache_store(ctx, cache_path);
+
 	return ctx;
 
 err_context_destroy:
@@ -11,10 +11,13 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 struct iio_buffer_impl_pdata;
 struct iio_block_impl_pdata;
+struct iio_context;
 struct iio_device;
+struct iio_uring;
 struct timespec;
 
 struct iio_buffer_pdata {
@@ -26,6 +29,15 @@ struct iio_buffer_pdata {
 	bool dmabuf_supported;
 	bool mmap_supported;
 	size_t size;
+
+	/* Wakeup tuning (see iio_buffer_set_wakeup()): watermark override
+	 * in samples (zero = one block), and cap on how long a transfer
+	 * polls for it, in milliseconds (zero = buffer timeout). */
+	size_t wakeup_min_samples;
+	unsigned int wakeup_max_wait_ms;
+
+	struct iio_uring *uring;
+	bool no_uring;
 };
 
 struct iio_block_pdata {
@@ -39,7 +51,7 @@ struct iio_block_pdata {
 int ioctl_nointr(int fd, unsigned long request, void *data);
 
 int buffer_check_ready(struct iio_buffer_pdata *pdata, int fd,
-		       short events, struct timespec *start);
+		       short events, struct timespec *start, bool wake_early);
 
 struct iio_block_pdata *
 local_create_dmabuf(struct iio_buffer_pdata *pdata, size_t size, void **data);
@@ -48,6 +60,7 @@ void local_free_dmabuf(struct iio_block_pdata *pdata);
 int local_enqueue_dmabuf(struct iio_block_pdata *pdata,
 			 size_t bytes_used, bool cyclic);
 int local_dequeue_dmabuf(struct iio_block_pdata *pdata, bool nonblock);
+int local_get_dmabuf_fd(struct iio_block_pdata *pdata);
 
 struct iio_block_pdata *
 local_create_mmap_block(struct iio_buffer_pdata *pdata,
@@ -59,5 +72,17 @@ int local_enqueue_mmap_block(struct iio_block_pdata *pdata,
 int local_dequeue_mmap_block(struct iio_block_pdata *pdata, bool nonblock);
 
 struct iio_buffer_impl_pdata * local_alloc_mmap_buffer_impl(void);
+void local_free_mmap_buffer_impl(struct iio_buffer_pdata *pdata);
+bool local_mmap_checked(const struct iio_buffer_pdata *pdata);
+
+int local_watch_devices(struct iio_context *ctx,
+			void (*cb)(const struct iio_context *ctx,
+				   const char *id, bool added, void *d),
+			void *d);
+void local_unwatch_devices(struct iio_context *ctx);
+
+ssize_t local_uring_rw(struct iio_buffer_pdata *buffer,
+		       void *dst, size_t len, bool do_read);
+void local_uring_free(struct iio_buffer_pdata *buffer);
 
 #endif /* __IIO_LOCAL_H */
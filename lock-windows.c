@@ -129,6 +129,28 @@ struct iio_thrd * iio_thrd_create(int (*thrd)(void *),
 	return iio_thrd;
 }
 
+int iio_thrd_set_affinity(struct iio_thrd *thrd, unsigned int cpu)
+{
+	if (cpu >= 8 * sizeof(DWORD_PTR))
+		return -EINVAL;
+
+	if (!SetThreadAffinityMask(thrd->thid, (DWORD_PTR)1 << cpu))
+		return -(int) GetLastError();
+
+	return 0;
+}
+
+int iio_thrd_set_priority(struct iio_thrd *thrd, int priority)
+{
+	int prio = priority > 0 ?
+		THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_NORMAL;
+
+	if (!SetThreadPriority(thrd->thid, prio))
+		return -(int) GetLastError();
+
+	return 0;
+}
+
 int iio_thrd_join_and_destroy(struct iio_thrd *thrd)
 {
 	DWORD ret = 0;
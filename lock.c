@@ -6,6 +6,10 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for pthread_setaffinity_np() */
+#endif
+
 #include "iio-config.h"
 
 #include <iio/iio-backend.h>
@@ -13,6 +17,7 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <time.h>
 
@@ -139,6 +144,36 @@ struct iio_thrd * iio_thrd_create(int (*thrd)(void *),
 	return iio_thrd;
 }
 
+int iio_thrd_set_affinity(struct iio_thrd *thrd, unsigned int cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return -pthread_setaffinity_np(thrd->thid, sizeof(set), &set);
+#else
+	return -ENOSYS;
+#endif
+}
+
+int iio_thrd_set_priority(struct iio_thrd *thrd, int priority)
+{
+	struct sched_param param = { 0 };
+	int policy = SCHED_OTHER;
+
+	/* A positive priority requests real-time (SCHED_FIFO) scheduling,
+	 * which usually needs CAP_SYS_NICE; zero reverts to the default
+	 * policy. */
+	if (priority > 0) {
+		policy = SCHED_FIFO;
+		param.sched_priority = priority;
+	}
+
+	return -pthread_setschedparam(thrd->thid, policy, &param);
+}
+
 int iio_thrd_join_and_destroy(struct iio_thrd *thrd)
 {
 	void *retval = NULL;
@@ -9,6 +9,7 @@
 #include "network.h"
 
 #include <errno.h>
+#include <string.h>
 #include <ws2tcpip.h>
 #define close(s) closesocket(s)
 
@@ -155,3 +156,242 @@ int do_select(int fd, unsigned int timeout)
 
 	return 0;
 }
+
+/* Overlapped stripe transfers. The sockets are created with
+ * WSA_FLAG_OVERLAPPED (see do_create_socket), so block payloads can be
+ * posted as asynchronous WSASend/WSARecv operations on a process-wide
+ * I/O completion port. One completion thread, shared by every open
+ * context, advances all in-flight transfers; the worker pool then only
+ * serves as a fallback when the port cannot be created. Both the port
+ * and the thread live for the rest of the process once created. */
+
+struct network_overlapped_op {
+	OVERLAPPED ov; /* Must be first */
+	struct network_stripe_xfer *xfer;
+
+	/* Wire-format tag preceding the payload; in transit during the
+	 * TAG state. */
+	uint64_t wire_tag;
+
+	enum { NETWORK_OV_TAG, NETWORK_OV_PAYLOAD } state;
+	size_t done;
+	DWORD flags;
+
+	HANDLE done_evt;
+	int ret;
+};
+
+static HANDLE network_iocp;
+static SRWLOCK network_iocp_lock = SRWLOCK_INIT;
+
+static void network_overlapped_post(struct network_overlapped_op *op)
+{
+	struct network_stripe_xfer *xfer = op->xfer;
+	WSABUF buf;
+	char *ptr;
+	size_t len;
+	int ret;
+
+	if (op->state == NETWORK_OV_TAG) {
+		ptr = (char *) &op->wire_tag;
+		len = sizeof(op->wire_tag);
+	} else {
+		ptr = xfer->ptr;
+		len = xfer->len;
+	}
+
+	buf.buf = ptr + op->done;
+	buf.len = (ULONG) (len - op->done);
+	op->flags = 0;
+
+	memset(&op->ov, 0, sizeof(op->ov));
+
+	if (xfer->is_read) {
+		ret = WSARecv((SOCKET) xfer->fd, &buf, 1, NULL, &op->flags,
+			      &op->ov, NULL);
+	} else {
+		ret = WSASend((SOCKET) xfer->fd, &buf, 1, NULL, 0,
+			      &op->ov, NULL);
+	}
+
+	/* On success a completion packet is queued to the port just like
+	 * for a pending operation, so only hard failures end the transfer
+	 * here. */
+	if (ret == SOCKET_ERROR) {
+		ret = WSAGetLastError();
+		if (ret != WSA_IO_PENDING) {
+			op->ret = -ret;
+			SetEvent(op->done_evt);
+		}
+	}
+}
+
+static void network_overlapped_advance(struct network_overlapped_op *op)
+{
+	struct network_stripe_xfer *xfer = op->xfer;
+	size_t total;
+
+	total = op->state == NETWORK_OV_TAG ?
+		sizeof(op->wire_tag) : xfer->len;
+
+	if (op->done < total) {
+		/* Short completion; post the remainder */
+		network_overlapped_post(op);
+		return;
+	}
+
+	if (op->state == NETWORK_OV_TAG) {
+		/* Each chunk is prefixed with the tag of its transfer
+		 * command, so that a de-synchronized stream is detected
+		 * instead of silently corrupting block data. */
+		if (xfer->is_read && op->wire_tag != xfer->tag) {
+			op->ret = -EPROTO;
+			SetEvent(op->done_evt);
+			return;
+		}
+
+		if (!xfer->len) {
+			op->ret = 0;
+			SetEvent(op->done_evt);
+			return;
+		}
+
+		op->state = NETWORK_OV_PAYLOAD;
+		op->done = 0;
+		network_overlapped_post(op);
+		return;
+	}
+
+	op->ret = 0;
+	SetEvent(op->done_evt);
+}
+
+static DWORD WINAPI network_iocp_thrd(LPVOID d)
+{
+	struct network_overlapped_op *op;
+	OVERLAPPED *ov;
+	ULONG_PTR key;
+	DWORD bytes;
+	BOOL success;
+
+	for (;;) {
+		bytes = 0;
+		ov = NULL;
+
+		success = GetQueuedCompletionStatus(network_iocp, &bytes,
+						    &key, &ov, INFINITE);
+		if (!ov)
+			continue; /* Port-level failure, nothing to advance */
+
+		op = (struct network_overlapped_op *) ov;
+
+		if (!success) {
+			op->ret = -(int) GetLastError();
+			SetEvent(op->done_evt);
+			continue;
+		}
+
+		if (bytes == 0) {
+			/* Graceful close mid-transfer */
+			op->ret = -EPIPE;
+			SetEvent(op->done_evt);
+			continue;
+		}
+
+		op->done += bytes;
+		network_overlapped_advance(op);
+	}
+
+	return 0;
+}
+
+bool network_overlapped_available(void)
+{
+	HANDLE thrd;
+	bool ok;
+
+	AcquireSRWLockExclusive(&network_iocp_lock);
+
+	if (!network_iocp) {
+		network_iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE,
+						      NULL, 0, 1);
+		if (network_iocp) {
+			thrd = CreateThread(NULL, 0, network_iocp_thrd,
+					    NULL, 0, NULL);
+			if (thrd) {
+				CloseHandle(thrd);
+			} else {
+				CloseHandle(network_iocp);
+				network_iocp = NULL;
+			}
+		}
+	}
+
+	ok = network_iocp != NULL;
+
+	ReleaseSRWLockExclusive(&network_iocp_lock);
+
+	return ok;
+}
+
+static int network_overlapped_associate(int fd)
+{
+	HANDLE ret;
+
+	ret = CreateIoCompletionPort((HANDLE) (SOCKET) fd,
+				     network_iocp, 0, 0);
+
+	/* ERROR_INVALID_PARAMETER means the socket is already associated
+	 * with the port, which is expected: associations are per-socket
+	 * and permanent. */
+	if (!ret && GetLastError() != ERROR_INVALID_PARAMETER)
+		return -(int) GetLastError();
+
+	return 0;
+}
+
+int network_stripe_transfer_overlapped(struct network_stripe_xfer *xfers,
+				       size_t nb)
+{
+	struct network_overlapped_op ops[8];
+	HANDLE events[8];
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < nb; i++) {
+		if (network_overlapped_associate(xfers[i].fd)) {
+			/* Let the caller fall back to the worker pool */
+			return -ENOSYS;
+		}
+	}
+
+	for (i = 0; i < nb; i++) {
+		events[i] = CreateEventW(NULL, TRUE, FALSE, NULL);
+		if (!events[i]) {
+			while (i--)
+				CloseHandle(events[i]);
+			return -ENOSYS;
+		}
+	}
+
+	for (i = 0; i < nb; i++) {
+		memset(&ops[i], 0, sizeof(ops[i]));
+		ops[i].xfer = &xfers[i];
+		ops[i].wire_tag = xfers[i].tag;
+		ops[i].state = NETWORK_OV_TAG;
+		ops[i].done_evt = events[i];
+
+		network_overlapped_post(&ops[i]);
+	}
+
+	WaitForMultipleObjects((DWORD) nb, events, TRUE, INFINITE);
+
+	for (i = 0; i < nb; i++) {
+		if (ops[i].ret && !ret)
+			ret = ops[i].ret;
+
+		CloseHandle(events[i]);
+	}
+
+	return ret;
+}
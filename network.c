@@ -8,7 +8,9 @@
 
 #include "dns_sd.h"
 #include "iio-config.h"
+#include "iiod-responder.h"
 #include "network.h"
+#include "sockopts.h"
 
 #include <iio/iio.h>
 #include <iio/iio-backend.h>
@@ -18,8 +20,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #ifdef _WIN32
 #include <netioapi.h>
@@ -40,10 +48,15 @@
 
 #include <arpa/inet.h>
 #include <netdb.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <poll.h>
+#endif
 #include <net/if.h>
 #include <netinet/tcp.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #endif
 
@@ -53,12 +66,70 @@
 
 #define NETWORK_TIMEOUT_MS 5000
 
+/* Sends at least this big bypass the copy to the socket buffers when
+ * zero-copy mode is enabled; smaller ones aren't worth the page pinning
+ * and completion tracking. */
+#define ZEROCOPY_THRESHOLD (64 * 1024)
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) \
+	&& defined(SO_EE_ORIGIN_ZEROCOPY)
+#define WITH_ZEROCOPY 1
+#else
+#define WITH_ZEROCOPY 0
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0
+#endif
+#endif
+
 struct iio_context_pdata {
 	struct iiod_client_pdata io_ctx;
 	struct addrinfo *addrinfo;
 	struct iiod_client *iiod_client;
+
+	/* Set when "addrinfo" is a hand-crafted entry wrapping an AF_UNIX
+	 * address; it must then be freed manually, not with freeaddrinfo() */
+	bool uds;
+
+	/* Connection-pool bookkeeping (IIO_NET_POOL): the URI key and the
+	 * "uri" attribute of the first context created over this
+	 * connection. NULL when the connection is not poolable. */
+	char *pool_key, *pool_uri;
+
+	/* Socket tuning requested in the URI, applied to every socket
+	 * opened for this context. All-zero when the URI had no options. */
+	struct iio_sockopts sockopts;
+};
+
+/* Opt-in process-wide pool of warm connections, keyed by URI. When
+ * IIO_NET_POOL is set, destroying a context parks its connection here
+ * instead of closing it, and a later iio_create_context() call for the
+ * same URI reuses it, skipping the name resolution, the TCP connect and
+ * the binary protocol negotiation. A numeric value of IIO_NET_POOL
+ * overrides the default idle expiry, in seconds. */
+#define NETWORK_POOL_SIZE 8
+#define NETWORK_POOL_IDLE_S 30
+
+struct network_pool_entry {
+	struct iio_context_pdata *pdata;
+	time_t parked;
 };
 
+static struct network_pool_entry network_pool[NETWORK_POOL_SIZE];
+
+#ifdef _WIN32
+static SRWLOCK network_pool_mutex = SRWLOCK_INIT;
+#define network_pool_lock() AcquireSRWLockExclusive(&network_pool_mutex)
+#define network_pool_unlock() ReleaseSRWLockExclusive(&network_pool_mutex)
+#else
+static pthread_mutex_t network_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define network_pool_lock() pthread_mutex_lock(&network_pool_mutex)
+#define network_pool_unlock() pthread_mutex_unlock(&network_pool_mutex)
+#endif
+
+/* Parked connections have no living context; route their logging
+ * nowhere until they are attached to a new one. */
+static const struct iio_context_params network_pool_params;
+
 struct iio_buffer_pdata {
 	struct iiod_client_pdata io_ctx;
 	struct iiod_client_buffer_pdata *pdata;
@@ -67,22 +138,46 @@ struct iio_buffer_pdata {
 	struct iiod_client *iiod_client;
 };
 
+extern const struct iio_backend iio_ip_backend;
+
 static struct iio_context *
 network_create_context(const struct iio_context_params *params,
 		       const char *host);
+static struct iio_context *
+uds_create_context(const struct iio_context_params *params,
+		   const char *path);
 
 static ssize_t
 network_write_data(struct iiod_client_pdata *io_ctx, const char *src, size_t len,
 		   unsigned int timeout_ms);
 static ssize_t
+network_writev_data(struct iiod_client_pdata *io_ctx,
+		    const struct iiod_buf *bufs, size_t nb,
+		    unsigned int timeout_ms);
+static ssize_t
+network_write_fd_data(struct iiod_client_pdata *io_ctx,
+		      const struct iiod_buf *bufs, size_t nb, int fd,
+		      unsigned int timeout_ms);
+static ssize_t
 network_read_data(struct iiod_client_pdata *io_ctx, char *dst, size_t len,
 		  unsigned int timeout_ms);
 static void network_cancel(struct iiod_client_pdata *io_ctx);
 
+static ssize_t
+network_write_block_oob(struct iiod_client_pdata *io_ctx, uint64_t tag,
+			const void *src, size_t len);
+static ssize_t
+network_read_block_oob(struct iiod_client_pdata *io_ctx, uint64_t tag,
+		       void *dst, size_t len);
+
 static const struct iiod_client_ops network_iiod_client_ops = {
 	.write = network_write_data,
+	.writev = network_writev_data,
+	.write_fd = network_write_fd_data,
 	.read = network_read_data,
 	.cancel = network_cancel,
+	.write_block_oob = network_write_block_oob,
+	.read_block_oob = network_read_block_oob,
 };
 
 static ssize_t network_recv(struct iiod_client_pdata *io_ctx, void *data,
@@ -122,12 +217,80 @@ static ssize_t network_recv(struct iiod_client_pdata *io_ctx, void *data,
 	return ret;
 }
 
+#if WITH_ZEROCOPY
+/* Reap MSG_ZEROCOPY completion notifications from the socket's error
+ * queue. Each notification covers a range of zero-copy sends; once one
+ * has been reaped, the kernel no longer references the corresponding
+ * payload pages. */
+static void network_zc_reap(struct iiod_client_pdata *io_ctx, bool wait)
+{
+	struct sock_extended_err *serr;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	char control[128];
+	struct pollfd pfd;
+	ssize_t ret;
+
+	while (io_ctx->zc_pending) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ret = recvmsg(io_ctx->fd, &msg, MSG_ERRQUEUE);
+		if (ret < 0) {
+			if (errno != EAGAIN || !wait)
+				return;
+
+			/* POLLERR is reported when the error queue is
+			 * non-empty, no events need to be requested. */
+			pfd.fd = io_ctx->fd;
+			pfd.events = 0;
+			pfd.revents = 0;
+			poll(&pfd, 1, -1);
+			continue;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level != SOL_IP && cm->cmsg_level != SOL_IPV6)
+				continue;
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (serr->ee_errno != 0 ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			ret = serr->ee_data - serr->ee_info + 1;
+			if ((size_t) ret > io_ctx->zc_pending)
+				io_ctx->zc_pending = 0;
+			else
+				io_ctx->zc_pending -= (unsigned int) ret;
+		}
+	}
+}
+#else
+static void network_zc_reap(struct iiod_client_pdata *io_ctx, bool wait)
+{
+}
+#endif
+
 static ssize_t network_send(struct iiod_client_pdata *io_ctx, const void *data,
 			    size_t len, int flags, unsigned int timeout_ms)
 {
+	bool zerocopy = false;
 	ssize_t ret;
 	int err;
 
+#if WITH_ZEROCOPY
+	if (io_ctx->zerocopy && len >= ZEROCOPY_THRESHOLD) {
+		/* Free completed slots first, so that the counter cannot
+		 * grow without bound. */
+		network_zc_reap(io_ctx, false);
+
+		zerocopy = true;
+		flags |= MSG_ZEROCOPY;
+	}
+#endif
+
 	while (1) {
 		ret = wait_cancellable(io_ctx, false, timeout_ms);
 		if (ret < 0)
@@ -140,10 +303,23 @@ static ssize_t network_send(struct iiod_client_pdata *io_ctx, const void *data,
 			break;
 
 		err = network_get_error();
+
+#if WITH_ZEROCOPY
+		/* Hitting the optmem limit: fall back to a copied send */
+		if (zerocopy && err == -ENOBUFS) {
+			zerocopy = false;
+			flags &= ~MSG_ZEROCOPY;
+			continue;
+		}
+#endif
+
 		if (!network_should_retry(err) && !network_is_interrupted(err))
 			return (ssize_t) err;
 	}
 
+	if (zerocopy)
+		io_ctx->zc_pending++;
+
 	return ret;
 }
 
@@ -166,10 +342,422 @@ network_readbuf(struct iio_buffer_pdata *pdata, void *dst, size_t len)
 	return iiod_client_readbuf(pdata->pdata, dst, len);
 }
 
+static ssize_t network_stripe_rw_all(int fd, void *ptr, size_t len,
+				     bool is_read)
+{
+	uintptr_t p = (uintptr_t) ptr;
+	ssize_t ret;
+
+	while (len) {
+		if (is_read)
+			ret = recv(fd, (void *) p, (int) len, 0);
+		else
+			ret = send(fd, (const void *) p, (int) len, 0);
+		if (ret == 0)
+			return -EPIPE;
+		if (ret < 0) {
+			ret = network_get_error();
+			if (network_is_interrupted((int) ret) ||
+			    network_should_retry((int) ret))
+				continue;
+			return ret;
+		}
+
+		p += ret;
+		len -= ret;
+	}
+
+	return (ssize_t) (p - (uintptr_t) ptr);
+}
+
+static int network_stripe_worker(void *p, void *d)
+{
+	struct network_stripe_xfer *xfer = d;
+	uint64_t tag;
+	ssize_t ret;
+
+	/* Each chunk is prefixed with the tag of its transfer command, so
+	 * that a de-synchronized stream is detected instead of silently
+	 * corrupting block data. */
+	if (xfer->is_read) {
+		ret = network_stripe_rw_all(xfer->fd, &tag, sizeof(tag), true);
+		if (ret < 0)
+			return (int) ret;
+		if (tag != xfer->tag)
+			return -EPROTO;
+	} else {
+		tag = xfer->tag;
+		ret = network_stripe_rw_all(xfer->fd, &tag, sizeof(tag), false);
+		if (ret < 0)
+			return (int) ret;
+	}
+
+	if (!xfer->len)
+		return 0;
+
+	ret = network_stripe_rw_all(xfer->fd, xfer->ptr, xfer->len,
+				    xfer->is_read);
+	return ret < 0 ? (int) ret : 0;
+}
+
+/* Gap timeout of the UDP receive loop: when a block is still incomplete
+ * and no datagram arrives for this long, the rest is written off as
+ * lost. The transfer response always precedes the datagrams, so a
+ * healthy path only ever waits for in-flight packets. */
+#define UDP_GAP_TIMEOUT_MS 20
+
+static int network_udp_wait(int fd, unsigned int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+#ifdef _WIN32
+	ret = WSAPoll(&pfd, 1, (int) timeout_ms);
+	if (ret < 0)
+		return -EIO;
+#else
+	do {
+		ret = poll(&pfd, 1, (int) timeout_ms);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret < 0)
+		return -errno;
+#endif
+
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+static ssize_t network_udp_read_block(struct iiod_client_pdata *io_ctx,
+				      uint64_t tag, void *dst, size_t len)
+{
+	char datagram[1400];
+	struct iiod_udp_hdr hdr;
+	size_t received = 0, total = len, chunk;
+	ssize_t ret;
+	int err;
+
+	/* Lost chunks must read as zeros, not as stale bytes */
+	memset(dst, 0, len);
+
+	while (received < total) {
+		err = network_udp_wait(io_ctx->udp_fd, UDP_GAP_TIMEOUT_MS);
+		if (err == -ETIMEDOUT)
+			break;
+		if (err)
+			return err;
+
+		ret = recv(io_ctx->udp_fd, datagram, sizeof(datagram), 0);
+		if (ret < 0)
+			return network_get_error();
+		if ((size_t) ret < sizeof(hdr))
+			continue;
+
+		memcpy(&hdr, datagram, sizeof(hdr));
+
+		/* Drop strays from an older, partially lost transfer */
+		if (hdr.tag != tag)
+			continue;
+
+		if (hdr.total < total)
+			total = hdr.total;
+
+		chunk = (size_t) ret - sizeof(hdr);
+		if (hdr.offset >= total || chunk > total - hdr.offset)
+			continue;
+
+		memcpy((char *) dst + hdr.offset, datagram + sizeof(hdr),
+		       chunk);
+		received += chunk;
+	}
+
+	return (ssize_t) received;
+}
+
+static ssize_t network_block_oob(struct iiod_client_pdata *io_ctx,
+				 uint64_t tag, void *ptr, size_t len,
+				 bool is_read)
+{
+	struct network_stripe_xfer xfers[8];
+	struct iio_task_token *tokens[8];
+	size_t i, chunk, offset = 0;
+	int ret = 0, err;
+
+	if (io_ctx->udp_fd >= 0) {
+		if (!is_read)
+			return -ENOSYS;
+
+		return network_udp_read_block(io_ctx, tag, ptr, len);
+	}
+
+	if (!io_ctx->nb_stripes)
+		return -ENOSYS;
+
+	chunk = (len + io_ctx->nb_stripes - 1) / io_ctx->nb_stripes;
+
+	for (i = 0; i < io_ctx->nb_stripes; i++) {
+		xfers[i].fd = io_ctx->stripe_fds[i];
+		xfers[i].tag = tag;
+		xfers[i].ptr = (char *) ptr + offset;
+		if (offset < len)
+			xfers[i].len = chunk < len - offset ? chunk : len - offset;
+		else
+			xfers[i].len = 0;
+		xfers[i].is_read = is_read;
+		offset += xfers[i].len;
+	}
+
+#ifdef _WIN32
+	/* Post the chunks as overlapped operations serviced by the shared
+	 * completion thread, instead of parking one worker thread per
+	 * stripe in blocking calls. */
+	if (network_overlapped_available()) {
+		ret = network_stripe_transfer_overlapped(xfers,
+							 io_ctx->nb_stripes);
+		return ret < 0 ? ret : (ssize_t) len;
+	}
+#endif
+
+	for (i = 0; i < io_ctx->nb_stripes; i++) {
+		tokens[i] = iio_task_enqueue(io_ctx->stripe_task, &xfers[i]);
+		err = iio_err(tokens[i]);
+		if (err) {
+			tokens[i] = NULL;
+			ret = err;
+		}
+	}
+
+	for (i = 0; i < io_ctx->nb_stripes; i++) {
+		if (!tokens[i])
+			continue;
+
+		err = iio_task_sync(tokens[i], 0);
+		if (err && !ret)
+			ret = err;
+	}
+
+	return ret < 0 ? ret : (ssize_t) len;
+}
+
+static ssize_t
+network_write_block_oob(struct iiod_client_pdata *io_ctx, uint64_t tag,
+			const void *src, size_t len)
+{
+	return network_block_oob(io_ctx, tag, (void *) src, len, false);
+}
+
+static ssize_t
+network_read_block_oob(struct iiod_client_pdata *io_ctx, uint64_t tag,
+		       void *dst, size_t len)
+{
+	return network_block_oob(io_ctx, tag, dst, len, true);
+}
+
+static void network_cleanup_stripes(struct iiod_client_pdata *io_ctx)
+{
+	unsigned int i;
+
+	if (io_ctx->stripe_task)
+		iio_task_destroy(io_ctx->stripe_task);
+	for (i = 0; i < io_ctx->nb_stripes; i++)
+		close(io_ctx->stripe_fds[i]);
+
+	io_ctx->nb_stripes = 0;
+	io_ctx->stripe_task = NULL;
+}
+
+/* Attach one stripe connection: plain socket, ASCII mode, one
+ * "STRIPE <token> <index>" command, one integer response. */
+static int network_attach_stripe(struct iio_context_pdata *ctx_pdata,
+				 uint64_t token, unsigned int idx)
+{
+	char buf[64], c;
+	size_t pos = 0;
+	ssize_t ret;
+	int fd;
+
+	fd = create_socket(ctx_pdata->addrinfo, NETWORK_TIMEOUT_MS);
+	if (fd < 0)
+		return fd;
+
+	iio_sockopts_apply(fd, &ctx_pdata->sockopts);
+
+	iio_snprintf(buf, sizeof(buf), "STRIPE %016llx %u\r\n",
+		     (unsigned long long) token, idx);
+
+	ret = network_stripe_rw_all(fd, buf, strlen(buf), false);
+	if (ret < 0)
+		goto err_close;
+
+	/* Read the status line */
+	for (pos = 0; pos < sizeof(buf) - 1; ) {
+		ret = network_stripe_rw_all(fd, &c, 1, true);
+		if (ret < 0)
+			goto err_close;
+		if (c == '\n')
+			break;
+		buf[pos++] = c;
+	}
+	buf[pos] = '\0';
+
+	ret = atoi(buf);
+	if (ret < 0)
+		goto err_close;
+
+	return fd;
+
+err_close:
+	close(fd);
+	return (int) ret;
+}
+
+static void network_setup_stripes(struct iio_buffer_pdata *buf)
+{
+	const struct iio_context *ctx = iio_device_get_context(buf->dev);
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
+	struct iiod_client_pdata *io_ctx = &buf->io_ctx;
+	unsigned long nb;
+	uint64_t token;
+	char *env, *end;
+	int ret;
+
+	env = getenv("IIO_STRIPES");
+	if (!env)
+		return;
+
+	nb = strtoul(env, &end, 10);
+	if (env == end || nb < 2 || nb > 8)
+		return;
+
+	/* The token only needs to be unique among the connections of one
+	 * server; the counter value is plenty. */
+	token = iiod_responder_read_counter_us() ^ ((uintptr_t) buf << 16);
+
+	ret = iiod_client_enable_stripes(buf->iiod_client, token,
+					 (unsigned int) nb);
+	if (ret < 0) {
+		dev_dbg(buf->dev, "Server has no striped transfer support\n");
+		return;
+	}
+
+	io_ctx->stripe_task = iio_task_create_pool(network_stripe_worker,
+						   NULL, "network-stripe",
+						   (unsigned int) nb);
+	if (iio_err(io_ctx->stripe_task)) {
+		io_ctx->stripe_task = NULL;
+		return;
+	}
+
+	for (io_ctx->nb_stripes = 0; io_ctx->nb_stripes < nb;
+	     io_ctx->nb_stripes++) {
+		ret = network_attach_stripe(ctx_pdata, token,
+					    io_ctx->nb_stripes);
+		if (ret < 0) {
+			dev_perror(buf->dev, ret,
+				   "Unable to attach stripe connection");
+			network_cleanup_stripes(io_ctx);
+			return;
+		}
+
+		io_ctx->stripe_fds[io_ctx->nb_stripes] = ret;
+	}
+
+	iio_task_start(io_ctx->stripe_task);
+
+	dev_dbg(buf->dev, "Block transfers striped over %lu connections\n",
+		nb);
+}
+
+static void network_setup_udp(struct iio_buffer_pdata *buf)
+{
+	const struct iio_context *ctx = iio_device_get_context(buf->dev);
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
+	struct iiod_client_pdata *io_ctx = &buf->io_ctx;
+	const struct addrinfo *ai = ctx_pdata->addrinfo;
+	struct sockaddr_storage addr;
+	uint64_t token, ack;
+	unsigned int i;
+	int fd, port, err;
+
+	if (!getenv("IIO_UDP"))
+		return;
+
+	/* Only the plain network transports can carry datagrams. The
+	 * enable call below rejects TX buffers itself: only capture
+	 * payloads may tolerate loss. */
+	if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
+		return;
+
+	/* The token only needs to be unique among the connections of one
+	 * server; the counter value is plenty. */
+	token = iiod_responder_read_counter_us() ^ ((uintptr_t) buf << 16);
+
+	port = iiod_client_enable_udp(buf->pdata, token);
+	if (port <= 0) {
+		dev_dbg(buf->dev, "Server has no UDP streaming support\n");
+		return;
+	}
+
+	fd = (int) socket(ai->ai_family, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return;
+
+	/* Both ends committed when the enable succeeded; from here on,
+	 * any handshake failure just leaves a dead data plane, and the
+	 * stream degrades to accounted loss instead of desynchronizing
+	 * the command stream. */
+	io_ctx->udp_fd = fd;
+
+	iio_sockopts_apply(fd, &ctx_pdata->sockopts);
+
+	memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+	if (addr.ss_family == AF_INET6)
+		((struct sockaddr_in6 *) &addr)->sin6_port = htons((uint16_t) port);
+	else
+		((struct sockaddr_in *) &addr)->sin_port = htons((uint16_t) port);
+
+	if (connect(fd, (struct sockaddr *) &addr, (socklen_t) ai->ai_addrlen) < 0)
+		return;
+
+	/* Hello handshake: send the token, wait for its echo. Retried a
+	 * few times, as these datagrams are just as droppable. */
+	for (i = 0; i < 3; i++) {
+		if (send(fd, (const char *) &token, sizeof(token), 0) < 0)
+			return;
+
+		err = network_udp_wait(fd, 300);
+		if (err)
+			continue;
+
+		if (recv(fd, (char *) &ack, sizeof(ack), 0) == sizeof(ack)
+		    && ack == token) {
+			dev_dbg(buf->dev,
+				"Block payloads streamed over UDP port %d\n",
+				port);
+			return;
+		}
+	}
+
+	dev_warn(buf->dev, "UDP handshake failed, stream will read as lost\n");
+}
+
 static ssize_t
 network_writebuf(struct iio_buffer_pdata *pdata, const void *src, size_t len)
 {
-	return iiod_client_writebuf(pdata->pdata, src, len);
+	ssize_t ret;
+
+	ret = iiod_client_writebuf(pdata->pdata, src, len);
+
+	/* Callers are free to refill the source buffer as soon as this
+	 * function returns, so wait until the kernel released the payload
+	 * pages of any zero-copy send. */
+	if (pdata->io_ctx.zc_pending)
+		network_zc_reap(&pdata->io_ctx, true);
+
+	return ret;
 }
 
 /* The purpose of this function is to provide a version of connect()
@@ -225,7 +813,8 @@ int create_socket(const struct addrinfo *addrinfo, unsigned int timeout)
 		return ret;
 	}
 
-	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+	if (addrinfo->ai_family != AF_UNIX &&
+	    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
 				(const char *) &yes, sizeof(yes)) < 0) {
 		ret = -errno;
 		close(fd);
@@ -329,6 +918,20 @@ network_setup_iiod_client(const struct iio_device *dev,
 	io_ctx->fd = ret;
 	io_ctx->cancelled = false;
 
+	iio_sockopts_apply(io_ctx->fd, &pdata->sockopts);
+
+#if WITH_ZEROCOPY
+	/* Opt-in zero-copy mode for the data sockets: payloads above
+	 * ZEROCOPY_THRESHOLD are then sent without copying them into the
+	 * socket buffers. */
+	if (getenv("IIO_ZEROCOPY")) {
+		int yes = 1;
+
+		io_ctx->zerocopy = !setsockopt(io_ctx->fd, SOL_SOCKET,
+					       SO_ZEROCOPY, &yes, sizeof(yes));
+	}
+#endif
+
 	ret = setup_cancel(io_ctx);
 	if (ret < 0) {
 		goto err_close_socket;
@@ -368,6 +971,161 @@ static void network_free_iiod_client(struct iiod_client *client,
 	io_ctx->fd = -1;
 }
 
+static void network_pool_free_pdata(struct iio_context_pdata *pdata)
+{
+	network_cancel(&pdata->io_ctx);
+	network_free_iiod_client(pdata->iiod_client, &pdata->io_ctx);
+	freeaddrinfo(pdata->addrinfo);
+	free(pdata->pool_key);
+	free(pdata->pool_uri);
+	free(pdata);
+}
+
+static unsigned int network_pool_idle_s(const char *env)
+{
+	long val = strtol(env, NULL, 10);
+
+	return val > 0 ? (unsigned int) val : NETWORK_POOL_IDLE_S;
+}
+
+/* Close connections that sat idle for too long.
+ * Must be called with the pool locked. */
+static void network_pool_expire(time_t now, unsigned int idle_s)
+{
+	unsigned int i;
+
+	for (i = 0; i < NETWORK_POOL_SIZE; i++) {
+		if (network_pool[i].pdata
+		    && now - network_pool[i].parked > (time_t) idle_s) {
+			network_pool_free_pdata(network_pool[i].pdata);
+			network_pool[i].pdata = NULL;
+		}
+	}
+}
+
+static bool network_pool_park(struct iio_context_pdata *pdata)
+{
+	const char *env = getenv("IIO_NET_POOL");
+	time_t now = time(NULL);
+	unsigned int i;
+
+	if (!env || !pdata->pool_key || pdata->io_ctx.cancelled)
+		return false;
+
+	network_pool_lock();
+
+	network_pool_expire(now, network_pool_idle_s(env));
+
+	for (i = 0; i < NETWORK_POOL_SIZE; i++) {
+		if (!network_pool[i].pdata)
+			break;
+	}
+
+	if (i == NETWORK_POOL_SIZE) {
+		network_pool_unlock();
+		return false;
+	}
+
+	/* The context owning this connection is going away; detach the
+	 * logging parameters from it. */
+	pdata->io_ctx.params = &network_pool_params;
+	iiod_client_set_params(pdata->iiod_client, &network_pool_params);
+
+	network_pool[i].pdata = pdata;
+	network_pool[i].parked = now;
+
+	network_pool_unlock();
+
+	return true;
+}
+
+static struct iio_context_pdata * network_pool_take(const char *key)
+{
+	const char *env = getenv("IIO_NET_POOL");
+	struct iio_context_pdata *pdata = NULL;
+	time_t now = time(NULL);
+	unsigned int i;
+
+	if (!env)
+		return NULL;
+
+	network_pool_lock();
+
+	network_pool_expire(now, network_pool_idle_s(env));
+
+	for (i = 0; i < NETWORK_POOL_SIZE; i++) {
+		if (network_pool[i].pdata
+		    && !strcmp(network_pool[i].pdata->pool_key, key)) {
+			pdata = network_pool[i].pdata;
+			network_pool[i].pdata = NULL;
+			break;
+		}
+	}
+
+	network_pool_unlock();
+
+	return pdata;
+}
+
+/* Create a context over a warm pooled connection, skipping name
+ * resolution, TCP connect and protocol negotiation. Returns NULL on any
+ * failure, in which case the caller creates a fresh connection. */
+static struct iio_context *
+network_create_context_from_pool(const struct iio_context_params *params,
+				 const char *key)
+{
+	const char *ctx_attrs[] = { "ip,ip-addr", "uri" };
+	const char *ctx_values[2];
+	struct iio_context_pdata *pdata;
+	struct iio_context *ctx;
+	char *description;
+	int ret;
+
+	pdata = network_pool_take(key);
+	if (!pdata)
+		return NULL;
+
+	pdata->io_ctx.params = params;
+	iiod_client_set_params(pdata->iiod_client, params);
+
+	/* Refresh the remote timeout; this doubles as a health check of
+	 * the parked connection. */
+	ret = iiod_client_set_timeout(pdata->iiod_client, params->timeout_ms);
+	if (ret) {
+		prm_dbg(params, "Pooled connection for %s is stale\n", key);
+		goto err_free_pdata;
+	}
+
+	description = network_get_description(pdata->addrinfo, params);
+	ret = iio_err(description);
+	if (ret)
+		goto err_free_pdata;
+
+	ctx_values[0] = description;
+	ctx_values[1] = pdata->pool_uri;
+
+	prm_dbg(params, "Creating context from pooled connection...\n");
+	ctx = iiod_client_create_context(pdata->iiod_client,
+					 &iio_ip_backend, description,
+					 ctx_attrs, ctx_values,
+					 ARRAY_SIZE(ctx_values));
+	ret = iio_err(ctx);
+	if (ret) {
+		free(description);
+		goto err_free_pdata;
+	}
+
+	iio_context_set_pdata(ctx, pdata);
+
+	pdata->io_ctx.params = iio_context_get_params(ctx);
+
+	return ctx;
+
+err_free_pdata:
+	network_pool_free_pdata(pdata);
+	return NULL;
+}
+
 static ssize_t network_read_dev_attr(const struct iio_device *dev,
 				     unsigned int buf_id, const char *attr,
 				     char *dst, size_t len,
@@ -388,8 +1146,46 @@ static ssize_t network_write_dev_attr(const struct iio_device *dev,
 	const struct iio_context *ctx = iio_device_get_context(dev);
 	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
 
-	return iiod_client_write_attr(pdata->iiod_client, dev, NULL,
-				      attr, src, len, type, buf_id);
+	return iiod_client_write_attr(pdata->iiod_client, dev, NULL,
+				      attr, src, len, type, buf_id);
+}
+
+static int network_read_attrs_bulk(const struct iio_context *ctx,
+				   struct iio_bulk_attr *attrs, size_t nb)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_read_attrs_bulk(pdata->iiod_client, attrs, nb);
+}
+
+static int network_write_attrs_bulk(const struct iio_context *ctx,
+				    struct iio_bulk_attr *attrs, size_t nb)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_write_attrs_bulk(pdata->iiod_client, attrs, nb);
+}
+
+static int network_reg_read_multi(struct iio_device *dev,
+				  const uint32_t *addrs, uint32_t *values,
+				  size_t nb)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_reg_read_multi(pdata->iiod_client, dev,
+					  addrs, values, nb);
+}
+
+static int network_reg_write_multi(struct iio_device *dev,
+				   const uint32_t *addrs,
+				   const uint32_t *values, size_t nb)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_reg_write_multi(pdata->iiod_client, dev,
+					   addrs, values, nb);
 }
 
 static ssize_t network_read_chn_attr(const struct iio_channel *chn,
@@ -436,12 +1232,29 @@ static void network_shutdown(struct iio_context *ctx)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
 
+	/* Park healthy connections for reuse by the next context created
+	 * for the same URI. The core frees the context's pdata pointer,
+	 * so detach it first. */
+	if (network_pool_park(pdata)) {
+		iio_context_set_pdata(ctx, NULL);
+		return;
+	}
+
 	network_cancel(&pdata->io_ctx);
 
 	/* TODO: Free buffers? */
 
 	network_free_iiod_client(pdata->iiod_client, &pdata->io_ctx);
-	freeaddrinfo(pdata->addrinfo);
+
+	if (pdata->uds) {
+		free(pdata->addrinfo->ai_addr);
+		free(pdata->addrinfo);
+	} else {
+		freeaddrinfo(pdata->addrinfo);
+	}
+
+	free(pdata->pool_key);
+	free(pdata->pool_uri);
 }
 
 static int network_set_timeout(struct iio_context *ctx, unsigned int timeout)
@@ -460,6 +1273,64 @@ static int network_set_timeout(struct iio_context *ctx, unsigned int timeout)
 	return 0;
 }
 
+/* Opt into zstd-compressed block transfers when IIO_ZSTD is set to the
+ * desired compression level, with an optional trained dictionary loaded
+ * from the file named by IIO_ZSTD_DICT. Any failure (old server, library
+ * built without ZSTD, ...) just leaves payloads uncompressed. */
+static void network_setup_zstd(struct iio_buffer_pdata *buf)
+{
+	void *dict = NULL;
+	size_t dict_len = 0;
+	long level, fsize;
+	char *env, *end;
+	FILE *f;
+	int ret;
+
+	env = getenv("IIO_ZSTD");
+	if (!env)
+		return;
+
+	level = strtol(env, &end, 10);
+	if (env == end || level < 1)
+		return;
+
+	env = getenv("IIO_ZSTD_DICT");
+	if (env) {
+		f = fopen(env, "rb");
+		if (!f) {
+			dev_perror(buf->dev, -errno,
+				   "Unable to open zstd dictionary");
+			return;
+		}
+
+		if (fseek(f, 0, SEEK_END) < 0 || (fsize = ftell(f)) <= 0 ||
+		    fseek(f, 0, SEEK_SET) < 0) {
+			fclose(f);
+			return;
+		}
+
+		dict = malloc(fsize);
+		if (!dict || fread(dict, 1, fsize, f) != (size_t) fsize) {
+			free(dict);
+			fclose(f);
+			return;
+		}
+
+		fclose(f);
+		dict_len = (size_t) fsize;
+	}
+
+	ret = iiod_client_enable_zstd(buf->iiod_client, (int) level,
+				      dict, dict_len);
+	free(dict);
+
+	if (ret < 0)
+		dev_dbg(buf->dev, "Server has no compressed transfer support\n");
+	else
+		dev_dbg(buf->dev, "Block transfers zstd-compressed at level %ld\n",
+			level);
+}
+
 static struct iio_buffer_pdata *
 network_create_buffer(const struct iio_device *dev, unsigned int idx,
 		      struct iio_channels_mask *mask)
@@ -476,6 +1347,7 @@ network_create_buffer(const struct iio_device *dev, unsigned int idx,
 
 	buf->io_ctx.params = params;
 	buf->io_ctx.ctx_pdata = pdata;
+	buf->io_ctx.udp_fd = -1;
 	buf->dev = dev;
 
 	buf->iiod_client = network_setup_iiod_client(dev, &buf->io_ctx);
@@ -493,6 +1365,52 @@ network_create_buffer(const struct iio_device *dev, unsigned int idx,
 		goto err_free_iiod_client;
 	}
 
+	/* Optionally stripe this buffer's block transfers over multiple
+	 * connections; any failure just leaves the single-socket path. */
+	network_setup_stripes(buf);
+
+	/* Optionally stream this buffer's capture payloads over a lossy
+	 * UDP data plane (IIO_UDP): a dropped datagram then costs a hole
+	 * in one block instead of head-of-line blocking the stream. */
+	if (!buf->io_ctx.nb_stripes)
+		network_setup_udp(buf);
+
+	/* Striped and datagram payloads move out-of-band and are never
+	 * compressed */
+	if (!buf->io_ctx.nb_stripes && buf->io_ctx.udp_fd < 0)
+		network_setup_zstd(buf);
+
+	/* Optionally drop the zero padding of the sample format on the
+	 * wire (IIO_PACK). Packed payloads are never compressed, so this
+	 * engages only when neither stripes nor zstd are in use. */
+	if (getenv("IIO_PACK")) {
+		ret = iiod_client_enable_pack(buf->pdata);
+		if (ret < 0)
+			dev_dbg(dev, "Bit-packing codec not enabled: %d\n",
+				ret);
+	}
+
+	/* Optionally let the server loop an already-uploaded cyclic
+	 * waveform instead of re-sending it (IIO_CYCLIC_CACHE). The
+	 * application then must not modify a block between enqueues. */
+	if (getenv("IIO_CYCLIC_CACHE")) {
+		ret = iiod_client_enable_cyclic_cache(buf->pdata);
+		if (ret < 0)
+			dev_dbg(dev, "Cyclic waveform cache not enabled: %d\n",
+				ret);
+	}
+
+	/* Optionally move block payloads through shared memory instead of
+	 * the socket (IIO_MEMFD). Only works on Unix-domain connections,
+	 * and is mutually exclusive with packed, compressed and striped
+	 * transfers. */
+	if (getenv("IIO_MEMFD")) {
+		ret = iiod_client_enable_memfd(buf->pdata);
+		if (ret < 0)
+			dev_dbg(dev, "Shared-memory blocks not enabled: %d\n",
+				ret);
+	}
+
 	return buf;
 
 err_free_iiod_client:
@@ -505,6 +1423,9 @@ err_free_buf:
 
 void network_free_buffer(struct iio_buffer_pdata *pdata)
 {
+	if (pdata->io_ctx.udp_fd >= 0)
+		close(pdata->io_ctx.udp_fd);
+	network_cleanup_stripes(&pdata->io_ctx);
 	iiod_client_free_buffer(pdata->pdata);
 	network_free_iiod_client(pdata->iiod_client, &pdata->io_ctx);
 	free(pdata);
@@ -516,6 +1437,26 @@ int network_enable_buffer(struct iio_buffer_pdata *pdata,
 	return iiod_client_enable_buffer(pdata->pdata, block_size, enable);
 }
 
+static int network_enable_buffers(struct iio_buffer_pdata **pdatas, size_t nb)
+{
+	struct iiod_client_buffer_pdata **cl_pdatas;
+	size_t i;
+	int ret;
+
+	cl_pdatas = calloc(nb, sizeof(*cl_pdatas));
+	if (!cl_pdatas)
+		return -ENOMEM;
+
+	for (i = 0; i < nb; i++)
+		cl_pdatas[i] = pdatas[i]->pdata;
+
+	ret = iiod_client_enable_buffers(cl_pdatas, nb);
+
+	free(cl_pdatas);
+
+	return ret;
+}
+
 struct iio_block_pdata * network_create_block(struct iio_buffer_pdata *pdata,
 					      size_t size, void **data)
 {
@@ -529,6 +1470,10 @@ static const struct iio_backend_ops network_ops = {
 	.write_device_attr = network_write_dev_attr,
 	.read_channel_attr = network_read_chn_attr,
 	.write_channel_attr = network_write_chn_attr,
+	.read_attrs_bulk = network_read_attrs_bulk,
+	.write_attrs_bulk = network_write_attrs_bulk,
+	.reg_read_multi = network_reg_read_multi,
+	.reg_write_multi = network_reg_write_multi,
 	.get_trigger = network_get_trigger,
 	.set_trigger = network_set_trigger,
 	.shutdown = network_shutdown,
@@ -537,6 +1482,7 @@ static const struct iio_backend_ops network_ops = {
 	.create_buffer = network_create_buffer,
 	.free_buffer = network_free_buffer,
 	.enable_buffer = network_enable_buffer,
+	.enable_buffers = network_enable_buffers,
 	.cancel_buffer = network_cancel_buffer,
 
 	.readbuf = network_readbuf,
@@ -557,6 +1503,48 @@ const struct iio_backend iio_ip_backend = {
 	.default_timeout_ms = NETWORK_TIMEOUT_MS,
 };
 
+/* Same backend over an AF_UNIX stream socket, for clients running on the
+ * same host as iiod (see iiod's --uds option). Identical wire protocol,
+ * but without the TCP loopback overhead. */
+static const struct iio_backend_ops uds_ops = {
+	.create = uds_create_context,
+	.read_device_attr = network_read_dev_attr,
+	.write_device_attr = network_write_dev_attr,
+	.read_channel_attr = network_read_chn_attr,
+	.write_channel_attr = network_write_chn_attr,
+	.read_attrs_bulk = network_read_attrs_bulk,
+	.write_attrs_bulk = network_write_attrs_bulk,
+	.reg_read_multi = network_reg_read_multi,
+	.reg_write_multi = network_reg_write_multi,
+	.get_trigger = network_get_trigger,
+	.set_trigger = network_set_trigger,
+	.shutdown = network_shutdown,
+	.set_timeout = network_set_timeout,
+
+	.create_buffer = network_create_buffer,
+	.free_buffer = network_free_buffer,
+	.enable_buffer = network_enable_buffer,
+	.enable_buffers = network_enable_buffers,
+	.cancel_buffer = network_cancel_buffer,
+
+	.readbuf = network_readbuf,
+	.writebuf = network_writebuf,
+
+	.create_block = network_create_block,
+	.free_block = iiod_client_free_block,
+	.enqueue_block = iiod_client_enqueue_block,
+	.dequeue_block = iiod_client_dequeue_block,
+};
+
+__api_export_if(WITH_NETWORK_BACKEND_DYNAMIC)
+const struct iio_backend iio_uds_backend = {
+	.api_version = IIO_BACKEND_API_V1,
+	.name = "uds",
+	.uri_prefix = "uds:",
+	.ops = &uds_ops,
+	.default_timeout_ms = NETWORK_TIMEOUT_MS,
+};
+
 static ssize_t network_write_data(struct iiod_client_pdata *io_ctx,
 				  const char *src, size_t len,
 				  unsigned int timeout_ms)
@@ -564,6 +1552,150 @@ static ssize_t network_write_data(struct iiod_client_pdata *io_ctx,
 	return network_send(io_ctx, src, len, 0, timeout_ms);
 }
 
+static ssize_t network_writev_data(struct iiod_client_pdata *io_ctx,
+				   const struct iiod_buf *bufs, size_t nb,
+				   unsigned int timeout_ms)
+{
+#ifdef _WIN32
+	WSABUF wsa_bufs[32];
+	DWORD sent;
+#else
+	struct iovec iov[32];
+	struct msghdr msg;
+#endif
+	bool zerocopy = false;
+	unsigned int i;
+	size_t total;
+	ssize_t ret;
+	int err;
+
+	/* Sending fewer buffers than requested is fine; the caller handles
+	 * short writes. */
+	if (nb > 32)
+		nb = 32;
+
+#ifdef _WIN32
+	for (i = 0; i < nb; i++) {
+		wsa_bufs[i].buf = bufs[i].ptr;
+		wsa_bufs[i].len = (ULONG) bufs[i].size;
+	}
+#else
+	for (i = 0; i < nb; i++) {
+		iov[i].iov_base = bufs[i].ptr;
+		iov[i].iov_len = bufs[i].size;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = nb;
+#endif
+
+	total = 0;
+	for (i = 0; i < nb; i++)
+		total += bufs[i].size;
+
+#if WITH_ZEROCOPY
+	if (io_ctx->zerocopy && total >= ZEROCOPY_THRESHOLD) {
+		network_zc_reap(io_ctx, false);
+		zerocopy = true;
+	}
+#endif
+
+	while (1) {
+		ret = wait_cancellable(io_ctx, false, timeout_ms);
+		if (ret < 0)
+			return ret;
+
+#ifdef _WIN32
+		if (!WSASend(io_ctx->fd, wsa_bufs, (DWORD) nb,
+			     &sent, 0, NULL, NULL))
+			return (ssize_t) sent;
+#else
+		ret = sendmsg(io_ctx->fd, &msg, zerocopy ? MSG_ZEROCOPY : 0);
+		if (ret == 0)
+			return -EPIPE;
+		else if (ret > 0)
+			break;
+#endif
+
+		err = network_get_error();
+
+#if WITH_ZEROCOPY
+		if (zerocopy && err == -ENOBUFS) {
+			zerocopy = false;
+			continue;
+		}
+#endif
+
+		if (!network_should_retry(err) && !network_is_interrupted(err))
+			return (ssize_t) err;
+	}
+
+	if (zerocopy)
+		io_ctx->zc_pending++;
+
+	return ret;
+}
+
+static ssize_t network_write_fd_data(struct iiod_client_pdata *io_ctx,
+				     const struct iiod_buf *bufs, size_t nb,
+				     int fd, unsigned int timeout_ms)
+{
+#ifdef _WIN32
+	return -ENOSYS;
+#else
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov[32];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	unsigned int i;
+	ssize_t ret;
+	int err;
+
+	/* Sending fewer buffers than requested is fine; the caller handles
+	 * short writes. The descriptor rides with the first bytes, which are
+	 * always part of the first sendmsg(). */
+	if (nb > 32)
+		nb = 32;
+
+	for (i = 0; i < nb; i++) {
+		iov[i].iov_base = bufs[i].ptr;
+		iov[i].iov_len = bufs[i].size;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = nb;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	while (1) {
+		ret = wait_cancellable(io_ctx, false, timeout_ms);
+		if (ret < 0)
+			return ret;
+
+		ret = sendmsg(io_ctx->fd, &msg, 0);
+		if (ret == 0)
+			return -EPIPE;
+		else if (ret > 0)
+			return ret;
+
+		err = network_get_error();
+		if (!network_should_retry(err) && !network_is_interrupted(err))
+			return (ssize_t) err;
+	}
+#endif
+}
+
 static ssize_t network_read_data(struct iiod_client_pdata *io_ctx,
 				 char *dst, size_t len, unsigned int timeout_ms)
 {
@@ -584,11 +1716,43 @@ static struct iio_context * network_create_context(const struct iio_context_para
 	char uri[FQDN_LEN + 3];
 	char port_str[6];
 	uint16_t port_num = IIOD_PORT;
-	char host_buf[FQDN_LEN + sizeof(":65535") + 1];
+	char host_buf[FQDN_LEN + sizeof(":65535") + 128];
 	char *host = hostname ? host_buf : NULL;
+	struct iio_sockopts sockopts = { 0 };
+	char *args, *devs = NULL;
 
 	iio_strlcpy(host_buf, hostname, sizeof(host_buf));
 
+	/* Socket tuning options ride in a query-string suffix, e.g.
+	 * "ip:host?rcvbuf=8M&busypoll=50&tos=0x2e". A "devices=" item
+	 * restricts the context to a comma-separated list of device IDs,
+	 * names or labels; as its value contains commas, it must be the
+	 * last '&'-separated item. */
+	args = host ? strchr(host, '?') : NULL;
+	if (args) {
+		*args++ = '\0';
+
+		devs = strstr(args, "devices=");
+		while (devs && devs != args && devs[-1] != '&')
+			devs = strstr(devs + 1, "devices=");
+		if (devs) {
+			if (devs == args)
+				args = NULL;
+			else
+				devs[-1] = '\0';
+			devs += sizeof("devices=") - 1;
+		}
+
+		if (args && args[0]) {
+			ret = iio_sockopts_parse(&sockopts, args);
+			if (ret) {
+				prm_err(params, "Invalid socket options: '%s'\n",
+					args);
+				return iio_ptr(ret);
+			}
+		}
+	}
+
 #ifdef _WIN32
 	unsigned int i;
 	WSADATA wsaData;
@@ -599,6 +1763,16 @@ static struct iio_context * network_create_context(const struct iio_context_para
 		return iio_ptr(ret);
 	}
 #endif
+	if (hostname && hostname[0]) {
+		char pool_key[sizeof("ip:") + FQDN_LEN + sizeof(":65535") + 128];
+
+		iio_snprintf(pool_key, sizeof(pool_key), "ip:%s", hostname);
+
+		ctx = network_create_context_from_pool(params, pool_key);
+		if (ctx)
+			return ctx;
+	}
+
 	/* ipv4 addresses are simply ip:port, e.g. 192.168.1.67:80
 	 * Because IPv6 addresses contain colons, and URLs use colons to separate
 	 * the host from the port number, RFC2732 (Format for Literal IPv6
@@ -724,12 +1898,16 @@ static struct iio_context * network_create_context(const struct iio_context_para
 		goto err_free_addrinfo;
 	}
 
+	iio_sockopts_apply(fd, &sockopts);
+
 	pdata = zalloc(sizeof(*pdata));
 	if (!pdata) {
 		ret = -ENOMEM;
 		goto err_close_socket;
 	}
 
+	pdata->sockopts = sockopts;
+
 	description = network_get_description(res, params);
 	ret = iio_err(description);
 	if (ret)
@@ -752,6 +1930,12 @@ static struct iio_context * network_create_context(const struct iio_context_para
 
 	pdata->iiod_client = iiod_client;
 
+	if (devs && devs[0]) {
+		ret = iiod_client_set_device_filter(iiod_client, devs);
+		if (ret)
+			goto err_destroy_iiod_client;
+	}
+
 	if (host && host[0])
 		iio_snprintf(uri, sizeof(uri), "ip:%s", host);
 	else
@@ -776,6 +1960,27 @@ static struct iio_context * network_create_context(const struct iio_context_para
 	params = iio_context_get_params(ctx);
 	pdata->io_ctx.params = params;
 
+	/* Remember the key and URI, so that the connection can be parked
+	 * into the pool when the context is destroyed. */
+	if (hostname && hostname[0] && getenv("IIO_NET_POOL")) {
+		size_t key_len = sizeof("ip:") + strlen(hostname);
+
+		pdata->pool_key = malloc(key_len);
+		if (pdata->pool_key) {
+			iio_snprintf(pdata->pool_key, key_len,
+				     "ip:%s", hostname);
+		}
+
+		pdata->pool_uri = iio_strdup(uri);
+
+		if (!pdata->pool_key || !pdata->pool_uri) {
+			free(pdata->pool_key);
+			free(pdata->pool_uri);
+			pdata->pool_key = NULL;
+			pdata->pool_uri = NULL;
+		}
+	}
+
 	return ctx;
 
 err_destroy_iiod_client:
@@ -793,3 +1998,120 @@ err_free_addrinfo:
 	freeaddrinfo(res);
 	return iio_ptr(ret);
 }
+
+static struct iio_context * uds_create_context(const struct iio_context_params *params,
+					       const char *path)
+{
+#ifdef _WIN32
+	prm_err(params, "Unix-domain sockets are not supported on this platform\n");
+	return iio_ptr(-ENOSYS);
+#else
+	struct iio_context *ctx;
+	struct iiod_client *iiod_client;
+	struct iio_context_pdata *pdata;
+	struct sockaddr_un *addr;
+	struct addrinfo *res;
+	char *description;
+	const char *ctx_attrs[] = { "uri" };
+	const char *ctx_values[1];
+	char uri[sizeof(addr->sun_path) + sizeof("uds:")];
+	int fd, ret;
+
+	if (!path[0] || strlen(path) >= sizeof(addr->sun_path))
+		return iio_ptr(-EINVAL);
+
+	addr = zalloc(sizeof(*addr));
+	if (!addr)
+		return iio_ptr(-ENOMEM);
+
+	addr->sun_family = AF_UNIX;
+	iio_strlcpy(addr->sun_path, path, sizeof(addr->sun_path));
+
+	/* Hand-crafted addrinfo wrapping the AF_UNIX address, so that the
+	 * per-buffer connections can reuse the regular socket creation path */
+	res = zalloc(sizeof(*res));
+	if (!res) {
+		ret = -ENOMEM;
+		goto err_free_addr;
+	}
+
+	res->ai_family = AF_UNIX;
+	res->ai_socktype = SOCK_STREAM;
+	res->ai_addr = (struct sockaddr *) addr;
+	res->ai_addrlen = sizeof(*addr);
+
+	fd = create_socket(res, params->timeout_ms);
+	if (fd < 0) {
+		ret = fd;
+		goto err_free_res;
+	}
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata) {
+		ret = -ENOMEM;
+		goto err_close_socket;
+	}
+
+	description = iio_strdup(path);
+	if (!description) {
+		ret = -ENOMEM;
+		goto err_free_pdata;
+	}
+
+	pdata->addrinfo = res;
+	pdata->uds = true;
+	pdata->io_ctx.fd = fd;
+	pdata->io_ctx.params = params;
+	pdata->io_ctx.ctx_pdata = pdata;
+
+	ret = setup_cancel(&pdata->io_ctx);
+	if (ret)
+		goto err_free_description;
+
+	iiod_client = iiod_client_new(params, &pdata->io_ctx,
+				      &network_iiod_client_ops);
+	ret = iio_err(iiod_client);
+	if (ret)
+		goto err_cleanup_cancel;
+
+	pdata->iiod_client = iiod_client;
+
+	iio_snprintf(uri, sizeof(uri), "uds:%s", path);
+	ctx_values[0] = uri;
+
+	prm_dbg(params, "Creating context...\n");
+	ctx = iiod_client_create_context(pdata->iiod_client,
+					 &iio_uds_backend, description,
+					 ctx_attrs, ctx_values,
+					 ARRAY_SIZE(ctx_values));
+	ret = iio_err(ctx);
+	if (ret)
+		goto err_destroy_iiod_client;
+
+	iio_context_set_pdata(ctx, pdata);
+
+	/* pdata->io_ctx.params points to the 'params' function argument,
+	 * switch it to our local one now */
+	params = iio_context_get_params(ctx);
+	pdata->io_ctx.params = params;
+
+	return ctx;
+
+err_destroy_iiod_client:
+	network_cancel(&pdata->io_ctx);
+	iiod_client_destroy(iiod_client);
+err_cleanup_cancel:
+	cleanup_cancel(&pdata->io_ctx);
+err_free_description:
+	free(description);
+err_free_pdata:
+	free(pdata);
+err_close_socket:
+	close(fd);
+err_free_res:
+	free(res);
+err_free_addr:
+	free(addr);
+	return iio_ptr(ret);
+#endif
+}
@@ -11,9 +11,12 @@
 #define __IIO_NETWORK_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct iio_context_params;
 struct iio_context_pdata;
+struct iio_task;
 struct addrinfo;
 
 struct iiod_client_pdata {
@@ -23,10 +26,48 @@ struct iiod_client_pdata {
 	void * events[2];
 	int cancel_fd[2];
 
+	/* MSG_ZEROCOPY state (Linux only): set when SO_ZEROCOPY could be
+	 * enabled on the socket, plus the number of zero-copy sends whose
+	 * completion notification has not been reaped from the socket's
+	 * error queue yet. */
+	bool zerocopy;
+	unsigned int zc_pending;
+
+	/* Striped block transfers: extra data sockets that block payloads
+	 * are split across, plus the worker pool moving the chunks in
+	 * parallel. Empty when striping is not negotiated. */
+	int stripe_fds[8];
+	unsigned int nb_stripes;
+	struct iio_task *stripe_task;
+
+	/* Connected datagram socket of the UDP data plane, or -1 when it
+	 * is not negotiated. Block payloads then arrive as sequenced
+	 * datagrams and lost ones are accounted instead of resent. */
+	int udp_fd;
+
 	const struct iio_context_params *params;
 	struct iio_context_pdata *ctx_pdata;
 };
 
+/* One stripe's share of a block transfer. Processed on the stripe worker
+ * pool, or posted as an overlapped operation on Windows. */
+struct network_stripe_xfer {
+	int fd;
+	uint64_t tag;
+	void *ptr;
+	size_t len;
+	bool is_read;
+};
+
+#ifdef _WIN32
+/* Overlapped stripe transfers: all chunks are posted as asynchronous
+ * operations on a process-wide I/O completion port, and a single
+ * completion thread shared across contexts advances them. */
+bool network_overlapped_available(void);
+int network_stripe_transfer_overlapped(struct network_stripe_xfer *xfers,
+				       size_t nb);
+#endif
+
 int setup_cancel(struct iiod_client_pdata *io_ctx);
 void cleanup_cancel(struct iiod_client_pdata *io_ctx);
 void do_cancel(struct iiod_client_pdata *io_ctx);
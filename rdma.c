@@ -0,0 +1,459 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2025 Analog Devices, Inc.
+ */
+
+#include "dns_sd.h"
+#include "iio-config.h"
+#include "iiod-responder.h"
+
+#include <iio/iio-backend.h>
+#include <iio/iio-debug.h>
+#include <iio/iiod-client.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <rdma/rsocket.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/* Same port as the TCP backend (IIOD_PORT); on the server side iiod is
+ * expected to run under the rsockets preload library, which keeps its
+ * listening socket number unchanged. */
+#define RDMA_DEFAULT_PORT "30431"
+
+struct iio_context_pdata {
+	int fd;
+	struct iiod_client *iiod_client;
+
+	struct iio_context_params params;
+};
+
+struct iio_buffer_pdata {
+	struct iiod_client_buffer_pdata *pdata;
+};
+
+static struct iio_context *
+rdma_create_context_from_args(const struct iio_context_params *params,
+			      const char *args);
+
+static int rdma_wait_ready(int fd, bool read, unsigned int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = read ? POLLIN : POLLOUT };
+	int ret;
+
+	do {
+		ret = rpoll(&pfd, 1, timeout_ms > 0 ? (int) timeout_ms : -1);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret < 0)
+		return -errno;
+	if (!ret)
+		return -ETIMEDOUT;
+	if (pfd.revents & POLLERR)
+		return -EIO;
+
+	return 0;
+}
+
+static ssize_t rdma_write_data(struct iiod_client_pdata *io_data,
+			       const char *data, size_t len,
+			       unsigned int timeout_ms)
+{
+	struct iio_context_pdata *pdata = (struct iio_context_pdata *) io_data;
+	ssize_t ret;
+	int err;
+
+	err = rdma_wait_ready(pdata->fd, false, timeout_ms);
+	if (err) {
+		prm_err(&pdata->params, "RDMA write failed: %i\n", err);
+		return err;
+	}
+
+	ret = rsend(pdata->fd, data, len, 0);
+	if (ret < 0)
+		return -errno;
+
+	prm_dbg(&pdata->params, "Write returned %li\n", (long) ret);
+
+	return ret;
+}
+
+static ssize_t rdma_writev_data(struct iiod_client_pdata *io_data,
+				const struct iiod_buf *bufs, size_t nb,
+				unsigned int timeout_ms)
+{
+	char buf[512];
+	size_t i, total = 0;
+
+	for (i = 0; i < nb; i++)
+		total += bufs[i].size;
+
+	/* Coalesce a command header and its small payload into a single
+	 * send, so that both travel in one RDMA work request. Bulk payloads
+	 * go out as-is; rsockets moves those with zero-copy RDMA writes. */
+	if (nb < 2 || total > sizeof(buf)) {
+		return rdma_write_data(io_data, bufs[0].ptr, bufs[0].size,
+				       timeout_ms);
+	}
+
+	for (i = 0, total = 0; i < nb; i++) {
+		memcpy(&buf[total], bufs[i].ptr, bufs[i].size);
+		total += bufs[i].size;
+	}
+
+	return rdma_write_data(io_data, buf, total, timeout_ms);
+}
+
+static ssize_t rdma_read_data(struct iiod_client_pdata *io_data,
+			      char *buf, size_t len, unsigned int timeout_ms)
+{
+	struct iio_context_pdata *pdata = (struct iio_context_pdata *) io_data;
+	ssize_t ret;
+	int err;
+
+	err = rdma_wait_ready(pdata->fd, true, timeout_ms);
+	if (err) {
+		prm_err(&pdata->params, "RDMA read failed: %i\n", err);
+		return err;
+	}
+
+	ret = rrecv(pdata->fd, buf, len, 0);
+	if (ret < 0)
+		return -errno;
+	if (!ret)
+		return -EPIPE;
+
+	prm_dbg(&pdata->params, "Read returned %li\n", (long) ret);
+
+	return ret;
+}
+
+static void rdma_cancel(struct iiod_client_pdata *io_data)
+{
+	struct iio_context_pdata *pdata = (struct iio_context_pdata *) io_data;
+
+	/* Unblock any transfer waiting in rpoll(); pending reads then fail
+	 * with -EPIPE and the iiod-client machinery unwinds. */
+	rshutdown(pdata->fd, SHUT_RDWR);
+}
+
+static ssize_t rdma_read_dev_attr(const struct iio_device *dev,
+				  unsigned int buf_id, const char *attr,
+				  char *dst, size_t len,
+				  enum iio_attr_type type)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_read_attr(pdata->iiod_client,
+				     dev, NULL, attr, dst, len, type, buf_id);
+}
+
+static ssize_t rdma_write_dev_attr(const struct iio_device *dev,
+				   unsigned int buf_id, const char *attr,
+				   const char *src, size_t len,
+				   enum iio_attr_type type)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_write_attr(pdata->iiod_client, dev, NULL, attr,
+				      src, len, type, buf_id);
+}
+
+static ssize_t rdma_read_chn_attr(const struct iio_channel *chn,
+				  const char *attr, char *dst, size_t len)
+{
+	const struct iio_device *dev = iio_channel_get_device(chn);
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_read_attr(pdata->iiod_client,
+				     dev, chn, attr, dst, len, false, 0);
+}
+
+static ssize_t rdma_write_chn_attr(const struct iio_channel *chn,
+				   const char *attr, const char *src,
+				   size_t len)
+{
+	const struct iio_device *dev = iio_channel_get_device(chn);
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_write_attr(pdata->iiod_client,
+				      dev, chn, attr, src, len, false, 0);
+}
+
+static int rdma_get_trigger(const struct iio_device *dev,
+			    const struct iio_device **trigger)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_get_trigger(pdata->iiod_client, dev, trigger);
+}
+
+static int rdma_set_trigger(const struct iio_device *dev,
+			    const struct iio_device *trigger)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_set_trigger(pdata->iiod_client, dev, trigger);
+}
+
+static void rdma_shutdown(struct iio_context *ctx)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
+
+	iiod_client_destroy(ctx_pdata->iiod_client);
+	rclose(ctx_pdata->fd);
+}
+
+static struct iio_buffer_pdata *
+rdma_create_buffer(const struct iio_device *dev, unsigned int idx,
+		   struct iio_channels_mask *mask)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	struct iio_buffer_pdata *buf;
+	int ret;
+
+	buf = zalloc(sizeof(*buf));
+	if (!buf)
+		return iio_ptr(-ENOMEM);
+
+	buf->pdata = iiod_client_create_buffer(pdata->iiod_client,
+					       dev, idx, mask);
+	ret = iio_err(buf->pdata);
+	if (ret) {
+		dev_perror(dev, ret, "Unable to create IIOD client");
+		free(buf);
+		return iio_ptr(ret);
+	}
+
+	return buf;
+}
+
+static void rdma_free_buffer(struct iio_buffer_pdata *buf)
+{
+	iiod_client_free_buffer(buf->pdata);
+	free(buf);
+}
+
+static int rdma_enable_buffers(struct iio_buffer_pdata **pdatas, size_t nb)
+{
+	struct iiod_client_buffer_pdata **cl_pdatas;
+	size_t i;
+	int ret;
+
+	cl_pdatas = calloc(nb, sizeof(*cl_pdatas));
+	if (!cl_pdatas)
+		return -ENOMEM;
+
+	for (i = 0; i < nb; i++)
+		cl_pdatas[i] = pdatas[i]->pdata;
+
+	ret = iiod_client_enable_buffers(cl_pdatas, nb);
+
+	free(cl_pdatas);
+
+	return ret;
+}
+
+static int rdma_enable_buffer(struct iio_buffer_pdata *buf,
+			      size_t nb_samples, bool enable)
+{
+	return iiod_client_enable_buffer(buf->pdata, nb_samples, enable);
+}
+
+static struct iio_block_pdata *
+rdma_create_block(struct iio_buffer_pdata *buf, size_t size, void **data)
+{
+	return iiod_client_create_block(buf->pdata, size, data);
+}
+
+static const struct iio_backend_ops rdma_ops = {
+	.create = rdma_create_context_from_args,
+	.read_device_attr = rdma_read_dev_attr,
+	.write_device_attr = rdma_write_dev_attr,
+	.read_channel_attr = rdma_read_chn_attr,
+	.write_channel_attr = rdma_write_chn_attr,
+	.shutdown = rdma_shutdown,
+	.get_trigger = rdma_get_trigger,
+	.set_trigger = rdma_set_trigger,
+
+	.create_buffer = rdma_create_buffer,
+	.free_buffer = rdma_free_buffer,
+	.enable_buffer = rdma_enable_buffer,
+	.enable_buffers = rdma_enable_buffers,
+
+	.create_block = rdma_create_block,
+	.free_block = iiod_client_free_block,
+	.enqueue_block = iiod_client_enqueue_block,
+	.dequeue_block = iiod_client_dequeue_block,
+};
+
+__api_export_if(WITH_RDMA_BACKEND_DYNAMIC)
+const struct iio_backend iio_rdma_backend = {
+	.api_version = IIO_BACKEND_API_V1,
+	.name = "rdma",
+	.uri_prefix = "rdma:",
+	.ops = &rdma_ops,
+	.default_timeout_ms = 5000,
+};
+
+static const struct iiod_client_ops rdma_iiod_client_ops = {
+	.write = rdma_write_data,
+	.writev = rdma_writev_data,
+	.read = rdma_read_data,
+	.cancel = rdma_cancel,
+};
+
+static int rdma_connect(const struct iio_context_params *params,
+			const char *host, const char *port)
+{
+	struct addrinfo hints, *res, *info;
+	int fd, ret;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	ret = getaddrinfo(host, port, &hints, &res);
+	if (ret) {
+		prm_err(params, "Unable to resolve '%s': %s\n",
+			host, gai_strerror(ret));
+		return -EHOSTUNREACH;
+	}
+
+	ret = -EHOSTUNREACH;
+
+	for (info = res; info; info = info->ai_next) {
+		fd = rsocket(info->ai_family, info->ai_socktype,
+			     info->ai_protocol);
+		if (fd < 0) {
+			ret = -errno;
+			continue;
+		}
+
+		if (!rconnect(fd, info->ai_addr, (socklen_t) info->ai_addrlen)) {
+			ret = fd;
+			break;
+		}
+
+		ret = -errno;
+		rclose(fd);
+	}
+
+	freeaddrinfo(res);
+
+	return ret;
+}
+
+static struct iio_context *
+rdma_create_context_from_args(const struct iio_context_params *params,
+			      const char *args)
+{
+	struct iio_context_pdata *pdata;
+	struct iio_context *ctx;
+	const char *ctx_params[] = { "uri", "rdma,host" };
+	const char *ctx_params_values[ARRAY_SIZE(ctx_params)];
+	const char *port = RDMA_DEFAULT_PORT;
+	char *host, *ptr, uri[FQDN_LEN + sizeof("rdma::65535")];
+	int fd, ret;
+
+	host = iio_strdup(args);
+	if (!host)
+		return iio_ptr(-ENOMEM);
+
+	/* Optional ":port" suffix; bare IPv6 addresses must be bracketed */
+	if (host[0] == '[') {
+		ptr = strchr(host, ']');
+		if (!ptr) {
+			ret = -EINVAL;
+			goto err_free_host;
+		}
+
+		if (ptr[1] == ':')
+			port = &ptr[2];
+		else if (ptr[1] != '\0') {
+			ret = -EINVAL;
+			goto err_free_host;
+		}
+
+		*ptr = '\0';
+		memmove(host, host + 1, (size_t)(ptr - host));
+	} else {
+		ptr = strchr(host, ':');
+		if (ptr) {
+			*ptr = '\0';
+			port = &ptr[1];
+		}
+	}
+
+	if (!host[0]) {
+		ret = -EINVAL;
+		goto err_free_host;
+	}
+
+	fd = rdma_connect(params, host, port);
+	if (fd < 0) {
+		ret = fd;
+		prm_perror(params, ret, "Unable to connect to '%s'", host);
+		goto err_free_host;
+	}
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata) {
+		ret = -ENOMEM;
+		goto err_close_fd;
+	}
+
+	pdata->fd = fd;
+	pdata->params = *params;
+
+	pdata->iiod_client = iiod_client_new(params,
+					     (struct iiod_client_pdata *) pdata,
+					     &rdma_iiod_client_ops);
+	ret = iio_err(pdata->iiod_client);
+	if (ret)
+		goto err_free_pdata;
+
+	iio_snprintf(uri, sizeof(uri), "rdma:%s", args);
+
+	ctx_params_values[0] = uri;
+	ctx_params_values[1] = host;
+
+	ctx = iiod_client_create_context(pdata->iiod_client,
+					 &iio_rdma_backend, NULL,
+					 ctx_params, ctx_params_values,
+					 ARRAY_SIZE(ctx_params));
+	ret = iio_err(ctx);
+	if (ret)
+		goto err_destroy_iiod_client;
+
+	iio_context_set_pdata(ctx, pdata);
+	free(host);
+
+	return ctx;
+
+err_destroy_iiod_client:
+	iiod_client_destroy(pdata->iiod_client);
+err_free_pdata:
+	free(pdata);
+err_close_fd:
+	rclose(fd);
+err_free_host:
+	free(host);
+	if (ret == -EINVAL)
+		prm_err(params, "Bad URI: \'rdma:%s\'\n", args);
+	return iio_ptr(ret);
+}
@@ -0,0 +1,508 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+#include "ringlog.h"
+
+#include <iio/iio-lock.h>
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_BUILD
+#define RINGLOG_TLS __declspec(thread)
+#else
+#define RINGLOG_TLS __thread
+#endif
+
+#define RINGLOG_NB_ENTRIES	256	/* Per thread; must be a power of two */
+#define RINGLOG_NB_ARGS		4
+#define RINGLOG_STR_LEN		56	/* %s arguments are copied (truncated) */
+#define RINGLOG_FLUSH_MS	10
+
+enum ringlog_arg_type {
+	RINGLOG_ARG_NONE,
+	RINGLOG_ARG_INT,
+	RINGLOG_ARG_UINT,
+	RINGLOG_ARG_DOUBLE,
+	RINGLOG_ARG_PTR,
+	RINGLOG_ARG_STR,
+};
+
+struct ringlog_arg {
+	enum ringlog_arg_type type;
+	union {
+		long long i;
+		unsigned long long u;
+		double d;
+		const void *p;
+		char s[RINGLOG_STR_LEN];
+	} v;
+};
+
+struct ringlog_entry {
+	const char *fmt;
+	FILE *out;
+	uint64_t timestamp_us;
+	struct ringlog_arg args[RINGLOG_NB_ARGS];
+};
+
+/* Single-producer (the owning thread) / single-consumer (the flush
+ * thread) ring. The producer fills entries[head % nb] and publishes it
+ * with a release store of head; the consumer renders everything between
+ * tail and head. Messages logged while the ring is full are counted in
+ * "dropped" instead of blocking the producer. */
+struct ringlog_ring {
+	struct ringlog_ring *next;
+	atomic_uint head, tail;
+	atomic_ullong dropped;
+	unsigned long long dropped_reported;
+	struct ringlog_entry entries[RINGLOG_NB_ENTRIES];
+};
+
+/* Rings are pushed here once and never removed: a short-lived thread's
+ * ring (a few tens of KiB) stays allocated until the process exits, so
+ * that the flush thread can walk the list without locks. */
+static atomic_uintptr_t rings_list;
+
+static RINGLOG_TLS struct ringlog_ring *thread_ring;
+
+static struct iio_mutex *ringlog_lock;
+static struct iio_cond *ringlog_cond;
+static atomic_int ringlog_state; /* 0: not started, 1: running, -1: disabled */
+
+bool iio_ringlog_enabled(void)
+{
+	static atomic_int enabled = -1;
+	int val;
+
+	val = atomic_load_explicit(&enabled, memory_order_relaxed);
+	if (val == -1) {
+		const char *env = getenv("IIO_LOG_RING");
+
+		val = env && *env == '1';
+		atomic_store_explicit(&enabled, val, memory_order_relaxed);
+	}
+
+	return val == 1;
+}
+
+/* Conversion specifier, parsed once at capture time and again at render
+ * time. "mods" covers the flags, field width and precision; the length
+ * modifier is dropped, as the captured arguments are re-printed with
+ * their promoted types. */
+struct ringlog_spec {
+	const char *mods;
+	size_t mods_len;
+	char conv;
+	enum { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL,
+	       LEN_Z, LEN_T, LEN_J } length;
+};
+
+static const char * ringlog_parse_spec(const char *c, struct ringlog_spec *spec)
+{
+	spec->mods = c;
+	spec->length = LEN_NONE;
+
+	while (*c == '-' || *c == '+' || *c == ' ' || *c == '#' || *c == '0')
+		c++;
+
+	/* Star width/precision would consume extra arguments; unsupported */
+	if (*c == '*')
+		return NULL;
+	while (*c >= '0' && *c <= '9')
+		c++;
+
+	if (*c == '.') {
+		c++;
+		if (*c == '*')
+			return NULL;
+		while (*c >= '0' && *c <= '9')
+			c++;
+	}
+
+	spec->mods_len = c - spec->mods;
+
+	switch (*c) {
+	case 'h':
+		spec->length = c[1] == 'h' ? LEN_HH : LEN_H;
+		c += spec->length == LEN_HH ? 2 : 1;
+		break;
+	case 'l':
+		spec->length = c[1] == 'l' ? LEN_LL : LEN_L;
+		c += spec->length == LEN_LL ? 2 : 1;
+		break;
+	case 'z':
+		spec->length = LEN_Z;
+		c++;
+		break;
+	case 't':
+		spec->length = LEN_T;
+		c++;
+		break;
+	case 'j':
+		spec->length = LEN_J;
+		c++;
+		break;
+	default:
+		break;
+	}
+
+	spec->conv = *c;
+
+	return c;
+}
+
+static bool ringlog_capture_arg(struct ringlog_arg *arg,
+				const struct ringlog_spec *spec, va_list *ap)
+{
+	const char *str;
+
+	switch (spec->conv) {
+	case 'd':
+	case 'i':
+		arg->type = RINGLOG_ARG_INT;
+		switch (spec->length) {
+		case LEN_L:
+			arg->v.i = va_arg(*ap, long);
+			break;
+		case LEN_LL:
+			arg->v.i = va_arg(*ap, long long);
+			break;
+		case LEN_Z:
+		case LEN_T:
+			arg->v.i = va_arg(*ap, ptrdiff_t);
+			break;
+		case LEN_J:
+			arg->v.i = va_arg(*ap, intmax_t);
+			break;
+		default:
+			arg->v.i = va_arg(*ap, int);
+			break;
+		}
+		return true;
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+	case 'c':
+		arg->type = RINGLOG_ARG_UINT;
+		switch (spec->length) {
+		case LEN_L:
+			arg->v.u = va_arg(*ap, unsigned long);
+			break;
+		case LEN_LL:
+			arg->v.u = va_arg(*ap, unsigned long long);
+			break;
+		case LEN_Z:
+		case LEN_T:
+			arg->v.u = va_arg(*ap, size_t);
+			break;
+		case LEN_J:
+			arg->v.u = va_arg(*ap, uintmax_t);
+			break;
+		default:
+			arg->v.u = va_arg(*ap, unsigned int);
+			break;
+		}
+		return true;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+		if (spec->length != LEN_NONE)
+			return false;
+		arg->type = RINGLOG_ARG_DOUBLE;
+		arg->v.d = va_arg(*ap, double);
+		return true;
+	case 's':
+		/* The string may be transient; keep a (truncated) copy */
+		arg->type = RINGLOG_ARG_STR;
+		str = va_arg(*ap, const char *);
+		if (!str)
+			str = "(null)";
+		strncpy(arg->v.s, str, sizeof(arg->v.s) - 1);
+		arg->v.s[sizeof(arg->v.s) - 1] = '\0';
+		return true;
+	case 'p':
+		arg->type = RINGLOG_ARG_PTR;
+		arg->v.p = va_arg(*ap, void *);
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool ringlog_capture(struct ringlog_entry *entry,
+			    const char *fmt, va_list ap)
+{
+	struct ringlog_spec spec;
+	unsigned int nb = 0;
+	const char *c;
+	va_list args;
+	bool ok = true;
+
+	va_copy(args, ap);
+
+	for (c = fmt; ok && *c; c++) {
+		if (*c != '%')
+			continue;
+		if (*++c == '%')
+			continue;
+
+		c = ringlog_parse_spec(c, &spec);
+		if (!c || nb == RINGLOG_NB_ARGS) {
+			ok = false;
+			break;
+		}
+
+		ok = ringlog_capture_arg(&entry->args[nb++], &spec, &args);
+	}
+
+	va_end(args);
+
+	while (ok && nb < RINGLOG_NB_ARGS)
+		entry->args[nb++].type = RINGLOG_ARG_NONE;
+
+	return ok;
+}
+
+static size_t ringlog_render_spec(char *dst, size_t avail,
+				  const struct ringlog_spec *spec,
+				  const struct ringlog_arg *arg)
+{
+	char specbuf[32];
+	size_t len;
+	int ret;
+
+	if (spec->mods_len + 4 > sizeof(specbuf) - 1)
+		return 0;
+
+	/* Rebuild the specifier around the promoted type */
+	specbuf[0] = '%';
+	memcpy(&specbuf[1], spec->mods, spec->mods_len);
+	len = 1 + spec->mods_len;
+
+	switch (arg->type) {
+	case RINGLOG_ARG_INT:
+	case RINGLOG_ARG_UINT:
+		if (spec->conv != 'c') {
+			specbuf[len++] = 'l';
+			specbuf[len++] = 'l';
+		}
+		specbuf[len++] = spec->conv;
+		specbuf[len] = '\0';
+		if (spec->conv == 'c')
+			ret = snprintf(dst, avail, specbuf, (int) arg->v.u);
+		else if (arg->type == RINGLOG_ARG_INT)
+			ret = snprintf(dst, avail, specbuf, arg->v.i);
+		else
+			ret = snprintf(dst, avail, specbuf, arg->v.u);
+		break;
+	case RINGLOG_ARG_DOUBLE:
+		specbuf[len++] = spec->conv;
+		specbuf[len] = '\0';
+		ret = snprintf(dst, avail, specbuf, arg->v.d);
+		break;
+	case RINGLOG_ARG_STR:
+		specbuf[len++] = 's';
+		specbuf[len] = '\0';
+		ret = snprintf(dst, avail, specbuf, arg->v.s);
+		break;
+	case RINGLOG_ARG_PTR:
+		specbuf[len++] = 'p';
+		specbuf[len] = '\0';
+		ret = snprintf(dst, avail, specbuf, arg->v.p);
+		break;
+	default:
+		ret = 0;
+		break;
+	}
+
+	return ret < 0 ? 0 : (size_t) ret;
+}
+
+static void ringlog_render(const struct ringlog_entry *entry)
+{
+	struct ringlog_spec spec;
+	char buf[1024];
+	size_t pos = 0;
+	unsigned int nb = 0;
+	const char *c;
+
+	for (c = entry->fmt; *c && pos < sizeof(buf) - 1; c++) {
+		if (*c != '%') {
+			buf[pos++] = *c;
+			continue;
+		}
+		if (*++c == '%') {
+			buf[pos++] = '%';
+			continue;
+		}
+
+		c = ringlog_parse_spec(c, &spec);
+		if (!c || nb == RINGLOG_NB_ARGS)
+			break;
+
+		pos += ringlog_render_spec(&buf[pos], sizeof(buf) - pos,
+					   &spec, &entry->args[nb++]);
+		if (pos > sizeof(buf) - 1)
+			pos = sizeof(buf) - 1;
+	}
+
+	fprintf(entry->out, "[%llu.%06llu] %.*s",
+		(unsigned long long) entry->timestamp_us / 1000000,
+		(unsigned long long) entry->timestamp_us % 1000000,
+		(int) pos, buf);
+}
+
+static void ringlog_flush_ring(struct ringlog_ring *ring)
+{
+	unsigned long long dropped;
+	unsigned int head, tail;
+
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	for (; tail != head; tail++)
+		ringlog_render(&ring->entries[tail % RINGLOG_NB_ENTRIES]);
+
+	atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+	dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+	if (dropped != ring->dropped_reported) {
+		fprintf(stderr, "WARNING: ring logger dropped %llu messages\n",
+			dropped - ring->dropped_reported);
+		ring->dropped_reported = dropped;
+	}
+}
+
+static void ringlog_flush_all(void)
+{
+	struct ringlog_ring *ring;
+
+	for (ring = (struct ringlog_ring *)
+			atomic_load_explicit(&rings_list, memory_order_acquire);
+	     ring; ring = ring->next) {
+		ringlog_flush_ring(ring);
+	}
+}
+
+static int ringlog_flush_thrd(void *d)
+{
+	iio_mutex_lock(ringlog_lock);
+
+	for (;;) {
+		iio_cond_wait(ringlog_cond, ringlog_lock, RINGLOG_FLUSH_MS);
+		ringlog_flush_all();
+	}
+
+	return 0;
+}
+
+/* Drain whatever the flush thread did not get to before exit */
+static void ringlog_atexit(void)
+{
+	ringlog_flush_all();
+}
+
+static bool ringlog_start_flusher(void)
+{
+	struct iio_thrd *thrd;
+	int state = 0;
+
+	if (!atomic_compare_exchange_strong(&ringlog_state, &state, 1))
+		return state == 1;
+
+	ringlog_lock = iio_mutex_create();
+	ringlog_cond = iio_cond_create();
+
+	if (iio_err(ringlog_lock) || iio_err(ringlog_cond))
+		goto err_disable;
+
+	thrd = iio_thrd_create(ringlog_flush_thrd, NULL, "iio-ringlog");
+	if (iio_err(thrd))
+		goto err_disable;
+
+	atexit(ringlog_atexit);
+
+	return true;
+
+err_disable:
+	atomic_store(&ringlog_state, -1);
+	return false;
+}
+
+static struct ringlog_ring * ringlog_get_ring(void)
+{
+	struct ringlog_ring *ring = thread_ring;
+	uintptr_t expected;
+
+	if (ring)
+		return ring;
+
+	if (!ringlog_start_flusher())
+		return NULL;
+
+	ring = zalloc(sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	expected = atomic_load_explicit(&rings_list, memory_order_relaxed);
+	do {
+		ring->next = (struct ringlog_ring *) expected;
+	} while (!atomic_compare_exchange_weak_explicit(&rings_list, &expected,
+							(uintptr_t) ring,
+							memory_order_release,
+							memory_order_relaxed));
+
+	thread_ring = ring;
+
+	return ring;
+}
+
+bool iio_ringlog_vprintf(FILE *out, const char *fmt, va_list ap)
+{
+	struct ringlog_entry *entry;
+	struct ringlog_ring *ring;
+	unsigned int head, tail;
+
+	if (atomic_load_explicit(&ringlog_state, memory_order_relaxed) == -1)
+		return false;
+
+	ring = ringlog_get_ring();
+	if (!ring)
+		return false;
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if (head - tail == RINGLOG_NB_ENTRIES) {
+		/* Full. Dropping perturbs the hot path less than either
+		 * waiting for the flusher or falling back to stderr. */
+		atomic_fetch_add_explicit(&ring->dropped, 1,
+					  memory_order_relaxed);
+		return true;
+	}
+
+	entry = &ring->entries[head % RINGLOG_NB_ENTRIES];
+	entry->fmt = fmt;
+	entry->out = out;
+	entry->timestamp_us = iio_read_counter_us();
+
+	if (!ringlog_capture(entry, fmt, ap))
+		return false;
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	return true;
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __IIO_RINGLOG_H__
+#define __IIO_RINGLOG_H__
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <iio/iio.h>
+
+/* Deferred logger for the debug infrastructure: instead of writing to
+ * stderr synchronously, log messages are captured (format pointer plus a
+ * copy of the arguments) into a per-thread lock-free ring and rendered by
+ * a background thread, so that full debug tracing perturbs the hot path
+ * by nanoseconds. Opt-in through IIO_LOG_RING=1 in the environment.
+ *
+ * The rings stay in memory, so the tail of the log survives a crash and
+ * can be recovered from a core dump even when the flush thread never got
+ * to run. */
+
+/* Whether IIO_LOG_RING=1 is set in the environment (cached) */
+bool iio_ringlog_enabled(void);
+
+/* Capture one message into the calling thread's ring. Returns false if
+ * the message could not be captured (unsupported conversion specifier,
+ * ring full, or no threads support): the caller should then print it
+ * synchronously as usual. */
+bool iio_ringlog_vprintf(FILE *out, const char *fmt, va_list ap);
+
+#endif /* __IIO_RINGLOG_H__ */
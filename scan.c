@@ -9,22 +9,152 @@
 #include "iio-config.h"
 #include "iio-private.h"
 
+#include <iio/iio-lock.h>
+
 #include <errno.h>
 #include <stdbool.h>
 #include <string.h>
 
+/* One backend scan, run in its own thread so that a slow backend (e.g.
+ * a mDNS browse) does not delay the results of the fast ones. */
+struct iio_scan_job {
+	struct iio_scan *ctx;
+	const struct iio_backend *backend;
+	struct iio_module *module;
+	char *args;
+	struct iio_context_params params;
+	struct iio_thrd *thrd;
+};
+
 struct iio_scan {
 	struct iio_context_info *info;
 	size_t count;
+
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+
+	struct iio_scan_job *jobs;
+	unsigned int nb_jobs;
+	unsigned int pending;
 };
 
-struct iio_scan * iio_scan(const struct iio_context_params *params,
-			   const char *backends)
+/* Long-lived discovery cache: a background thread periodically re-runs
+ * the backend scans and diffs the results against the cache, so that
+ * queries are answered instantly and changes are notified through a
+ * callback instead of every caller paying the full scan latency. */
+struct iio_scan_monitor {
+	struct iio_context_params params;
+	char *backends;
+	unsigned int interval_ms;
+
+	void (*cb)(void *d, const char *description,
+		   const char *uri, bool connected);
+	void *d;
+
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+	struct iio_thrd *thrd;
+	bool stop;
+
+	struct iio_context_info *info;
+	size_t count;
+};
+
+/* Add / remove notification, recorded under the monitor's lock and
+ * fired once it has been dropped. The strings of a "removed" event are
+ * detached from the cache and owned by the event. */
+struct iio_scan_monitor_event {
+	char *description, *uri;
+	bool connected;
+};
+
+static int iio_scan_job_thrd(void *d)
+{
+	struct iio_scan_job *job = d;
+	struct iio_scan *ctx = job->ctx;
+	int ret;
+
+	ret = job->backend->ops->scan(&job->params, ctx, job->args);
+	if (ret < 0) {
+		prm_perror(&job->params, ret, "Unable to scan %s context",
+			   job->backend->name);
+	}
+
+	iio_mutex_lock(ctx->lock);
+	ctx->pending--;
+	iio_cond_signal(ctx->cond);
+	iio_mutex_unlock(ctx->lock);
+
+	return 0;
+}
+
+static int iio_scan_add_job(struct iio_scan *ctx,
+			    const struct iio_backend *backend,
+			    struct iio_module *module, const char *args,
+			    const struct iio_context_params *params)
+{
+	struct iio_scan_job *jobs, *job;
+
+	jobs = realloc(ctx->jobs, (ctx->nb_jobs + 1) * sizeof(*jobs));
+	if (!jobs)
+		return -ENOMEM;
+
+	ctx->jobs = jobs;
+
+	job = &jobs[ctx->nb_jobs];
+	job->ctx = ctx;
+	job->backend = backend;
+	job->module = module;
+	job->params = *params;
+	job->thrd = NULL;
+	job->args = NULL;
+
+	if (args) {
+		job->args = iio_strdup(args);
+		if (!job->args)
+			return -ENOMEM;
+	}
+
+	ctx->nb_jobs++;
+
+	return 0;
+}
+
+static struct iio_scan * iio_scan_alloc(void)
+{
+	struct iio_scan *ctx;
+	int ret;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return iio_ptr(-ENOMEM);
+
+	ctx->lock = iio_mutex_create();
+	ret = iio_err(ctx->lock);
+	if (ret) {
+		free(ctx);
+		return iio_ptr(ret);
+	}
+
+	ctx->cond = iio_cond_create();
+	ret = iio_err(ctx->cond);
+	if (ret) {
+		iio_mutex_destroy(ctx->lock);
+		free(ctx);
+		return iio_ptr(ret);
+	}
+
+	return ctx;
+}
+
+struct iio_scan * iio_scan_start(const struct iio_context_params *params,
+				 const char *backends)
 {
 	const struct iio_context_params *default_params = get_default_params();
 	struct iio_context_params params2 = { 0 };
 	char *token, *rest, *rest2, *backend_name;
 	const struct iio_backend *backend = NULL;
+	struct iio_scan_job *job;
 	struct iio_module *module;
 	const char *args, *uri;
 	struct iio_scan *ctx;
@@ -41,9 +171,9 @@ struct iio_scan * iio_scan(const struct iio_context_params *params,
 	if (!params2.stderr_level)
 		params2.stderr_level = default_params->stderr_level;
 
-	ctx = calloc(1, sizeof(*ctx));
-	if (!ctx)
-		return iio_ptr(-ENOMEM);
+	ctx = iio_scan_alloc();
+	if (iio_err(ctx))
+		return ctx;
 
 	if (!backends)
 		backends = LIBIIO_SCAN_BACKENDS;
@@ -109,6 +239,8 @@ struct iio_scan * iio_scan(const struct iio_context_params *params,
 		if (!backend->ops || !backend->ops->scan) {
 			prm_warn(params, "Backend %s does not support scanning.\n",
 				 token);
+			if (WITH_MODULES && module)
+				iio_release_module(module);
 			continue;
 		}
 
@@ -117,72 +249,430 @@ struct iio_scan * iio_scan(const struct iio_context_params *params,
 		else
 			params2.timeout_ms = backend->default_timeout_ms;
 
-		ret = backend->ops->scan(&params2, ctx, args);
-		if (ret < 0) {
-			prm_perror(&params2, ret,
-				   "Unable to scan %s context", token);
+		ret = iio_scan_add_job(ctx, backend, module, args, &params2);
+		if (ret) {
+			if (WITH_MODULES && module)
+				iio_release_module(module);
+			iio_scan_destroy(ctx);
+			return iio_ptr(ret);
 		}
+	}
+
+	/* The job list is final now; spawn one scanner thread per backend.
+	 * If a thread cannot be created, scan inline as a fallback. */
+	ctx->pending = ctx->nb_jobs;
 
-		if (WITH_MODULES && module)
-			iio_release_module(module);
+	for (i = 0; i < ctx->nb_jobs; i++) {
+		job = &ctx->jobs[i];
+
+		job->thrd = iio_thrd_create(iio_scan_job_thrd, job,
+					    job->backend->name);
+		if (iio_err(job->thrd)) {
+			job->thrd = NULL;
+			iio_scan_job_thrd(job);
+		}
 	}
 
 	return ctx;
 }
 
+struct iio_scan * iio_scan(const struct iio_context_params *params,
+			   const char *backends)
+{
+	struct iio_scan *ctx;
+	int ret;
+
+	ctx = iio_scan_start(params, backends);
+	if (iio_err(ctx))
+		return ctx;
+
+	do {
+		ret = iio_scan_poll(ctx, 0);
+	} while (ret > 0);
+
+	return ctx;
+}
+
+int iio_scan_poll(struct iio_scan *ctx, unsigned int timeout_ms)
+{
+	size_t count;
+	int ret = 0;
+
+	iio_mutex_lock(ctx->lock);
+
+	count = ctx->count;
+
+	while (ctx->pending && ctx->count == count) {
+		ret = iio_cond_wait(ctx->cond, ctx->lock, timeout_ms);
+		if (ret == -ETIMEDOUT)
+			break;
+
+		ret = 0;
+	}
+
+	if (!ret)
+		ret = !!ctx->pending;
+
+	iio_mutex_unlock(ctx->lock);
+
+	return ret;
+}
+
 void iio_scan_destroy(struct iio_scan *ctx)
 {
+	struct iio_scan_job *job;
 	unsigned int i;
 
+	for (i = 0; i < ctx->nb_jobs; i++) {
+		job = &ctx->jobs[i];
+
+		if (job->thrd)
+			iio_thrd_join_and_destroy(job->thrd);
+		if (WITH_MODULES && job->module)
+			iio_release_module(job->module);
+		free(job->args);
+	}
+
+	free(ctx->jobs);
+
 	for (i = 0; i < ctx->count; i++) {
 		free(ctx->info[i].description);
 		free(ctx->info[i].uri);
 	}
 
+	iio_cond_destroy(ctx->cond);
+	iio_mutex_destroy(ctx->lock);
+
 	free(ctx->info);
 	free(ctx);
 }
 
 size_t iio_scan_get_results_count(const struct iio_scan *ctx)
 {
-	return ctx->count;
+	struct iio_scan *scan = (struct iio_scan *) ctx;
+	size_t count;
+
+	iio_mutex_lock(scan->lock);
+	count = scan->count;
+	iio_mutex_unlock(scan->lock);
+
+	return count;
 }
 
 const char *
 iio_scan_get_description(const struct iio_scan *ctx, size_t idx)
 {
-	if (idx >= ctx->count)
-		return NULL;
+	struct iio_scan *scan = (struct iio_scan *) ctx;
+	const char *description = NULL;
+
+	iio_mutex_lock(scan->lock);
+	if (idx < scan->count)
+		description = scan->info[idx].description;
+	iio_mutex_unlock(scan->lock);
 
-	return ctx->info[idx].description;
+	return description;
 }
 
 const char * iio_scan_get_uri(const struct iio_scan *ctx, size_t idx)
 {
-	if (idx >= ctx->count)
-		return NULL;
+	struct iio_scan *scan = (struct iio_scan *) ctx;
+	const char *uri = NULL;
+
+	iio_mutex_lock(scan->lock);
+	if (idx < scan->count)
+		uri = scan->info[idx].uri;
+	iio_mutex_unlock(scan->lock);
 
-	return ctx->info[idx].uri;
+	return uri;
 }
 
 int iio_scan_add_result(struct iio_scan *ctx, const char *desc, const char *uri)
 {
 	struct iio_context_info *info;
-	size_t size = ctx->count;
+	size_t size;
+	int ret = 0;
+
+	iio_mutex_lock(ctx->lock);
+
+	size = ctx->count;
 
 	info = realloc(ctx->info, (size + 1) * sizeof(*info));
-	if (!info)
-		return -ENOMEM;
+	if (!info) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
 
 	ctx->info = info;
-	ctx->count = size + 1;
 
 	info = &info[size];
 	info->description = iio_strdup(desc);
 	info->uri = iio_strdup(uri);
 
-	if (!info->description || !info->uri)
-		return -ENOMEM;
+	if (!info->description || !info->uri) {
+		free(info->description);
+		free(info->uri);
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	ctx->count = size + 1;
+	iio_cond_signal(ctx->cond);
+
+out_unlock:
+	iio_mutex_unlock(ctx->lock);
+
+	return ret;
+}
+
+static void iio_scan_monitor_update(struct iio_scan_monitor *mon,
+				    const struct iio_scan *scan)
+{
+	struct iio_scan_monitor_event *events;
+	struct iio_context_info *info;
+	size_t i, j, nb_new, nb_events = 0;
+	const char *uri, *desc;
+	bool found;
+
+	nb_new = iio_scan_get_results_count(scan);
+
+	events = calloc(mon->count + nb_new + 1, sizeof(*events));
+	if (!events) {
+		prm_warn(&mon->params, "Unable to diff scan results\n");
+		return;
+	}
+
+	iio_mutex_lock(mon->lock);
+
+	/* Cached entries that disappeared from the scan results */
+	for (i = 0; i < mon->count; ) {
+		found = false;
+
+		for (j = 0; j < nb_new; j++) {
+			uri = iio_scan_get_uri(scan, j);
+			if (uri && !strcmp(mon->info[i].uri, uri)) {
+				found = true;
+				break;
+			}
+		}
+
+		if (found) {
+			i++;
+			continue;
+		}
+
+		events[nb_events].description = mon->info[i].description;
+		events[nb_events].uri = mon->info[i].uri;
+		events[nb_events++].connected = false;
+
+		mon->info[i] = mon->info[--mon->count];
+	}
+
+	/* Scan results not yet in the cache */
+	for (j = 0; j < nb_new; j++) {
+		uri = iio_scan_get_uri(scan, j);
+		desc = iio_scan_get_description(scan, j);
+		if (!uri)
+			continue;
+
+		found = false;
+
+		for (i = 0; i < mon->count; i++) {
+			if (!strcmp(mon->info[i].uri, uri)) {
+				found = true;
+				break;
+			}
+		}
+
+		if (found)
+			continue;
+
+		info = realloc(mon->info, (mon->count + 1) * sizeof(*info));
+		if (!info) {
+			prm_warn(&mon->params, "Unable to cache scan result\n");
+			continue;
+		}
+
+		mon->info = info;
+
+		info = &info[mon->count];
+		info->description = iio_strdup(desc ? desc : "");
+		info->uri = iio_strdup(uri);
+
+		if (!info->description || !info->uri) {
+			free(info->description);
+			free(info->uri);
+			continue;
+		}
+
+		mon->count++;
+
+		events[nb_events].description = info->description;
+		events[nb_events].uri = info->uri;
+		events[nb_events++].connected = true;
+	}
+
+	iio_mutex_unlock(mon->lock);
+
+	/* Fire the notifications without the lock held, so that the
+	 * callback is free to query the monitor. The strings of "added"
+	 * events are owned by the cache, which only the monitor thread
+	 * (us) may shrink; they are valid for the callback's duration. */
+	for (i = 0; i < nb_events; i++) {
+		if (mon->cb) {
+			mon->cb(mon->d, events[i].description, events[i].uri,
+				events[i].connected);
+		}
+
+		if (!events[i].connected) {
+			free(events[i].description);
+			free(events[i].uri);
+		}
+	}
+
+	free(events);
+}
+
+static int iio_scan_monitor_thrd(void *d)
+{
+	struct iio_scan_monitor *mon = d;
+	struct iio_scan *scan;
+	bool stop;
+	int ret;
+
+	for (;;) {
+		iio_mutex_lock(mon->lock);
+		stop = mon->stop;
+		iio_mutex_unlock(mon->lock);
+
+		if (stop)
+			break;
+
+		scan = iio_scan(&mon->params, mon->backends);
+		ret = iio_err(scan);
+		if (ret) {
+			prm_perror(&mon->params, ret, "Unable to scan contexts");
+		} else {
+			iio_scan_monitor_update(mon, scan);
+			iio_scan_destroy(scan);
+		}
+
+		iio_mutex_lock(mon->lock);
+		if (!mon->stop)
+			iio_cond_wait(mon->cond, mon->lock, mon->interval_ms);
+		stop = mon->stop;
+		iio_mutex_unlock(mon->lock);
+
+		if (stop)
+			break;
+	}
 
 	return 0;
 }
+
+struct iio_scan_monitor *
+iio_scan_monitor_create(const struct iio_context_params *params,
+			const char *backends, unsigned int interval_ms,
+			void (*cb)(void *d, const char *description,
+				   const char *uri, bool connected),
+			void *d)
+{
+	struct iio_scan_monitor *mon;
+	int ret;
+
+	mon = calloc(1, sizeof(*mon));
+	if (!mon)
+		return iio_ptr(-ENOMEM);
+
+	if (!params)
+		params = get_default_params();
+	mon->params = *params;
+
+	mon->cb = cb;
+	mon->d = d;
+	mon->interval_ms = interval_ms ? interval_ms : 5000;
+
+	if (backends) {
+		mon->backends = iio_strdup(backends);
+		if (!mon->backends) {
+			ret = -ENOMEM;
+			goto err_free_mon;
+		}
+	}
+
+	mon->lock = iio_mutex_create();
+	ret = iio_err(mon->lock);
+	if (ret)
+		goto err_free_backends;
+
+	mon->cond = iio_cond_create();
+	ret = iio_err(mon->cond);
+	if (ret)
+		goto err_free_lock;
+
+	mon->thrd = iio_thrd_create(iio_scan_monitor_thrd, mon, "scan-monitor");
+	ret = iio_err(mon->thrd);
+	if (ret)
+		goto err_free_cond;
+
+	return mon;
+
+err_free_cond:
+	iio_cond_destroy(mon->cond);
+err_free_lock:
+	iio_mutex_destroy(mon->lock);
+err_free_backends:
+	free(mon->backends);
+err_free_mon:
+	free(mon);
+	return iio_ptr(ret);
+}
+
+struct iio_scan * iio_scan_monitor_get_results(struct iio_scan_monitor *mon)
+{
+	struct iio_scan *ctx;
+	size_t i;
+	int ret;
+
+	ctx = iio_scan_alloc();
+	if (iio_err(ctx))
+		return ctx;
+
+	iio_mutex_lock(mon->lock);
+
+	for (i = 0; i < mon->count; i++) {
+		ret = iio_scan_add_result(ctx, mon->info[i].description,
+					  mon->info[i].uri);
+		if (ret) {
+			iio_mutex_unlock(mon->lock);
+			iio_scan_destroy(ctx);
+			return iio_ptr(ret);
+		}
+	}
+
+	iio_mutex_unlock(mon->lock);
+
+	return ctx;
+}
+
+void iio_scan_monitor_destroy(struct iio_scan_monitor *mon)
+{
+	size_t i;
+
+	iio_mutex_lock(mon->lock);
+	mon->stop = true;
+	iio_cond_signal(mon->cond);
+	iio_mutex_unlock(mon->lock);
+
+	iio_thrd_join_and_destroy(mon->thrd);
+
+	for (i = 0; i < mon->count; i++) {
+		free(mon->info[i].description);
+		free(mon->info[i].uri);
+	}
+
+	free(mon->info);
+	iio_cond_destroy(mon->cond);
+	iio_mutex_destroy(mon->lock);
+	free(mon->backends);
+	free(mon);
+}
@@ -0,0 +1,580 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#include "serial-frame.h"
+
+#include <iio/iio-lock.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Wire format: a 7-byte header followed by the payload.
+ *   [0]   0xA5 start-of-frame marker
+ *   [1]   frame type (data / ack / nak)
+ *   [2]   sequence number
+ *   [3-4] payload length, little-endian (zero for ack / nak)
+ *   [5-6] CRC-16/CCITT of bytes 0-4 and the payload, little-endian
+ * The receiver hunts for the next marker byte after a CRC failure, so
+ * a corrupted frame costs one retransmission, not the connection. */
+#define FRAME_SOF	0xA5
+#define FRAME_HDR_SIZE	7
+
+#define FRAME_DATA	0x01
+#define FRAME_ACK	0x02
+#define FRAME_NAK	0x03
+
+#define FRAME_MAX_PAYLOAD 1024
+
+/* Number of unacknowledged data frames the sender may have in flight.
+ * Must not exceed half the 8-bit sequence space, so that a sequence
+ * number unambiguously identifies a frame within the window. */
+#define FRAME_WINDOW	8
+
+/* Delay before an unacknowledged frame is transmitted again */
+#define FRAME_RTO_US	(200 * 1000)
+
+/* In-order bytes buffered for serial_framer_recv(). Larger than the
+ * receive window so that acknowledged frames always find room.
+ * Must be a power of two. */
+#define FRAME_DELIVER_SIZE 16384
+
+struct frame_tx_slot {
+	uint8_t buf[FRAME_HDR_SIZE + FRAME_MAX_PAYLOAD];
+	size_t len;		/* total encoded length */
+	uint64_t time_us;	/* time of the last (re)transmission */
+	uint8_t seq;
+	bool pending;
+};
+
+struct frame_rx_slot {
+	uint8_t buf[FRAME_MAX_PAYLOAD];
+	size_t len;
+	bool valid;
+};
+
+/* Wire actions decided while parsing under the state lock, performed
+ * once the lock has been dropped. */
+struct frame_actions {
+	uint8_t acks[2 * FRAME_WINDOW];
+	unsigned int nb_acks;
+	uint8_t nak_seq;
+	bool nak;
+	bool retransmit[FRAME_WINDOW];
+};
+
+struct serial_framer {
+	const struct serial_framer_ops *ops;
+	void *d;
+
+	struct iio_mutex *lock;		/* protects all the state below */
+	struct iio_cond *cond;
+	struct iio_mutex *wire_lock;	/* serializes wire writes */
+
+	/* Sender state: one slot per in-flight data frame */
+	struct frame_tx_slot tx_slots[FRAME_WINDOW];
+	uint8_t tx_seq;
+
+	/* Receiver state: out-of-order frames parked until the gap
+	 * before them is filled (selective repeat) */
+	struct frame_rx_slot rx_slots[FRAME_WINDOW];
+	uint8_t rx_expected;
+	bool rx_busy;			/* a thread is reading the wire */
+
+	/* Raw bytes accumulated from the wire, not yet parsed */
+	uint8_t rxbuf[4096];
+	size_t rx_fill;
+
+	/* In-order payload bytes, free-running masked counters */
+	uint8_t deliver[FRAME_DELIVER_SIZE];
+	size_t deliver_head, deliver_tail;
+
+	int err;
+};
+
+static uint64_t frame_counter_us(void)
+{
+#ifdef _WIN32
+	return (uint64_t) GetTickCount64() * 1000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000;
+#endif
+}
+
+static uint16_t frame_crc(const uint8_t *data, size_t len, uint16_t crc)
+{
+	unsigned int i;
+
+	while (len--) {
+		crc ^= (uint16_t) *data++ << 8;
+
+		for (i = 0; i < 8; i++) {
+			if (crc & 0x8000)
+				crc = (uint16_t) (crc << 1) ^ 0x1021;
+			else
+				crc = (uint16_t) (crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+static size_t frame_encode(uint8_t *dst, uint8_t type, uint8_t seq,
+			   const void *payload, size_t len)
+{
+	uint16_t crc;
+
+	dst[0] = FRAME_SOF;
+	dst[1] = type;
+	dst[2] = seq;
+	dst[3] = len & 0xff;
+	dst[4] = (len >> 8) & 0xff;
+
+	if (len)
+		memcpy(&dst[FRAME_HDR_SIZE], payload, len);
+
+	crc = frame_crc(dst, 5, 0xffff);
+	crc = frame_crc(&dst[FRAME_HDR_SIZE], len, crc);
+
+	dst[5] = crc & 0xff;
+	dst[6] = (crc >> 8) & 0xff;
+
+	return FRAME_HDR_SIZE + len;
+}
+
+static int frame_wire_write(struct serial_framer *framer,
+			    const uint8_t *buf, size_t len)
+{
+	ssize_t ret;
+
+	iio_mutex_lock(framer->wire_lock);
+
+	while (len) {
+		ret = framer->ops->write(framer->d, buf, len);
+		if (ret <= 0) {
+			iio_mutex_unlock(framer->wire_lock);
+			return ret < 0 ? (int) ret : -EPIPE;
+		}
+
+		buf += ret;
+		len -= (size_t) ret;
+	}
+
+	iio_mutex_unlock(framer->wire_lock);
+
+	return 0;
+}
+
+static int frame_send_control(struct serial_framer *framer,
+			      uint8_t type, uint8_t seq)
+{
+	uint8_t buf[FRAME_HDR_SIZE];
+
+	frame_encode(buf, type, seq, NULL, 0);
+
+	return frame_wire_write(framer, buf, sizeof(buf));
+}
+
+static void frame_mark_error(struct serial_framer *framer, int err)
+{
+	iio_mutex_lock(framer->lock);
+	if (!framer->err)
+		framer->err = err;
+	iio_cond_signal(framer->cond);
+	iio_mutex_unlock(framer->lock);
+}
+
+/* Move consecutive received frames into the deliver ring.
+ * Must be called with the state lock held. */
+static void frame_drain_rx(struct serial_framer *framer)
+{
+	struct frame_rx_slot *slot;
+	size_t space, pos, count, copied;
+
+	for (;;) {
+		slot = &framer->rx_slots[framer->rx_expected % FRAME_WINDOW];
+		if (!slot->valid)
+			break;
+
+		space = FRAME_DELIVER_SIZE
+			- (framer->deliver_head - framer->deliver_tail);
+		if (space < slot->len)
+			break;
+
+		for (copied = 0; copied < slot->len; copied += count) {
+			pos = framer->deliver_head & (FRAME_DELIVER_SIZE - 1);
+
+			count = slot->len - copied;
+			if (count > FRAME_DELIVER_SIZE - pos)
+				count = FRAME_DELIVER_SIZE - pos;
+
+			memcpy(&framer->deliver[pos], &slot->buf[copied], count);
+			framer->deliver_head += count;
+		}
+
+		slot->valid = false;
+		framer->rx_expected++;
+	}
+}
+
+static void frame_ack_later(struct frame_actions *act, uint8_t seq)
+{
+	if (act->nb_acks < sizeof(act->acks))
+		act->acks[act->nb_acks++] = seq;
+}
+
+/* Parse the raw receive buffer for complete frames.
+ * Must be called with the state lock held. */
+static void frame_parse(struct serial_framer *framer,
+			struct frame_actions *act)
+{
+	uint8_t *buf = framer->rxbuf;
+	size_t fill = framer->rx_fill, pos = 0, len;
+	struct frame_rx_slot *slot;
+	struct frame_tx_slot *tx;
+	uint16_t crc, expected_crc;
+	uint8_t type, seq, off;
+	unsigned int i;
+
+	while (fill - pos >= FRAME_HDR_SIZE) {
+		type = buf[pos + 1];
+		len = (size_t) buf[pos + 3] | ((size_t) buf[pos + 4] << 8);
+
+		if (buf[pos] != FRAME_SOF || type < FRAME_DATA
+		    || type > FRAME_NAK || len > FRAME_MAX_PAYLOAD) {
+			/* Not a frame header: hunt for the next marker */
+			pos++;
+			continue;
+		}
+
+		if (fill - pos < FRAME_HDR_SIZE + len)
+			break; /* Incomplete frame; wait for more bytes */
+
+		crc = frame_crc(&buf[pos], 5, 0xffff);
+		crc = frame_crc(&buf[pos + FRAME_HDR_SIZE], len, crc);
+		expected_crc = (uint16_t) buf[pos + 5]
+			| ((uint16_t) buf[pos + 6] << 8);
+
+		if (crc != expected_crc) {
+			/* Corrupted: resync on the next marker, and ask
+			 * the peer to resend from what we expect */
+			if (!act->nak) {
+				act->nak = true;
+				act->nak_seq = framer->rx_expected;
+			}
+			pos++;
+			continue;
+		}
+
+		seq = buf[pos + 2];
+
+		switch (type) {
+		case FRAME_DATA:
+			off = (uint8_t) (seq - framer->rx_expected);
+
+			if (off < FRAME_WINDOW) {
+				slot = &framer->rx_slots[seq % FRAME_WINDOW];
+
+				if (!slot->valid) {
+					slot->len = len;
+					memcpy(slot->buf,
+					       &buf[pos + FRAME_HDR_SIZE], len);
+					slot->valid = true;
+				}
+
+				frame_ack_later(act, seq);
+			} else if ((uint8_t) (framer->rx_expected - 1 - seq)
+				   < FRAME_WINDOW) {
+				/* Already delivered; our ack got lost */
+				frame_ack_later(act, seq);
+			}
+			/* Frames beyond the window are dropped unacked;
+			 * the sender retries once we have drained. */
+			break;
+
+		case FRAME_ACK:
+			for (i = 0; i < FRAME_WINDOW; i++) {
+				tx = &framer->tx_slots[i];
+				if (tx->pending && tx->seq == seq)
+					tx->pending = false;
+			}
+			break;
+
+		case FRAME_NAK:
+			/* Resend everything from the requested frame on */
+			for (i = 0; i < FRAME_WINDOW; i++) {
+				tx = &framer->tx_slots[i];
+				if (tx->pending
+				    && (uint8_t) (tx->seq - seq) < FRAME_WINDOW)
+					act->retransmit[i] = true;
+			}
+			break;
+		}
+
+		pos += FRAME_HDR_SIZE + len;
+	}
+
+	framer->rx_fill = fill - pos;
+	memmove(buf, &buf[pos], framer->rx_fill);
+}
+
+/* Read the wire once, parse, then perform the resulting wire actions
+ * (acks, naks, retransmissions due). Called without the state lock, by
+ * the thread owning rx_busy. */
+static int frame_pump(struct serial_framer *framer, unsigned int timeout_ms)
+{
+	uint8_t resend[FRAME_WINDOW][FRAME_HDR_SIZE + FRAME_MAX_PAYLOAD];
+	size_t resend_len[FRAME_WINDOW];
+	struct frame_actions act = { 0 };
+	struct frame_tx_slot *slot;
+	unsigned int i, nb_resend = 0;
+	uint64_t now;
+	ssize_t ret;
+	int err;
+
+	ret = framer->ops->read(framer->d, &framer->rxbuf[framer->rx_fill],
+				sizeof(framer->rxbuf) - framer->rx_fill,
+				timeout_ms);
+	if (ret < 0)
+		return (int) ret;
+
+	iio_mutex_lock(framer->lock);
+
+	if (ret > 0) {
+		framer->rx_fill += (size_t) ret;
+		frame_parse(framer, &act);
+		frame_drain_rx(framer);
+	}
+
+	now = frame_counter_us();
+
+	/* Copy the frames to resend while the lock pins the slots, as
+	 * an ack racing with the wire write would free them under us. */
+	for (i = 0; i < FRAME_WINDOW; i++) {
+		slot = &framer->tx_slots[i];
+
+		if (slot->pending && (act.retransmit[i]
+				      || now - slot->time_us > FRAME_RTO_US)) {
+			memcpy(resend[nb_resend], slot->buf, slot->len);
+			resend_len[nb_resend++] = slot->len;
+			slot->time_us = now;
+		}
+	}
+
+	iio_cond_signal(framer->cond);
+	iio_mutex_unlock(framer->lock);
+
+	for (i = 0; i < act.nb_acks; i++) {
+		err = frame_send_control(framer, FRAME_ACK, act.acks[i]);
+		if (err)
+			return err;
+	}
+
+	if (act.nak) {
+		err = frame_send_control(framer, FRAME_NAK, act.nak_seq);
+		if (err)
+			return err;
+	}
+
+	for (i = 0; i < nb_resend; i++) {
+		err = frame_wire_write(framer, resend[i], resend_len[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+struct serial_framer *
+serial_framer_create(const struct serial_framer_ops *ops, void *d)
+{
+	struct serial_framer *framer;
+
+	framer = calloc(1, sizeof(*framer));
+	if (!framer)
+		return NULL;
+
+	framer->ops = ops;
+	framer->d = d;
+
+	framer->lock = iio_mutex_create();
+	if (iio_err(framer->lock))
+		goto err_free_framer;
+
+	framer->wire_lock = iio_mutex_create();
+	if (iio_err(framer->wire_lock))
+		goto err_free_lock;
+
+	framer->cond = iio_cond_create();
+	if (iio_err(framer->cond))
+		goto err_free_wire_lock;
+
+	return framer;
+
+err_free_wire_lock:
+	iio_mutex_destroy(framer->wire_lock);
+err_free_lock:
+	iio_mutex_destroy(framer->lock);
+err_free_framer:
+	free(framer);
+	return NULL;
+}
+
+void serial_framer_destroy(struct serial_framer *framer)
+{
+	iio_cond_destroy(framer->cond);
+	iio_mutex_destroy(framer->wire_lock);
+	iio_mutex_destroy(framer->lock);
+	free(framer);
+}
+
+ssize_t serial_framer_send(struct serial_framer *framer,
+			   const void *src, size_t len)
+{
+	uint8_t frame[FRAME_HDR_SIZE + FRAME_MAX_PAYLOAD];
+	const uint8_t *ptr = src;
+	struct frame_tx_slot *slot;
+	size_t chunk, sent = 0, flen;
+	unsigned int i;
+	int ret;
+
+	while (sent < len) {
+		chunk = len - sent;
+		if (chunk > FRAME_MAX_PAYLOAD)
+			chunk = FRAME_MAX_PAYLOAD;
+
+		iio_mutex_lock(framer->lock);
+
+		for (;;) {
+			if (framer->err) {
+				ret = framer->err;
+				iio_mutex_unlock(framer->lock);
+				return ret;
+			}
+
+			slot = NULL;
+			for (i = 0; i < FRAME_WINDOW; i++) {
+				if (!framer->tx_slots[i].pending) {
+					slot = &framer->tx_slots[i];
+					break;
+				}
+			}
+
+			if (slot)
+				break;
+
+			/* Window full: wait for the receive path to
+			 * collect acknowledgments */
+			iio_cond_wait(framer->cond, framer->lock, 100);
+		}
+
+		slot->seq = framer->tx_seq++;
+		slot->len = frame_encode(slot->buf, FRAME_DATA, slot->seq,
+					 &ptr[sent], chunk);
+		slot->time_us = frame_counter_us();
+		slot->pending = true;
+
+		memcpy(frame, slot->buf, slot->len);
+		flen = slot->len;
+
+		iio_mutex_unlock(framer->lock);
+
+		ret = frame_wire_write(framer, frame, flen);
+		if (ret) {
+			frame_mark_error(framer, ret);
+			return ret;
+		}
+
+		sent += chunk;
+	}
+
+	return (ssize_t) len;
+}
+
+ssize_t serial_framer_recv(struct serial_framer *framer,
+			   void *dst, size_t len, unsigned int timeout_ms)
+{
+	uint64_t start = frame_counter_us();
+	unsigned int wait_ms;
+	size_t count, pos;
+	int ret;
+
+	iio_mutex_lock(framer->lock);
+
+	while (framer->deliver_head == framer->deliver_tail) {
+		if (framer->err) {
+			ret = framer->err;
+			iio_mutex_unlock(framer->lock);
+			return ret;
+		}
+
+		if (framer->rx_busy) {
+			iio_cond_wait(framer->cond, framer->lock, 100);
+		} else {
+			framer->rx_busy = true;
+			iio_mutex_unlock(framer->lock);
+
+			/* Cap the wire timeout so that retransmission
+			 * timers fire even on an idle link */
+			wait_ms = 100;
+			if (timeout_ms && timeout_ms < wait_ms)
+				wait_ms = timeout_ms;
+
+			ret = frame_pump(framer, wait_ms);
+
+			iio_mutex_lock(framer->lock);
+			framer->rx_busy = false;
+			iio_cond_signal(framer->cond);
+
+			if (ret) {
+				if (!framer->err)
+					framer->err = ret;
+				iio_mutex_unlock(framer->lock);
+				return ret;
+			}
+		}
+
+		if (timeout_ms
+		    && frame_counter_us() - start >= timeout_ms * 1000ull
+		    && framer->deliver_head == framer->deliver_tail) {
+			iio_mutex_unlock(framer->lock);
+			return -ETIMEDOUT;
+		}
+	}
+
+	count = framer->deliver_head - framer->deliver_tail;
+	if (count > len)
+		count = len;
+
+	/* Copy one contiguous span; the caller loops anyway */
+	pos = framer->deliver_tail & (FRAME_DELIVER_SIZE - 1);
+	if (count > FRAME_DELIVER_SIZE - pos)
+		count = FRAME_DELIVER_SIZE - pos;
+
+	memcpy(dst, &framer->deliver[pos], count);
+	framer->deliver_tail += count;
+
+	/* The freed room may unblock parked in-window frames */
+	frame_drain_rx(framer);
+
+	iio_cond_signal(framer->cond);
+	iio_mutex_unlock(framer->lock);
+
+	return (ssize_t) count;
+}
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ */
+
+#ifndef __SERIAL_FRAME_H__
+#define __SERIAL_FRAME_H__
+
+#include <stddef.h>
+
+#if (defined(_WIN32) || defined(__MBED__))
+#ifndef _SSIZE_T_DEFINED
+typedef ptrdiff_t ssize_t;
+#define _SSIZE_T_DEFINED
+#endif
+#else
+#include <sys/types.h>
+#endif
+
+/*
+ * Sliding-window framing for serial links.
+ *
+ * The raw byte stream is cut into CRC-protected frames carrying 8-bit
+ * sequence numbers. Up to a window of data frames may be unacknowledged
+ * at any time, so several commands or block payloads are in flight on
+ * the wire instead of one exchange ping-ponging at a time; a corrupted
+ * frame is selectively retransmitted (on NAK or timeout) without
+ * disturbing the frames around it. Both ends must enable it: iiod with
+ * the ",arq" suffix of its -s/--serial option, the library through the
+ * serial backend.
+ *
+ * The framer is transport-agnostic; the wire is abstracted by the two
+ * ops below.
+ */
+
+struct serial_framer;
+
+struct serial_framer_ops {
+	/* Read up to "len" bytes from the wire. A timeout of 0 means
+	 * blocking; return 0 on timeout, a negative errno code on error. */
+	ssize_t (*read)(void *d, void *buf, size_t len,
+			unsigned int timeout_ms);
+
+	/* Write up to "len" bytes to the wire; short writes are fine. */
+	ssize_t (*write)(void *d, const void *buf, size_t len);
+};
+
+/* Create / destroy a framer. Returns NULL if out of memory. */
+struct serial_framer *
+serial_framer_create(const struct serial_framer_ops *ops, void *d);
+void serial_framer_destroy(struct serial_framer *framer);
+
+/* Send a chunk of the byte stream. Thread-safe; blocks while the send
+ * window is full. Returns "len" or a negative errno code. */
+ssize_t serial_framer_send(struct serial_framer *framer,
+			   const void *src, size_t len);
+
+/* Receive up to "len" in-order bytes of the stream. Single consumer;
+ * acknowledgments and retransmissions are serviced from here, so one
+ * thread should call it continuously (with a short timeout) even when
+ * idle. Returns -ETIMEDOUT if nothing arrived in time. */
+ssize_t serial_framer_recv(struct serial_framer *framer,
+			   void *dst, size_t len, unsigned int timeout_ms);
+
+#endif /* __SERIAL_FRAME_H__ */
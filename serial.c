@@ -7,6 +7,8 @@
  */
 
 #include "iio-config.h"
+#include "iiod-responder.h"
+#include "serial-frame.h"
 
 #include <iio/iio-backend.h>
 #include <iio/iio-debug.h>
@@ -15,16 +17,38 @@
 
 #include <errno.h>
 #include <libserialport.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
+/* Size of the read-ahead ring buffer. Must be a power of two. */
+#define SERIAL_RING_SIZE 65536
+
 struct iio_context_pdata {
 	struct sp_port *port;
 	struct iiod_client *iiod_client;
 
 	struct iio_context_params params;
+
+	/* Sliding-window framing layer; NULL unless enabled through the
+	 * IIO_SERIAL_ARQ environment variable (iiod must have been
+	 * started with the matching ",arq" option). */
+	struct serial_framer *framer;
+
+	/* Background read-ahead: a reader thread continuously drains the
+	 * UART into this ring, so that protocol parsing consumes from
+	 * memory instead of paying a turnaround on the wire for every
+	 * exchange. The head and tail counters are free-running and masked
+	 * on access. */
+	struct iio_thrd *reader_thrd;
+	struct iio_mutex *ring_lock;
+	struct iio_cond *ring_cond;
+	size_t ring_head, ring_tail;
+	int ring_err;
+	bool ring_stop;
+	char ring[SERIAL_RING_SIZE];
 };
 
 struct iio_buffer_pdata {
@@ -146,6 +170,32 @@ static ssize_t serial_write_chn_attr(const struct iio_channel *chn,
 				      dev, chn, attr, src, len, false, 0);
 }
 
+static ssize_t serial_frame_read(void *d, void *buf, size_t len,
+				 unsigned int timeout_ms)
+{
+	struct iio_context_pdata *pdata = d;
+	enum sp_return sp_ret;
+
+	sp_ret = sp_blocking_read_next(pdata->port, buf, len, timeout_ms);
+
+	return (ssize_t) libserialport_to_errno(sp_ret);
+}
+
+static ssize_t serial_frame_write(void *d, const void *buf, size_t len)
+{
+	struct iio_context_pdata *pdata = d;
+	enum sp_return sp_ret;
+
+	sp_ret = sp_blocking_write(pdata->port, buf, len, 0);
+
+	return (ssize_t) libserialport_to_errno(sp_ret);
+}
+
+static const struct serial_framer_ops serial_frame_ops = {
+	.read = serial_frame_read,
+	.write = serial_frame_write,
+};
+
 static ssize_t serial_write_data(struct iiod_client_pdata *io_data,
 				 const char *data, size_t len,
 				 unsigned int timeout_ms)
@@ -154,6 +204,16 @@ static ssize_t serial_write_data(struct iiod_client_pdata *io_data,
 	enum sp_return sp_ret;
 	ssize_t ret;
 
+	if (pdata->framer) {
+		ret = serial_framer_send(pdata->framer, data, len);
+		if (ret < 0) {
+			prm_err(&pdata->params,
+				"Framed serial write failed: %i\n", (int) ret);
+		}
+
+		return ret;
+	}
+
 	sp_ret = sp_blocking_write(pdata->port, data, len, timeout_ms);
 	ret = (ssize_t) libserialport_to_errno(sp_ret);
 
@@ -171,32 +231,193 @@ static ssize_t serial_write_data(struct iiod_client_pdata *io_data,
 	return ret;
 }
 
+static ssize_t serial_writev_data(struct iiod_client_pdata *io_data,
+				  const struct iiod_buf *bufs, size_t nb,
+				  unsigned int timeout_ms)
+{
+	char buf[512];
+	size_t i, total = 0;
+
+	for (i = 0; i < nb; i++)
+		total += bufs[i].size;
+
+	/* Coalesce small scattered writes (typically a command header and
+	 * its payload) into a single write, so that they go out in one
+	 * burst instead of one turnaround each. Bigger payloads are sent
+	 * as-is; the caller handles short writes. */
+	if (nb < 2 || total > sizeof(buf)) {
+		return serial_write_data(io_data, bufs[0].ptr, bufs[0].size,
+					 timeout_ms);
+	}
+
+	for (i = 0, total = 0; i < nb; i++) {
+		memcpy(&buf[total], bufs[i].ptr, bufs[i].size);
+		total += bufs[i].size;
+	}
+
+	return serial_write_data(io_data, buf, total, timeout_ms);
+}
+
+static int serial_reader_thrd(void *d)
+{
+	struct iio_context_pdata *pdata = d;
+	size_t offset, pos, avail, count;
+	enum sp_return sp_ret;
+	char buf[4096];
+	ssize_t ret;
+	bool stop;
+
+	for (;;) {
+		/* Poll with a short timeout, so that a shutdown request is
+		 * noticed quickly. */
+		if (pdata->framer) {
+			ret = serial_framer_recv(pdata->framer, buf,
+						 sizeof(buf), 100);
+			if (ret == -ETIMEDOUT)
+				ret = 0;
+		} else {
+			sp_ret = sp_blocking_read_next(pdata->port, buf,
+						       sizeof(buf), 100);
+			ret = (ssize_t) libserialport_to_errno(sp_ret);
+		}
+
+		iio_mutex_lock(pdata->ring_lock);
+
+		if (pdata->ring_stop) {
+			iio_mutex_unlock(pdata->ring_lock);
+			break;
+		}
+
+		if (ret < 0) {
+			pdata->ring_err = (int) ret;
+			iio_cond_signal(pdata->ring_cond);
+			iio_mutex_unlock(pdata->ring_lock);
+			break;
+		}
+
+		for (offset = 0; offset < (size_t) ret; ) {
+			avail = SERIAL_RING_SIZE
+				- (pdata->ring_head - pdata->ring_tail);
+			if (!avail) {
+				/* Ring full; wait for the parser to catch up */
+				iio_cond_wait(pdata->ring_cond,
+					      pdata->ring_lock, 0);
+				if (pdata->ring_stop)
+					break;
+				continue;
+			}
+
+			count = (size_t) ret - offset;
+			if (count > avail)
+				count = avail;
+
+			pos = pdata->ring_head & (SERIAL_RING_SIZE - 1);
+			if (count > SERIAL_RING_SIZE - pos)
+				count = SERIAL_RING_SIZE - pos;
+
+			memcpy(&pdata->ring[pos], &buf[offset], count);
+			pdata->ring_head += count;
+			offset += count;
+
+			iio_cond_signal(pdata->ring_cond);
+		}
+
+		stop = pdata->ring_stop;
+		iio_mutex_unlock(pdata->ring_lock);
+
+		if (stop)
+			break;
+	}
+
+	return 0;
+}
+
 static ssize_t serial_read_data(struct iiod_client_pdata *io_data,
 				char *buf, size_t len, unsigned int timeout_ms)
 {
 	struct iio_context_pdata *pdata = (struct iio_context_pdata *) io_data;
-	enum sp_return sp_ret;
-	ssize_t ret;
+	size_t count, pos;
+	ssize_t ret = 0;
 
-	sp_ret = sp_blocking_read_next(pdata->port, buf, len, timeout_ms);
-	ret = (ssize_t) libserialport_to_errno(sp_ret);
+	iio_mutex_lock(pdata->ring_lock);
 
-	prm_dbg(&pdata->params, "Read returned %li: %.*s\n",
-		(long) ret, (int) ret, buf);
+	while (pdata->ring_head == pdata->ring_tail) {
+		if (pdata->ring_err) {
+			ret = pdata->ring_err;
+			break;
+		}
 
-	if (ret == 0) {
-		prm_err(&pdata->params, "sp_blocking_read_next has timed out\n");
-		return -ETIMEDOUT;
+		ret = iio_cond_wait(pdata->ring_cond, pdata->ring_lock,
+				    timeout_ms);
+		if (ret == -ETIMEDOUT) {
+			prm_err(&pdata->params, "Serial read has timed out\n");
+			break;
+		}
+
+		ret = 0;
 	}
 
+	if (!ret) {
+		count = pdata->ring_head - pdata->ring_tail;
+		if (count > len)
+			count = len;
+
+		pos = pdata->ring_tail & (SERIAL_RING_SIZE - 1);
+		if (count > SERIAL_RING_SIZE - pos)
+			count = SERIAL_RING_SIZE - pos;
+
+		memcpy(buf, &pdata->ring[pos], count);
+		pdata->ring_tail += count;
+		ret = (ssize_t) count;
+
+		/* Wake the reader thread if it was waiting for room */
+		iio_cond_signal(pdata->ring_cond);
+	}
+
+	iio_mutex_unlock(pdata->ring_lock);
+
+	prm_dbg(&pdata->params, "Read returned %li: %.*s\n",
+		(long) ret, ret > 0 ? (int) ret : 0, buf);
+
 	return ret;
 }
 
+static void serial_cancel(struct iiod_client_pdata *io_data)
+{
+	struct iio_context_pdata *pdata = (struct iio_context_pdata *) io_data;
+
+	/* Fail any read blocked on the ring right away, instead of letting
+	 * it wait out the remainder of its timeout. The reader thread
+	 * itself polls the UART with a short timeout and needs no extra
+	 * kick. Writes cannot be interrupted mid-transfer, but they are
+	 * bounded by the UART's own pacing. */
+	iio_mutex_lock(pdata->ring_lock);
+	if (!pdata->ring_err)
+		pdata->ring_err = -EBADF;
+	iio_cond_signal(pdata->ring_cond);
+	iio_mutex_unlock(pdata->ring_lock);
+}
+
+static void serial_stop_reader(struct iio_context_pdata *pdata)
+{
+	iio_mutex_lock(pdata->ring_lock);
+	pdata->ring_stop = true;
+	iio_cond_signal(pdata->ring_cond);
+	iio_mutex_unlock(pdata->ring_lock);
+
+	iio_thrd_join_and_destroy(pdata->reader_thrd);
+}
+
 static void serial_shutdown(struct iio_context *ctx)
 {
 	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
 
 	iiod_client_destroy(ctx_pdata->iiod_client);
+	serial_stop_reader(ctx_pdata);
+	if (ctx_pdata->framer)
+		serial_framer_destroy(ctx_pdata->framer);
+	iio_cond_destroy(ctx_pdata->ring_cond);
+	iio_mutex_destroy(ctx_pdata->ring_lock);
 	sp_close(ctx_pdata->port);
 	sp_free_port(ctx_pdata->port);
 }
@@ -250,6 +471,26 @@ static void serial_free_buffer(struct iio_buffer_pdata *buf)
 	free(buf);
 }
 
+static int serial_enable_buffers(struct iio_buffer_pdata **pdatas, size_t nb)
+{
+	struct iiod_client_buffer_pdata **cl_pdatas;
+	size_t i;
+	int ret;
+
+	cl_pdatas = calloc(nb, sizeof(*cl_pdatas));
+	if (!cl_pdatas)
+		return -ENOMEM;
+
+	for (i = 0; i < nb; i++)
+		cl_pdatas[i] = pdatas[i]->pdata;
+
+	ret = iiod_client_enable_buffers(cl_pdatas, nb);
+
+	free(cl_pdatas);
+
+	return ret;
+}
+
 static int serial_enable_buffer(struct iio_buffer_pdata *buf,
 				size_t nb_samples, bool enable)
 {
@@ -275,6 +516,7 @@ static const struct iio_backend_ops serial_ops = {
 	.create_buffer = serial_create_buffer,
 	.free_buffer = serial_free_buffer,
 	.enable_buffer = serial_enable_buffer,
+	.enable_buffers = serial_enable_buffers,
 
 	.create_block = serial_create_block,
 	.free_block = iiod_client_free_block,
@@ -293,7 +535,9 @@ const struct iio_backend iio_serial_backend = {
 
 static const struct iiod_client_ops serial_iiod_client_ops = {
 	.write = serial_write_data,
+	.writev = serial_writev_data,
 	.read = serial_read_data,
+	.cancel = serial_cancel,
 };
 
 static int apply_settings(struct sp_port *port, unsigned int baud_rate,
@@ -378,12 +622,39 @@ static struct iio_context * serial_create_context(
 	pdata->port = port;
 	pdata->params = *params;
 
+	pdata->ring_lock = iio_mutex_create();
+	ret = iio_err(pdata->ring_lock);
+	if (ret)
+		goto err_free_pdata;
+
+	pdata->ring_cond = iio_cond_create();
+	ret = iio_err(pdata->ring_cond);
+	if (ret)
+		goto err_free_ring_lock;
+
+	/* Framing must be symmetric, so it is strictly opt-in */
+	if (getenv("IIO_SERIAL_ARQ")) {
+		pdata->framer = serial_framer_create(&serial_frame_ops, pdata);
+		if (!pdata->framer) {
+			ret = -ENOMEM;
+			goto err_free_ring_cond;
+		}
+	}
+
+	/* Start draining the UART into the read-ahead ring before the
+	 * first protocol exchange. */
+	pdata->reader_thrd = iio_thrd_create(serial_reader_thrd, pdata,
+					     "serial-rx");
+	ret = iio_err(pdata->reader_thrd);
+	if (ret)
+		goto err_free_framer;
+
 	pdata->iiod_client = iiod_client_new(params,
 					     (struct iiod_client_pdata *) pdata,
 					     &serial_iiod_client_ops);
 	ret = iio_err(pdata->iiod_client);
 	if (ret)
-		goto err_free_pdata;
+		goto err_stop_reader;
 
 	iio_snprintf(uri, uri_len, "serial:%s,%u,%u%c%u%c",
 			port_name, baud_rate, bits,
@@ -408,6 +679,15 @@ static struct iio_context * serial_create_context(
 
 err_destroy_iiod_client:
 	iiod_client_destroy(pdata->iiod_client);
+err_stop_reader:
+	serial_stop_reader(pdata);
+err_free_framer:
+	if (pdata->framer)
+		serial_framer_destroy(pdata->framer);
+err_free_ring_cond:
+	iio_cond_destroy(pdata->ring_cond);
+err_free_ring_lock:
+	iio_mutex_destroy(pdata->ring_lock);
 err_free_pdata:
 	free(pdata);
 err_close_port:
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2025 Analog Devices, Inc.
+ */
+
+#include "sockopts.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#endif
+
+static int iio_sockopts_parse_size(const char *value, long long *out)
+{
+	long long size;
+	char *end;
+
+	errno = 0;
+	size = strtoll(value, &end, 0);
+	if (errno || end == value || size < 0)
+		return -EINVAL;
+
+	switch (*end) {
+	case 'G':
+	case 'g':
+		size <<= 10;
+		/* fallthrough */
+	case 'M':
+	case 'm':
+		size <<= 10;
+		/* fallthrough */
+	case 'K':
+	case 'k':
+		size <<= 10;
+		end++;
+		break;
+	default:
+		break;
+	}
+
+	if (*end || size > INT_MAX)
+		return -EINVAL;
+
+	*out = size;
+	return 0;
+}
+
+int iio_sockopts_parse(struct iio_sockopts *opts, const char *args)
+{
+	const char *ptr, *next;
+	char item[32], *value;
+	size_t item_len;
+	long long size;
+	char *end;
+	long val;
+	int ret;
+
+	for (ptr = args; ptr && *ptr; ptr = next) {
+		next = strpbrk(ptr, "&,");
+		if (next) {
+			item_len = next - ptr;
+			next++;
+		} else {
+			item_len = strlen(ptr);
+		}
+
+		if (item_len >= sizeof(item))
+			return -EINVAL;
+
+		memcpy(item, ptr, item_len);
+		item[item_len] = '\0';
+
+		value = strchr(item, '=');
+		if (value)
+			*value++ = '\0';
+
+		if (!strcmp(item, "rcvbuf") || !strcmp(item, "sndbuf")) {
+			if (!value)
+				return -EINVAL;
+
+			ret = iio_sockopts_parse_size(value, &size);
+			if (ret)
+				return ret;
+
+			if (item[0] == 'r')
+				opts->rcvbuf = size;
+			else
+				opts->sndbuf = size;
+		} else if (!strcmp(item, "busypoll")) {
+			if (!value)
+				return -EINVAL;
+
+			errno = 0;
+			val = strtol(value, &end, 0);
+			if (errno || end == value || *end || val < 0)
+				return -EINVAL;
+
+			opts->busy_poll_us = val;
+		} else if (!strcmp(item, "tos")) {
+			if (!value)
+				return -EINVAL;
+
+			errno = 0;
+			val = strtol(value, &end, 0);
+			if (errno || end == value || *end
+			    || val < 0 || val > 0xff)
+				return -EINVAL;
+
+			opts->tos = (int) val;
+			opts->tos_set = true;
+		} else if (!strcmp(item, "quickack")) {
+			opts->quickack = !value || value[0] != '0';
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+void iio_sockopts_apply(int fd, const struct iio_sockopts *opts)
+{
+	int val;
+
+	if (opts->rcvbuf) {
+		val = (int) opts->rcvbuf;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+			   (const char *) &val, sizeof(val));
+	}
+
+	if (opts->sndbuf) {
+		val = (int) opts->sndbuf;
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+			   (const char *) &val, sizeof(val));
+	}
+
+#ifdef SO_BUSY_POLL
+	if (opts->busy_poll_us) {
+		val = (int) opts->busy_poll_us;
+		setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+			   (const char *) &val, sizeof(val));
+	}
+#endif
+
+	if (opts->tos_set) {
+		val = opts->tos;
+#ifdef IP_TOS
+		setsockopt(fd, IPPROTO_IP, IP_TOS,
+			   (const char *) &val, sizeof(val));
+#endif
+#ifdef IPV6_TCLASS
+		setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS,
+			   (const char *) &val, sizeof(val));
+#endif
+	}
+
+#ifdef TCP_QUICKACK
+	if (opts->quickack) {
+		val = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK,
+			   (const char *) &val, sizeof(val));
+	}
+#endif
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2025 Analog Devices, Inc.
+ */
+
+#ifndef __IIO_SOCKOPTS_H
+#define __IIO_SOCKOPTS_H
+
+#include <stdbool.h>
+
+/* Socket tuning knobs, parsed from the "?key=value&..." suffix of ip:
+ * URIs on the client side and from the --sockopts argument of iiod.
+ * The all-zero struct means "kernel defaults everywhere". */
+struct iio_sockopts {
+	/* SO_RCVBUF / SO_SNDBUF, in bytes; zero keeps the default */
+	long long rcvbuf, sndbuf;
+
+	/* SO_BUSY_POLL, in microseconds; zero keeps polling disabled */
+	long busy_poll_us;
+
+	/* IP_TOS / IPV6_TCLASS byte (DSCP marking), when tos_set */
+	int tos;
+	bool tos_set;
+
+	/* TCP_QUICKACK */
+	bool quickack;
+};
+
+/* Parse a list of "key[=value]" items separated by '&' or ','. Known
+ * keys: rcvbuf/sndbuf (byte sizes, K/M/G suffixes accepted), busypoll
+ * (microseconds), tos (0-255, "0x" prefix accepted) and quickack.
+ * Returns a negative error code on malformed input or unknown keys. */
+int iio_sockopts_parse(struct iio_sockopts *opts, const char *args);
+
+/* Apply the options to a socket. Best-effort: options the platform,
+ * socket family or kernel configuration does not support are silently
+ * skipped. */
+void iio_sockopts_apply(int fd, const struct iio_sockopts *opts);
+
+#endif /* __IIO_SOCKOPTS_H */
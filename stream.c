@@ -11,14 +11,48 @@
 #include <errno.h>
 #include <iio/iio-debug.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+/* Auto-tuned streams (nb_blocks == 0) start with the minimum rotation
+ * depth and may grow it up to the number of blocks actually created.
+ * A shrink is only attempted after this many underrun-free rotations. */
+#define IIO_STREAM_TUNE_MIN_BLOCKS	2
+#define IIO_STREAM_TUNE_MAX_BLOCKS	8
+#define IIO_STREAM_TUNE_QUIET_ROTATIONS	64
+
+enum iio_stream_block_state {
+	IIO_STREAM_BLOCK_IDLE,
+	IIO_STREAM_BLOCK_QUEUED,
+	IIO_STREAM_BLOCK_HELD,
+};
+
 struct iio_stream {
 	struct iio_buffer *buffer;
 	struct iio_block **blocks;
 	size_t buf_size, nb_blocks;
 	bool started, buf_enabled, all_enqueued;
 	unsigned int curr;
+
+	/* State for iio_stream_get_any_block(). The two dequeuing schemes
+	 * cannot be mixed; whichever is called first locks the stream into
+	 * its mode. */
+	enum iio_stream_block_state *states;
+	uint64_t *seqnos;
+	uint64_t next_seq;
+	bool ordered_mode, any_mode;
+
+	/* Auto-tune state (nb_blocks == 0 at creation): only "depth" of the
+	 * nb_blocks blocks rotate; the depth is adjusted once per rotation
+	 * from the buffer's xrun counter and from the min/max time spent
+	 * waiting in iio_block_dequeue() over the observation window. */
+	bool autotune;
+	size_t depth;
+	uint64_t last_xruns;
+	unsigned int quiet_rotations;
+	uint64_t wait_min, wait_max;
+	uint64_t window_start_us;
+	unsigned int window_blocks;
 };
 
 struct iio_stream *
@@ -27,24 +61,38 @@ iio_buffer_create_stream(struct iio_buffer *buffer, size_t nb_blocks,
 {
 	struct iio_stream *stream;
 	size_t i, sample_size, buf_size;
+	bool autotune = !nb_blocks;
 	int err;
 
-	if (!nb_blocks || !samples_count)
+	if (!samples_count)
 		return iio_ptr(-EINVAL);
 
+	/* nb_blocks == 0 selects the auto-tuned mode: create the maximum
+	 * number of blocks up front, but start rotating only a conservative
+	 * few of them. */
+	if (autotune)
+		nb_blocks = IIO_STREAM_TUNE_MAX_BLOCKS;
+
 	stream = zalloc(sizeof(*stream));
 	if (!stream)
 		return iio_ptr(-ENOMEM);
 
 	stream->blocks = calloc(nb_blocks, sizeof(*stream->blocks));
-	if (!stream->blocks) {
+	stream->states = calloc(nb_blocks, sizeof(*stream->states));
+	stream->seqnos = calloc(nb_blocks, sizeof(*stream->seqnos));
+	if (!stream->blocks || !stream->states || !stream->seqnos) {
 		err = -ENOMEM;
-		goto err_free_stream;
+		goto err_free_stream_blocks;
 	}
 
 	sample_size = iio_device_get_sample_size(buffer->dev, buffer->mask);
 	buf_size = samples_count * sample_size;
 
+	/* Best effort: when the backend doesn't allocate the block data
+	 * itself, carving the blocks out of one contiguous hugepage-friendly
+	 * arena avoids fragmenting the heap with big allocations. */
+	iio_buffer_reserve_arena(buffer, nb_blocks, buf_size);
+
 	for (i = 0; i < nb_blocks; i++) {
 		stream->blocks[i] = iio_buffer_create_block(buffer, buf_size);
 		err = iio_err(stream->blocks[i]);
@@ -57,15 +105,22 @@ iio_buffer_create_stream(struct iio_buffer *buffer, size_t nb_blocks,
 	stream->buffer = buffer;
 	stream->nb_blocks = nb_blocks;
 	stream->buf_size = buf_size;
+	stream->autotune = autotune;
+
+	if (autotune) {
+		stream->depth = IIO_STREAM_TUNE_MIN_BLOCKS;
+		stream->wait_min = UINT64_MAX;
+	}
 
 	return stream;
 
 err_free_stream_blocks:
-	for (i = 0; i < nb_blocks; i++)
+	for (i = 0; stream->blocks && i < nb_blocks; i++)
 		if (stream->blocks[i])
 			iio_block_destroy(stream->blocks[i]);
+	free(stream->seqnos);
+	free(stream->states);
 	free(stream->blocks);
-err_free_stream:
 	free(stream);
 	return iio_ptr(err);
 }
@@ -77,10 +132,195 @@ void iio_stream_destroy(struct iio_stream *stream)
 	for (i = 0; i < stream->nb_blocks; i++)
 		if (stream->blocks[i])
 			iio_block_destroy(stream->blocks[i]);
+	free(stream->seqnos);
+	free(stream->states);
 	free(stream->blocks);
 	free(stream);
 }
 
+static int iio_stream_enqueue_block(struct iio_stream *stream, unsigned int i)
+{
+	bool is_tx = iio_device_is_tx(stream->buffer->dev);
+	const struct iio_device *dev = stream->buffer->dev;
+	size_t buf_size = is_tx ? stream->buf_size : 0;
+	int err;
+
+	err = iio_block_enqueue(stream->blocks[i], buf_size, false);
+	if (err < 0) {
+		dev_perror(dev, err, "Unable to enqueue block");
+		return err;
+	}
+
+	stream->states[i] = IIO_STREAM_BLOCK_QUEUED;
+	if (!is_tx)
+		stream->seqnos[i] = stream->next_seq++;
+
+	if (!stream->buf_enabled) {
+		err = iio_buffer_enable(stream->buffer);
+		if (err) {
+			dev_perror(dev, err, "Unable to enable buffer");
+			return err;
+		}
+
+		stream->buf_enabled = true;
+	}
+
+	return 0;
+}
+
+/* Called once per rotation. Returns 1 to grow the rotation by one block,
+ * -1 to shrink it, 0 to leave it alone. */
+static int iio_stream_autotune_decide(struct iio_stream *stream)
+{
+	struct iio_buffer_stats stats;
+	uint64_t now, period, jitter;
+	int action = 0;
+
+	if (iio_buffer_get_stats(stream->buffer, &stats))
+		return 0;
+
+	now = iio_read_counter_us();
+
+	if (stats.xruns != stream->last_xruns) {
+		/* Underrun since the last rotation: add one block of margin
+		 * and restart the observation window. */
+		stream->last_xruns = stats.xruns;
+		stream->quiet_rotations = 0;
+		action = 1;
+	} else if (++stream->quiet_rotations >= IIO_STREAM_TUNE_QUIET_ROTATIONS) {
+		/* Removing a block removes one block period of margin;
+		 * only shrink when the dequeue-wait jitter observed over
+		 * the window leaves clear headroom. */
+		if (stream->window_blocks) {
+			period = (now - stream->window_start_us)
+				/ stream->window_blocks;
+			jitter = stream->wait_max - stream->wait_min;
+			if (jitter * 2 < period)
+				action = -1;
+		}
+
+		stream->quiet_rotations = 0;
+	} else {
+		return 0;
+	}
+
+	stream->wait_min = UINT64_MAX;
+	stream->wait_max = 0;
+	stream->window_blocks = 0;
+	stream->window_start_us = now;
+
+	return action;
+}
+
+static const struct iio_block *
+iio_stream_get_next_block_tuned(struct iio_stream *stream)
+{
+	const struct iio_device *dev = stream->buffer->dev;
+	bool is_tx = iio_device_is_tx(dev);
+	unsigned int i, curr = stream->curr;
+	uint64_t wait;
+	int err, action;
+
+	if (!stream->started) {
+		stream->started = true;
+		stream->window_start_us = iio_read_counter_us();
+
+		/* RX: prime the initial rotation. TX: hand out the first
+		 * block for filling. */
+		for (i = 0; !is_tx && i < stream->depth; i++) {
+			err = iio_stream_enqueue_block(stream, i);
+			if (err < 0)
+				return iio_ptr(err);
+		}
+
+		if (is_tx) {
+			stream->states[0] = IIO_STREAM_BLOCK_HELD;
+			return stream->blocks[0];
+		}
+	} else {
+		action = curr == stream->depth - 1
+			? iio_stream_autotune_decide(stream) : 0;
+
+		if (action < 0 && stream->depth > IIO_STREAM_TUNE_MIN_BLOCKS) {
+			/* Retire the block the caller just released. A TX
+			 * block carries samples, so flush it one last time;
+			 * it is reclaimed if the rotation grows again. */
+			if (is_tx) {
+				err = iio_stream_enqueue_block(stream, curr);
+				if (err < 0)
+					return iio_ptr(err);
+			} else {
+				stream->states[curr] = IIO_STREAM_BLOCK_IDLE;
+			}
+
+			stream->depth--;
+			curr = 0;
+		} else {
+			err = iio_stream_enqueue_block(stream, curr);
+			if (err < 0)
+				return iio_ptr(err);
+
+			curr = (curr + 1) % stream->depth;
+
+			if (action > 0 && curr == 0
+			    && stream->depth < stream->nb_blocks) {
+				i = stream->depth;
+
+				/* A block retired while carrying samples is
+				 * still enqueued; reclaim it only once its
+				 * transfer completed. */
+				if (stream->states[i] == IIO_STREAM_BLOCK_QUEUED
+				    && !iio_block_dequeue(stream->blocks[i], true))
+					stream->states[i] = IIO_STREAM_BLOCK_IDLE;
+
+				if (stream->states[i] == IIO_STREAM_BLOCK_IDLE) {
+					if (!is_tx) {
+						err = iio_stream_enqueue_block(stream, i);
+						if (err < 0)
+							return iio_ptr(err);
+					}
+
+					stream->depth++;
+				}
+			}
+		}
+	}
+
+	if (stream->states[curr] == IIO_STREAM_BLOCK_IDLE) {
+		/* A TX block that just joined the rotation: hand it out for
+		 * filling. Its RX counterpart must capture data first. */
+		if (is_tx) {
+			stream->states[curr] = IIO_STREAM_BLOCK_HELD;
+			stream->curr = curr;
+			return stream->blocks[curr];
+		}
+
+		err = iio_stream_enqueue_block(stream, curr);
+		if (err < 0)
+			return iio_ptr(err);
+	}
+
+	wait = iio_read_counter_us();
+
+	err = iio_block_dequeue(stream->blocks[curr], false);
+	if (err < 0) {
+		dev_perror(dev, err, "Unable to dequeue block");
+		return iio_ptr(err);
+	}
+
+	wait = iio_read_counter_us() - wait;
+	if (wait < stream->wait_min)
+		stream->wait_min = wait;
+	if (wait > stream->wait_max)
+		stream->wait_max = wait;
+	stream->window_blocks++;
+
+	stream->states[curr] = IIO_STREAM_BLOCK_HELD;
+	stream->curr = curr;
+
+	return stream->blocks[curr];
+}
+
 const struct iio_block *
 iio_stream_get_next_block(struct iio_stream *stream)
 {
@@ -90,6 +330,14 @@ iio_stream_get_next_block(struct iio_stream *stream)
 	unsigned int i;
 	int err;
 
+	if (stream->any_mode)
+		return iio_ptr(-EPERM);
+
+	stream->ordered_mode = true;
+
+	if (stream->autotune)
+		return iio_stream_get_next_block_tuned(stream);
+
 	if (!stream->started) {
 		for (i = 1; !is_tx && i < stream->nb_blocks; i++) {
 			err = iio_block_enqueue(stream->blocks[i], 0, false);
@@ -138,3 +386,107 @@ iio_stream_get_next_block(struct iio_stream *stream)
 
 	return stream->blocks[stream->curr];
 }
+
+const struct iio_block *
+iio_stream_get_any_block(struct iio_stream *stream, uint64_t *seqno)
+{
+	const struct iio_device *dev = stream->buffer->dev;
+	bool is_tx = iio_device_is_tx(dev);
+	unsigned int i, oldest;
+	uint64_t min_seq;
+	bool found;
+	int err;
+
+	if (stream->ordered_mode)
+		return iio_ptr(-EPERM);
+
+	stream->any_mode = true;
+
+	if (!stream->started) {
+		stream->started = true;
+
+		/* RX: prime the ring by enqueueing every block right away.
+		 * TX blocks start idle and are handed out for filling. */
+		for (i = 0; !is_tx && i < stream->nb_blocks; i++) {
+			err = iio_stream_enqueue_block(stream, i);
+			if (err < 0)
+				return iio_ptr(err);
+		}
+	}
+
+	/* Re-enqueue the block that was returned by the previous call */
+	for (i = 0; i < stream->nb_blocks; i++) {
+		if (stream->states[i] != IIO_STREAM_BLOCK_HELD)
+			continue;
+
+		err = iio_stream_enqueue_block(stream, i);
+		if (err < 0)
+			return iio_ptr(err);
+	}
+
+	/* TX ramp-up: hand out blocks that have never been filled yet */
+	for (i = 0; i < stream->nb_blocks; i++) {
+		if (stream->states[i] == IIO_STREAM_BLOCK_IDLE)
+			goto out_return_block;
+	}
+
+	for (;;) {
+		/* Return whichever enqueued block completed first */
+		for (i = 0; i < stream->nb_blocks; i++) {
+			if (stream->states[i] != IIO_STREAM_BLOCK_QUEUED)
+				continue;
+
+			err = iio_block_dequeue(stream->blocks[i], true);
+			if (err == -EBUSY)
+				continue;
+			if (err < 0) {
+				dev_perror(dev, err, "Unable to dequeue block");
+				return iio_ptr(err);
+			}
+
+			goto out_return_block;
+		}
+
+		/* None ready: wait on the oldest enqueued block */
+		found = false;
+		min_seq = 0;
+		oldest = 0;
+
+		for (i = 0; i < stream->nb_blocks; i++) {
+			if (stream->states[i] != IIO_STREAM_BLOCK_QUEUED)
+				continue;
+
+			if (!found || stream->seqnos[i] < min_seq) {
+				min_seq = stream->seqnos[i];
+				oldest = i;
+				found = true;
+			}
+		}
+
+		if (!found)
+			return iio_ptr(-EPERM);
+
+		err = iio_block_dequeue(stream->blocks[oldest], false);
+		if (err < 0) {
+			dev_perror(dev, err, "Unable to dequeue block");
+			return iio_ptr(err);
+		}
+
+		i = oldest;
+		break;
+	}
+
+out_return_block:
+	stream->states[i] = IIO_STREAM_BLOCK_HELD;
+	if (is_tx)
+		stream->seqnos[i] = stream->next_seq++;
+	if (seqno)
+		*seqno = stream->seqnos[i];
+
+	return stream->blocks[i];
+}
+
+int iio_stream_get_event_fd(const struct iio_stream *stream)
+{
+	return iio_buffer_get_event_fd(stream->buffer);
+}
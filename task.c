@@ -6,10 +6,14 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#include "iio-trace.h"
+
 #include <iio/iio-lock.h>
 
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 struct iio_task_token {
@@ -19,19 +23,37 @@ struct iio_task_token {
 
 	struct iio_cond *done_cond;
 	struct iio_mutex *done_lock;
-	bool done, autoclear;
+	bool done, complete, autoclear, prio;
 	int ret;
 };
 
 struct iio_task {
-	struct iio_thrd *thrd;
+	struct iio_thrd **thrds;
+	unsigned int nb_workers;
 	struct iio_cond *cond;
 	struct iio_mutex *lock;
 	int (*fn)(void *, void *);
 	void *firstarg;
 
-	struct iio_task_token *list;
-	bool running, stop;
+	/* Lock-free MPSC stack of freshly enqueued tokens. Producers push
+	 * with a CAS and only take the mutex (to signal the workers) on the
+	 * empty -> non-empty transition; drains into "list" under "lock". */
+	atomic_uintptr_t in_head;
+
+	/* Lock-free stack of recycled tokens, to avoid a malloc() plus two
+	 * mutex/cond creations on every single enqueue. Only autoclear
+	 * tokens are recycled (by the worker, which cannot outlive the
+	 * task); synced tokens are destroyed, as iio_task_sync() may run
+	 * after the task itself was destroyed. */
+	atomic_uintptr_t free_head;
+
+	/* Pending tokens, in enqueue order. Tokens enqueued with
+	 * iio_task_enqueue_prio() go to "list_prio", which is always
+	 * dispatched first; tokens of the same class never overtake
+	 * each other. */
+	struct iio_task_token *list, *list_prio;
+	struct iio_task_token *inflight, *inflight_last;
+	bool running, stop, retiring;
 };
 
 static void iio_task_token_destroy(struct iio_task_token *token)
@@ -41,16 +63,101 @@ static void iio_task_token_destroy(struct iio_task_token *token)
 	free(token);
 }
 
+static struct iio_task_token * iio_task_stack_pop_all(atomic_uintptr_t *head)
+{
+	return (struct iio_task_token *) atomic_exchange(head, (uintptr_t) NULL);
+}
+
+/* Returns true if the stack was empty before the push */
+static bool iio_task_stack_push(atomic_uintptr_t *head,
+				struct iio_task_token *entry,
+				struct iio_task_token *last)
+{
+	uintptr_t old;
+
+	do {
+		old = atomic_load(head);
+		last->next = (struct iio_task_token *) old;
+	} while (!atomic_compare_exchange_weak(head, &old, (uintptr_t) entry));
+
+	return !old;
+}
+
+static struct iio_task_token * iio_task_token_get(struct iio_task *task)
+{
+	struct iio_task_token *entry, *next, *last;
+
+	/* Grab the whole free stack, keep the first token and push the
+	 * remainder back; taking everything at once side-steps the ABA
+	 * problem of a lock-free pop. */
+	entry = iio_task_stack_pop_all(&task->free_head);
+	if (!entry)
+		return NULL;
+
+	next = entry->next;
+	if (next) {
+		for (last = next; last->next; )
+			last = last->next;
+
+		iio_task_stack_push(&task->free_head, next, last);
+	}
+
+	return entry;
+}
+
+static void iio_task_token_put(struct iio_task_token *token)
+{
+	iio_task_stack_push(&token->task->free_head, token, token);
+}
+
+/* Must be called with task->lock held */
+static void iio_task_drain_input(struct iio_task *task)
+{
+	struct iio_task_token *entry, *next, *list = NULL, *tmp, **head;
+
+	/* The input stack is in LIFO order; reverse it into enqueue order */
+	for (entry = iio_task_stack_pop_all(&task->in_head);
+	     entry; entry = next) {
+		next = entry->next;
+		entry->next = list;
+		list = entry;
+	}
+
+	/* Sort the tokens into their class's list */
+	for (entry = list; entry; entry = next) {
+		next = entry->next;
+		entry->next = NULL;
+
+		head = entry->prio ? &task->list_prio : &task->list;
+
+		if (!*head) {
+			*head = entry;
+		} else {
+			for (tmp = *head; tmp->next; )
+				tmp = tmp->next;
+
+			tmp->next = entry;
+		}
+	}
+}
+
 static int iio_task_run(void *d)
 {
 	struct iio_task *task = d;
 	struct iio_task_token *entry;
 	bool autoclear;
+	int ret;
 
 	iio_mutex_lock(task->lock);
 
 	for (;;) {
-		while (!task->stop && !(task->list && task->running)) {
+		for (;;) {
+			iio_task_drain_input(task);
+
+			if (task->stop ||
+			    ((task->list || task->list_prio) && task->running))
+				break;
+
 			iio_cond_wait(task->cond, task->lock, 0);
 
 			/* If iio_task_stop() was called while we were waiting
@@ -62,45 +169,97 @@ static int iio_task_run(void *d)
 		if (task->stop)
 			break;
 
-		entry = task->list;
-		task->list = entry->next;
-		iio_mutex_unlock(task->lock);
+		if (task->list_prio) {
+			entry = task->list_prio;
+			task->list_prio = entry->next;
+		} else {
+			entry = task->list;
+			task->list = entry->next;
+		}
+		entry->next = NULL;
+
+		/* Keep processed entries on an in-flight list, in dequeue
+		 * order, so that completions can be delivered in the same
+		 * order that the tokens were enqueued even when multiple
+		 * workers process them in parallel. */
+		if (task->inflight_last)
+			task->inflight_last->next = entry;
+		else
+			task->inflight = entry;
+		task->inflight_last = entry;
 
-		entry->ret = task->fn(task->firstarg, entry->elm);
+		iio_mutex_unlock(task->lock);
 
-		iio_mutex_lock(entry->done_lock);
-		entry->done = true;
-		autoclear = entry->autoclear;
-		iio_cond_signal(entry->done_cond);
-		iio_mutex_unlock(entry->done_lock);
+		iio_trace2(task_dispatch, task, entry->elm);
+		ret = task->fn(task->firstarg, entry->elm);
+		iio_trace3(task_complete, task, entry->elm, ret);
 
-		if (autoclear)
-			iio_task_token_destroy(entry);
+		iio_mutex_lock(task->lock);
+		entry->ret = ret;
+		entry->complete = true;
+
+		/* Retire completed entries from the head of the in-flight
+		 * list. Only one worker retires at a time; the others just
+		 * mark their entry as complete and the retiring worker will
+		 * pick it up when it re-checks the list head. */
+		while (!task->retiring
+		       && task->inflight && task->inflight->complete) {
+			task->retiring = true;
+
+			entry = task->inflight;
+			task->inflight = entry->next;
+			if (!task->inflight)
+				task->inflight_last = NULL;
+
+			iio_mutex_unlock(task->lock);
+
+			iio_mutex_lock(entry->done_lock);
+			entry->done = true;
+			autoclear = entry->autoclear;
+			iio_cond_signal(entry->done_cond);
+			iio_mutex_unlock(entry->done_lock);
+
+			if (autoclear)
+				iio_task_token_put(entry);
+
+			iio_mutex_lock(task->lock);
+			task->retiring = false;
+		}
 
 		/* Signal that we're done with the previous entry */
-		iio_mutex_lock(task->lock);
 		iio_cond_signal(task->cond);
 	}
 
+	/* Pass the stop signal along to the next waiting worker */
+	iio_cond_signal(task->cond);
 	iio_mutex_unlock(task->lock);
 
 	return 0;
 }
 
-struct iio_task * iio_task_create(int (*fn)(void *, void *),
-				  void *firstarg, const char *name)
+struct iio_task * iio_task_create_pool(int (*fn)(void *, void *),
+				       void *firstarg, const char *name,
+				       unsigned int nb_workers)
 {
 	struct iio_task *task;
+	unsigned int i;
 	int err = -ENOMEM;
 
+	if (!nb_workers)
+		return iio_ptr(-EINVAL);
+
 	task = calloc(1, sizeof(*task));
 	if (!task)
 		return iio_ptr(-ENOMEM);
 
+	task->thrds = calloc(nb_workers, sizeof(*task->thrds));
+	if (!task->thrds)
+		goto err_free_task;
+
 	task->lock = iio_mutex_create();
 	err = iio_err(task->lock);
 	if (err)
-		goto err_free_task;
+		goto err_free_thrds;
 
 	task->cond = iio_cond_create();
 	err = iio_err(task->cond);
@@ -110,71 +269,116 @@ struct iio_task * iio_task_create(int (*fn)(void *, void *),
 	task->fn = fn;
 	task->firstarg = firstarg;
 
-	task->thrd = iio_thrd_create(iio_task_run, task, name);
-	err = iio_err(task->thrd);
-	if (err)
-		goto err_free_cond;
+	for (i = 0; i < nb_workers; i++) {
+		task->thrds[i] = iio_thrd_create(iio_task_run, task, name);
+		err = iio_err(task->thrds[i]);
+		if (err)
+			goto err_stop_workers;
+
+		task->nb_workers++;
+	}
 
 	return task;
 
-err_free_cond:
+err_stop_workers:
+	iio_mutex_lock(task->lock);
+	task->stop = true;
+	iio_cond_signal(task->cond);
+	iio_mutex_unlock(task->lock);
+
+	for (i = 0; i < task->nb_workers; i++)
+		iio_thrd_join_and_destroy(task->thrds[i]);
+
 	iio_cond_destroy(task->cond);
 err_free_lock:
 	iio_mutex_destroy(task->lock);
+err_free_thrds:
+	free(task->thrds);
 err_free_task:
 	free(task);
 	return iio_ptr(err);
 }
 
-static struct iio_task_token *
-iio_task_do_enqueue(struct iio_task *task, void *elm, bool autoclear)
+struct iio_task * iio_task_create(int (*fn)(void *, void *),
+				  void *firstarg, const char *name)
 {
-	struct iio_task_token *entry, *tmp;
-	int err = -ENOMEM;
+	return iio_task_create_pool(fn, firstarg, name, 1);
+}
 
-	entry = calloc(1, sizeof(*entry));
-	if (!entry)
-		return iio_ptr(-ENOMEM);
+int iio_task_set_affinity(struct iio_task *task, unsigned int cpu)
+{
+	unsigned int i;
+	int err;
 
-	entry->task = task;
-	entry->elm = elm;
+	for (i = 0; i < task->nb_workers; i++) {
+		err = iio_thrd_set_affinity(task->thrds[i], cpu);
+		if (err)
+			return err;
+	}
 
-	entry->done_cond = iio_cond_create();
-	err = iio_err(entry->done_cond);
-	if (err)
-		goto err_free_entry;
+	return 0;
+}
 
-	entry->done_lock = iio_mutex_create();
-	err = iio_err(entry->done_lock);
-	if (err)
-		goto err_free_cond;
+int iio_task_set_priority(struct iio_task *task, int priority)
+{
+	unsigned int i;
+	int err;
 
-	entry->autoclear = autoclear;
+	for (i = 0; i < task->nb_workers; i++) {
+		err = iio_thrd_set_priority(task->thrds[i], priority);
+		if (err)
+			return err;
+	}
 
-	iio_mutex_lock(task->lock);
+	return 0;
+}
 
-	if (task->stop) {
-		iio_mutex_unlock(task->lock);
-		err = -EBADF;
-		goto err_free_lock;
-	}
+static struct iio_task_token *
+iio_task_do_enqueue(struct iio_task *task, void *elm, bool autoclear, bool prio)
+{
+	struct iio_task_token *entry;
+	int err = -ENOMEM;
 
-	if (!task->list) {
-		task->list = entry;
-	} else {
-		for (tmp = task->list; tmp->next; )
-			tmp = tmp->next;
+	if (task->stop)
+		return iio_ptr(-EBADF);
 
-		tmp->next = entry;
+	entry = iio_task_token_get(task);
+	if (!entry) {
+		entry = calloc(1, sizeof(*entry));
+		if (!entry)
+			return iio_ptr(-ENOMEM);
+
+		entry->done_cond = iio_cond_create();
+		err = iio_err(entry->done_cond);
+		if (err)
+			goto err_free_entry;
+
+		entry->done_lock = iio_mutex_create();
+		err = iio_err(entry->done_lock);
+		if (err)
+			goto err_free_cond;
 	}
 
-	iio_cond_signal(task->cond);
-	iio_mutex_unlock(task->lock);
+	entry->task = task;
+	entry->elm = elm;
+	entry->next = NULL;
+	entry->done = false;
+	entry->complete = false;
+	entry->ret = 0;
+	entry->autoclear = autoclear;
+	entry->prio = prio;
+
+	/* Lock-free push; we only need to wake up a worker when the input
+	 * stack transitions from empty to non-empty, as the workers always
+	 * drain it completely before going to sleep. */
+	if (iio_task_stack_push(&task->in_head, entry, entry)) {
+		iio_mutex_lock(task->lock);
+		iio_cond_signal(task->cond);
+		iio_mutex_unlock(task->lock);
+	}
 
 	return entry;
 
-err_free_lock:
-	iio_mutex_destroy(entry->done_lock);
 err_free_cond:
 	iio_cond_destroy(entry->done_cond);
 err_free_entry:
@@ -184,12 +388,17 @@ err_free_entry:
 
 struct iio_task_token * iio_task_enqueue(struct iio_task *task, void *elm)
 {
-	return iio_task_do_enqueue(task, elm, false);
+	return iio_task_do_enqueue(task, elm, false, false);
+}
+
+struct iio_task_token * iio_task_enqueue_prio(struct iio_task *task, void *elm)
+{
+	return iio_task_do_enqueue(task, elm, false, true);
 }
 
 int iio_task_enqueue_autoclear(struct iio_task *task, void *elm)
 {
-	return iio_err(iio_task_do_enqueue(task, elm, true));
+	return iio_err(iio_task_do_enqueue(task, elm, true, false));
 }
 
 int iio_task_sync(struct iio_task_token *token, unsigned int timeout_ms)
@@ -210,6 +419,10 @@ int iio_task_sync(struct iio_task_token *token, unsigned int timeout_ms)
 
 	ret = token->ret;
 
+	/* Destroy the token instead of recycling it: clients may legally
+	 * sync a token after the task was flushed or even destroyed, at
+	 * which point the free stack is gone. Only the worker's autoclear
+	 * path, which provably runs while the task is alive, recycles. */
 	iio_task_token_destroy(token);
 
 	return ret;
@@ -221,9 +434,16 @@ void iio_task_flush(struct iio_task *task)
 
 	iio_mutex_lock(task->lock);
 
-	while (task->list) {
-		token = task->list;
-		task->list = token->next;
+	iio_task_drain_input(task);
+
+	while (task->list || task->list_prio) {
+		if (task->list_prio) {
+			token = task->list_prio;
+			task->list_prio = token->next;
+		} else {
+			token = task->list;
+			task->list = token->next;
+		}
 		iio_mutex_unlock(task->lock);
 
 		iio_mutex_lock(token->done_lock);
@@ -240,24 +460,49 @@ void iio_task_flush(struct iio_task *task)
 
 int iio_task_destroy(struct iio_task *task)
 {
-	int ret;
+	struct iio_task_token *token, *next;
+	unsigned int i;
+	int err, ret = 0;
 
 	iio_mutex_lock(task->lock);
 	task->stop = true;
 	iio_cond_signal(task->cond);
 	iio_mutex_unlock(task->lock);
 
-	ret = iio_thrd_join_and_destroy(task->thrd);
+	for (i = 0; i < task->nb_workers; i++) {
+		err = iio_thrd_join_and_destroy(task->thrds[i]);
+		if (err && !ret)
+			ret = err;
+	}
 
 	iio_task_flush(task);
 
+	for (token = iio_task_stack_pop_all(&task->free_head);
+	     token; token = next) {
+		next = token->next;
+		iio_task_token_destroy(token);
+	}
+
 	iio_cond_destroy(task->cond);
 	iio_mutex_destroy(task->lock);
+	free(task->thrds);
 	free(task);
 
 	return ret;
 }
 
+bool iio_task_has_pending(struct iio_task *task)
+{
+	bool pending;
+
+	iio_mutex_lock(task->lock);
+	iio_task_drain_input(task);
+	pending = task->list || task->list_prio;
+	iio_mutex_unlock(task->lock);
+
+	return pending;
+}
+
 bool iio_task_is_done(struct iio_task_token *token)
 {
 	return token->done;
@@ -266,16 +511,20 @@ bool iio_task_is_done(struct iio_task_token *token)
 void iio_task_cancel(struct iio_task_token *token)
 {
 	struct iio_task *task = token->task;
-	struct iio_task_token *tmp;
+	struct iio_task_token *tmp, **head;
 	bool found = false;
 
 	iio_mutex_lock(task->lock);
 
-	if (token == task->list) {
-		task->list = token->next;
+	iio_task_drain_input(task);
+
+	head = token->prio ? &task->list_prio : &task->list;
+
+	if (token == *head) {
+		*head = token->next;
 		found = true;
-	} else if (task->list) {
-		for (tmp = task->list; tmp->next; tmp = tmp->next) {
+	} else if (*head) {
+		for (tmp = *head; tmp->next; tmp = tmp->next) {
 			if (tmp->next == token) {
 				tmp->next = tmp->next->next;
 				found = true;
@@ -311,6 +560,11 @@ void iio_task_stop(struct iio_task *task)
 	iio_mutex_lock(task->lock);
 	task->running = false;
 	iio_cond_signal(task->cond);
-	iio_cond_wait(task->cond, task->lock, 0);
+
+	/* Wait until all workers have drained their in-flight entries */
+	do {
+		iio_cond_wait(task->cond, task->lock, 0);
+	} while (task->inflight);
+
 	iio_mutex_unlock(task->lock);
 }
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <libusb.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Endpoint for non-streaming operations */
@@ -27,6 +28,19 @@
 
 #define IIO_INTERFACE_NAME	"IIO"
 
+/*
+ * Maximum size of one URB. If an URB is too big, the IOCTL_USBFS_SUBMITURB
+ * ioctl (called by libusb) might fail with errno set to ENOMEM, as the
+ * kernel might use contiguous allocation for the URB if the driver doesn't
+ * support scatter-gather. The iiod-client code handles short transfers
+ * properly and asks for a new one.
+ */
+#define USB_URB_SIZE		(1 * 1024 * 1024)
+
+/* Upper bound on the number of URBs kept in flight for one large transfer
+ * (see IIO_USB_URBS) */
+#define USB_URB_MAX_DEPTH	8
+
 struct iio_usb_ep_couple {
 	unsigned char addr_in, addr_out;
 	uint16_t pipe_id;
@@ -41,7 +55,8 @@ struct iiod_client_pdata {
 
 	struct iio_mutex *lock;
 	bool cancelled;
-	struct libusb_transfer *transfer;
+	struct libusb_transfer *transfers[USB_URB_MAX_DEPTH];
+	unsigned int nb_transfers;
 
 	struct iio_context_pdata *ctx_pdata;
 };
@@ -57,6 +72,9 @@ struct iio_context_pdata {
 	struct iio_usb_ep_couple *io_endpoints;
 	uint16_t nb_ep_couples;
 
+	/* Number of URBs kept in flight for one large transfer */
+	unsigned int urb_queue_depth;
+
 	struct iiod_client_pdata io_ctx;
 };
 
@@ -114,6 +132,25 @@ static ssize_t read_data_sync(struct iiod_client_pdata *ep, char *buf,
 			      size_t len, unsigned int timeout_ms);
 static void usb_cancel(struct iiod_client_pdata *io_ctx);
 
+/* Number of URBs kept in flight for one large transfer, optionally
+ * overridden with the IIO_USB_URBS environment variable. */
+static unsigned int usb_get_urb_queue_depth(void)
+{
+	const char *env = getenv("IIO_USB_URBS");
+	long depth;
+
+	if (!env)
+		return 4;
+
+	depth = strtol(env, NULL, 10);
+	if (depth < 1)
+		return 1;
+	if (depth > USB_URB_MAX_DEPTH)
+		return USB_URB_MAX_DEPTH;
+
+	return (unsigned int) depth;
+}
+
 static int usb_io_context_init(struct iiod_client_pdata *io_ctx)
 {
 	io_ctx->lock = iio_mutex_create();
@@ -403,10 +440,14 @@ static int iio_usb_match_device(struct libusb_device *dev,
 
 static void usb_cancel(struct iiod_client_pdata *io_ctx)
 {
+	unsigned int i;
+
 	iio_mutex_lock(io_ctx->lock);
 
-	if (io_ctx->transfer && !io_ctx->cancelled)
-		libusb_cancel_transfer(io_ctx->transfer);
+	if (!io_ctx->cancelled) {
+		for (i = 0; i < io_ctx->nb_transfers; i++)
+			libusb_cancel_transfer(io_ctx->transfers[i]);
+	}
 	io_ctx->cancelled = true;
 
 	iio_mutex_unlock(io_ctx->lock);
@@ -516,6 +557,26 @@ static void usb_free_buffer(struct iio_buffer_pdata *buf)
 	free(buf);
 }
 
+static int usb_enable_buffers(struct iio_buffer_pdata **pdatas, size_t nb)
+{
+	struct iiod_client_buffer_pdata **cl_pdatas;
+	size_t i;
+	int ret;
+
+	cl_pdatas = calloc(nb, sizeof(*cl_pdatas));
+	if (!cl_pdatas)
+		return -ENOMEM;
+
+	for (i = 0; i < nb; i++)
+		cl_pdatas[i] = pdatas[i]->pdata;
+
+	ret = iiod_client_enable_buffers(cl_pdatas, nb);
+
+	free(cl_pdatas);
+
+	return ret;
+}
+
 static int usb_enable_buffer(struct iio_buffer_pdata *pdata,
 			     size_t nb_samples, bool enable)
 {
@@ -543,6 +604,7 @@ static const struct iio_backend_ops usb_ops = {
 	.create_buffer = usb_create_buffer,
 	.free_buffer = usb_free_buffer,
 	.enable_buffer = usb_enable_buffer,
+	.enable_buffers = usb_enable_buffers,
 	.cancel_buffer = usb_cancel_buffer,
 
 	.readbuf = usb_readbuf,
@@ -563,10 +625,19 @@ const struct iio_backend iio_usb_backend = {
 	.default_timeout_ms = 5000,
 };
 
-static void LIBUSB_CALL sync_transfer_cb(struct libusb_transfer *transfer)
+struct usb_transfer_queue {
+	unsigned int remaining;
+	int completed;
+};
+
+static void LIBUSB_CALL usb_transfer_cb(struct libusb_transfer *transfer)
 {
-	int *completed = transfer->user_data;
-	*completed = 1;
+	struct usb_transfer_queue *queue = transfer->user_data;
+
+	/* Callbacks are serialized by libusb's event lock, so the counter
+	 * needs no extra protection. */
+	if (!--queue->remaining)
+		queue->completed = 1;
 }
 
 static int usb_sync_transfer(struct iio_context_pdata *pdata,
@@ -574,21 +645,12 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 			     unsigned int ep_type, char *data, size_t len,
 			     int *transferred, unsigned int timeout_ms)
 {
+	struct usb_transfer_queue queue = { 0 };
+	struct libusb_transfer *transfer;
+	size_t chunk, offset = 0;
+	unsigned int i, nb = 0;
 	unsigned char ep;
-	struct libusb_transfer *transfer = NULL;
-	int completed = 0;
-	int ret;
-
-	/*
-	 * If the size of the data to transfer is too big, the
-	 * IOCTL_USBFS_SUBMITURB ioctl (called by libusb) might fail with
-	 * errno set to ENOMEM, as the kernel might use contiguous allocation
-	 * for the URB if the driver doesn't support scatter-gather.
-	 * To prevent that, we support URBs of 1 MiB maximum. The iiod-client
-	 * code will handle this properly and ask for a new transfer.
-	 */
-	if (len > 1 * 1024 * 1024)
-		len = 1 * 1024 * 1024;
+	int ret = 0;
 
 	if (ep_type == LIBUSB_ENDPOINT_IN)
 		ep = io_ctx->ep->addr_in;
@@ -598,8 +660,8 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 	/*
 	 * For cancellation support the check whether the buffer has already been
 	 * cancelled and the allocation as well as the assignment of the new
-	 * transfer needs to happen in one atomic step. Otherwise it is possible
-	 * that the cancellation is missed and transfer is not aborted.
+	 * transfers needs to happen in one atomic step. Otherwise it is possible
+	 * that the cancellation is missed and a transfer is not aborted.
 	 */
 	iio_mutex_lock(io_ctx->lock);
 	if (io_ctx->cancelled) {
@@ -607,70 +669,108 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 		goto unlock;
 	}
 
-	transfer = libusb_alloc_transfer(0);
-	if (!transfer) {
-		ret = -ENOMEM;
-		goto unlock;
-	}
-
-	transfer->user_data = &completed;
+	/*
+	 * Large transfers are split into up to "urb_queue_depth" URBs of
+	 * USB_URB_SIZE bytes each, all submitted together, so that the bus
+	 * does not idle between one URB completing and the next submission.
+	 * A failure to queue more than the first URB just shortens the
+	 * pipeline; the caller asks for the rest of the data again.
+	 */
+	for (nb = 0; nb < pdata->urb_queue_depth && offset < len; nb++) {
+		chunk = len - offset;
+		if (chunk > USB_URB_SIZE)
+			chunk = USB_URB_SIZE;
+
+		transfer = libusb_alloc_transfer(0);
+		if (!transfer) {
+			if (!nb)
+				ret = -ENOMEM;
+			break;
+		}
 
-	libusb_fill_bulk_transfer(transfer, pdata->hdl, ep,
-			(unsigned char *) data, (int) len, sync_transfer_cb,
-			&completed, timeout_ms);
-	transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+		libusb_fill_bulk_transfer(transfer, pdata->hdl, ep,
+				(unsigned char *) data + offset, (int) chunk,
+				usb_transfer_cb, &queue, timeout_ms);
+		transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+
+		ret = libusb_submit_transfer(transfer);
+		if (ret) {
+			if (!nb)
+				ret = -(int) libusb_to_errno(ret);
+			else
+				ret = 0;
+			libusb_free_transfer(transfer);
+			break;
+		}
 
-	ret = libusb_submit_transfer(transfer);
-	if (ret) {
-		ret = -(int) libusb_to_errno(ret);
-		libusb_free_transfer(transfer);
-		goto unlock;
+		io_ctx->transfers[nb] = transfer;
+		queue.remaining++;
+		offset += chunk;
 	}
 
-	io_ctx->transfer = transfer;
+	io_ctx->nb_transfers = nb;
 unlock:
 	iio_mutex_unlock(io_ctx->lock);
 	if (ret)
 		return ret;
 
-	while (!completed) {
-		ret = libusb_handle_events_completed(pdata->ctx, &completed);
+	while (!queue.completed) {
+		ret = libusb_handle_events_completed(pdata->ctx,
+						     &queue.completed);
 		if (ret < 0) {
 			if (ret == LIBUSB_ERROR_INTERRUPTED)
 				continue;
-			libusb_cancel_transfer(transfer);
+			for (i = 0; i < nb; i++)
+				libusb_cancel_transfer(io_ctx->transfers[i]);
 			continue;
 		}
 	}
 
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_COMPLETED:
-		*transferred = transfer->actual_length;
-		ret = 0;
-		break;
-	case LIBUSB_TRANSFER_TIMED_OUT:
-		ret = -ETIMEDOUT;
-		break;
-	case LIBUSB_TRANSFER_STALL:
-		ret = -EPIPE;
-		break;
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		ret = -ENODEV;
-		break;
-	case LIBUSB_TRANSFER_CANCELLED:
-		ret = -EBADF;
-		break;
-	default:
-		ret = -EIO;
-		break;
+	/* Walk the URBs in submission order; the first error ends the
+	 * transfer. */
+	*transferred = 0;
+	ret = 0;
+
+	for (i = 0; i < nb && !ret; i++) {
+		transfer = io_ctx->transfers[i];
+
+		switch (transfer->status) {
+		case LIBUSB_TRANSFER_COMPLETED:
+			*transferred += transfer->actual_length;
+
+			/* A short URB that is not the last one means the
+			 * device ended the stream early; data already queued
+			 * into the following URBs would leave a hole in the
+			 * byte stream, so give up on the whole transfer. */
+			if (transfer->actual_length < transfer->length &&
+			    i < nb - 1)
+				ret = -EIO;
+			break;
+		case LIBUSB_TRANSFER_TIMED_OUT:
+			ret = -ETIMEDOUT;
+			break;
+		case LIBUSB_TRANSFER_STALL:
+			ret = -EPIPE;
+			break;
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			ret = -ENODEV;
+			break;
+		case LIBUSB_TRANSFER_CANCELLED:
+			ret = -EBADF;
+			break;
+		default:
+			ret = -EIO;
+			break;
+		}
 	}
 
 	/* Same as above. This needs to be atomic in regards to usb_cancel(). */
 	iio_mutex_lock(io_ctx->lock);
-	io_ctx->transfer = NULL;
+	io_ctx->nb_transfers = 0;
 	iio_mutex_unlock(io_ctx->lock);
 
-	libusb_free_transfer(transfer);
+	for (i = 0; i < nb; i++)
+		libusb_free_transfer(io_ctx->transfers[i]);
 
 	return ret;
 }
@@ -977,6 +1077,7 @@ static struct iio_context * usb_create_context(const struct iio_context_params *
 	pdata->ctx = usb_ctx;
 	pdata->hdl = hdl;
 	pdata->intrfc = intrfc;
+	pdata->urb_queue_depth = usb_get_urb_queue_depth();
 
 	ret = usb_io_context_init(&pdata->io_ctx);
 	if (ret)
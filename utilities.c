@@ -12,9 +12,11 @@
 #include "dns_sd.h"
 #include "iio-config.h"
 #include "iio-private.h"
+#include "ringlog.h"
 
 #include <errno.h>
 #include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
 #include <locale.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -253,6 +255,250 @@ char *iio_strndup(const char *str, size_t n)
 #endif
 }
 
+static uint32_t iio_str_index_hash(const char *key)
+{
+	uint32_t h = 0x811c9dc5;
+
+	/* FNV-1a */
+	while (*key) {
+		h ^= (uint8_t) *key++;
+		h *= 0x1000193;
+	}
+
+	return h;
+}
+
+int iio_str_index_init(struct iio_str_index *idx, unsigned int nb)
+{
+	unsigned int size = 8;
+
+	if (!nb)
+		return -EINVAL;
+
+	/* Power-of-two size, load factor of 0.5 at most */
+	while (size < nb * 2)
+		size <<= 1;
+
+	idx->entries = calloc(size, sizeof(*idx->entries));
+	if (!idx->entries)
+		return -ENOMEM;
+
+	idx->mask = size - 1;
+
+	return 0;
+}
+
+void iio_str_index_add(struct iio_str_index *idx, const char *key, void *ptr)
+{
+	uint32_t h = iio_str_index_hash(key);
+
+	while (idx->entries[h & idx->mask].key)
+		h++;
+
+	idx->entries[h & idx->mask].key = key;
+	idx->entries[h & idx->mask].ptr = ptr;
+}
+
+void * iio_str_index_find(const struct iio_str_index *idx, const char *key,
+			  bool (*match)(void *ptr, void *d), void *d)
+{
+	const struct iio_str_index_entry *entry;
+	uint32_t h = iio_str_index_hash(key);
+
+	for (;; h++) {
+		entry = &idx->entries[h & idx->mask];
+		if (!entry->key)
+			return NULL;
+
+		if (!strcmp(entry->key, key)
+		    && (!match || match(entry->ptr, d)))
+			return entry->ptr;
+	}
+}
+
+void iio_str_index_release(struct iio_str_index *idx)
+{
+	free(idx->entries);
+	idx->entries = NULL;
+	idx->mask = 0;
+}
+
+/* String interning pool: identical strings share one allocation, carved
+ * out of a chain of fixed-size arena blocks. The strings live until the
+ * pool is destroyed, so teardown is one sweep over the blocks instead of
+ * one free() per string. */
+
+#define STR_POOL_BLOCK_SIZE 16384
+
+struct iio_str_pool_block {
+	struct iio_str_pool_block *next;
+	size_t used, size;
+	char data[];
+};
+
+struct iio_str_pool {
+	/* Serializes iio_str_pool_get(): the table is rehashed and the
+	 * arena bump-allocated in place, so concurrent interning (e.g.
+	 * from the parallel device creation workers) must not race. */
+	struct iio_mutex *lock;
+
+	struct iio_str_pool_block *blocks;
+
+	/* Open-addressing set of the interned strings, rehashed when the
+	 * load factor reaches 0.5. The entries point into the arena, so
+	 * they stay valid across a rehash. */
+	const char **table;
+	uint32_t mask; /* table size - 1; the size is a power of two */
+	uint32_t count;
+};
+
+struct iio_str_pool * iio_str_pool_create(void)
+{
+	struct iio_str_pool *pool;
+
+	pool = zalloc(sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->lock = iio_mutex_create();
+	if (iio_err(pool->lock)) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->table = calloc(64, sizeof(*pool->table));
+	if (!pool->table) {
+		iio_mutex_destroy(pool->lock);
+		free(pool);
+		return NULL;
+	}
+
+	pool->mask = 64 - 1;
+
+	return pool;
+}
+
+void iio_str_pool_destroy(struct iio_str_pool *pool)
+{
+	struct iio_str_pool_block *block, *next;
+
+	if (!pool)
+		return;
+
+	for (block = pool->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	iio_mutex_destroy(pool->lock);
+	free(pool->table);
+	free(pool);
+}
+
+static int iio_str_pool_grow_table(struct iio_str_pool *pool)
+{
+	uint32_t i, h, mask = pool->mask * 2 + 1;
+	const char **table;
+
+	table = calloc(mask + 1, sizeof(*table));
+	if (!table)
+		return -ENOMEM;
+
+	for (i = 0; i <= pool->mask; i++) {
+		if (!pool->table[i])
+			continue;
+
+		h = iio_str_index_hash(pool->table[i]);
+		while (table[h & mask])
+			h++;
+
+		table[h & mask] = pool->table[i];
+	}
+
+	free(pool->table);
+	pool->table = table;
+	pool->mask = mask;
+
+	return 0;
+}
+
+static char * iio_str_pool_alloc(struct iio_str_pool *pool, size_t len)
+{
+	struct iio_str_pool_block *block = pool->blocks;
+	size_t size = STR_POOL_BLOCK_SIZE;
+	char *ptr;
+
+	if (!block || block->size - block->used < len) {
+		if (len > size)
+			size = len;
+
+		block = malloc(sizeof(*block) + size);
+		if (!block)
+			return NULL;
+
+		block->next = pool->blocks;
+		block->used = 0;
+		block->size = size;
+		pool->blocks = block;
+	}
+
+	ptr = &block->data[block->used];
+	block->used += len;
+
+	return ptr;
+}
+
+static const char *
+iio_str_pool_get_unlocked(struct iio_str_pool *pool, const char *str)
+{
+	uint32_t h = iio_str_index_hash(str);
+	const char *entry;
+	size_t len;
+	char *copy;
+
+	for (;; h++) {
+		entry = pool->table[h & pool->mask];
+		if (!entry)
+			break;
+
+		if (!strcmp(entry, str))
+			return entry;
+	}
+
+	if (pool->count * 2 >= pool->mask + 1) {
+		if (iio_str_pool_grow_table(pool))
+			return NULL;
+
+		h = iio_str_index_hash(str);
+		while (pool->table[h & pool->mask])
+			h++;
+	}
+
+	len = strlen(str) + 1;
+
+	copy = iio_str_pool_alloc(pool, len);
+	if (!copy)
+		return NULL;
+
+	memcpy(copy, str, len); /* Flawfinder: ignore */
+
+	pool->table[h & pool->mask] = copy;
+	pool->count++;
+
+	return copy;
+}
+
+const char * iio_str_pool_get(struct iio_str_pool *pool, const char *str)
+{
+	const char *entry;
+
+	iio_mutex_lock(pool->lock);
+	entry = iio_str_pool_get_unlocked(pool, str);
+	iio_mutex_unlock(pool->lock);
+
+	return entry;
+}
+
 /* strlcpy is designed to be safer, more consistent, and less error prone
  * replacements for strncpy, since it guarantees to NUL-terminate the result.
  *
@@ -394,8 +640,13 @@ void iio_prm_printf(const struct iio_context_params *params,
 		out = msg_level <= LEVEL_WARNING ? stderr : stdout;
 	}
 
-	if (out)
-		vfprintf(out, fmt, ap);
+	if (out) {
+		/* With IIO_LOG_RING=1 the message is captured into the
+		 * calling thread's ring and written out later, so that
+		 * logging barely perturbs the hot path. */
+		if (!iio_ringlog_enabled() || !iio_ringlog_vprintf(out, fmt, ap))
+			vfprintf(out, fmt, ap);
+	}
 
 	va_end(ap);
 }
@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <iio/iio.h>
@@ -314,3 +315,243 @@ void gen_function(const char* prefix, const char* target,
 	}
 }
 
+/* Specialized capture pipeline generation: everything the library would
+ * compute or dispatch at runtime (sample size, channel offsets, the
+ * convert operations of iio_channel_convert()) is folded into constants
+ * and straight-line code, so the compiler can fully vectorize the demux
+ * loops. */
+
+struct gen_chn_info {
+	const struct iio_channel *ch;
+	const char *id;
+	unsigned long offset;
+};
+
+static bool gen_host_is_le(void)
+{
+#ifdef _MSC_BUILD
+	return true;
+#else
+	return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#endif
+}
+
+/* Mirrors the layout logic of iio_device_get_sample_size(): channels are
+ * laid out in index order, each aligned to its own length. */
+static unsigned int gen_layout(const struct iio_device *dev,
+			       const struct iio_channels_mask *mask,
+			       struct gen_chn_info *chns)
+{
+	const struct iio_channel *ch, *prev = NULL;
+	const struct iio_data_format *fmt;
+	unsigned long size = 0, length;
+	unsigned int i, nb = 0;
+
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		ch = iio_device_get_channel(dev, i);
+		fmt = iio_channel_get_data_format(ch);
+		length = fmt->length / 8 * fmt->repeat;
+
+		if (iio_channel_get_index(ch) < 0)
+			break;
+		if (!iio_channel_is_enabled(ch, mask))
+			continue;
+
+		if (prev && iio_channel_get_index(ch) ==
+				iio_channel_get_index(prev)) {
+			chns[nb] = chns[nb - 1];
+			chns[nb++].ch = ch;
+			prev = ch;
+			continue;
+		}
+
+		if (size % length)
+			size += length - (size % length);
+
+		chns[nb].ch = ch;
+		chns[nb].id = iio_channel_get_id(ch);
+		chns[nb++].offset = size;
+
+		size += length;
+		prev = ch;
+	}
+
+	return nb;
+}
+
+static void gen_pipeline_convert(FILE *f, const struct gen_chn_info *info,
+				 unsigned int elem)
+{
+	const struct iio_data_format *fmt =
+		iio_channel_get_data_format(info->ch);
+	unsigned int len = fmt->length / 8;
+	unsigned long offset = info->offset + (unsigned long) elem * len;
+	bool swap = gen_host_is_le() ^ !fmt->is_be;
+
+	fprintf(f, "\t\tmemcpy(&%s_raw, src + %lu, %u);\n",
+		info->id, offset, len);
+
+	if (swap && len > 1)
+		fprintf(f, "\t\t%s_raw = __builtin_bswap%u(%s_raw);\n",
+			info->id, fmt->length, info->id);
+
+	if (fmt->shift)
+		fprintf(f, "\t\t%s_raw >>= %u;\n", info->id, fmt->shift);
+
+	if (!fmt->is_fully_defined && fmt->bits < fmt->length) {
+		if (fmt->is_signed) {
+			fprintf(f, "\t\t%s_raw = (uint%u_t)((int%u_t)(%s_raw << %u) >> %u);\n",
+				info->id, fmt->length, fmt->length, info->id,
+				fmt->length - fmt->bits,
+				fmt->length - fmt->bits);
+		} else {
+			fprintf(f, "\t\t%s_raw &= 0x%lxu;\n", info->id,
+				(1ul << fmt->bits) - 1);
+		}
+	}
+
+	if (fmt->repeat > 1) {
+		fprintf(f, "\t\t%s_samples[i * %u + %u] = (%sint%u_t) %s_raw;\n",
+			info->id, fmt->repeat, elem,
+			fmt->is_signed ? "" : "u", fmt->length, info->id);
+	} else {
+		fprintf(f, "\t\t%s_samples[i] = (%sint%u_t) %s_raw;\n",
+			info->id, fmt->is_signed ? "" : "u", fmt->length,
+			info->id);
+	}
+}
+
+int gen_pipeline(const char *gen_file, const struct iio_device *dev,
+		 const struct iio_channels_mask *mask,
+		 unsigned int nb_blocks, unsigned long samples_per_block)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	const struct iio_data_format *fmt;
+	struct gen_chn_info *chns;
+	unsigned int i, j, nb;
+	ssize_t sample_size;
+	const char *dev_id, *uri;
+	FILE *f;
+	int ret;
+
+	sample_size = iio_device_get_sample_size(dev, mask);
+	if (sample_size <= 0)
+		return sample_size ? (int) sample_size : -EINVAL;
+
+	chns = calloc(iio_device_get_channels_count(dev), sizeof(*chns));
+	if (!chns)
+		return -ENOMEM;
+
+	nb = gen_layout(dev, mask, chns);
+	if (!nb) {
+		free(chns);
+		return -EINVAL;
+	}
+
+	ret = gen_fopen(&f, gen_file, "w");
+	if (ret) {
+		free(chns);
+		return ret;
+	}
+
+	dev_id = iio_device_get_name(dev);
+	if (!dev_id)
+		dev_id = iio_device_get_id(dev);
+
+	fprintf(f, "/*******************************************************************\n"
+		   " * This is autogenerated code from the iio_utils package\n"
+		   " * Code snippets in this file are released under the WTFPL.\n"
+		   " * For more information, check out : http://www.wtfpl.net/.\n"
+		   " * This does not effect the license for libiio or iio-utils.\n"
+		   " * If this helps - great, if it does not - stop using it.\n"
+		   " *******************************************************************\n");
+	fprintf(f, " * Capture pipeline specialized for device '%s'.\n", dev_id);
+	fprintf(f, " * The sample layout and the convert operations are folded into\n"
+		   " * constants; regenerate when the channel set or formats change.\n");
+	fprintf(f, " * Compile with 'gcc -O2 %s -o /tmp/aout -liio'\n", gen_file);
+	fprintf(f, " *******************************************************************/\n");
+	fprintf(f, "#include <stdint.h>\n#include <stdio.h>\n"
+		   "#include <stdlib.h>\n#include <string.h>\n\n"
+		   "#include <iio/iio.h>\n\n");
+
+	uri = iio_context_get_attr_value(ctx, "uri");
+	fprintf(f, "#define URI \"%s\"\n", uri ? uri : "unknown:");
+	fprintf(f, "#define DEVICE \"%s\"\n\n", dev_id);
+	fprintf(f, "/* Fixed block geometry */\n");
+	fprintf(f, "#define SAMPLE_SIZE %ld /* bytes, constant-folded */\n",
+		(long) sample_size);
+	fprintf(f, "#define NB_BLOCKS %u\n", nb_blocks);
+	fprintf(f, "#define BLOCK_SAMPLES %lu\n", samples_per_block);
+	fprintf(f, "#define BLOCK_SIZE (BLOCK_SAMPLES * SAMPLE_SIZE)\n\n");
+
+	fprintf(f, "/* One demuxed output array per channel */\n");
+	for (i = 0; i < nb; i++) {
+		fmt = iio_channel_get_data_format(chns[i].ch);
+		fprintf(f, "static %sint%u_t %s_samples[BLOCK_SAMPLES * %u];\n",
+			fmt->is_signed ? "" : "u", fmt->length,
+			chns[i].id, fmt->repeat);
+	}
+
+	fprintf(f, "\n/* Demux and convert one block. The operations below are exactly\n"
+		   " * those that iio_channel_convert() would select at runtime for\n"
+		   " * each channel's format, with all the branches resolved. */\n");
+	fprintf(f, "static void demux_block(const uint8_t *src, size_t nb_samples)\n{\n");
+	fprintf(f, "\tsize_t i;\n\n");
+	fprintf(f, "\tfor (i = 0; i < nb_samples; i++, src += SAMPLE_SIZE) {\n");
+
+	for (i = 0; i < nb; i++) {
+		fmt = iio_channel_get_data_format(chns[i].ch);
+		fprintf(f, "\t\tuint%u_t %s_raw;\n", fmt->length, chns[i].id);
+	}
+	fprintf(f, "\n");
+
+	for (i = 0; i < nb; i++) {
+		fmt = iio_channel_get_data_format(chns[i].ch);
+		for (j = 0; j < fmt->repeat; j++)
+			gen_pipeline_convert(f, &chns[i], j);
+	}
+
+	fprintf(f, "\t}\n}\n\n");
+
+	fprintf(f, "int main(void)\n{\n"
+		   "\tstruct iio_channels_mask *mask;\n"
+		   "\tstruct iio_context *ctx;\n"
+		   "\tstruct iio_device *dev;\n"
+		   "\tstruct iio_channel *ch;\n"
+		   "\tstruct iio_buffer *buffer;\n"
+		   "\tstruct iio_stream *stream;\n"
+		   "\tconst struct iio_block *block;\n\n");
+	fprintf(f, "\tctx = iio_create_context(NULL, URI);\n"
+		   "\tif (iio_err(ctx))\n\t\treturn EXIT_FAILURE;\n\n");
+	fprintf(f, "\tdev = iio_context_find_device(ctx, DEVICE);\n"
+		   "\tif (!dev)\n\t\treturn EXIT_FAILURE;\n\n");
+	fprintf(f, "\tmask = iio_create_channels_mask(iio_device_get_channels_count(dev));\n"
+		   "\tif (!mask)\n\t\treturn EXIT_FAILURE;\n\n");
+
+	for (i = 0; i < nb; i++) {
+		fprintf(f, "\tch = iio_device_find_channel(dev, \"%s\", false);\n"
+			   "\tif (!ch)\n\t\treturn EXIT_FAILURE;\n"
+			   "\tiio_channel_enable(ch, mask);\n\n", chns[i].id);
+	}
+
+	fprintf(f, "\n\tbuffer = iio_device_create_buffer(dev, 0, mask);\n"
+		   "\tif (iio_err(buffer))\n\t\treturn EXIT_FAILURE;\n\n");
+	fprintf(f, "\tstream = iio_buffer_create_stream(buffer, NB_BLOCKS, BLOCK_SAMPLES);\n"
+		   "\tif (iio_err(stream))\n\t\treturn EXIT_FAILURE;\n\n");
+	fprintf(f, "\tfor (;;) {\n"
+		   "\t\tblock = iio_stream_get_next_block(stream);\n"
+		   "\t\tif (iio_err(block))\n\t\t\tbreak;\n\n"
+		   "\t\tdemux_block(iio_block_start(block), BLOCK_SAMPLES);\n\n"
+		   "\t\t/* Process the demuxed channel arrays here */\n"
+		   "\t}\n\n");
+	fprintf(f, "\tiio_stream_destroy(stream);\n"
+		   "\tiio_buffer_destroy(buffer);\n"
+		   "\tiio_channels_mask_destroy(mask);\n"
+		   "\tiio_context_destroy(ctx);\n"
+		   "\treturn EXIT_SUCCESS;\n}\n");
+
+	fclose(f);
+	free(chns);
+
+	return 0;
+}
@@ -20,4 +20,7 @@ void gen_ch(const struct iio_channel *ch);
 void gen_function(const char* prefix, const char* target,
                 const char* attr, const char* wbuf);
 void gen_context_timeout(unsigned int timeout_ms);
+int gen_pipeline(const char *gen_file, const struct iio_device *dev,
+		const struct iio_channels_mask *mask,
+		unsigned int nb_blocks, unsigned long samples_per_block);
 #endif
@@ -281,10 +281,145 @@ static int dump_channel_attributes(const struct iio_device *dev,
 	return (int)ret;
 }
 
+/*
+ * Parallel dump mode: instead of reading each matched attribute with its
+ * own command / response round trip, queue them all, then read them in
+ * batches through iio_attrs_read_bulk(). With the network backend and a
+ * recent iiod, each batch is a single round trip; results are printed as
+ * each batch completes.
+ */
+
+#define PARALLEL_BATCH 64
+
+static struct {
+	struct iio_bulk_attr *attrs;
+	enum verbosity *quiet;
+	size_t nb, nb_alloc;
+} pdump;
+
+static void parallel_queue(const struct iio_device *dev,
+			   const struct iio_channel *chn, const char *attr,
+			   unsigned int type, enum verbosity quiet)
+{
+	struct iio_bulk_attr *battr;
+	size_t new_alloc;
+	void *ptr;
+
+	if (pdump.nb == pdump.nb_alloc) {
+		new_alloc = pdump.nb_alloc ? pdump.nb_alloc * 2 : 256;
+
+		ptr = realloc(pdump.attrs, new_alloc * sizeof(*pdump.attrs));
+		if (!ptr) {
+			IIO_ERR("Unable to allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+		pdump.attrs = ptr;
+
+		ptr = realloc(pdump.quiet, new_alloc * sizeof(*pdump.quiet));
+		if (!ptr) {
+			IIO_ERR("Unable to allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+		pdump.quiet = ptr;
+
+		pdump.nb_alloc = new_alloc;
+	}
+
+	battr = &pdump.attrs[pdump.nb];
+	memset(battr, 0, sizeof(*battr));
+	battr->dev = dev;
+	battr->chn = chn;
+	battr->attr = attr;
+	battr->type = type;
+
+	pdump.quiet[pdump.nb++] = quiet;
+}
+
+static void parallel_print(const struct iio_bulk_attr *battr,
+			   enum verbosity quiet)
+{
+	const char *ch_name, *type_name;
+
+	if (quiet == ATTR_VERBOSE) {
+		printf("%s ", iio_device_is_trigger(battr->dev) ? "trig" : "dev");
+		printf("'%s', ", get_label_or_name_or_id(battr->dev));
+
+		if (battr->chn) {
+			if (iio_channel_is_output(battr->chn))
+				type_name = "output";
+			else
+				type_name = "input";
+
+			printf("channel '%s' (%s), ",
+			       iio_channel_get_id(battr->chn), type_name);
+
+			ch_name = iio_channel_get_name(battr->chn);
+			if (ch_name)
+				printf("id '%s', ", ch_name);
+		} else if (battr->type == 1) {
+			printf("debug ");
+		} else if (battr->type == 2) {
+			printf("buffer ");
+		}
+
+		printf("attr '%s', ", battr->attr);
+	}
+
+	if (battr->ret > 0) {
+		if (quiet == ATTR_NORMAL)
+			printf("%s\n", battr->value);
+		else if (quiet == ATTR_VERBOSE)
+			printf("value '%s'\n", battr->value);
+	} else {
+		IIO_PERROR((int) battr->ret, "Unable to read attribute");
+	}
+}
+
+static bool parallel_flush(void)
+{
+	char *values = xmalloc((size_t) PARALLEL_BATCH * BUF_SIZE, MY_NAME);
+	size_t i, j, nb;
+	bool err = false;
+	int ret;
+
+	for (i = 0; i < pdump.nb; i += nb) {
+		nb = pdump.nb - i;
+		if (nb > PARALLEL_BATCH)
+			nb = PARALLEL_BATCH;
+
+		for (j = 0; j < nb; j++) {
+			pdump.attrs[i + j].value = &values[j * BUF_SIZE];
+			pdump.attrs[i + j].len = BUF_SIZE;
+		}
+
+		ret = iio_attrs_read_bulk(&pdump.attrs[i], nb);
+		if (ret) {
+			IIO_PERROR(ret, "Unable to read attributes");
+			err = true;
+			break;
+		}
+
+		for (j = 0; j < nb; j++) {
+			parallel_print(&pdump.attrs[i + j], pdump.quiet[i + j]);
+
+			if (pdump.attrs[i + j].ret < 0)
+				err = true;
+		}
+	}
+
+	free(values);
+	free(pdump.attrs);
+	free(pdump.quiet);
+	memset(&pdump, 0, sizeof(pdump));
+
+	return err;
+}
+
 static const struct option options[] = {
 	{"ignore-case", no_argument, 0, 'I'},
 	{"quiet", no_argument, 0, 'q'},
 	{"verbose", no_argument, 0, 'v'},
+	{"parallel", no_argument, 0, 'P'},
 	{"generate-code", required_argument, 0, 'g'},
 	/* Channel qualifiers */
 	{"input-channel", no_argument, 0, 'i'},
@@ -309,6 +444,7 @@ static const char *options_descriptions[] = {
 	"Ignore case distinctions.",
 	"Return result only.",
 	"Verbose, say what is going on",
+	"Read attributes in parallel, batched through bulk reads.",
 	"Generate code.",
 	/* Channel qualifiers */
 	"Filter Input Channels only.",
@@ -322,7 +458,7 @@ static const char *options_descriptions[] = {
 	"Read/Write debug attributes.",
 };
 
-#define MY_OPTS "CdcBDiosIqvg:"
+#define MY_OPTS "CdcBDiosIqvPg:"
 int main(int argc, char **argv)
 {
 	char **argw;
@@ -333,7 +469,7 @@ int main(int argc, char **argv)
 	bool search_device = false, ignore_case = false,
 		search_channel = false, search_buffer = false, search_debug = false,
 		search_context = false, input_only = false, output_only = false,
-		scan_only = false, gen_code = false;
+		scan_only = false, gen_code = false, parallel = false;
 	enum verbosity quiet = ATTR_NORMAL;
 	bool found_err = false, read_err = false, write_err = false,
 		dev_found = false, attr_found = false, ctx_found = false,
@@ -416,6 +552,9 @@ int main(int argc, char **argv)
 		case 'v':
 			quiet = ATTR_VERBOSE;
 			break;
+		case 'P':
+			parallel = true;
+			break;
 		case 'g':
 			if (!optarg || optarg[0] == '-') {
 				fprintf(stderr, "Code generation requires an option\n");
@@ -568,6 +707,11 @@ int main(int argc, char **argv)
 		quiet = ATTR_VERBOSE;
 	}
 
+	if (parallel && (wbuf || gen_code)) {
+		fprintf(stderr, "Parallel mode can only be used to read attributes.\n");
+		return EXIT_FAILURE;
+	}
+
 	if (gen_code) {
 		gen_start(gen_file);
 		gen_context(iio_context_get_attr_value(ctx, "uri"));
@@ -768,6 +912,11 @@ int main(int argc, char **argv)
 					found_err = false;
 					attr_found = true;
 					gen_ch(ch);
+					if (parallel) {
+						parallel_queue(dev, ch, attr, 0,
+							       attr_index ? quiet : ATTR_VERBOSE);
+						continue;
+					}
 					ret = dump_channel_attributes(dev, ch, attr, wbuf,
 								attr_index ? quiet : ATTR_VERBOSE);
 					if (wbuf && ret < 0)
@@ -798,6 +947,11 @@ int main(int argc, char **argv)
 					gen_dev(dev);
 					found_err = false;
 					attr_found = true;
+					if (parallel) {
+						parallel_queue(dev, NULL, attr, 0,
+							       attr_index ? quiet : ATTR_VERBOSE);
+						continue;
+					}
 					ret = dump_device_attributes(dev, attr, wbuf,
 							       attr_index ? quiet : ATTR_VERBOSE);
 					if (wbuf && ret < 0)
@@ -827,6 +981,11 @@ int main(int argc, char **argv)
 						gen_dev(dev);
 						found_err = false;
 						attr_found = true;
+						if (parallel) {
+							parallel_queue(dev, NULL, attr, 2,
+								       attr_index ? quiet : ATTR_VERBOSE);
+							continue;
+						}
 						ret = dump_buffer_attributes(dev, attr, wbuf,
 									  attr_index ? quiet : ATTR_VERBOSE);
 						if (wbuf && ret < 0)
@@ -853,6 +1012,11 @@ int main(int argc, char **argv)
 						found_err = false;
 						attr_found = true;
 						debug_found = true;
+						if (parallel) {
+							parallel_queue(dev, NULL, attr, 1,
+								       attr_index ? quiet : ATTR_VERBOSE);
+							continue;
+						}
 						ret = dump_debug_attributes(dev, attr, wbuf,
 								      attr_index ? quiet : ATTR_VERBOSE);
 						if (wbuf && ret < 0)
@@ -865,6 +1029,8 @@ int main(int argc, char **argv)
 			}
 		}
 
+		if (parallel && parallel_flush())
+			read_err = true;
 	}
 
 	iio_context_destroy(ctx);
@@ -0,0 +1,563 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_bench - Part of the Industrial I/O (IIO) utilities
+ *
+ * Measures block throughput, enqueue-to-dequeue latency percentiles and
+ * CPU cost per gigabyte for a given device, over whatever backend the
+ * context URI points to (local:, ip:, usb:, ...). Results can be printed
+ * as a single JSON object for regression tracking.
+ * */
+
+#include <errno.h>
+#include <getopt.h>
+#include <iio/iio.h>
+#include <iio/iio-debug.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+#include "iio_common.h"
+
+#define MY_NAME "iio_bench"
+
+#define SAMPLES_PER_BLOCK 4096
+#define BLOCKS_IN_FLIGHT 4
+#define MAX_BLOCKS_IN_FLIGHT 64
+#define DEFAULT_DURATION_S 5
+
+/* Log-bucketed latency histogram (HDR style): exact counts below 32 us,
+ * then 32 linear sub-buckets per power of two, which bounds the
+ * quantization error of the percentiles to about 3%. */
+#define HDR_SUB_BITS 5
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)
+#define HDR_NB_BUCKETS ((64 - HDR_SUB_BITS + 1) * HDR_SUB_COUNT)
+
+static const struct option options[] = {
+	  {"buffer-size", required_argument, 0, 'b'},
+	  {"nb-blocks", required_argument, 0, 'n'},
+	  {"duration", required_argument, 0, 'd'},
+	  {"count", required_argument, 0, 'c'},
+	  {"write", no_argument, 0, 'w'},
+	  {"json", no_argument, 0, 'j'},
+	  {0, 0, 0, 0},
+};
+
+static const char *options_descriptions[] = {
+	"[-b <buffer-size>] [-n <nb-blocks>] [-d <seconds>]"
+		"\n\t\t\t[-c <count>] [-w] [-j] <iio_device> [<channel> ...]",
+	"Size of each block, in samples. Default is 4096.",
+	"Number of blocks kept in flight. Default is 4.",
+	"Duration of the measurement, in seconds. Default is 5.",
+	"Number of blocks to transfer (overrides the duration).",
+	"Benchmark the transmit (TX) direction instead of receive.",
+	"Print the results as a JSON object on the standard output.",
+};
+
+static struct iio_context *ctx;
+static struct iio_buffer *buffer;
+
+static uint64_t hdr_counts[HDR_NB_BUCKETS];
+static uint64_t hdr_total, hdr_sum, hdr_min = UINT64_MAX, hdr_max;
+
+static volatile sig_atomic_t app_running = true;
+
+static void quit_all(int sig)
+{
+	app_running = false;
+	if (buffer)
+		iio_buffer_cancel(buffer);
+}
+
+#ifdef _WIN32
+
+BOOL WINAPI sig_handler_fn(DWORD dwCtrlType)
+{
+	/* Runs in its own thread */
+
+	switch (dwCtrlType) {
+	case CTRL_C_EVENT:
+	case CTRL_CLOSE_EVENT:
+		quit_all(SIGTERM);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void setup_sig_handler(void)
+{
+	SetConsoleCtrlHandler(sig_handler_fn, TRUE);
+}
+
+#elif NO_THREADS
+
+static void sig_handler(int sig)
+{
+	if (!app_running)
+		exit(sig);
+	app_running = false;
+}
+
+static void set_handler(int sig)
+{
+	struct sigaction action;
+
+	sigaction(sig, NULL, &action);
+	action.sa_handler = sig_handler;
+	sigaction(sig, &action, NULL);
+}
+
+static void setup_sig_handler(void)
+{
+	set_handler(SIGHUP);
+	set_handler(SIGPIPE);
+	set_handler(SIGINT);
+	set_handler(SIGSEGV);
+	set_handler(SIGTERM);
+}
+
+#else
+
+#include <pthread.h>
+
+static void * sig_handler_thd(void *data)
+{
+	sigset_t *mask = data;
+	int ret, sig;
+
+	/* Blocks until one of the termination signals is received */
+	do {
+		ret = sigwait(mask, &sig);
+	} while (ret == EINTR);
+
+	quit_all(ret);
+
+	return NULL;
+}
+
+static void setup_sig_handler(void)
+{
+	sigset_t mask, oldmask;
+	pthread_t thd;
+	int ret;
+
+	/*
+	 * Async signals are difficult to handle and the IIO API is not signal
+	 * safe. Use a separate thread and handle the signals synchronous so we
+	 * can call iio_buffer_cancel().
+	 */
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGSEGV);
+	sigaddset(&mask, SIGTERM);
+
+	pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+	ret = pthread_create(&thd, NULL, sig_handler_thd, &mask);
+	if (ret) {
+		fprintf(stderr, "Failed to create signal handler thread: %d\n", ret);
+		pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	}
+}
+
+#endif
+
+static unsigned int bench_fls(uint64_t value)
+{
+	unsigned int msb = 0;
+
+	while (value >>= 1)
+		msb++;
+
+	return msb;
+}
+
+static void hdr_record(uint64_t value)
+{
+	unsigned int msb, idx;
+
+	if (value < HDR_SUB_COUNT) {
+		idx = (unsigned int) value;
+	} else {
+		msb = bench_fls(value);
+		idx = ((msb - HDR_SUB_BITS + 1) << HDR_SUB_BITS)
+			| ((value >> (msb - HDR_SUB_BITS)) & (HDR_SUB_COUNT - 1));
+	}
+
+	hdr_counts[idx]++;
+	hdr_total++;
+	hdr_sum += value;
+	if (value < hdr_min)
+		hdr_min = value;
+	if (value > hdr_max)
+		hdr_max = value;
+}
+
+/* Lower bound of the bucket's value range, inverse of the hdr_record()
+ * index computation. */
+static uint64_t hdr_bucket_value(unsigned int idx)
+{
+	unsigned int msb;
+
+	if (idx < HDR_SUB_COUNT)
+		return idx;
+
+	msb = (idx >> HDR_SUB_BITS) + HDR_SUB_BITS - 1;
+
+	return (uint64_t) (HDR_SUB_COUNT + (idx & (HDR_SUB_COUNT - 1)))
+		<< (msb - HDR_SUB_BITS);
+}
+
+static uint64_t hdr_percentile(double percentile)
+{
+	uint64_t target, acc = 0;
+	unsigned int i;
+
+	target = (uint64_t) (percentile * (double) hdr_total / 100.0);
+	if (target < 1)
+		target = 1;
+
+	for (i = 0; i < HDR_NB_BUCKETS; i++) {
+		acc += hdr_counts[i];
+		if (acc >= target)
+			return hdr_bucket_value(i);
+	}
+
+	return hdr_max;
+}
+
+static double get_cpu_time_s(void)
+{
+#ifdef _WIN32
+	FILETIME creation, exit_time, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit_time,
+			     &kernel, &user))
+		return 0.0;
+
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	/* FILETIME counts 100ns ticks */
+	return (double) (k.QuadPart + u.QuadPart) / 1e7;
+#else
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		return 0.0;
+
+	return (double) usage.ru_utime.tv_sec + (double) usage.ru_stime.tv_sec
+		+ ((double) usage.ru_utime.tv_usec
+		   + (double) usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+static void print_results(const struct iio_device *dev, bool is_write,
+			  bool json, size_t block_size, unsigned int nb_blocks,
+			  uint64_t bytes, uint64_t duration_us, double cpu_s)
+{
+	const char *uri = iio_context_get_attr_value(ctx, "uri");
+	double throughput, gb, cpu_per_gb, mean;
+
+	throughput = duration_us ?
+		(double) bytes * 1e6 / (double) duration_us : 0.0;
+	gb = (double) bytes / 1e9;
+	cpu_per_gb = gb > 0.0 ? cpu_s / gb : 0.0;
+	mean = hdr_total ? (double) hdr_sum / (double) hdr_total : 0.0;
+
+	if (json) {
+		printf("{\n"
+		       "  \"uri\": \"%s\",\n"
+		       "  \"device\": \"%s\",\n"
+		       "  \"direction\": \"%s\",\n"
+		       "  \"block_size_bytes\": %zu,\n"
+		       "  \"blocks_in_flight\": %u,\n"
+		       "  \"blocks\": %" PRIu64 ",\n"
+		       "  \"bytes\": %" PRIu64 ",\n"
+		       "  \"duration_us\": %" PRIu64 ",\n"
+		       "  \"throughput_bytes_per_sec\": %.0f,\n"
+		       "  \"latency_us\": {\n"
+		       "    \"min\": %" PRIu64 ",\n"
+		       "    \"mean\": %.1f,\n"
+		       "    \"p50\": %" PRIu64 ",\n"
+		       "    \"p90\": %" PRIu64 ",\n"
+		       "    \"p99\": %" PRIu64 ",\n"
+		       "    \"p999\": %" PRIu64 ",\n"
+		       "    \"max\": %" PRIu64 "\n"
+		       "  },\n"
+		       "  \"cpu_sec_per_gb\": %.3f\n"
+		       "}\n",
+		       uri ? uri : "", dev_name(dev),
+		       is_write ? "tx" : "rx",
+		       block_size, nb_blocks, hdr_total, bytes, duration_us,
+		       throughput,
+		       hdr_total ? hdr_min : 0, mean,
+		       hdr_percentile(50.0), hdr_percentile(90.0),
+		       hdr_percentile(99.0), hdr_percentile(99.9),
+		       hdr_max, cpu_per_gb);
+		return;
+	}
+
+	printf("Device: %s (%s, %s)\n", dev_name(dev), uri ? uri : "?",
+	       is_write ? "TX" : "RX");
+	printf("Blocks: %" PRIu64 " x %zu bytes (%u in flight)\n",
+	       hdr_total, block_size, nb_blocks);
+	printf("Throughput: %.1f MiB/s\n", throughput / 1048576.0);
+	printf("Latency (us): min %" PRIu64 " / mean %.1f / p50 %" PRIu64
+	       " / p90 %" PRIu64 " / p99 %" PRIu64 " / p99.9 %" PRIu64
+	       " / max %" PRIu64 "\n",
+	       hdr_total ? hdr_min : 0, mean,
+	       hdr_percentile(50.0), hdr_percentile(90.0),
+	       hdr_percentile(99.0), hdr_percentile(99.9), hdr_max);
+	printf("CPU: %.3f core-seconds per GB\n", cpu_per_gb);
+}
+
+#define MY_OPTS "b:n:d:c:wj"
+
+int main(int argc, char **argv)
+{
+	char **argw;
+	unsigned int i, j, nb_channels, nb_active_channels = 0;
+	unsigned int buffer_size = SAMPLES_PER_BLOCK;
+	unsigned int nb_blocks = BLOCKS_IN_FLIGHT;
+	uint64_t duration_s = DEFAULT_DURATION_S, count = 0;
+	uint64_t ts[MAX_BLOCKS_IN_FLIGHT];
+	uint64_t bytes = 0, done = 0, start_us, end_us, now;
+	struct iio_block *blocks[MAX_BLOCKS_IN_FLIGHT] = { NULL };
+	struct iio_device *dev;
+	struct iio_channel *ch;
+	struct iio_channels_mask *mask;
+	ssize_t sample_size;
+	size_t block_size;
+	bool is_write = false, json = false;
+	double cpu_before, cpu_after;
+	struct option *opts;
+	int c, err, ret = EXIT_FAILURE;
+
+	argw = dup_argv(MY_NAME, argc, argv);
+
+	setup_sig_handler();
+
+	ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
+				 options, options_descriptions, &ret);
+	opts = add_common_options(options);
+	if (!opts) {
+		fprintf(stderr, "Failed to add common options\n");
+		goto err_free_ctx;
+	}
+
+	while ((c = getopt_long(argc, argw, "+" COMMON_OPTIONS MY_OPTS,	/* Flawfinder: ignore */
+					opts, NULL)) != -1) {
+		switch (c) {
+		/* All these are handled in the common */
+		case 'h':
+		case 'V':
+		case 'u':
+		case 'T':
+			break;
+		case 'S':
+		case 'a':
+			if (!optarg && argc > optind && argv[optind] != NULL
+					&& argv[optind][0] != '-')
+				optind++;
+			break;
+		case 'b':
+			buffer_size = sanitize_clamp("buffer size", optarg,
+						     1, 1024 * 1024 * 1024);
+			break;
+		case 'n':
+			nb_blocks = sanitize_clamp("number of blocks", optarg,
+						   1, MAX_BLOCKS_IN_FLIGHT);
+			break;
+		case 'd':
+			duration_s = sanitize_clamp("duration", optarg,
+						    1, 24 * 60 * 60);
+			break;
+		case 'c':
+			count = sanitize_clamp("count", optarg, 1, UINT64_MAX);
+			break;
+		case 'w':
+			is_write = true;
+			break;
+		case 'j':
+			json = true;
+			break;
+		case '?':
+			printf("Unknown argument '%c'\n", c);
+			goto err_free_ctx;
+		}
+	}
+	free(opts);
+
+	if (!ctx)
+		goto err_free_argw;
+
+	if (!argw[optind]) {
+		fprintf(stderr, "Too few arguments.\n\n");
+		usage(MY_NAME, options, options_descriptions);
+		goto err_free_ctx;
+	}
+
+	dev = iio_context_find_device(ctx, argw[optind]);
+	if (!dev) {
+		fprintf(stderr, "Device %s not found\n", argw[optind]);
+		goto err_free_ctx;
+	}
+
+	nb_channels = iio_device_get_channels_count(dev);
+	mask = iio_create_channels_mask(nb_channels);
+	if (!mask) {
+		fprintf(stderr, "Unable to create channels mask\n");
+		goto err_free_ctx;
+	}
+
+	if (argc == optind + 1) {
+		/* Enable all channels */
+		for (i = 0; i < nb_channels; i++) {
+			ch = iio_device_get_channel(dev, i);
+
+			if (is_write == iio_channel_is_output(ch)) {
+				iio_channel_enable(ch, mask);
+				nb_active_channels++;
+			}
+		}
+	} else {
+		for (j = optind + 1; j < (unsigned int) argc; j++) {
+			err = iio_device_enable_channel(dev, argw[j],
+							is_write, mask);
+			if (err < 0) {
+				dev_perror(dev, err, "Bad channel name \"%s\"",
+					   argw[j]);
+				goto err_free_mask;
+			}
+			nb_active_channels++;
+		}
+	}
+
+	if (!nb_active_channels) {
+		fprintf(stderr, "No %sput channels found\n",
+			is_write ? "out" : "in");
+		goto err_free_mask;
+	}
+
+	sample_size = iio_device_get_sample_size(dev, mask);
+	if (sample_size == 0) {
+		fprintf(stderr, "Unable to get sample size, returned 0\n");
+		goto err_free_mask;
+	} else if (sample_size < 0) {
+		dev_perror(dev, (int) sample_size, "Unable to get sample size");
+		goto err_free_mask;
+	}
+
+	block_size = buffer_size * (size_t) sample_size;
+
+	buffer = iio_device_create_buffer(dev, 0, mask);
+	err = iio_err(buffer);
+	if (err) {
+		buffer = NULL;
+		dev_perror(dev, err, "Unable to allocate buffer");
+		goto err_free_mask;
+	}
+
+	for (i = 0; i < nb_blocks; i++) {
+		blocks[i] = iio_buffer_create_block(buffer, block_size);
+		err = iio_err(blocks[i]);
+		if (err) {
+			dev_perror(dev, err, "Unable to create block");
+			goto err_free_blocks;
+		}
+	}
+
+	/* TX blocks carry zeroes; the wire and DMA cost is the same */
+	if (is_write) {
+		for (i = 0; i < nb_blocks; i++)
+			memset(iio_block_start(blocks[i]), 0, block_size);
+	}
+
+	for (i = 0; i < nb_blocks; i++) {
+		ts[i] = get_time_us();
+		err = iio_block_enqueue(blocks[i], 0, false);
+		if (err) {
+			dev_perror(dev, err, "Unable to enqueue block");
+			goto err_free_blocks;
+		}
+	}
+
+	err = iio_buffer_enable(buffer);
+	if (err) {
+		dev_perror(dev, err, "Unable to enable buffer");
+		goto err_free_blocks;
+	}
+
+	cpu_before = get_cpu_time_s();
+	start_us = get_time_us();
+	end_us = start_us + duration_s * 1000000u;
+
+	while (app_running) {
+		i = (unsigned int) (done % nb_blocks);
+
+		err = iio_block_dequeue(blocks[i], false);
+		if (err) {
+			if (app_running)
+				dev_perror(dev, err, "Unable to dequeue block");
+			break;
+		}
+
+		now = get_time_us();
+		hdr_record(now - ts[i]);
+		bytes += block_size;
+		done++;
+
+		if (count ? done >= count : now >= end_us)
+			break;
+
+		ts[i] = get_time_us();
+		err = iio_block_enqueue(blocks[i], 0, false);
+		if (err) {
+			dev_perror(dev, err, "Unable to enqueue block");
+			break;
+		}
+	}
+
+	end_us = get_time_us();
+	cpu_after = get_cpu_time_s();
+
+	iio_buffer_cancel(buffer);
+
+	if (done) {
+		print_results(dev, is_write, json, block_size, nb_blocks,
+			      bytes, end_us - start_us,
+			      cpu_after - cpu_before);
+		ret = EXIT_SUCCESS;
+	}
+
+err_free_blocks:
+	for (i = 0; i < nb_blocks; i++) {
+		if (blocks[i] && !iio_err(blocks[i]))
+			iio_block_destroy(blocks[i]);
+	}
+	iio_buffer_destroy(buffer);
+err_free_mask:
+	iio_channels_mask_destroy(mask);
+err_free_ctx:
+	if (ctx)
+		iio_context_destroy(ctx);
+err_free_argw:
+	free_argw(argc, argw);
+	return ret;
+}
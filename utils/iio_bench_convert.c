@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_bench_convert - Part of the Industrial I/O (IIO) utilities
+ *
+ * Microbenchmark for the sample conversion kernels of the library
+ * (iio_channel_convert() and friends, i.e. the byte swapping, bit
+ * shifting and sign extension loops of channel.c). Sweeps a realistic
+ * format matrix over a cache-sized and a DRAM-sized working set and
+ * reports the achieved bandwidth, so that optimizations of the kernels
+ * have a regression gate.
+ * */
+
+#include <errno.h>
+#include <iio/iio.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "iio_common.h"
+
+#define MY_NAME "iio_bench_convert"
+
+#define SMALL_SIZE (64 * 1024)
+#define LARGE_SIZE (64 * 1024 * 1024)
+
+/* Each measurement runs for at least this long */
+#define MIN_RUN_US 300000
+
+#if defined(_MSC_BUILD)
+#include <intrin.h>
+#define HAVE_CYCLES 1
+static uint64_t bench_cycles(void)
+{
+	return __rdtsc();
+}
+#elif defined(__x86_64__) || defined(__i386__)
+#define HAVE_CYCLES 1
+static uint64_t bench_cycles(void)
+{
+	unsigned int lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((uint64_t) hi << 32) | lo;
+}
+#else
+static uint64_t bench_cycles(void)
+{
+	return 0;
+}
+#endif
+
+/* The format matrix: one scan element per entry, covering the storage
+ * sizes, shifts, signedness and endianness combinations commonly found
+ * on real converters. */
+static const struct bench_format {
+	char endianness, sign;
+	unsigned int bits, length, shift;
+} bench_formats[] = {
+	{ 'l', 'u',  8,  8, 0 },
+	{ 'l', 's',  8,  8, 0 },
+	{ 'l', 's', 12, 16, 4 },
+	{ 'b', 's', 12, 16, 4 },
+	{ 'l', 'u', 16, 16, 0 },
+	{ 'b', 's', 16, 16, 0 },
+	{ 'l', 's', 24, 32, 8 },
+	{ 'b', 's', 24, 32, 8 },
+	{ 'l', 'u', 32, 32, 0 },
+	{ 'b', 'u', 32, 32, 0 },
+	{ 'l', 's', 64, 64, 0 },
+	{ 'b', 's', 64, 64, 0 },
+};
+
+#define NB_FORMATS (sizeof(bench_formats) / sizeof(bench_formats[0]))
+
+/* Same DTD as the one the library prepends to generated context XML */
+static const char xml_doctype[] = "<!DOCTYPE context ["
+"<!ELEMENT context (device | context-attribute)*>"
+"<!ELEMENT context-attribute EMPTY>"
+"<!ELEMENT device (channel | attribute | debug-attribute | buffer-attribute)*>"
+"<!ELEMENT channel (scan-element?, attribute*)>"
+"<!ELEMENT attribute EMPTY>"
+"<!ELEMENT scan-element EMPTY>"
+"<!ELEMENT debug-attribute EMPTY>"
+"<!ELEMENT buffer-attribute EMPTY>"
+"<!ATTLIST context name CDATA #REQUIRED version-major CDATA #REQUIRED "
+"version-minor CDATA #REQUIRED version-git CDATA #REQUIRED description CDATA #IMPLIED>"
+"<!ATTLIST context-attribute name CDATA #REQUIRED value CDATA #REQUIRED>"
+"<!ATTLIST device id CDATA #REQUIRED name CDATA #IMPLIED label CDATA #IMPLIED>"
+"<!ATTLIST channel id CDATA #REQUIRED type (input|output) #REQUIRED name CDATA #IMPLIED>"
+"<!ATTLIST scan-element index CDATA #REQUIRED format CDATA #REQUIRED scale CDATA #IMPLIED>"
+"<!ATTLIST attribute name CDATA #REQUIRED filename CDATA #IMPLIED>"
+"<!ATTLIST debug-attribute name CDATA #REQUIRED>"
+"<!ATTLIST buffer-attribute name CDATA #REQUIRED>"
+"]>";
+
+static int write_context_xml(FILE *f)
+{
+	unsigned int i;
+	int ret;
+
+	ret = fprintf(f, "<?xml version=\"1.0\" encoding=\"utf-8\"?>%s"
+		      "<context name=\"xml\" version-major=\"%u\" "
+		      "version-minor=\"%u\" version-git=\"\" "
+		      "description=\"%s\">"
+		      "<device id=\"iio:device0\" name=\"bench\">",
+		      xml_doctype, iio_context_get_version_major(NULL),
+		      iio_context_get_version_minor(NULL), MY_NAME);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < NB_FORMATS; i++) {
+		const struct bench_format *fmt = &bench_formats[i];
+
+		ret = fprintf(f, "<channel id=\"voltage%u\" type=\"input\">"
+			      "<scan-element index=\"%u\" "
+			      "format=\"%ce:%c%u/%u&gt;&gt;%u\"/>"
+			      "</channel>",
+			      i, i, fmt->endianness, fmt->sign,
+			      fmt->bits, fmt->length, fmt->shift);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = fprintf(f, "</device></context>");
+
+	return ret < 0 ? ret : 0;
+}
+
+static void bench_kernel(const struct iio_channel *chn, bool inverse,
+			 void *dst, const void *src, size_t size,
+			 size_t sample_len)
+{
+	size_t nb = size / sample_len;
+	uint64_t before_us, after_us, before_cyc, after_cyc;
+	uint64_t iters = 0, bytes;
+	double mb_per_s, bytes_per_cycle;
+
+	/* Warm up the caches and the branch predictors */
+	if (inverse)
+		iio_channel_convert_array_inverse(chn, dst, src, nb);
+	else
+		iio_channel_convert_array(chn, dst, src, nb);
+
+	before_us = get_time_us();
+	before_cyc = bench_cycles();
+
+	do {
+		if (inverse)
+			iio_channel_convert_array_inverse(chn, dst, src, nb);
+		else
+			iio_channel_convert_array(chn, dst, src, nb);
+
+		iters++;
+		after_us = get_time_us();
+	} while (after_us - before_us < MIN_RUN_US);
+
+	after_cyc = bench_cycles();
+
+	bytes = (uint64_t) nb * sample_len * iters;
+	mb_per_s = (double) bytes / (double) (after_us - before_us);
+
+	printf("%6zu KiB  %-15s  %8.1f MB/s", size / 1024,
+	       inverse ? "convert-inverse" : "convert", mb_per_s);
+
+	if (HAVE_CYCLES && after_cyc > before_cyc) {
+		bytes_per_cycle = (double) bytes
+			/ (double) (after_cyc - before_cyc);
+		printf("  %6.3f bytes/cycle", bytes_per_cycle);
+	}
+
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	char uri[512 + sizeof("xml:")];
+	char path[512];
+	unsigned int i;
+	size_t sizes[] = { SMALL_SIZE, LARGE_SIZE };
+	void *src, *dst;
+	FILE *f;
+	size_t j, k;
+	int err, ret = EXIT_FAILURE;
+
+#ifdef _WIN32
+	char tmpdir[MAX_PATH];
+
+	if (!GetTempPathA(sizeof(tmpdir), tmpdir) ||
+	    !GetTempFileNameA(tmpdir, "iio", 0, path)) {
+		fprintf(stderr, "Unable to create temporary file\n");
+		return EXIT_FAILURE;
+	}
+
+	f = fopen(path, "w"); /* Flawfinder: ignore */
+	if (!f) {
+		fprintf(stderr, "Unable to open temporary file\n");
+		return EXIT_FAILURE;
+	}
+#else
+	int fd;
+
+	snprintf(path, sizeof(path), "/tmp/%s_XXXXXX", MY_NAME);
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create temporary file\n");
+		return EXIT_FAILURE;
+	}
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+#endif
+
+	err = write_context_xml(f);
+	fclose(f);
+	if (err < 0) {
+		fprintf(stderr, "Unable to write context XML\n");
+		goto err_unlink;
+	}
+
+	snprintf(uri, sizeof(uri), "xml:%s", path);
+
+	ctx = iio_create_context(NULL, uri);
+	err = iio_err(ctx);
+	if (err) {
+		char buf[1024];
+
+		iio_strerror(err, buf, sizeof(buf));
+		fprintf(stderr, "Unable to create XML context: %s\n", buf);
+		goto err_unlink;
+	}
+
+	dev = iio_context_get_device(ctx, 0);
+
+	src = xmalloc(LARGE_SIZE, MY_NAME);
+	dst = xmalloc(LARGE_SIZE, MY_NAME);
+
+	/* Pseudo-random payload; the kernels are data-independent but this
+	 * keeps the memory subsystem honest. */
+	srand(0);
+	for (j = 0; j < LARGE_SIZE; j++)
+		((unsigned char *) src)[j] = (unsigned char) rand();
+
+	for (i = 0; i < NB_FORMATS; i++) {
+		const struct bench_format *fmt = &bench_formats[i];
+		const struct iio_channel *chn = iio_device_get_channel(dev, i);
+		size_t sample_len = fmt->length / 8;
+
+		if (!chn) {
+			fprintf(stderr, "Channel %u not found\n", i);
+			goto err_free_bufs;
+		}
+
+		for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			for (k = 0; k < 2; k++) {
+				printf("%ce:%c%u/%u>>%u  ",
+				       fmt->endianness, fmt->sign, fmt->bits,
+				       fmt->length, fmt->shift);
+				bench_kernel(chn, k == 1, dst, src, sizes[j],
+					     sample_len);
+			}
+		}
+	}
+
+	ret = EXIT_SUCCESS;
+
+err_free_bufs:
+	free(src);
+	free(dst);
+	iio_context_destroy(ctx);
+err_unlink:
+#ifdef _WIN32
+	DeleteFileA(path);
+#else
+	unlink(path);
+#endif
+	return ret;
+}
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * iio_capture.h - Part of the Industrial I/O (IIO) utilities
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ * */
+
+#ifndef IIO_CAPTURE_H
+#define IIO_CAPTURE_H
+
+#include <stdint.h>
+
+/*
+ * On-disk layout of the capture container written by iio_record and
+ * played back by iio_replay.
+ *
+ * The file starts with a fixed header, followed by a binary snapshot of
+ * the recorded context (iio_context_serialize_binary) and one channel
+ * entry per recorded channel. The block records then follow back to
+ * back, each padded to IIO_CAPTURE_ALIGN so that the whole file can
+ * simply be mmap()ed and walked with pointer casts. A sparse index (one
+ * entry every "index_stride" blocks) is appended after the last block,
+ * and the header is rewritten on close to point at it.
+ *
+ * All fields are in the byte order of the recording host; the magic
+ * doubles as the endianness check.
+ */
+
+#define IIO_CAPTURE_MAGIC "IIOCAP01"
+#define IIO_CAPTURE_ALIGN 8
+#define IIO_CAPTURE_DEFAULT_STRIDE 64
+
+struct iio_capture_hdr {
+	char magic[8];
+
+	/* File offset of the first block record */
+	uint64_t data_offset;
+	/* File offset of the sparse index; 0 when the recording was not
+	 * closed cleanly (the blocks can still be walked sequentially) */
+	uint64_t index_offset;
+
+	uint64_t nb_blocks;
+	uint64_t nb_samples;
+
+	/* Size of the binary context snapshot following this header */
+	uint32_t ctx_size;
+	uint32_t nb_channels;
+	uint32_t sample_size;
+	/* One index entry every that many blocks */
+	uint32_t index_stride;
+	/* Payload size of a full block, in bytes; only the last block of
+	 * a recording may be shorter */
+	uint32_t block_size;
+	uint32_t reserved;
+
+	char dev_id[32];
+};
+
+/* Channel entry: the channel ID plus its iio_data_format, spelled out
+ * field by field so that the on-disk layout does not depend on the
+ * library's ABI. Channels appear in the order they interleave in the
+ * samples. */
+struct iio_capture_chn {
+	char id[32];
+
+	uint32_t length;
+	uint32_t bits;
+	uint32_t shift;
+	uint32_t repeat;
+	uint8_t is_signed;
+	uint8_t is_be;
+	uint8_t with_scale;
+	uint8_t pad;
+	double scale;
+};
+
+/* One block record; the payload follows, padded to IIO_CAPTURE_ALIGN */
+struct iio_capture_block {
+	uint64_t timestamp_us;
+	uint32_t bytes_used;
+	uint32_t pad;
+};
+
+struct iio_capture_idx {
+	/* File offset of the block record */
+	uint64_t offset;
+	uint64_t timestamp_us;
+	/* Cumulative sample count at the start of the block */
+	uint64_t first_sample;
+};
+
+#endif /* IIO_CAPTURE_H */
@@ -0,0 +1,517 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_record - Part of the Industrial I/O (IIO) utilities
+ *
+ * Records a capture into the indexed container format described in
+ * iio_capture.h: a binary snapshot of the context and the channel data
+ * formats in the header, timestamped block records in the body, and a
+ * sparse index appended on close so that iio_replay (or any offline
+ * consumer) can seek by time instead of scanning the whole file.
+ * */
+
+#include <errno.h>
+#include <getopt.h>
+#include <iio/iio.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-debug.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iio_capture.h"
+#include "iio_common.h"
+
+#define MY_NAME "iio_record"
+
+#define SAMPLES_PER_BLOCK 4096
+#define BLOCKS_IN_FLIGHT 4
+
+static const struct option options[] = {
+	  {"trigger", required_argument, 0, 't'},
+	  {"buffer-size", required_argument, 0, 'b'},
+	  {"samples", required_argument, 0, 's'},
+	  {"index-stride", required_argument, 0, 'n'},
+	  {"output", required_argument, 0, 'o'},
+	  {0, 0, 0, 0},
+};
+
+static const char *options_descriptions[] = {
+	"[-t <trigger>] [-b <buffer-size>] [-s <samples>]"
+		"\n\t\t\t[-n <stride>] -o <file> <iio_device> [<channel> ...]",
+	"Use the specified trigger.",
+	"Size of the capture blocks, in samples. Default is 4096.",
+	"Number of samples to record, 0 = until interrupted. Default is 0.",
+	"Write one index entry every that many blocks. Default is 64.",
+	"File to record into.",
+};
+
+static struct iio_context *ctx;
+static struct iio_buffer *buffer;
+
+static volatile sig_atomic_t app_running = true;
+
+static void quit_all(int sig)
+{
+	app_running = false;
+	if (buffer)
+		iio_buffer_cancel(buffer);
+}
+
+#ifdef _WIN32
+
+BOOL WINAPI sig_handler_fn(DWORD dwCtrlType)
+{
+	/* Runs in its own thread */
+
+	switch (dwCtrlType) {
+	case CTRL_C_EVENT:
+	case CTRL_CLOSE_EVENT:
+		quit_all(SIGTERM);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void setup_sig_handler(void)
+{
+	SetConsoleCtrlHandler(sig_handler_fn, TRUE);
+}
+
+#elif NO_THREADS
+
+static void sig_handler(int sig)
+{
+	if (!app_running)
+		exit(sig);
+	app_running = false;
+}
+
+static void set_handler(int sig)
+{
+	struct sigaction action;
+
+	sigaction(sig, NULL, &action);
+	action.sa_handler = sig_handler;
+	sigaction(sig, &action, NULL);
+}
+
+static void setup_sig_handler(void)
+{
+	set_handler(SIGHUP);
+	set_handler(SIGPIPE);
+	set_handler(SIGINT);
+	set_handler(SIGSEGV);
+	set_handler(SIGTERM);
+}
+
+#else
+
+#include <pthread.h>
+
+static void * sig_handler_thd(void *data)
+{
+	sigset_t *mask = data;
+	int ret, sig;
+
+	/* Blocks until one of the termination signals is received */
+	do {
+		ret = sigwait(mask, &sig);
+	} while (ret == EINTR);
+
+	quit_all(ret);
+
+	return NULL;
+}
+
+static void setup_sig_handler(void)
+{
+	sigset_t mask, oldmask;
+	pthread_t thd;
+	int ret;
+
+	/*
+	 * Async signals are difficult to handle and the IIO API is not signal
+	 * safe. Use a separate thread and handle the signals synchronous so we
+	 * can call iio_buffer_cancel().
+	 */
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGSEGV);
+	sigaddset(&mask, SIGTERM);
+
+	pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+	ret = pthread_create(&thd, NULL, sig_handler_thd, &mask);
+	if (ret) {
+		fprintf(stderr, "Failed to create signal handler thread: %d\n", ret);
+		pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	}
+}
+
+#endif
+
+static void fill_chn_entry(struct iio_capture_chn *entry,
+			   const struct iio_channel *ch)
+{
+	const struct iio_data_format *fmt = iio_channel_get_data_format(ch);
+
+	memset(entry, 0, sizeof(*entry));
+	snprintf(entry->id, sizeof(entry->id), "%s", iio_channel_get_id(ch));
+
+	entry->length = fmt->length;
+	entry->bits = fmt->bits;
+	entry->shift = fmt->shift;
+	entry->repeat = fmt->repeat;
+	entry->is_signed = fmt->is_signed;
+	entry->is_be = fmt->is_be;
+	entry->with_scale = fmt->with_scale;
+	entry->scale = fmt->scale;
+}
+
+static int write_header(FILE *f, const struct iio_capture_hdr *hdr,
+			const void *ctx_bin,
+			const struct iio_capture_chn *chns)
+{
+	static const char zeroes[IIO_CAPTURE_ALIGN] = { 0 };
+	uint64_t end;
+
+	if (fseek(f, 0, SEEK_SET) < 0)
+		return -1;
+
+	if (fwrite(hdr, sizeof(*hdr), 1, f) != 1 ||
+	    fwrite(ctx_bin, 1, hdr->ctx_size, f) != hdr->ctx_size ||
+	    fwrite(chns, sizeof(*chns), hdr->nb_channels, f) != hdr->nb_channels)
+		return -1;
+
+	end = sizeof(*hdr) + hdr->ctx_size
+		+ hdr->nb_channels * sizeof(*chns);
+	if (end < hdr->data_offset &&
+	    fwrite(zeroes, 1, hdr->data_offset - end, f)
+	    != hdr->data_offset - end)
+		return -1;
+
+	return 0;
+}
+
+#define MY_OPTS "t:b:s:n:o:"
+
+int main(int argc, char **argv)
+{
+	static const char zeroes[IIO_CAPTURE_ALIGN] = { 0 };
+	char **argw;
+	unsigned int i, j, nb_channels, nb_active_channels = 0;
+	unsigned int buffer_size = SAMPLES_PER_BLOCK;
+	unsigned int index_stride = IIO_CAPTURE_DEFAULT_STRIDE;
+	uint64_t num_samples = 0;
+	struct iio_capture_hdr hdr;
+	struct iio_capture_chn *chns;
+	struct iio_capture_block rec;
+	struct iio_capture_idx *idx = NULL, *new_idx;
+	size_t nb_idx = 0, nb_idx_allocated = 0;
+	struct iio_device *dev, *trigger;
+	struct iio_channel *ch;
+	struct iio_stream *stream;
+	const struct iio_block *block;
+	struct iio_channels_mask *mask;
+	const struct iio_channels_mask *hw_mask;
+	ssize_t sample_size, ctx_size;
+	const char *output_path = NULL, *trigger_name = NULL;
+	void *ctx_bin, *start;
+	uint64_t offset, len, pad;
+	struct option *opts;
+	FILE *f = NULL;
+	int c, err, ret = EXIT_FAILURE;
+
+	argw = dup_argv(MY_NAME, argc, argv);
+
+	setup_sig_handler();
+
+	ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
+				 options, options_descriptions, &ret);
+	opts = add_common_options(options);
+	if (!opts) {
+		fprintf(stderr, "Failed to add common options\n");
+		goto err_free_ctx;
+	}
+
+	while ((c = getopt_long(argc, argw, "+" COMMON_OPTIONS MY_OPTS,	/* Flawfinder: ignore */
+					opts, NULL)) != -1) {
+		switch (c) {
+		/* All these are handled in the common */
+		case 'h':
+		case 'V':
+		case 'u':
+		case 'T':
+			break;
+		case 'S':
+		case 'a':
+			if (!optarg && argc > optind && argv[optind] != NULL
+					&& argv[optind][0] != '-')
+				optind++;
+			break;
+		case 't':
+			trigger_name = optarg;
+			break;
+		case 'b':
+			buffer_size = sanitize_clamp("buffer size", optarg,
+						     1, 1024 * 1024 * 1024);
+			break;
+		case 's':
+			num_samples = sanitize_clamp("number of samples",
+						     optarg, 0, UINT64_MAX);
+			break;
+		case 'n':
+			index_stride = sanitize_clamp("index stride", optarg,
+						      1, UINT32_MAX);
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
+		case '?':
+			printf("Unknown argument '%c'\n", c);
+			goto err_free_ctx;
+		}
+	}
+	free(opts);
+
+	if (!ctx)
+		goto err_free_argw;
+
+	if (!output_path) {
+		fprintf(stderr, "No output file given.\n\n");
+		usage(MY_NAME, options, options_descriptions);
+		goto err_free_ctx;
+	}
+
+	if (!argw[optind]) {
+		fprintf(stderr, "Too few arguments.\n\n");
+		usage(MY_NAME, options, options_descriptions);
+		goto err_free_ctx;
+	}
+
+	dev = iio_context_find_device(ctx, argw[optind]);
+	if (!dev) {
+		fprintf(stderr, "Device %s not found\n", argw[optind]);
+		goto err_free_ctx;
+	}
+
+	if (trigger_name) {
+		trigger = iio_context_find_device(ctx, trigger_name);
+		if (!trigger || !iio_device_is_trigger(trigger)) {
+			fprintf(stderr, "Trigger %s not found\n", trigger_name);
+			goto err_free_ctx;
+		}
+
+		err = iio_device_set_trigger(dev, trigger);
+		if (err < 0)
+			dev_perror(dev, err, "Unable to set trigger");
+	}
+
+	nb_channels = iio_device_get_channels_count(dev);
+	mask = iio_create_channels_mask(nb_channels);
+	if (!mask) {
+		fprintf(stderr, "Unable to create channels mask\n");
+		goto err_free_ctx;
+	}
+
+	if (argc == optind + 1) {
+		/* Enable all channels */
+		for (i = 0; i < nb_channels; i++) {
+			ch = iio_device_get_channel(dev, i);
+
+			if (!iio_channel_is_output(ch)) {
+				iio_channel_enable(ch, mask);
+				nb_active_channels++;
+			}
+		}
+	} else {
+		for (j = optind + 1; j < (unsigned int) argc; j++) {
+			err = iio_device_enable_channel(dev, argw[j], false,
+							mask);
+			if (err < 0) {
+				dev_perror(dev, err, "Bad channel name \"%s\"",
+					   argw[j]);
+				goto err_free_mask;
+			}
+			nb_active_channels++;
+		}
+	}
+
+	if (!nb_active_channels) {
+		fprintf(stderr, "No input channels found\n");
+		goto err_free_mask;
+	}
+
+	buffer = iio_device_create_buffer(dev, 0, mask);
+	err = iio_err(buffer);
+	if (err) {
+		buffer = NULL;
+		dev_perror(dev, err, "Unable to allocate buffer");
+		goto err_free_mask;
+	}
+
+	/* Record the channels the hardware actually enabled, so that the
+	 * payloads can be written (and replayed) without demuxing. */
+	hw_mask = iio_buffer_get_channels_mask(buffer);
+	sample_size = iio_device_get_sample_size(dev, hw_mask);
+	if (sample_size <= 0) {
+		dev_perror(dev, (int) sample_size, "Unable to get sample size");
+		goto err_destroy_buffer;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, IIO_CAPTURE_MAGIC, sizeof(hdr.magic));
+	snprintf(hdr.dev_id, sizeof(hdr.dev_id), "%s", iio_device_get_id(dev));
+	hdr.sample_size = (uint32_t) sample_size;
+	hdr.index_stride = index_stride;
+	hdr.block_size = buffer_size * (uint32_t) sample_size;
+
+	for (i = 0; i < nb_channels; i++) {
+		ch = iio_device_get_channel(dev, i);
+		if (iio_channel_is_enabled(ch, hw_mask))
+			hdr.nb_channels++;
+	}
+
+	chns = xmalloc(hdr.nb_channels * sizeof(*chns), MY_NAME);
+
+	/* Channel entries in interleave order */
+	for (i = 0, j = 0; i < nb_channels; i++) {
+		ch = iio_device_get_channel(dev, i);
+		if (iio_channel_is_enabled(ch, hw_mask))
+			fill_chn_entry(&chns[j++], ch);
+	}
+
+	ctx_size = iio_context_serialize_binary(ctx, &ctx_bin);
+	if (ctx_size < 0) {
+		ctx_perror(ctx, (int) ctx_size, "Unable to serialize context");
+		goto err_free_chns;
+	}
+
+	hdr.ctx_size = (uint32_t) ctx_size;
+	hdr.data_offset = sizeof(hdr) + hdr.ctx_size
+		+ hdr.nb_channels * sizeof(*chns);
+	hdr.data_offset = (hdr.data_offset + IIO_CAPTURE_ALIGN - 1)
+		& ~(uint64_t)(IIO_CAPTURE_ALIGN - 1);
+
+	f = fopen(output_path, "wb");
+	if (!f) {
+		perror("Unable to open output file");
+		goto err_free_ctx_bin;
+	}
+
+	if (write_header(f, &hdr, ctx_bin, chns)) {
+		perror("Unable to write header");
+		goto err_close_file;
+	}
+
+	stream = iio_buffer_create_stream(buffer, BLOCKS_IN_FLIGHT,
+					  buffer_size);
+	err = iio_err(stream);
+	if (err) {
+		dev_perror(dev, err, "Unable to create stream");
+		goto err_close_file;
+	}
+
+	offset = hdr.data_offset;
+
+	while (app_running) {
+		block = iio_stream_get_next_block(stream);
+		err = iio_err(block);
+		if (err) {
+			if (app_running)
+				dev_perror(dev, err, "Unable to get next block");
+			break;
+		}
+
+		start = iio_block_start(block);
+		len = (uintptr_t) iio_block_end(block) - (uintptr_t) start;
+
+		if (num_samples) {
+			if (len > (num_samples - hdr.nb_samples) * sample_size)
+				len = (num_samples - hdr.nb_samples) * sample_size;
+		}
+
+		rec.timestamp_us = get_time_us();
+		rec.bytes_used = (uint32_t) len;
+		rec.pad = 0;
+
+		if (hdr.nb_blocks % index_stride == 0) {
+			if (nb_idx == nb_idx_allocated) {
+				nb_idx_allocated = nb_idx_allocated
+					? nb_idx_allocated * 2 : 64;
+				new_idx = realloc(idx, nb_idx_allocated
+						  * sizeof(*idx));
+				if (!new_idx) {
+					fprintf(stderr, "Unable to grow index\n");
+					break;
+				}
+				idx = new_idx;
+			}
+
+			idx[nb_idx].offset = offset;
+			idx[nb_idx].timestamp_us = rec.timestamp_us;
+			idx[nb_idx].first_sample = hdr.nb_samples;
+			nb_idx++;
+		}
+
+		pad = (IIO_CAPTURE_ALIGN - len % IIO_CAPTURE_ALIGN)
+			% IIO_CAPTURE_ALIGN;
+
+		if (fwrite(&rec, sizeof(rec), 1, f) != 1 ||
+		    fwrite(start, 1, len, f) != len ||
+		    (pad && fwrite(zeroes, 1, pad, f) != pad)) {
+			perror("Unable to write block");
+			break;
+		}
+
+		offset += sizeof(rec) + len + pad;
+		hdr.nb_blocks++;
+		hdr.nb_samples += len / sample_size;
+
+		if (num_samples && hdr.nb_samples >= num_samples) {
+			ret = EXIT_SUCCESS;
+			break;
+		}
+	}
+
+	if (!app_running)
+		ret = EXIT_SUCCESS;
+
+	/* Append the sparse index and point the header at it */
+	hdr.index_offset = offset;
+	if ((nb_idx && fwrite(idx, sizeof(*idx), nb_idx, f) != nb_idx) ||
+	    write_header(f, &hdr, ctx_bin, chns)) {
+		perror("Unable to write index");
+		ret = EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "%" PRIu64 " blocks (%" PRIu64 " samples) recorded, "
+		"%zu index entries\n",
+		hdr.nb_blocks, hdr.nb_samples, nb_idx);
+
+	iio_stream_destroy(stream);
+err_close_file:
+	if (fclose(f))
+		ret = EXIT_FAILURE;
+	free(idx);
+err_free_ctx_bin:
+	free(ctx_bin);
+err_free_chns:
+	free(chns);
+err_destroy_buffer:
+	iio_buffer_destroy(buffer);
+err_free_mask:
+	iio_channels_mask_destroy(mask);
+err_free_ctx:
+	if (ctx)
+		iio_context_destroy(ctx);
+err_free_argw:
+	free_argw(argc, argw);
+	return ret;
+}
@@ -8,8 +8,10 @@
 
 #include <errno.h>
 #include <iio/iio.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 
 #include "iio_common.h"
@@ -21,7 +23,7 @@ static const struct option options[] = {
 };
 
 static const char *options_descriptions[] = {
-	"<device> <register> [<value>]\n"
+	"<device> <register>[:<count>] [<value>]\n"
 };
 
 static int write_reg(struct iio_device *dev, uint32_t addr, uint32_t val)
@@ -60,10 +62,48 @@ err_destroy_context:
 	return EXIT_FAILURE;
 }
 
+static int read_regs(struct iio_device *dev, unsigned long addr,
+		     unsigned long count)
+{
+	uint32_t *addrs, *values;
+	unsigned long i;
+	int ret = EXIT_FAILURE;
+
+	addrs = calloc(count, sizeof(*addrs));
+	values = calloc(count, sizeof(*values));
+	if (!addrs || !values) {
+		fprintf(stderr, "Unable to allocate memory\n");
+		goto out_free;
+	}
+
+	for (i = 0; i < count; i++)
+		addrs[i] = (uint32_t) (addr + i);
+
+	/* One protocol command for the whole range, where supported */
+	ret = iio_device_reg_read_multi(dev, addrs, values, count);
+	if (ret < 0) {
+		errno = -ret;
+		perror("Unable to read registers");
+		ret = EXIT_FAILURE;
+		goto out_free;
+	}
+
+	for (i = 0; i < count; i++)
+		printf("0x%" PRIx32 ": 0x%x\n", addrs[i], values[i]);
+
+	ret = EXIT_SUCCESS;
+
+out_free:
+	free(values);
+	free(addrs);
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	char **argw;
-	unsigned long addr;
+	unsigned long addr, count;
+	char *count_str;
 	struct iio_context *ctx;
 	struct iio_device *dev;
 	int c, ret = EXIT_FAILURE;
@@ -116,9 +156,20 @@ int main(int argc, char **argv)
 		goto err_destroy_context;
 	}
 
+	/* "<register>:<count>" reads a contiguous range in one batch */
+	count_str = strchr(argw[optind + 1], ':');
+	if (count_str)
+		*count_str++ = '\0';
+
 	addr = sanitize_clamp("register address", argw[optind + 1], 0, UINT32_MAX);
 
 	if ((argc - optind) == 2) {
+		if (count_str) {
+			count = sanitize_clamp("register count", count_str,
+					       1, 0xffff);
+			return read_regs(dev, addr, count);
+		}
+
 		return read_reg(dev, addr);
 	} else {
 		uint32_t val = sanitize_clamp("register value", argw[optind + 2], 0, UINT32_MAX);
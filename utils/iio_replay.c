@@ -0,0 +1,484 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_replay - Part of the Industrial I/O (IIO) utilities
+ *
+ * Plays a capture recorded by iio_record back through a TX buffer at
+ * line rate: blocks are enqueued as fast as the hardware dequeues them,
+ * so the replay paces itself on the device. The sparse index lets the
+ * playback start from an arbitrary time offset without scanning the
+ * file, and the recorded data formats are checked against the target
+ * device before anything is sent.
+ * */
+
+#include <errno.h>
+#include <getopt.h>
+#include <iio/iio.h>
+#include <iio/iio-debug.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iio_capture.h"
+#include "iio_common.h"
+
+#define MY_NAME "iio_replay"
+
+#define BLOCKS_IN_FLIGHT 4
+
+static const struct option options[] = {
+	  {"seek", required_argument, 0, 's'},
+	  {"loop", no_argument, 0, 'l'},
+	  {0, 0, 0, 0},
+};
+
+static const char *options_descriptions[] = {
+	"[-s <seconds>] [-l] <file> [<iio_device>]",
+	"Start the playback that many seconds into the recording,\n"
+		"\t\t\tseeking through the index.",
+	"Loop the playback until interrupted.",
+};
+
+static struct iio_context *ctx;
+static struct iio_buffer *buffer;
+
+static volatile sig_atomic_t app_running = true;
+
+static void quit_all(int sig)
+{
+	app_running = false;
+	if (buffer)
+		iio_buffer_cancel(buffer);
+}
+
+#ifdef _WIN32
+
+BOOL WINAPI sig_handler_fn(DWORD dwCtrlType)
+{
+	/* Runs in its own thread */
+
+	switch (dwCtrlType) {
+	case CTRL_C_EVENT:
+	case CTRL_CLOSE_EVENT:
+		quit_all(SIGTERM);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void setup_sig_handler(void)
+{
+	SetConsoleCtrlHandler(sig_handler_fn, TRUE);
+}
+
+#elif NO_THREADS
+
+static void sig_handler(int sig)
+{
+	if (!app_running)
+		exit(sig);
+	app_running = false;
+}
+
+static void set_handler(int sig)
+{
+	struct sigaction action;
+
+	sigaction(sig, NULL, &action);
+	action.sa_handler = sig_handler;
+	sigaction(sig, &action, NULL);
+}
+
+static void setup_sig_handler(void)
+{
+	set_handler(SIGHUP);
+	set_handler(SIGPIPE);
+	set_handler(SIGINT);
+	set_handler(SIGSEGV);
+	set_handler(SIGTERM);
+}
+
+#else
+
+#include <pthread.h>
+
+static void * sig_handler_thd(void *data)
+{
+	sigset_t *mask = data;
+	int ret, sig;
+
+	/* Blocks until one of the termination signals is received */
+	do {
+		ret = sigwait(mask, &sig);
+	} while (ret == EINTR);
+
+	quit_all(ret);
+
+	return NULL;
+}
+
+static void setup_sig_handler(void)
+{
+	sigset_t mask, oldmask;
+	pthread_t thd;
+	int ret;
+
+	/*
+	 * Async signals are difficult to handle and the IIO API is not signal
+	 * safe. Use a separate thread and handle the signals synchronous so we
+	 * can call iio_buffer_cancel().
+	 */
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGSEGV);
+	sigaddset(&mask, SIGTERM);
+
+	pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+	ret = pthread_create(&thd, NULL, sig_handler_thd, &mask);
+	if (ret) {
+		fprintf(stderr, "Failed to create signal handler thread: %d\n", ret);
+		pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	}
+}
+
+#endif
+
+static bool chn_format_matches(const struct iio_capture_chn *entry,
+			       const struct iio_channel *ch)
+{
+	const struct iio_data_format *fmt = iio_channel_get_data_format(ch);
+
+	return entry->length == fmt->length && entry->bits == fmt->bits
+		&& entry->shift == fmt->shift && entry->repeat == fmt->repeat
+		&& entry->is_signed == fmt->is_signed
+		&& entry->is_be == fmt->is_be;
+}
+
+/* Seek through the sparse index to the last block that starts at or
+ * before "seek_s" seconds into the recording. Returns the number of
+ * blocks skipped, or a negative value on error. */
+static int64_t seek_to_time(FILE *f, const struct iio_capture_hdr *hdr,
+			    uint64_t seek_s)
+{
+	struct iio_capture_idx *idx;
+	uint64_t target_us;
+	size_t i, nb_idx;
+
+	if (!hdr->index_offset || !hdr->nb_blocks) {
+		fprintf(stderr, "Recording has no index, cannot seek\n");
+		return -1;
+	}
+
+	nb_idx = (hdr->nb_blocks - 1) / hdr->index_stride + 1;
+
+	idx = xmalloc(nb_idx * sizeof(*idx), MY_NAME);
+
+	if (fseek(f, (long) hdr->index_offset, SEEK_SET) < 0 ||
+	    fread(idx, sizeof(*idx), nb_idx, f) != nb_idx) {
+		fprintf(stderr, "Unable to read index\n");
+		free(idx);
+		return -1;
+	}
+
+	target_us = idx[0].timestamp_us + seek_s * 1000000u;
+
+	for (i = nb_idx - 1; i > 0; i--) {
+		if (idx[i].timestamp_us <= target_us)
+			break;
+	}
+
+	if (fseek(f, (long) idx[i].offset, SEEK_SET) < 0) {
+		fprintf(stderr, "Unable to seek to block\n");
+		free(idx);
+		return -1;
+	}
+
+	free(idx);
+
+	return (int64_t) (i * hdr->index_stride);
+}
+
+#define MY_OPTS "s:l"
+
+int main(int argc, char **argv)
+{
+	char **argw;
+	unsigned int i, nb_channels;
+	uint64_t seek_s = 0, done, skipped = 0, replayed = 0;
+	struct iio_capture_hdr hdr;
+	struct iio_capture_chn *chns;
+	struct iio_capture_block rec;
+	struct iio_device *dev;
+	struct iio_channel *ch;
+	struct iio_channels_mask *mask;
+	struct iio_block *blocks[BLOCKS_IN_FLIGHT] = { NULL };
+	unsigned int nb_queued, nb_inflight;
+	ssize_t sample_size;
+	const char *path, *dev_id;
+	bool loop = false, enabled;
+	size_t pad;
+	int64_t first_block;
+	struct option *opts;
+	FILE *f = NULL;
+	int c, err, ret = EXIT_FAILURE;
+
+	argw = dup_argv(MY_NAME, argc, argv);
+
+	setup_sig_handler();
+
+	ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
+				 options, options_descriptions, &ret);
+	opts = add_common_options(options);
+	if (!opts) {
+		fprintf(stderr, "Failed to add common options\n");
+		goto err_free_ctx;
+	}
+
+	while ((c = getopt_long(argc, argw, "+" COMMON_OPTIONS MY_OPTS,	/* Flawfinder: ignore */
+					opts, NULL)) != -1) {
+		switch (c) {
+		/* All these are handled in the common */
+		case 'h':
+		case 'V':
+		case 'u':
+		case 'T':
+			break;
+		case 'S':
+		case 'a':
+			if (!optarg && argc > optind && argv[optind] != NULL
+					&& argv[optind][0] != '-')
+				optind++;
+			break;
+		case 's':
+			seek_s = sanitize_clamp("seek offset", optarg,
+						0, UINT32_MAX);
+			break;
+		case 'l':
+			loop = true;
+			break;
+		case '?':
+			printf("Unknown argument '%c'\n", c);
+			goto err_free_ctx;
+		}
+	}
+	free(opts);
+
+	if (!ctx)
+		goto err_free_argw;
+
+	if (!argw[optind]) {
+		fprintf(stderr, "Too few arguments.\n\n");
+		usage(MY_NAME, options, options_descriptions);
+		goto err_free_ctx;
+	}
+
+	path = argw[optind];
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror("Unable to open input file");
+		goto err_free_ctx;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, IIO_CAPTURE_MAGIC, sizeof(hdr.magic))) {
+		fprintf(stderr, "%s is not a capture recorded by iio_record\n",
+			path);
+		goto err_close_file;
+	}
+
+	chns = xmalloc(hdr.nb_channels * sizeof(*chns), MY_NAME);
+
+	/* The channel entries follow the context snapshot */
+	if (fseek(f, (long) (sizeof(hdr) + hdr.ctx_size), SEEK_SET) < 0 ||
+	    fread(chns, sizeof(*chns), hdr.nb_channels, f) != hdr.nb_channels) {
+		fprintf(stderr, "Unable to read channel entries\n");
+		goto err_free_chns;
+	}
+
+	dev_id = argw[optind + 1] ? argw[optind + 1] : hdr.dev_id;
+
+	dev = iio_context_find_device(ctx, dev_id);
+	if (!dev) {
+		fprintf(stderr, "Device %s not found\n", dev_id);
+		goto err_free_chns;
+	}
+
+	nb_channels = iio_device_get_channels_count(dev);
+	mask = iio_create_channels_mask(nb_channels);
+	if (!mask) {
+		fprintf(stderr, "Unable to create channels mask\n");
+		goto err_free_chns;
+	}
+
+	/* Enable the recorded channels, in the TX direction */
+	for (i = 0; i < hdr.nb_channels; i++) {
+		ch = iio_device_find_channel(dev, chns[i].id, true);
+		if (!ch) {
+			fprintf(stderr, "Channel %s not found\n", chns[i].id);
+			goto err_free_mask;
+		}
+
+		if (!chn_format_matches(&chns[i], ch)) {
+			fprintf(stderr, "Data format of channel %s does not match the recording\n",
+				chns[i].id);
+			goto err_free_mask;
+		}
+
+		iio_channel_enable(ch, mask);
+	}
+
+	buffer = iio_device_create_buffer(dev, 0, mask);
+	err = iio_err(buffer);
+	if (err) {
+		buffer = NULL;
+		dev_perror(dev, err, "Unable to allocate buffer");
+		goto err_free_mask;
+	}
+
+	/* The samples are replayed as recorded: the hardware must end up
+	 * with the very same set of channels enabled. */
+	sample_size = iio_device_get_sample_size(dev,
+					iio_buffer_get_channels_mask(buffer));
+	if (sample_size != (ssize_t) hdr.sample_size) {
+		fprintf(stderr, "Sample size of %s does not match the recording\n",
+			dev_id);
+		goto err_destroy_buffer;
+	}
+
+	for (i = 0; i < BLOCKS_IN_FLIGHT; i++) {
+		blocks[i] = iio_buffer_create_block(buffer, hdr.block_size);
+		err = iio_err(blocks[i]);
+		if (err) {
+			blocks[i] = NULL;
+			dev_perror(dev, err, "Unable to create block");
+			goto err_free_blocks;
+		}
+	}
+
+	do {
+		if (seek_s) {
+			first_block = seek_to_time(f, &hdr, seek_s);
+			if (first_block < 0)
+				goto err_free_blocks;
+			skipped = (uint64_t) first_block;
+		} else if (fseek(f, (long) hdr.data_offset, SEEK_SET) < 0) {
+			perror("Unable to seek to data");
+			goto err_free_blocks;
+		}
+
+		enabled = false;
+		nb_queued = 0;
+
+		for (done = skipped; app_running && done < hdr.nb_blocks;
+		     done++) {
+			i = nb_queued % BLOCKS_IN_FLIGHT;
+
+			if (nb_queued >= BLOCKS_IN_FLIGHT) {
+				err = iio_block_dequeue(blocks[i], false);
+				if (err) {
+					if (app_running)
+						dev_perror(dev, err, "Unable to dequeue block");
+					goto out_disable;
+				}
+			}
+
+			if (fread(&rec, sizeof(rec), 1, f) != 1 ||
+			    rec.bytes_used > hdr.block_size) {
+				fprintf(stderr, "Corrupt block record\n");
+				goto out_disable;
+			}
+
+			if (fread(iio_block_start(blocks[i]), 1,
+				  rec.bytes_used, f) != rec.bytes_used) {
+				fprintf(stderr, "Truncated block payload\n");
+				goto out_disable;
+			}
+
+			pad = (IIO_CAPTURE_ALIGN
+			       - rec.bytes_used % IIO_CAPTURE_ALIGN)
+				% IIO_CAPTURE_ALIGN;
+			if (pad && fseek(f, (long) pad, SEEK_CUR) < 0) {
+				perror("Unable to skip padding");
+				goto out_disable;
+			}
+
+			err = iio_block_enqueue(blocks[i], rec.bytes_used,
+						false);
+			if (err) {
+				dev_perror(dev, err, "Unable to enqueue block");
+				goto out_disable;
+			}
+
+			nb_queued++;
+			replayed++;
+
+			if (!enabled && nb_queued == BLOCKS_IN_FLIGHT) {
+				err = iio_buffer_enable(buffer);
+				if (err) {
+					dev_perror(dev, err, "Unable to enable buffer");
+					goto err_free_blocks;
+				}
+				enabled = true;
+			}
+		}
+
+		/* Short recording: enable once everything is queued */
+		if (!enabled && nb_queued) {
+			err = iio_buffer_enable(buffer);
+			if (err) {
+				dev_perror(dev, err, "Unable to enable buffer");
+				goto err_free_blocks;
+			}
+			enabled = true;
+		}
+
+		/* Drain the blocks still in flight, oldest first */
+		nb_inflight = nb_queued < BLOCKS_IN_FLIGHT
+			? nb_queued : BLOCKS_IN_FLIGHT;
+		for (i = 0; app_running && i < nb_inflight; i++) {
+			err = iio_block_dequeue(blocks[(nb_queued - nb_inflight
+							+ i) % BLOCKS_IN_FLIGHT],
+						false);
+			if (err && app_running) {
+				dev_perror(dev, err, "Unable to dequeue block");
+				break;
+			}
+		}
+
+out_disable:
+		if (enabled)
+			iio_buffer_disable(buffer);
+	} while (loop && app_running);
+
+	if (replayed) {
+		fprintf(stderr, "%" PRIu64 " blocks replayed\n", replayed);
+		ret = EXIT_SUCCESS;
+	}
+
+err_free_blocks:
+	for (i = 0; i < BLOCKS_IN_FLIGHT; i++) {
+		if (blocks[i])
+			iio_block_destroy(blocks[i]);
+	}
+err_destroy_buffer:
+	iio_buffer_destroy(buffer);
+err_free_mask:
+	iio_channels_mask_destroy(mask);
+err_free_chns:
+	free(chns);
+err_close_file:
+	fclose(f);
+err_free_ctx:
+	if (ctx)
+		iio_context_destroy(ctx);
+err_free_argw:
+	free_argw(argc, argw);
+	return ret;
+}
@@ -6,6 +6,10 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  * */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for O_DIRECT */
+#endif
+
 #include <errno.h>
 #include <getopt.h>
 #include <iio/iio.h>
@@ -13,6 +17,7 @@
 #include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -24,6 +29,7 @@
 #include <unistd.h>
 #endif
 
+#include "gen_code.h"
 #include "iio_common.h"
 
 #define MY_NAME "iio_rwdev"
@@ -40,6 +46,8 @@ static const struct option options[] = {
 	  {"write", no_argument, 0, 'w'},
 	  {"cyclic", no_argument, 0, 'c'},
 	  {"benchmark", no_argument, 0, 'B'},
+	  {"output", required_argument, 0, 'o'},
+	  {"gen-pipeline", required_argument, 0, 'g'},
 	  {0, 0, 0, 0},
 };
 
@@ -54,6 +62,14 @@ static const char *options_descriptions[] = {
 	"Use cyclic buffer mode.",
 	"Benchmark throughput."
 		"\n\t\t\tStatistics will be printed on the standard input.",
+	"Record captured samples to the given file through a dedicated\n"
+		"\t\t\twriter thread, using O_DIRECT and preallocation. Blocks\n"
+		"\t\t\tare dropped (and counted) instead of stalling the\n"
+		"\t\t\tcapture when the disk cannot keep up.",
+	"Generate C source for a capture pipeline specialized for the\n"
+		"\t\t\tgiven device, channels and buffer size, then exit.\n"
+		"\t\t\tSample size, layout and conversions are folded into\n"
+		"\t\t\tconstants, so the demux loops fully vectorize.",
 };
 
 static struct iio_context *ctx;
@@ -74,6 +90,8 @@ static void quit_all(int sig)
 
 #ifdef _WIN32
 
+#define HAS_WRITER_THREAD 0
+
 BOOL WINAPI sig_handler_fn(DWORD dwCtrlType)
 {
 	/* Runs in its own thread */
@@ -95,6 +113,8 @@ static void setup_sig_handler(void)
 
 #elif NO_THREADS
 
+#define HAS_WRITER_THREAD 0
+
 static void sig_handler(int sig)
 {
 	/*
@@ -126,8 +146,11 @@ static void setup_sig_handler(void)
 
 #else
 
+#include <fcntl.h>
 #include <pthread.h>
 
+#define HAS_WRITER_THREAD 1
+
 static void * sig_handler_thd(void *data)
 {
 	sigset_t *mask = data;
@@ -171,6 +194,227 @@ static void setup_sig_handler(void)
 	}
 }
 
+/*
+ * Decoupled capture/writer pipeline (--output): the capture loop copies
+ * each block into a big sector-aligned staging ring and immediately
+ * re-enqueues it, while a writer thread streams the ring to the output
+ * file in fixed-size O_DIRECT chunks. A disk hiccup thus never stalls
+ * the DMA pipeline: when the ring is full, the block is dropped and
+ * counted instead.
+ */
+
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
+#define WRITER_CHUNK_SIZE (4 * 1024 * 1024)
+#define WRITER_NB_CHUNKS 8
+#define WRITER_ALIGN 4096
+
+struct file_writer {
+	int fd;
+	bool direct;
+
+	uint8_t *ring;
+	size_t ring_size;
+
+	/* Byte offsets into the captured stream; "produced" is only
+	 * advanced by the capture loop, "consumed" by the writer thread.
+	 * Both protected by "lock". */
+	uint64_t produced, consumed;
+	bool stop, error;
+
+	uint64_t written_bytes, dropped_blocks, dropped_bytes;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thd;
+};
+
+static struct file_writer *writer;
+
+static void * file_writer_thd(void *d)
+{
+	struct file_writer *w = d;
+	size_t pos, avail, len, padded;
+	ssize_t nb;
+
+	pthread_mutex_lock(&w->lock);
+
+	for (;;) {
+		while (!w->stop &&
+		       w->produced - w->consumed < WRITER_CHUNK_SIZE)
+			pthread_cond_wait(&w->cond, &w->lock);
+
+		avail = (size_t) (w->produced - w->consumed);
+		if (!avail && w->stop)
+			break;
+
+		len = avail < WRITER_CHUNK_SIZE ? avail : WRITER_CHUNK_SIZE;
+		pos = (size_t) (w->consumed % w->ring_size);
+
+		pthread_mutex_unlock(&w->lock);
+
+		/* O_DIRECT writes must be a multiple of the sector size:
+		 * the final short chunk is padded with stale ring bytes,
+		 * and the file truncated to its real length afterwards. */
+		padded = w->direct
+			? (len + WRITER_ALIGN - 1) & ~(size_t)(WRITER_ALIGN - 1)
+			: len;
+
+		nb = write(w->fd, w->ring + pos, padded);
+
+		pthread_mutex_lock(&w->lock);
+
+		if (nb < (ssize_t) padded) {
+			if (nb < 0)
+				perror("Unable to write output file");
+			else
+				fprintf(stderr, "Short write on output file\n");
+			w->error = true;
+			break;
+		}
+
+		w->consumed += len;
+		w->written_bytes += len;
+	}
+
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static struct file_writer *
+file_writer_create(const char *path, uint64_t prealloc)
+{
+	struct file_writer *w;
+	int err;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+
+	w->ring_size = (size_t) WRITER_CHUNK_SIZE * WRITER_NB_CHUNKS;
+
+	err = posix_memalign((void **) &w->ring, WRITER_ALIGN, w->ring_size);
+	if (err)
+		goto err_free_w;
+
+	w->direct = O_DIRECT != 0;
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+	if (w->fd < 0 && O_DIRECT) {
+		/* Not all filesystems support O_DIRECT */
+		w->direct = false;
+		w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	}
+	if (w->fd < 0) {
+		perror("Unable to open output file");
+		goto err_free_ring;
+	}
+
+	/* Preallocate when the capture length is known, so that the writes
+	 * don't stall on block allocation. Best effort. */
+	if (prealloc && posix_fallocate(w->fd, 0, (off_t) prealloc))
+		fprintf(stderr, "Unable to preallocate output file\n");
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+
+	err = pthread_create(&w->thd, NULL, file_writer_thd, w);
+	if (err) {
+		fprintf(stderr, "Failed to create writer thread: %d\n", err);
+		goto err_close_fd;
+	}
+
+	return w;
+
+err_close_fd:
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	close(w->fd);
+err_free_ring:
+	free(w->ring);
+err_free_w:
+	free(w);
+	return NULL;
+}
+
+static bool file_writer_push(struct file_writer *w,
+			     const void *data, size_t len)
+{
+	size_t pos, space;
+
+	pthread_mutex_lock(&w->lock);
+
+	if (w->error) {
+		pthread_mutex_unlock(&w->lock);
+		return false;
+	}
+
+	space = w->ring_size - (size_t) (w->produced - w->consumed);
+	if (space < len) {
+		/* Never stall the DMA pipeline on the disk */
+		w->dropped_blocks++;
+		w->dropped_bytes += len;
+		pthread_mutex_unlock(&w->lock);
+		return true;
+	}
+
+	pthread_mutex_unlock(&w->lock);
+
+	/* Safe outside the lock: only this thread advances "produced", and
+	 * the writer thread only ever makes more room. */
+	pos = (size_t) (w->produced % w->ring_size);
+	if (pos + len <= w->ring_size) {
+		memcpy(w->ring + pos, data, len);
+	} else {
+		memcpy(w->ring + pos, data, w->ring_size - pos);
+		memcpy(w->ring, (const uint8_t *) data + (w->ring_size - pos),
+		       len - (w->ring_size - pos));
+	}
+
+	pthread_mutex_lock(&w->lock);
+	w->produced += len;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	return true;
+}
+
+static int file_writer_finish(struct file_writer *w)
+{
+	int ret;
+
+	pthread_mutex_lock(&w->lock);
+	w->stop = true;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thd, NULL);
+
+	ret = w->error ? -1 : 0;
+	if (!ret && w->direct && ftruncate(w->fd, (off_t) w->written_bytes)) {
+		perror("Unable to truncate output file");
+		ret = -1;
+	}
+
+	close(w->fd);
+
+	fprintf(stderr, "\n%" PRIu64 " bytes written", w->written_bytes);
+	if (w->dropped_blocks) {
+		fprintf(stderr, ", %" PRIu64 " blocks (%" PRIu64 " bytes) dropped",
+			w->dropped_blocks, w->dropped_bytes);
+	}
+	fprintf(stderr, "\n");
+
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w->ring);
+	free(w);
+
+	return ret;
+}
+
 #endif
 
 static ssize_t transfer_sample(const struct iio_channel *chn,
@@ -179,6 +423,13 @@ static ssize_t transfer_sample(const struct iio_channel *chn,
 	bool *is_write = d;
 	size_t nb;
 
+#if HAS_WRITER_THREAD
+	if (writer && !*is_write) {
+		if (!file_writer_push(writer, buf, len))
+			return -1;
+		nb = len;
+	} else
+#endif
 	if (*is_write)
 		nb = fread(buf, 1, len, stdin);
 	else
@@ -194,7 +445,7 @@ static ssize_t transfer_sample(const struct iio_channel *chn,
 	return (ssize_t) nb;
 }
 
-#define MY_OPTS "t:b:s:T:wcB"
+#define MY_OPTS "t:b:s:T:wcBo:g:"
 
 int main(int argc, char **argv)
 {
@@ -213,6 +464,8 @@ int main(int argc, char **argv)
 	struct iio_channels_mask *mask;
 	const struct iio_channels_mask *hw_mask;
 	struct option *opts;
+	const char *output_path = NULL;
+	const char *gen_file = NULL;
 	uint64_t before = 0, after, rate, total;
 	size_t rw_len, len, nb;
 	void *start;
@@ -275,6 +528,25 @@ int main(int argc, char **argv)
 		case 'w':
 			is_write = true;
 			break;
+		case 'o':
+			if (!optarg) {
+				fprintf(stderr, "Output file requires an argument\n");
+				goto err_free_ctx;
+			}
+#if HAS_WRITER_THREAD
+			output_path = optarg;
+			break;
+#else
+			fprintf(stderr, "Output file is not supported on this platform\n");
+			goto err_free_ctx;
+#endif
+		case 'g':
+			if (!optarg) {
+				fprintf(stderr, "Generated file requires an argument\n");
+				goto err_free_ctx;
+			}
+			gen_file = optarg;
+			break;
 		case '?':
 			printf("Unknown argument '%c'\n", c);
 			goto err_free_ctx;
@@ -301,6 +573,21 @@ int main(int argc, char **argv)
 		goto err_free_ctx;
 	}
 
+	if (output_path && is_write) {
+		fprintf(stderr, "Output file can only be used when capturing.\n");
+		goto err_free_ctx;
+	}
+
+	if (output_path && benchmark) {
+		fprintf(stderr, "Cannot benchmark with an output file.\n");
+		goto err_free_ctx;
+	}
+
+	if (gen_file && is_write) {
+		fprintf(stderr, "Pipeline generation only supports capture.\n");
+		goto err_free_ctx;
+	}
+
 	if (!ctx)
 		return ret;
 
@@ -412,6 +699,18 @@ int main(int argc, char **argv)
 		goto err_free_mask;
 	}
 
+	if (gen_file) {
+		ret = gen_pipeline(gen_file, dev, mask, 4, buffer_size);
+		if (ret) {
+			dev_perror(dev, ret, "Unable to generate pipeline");
+			goto err_free_mask;
+		}
+
+		printf("Pipeline written to %s\n", gen_file);
+		ret = EXIT_SUCCESS;
+		goto err_free_mask;
+	}
+
 	buffer = iio_device_create_buffer(dev, 0, mask);
 	ret = iio_err(buffer);
 	if (ret) {
@@ -429,6 +728,16 @@ int main(int argc, char **argv)
 		goto err_destroy_buffer;
 	}
 
+#if HAS_WRITER_THREAD
+	if (output_path) {
+		writer = file_writer_create(output_path,
+					    num_samples ?
+					    (uint64_t) num_samples * sample_size : 0);
+		if (!writer)
+			goto err_destroy_stream;
+	}
+#endif
+
 #ifdef _WIN32
 	/*
 	 * Deactivate the translation for the stdout. Otherwise, bytes that have
@@ -497,7 +806,17 @@ int main(int argc, char **argv)
 			if (num_samples && len > num_samples * sample_size)
 				len = num_samples * sample_size;
 
-			for (rw_len = len; len; ) {
+			rw_len = len;
+
+#if HAS_WRITER_THREAD
+			if (writer) {
+				if (!file_writer_push(writer, start, len))
+					goto err_destroy_stream;
+				len = 0;
+			}
+#endif
+
+			for (; len; ) {
 				if (is_write)
 					nb = fread(start, 1, len, stdin);
 				else
@@ -524,6 +843,13 @@ int main(int argc, char **argv)
 	}
 
 err_destroy_stream:
+#if HAS_WRITER_THREAD
+	if (writer) {
+		if (file_writer_finish(writer))
+			exit_code = EXIT_FAILURE;
+		writer = NULL;
+	}
+#endif
 	iio_stream_destroy(stream);
 err_destroy_buffer:
 	iio_buffer_destroy(buffer);
@@ -10,76 +10,84 @@
 
 #include <errno.h>
 #include <iio/iio-debug.h>
-#include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include <string.h>
 
+/*
+ * The context description is parsed with the streaming xmlreader API
+ * instead of building a full DOM: devices, channels and attributes are
+ * constructed in a single pass over the document, so the peak memory
+ * consumption stays around the size of the largest element instead of
+ * several times the size of the whole XML.
+ */
+
 #define XML_HEADER "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
 
 static struct iio_context *
 xml_create_context(const struct iio_context_params *params,
 		   const char *xml_file);
 
-static int add_attr_to_channel(struct iio_channel *chn, xmlNode *n)
+static int parse_channel_attr(struct iio_channel *chn, xmlTextReaderPtr reader)
 {
-	xmlAttr *attr;
-	char *name = NULL, *filename = NULL;
+	struct iio_str_pool *pool = chn->dev->ctx->str_pool;
+	const char *name = NULL, *filename = NULL;
 	struct iio_channel_attr *attrs;
-	int err = -ENOMEM;
+	int ret;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((char *) attr->name, "name")) {
-			name = iio_strdup((char *) attr->children->content);
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *aname = (const char *) xmlTextReaderConstName(reader);
+		const char *value = (const char *) xmlTextReaderConstValue(reader);
+
+		if (!strcmp(aname, "name")) {
+			name = iio_str_pool_get(pool, value);
 			if (!name)
-				goto err_free;
-		} else if (!strcmp((char *) attr->name, "filename")) {
-			filename = iio_strdup((char *) attr->children->content);
+				return -ENOMEM;
+		} else if (!strcmp(aname, "filename")) {
+			filename = iio_str_pool_get(pool, value);
 			if (!filename)
-				goto err_free;
+				return -ENOMEM;
 		} else {
 			chn_dbg(chn, "Unknown field \'%s\' in channel %s\n",
-				attr->name, chn->id);
+				aname, chn->id);
 		}
 	}
 
 	if (!name) {
 		chn_err(chn, "Incomplete attribute in channel %s\n", chn->id);
-		err = -EINVAL;
-		goto err_free;
+		return -EINVAL;
 	}
 
-	if (!filename) {
-		filename = iio_strdup(name);
-		if (!filename)
-			goto err_free;
-	}
+	if (!filename)
+		filename = name;
 
 	attrs = realloc(chn->attrs, (1 + chn->nb_attrs) *
 			sizeof(struct iio_channel_attr));
 	if (!attrs)
-		goto err_free;
+		return -ENOMEM;
 
 	attrs[chn->nb_attrs].filename = filename;
 	attrs[chn->nb_attrs++].name = name;
 	chn->attrs = attrs;
 	return 0;
-
-err_free:
-	free(name);
-	free(filename);
-	return err;
 }
 
-static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_type type)
+static int parse_device_attr(struct iio_device *dev, xmlTextReaderPtr reader,
+			     enum iio_attr_type type)
 {
-	xmlAttr *attr;
-	char *name = NULL;
+	const char *name = NULL;
+	int ret;
+
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *aname = (const char *) xmlTextReaderConstName(reader);
+		const char *value = (const char *) xmlTextReaderConstValue(reader);
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((char *) attr->name, "name")) {
-			name = (char *) attr->children->content;
+		if (!strcmp(aname, "name")) {
+			name = value;
 		} else {
 			dev_dbg(dev, "Unknown field \'%s\' in device %s\n",
-				attr->name, dev->id);
+				aname, dev->id);
 		}
 	}
 
@@ -100,14 +108,15 @@ static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_
 	}
 }
 
-static int setup_scan_element(struct iio_channel *chn, xmlNode *n)
+static int parse_scan_element(struct iio_channel *chn, xmlTextReaderPtr reader)
 {
-	xmlAttr *attr;
-	int err;
+	int ret, err;
+
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *name = (const char *) xmlTextReaderConstName(reader);
+		const char *content = (const char *) xmlTextReaderConstValue(reader);
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		const char *name = (const char *) attr->name,
-		      *content = (const char *) attr->children->content;
 		if (!strcmp(name, "index")) {
 			char *end;
 			long long value;
@@ -174,11 +183,11 @@ static int setup_scan_element(struct iio_channel *chn, xmlNode *n)
 	return 0;
 }
 
-static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
+static struct iio_channel * create_channel(struct iio_device *dev,
+					   xmlTextReaderPtr reader)
 {
-	xmlAttr *attr;
 	struct iio_channel *chn;
-	int err = -ENOMEM;
+	int ret, err = -ENOMEM;
 
 	chn = zalloc(sizeof(*chn));
 	if (!chn)
@@ -189,9 +198,11 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 	/* Set the default index value < 0 (== no index) */
 	chn->index = -ENOENT;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		const char *name = (const char *) attr->name,
-		      *content = (const char *) attr->children->content;
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *name = (const char *) xmlTextReaderConstName(reader);
+		const char *content = (const char *) xmlTextReaderConstValue(reader);
+
 		if (!strcmp(name, "name")) {
 			chn->name = iio_strdup(content);
 			if (!chn->name)
@@ -217,25 +228,6 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 		goto err_free_channel;
 	}
 
-	for (n = n->children; n; n = n->next) {
-		if (!strcmp((char *) n->name, "attribute")) {
-			err = add_attr_to_channel(chn, n);
-			if (err < 0)
-				goto err_free_channel;
-		} else if (!strcmp((char *) n->name, "scan-element")) {
-			chn->is_scan_element = true;
-			err = setup_scan_element(chn, n);
-			if (err < 0)
-				goto err_free_channel;
-		} else if (strcmp((char *) n->name, "text")) {
-			dev_dbg(dev, "Unknown children \'%s\' in <channel>\n",
-				n->name);
-			continue;
-		}
-	}
-
-	iio_channel_init_finalize(chn);
-
 	return chn;
 
 err_free_channel:
@@ -243,11 +235,11 @@ err_free_channel:
 	return iio_ptr(err);
 }
 
-static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
+static struct iio_device * create_device(struct iio_context *ctx,
+					 xmlTextReaderPtr reader)
 {
-	xmlAttr *attr;
 	struct iio_device *dev;
-	int err = -ENOMEM;
+	int ret, err = -ENOMEM;
 
 	dev = zalloc(sizeof(*dev));
 	if (!dev)
@@ -255,23 +247,26 @@ static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
 
 	dev->ctx = ctx;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((char *) attr->name, "name")) {
-			dev->name = iio_strdup(
-					(char *) attr->children->content);
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *name = (const char *) xmlTextReaderConstName(reader);
+		const char *content = (const char *) xmlTextReaderConstValue(reader);
+
+		if (!strcmp(name, "name")) {
+			dev->name = iio_strdup(content);
 			if (!dev->name)
 				goto err_free_device;
-		} else if (!strcmp((char *) attr->name, "label")) {
-			dev->label = iio_strdup((char *) attr->children->content);
+		} else if (!strcmp(name, "label")) {
+			dev->label = iio_strdup(content);
 			if (!dev->label)
 				goto err_free_device;
-		} else if (!strcmp((char *) attr->name, "id")) {
-			dev->id = iio_strdup((char *) attr->children->content);
+		} else if (!strcmp(name, "id")) {
+			dev->id = iio_strdup(content);
 			if (!dev->id)
 				goto err_free_device;
 		} else {
 			ctx_dbg(ctx, "Unknown attribute \'%s\' in <device>\n",
-				attr->name);
+				name);
 		}
 	}
 
@@ -281,46 +276,6 @@ static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
 		goto err_free_device;
 	}
 
-	for (n = n->children; n; n = n->next) {
-		if (!strcmp((char *) n->name, "channel")) {
-			struct iio_channel **chns,
-					   *chn = create_channel(dev, n);
-			err = iio_err(chn);
-			if (err) {
-				dev_perror(dev, err, "Unable to create channel");
-				goto err_free_device;
-			}
-
-			chns = realloc(dev->channels, (1 + dev->nb_channels) *
-					sizeof(struct iio_channel *));
-			if (!chns) {
-				err = -ENOMEM;
-				dev_err(dev, "Unable to allocate memory\n");
-				free(chn);
-				goto err_free_device;
-			}
-
-			chns[dev->nb_channels++] = chn;
-			dev->channels = chns;
-		} else if (!strcmp((char *) n->name, "attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEVICE);
-			if (err < 0)
-				goto err_free_device;
-		} else if (!strcmp((char *) n->name, "debug-attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEBUG);
-			if (err < 0)
-				goto err_free_device;
-		} else if (!strcmp((char *) n->name, "buffer-attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_BUFFER);
-			if (err < 0)
-				goto err_free_device;
-		} else if (strcmp((char *) n->name, "text")) {
-			dev_dbg(dev, "Unknown children \'%s\' in <device>\n",
-				n->name);
-			continue;
-		}
-	}
-
 	return dev;
 
 err_free_device:
@@ -340,17 +295,19 @@ const struct iio_backend iio_xml_backend = {
 	.ops = &xml_ops,
 };
 
-static int parse_context_attr(struct iio_context *ctx, xmlNode *n)
+static int parse_context_attr(struct iio_context *ctx, xmlTextReaderPtr reader)
 {
-	xmlAttr *attr;
 	const char *name = NULL, *value = NULL;
+	int ret;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((const char *) attr->name, "name")) {
-			name = (const char *) attr->children->content;
-		} else if (!strcmp((const char *) attr->name, "value")) {
-			value = (const char *) attr->children->content;
-		}
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *aname = (const char *) xmlTextReaderConstName(reader);
+
+		if (!strcmp(aname, "name"))
+			name = (const char *) xmlTextReaderConstValue(reader);
+		else if (!strcmp(aname, "value"))
+			value = (const char *) xmlTextReaderConstValue(reader);
 	}
 
 	if (!name || !value)
@@ -359,80 +316,36 @@ static int parse_context_attr(struct iio_context *ctx, xmlNode *n)
 		return iio_context_add_attr(ctx, name, value);
 }
 
-static int iio_populate_xml_context_helper(struct iio_context *ctx, xmlNode *root)
-{
-	xmlNode *n;
-	int err;
-
-	for (n = root->children; n; n = n->next) {
-		struct iio_device *dev;
-
-		if (!strcmp((char *) n->name, "context-attribute")) {
-			err = parse_context_attr(ctx, n);
-			if (err)
-				return err;
-
-			continue;
-		} else if (strcmp((char *) n->name, "device")) {
-			if (strcmp((char *) n->name, "text"))
-				ctx_dbg(ctx, "Unknown children \'%s\' in "
-					"<context>\n", n->name);
-			continue;
-		}
-
-		dev = create_device(ctx, n);
-		err = iio_err(dev);
-		if (err) {
-			ctx_perror(ctx, err, "Unable to create device");
-			return err;
-		}
-
-		err = iio_context_add_device(ctx, dev);
-		if (err) {
-			free(dev);
-			return err;
-		}
-	}
-
-	return iio_context_init(ctx);
-}
-
 static struct iio_context *
-iio_create_xml_context_helper(const struct iio_context_params *params,
-			      xmlDoc *doc)
+create_context_root(const struct iio_context_params *params,
+		    xmlTextReaderPtr reader)
 {
-	const char *description = NULL, *git_tag = NULL, *content;
+	const char *description = NULL, *git_tag = NULL;
 	struct iio_context *ctx;
 	long major = 0, minor = 0;
-	xmlNode *root;
-	xmlAttr *attr;
 	char *end;
-	int err;
+	int ret, err;
 
-	root = xmlDocGetRootElement(doc);
-	if (strcmp((char *) root->name, "context")) {
-		prm_err(params, "Unrecognized XML file\n");
-		return iio_ptr(-EINVAL);
-	}
+	for (ret = xmlTextReaderMoveToFirstAttribute(reader); ret == 1;
+	     ret = xmlTextReaderMoveToNextAttribute(reader)) {
+		const char *name = (const char *) xmlTextReaderConstName(reader);
+		const char *content = (const char *) xmlTextReaderConstValue(reader);
 
-	for (attr = root->properties; attr; attr = attr->next) {
-		content = (const char *) attr->children->content;
-
-		if (!strcmp((char *) attr->name, "description")) {
+		if (!strcmp(name, "description")) {
 			description = content;
-		} else if (!strcmp((char *) attr->name, "version-major")) {
+		} else if (!strcmp(name, "version-major")) {
 			errno = 0;
 			major = strtol(content, &end, 10);
 			if (*end != '\0' ||  errno == ERANGE)
 				prm_warn(params, "invalid format for major version\n");
-		} else if (!strcmp((char *) attr->name, "version-minor")) {
+		} else if (!strcmp(name, "version-minor")) {
 			errno = 0;
 			minor = strtol(content, &end, 10);
 			if (*end != '\0' || errno == ERANGE)
 				prm_warn(params, "invalid format for minor version\n");
-		} else if (!strcmp((char *) attr->name, "version-git")) {
+		} else if (!strcmp(name, "version-git")) {
 			git_tag = content;
-		} else if (strcmp((char *) attr->name, "name")) {
+		} else if (strcmp(name, "name")) {
 			prm_dbg(params, "Unknown parameter \'%s\' in <context>\n",
 				content);
 		}
@@ -458,37 +371,168 @@ iio_create_xml_context_helper(const struct iio_context_params *params,
 		}
 	}
 
-	err = iio_populate_xml_context_helper(ctx, root);
-	if (err) {
-		iio_context_destroy(ctx);
-		return iio_ptr(err);
+	return ctx;
+}
+
+static struct iio_context *
+iio_create_xml_context_helper(const struct iio_context_params *params,
+			      xmlTextReaderPtr reader)
+{
+	struct iio_context *ctx = NULL;
+	struct iio_device *dev = NULL;
+	struct iio_channel *chn = NULL, **chns;
+	const char *name;
+	bool empty;
+	int ret, err;
+
+	while ((ret = xmlTextReaderRead(reader)) == 1) {
+		switch (xmlTextReaderNodeType(reader)) {
+		case XML_READER_TYPE_ELEMENT:
+			break;
+		case XML_READER_TYPE_END_ELEMENT:
+			name = (const char *) xmlTextReaderConstName(reader);
+
+			if (chn && !strcmp(name, "channel")) {
+				iio_channel_init_finalize(chn);
+				chn = NULL;
+			} else if (dev && !strcmp(name, "device")) {
+				dev = NULL;
+			}
+			continue;
+		default:
+			continue;
+		}
+
+		name = (const char *) xmlTextReaderConstName(reader);
+		empty = xmlTextReaderIsEmptyElement(reader);
+
+		if (!ctx) {
+			if (strcmp(name, "context")) {
+				prm_err(params, "Unrecognized XML file\n");
+				err = -EINVAL;
+				goto err_destroy_ctx;
+			}
+
+			ctx = create_context_root(params, reader);
+			err = iio_err(ctx);
+			if (err) {
+				ctx = NULL;
+				goto err_destroy_ctx;
+			}
+		} else if (!strcmp(name, "context-attribute")) {
+			err = parse_context_attr(ctx, reader);
+			if (err)
+				goto err_destroy_ctx;
+		} else if (!strcmp(name, "device")) {
+			dev = create_device(ctx, reader);
+			err = iio_err(dev);
+			if (err) {
+				dev = NULL;
+				ctx_perror(ctx, err, "Unable to create device");
+				goto err_destroy_ctx;
+			}
+
+			err = iio_context_add_device(ctx, dev);
+			if (err) {
+				free_device(dev);
+				goto err_destroy_ctx;
+			}
+
+			if (empty)
+				dev = NULL;
+		} else if (dev && !strcmp(name, "channel")) {
+			chn = create_channel(dev, reader);
+			err = iio_err(chn);
+			if (err) {
+				chn = NULL;
+				dev_perror(dev, err, "Unable to create channel");
+				goto err_destroy_ctx;
+			}
+
+			chns = realloc(dev->channels, (1 + dev->nb_channels) *
+					sizeof(struct iio_channel *));
+			if (!chns) {
+				err = -ENOMEM;
+				dev_err(dev, "Unable to allocate memory\n");
+				free_channel(chn);
+				goto err_destroy_ctx;
+			}
+
+			chns[dev->nb_channels++] = chn;
+			dev->channels = chns;
+
+			if (empty) {
+				iio_channel_init_finalize(chn);
+				chn = NULL;
+			}
+		} else if (chn && !strcmp(name, "attribute")) {
+			err = parse_channel_attr(chn, reader);
+			if (err < 0)
+				goto err_destroy_ctx;
+		} else if (chn && !strcmp(name, "scan-element")) {
+			chn->is_scan_element = true;
+
+			err = parse_scan_element(chn, reader);
+			if (err < 0)
+				goto err_destroy_ctx;
+		} else if (dev && !strcmp(name, "attribute")) {
+			err = parse_device_attr(dev, reader, IIO_ATTR_TYPE_DEVICE);
+			if (err < 0)
+				goto err_destroy_ctx;
+		} else if (dev && !strcmp(name, "debug-attribute")) {
+			err = parse_device_attr(dev, reader, IIO_ATTR_TYPE_DEBUG);
+			if (err < 0)
+				goto err_destroy_ctx;
+		} else if (dev && !strcmp(name, "buffer-attribute")) {
+			err = parse_device_attr(dev, reader, IIO_ATTR_TYPE_BUFFER);
+			if (err < 0)
+				goto err_destroy_ctx;
+		} else {
+			ctx_dbg(ctx, "Unknown children \'%s\' in <%s>\n",
+				name, chn ? "channel" : dev ? "device" : "context");
+		}
 	}
 
+	if (ret < 0 || !ctx) {
+		prm_err(params, "Unable to parse XML file\n");
+		err = -EINVAL;
+		goto err_destroy_ctx;
+	}
+
+	err = iio_context_init(ctx);
+	if (err)
+		goto err_destroy_ctx;
+
 	return ctx;
+
+err_destroy_ctx:
+	if (ctx)
+		iio_context_destroy(ctx);
+	return iio_ptr(err);
 }
 
 static struct iio_context *
 xml_create_context(const struct iio_context_params *params, const char *arg)
 {
 	struct iio_context *ctx;
-	xmlDoc *doc;
+	xmlTextReaderPtr reader;
 
 	LIBXML_TEST_VERSION;
 
 	if (!strncmp(arg, XML_HEADER, sizeof(XML_HEADER) - 1)) {
-		doc = xmlReadMemory(arg, (int) strlen(arg),
-				    NULL, NULL, XML_PARSE_DTDVALID);
+		reader = xmlReaderForMemory(arg, (int) strlen(arg),
+					    NULL, NULL, XML_PARSE_DTDVALID);
 	} else {
-		doc = xmlReadFile(arg, NULL, XML_PARSE_DTDVALID);
+		reader = xmlReaderForFile(arg, NULL, XML_PARSE_DTDVALID);
 	}
 
-	if (!doc) {
+	if (!reader) {
 		prm_err(params, "Unable to parse XML file\n");
 		return iio_ptr(-EINVAL);
 	}
 
-	ctx = iio_create_xml_context_helper(params, doc);
-	xmlFreeDoc(doc);
+	ctx = iio_create_xml_context_helper(params, reader);
+	xmlFreeTextReader(reader);
 	return ctx;
 }
 